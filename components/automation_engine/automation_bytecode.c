@@ -0,0 +1,810 @@
+#include "automation_bytecode.h"
+
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "event_bus.h"
+#include "automation_scheduler.h"
+
+#define BC_LOCAL_LOOP_SLOTS 16
+#define BC_WAIT_POLL_MS 50
+#define BC_EVENT_TOPIC_MAX sizeof(((event_bus_message_t *)0)->topic)
+#define BC_EVENT_PAYLOAD_MAX sizeof(((event_bus_message_t *)0)->payload)
+
+typedef struct {
+    const char *name;
+    event_bus_type_t type;
+} bc_event_map_t;
+
+static const bc_event_map_t s_event_map[] = {
+    {"card_ok", EVENT_CARD_OK},
+    {"card_bad", EVENT_CARD_BAD},
+    {"relay_cmd", EVENT_RELAY_CMD},
+    {"audio_play", EVENT_AUDIO_PLAY},
+    {"volume_set", EVENT_VOLUME_SET},
+    {"web_command", EVENT_WEB_COMMAND},
+    {"system_status", EVENT_SYSTEM_STATUS},
+    {"device_config_changed", EVENT_DEVICE_CONFIG_CHANGED},
+};
+
+typedef struct {
+    automation_program_t *programs;
+    size_t program_count;
+    size_t program_cap;
+    automation_insn_t *insns;
+    size_t insn_count;
+    size_t insn_cap;
+    automation_flag_req_t *reqs;
+    size_t req_count;
+    size_t req_cap;
+    automation_binding_t *bindings;
+    size_t binding_count;
+    size_t binding_cap;
+    char *strings;
+    size_t strings_len;
+    size_t strings_cap;
+    uint32_t *hash;
+    size_t hash_cap;
+    size_t hash_used;
+    bool failed;
+} bc_builder_t;
+
+static const char *TAG = "automation_bc";
+
+static void *bc_realloc(void *ptr, size_t size)
+{
+    void *next = heap_caps_realloc(ptr, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!next) {
+        next = heap_caps_realloc(ptr, size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    return next;
+}
+
+static bool bc_reserve(bc_builder_t *b, void **buf, size_t *cap, size_t need, size_t elem)
+{
+    if (b->failed) {
+        return false;
+    }
+    if (need <= *cap) {
+        return true;
+    }
+    size_t next_cap = *cap ? *cap * 2 : 16;
+    while (next_cap < need) {
+        next_cap *= 2;
+    }
+    void *next = bc_realloc(*buf, next_cap * elem);
+    if (!next) {
+        b->failed = true;
+        return false;
+    }
+    *buf = next;
+    *cap = next_cap;
+    return true;
+}
+
+static void *bc_shrink(void *ptr, size_t size)
+{
+    if (!ptr || size == 0) {
+        return ptr;
+    }
+    void *next = bc_realloc(ptr, size);
+    return next ? next : ptr;
+}
+
+static uint32_t bc_hash(const char *s)
+{
+    uint32_t h = 2166136261u;
+    while (*s) {
+        h ^= (uint8_t)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static bool bc_hash_insert(uint32_t *table, size_t cap, const char *pool, uint32_t ref)
+{
+    size_t mask = cap - 1;
+    size_t pos = bc_hash(pool + ref) & mask;
+    for (size_t probe = 0; probe < cap; ++probe) {
+        if (table[pos] == 0) {
+            table[pos] = ref;
+            return true;
+        }
+        pos = (pos + 1) & mask;
+    }
+    return false;
+}
+
+static bool bc_hash_grow(bc_builder_t *b)
+{
+    size_t next_cap = b->hash_cap ? b->hash_cap * 2 : 64;
+    uint32_t *next = heap_caps_calloc(next_cap, sizeof(uint32_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!next) {
+        next = heap_caps_calloc(next_cap, sizeof(uint32_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    if (!next) {
+        b->failed = true;
+        return false;
+    }
+    for (size_t i = 0; i < b->hash_cap; ++i) {
+        if (b->hash[i]) {
+            bc_hash_insert(next, next_cap, b->strings, b->hash[i]);
+        }
+    }
+    heap_caps_free(b->hash);
+    b->hash = next;
+    b->hash_cap = next_cap;
+    return true;
+}
+
+// Returns the pool offset of an interned copy of s; 0 is the shared empty string.
+static uint32_t bc_intern(bc_builder_t *b, const char *s)
+{
+    if (!s || !s[0] || b->failed) {
+        return 0;
+    }
+    if ((b->hash_used + 1) * 2 > b->hash_cap && !bc_hash_grow(b)) {
+        return 0;
+    }
+    size_t mask = b->hash_cap - 1;
+    size_t pos = bc_hash(s) & mask;
+    while (b->hash[pos]) {
+        if (strcmp(b->strings + b->hash[pos], s) == 0) {
+            return b->hash[pos];
+        }
+        pos = (pos + 1) & mask;
+    }
+    size_t len = strlen(s) + 1;
+    if (!bc_reserve(b, (void **)&b->strings, &b->strings_cap, b->strings_len + len, 1)) {
+        return 0;
+    }
+    uint32_t ref = (uint32_t)b->strings_len;
+    memcpy(b->strings + ref, s, len);
+    b->strings_len += len;
+    b->hash[pos] = ref;
+    b->hash_used++;
+    return ref;
+}
+
+// Case-folded FNV-1a over "device/scenario"; lookups by id are case-insensitive too.
+uint32_t automation_program_key(const char *device_id, const char *scenario_id)
+{
+    uint32_t h = 2166136261u;
+    const char *parts[2] = {device_id ? device_id : "", scenario_id ? scenario_id : ""};
+    for (size_t p = 0; p < 2; ++p) {
+        for (const char *c = parts[p]; *c; ++c) {
+            h ^= (uint8_t)tolower((unsigned char)*c);
+            h *= 16777619u;
+        }
+        h ^= '/';
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static uint8_t bc_priority_class(uint8_t priority)
+{
+    switch (priority) {
+    case DEVICE_SCENARIO_PRIORITY_LOW:
+        return AUTOMATION_PRIORITY_LOW;
+    case DEVICE_SCENARIO_PRIORITY_HIGH:
+        return AUTOMATION_PRIORITY_HIGH;
+    case DEVICE_SCENARIO_PRIORITY_CRITICAL:
+        return AUTOMATION_PRIORITY_CRITICAL;
+    case DEVICE_SCENARIO_PRIORITY_NORMAL:
+    default:
+        return AUTOMATION_PRIORITY_NORMAL;
+    }
+}
+
+static bool bc_is_dynamic(const char *s)
+{
+    return s && strstr(s, "{{") != NULL;
+}
+
+static automation_insn_t *bc_emit(bc_builder_t *b, automation_op_t op, uint16_t step)
+{
+    if (!bc_reserve(b, (void **)&b->insns, &b->insn_cap, b->insn_count + 1, sizeof(automation_insn_t))) {
+        return NULL;
+    }
+    automation_insn_t *insn = &b->insns[b->insn_count++];
+    memset(insn, 0, sizeof(*insn));
+    insn->op = (uint8_t)op;
+    insn->step = step;
+    return insn;
+}
+
+int automation_event_type_from_name(const char *name)
+{
+    if (!name || !name[0]) {
+        return EVENT_NONE;
+    }
+    for (size_t i = 0; i < sizeof(s_event_map) / sizeof(s_event_map[0]); ++i) {
+        if (strcasecmp(s_event_map[i].name, name) == 0) {
+            return s_event_map[i].type;
+        }
+    }
+    return EVENT_NONE;
+}
+
+static void bc_compile_step(bc_builder_t *b,
+                            const device_descriptor_t *device,
+                            const device_action_step_t *step,
+                            uint16_t idx,
+                            uint8_t total,
+                            uint16_t *loop_slots)
+{
+    if (step->delay_ms > 0) {
+        automation_insn_t *insn = bc_emit(b, AUTOMATION_OP_SLEEP, idx);
+        if (insn) {
+            insn->a = step->delay_ms;
+        }
+    }
+    automation_insn_t *insn = NULL;
+    switch (step->type) {
+    case DEVICE_ACTION_MQTT_PUBLISH:
+        if (!step->data.mqtt.topic[0]) {
+            break;
+        }
+        insn = bc_emit(b, AUTOMATION_OP_MQTT, idx);
+        if (insn) {
+            insn->a = bc_intern(b, step->data.mqtt.topic);
+            insn->b = bc_intern(b, step->data.mqtt.payload);
+            insn->flags |= bc_is_dynamic(step->data.mqtt.topic) ? AUTOMATION_INSN_A_DYNAMIC : 0;
+            insn->flags |= bc_is_dynamic(step->data.mqtt.payload) ? AUTOMATION_INSN_B_DYNAMIC : 0;
+        }
+        break;
+    case DEVICE_ACTION_AUDIO_PLAY:
+        if (!step->data.audio.track[0]) {
+            break;
+        }
+        insn = bc_emit(b, AUTOMATION_OP_AUDIO_PLAY, idx);
+        if (insn) {
+            insn->a = bc_intern(b, step->data.audio.track);
+            insn->flags |= bc_is_dynamic(step->data.audio.track) ? AUTOMATION_INSN_A_DYNAMIC : 0;
+        }
+        break;
+    case DEVICE_ACTION_AUDIO_STOP:
+        bc_emit(b, AUTOMATION_OP_AUDIO_STOP, idx);
+        break;
+    case DEVICE_ACTION_SET_FLAG:
+        insn = bc_emit(b, AUTOMATION_OP_SET_FLAG, idx);
+        if (insn) {
+            insn->a = bc_intern(b, step->data.flag.flag);
+            insn->flags |= step->data.flag.value ? AUTOMATION_INSN_VALUE : 0;
+        }
+        break;
+    case DEVICE_ACTION_WAIT_FLAGS: {
+        const device_wait_flags_t *wait = &step->data.wait_flags;
+        uint8_t count = wait->requirement_count;
+        if (count > DEVICE_MANAGER_MAX_FLAG_RULES) {
+            count = DEVICE_MANAGER_MAX_FLAG_RULES;
+        }
+        if (count == 0) {
+            break;
+        }
+        if (!bc_reserve(b, (void **)&b->reqs, &b->req_cap, b->req_count + count, sizeof(automation_flag_req_t))) {
+            break;
+        }
+        insn = bc_emit(b, AUTOMATION_OP_WAIT_FLAGS, idx);
+        if (!insn) {
+            break;
+        }
+        insn->a = (uint32_t)b->req_count;
+        insn->b = count;
+        insn->c = wait->timeout_ms;
+        insn->flags |= wait->mode == DEVICE_CONDITION_ANY ? AUTOMATION_INSN_MODE_ANY : 0;
+        for (uint8_t i = 0; i < count; ++i) {
+            automation_flag_req_t *req = &b->reqs[b->req_count++];
+            req->flag = bc_intern(b, wait->requirements[i].flag);
+            req->required_state = wait->requirements[i].required_state;
+        }
+        break;
+    }
+    case DEVICE_ACTION_LOOP:
+        if (step->data.loop.target_step >= total) {
+            break;
+        }
+        insn = bc_emit(b, AUTOMATION_OP_LOOP, idx);
+        if (insn) {
+            // a holds the target step until the program is finished; see bc_compile_scenario
+            insn->a = step->data.loop.target_step;
+            insn->b = step->data.loop.max_iterations;
+            insn->c = (*loop_slots)++;
+        }
+        break;
+    case DEVICE_ACTION_EVENT_BUS: {
+        int type = automation_event_type_from_name(step->data.event.event);
+        if (type == EVENT_NONE) {
+            ESP_LOGW(TAG, "%s: unknown event action '%s' dropped", device->display_name, step->data.event.event);
+            break;
+        }
+        insn = bc_emit(b, AUTOMATION_OP_EVENT, idx);
+        if (insn) {
+            insn->a = (uint32_t)type;
+            insn->b = bc_intern(b, step->data.event.topic);
+            insn->c = bc_intern(b, step->data.event.payload);
+            insn->flags |= bc_is_dynamic(step->data.event.topic) ? AUTOMATION_INSN_B_DYNAMIC : 0;
+            insn->flags |= bc_is_dynamic(step->data.event.payload) ? AUTOMATION_INSN_C_DYNAMIC : 0;
+        }
+        break;
+    }
+    case DEVICE_ACTION_JOIN:
+        insn = bc_emit(b, AUTOMATION_OP_JOIN, idx);
+        if (insn) {
+            insn->a = step->data.join.timeout_ms;
+        }
+        break;
+    case DEVICE_ACTION_PARALLEL:    // handled by bc_compile_parallel
+    case DEVICE_ACTION_DELAY:
+    case DEVICE_ACTION_NOP:
+    default:
+        break;
+    }
+}
+
+// Emits one FORK per branch, a JUMP over the bodies, then each branch body. Branches are
+// single steps; loops and nested groups are not allowed inside them.
+static uint8_t bc_compile_parallel(bc_builder_t *b,
+                                   const device_descriptor_t *device,
+                                   const device_scenario_t *scenario,
+                                   uint8_t idx,
+                                   uint8_t total,
+                                   uint32_t first_insn)
+{
+    const device_action_step_t *group = &scenario->steps[idx];
+    uint8_t count = group->data.parallel.count;
+    if (count > total - idx - 1) {
+        count = (uint8_t)(total - idx - 1);
+    }
+    if (group->delay_ms > 0) {
+        automation_insn_t *sleep = bc_emit(b, AUTOMATION_OP_SLEEP, idx);
+        if (sleep) {
+            sleep->a = group->delay_ms;
+        }
+    }
+    if (count == 0) {
+        return 0;
+    }
+    size_t forks = b->insn_count;
+    for (uint8_t i = 0; i < count; ++i) {
+        bc_emit(b, AUTOMATION_OP_FORK, idx);
+    }
+    size_t jump = b->insn_count;
+    bc_emit(b, AUTOMATION_OP_JUMP, idx);
+    for (uint8_t i = 0; i < count && !b->failed; ++i) {
+        uint8_t step_idx = (uint8_t)(idx + 1 + i);
+        const device_action_step_t *step = &scenario->steps[step_idx];
+        uint32_t start = (uint32_t)(b->insn_count - first_insn);
+        if (step->type == DEVICE_ACTION_LOOP || step->type == DEVICE_ACTION_PARALLEL ||
+            step->type == DEVICE_ACTION_JOIN) {
+            ESP_LOGW(TAG, "%s: step %u not allowed inside parallel group", device->display_name, step_idx);
+        } else {
+            uint16_t no_slots = 0;
+            bc_compile_step(b, device, step, step_idx, total, &no_slots);
+        }
+        if (!b->failed) {
+            b->insns[forks + i].a = start;
+            b->insns[forks + i].b = (uint32_t)(b->insn_count - first_insn);
+        }
+    }
+    if (!b->failed) {
+        b->insns[jump].a = (uint32_t)(b->insn_count - first_insn);
+    }
+    return count;
+}
+
+static void bc_compile_scenario(bc_builder_t *b,
+                                const device_descriptor_t *device,
+                                uint8_t device_index,
+                                const device_scenario_t *scenario)
+{
+    if (!bc_reserve(b, (void **)&b->programs, &b->program_cap, b->program_count + 1, sizeof(automation_program_t))) {
+        return;
+    }
+    automation_program_t prog = {
+        .device_id = bc_intern(b, device->id),
+        .device_name = bc_intern(b, device->display_name),
+        .scenario_id = bc_intern(b, scenario->id),
+        .scenario_name = bc_intern(b, scenario->name),
+        .first_insn = (uint32_t)b->insn_count,
+        .key = automation_program_key(device->id, scenario->id[0] ? scenario->id : scenario->name),
+        .priority = bc_priority_class(scenario->priority),
+        .concurrency = scenario->concurrency <= DEVICE_SCENARIO_CONCURRENCY_DROP
+                           ? scenario->concurrency
+                           : DEVICE_SCENARIO_CONCURRENCY_PARALLEL,
+        .device = device_index,
+    };
+    uint8_t total = scenario->steps ? scenario->step_count : 0;
+    // First instruction of every step, for resolving loop targets below.
+    uint32_t *step_pc = NULL;
+    if (total) {
+        step_pc = heap_caps_malloc(total * sizeof(uint32_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!step_pc) {
+            step_pc = heap_caps_malloc(total * sizeof(uint32_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        }
+        if (!step_pc) {
+            b->failed = true;
+            return;
+        }
+    }
+    for (uint8_t i = 0; i < total; ++i) {
+        step_pc[i] = (uint32_t)(b->insn_count - prog.first_insn);
+        if (scenario->steps[i].type == DEVICE_ACTION_PARALLEL) {
+            uint8_t branches = bc_compile_parallel(b, device, scenario, i, total, prog.first_insn);
+            // A loop back into the group restarts the whole group.
+            for (uint8_t j = 1; j <= branches; ++j) {
+                step_pc[i + j] = step_pc[i];
+            }
+            i += branches;
+            continue;
+        }
+        bc_compile_step(b, device, &scenario->steps[i], i, total, &prog.loop_slots);
+    }
+    if (b->failed) {
+        heap_caps_free(step_pc);
+        return;
+    }
+    size_t count = b->insn_count - prog.first_insn;
+    for (size_t pc = 0; pc < count; ++pc) {
+        automation_insn_t *insn = &b->insns[prog.first_insn + pc];
+        if (insn->op == AUTOMATION_OP_LOOP) {
+            insn->a = step_pc[insn->a];
+        }
+    }
+    heap_caps_free(step_pc);
+    prog.insn_count = (uint16_t)count;
+    prog.step_count = total;
+    b->programs[b->program_count++] = prog;
+}
+
+static void bc_bind_topics(bc_builder_t *b, const device_descriptor_t *device, size_t first_program)
+{
+    for (uint8_t t = 0; t < device->topic_count && t < DEVICE_MANAGER_MAX_TOPICS_PER_DEVICE; ++t) {
+        const device_topic_binding_t *binding = &device->topics[t];
+        int found = -1;
+        for (uint8_t s = 0; s < device->scenario_count && s < DEVICE_MANAGER_MAX_SCENARIOS_PER_DEVICE; ++s) {
+            const device_scenario_t *sc = &device->scenarios[s];
+            if (binding->name[0] &&
+                ((sc->id[0] && strcasecmp(sc->id, binding->name) == 0) ||
+                 (sc->name[0] && strcasecmp(sc->name, binding->name) == 0))) {
+                found = s;
+                break;
+            }
+        }
+        if (found < 0) {
+            ESP_LOGW(TAG, "device %s topic %s has no scenario %s", device->display_name, binding->topic, binding->name);
+            continue;
+        }
+        if (!binding->topic[0]) {
+            continue;
+        }
+        if (!bc_reserve(b, (void **)&b->bindings, &b->binding_cap, b->binding_count + 1, sizeof(automation_binding_t))) {
+            return;
+        }
+        automation_binding_t *entry = &b->bindings[b->binding_count++];
+        entry->topic = bc_intern(b, binding->topic);
+        entry->program = (uint16_t)(first_program + (size_t)found);
+        entry->limit = device->topic_limits[t];
+    }
+}
+
+static void bc_builder_free(bc_builder_t *b)
+{
+    heap_caps_free(b->programs);
+    heap_caps_free(b->insns);
+    heap_caps_free(b->reqs);
+    heap_caps_free(b->bindings);
+    heap_caps_free(b->strings);
+    heap_caps_free(b->hash);
+    memset(b, 0, sizeof(*b));
+}
+
+esp_err_t automation_image_build(const device_manager_config_t *cfg, automation_image_t **out)
+{
+    if (!cfg || !out) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *out = NULL;
+    bc_builder_t b = {0};
+    if (!bc_reserve(&b, (void **)&b.strings, &b.strings_cap, 1, 1)) {
+        return ESP_ERR_NO_MEM;
+    }
+    b.strings[0] = 0;
+    b.strings_len = 1;
+    uint8_t device_cap = cfg->device_capacity ? cfg->device_capacity : DEVICE_MANAGER_MAX_DEVICES;
+    for (uint8_t d = 0; d < cfg->device_count && d < device_cap && !b.failed; ++d) {
+        const device_descriptor_t *device = &cfg->devices[d];
+        size_t first_program = b.program_count;
+        for (uint8_t s = 0; s < device->scenario_count && s < DEVICE_MANAGER_MAX_SCENARIOS_PER_DEVICE; ++s) {
+            bc_compile_scenario(&b, device, d, &device->scenarios[s]);
+        }
+        bc_bind_topics(&b, device, first_program);
+    }
+    automation_image_t *image = NULL;
+    if (!b.failed) {
+        image = heap_caps_calloc(1, sizeof(*image), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!image) {
+            image = heap_caps_calloc(1, sizeof(*image), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        }
+    }
+    if (!image) {
+        bc_builder_free(&b);
+        ESP_LOGE(TAG, "compile failed (no memory)");
+        return ESP_ERR_NO_MEM;
+    }
+    atomic_init(&image->refs, 1);
+    image->generation = cfg->generation;
+    image->programs = bc_shrink(b.programs, b.program_count * sizeof(automation_program_t));
+    image->program_count = b.program_count;
+    image->insns = bc_shrink(b.insns, b.insn_count * sizeof(automation_insn_t));
+    image->insn_count = b.insn_count;
+    image->reqs = bc_shrink(b.reqs, b.req_count * sizeof(automation_flag_req_t));
+    image->req_count = b.req_count;
+    image->bindings = bc_shrink(b.bindings, b.binding_count * sizeof(automation_binding_t));
+    image->binding_count = b.binding_count;
+    image->strings = bc_shrink(b.strings, b.strings_len);
+    image->strings_len = b.strings_len;
+    heap_caps_free(b.hash);
+    *out = image;
+    return ESP_OK;
+}
+
+void automation_image_retain(automation_image_t *image)
+{
+    if (image) {
+        atomic_fetch_add(&image->refs, 1);
+    }
+}
+
+void automation_image_release(automation_image_t *image)
+{
+    if (!image) {
+        return;
+    }
+    if (atomic_fetch_sub(&image->refs, 1) != 1) {
+        return;
+    }
+    heap_caps_free(image->programs);
+    heap_caps_free(image->insns);
+    heap_caps_free(image->reqs);
+    heap_caps_free(image->bindings);
+    heap_caps_free(image->strings);
+    heap_caps_free(image);
+}
+
+size_t automation_image_footprint(const automation_image_t *image)
+{
+    if (!image) {
+        return 0;
+    }
+    return sizeof(*image) +
+           image->program_count * sizeof(automation_program_t) +
+           image->insn_count * sizeof(automation_insn_t) +
+           image->req_count * sizeof(automation_flag_req_t) +
+           image->binding_count * sizeof(automation_binding_t) +
+           image->strings_len;
+}
+
+const automation_program_t *automation_image_find(const automation_image_t *image,
+                                                  const char *device_id,
+                                                  const char *scenario_id)
+{
+    if (!image || !device_id || !device_id[0] || !scenario_id || !scenario_id[0]) {
+        return NULL;
+    }
+    // Devices are told apart by index: several of them may share an empty id.
+    int matched = -1;
+    int rejected = -1;
+    for (size_t i = 0; i < image->program_count; ++i) {
+        const automation_program_t *prog = &image->programs[i];
+        if (matched >= 0 && prog->device != matched) {
+            break;
+        }
+        if (matched < 0) {
+            if (prog->device == rejected) {
+                continue;
+            }
+            const char *id = automation_image_str(image, prog->device_id);
+            const char *name = automation_image_str(image, prog->device_name);
+            if (!((id[0] && strcasecmp(id, device_id) == 0) || (name[0] && strcasecmp(name, device_id) == 0))) {
+                rejected = prog->device;
+                continue;
+            }
+            matched = prog->device;
+        }
+        const char *sid = automation_image_str(image, prog->scenario_id);
+        const char *sname = automation_image_str(image, prog->scenario_name);
+        if ((sid[0] && strcasecmp(sid, scenario_id) == 0) || (sname[0] && strcasecmp(sname, scenario_id) == 0)) {
+            return prog;
+        }
+    }
+    return NULL;
+}
+
+static const char *vm_operand(const automation_image_t *image,
+                              const automation_vm_env_t *env,
+                              uint32_t ref,
+                              bool dynamic,
+                              char *buf,
+                              size_t buf_len)
+{
+    const char *src = automation_image_str(image, ref);
+    if (!dynamic || !env->render) {
+        return src;
+    }
+    env->render(env->ctx, src, buf, buf_len);
+    return buf;
+}
+
+static bool vm_requirements_met(const automation_image_t *image,
+                                const automation_insn_t *insn,
+                                const automation_vm_env_t *env)
+{
+    bool mode_any = (insn->flags & AUTOMATION_INSN_MODE_ANY) != 0;
+    bool any_met = false;
+    for (uint32_t i = 0; i < insn->b; ++i) {
+        const automation_flag_req_t *req = &image->reqs[insn->a + i];
+        bool state = env->get_flag(env->ctx, automation_image_str(image, req->flag));
+        bool met = req->required_state ? state : !state;
+        if (!met && !mode_any) {
+            return false;
+        }
+        if (met && mode_any) {
+            return true;
+        }
+        any_met |= met;
+    }
+    return mode_any ? any_met : true;
+}
+
+static bool vm_wait_flags(const automation_image_t *image,
+                          const automation_insn_t *insn,
+                          const automation_vm_env_t *env)
+{
+    const int64_t start = env->now_ms(env->ctx);
+    while (!vm_requirements_met(image, insn, env)) {
+        if (env->cancelled && env->cancelled(env->ctx)) {
+            return false;
+        }
+        if (insn->c > 0 && env->now_ms(env->ctx) - start >= (int64_t)insn->c) {
+            ESP_LOGW(TAG, "wait flags timeout (%" PRIu32 " ms)", insn->c);
+            return false;
+        }
+        env->sleep_ms(env->ctx, BC_WAIT_POLL_MS);
+    }
+    return true;
+}
+
+esp_err_t automation_vm_run(const automation_image_t *image,
+                            const automation_program_t *program,
+                            const automation_vm_env_t *env)
+{
+    return automation_vm_run_range(image, program, 0, program ? program->insn_count : 0, env);
+}
+
+esp_err_t automation_vm_run_range(const automation_image_t *image,
+                                  const automation_program_t *program,
+                                  uint32_t start,
+                                  uint32_t end,
+                                  const automation_vm_env_t *env)
+{
+    if (!image || !program || !env || !env->sleep_ms || !env->now_ms || !env->mqtt_publish ||
+        !env->audio_play || !env->audio_stop || !env->set_flag || !env->get_flag || !env->post_event) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (end > program->insn_count || start > end) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const automation_insn_t *code = image->insns + program->first_insn;
+    uint16_t local_counters[BC_LOCAL_LOOP_SLOTS] = {0};
+    uint16_t *counters = local_counters;
+    if (program->loop_slots > BC_LOCAL_LOOP_SLOTS) {
+        counters = heap_caps_calloc(program->loop_slots, sizeof(uint16_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!counters) {
+            counters = heap_caps_calloc(program->loop_slots, sizeof(uint16_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        }
+        if (!counters) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    uint32_t pc = start;
+    uint16_t step = UINT16_MAX;
+    esp_err_t result = ESP_OK;
+    while (pc < end) {
+        if (env->cancelled && env->cancelled(env->ctx)) {
+            result = ESP_ERR_INVALID_STATE;
+            break;
+        }
+        const automation_insn_t *insn = &code[pc++];
+        if (insn->step != step) {
+            step = insn->step;
+            if (env->step_begin) {
+                env->step_begin(env->ctx, step);
+            }
+        }
+        switch (insn->op) {
+        case AUTOMATION_OP_SLEEP:
+            env->sleep_ms(env->ctx, insn->a);
+            break;
+        case AUTOMATION_OP_MQTT: {
+            char topic_buf[DEVICE_MANAGER_TOPIC_MAX_LEN];
+            char payload_buf[DEVICE_MANAGER_PAYLOAD_MAX_LEN];
+            const char *topic = vm_operand(image, env, insn->a, insn->flags & AUTOMATION_INSN_A_DYNAMIC,
+                                           topic_buf, sizeof(topic_buf));
+            const char *payload = vm_operand(image, env, insn->b, insn->flags & AUTOMATION_INSN_B_DYNAMIC,
+                                             payload_buf, sizeof(payload_buf));
+            if (topic[0]) {
+                env->mqtt_publish(env->ctx, topic, payload);
+            } else {
+                ESP_LOGW(TAG, "mqtt_publish skipped (empty topic)");
+            }
+            break;
+        }
+        case AUTOMATION_OP_AUDIO_PLAY: {
+            char track_buf[DEVICE_MANAGER_TRACK_NAME_MAX_LEN];
+            const char *track = vm_operand(image, env, insn->a, insn->flags & AUTOMATION_INSN_A_DYNAMIC,
+                                           track_buf, sizeof(track_buf));
+            if (track[0]) {
+                env->audio_play(env->ctx, track);
+            } else {
+                ESP_LOGW(TAG, "audio_play skipped (empty track)");
+            }
+            break;
+        }
+        case AUTOMATION_OP_AUDIO_STOP:
+            env->audio_stop(env->ctx);
+            break;
+        case AUTOMATION_OP_SET_FLAG:
+            env->set_flag(env->ctx, automation_image_str(image, insn->a), (insn->flags & AUTOMATION_INSN_VALUE) != 0);
+            break;
+        case AUTOMATION_OP_WAIT_FLAGS:
+            vm_wait_flags(image, insn, env);
+            break;
+        case AUTOMATION_OP_LOOP: {
+            uint16_t *counter = &counters[insn->c];
+            if (insn->b == 0 || *counter < insn->b) {
+                (*counter)++;
+                pc = insn->a;
+            }
+            break;
+        }
+        case AUTOMATION_OP_EVENT: {
+            char topic_buf[BC_EVENT_TOPIC_MAX];
+            char payload_buf[BC_EVENT_PAYLOAD_MAX];
+            const char *topic = vm_operand(image, env, insn->b, insn->flags & AUTOMATION_INSN_B_DYNAMIC,
+                                           topic_buf, sizeof(topic_buf));
+            const char *payload = vm_operand(image, env, insn->c, insn->flags & AUTOMATION_INSN_C_DYNAMIC,
+                                             payload_buf, sizeof(payload_buf));
+            env->post_event(env->ctx, (int)insn->a, topic, payload);
+            break;
+        }
+        case AUTOMATION_OP_FORK:
+            if (!env->fork || !env->fork(env->ctx, insn->a, insn->b)) {
+                esp_err_t err = automation_vm_run_range(image, program, insn->a, insn->b, env);
+                if (err == ESP_ERR_INVALID_STATE) {
+                    result = err;
+                    pc = end;
+                }
+            }
+            break;
+        case AUTOMATION_OP_JUMP:
+            pc = insn->a;
+            break;
+        case AUTOMATION_OP_JOIN:
+            if (env->join) {
+                env->join(env->ctx, insn->a);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    if (counters != local_counters) {
+        heap_caps_free(counters);
+    }
+    return result;
+}
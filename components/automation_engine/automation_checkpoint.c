@@ -0,0 +1,488 @@
+#include "automation_checkpoint.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_check.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "device_manager_utils.h"
+#include "dm_config.h"
+#include "dm_template_runtime.h"
+#include "automation_engine.h"
+
+#define CHECKPOINT_MAGIC 0x4b43504dU      // "MPCK"
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_TASK_STACK 3072
+#define CHECKPOINT_TASK_PRIO 2
+#ifdef CONFIG_BROKER_CHECKPOINT_RUNTIME_SLOTS
+#define CHECKPOINT_RUNTIME_SLOTS CONFIG_BROKER_CHECKPOINT_RUNTIME_SLOTS
+#else
+#define CHECKPOINT_RUNTIME_SLOTS 32
+#endif
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t runtime_slots;
+    uint32_t runtime_slot_size;
+    uint32_t flag_slot_size;
+    uint32_t var_slot_size;
+    uint32_t reserved;
+    uint64_t config_digest;
+} checkpoint_header_t;
+
+// Every slot starts with this head; len 0 marks an empty slot.
+typedef struct {
+    uint64_t check;             // dm_hash_bytes of the payload
+    uint32_t len;
+    uint32_t reserved;
+} checkpoint_slot_head_t;
+
+typedef struct {
+    uint32_t count;
+    automation_flag_record_t flags[AUTOMATION_FLAG_CAPACITY];
+} checkpoint_flags_t;
+
+typedef struct {
+    uint32_t count;
+    automation_var_record_t vars[AUTOMATION_CONTEXT_MAX_VARS];
+} checkpoint_vars_t;
+
+typedef struct {
+    dm_runtime_state_t runtimes[CHECKPOINT_RUNTIME_SLOTS];
+    checkpoint_flags_t flags;
+    checkpoint_vars_t vars;
+} checkpoint_buffers_t;
+
+#define RUNTIME_SLOT_SIZE (sizeof(checkpoint_slot_head_t) + sizeof(dm_runtime_state_t))
+#define FLAG_SLOT_SIZE (sizeof(checkpoint_slot_head_t) + sizeof(checkpoint_flags_t))
+#define VAR_SLOT_SIZE (sizeof(checkpoint_slot_head_t) + sizeof(checkpoint_vars_t))
+#define RUNTIME_SLOTS_OFFSET ((long)sizeof(checkpoint_header_t))
+#define FLAG_SLOT_OFFSET (RUNTIME_SLOTS_OFFSET + (long)(CHECKPOINT_RUNTIME_SLOTS * RUNTIME_SLOT_SIZE))
+#define VAR_SLOT_OFFSET (FLAG_SLOT_OFFSET + (long)FLAG_SLOT_SIZE)
+#define CHECKPOINT_FILE_SIZE (VAR_SLOT_OFFSET + (long)VAR_SLOT_SIZE)
+
+// Slot indexes in s_written: runtimes first, then flags and variables.
+#define FLAG_SLOT_INDEX CHECKPOINT_RUNTIME_SLOTS
+#define VAR_SLOT_INDEX (CHECKPOINT_RUNTIME_SLOTS + 1)
+#define CHECKPOINT_SLOT_COUNT (CHECKPOINT_RUNTIME_SLOTS + 2)
+
+static const char *TAG = "checkpoint";
+static SemaphoreHandle_t s_lock;
+static TaskHandle_t s_task;
+static checkpoint_buffers_t *s_buf;
+// Mirror of what the file holds, so unchanged slots are never rewritten.
+static bool s_file_ready;
+static uint64_t s_file_digest;
+static uint64_t s_written[CHECKPOINT_SLOT_COUNT];
+static char s_slot_ids[CHECKPOINT_RUNTIME_SLOTS][DEVICE_MANAGER_ID_MAX_LEN];
+static bool s_slots_warned;
+static bool s_digest_valid;
+static uint32_t s_digest_generation;
+static uint64_t s_digest;
+static automation_checkpoint_stats_t s_stats;
+
+static esp_err_t ensure_state(void)
+{
+    if (!s_lock) {
+        s_lock = xSemaphoreCreateMutex();
+        ESP_RETURN_ON_FALSE(s_lock, ESP_ERR_NO_MEM, TAG, "lock alloc failed");
+    }
+    if (!s_buf) {
+        s_buf = heap_caps_calloc(1, sizeof(*s_buf), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!s_buf) {
+            s_buf = heap_caps_calloc(1, sizeof(*s_buf), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        }
+        ESP_RETURN_ON_FALSE(s_buf, ESP_ERR_NO_MEM, TAG, "buffer alloc failed");
+    }
+    return ESP_OK;
+}
+
+// Digest of the device descriptors; recomputed only when the config generation moves.
+static uint64_t config_digest(void)
+{
+    const device_manager_config_t *cfg = device_manager_acquire_config();
+    if (!cfg) {
+        return 0;
+    }
+    if (!s_digest_valid || cfg->generation != s_digest_generation) {
+        uint8_t count = cfg->device_count < cfg->device_capacity ? cfg->device_count : cfg->device_capacity;
+        s_digest = count;
+        for (uint8_t i = 0; i < count; ++i) {
+            s_digest = s_digest * 31 + dm_config_device_digest(&cfg->devices[i], true);
+        }
+        s_digest_generation = cfg->generation;
+        s_digest_valid = true;
+    }
+    uint64_t digest = s_digest;
+    device_manager_release_config(cfg);
+    return digest;
+}
+
+static uint64_t payload_check(const void *payload, size_t len)
+{
+    if (!len) {
+        return 0;
+    }
+    uint64_t check = dm_hash_bytes(payload, len);
+    return check ? check : 1;
+}
+
+static long slot_offset(size_t index)
+{
+    if (index == FLAG_SLOT_INDEX) {
+        return FLAG_SLOT_OFFSET;
+    }
+    if (index == VAR_SLOT_INDEX) {
+        return VAR_SLOT_OFFSET;
+    }
+    return RUNTIME_SLOTS_OFFSET + (long)(index * RUNTIME_SLOT_SIZE);
+}
+
+static size_t slot_capacity(size_t index)
+{
+    if (index == FLAG_SLOT_INDEX) {
+        return sizeof(checkpoint_flags_t);
+    }
+    if (index == VAR_SLOT_INDEX) {
+        return sizeof(checkpoint_vars_t);
+    }
+    return sizeof(dm_runtime_state_t);
+}
+
+static void fill_header(checkpoint_header_t *hdr, uint64_t digest)
+{
+    *hdr = (checkpoint_header_t){
+        .magic = CHECKPOINT_MAGIC,
+        .version = CHECKPOINT_VERSION,
+        .runtime_slots = CHECKPOINT_RUNTIME_SLOTS,
+        .runtime_slot_size = RUNTIME_SLOT_SIZE,
+        .flag_slot_size = FLAG_SLOT_SIZE,
+        .var_slot_size = VAR_SLOT_SIZE,
+        .config_digest = digest,
+    };
+}
+
+static bool header_layout_ok(const checkpoint_header_t *hdr)
+{
+    checkpoint_header_t expected;
+    fill_header(&expected, hdr->config_digest);
+    return memcmp(hdr, &expected, sizeof(expected)) == 0;
+}
+
+// Creates the file at full size so later writes only overwrite clusters in place.
+static FILE *create_file(uint64_t digest)
+{
+    FILE *f = fopen(AUTOMATION_CHECKPOINT_PATH, "w+b");
+    if (!f) {
+        return NULL;
+    }
+    static const uint8_t zeros[256];
+    long left = CHECKPOINT_FILE_SIZE;
+    while (left > 0) {
+        size_t chunk = left > (long)sizeof(zeros) ? sizeof(zeros) : (size_t)left;
+        if (fwrite(zeros, 1, chunk, f) != chunk) {
+            fclose(f);
+            return NULL;
+        }
+        left -= (long)chunk;
+    }
+    checkpoint_header_t hdr;
+    fill_header(&hdr, digest);
+    if (fseek(f, 0, SEEK_SET) != 0 || fwrite(&hdr, sizeof(hdr), 1, f) != 1) {
+        fclose(f);
+        return NULL;
+    }
+    memset(s_written, 0, sizeof(s_written));
+    memset(s_slot_ids, 0, sizeof(s_slot_ids));
+    s_file_digest = digest;
+    s_file_ready = true;
+    ESP_LOGI(TAG, "created %s (%ld bytes)", AUTOMATION_CHECKPOINT_PATH, CHECKPOINT_FILE_SIZE);
+    return f;
+}
+
+static FILE *open_file(uint64_t digest)
+{
+    if (s_file_ready) {
+        FILE *f = fopen(AUTOMATION_CHECKPOINT_PATH, "r+b");
+        if (f && fseek(f, 0, SEEK_END) == 0 && ftell(f) == CHECKPOINT_FILE_SIZE) {
+            return f;
+        }
+        if (f) {
+            fclose(f);
+        }
+        s_file_ready = false;
+    }
+    return create_file(digest);
+}
+
+// Keeps every device on the slot it had, so a change rewrites only that device's slot.
+static void assign_runtime_slots(const dm_runtime_state_t *records, size_t count,
+                                 const dm_runtime_state_t *by_slot[CHECKPOINT_RUNTIME_SLOTS])
+{
+    bool placed[CHECKPOINT_RUNTIME_SLOTS] = {0};
+    for (size_t s = 0; s < CHECKPOINT_RUNTIME_SLOTS; ++s) {
+        by_slot[s] = NULL;
+        for (size_t r = 0; s_slot_ids[s][0] && r < count; ++r) {
+            if (!placed[r] && strcmp(records[r].device_id, s_slot_ids[s]) == 0) {
+                by_slot[s] = &records[r];
+                placed[r] = true;
+                break;
+            }
+        }
+    }
+    for (size_t r = 0; r < count; ++r) {
+        for (size_t s = 0; !placed[r] && s < CHECKPOINT_RUNTIME_SLOTS; ++s) {
+            if (!by_slot[s]) {
+                by_slot[s] = &records[r];
+                placed[r] = true;
+            }
+        }
+    }
+}
+
+static esp_err_t write_slot(FILE *f, size_t index, const void *payload, size_t len, uint64_t check)
+{
+    checkpoint_slot_head_t head = {
+        .check = check,
+        .len = (uint32_t)len,
+    };
+    if (fseek(f, slot_offset(index), SEEK_SET) != 0 || fwrite(&head, sizeof(head), 1, f) != 1 ||
+        (len && fwrite(payload, 1, len, f) != len)) {
+        return ESP_FAIL;
+    }
+    s_written[index] = check;
+    s_stats.slots_written++;
+    s_stats.bytes_written += (uint32_t)(sizeof(head) + len);
+    return ESP_OK;
+}
+
+esp_err_t automation_checkpoint_flush(void)
+{
+    ESP_RETURN_ON_ERROR(ensure_state(), TAG, "init failed");
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int64_t start_us = esp_timer_get_time();
+    checkpoint_buffers_t *buf = s_buf;
+
+    memset(buf, 0, sizeof(*buf));
+    size_t runtime_count = dm_template_runtime_export_state(buf->runtimes, CHECKPOINT_RUNTIME_SLOTS);
+    if (runtime_count == CHECKPOINT_RUNTIME_SLOTS && !s_slots_warned) {
+        dm_template_runtime_stats_t rt;
+        dm_template_runtime_get_stats(&rt);
+        if (rt.runtimes > CHECKPOINT_RUNTIME_SLOTS) {
+            ESP_LOGW(TAG, "%u runtimes, only %u checkpointed", (unsigned)rt.runtimes, (unsigned)CHECKPOINT_RUNTIME_SLOTS);
+            s_slots_warned = true;
+        }
+    }
+    buf->flags.count = (uint32_t)automation_engine_export_flags(buf->flags.flags, AUTOMATION_FLAG_CAPACITY);
+    buf->vars.count = (uint32_t)automation_engine_export_variables(buf->vars.vars, AUTOMATION_CONTEXT_MAX_VARS);
+
+    const void *payload[CHECKPOINT_SLOT_COUNT];
+    size_t len[CHECKPOINT_SLOT_COUNT];
+    uint64_t check[CHECKPOINT_SLOT_COUNT];
+    const dm_runtime_state_t *by_slot[CHECKPOINT_RUNTIME_SLOTS];
+    assign_runtime_slots(buf->runtimes, runtime_count, by_slot);
+    for (size_t s = 0; s < CHECKPOINT_RUNTIME_SLOTS; ++s) {
+        payload[s] = by_slot[s];
+        len[s] = by_slot[s] ? offsetof(dm_runtime_state_t, data) + by_slot[s]->len : 0;
+    }
+    payload[FLAG_SLOT_INDEX] = &buf->flags;
+    len[FLAG_SLOT_INDEX] = offsetof(checkpoint_flags_t, flags) + buf->flags.count * sizeof(automation_flag_record_t);
+    payload[VAR_SLOT_INDEX] = &buf->vars;
+    len[VAR_SLOT_INDEX] = offsetof(checkpoint_vars_t, vars) + buf->vars.count * sizeof(automation_var_record_t);
+
+    uint64_t digest = config_digest();
+    bool dirty = !s_file_ready || digest != s_file_digest;
+    for (size_t i = 0; i < CHECKPOINT_SLOT_COUNT; ++i) {
+        check[i] = payload_check(payload[i], len[i]);
+        dirty |= check[i] != s_written[i];
+    }
+    if (!dirty) {
+        xSemaphoreGive(s_lock);
+        return ESP_OK;
+    }
+
+    esp_err_t err = ESP_OK;
+    FILE *f = open_file(digest);
+    if (!f) {
+        err = ESP_ERR_NOT_FOUND;
+    }
+    if (err == ESP_OK && digest != s_file_digest) {
+        checkpoint_header_t hdr;
+        fill_header(&hdr, digest);
+        if (fseek(f, 0, SEEK_SET) != 0 || fwrite(&hdr, sizeof(hdr), 1, f) != 1) {
+            err = ESP_FAIL;
+        } else {
+            s_file_digest = digest;
+        }
+    }
+    for (size_t i = 0; err == ESP_OK && i < CHECKPOINT_SLOT_COUNT; ++i) {
+        if (check[i] != s_written[i]) {
+            err = write_slot(f, i, payload[i], len[i], check[i]);
+        }
+    }
+    for (size_t s = 0; err == ESP_OK && s < CHECKPOINT_RUNTIME_SLOTS; ++s) {
+        dm_str_copy(s_slot_ids[s], sizeof(s_slot_ids[s]), by_slot[s] ? by_slot[s]->device_id : "");
+    }
+    if (f) {
+        if (fflush(f) != 0 || fsync(fileno(f)) != 0) {
+            err = ESP_FAIL;
+        }
+        fclose(f);
+    }
+    if (err == ESP_OK) {
+        s_stats.flushes++;
+    } else {
+        // The mirror no longer matches the file; rewrite everything next time.
+        s_stats.failures++;
+        s_file_ready = false;
+    }
+    s_stats.last_flush_us = esp_timer_get_time() - start_us;
+    xSemaphoreGive(s_lock);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "flush failed: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+// Reads one slot into the shared buffer; false when it is empty or torn.
+static bool read_slot(FILE *f, size_t index, void *payload, size_t *out_len)
+{
+    checkpoint_slot_head_t head;
+    *out_len = 0;
+    if (fseek(f, slot_offset(index), SEEK_SET) != 0 || fread(&head, sizeof(head), 1, f) != 1) {
+        return false;
+    }
+    if (!head.len || head.len > slot_capacity(index) || fread(payload, 1, head.len, f) != head.len ||
+        payload_check(payload, head.len) != head.check) {
+        return false;
+    }
+    s_written[index] = head.check;
+    *out_len = head.len;
+    return true;
+}
+
+esp_err_t automation_checkpoint_restore(void)
+{
+    ESP_RETURN_ON_ERROR(ensure_state(), TAG, "init failed");
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int64_t start_us = esp_timer_get_time();
+    checkpoint_buffers_t *buf = s_buf;
+    memset(buf, 0, sizeof(*buf));
+    memset(s_written, 0, sizeof(s_written));
+    memset(s_slot_ids, 0, sizeof(s_slot_ids));
+    s_file_ready = false;
+
+    FILE *f = fopen(AUTOMATION_CHECKPOINT_PATH, "rb");
+    if (!f) {
+        xSemaphoreGive(s_lock);
+        ESP_LOGI(TAG, "no checkpoint at %s", AUTOMATION_CHECKPOINT_PATH);
+        return ESP_ERR_NOT_FOUND;
+    }
+    checkpoint_header_t hdr;
+    bool layout_ok = fread(&hdr, sizeof(hdr), 1, f) == 1 && header_layout_ok(&hdr) &&
+                     fseek(f, 0, SEEK_END) == 0 && ftell(f) == CHECKPOINT_FILE_SIZE;
+    if (!layout_ok) {
+        fclose(f);
+        xSemaphoreGive(s_lock);
+        ESP_LOGW(TAG, "checkpoint layout changed, starting fresh");
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    // Every slot is mirrored, applied or not, so the next flush only writes what differs.
+    size_t len = 0;
+    bool runtime_ok[CHECKPOINT_RUNTIME_SLOTS] = {0};
+    for (size_t s = 0; s < CHECKPOINT_RUNTIME_SLOTS; ++s) {
+        runtime_ok[s] = read_slot(f, s, &buf->runtimes[s], &len) &&
+                        len == offsetof(dm_runtime_state_t, data) + buf->runtimes[s].len;
+        if (runtime_ok[s]) {
+            buf->runtimes[s].device_id[sizeof(buf->runtimes[s].device_id) - 1] = 0;
+            dm_str_copy(s_slot_ids[s], sizeof(s_slot_ids[s]), buf->runtimes[s].device_id);
+        }
+    }
+    bool flags_ok = read_slot(f, FLAG_SLOT_INDEX, &buf->flags, &len) &&
+                    buf->flags.count <= AUTOMATION_FLAG_CAPACITY &&
+                    len == offsetof(checkpoint_flags_t, flags) + buf->flags.count * sizeof(automation_flag_record_t);
+    bool vars_ok = read_slot(f, VAR_SLOT_INDEX, &buf->vars, &len) &&
+                   buf->vars.count <= AUTOMATION_CONTEXT_MAX_VARS &&
+                   len == offsetof(checkpoint_vars_t, vars) + buf->vars.count * sizeof(automation_var_record_t);
+    fclose(f);
+    s_file_digest = hdr.config_digest;
+    s_file_ready = true;
+
+    if (hdr.config_digest != config_digest()) {
+        xSemaphoreGive(s_lock);
+        ESP_LOGW(TAG, "checkpoint belongs to another device config, not restored");
+        return ESP_ERR_INVALID_STATE;
+    }
+    uint32_t runtimes = 0;
+    for (size_t s = 0; s < CHECKPOINT_RUNTIME_SLOTS; ++s) {
+        if (runtime_ok[s] && dm_template_runtime_import_state(&buf->runtimes[s]) == ESP_OK) {
+            runtimes++;
+        }
+    }
+    if (flags_ok) {
+        automation_engine_import_flags(buf->flags.flags, buf->flags.count);
+    }
+    if (vars_ok) {
+        automation_engine_import_variables(buf->vars.vars, buf->vars.count);
+    }
+    s_stats.restored_runtimes = runtimes;
+    s_stats.restored_flags = flags_ok ? buf->flags.count : 0;
+    s_stats.restored_variables = vars_ok ? buf->vars.count : 0;
+    s_stats.restore_us = esp_timer_get_time() - start_us;
+    ESP_LOGI(TAG, "restored in %lld us: %" PRIu32 " runtimes, %" PRIu32 " flags, %" PRIu32 " vars",
+             (long long)s_stats.restore_us,
+             s_stats.restored_runtimes,
+             s_stats.restored_flags,
+             s_stats.restored_variables);
+    xSemaphoreGive(s_lock);
+    return ESP_OK;
+}
+
+static void checkpoint_task(void *arg)
+{
+    const TickType_t period = pdMS_TO_TICKS((uint32_t)(uintptr_t)arg);
+    for (;;) {
+        // One pass per period bounds flash wear no matter how busy the room is.
+        vTaskDelay(period);
+        automation_checkpoint_flush();
+    }
+}
+
+esp_err_t automation_checkpoint_start(uint32_t interval_ms)
+{
+    if (!interval_ms || s_task) {
+        return ESP_OK;
+    }
+    ESP_RETURN_ON_ERROR(ensure_state(), TAG, "init failed");
+    BaseType_t ok = xTaskCreate(checkpoint_task,
+                                "checkpoint",
+                                CHECKPOINT_TASK_STACK,
+                                (void *)(uintptr_t)interval_ms,
+                                CHECKPOINT_TASK_PRIO,
+                                &s_task);
+    ESP_RETURN_ON_FALSE(ok == pdPASS, ESP_FAIL, TAG, "task create failed");
+    ESP_LOGI(TAG, "writing %s every %" PRIu32 " ms", AUTOMATION_CHECKPOINT_PATH, interval_ms);
+    return ESP_OK;
+}
+
+void automation_checkpoint_get_stats(automation_checkpoint_stats_t *out)
+{
+    if (!out) {
+        return;
+    }
+    if (!s_lock) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *out = s_stats;
+    xSemaphoreGive(s_lock);
+}
@@ -2,12 +2,12 @@
 
 #include <string.h>
 #include <strings.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <inttypes.h>
 #include <ctype.h>
 #include <stdio.h>
 #include "freertos/FreeRTOS.h"
-#include "freertos/queue.h"
 #include "freertos/semphr.h"
 #include "freertos/task.h"
 #include "esp_log.h"
@@ -16,31 +16,37 @@
 #include "esp_timer.h"
 #include "audio_player.h"
 #include "device_manager.h"
+#include "device_manager_utils.h"
+#include "dm_config.h"
 #include "event_bus.h"
 #include "mqtt_core.h"
 #include "dm_template_runtime.h"
+#include "dm_timer_wheel.h"
+#include "dm_rate_gate.h"
+#include "automation_bytecode.h"
+#include "automation_checkpoint.h"
+#include "automation_scheduler.h"
+#include "automation_trace.h"
 
-#define AUTOMATION_QUEUE_LENGTH 16
 #define AUTOMATION_WORKER_STACK 4096
 #define AUTOMATION_WORKER_PRIO 5
 #define AUTOMATION_WORKER_COUNT 2
-#define AUTOMATION_FLAG_CAPACITY (DEVICE_MANAGER_MAX_DEVICES * DEVICE_MANAGER_MAX_SCENARIOS_PER_DEVICE)
+#define AUTOMATION_PRIORITY_WORKER_COUNT 1      // extra workers that only take high/critical jobs
+#define AUTOMATION_SLEEP_SLICE_MS 100
+#define AUTOMATION_JOIN_POLL_MS 10
 #define AUTOMATION_RELOAD_LOCK_TIMEOUT pdMS_TO_TICKS(200)
-#define AUTOMATION_TRIGGER_CAPACITY (DEVICE_MANAGER_MAX_DEVICES * DEVICE_MANAGER_MAX_TOPICS_PER_DEVICE)
-#define AUTOMATION_CONTEXT_MAX_VARS 32
-#define AUTOMATION_CONTEXT_KEY_MAX 48
-#define AUTOMATION_CONTEXT_VALUE_MAX 192
-
-typedef struct {
-    char topic[DEVICE_MANAGER_TOPIC_MAX_LEN];
-    const device_descriptor_t *device;
-    const device_scenario_t *scenario;
-} automation_trigger_t;
-
-typedef struct {
-    const device_descriptor_t *device;
-    const device_scenario_t *scenario;
-} automation_job_t;
+#define AUTOMATION_HANDLE_CAPACITY 256          // scenarios templates and actions refer to by handle
+#define AUTOMATION_PROGRAM_UNBOUND (-1)
+#ifdef CONFIG_BROKER_CHECKPOINT_INTERVAL_MS
+#define AUTOMATION_CHECKPOINT_INTERVAL_MS CONFIG_BROKER_CHECKPOINT_INTERVAL_MS
+#else
+#define AUTOMATION_CHECKPOINT_INTERVAL_MS 2000
+#endif
+#ifdef CONFIG_BROKER_ROOM_RESET_TOPIC
+#define AUTOMATION_ROOM_RESET_TOPIC CONFIG_BROKER_ROOM_RESET_TOPIC
+#else
+#define AUTOMATION_ROOM_RESET_TOPIC "broker/room/reset"
+#endif
 
 typedef struct {
     char name[DEVICE_MANAGER_FLAG_NAME_MAX_LEN];
@@ -48,14 +54,44 @@ typedef struct {
     bool value;
 } automation_flag_t;
 
+// Open-addressing table keyed by the case-folded name. Flags are never removed one by one,
+// only cleared together, so probing needs no tombstones. Half full at most.
+#define AUTOMATION_FLAG_SLOTS (AUTOMATION_FLAG_CAPACITY * 2)
+_Static_assert((AUTOMATION_FLAG_SLOTS & (AUTOMATION_FLAG_SLOTS - 1)) == 0,
+               "flag slots are masked, AUTOMATION_FLAG_CAPACITY must be a power of two");
+typedef struct {
+    automation_flag_t slots[AUTOMATION_FLAG_SLOTS];
+    size_t count;
+} automation_flag_table_t;
+
+// Handle slot: keeps the lookup key and the program index in the current image.
+// A slot with no holders is reclaimed on reload; an empty device_id marks it free.
+typedef struct {
+    char device_id[DEVICE_MANAGER_ID_MAX_LEN];
+    char scenario_id[DEVICE_MANAGER_NAME_MAX_LEN];
+    int32_t program;
+    uint16_t refs;
+} automation_handle_slot_t;
+
+// Rate gate of one image binding; rebuilt with the image.
+typedef struct {
+    dm_rate_gate_t gate;
+    uint16_t program;
+} automation_binding_gate_t;
+
 static const char *TAG = "automation";
-static automation_trigger_t *s_triggers = NULL;
-static size_t s_trigger_count = 0;
+static automation_image_t *s_image = NULL;
+static uint64_t s_image_source_hash;     // device content the current image was compiled from
+static automation_binding_gate_t *s_binding_gates = NULL;   // parallel to s_image->bindings
+static uint32_t s_retired_rate_passed;
+static uint32_t s_retired_rate_suppressed;
 static SemaphoreHandle_t s_trigger_mutex = NULL;
-static QueueHandle_t s_job_queue = NULL;
-static automation_flag_t s_flags[AUTOMATION_FLAG_CAPACITY];
+static automation_handle_slot_t *s_handles = NULL;
+static size_t s_handle_count = 0;
+static automation_flag_table_t *s_flags = NULL;
+static automation_flag_table_t *s_flag_baseline = NULL;
 static SemaphoreHandle_t s_flag_mutex = NULL;
-static TaskHandle_t s_workers[AUTOMATION_WORKER_COUNT] = {0};
+static TaskHandle_t s_workers[AUTOMATION_WORKER_COUNT + AUTOMATION_PRIORITY_WORKER_COUNT] = {0};
 static SemaphoreHandle_t s_context_mutex = NULL;
 
 typedef struct {
@@ -66,52 +102,82 @@ typedef struct {
 
 static automation_context_var_t s_context_vars[AUTOMATION_CONTEXT_MAX_VARS];
 
-typedef struct {
-    const char *name;
-    event_bus_type_t type;
-} automation_event_map_t;
-
-static const automation_event_map_t s_event_map[] = {
-    {"card_ok", EVENT_CARD_OK},
-    {"card_bad", EVENT_CARD_BAD},
-    {"relay_cmd", EVENT_RELAY_CMD},
-    {"audio_play", EVENT_AUDIO_PLAY},
-    {"volume_set", EVENT_VOLUME_SET},
-    {"web_command", EVENT_WEB_COMMAND},
-    {"system_status", EVENT_SYSTEM_STATUS},
-    {"device_config_changed", EVENT_DEVICE_CONFIG_CHANGED},
-};
-
 static void automation_worker(void *param);
-static void automation_execute_job(const automation_job_t *job);
+static void automation_execute_job(automation_job_t *job);
+
+// Per-execution state handed to the VM callbacks.
+typedef struct {
+    automation_job_t *job;
+    automation_trace_ref_t trace;
+    uint16_t step;
+    int64_t step_us;
+} automation_exec_t;
 static void automation_handle_event(const event_bus_message_t *msg);
-static event_bus_type_t event_name_to_type(const char *name);
-static const device_descriptor_t *find_device_by_id(const char *id);
-static const device_scenario_t *find_scenario_by_id(const device_descriptor_t *device, const char *id);
+static void handle_room_reset_command(const char *payload);
+static void ctx_str_copy(char *dst, size_t dst_len, const char *src);
 static void automation_context_set_internal(const char *key, const char *value);
 static void automation_context_clear_internal(const char *key);
 static size_t automation_context_lookup(const char *key, char *out, size_t out_len);
 static void automation_render_template(const char *src, char *dst, size_t dst_len);
 
+static void post_flag_changed(const char *name, bool value)
+{
+    event_bus_message_t msg = {
+        .type = EVENT_FLAG_CHANGED,
+    };
+    strncpy(msg.topic, name, sizeof(msg.topic) - 1);
+    strncpy(msg.payload, value ? "true" : "false", sizeof(msg.payload) - 1);
+    msg.topic[sizeof(msg.topic) - 1] = 0;
+    msg.payload[sizeof(msg.payload) - 1] = 0;
+    event_bus_post(&msg, pdMS_TO_TICKS(20));
+}
+
+static size_t flag_hash(const char *name)
+{
+    uint32_t hash = 2166136261u;
+    for (const char *p = name; *p; ++p) {
+        hash = (hash ^ (uint8_t)tolower((unsigned char)*p)) * 16777619u;
+    }
+    return hash & (AUTOMATION_FLAG_SLOTS - 1);
+}
+
+// s_flag_mutex must be held. Returns the flag's slot, or the empty slot it would take
+// (NULL when the table is full).
+static automation_flag_t *flag_slot(automation_flag_table_t *table, const char *name)
+{
+    size_t i = flag_hash(name);
+    for (size_t probe = 0; probe < AUTOMATION_FLAG_SLOTS; ++probe) {
+        automation_flag_t *slot = &table->slots[i];
+        if (!slot->in_use) {
+            return table->count < AUTOMATION_FLAG_CAPACITY ? slot : NULL;
+        }
+        if (strcasecmp(slot->name, name) == 0) {
+            return slot;
+        }
+        i = (i + 1) & (AUTOMATION_FLAG_SLOTS - 1);
+    }
+    return NULL;
+}
+
+static automation_flag_table_t *alloc_flag_table(void)
+{
+    automation_flag_table_t *table = heap_caps_calloc(1, sizeof(*table), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!table) {
+        table = heap_caps_calloc(1, sizeof(*table), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    return table;
+}
+
 static void automation_set_flag(const char *name, bool value)
 {
     if (!name || !name[0]) {
         return;
     }
-    if (!s_flag_mutex) {
+    if (!s_flag_mutex || !s_flags) {
         return;
     }
     xSemaphoreTake(s_flag_mutex, portMAX_DELAY);
-    automation_flag_t *slot = NULL;
-    for (size_t i = 0; i < AUTOMATION_FLAG_CAPACITY; ++i) {
-        if (s_flags[i].in_use && strcasecmp(s_flags[i].name, name) == 0) {
-            slot = &s_flags[i];
-            break;
-        }
-        if (!s_flags[i].in_use && !slot) {
-            slot = &s_flags[i];
-        }
-    }
+    automation_flag_t *slot = flag_slot(s_flags, name);
     if (slot) {
         bool changed = true;
         if (slot->in_use) {
@@ -120,18 +186,12 @@ static void automation_set_flag(const char *name, bool value)
             strncpy(slot->name, name, sizeof(slot->name) - 1);
             slot->name[sizeof(slot->name) - 1] = 0;
             slot->in_use = true;
+            s_flags->count++;
         }
         slot->value = value;
         ESP_LOGD(TAG, "flag %s=%d", slot->name, value);
         if (changed) {
-            event_bus_message_t msg = {
-                .type = EVENT_FLAG_CHANGED,
-            };
-            strncpy(msg.topic, slot->name, sizeof(msg.topic) - 1);
-            strncpy(msg.payload, value ? "true" : "false", sizeof(msg.payload) - 1);
-            msg.topic[sizeof(msg.topic) - 1] = 0;
-            msg.payload[sizeof(msg.payload) - 1] = 0;
-            event_bus_post(&msg, pdMS_TO_TICKS(20));
+            post_flag_changed(slot->name, value);
         }
     } else {
         ESP_LOGW(TAG, "no flag slot for %s", name);
@@ -141,395 +201,547 @@ static void automation_set_flag(const char *name, bool value)
 
 static bool automation_get_flag(const char *name)
 {
-    if (!name || !name[0] || !s_flag_mutex) {
+    if (!name || !name[0] || !s_flag_mutex || !s_flags) {
         return false;
     }
-    bool value = false;
     xSemaphoreTake(s_flag_mutex, portMAX_DELAY);
-    for (size_t i = 0; i < AUTOMATION_FLAG_CAPACITY; ++i) {
-        if (s_flags[i].in_use && strcasecmp(s_flags[i].name, name) == 0) {
-            value = s_flags[i].value;
-            break;
-        }
-    }
+    const automation_flag_t *slot = flag_slot(s_flags, name);
+    bool value = slot && slot->in_use && slot->value;
     xSemaphoreGive(s_flag_mutex);
     return value;
 }
 
-static event_bus_type_t event_name_to_type(const char *name)
+esp_err_t automation_engine_init(void)
 {
-    if (!name || !name[0]) {
-        return EVENT_NONE;
+    if (!s_trigger_mutex) {
+        s_trigger_mutex = xSemaphoreCreateMutex();
     }
-    for (size_t i = 0; i < sizeof(s_event_map) / sizeof(s_event_map[0]); ++i) {
-        if (strcasecmp(s_event_map[i].name, name) == 0) {
-            return s_event_map[i].type;
-        }
+    if (!s_flag_mutex) {
+        s_flag_mutex = xSemaphoreCreateMutex();
     }
-    return EVENT_NONE;
-}
-
-static bool automation_requirements_met(const device_wait_flags_t *wait)
-{
-    if (!wait || wait->requirement_count == 0) {
-        return true;
+    if (!s_context_mutex) {
+        s_context_mutex = xSemaphoreCreateMutex();
     }
-    bool any_met = false;
-    for (uint8_t i = 0; i < wait->requirement_count; ++i) {
-        bool state = automation_get_flag(wait->requirements[i].flag);
-        if (wait->requirements[i].required_state) {
-            if (!state && wait->mode == DEVICE_CONDITION_ALL) {
-                return false;
-            }
-            if (state && wait->mode == DEVICE_CONDITION_ANY) {
-                return true;
-            }
-            if (state) {
-                any_met = true;
-            }
-        } else {
-            if (state && wait->mode == DEVICE_CONDITION_ALL) {
-                return false;
-            }
-            if (!state && wait->mode == DEVICE_CONDITION_ANY) {
-                return true;
-            }
-            if (!state) {
-                any_met = true;
-            }
-        }
+    if (!s_flags) {
+        s_flags = alloc_flag_table();
+    }
+    if (!s_flag_baseline) {
+        s_flag_baseline = alloc_flag_table();
     }
-    return wait->mode == DEVICE_CONDITION_ALL ? true : any_met;
+    ESP_RETURN_ON_FALSE(s_trigger_mutex && s_flag_mutex && s_flags && s_flag_baseline, ESP_ERR_NO_MEM, TAG,
+                        "init alloc failed");
+    ESP_RETURN_ON_ERROR(automation_scheduler_init(), TAG, "scheduler init failed");
+    ESP_RETURN_ON_ERROR(automation_trace_init(), TAG, "trace init failed");
+    ESP_RETURN_ON_ERROR(event_bus_register_handler(automation_handle_event), TAG, "event reg failed");
+    return ESP_OK;
 }
 
-static bool automation_wait_for_flags(const device_wait_flags_t *wait)
+esp_err_t automation_engine_start(void)
 {
-    if (!wait) {
-        return true;
-    }
-    int64_t timeout_ms = wait->timeout_ms;
-    const int64_t start = esp_timer_get_time() / 1000;
-    while (!automation_requirements_met(wait)) {
-        if (timeout_ms > 0) {
-            int64_t now = esp_timer_get_time() / 1000;
-            if (now - start >= timeout_ms) {
-                ESP_LOGW(TAG, "wait flags timeout (%" PRIu32 " ms)", (uint32_t)wait->timeout_ms);
-                return false;
-            }
+    for (size_t i = 0; i < AUTOMATION_WORKER_COUNT + AUTOMATION_PRIORITY_WORKER_COUNT; ++i) {
+        if (!s_workers[i]) {
+            bool priority_lane = i >= AUTOMATION_WORKER_COUNT;
+            char name[16];
+            snprintf(name, sizeof(name), priority_lane ? "automation_hi%u" : "automation%u", (unsigned)i);
+            BaseType_t ok = xTaskCreate(automation_worker,
+                                        name,
+                                        AUTOMATION_WORKER_STACK,
+                                        (void *)(uintptr_t)(priority_lane ? AUTOMATION_PRIORITY_HIGH
+                                                                         : AUTOMATION_PRIORITY_LOW),
+                                        priority_lane ? AUTOMATION_WORKER_PRIO + 1 : AUTOMATION_WORKER_PRIO,
+                                        &s_workers[i]);
+            ESP_RETURN_ON_FALSE(ok == pdPASS, ESP_FAIL, TAG, "worker %u create failed", (unsigned)i);
         }
-        vTaskDelay(pdMS_TO_TICKS(50));
     }
-    return true;
+    automation_engine_reload();
+    // Runtimes exist once the config is registered; bring back their state before the first event.
+    automation_checkpoint_restore();
+    return automation_checkpoint_start(AUTOMATION_CHECKPOINT_INTERVAL_MS);
 }
 
-static const device_descriptor_t *find_device_by_id(const char *id)
+static int32_t bind_program(const automation_image_t *image, const char *device_id, const char *scenario_id)
 {
-    if (!id || !id[0]) {
-        return NULL;
-    }
-    const device_manager_config_t *cfg = device_manager_lock_config();
-    if (!cfg) {
-        device_manager_unlock_config();
-        return NULL;
-    }
-    const device_descriptor_t *result = NULL;
-    uint8_t limit = cfg->device_capacity ? cfg->device_capacity : DEVICE_MANAGER_MAX_DEVICES;
-    for (uint8_t i = 0; i < cfg->device_count && i < limit; ++i) {
-        const device_descriptor_t *dev = &cfg->devices[i];
-        if ((dev->id[0] && strcasecmp(dev->id, id) == 0) ||
-            (dev->display_name[0] && strcasecmp(dev->display_name, id) == 0)) {
-            result = dev;
-            break;
-        }
-    }
-    device_manager_unlock_config();
-    return result;
+    const automation_program_t *program = automation_image_find(image, device_id, scenario_id);
+    return program ? (int32_t)(program - image->programs) : AUTOMATION_PROGRAM_UNBOUND;
 }
 
-static const device_scenario_t *find_scenario_for_binding(const device_descriptor_t *device, const char *name)
+// s_trigger_mutex must be held; frees slots nobody holds and points the rest at the new image.
+static void rebind_handles_locked(void)
 {
-    if (!device || !name || !name[0]) {
-        return NULL;
-    }
-    for (uint8_t i = 0; i < device->scenario_count; ++i) {
-        const device_scenario_t *sc = &device->scenarios[i];
-        if ((sc->id[0] && strcasecmp(sc->id, name) == 0) ||
-            (sc->name[0] && strcasecmp(sc->name, name) == 0)) {
-            return sc;
+    for (size_t i = 0; i < s_handle_count; ++i) {
+        automation_handle_slot_t *slot = &s_handles[i];
+        if (!slot->refs) {
+            memset(slot, 0, sizeof(*slot));
+            continue;
         }
+        slot->program = bind_program(s_image, slot->device_id, slot->scenario_id);
+    }
+    while (s_handle_count && !s_handles[s_handle_count - 1].device_id[0]) {
+        --s_handle_count;
     }
-    return NULL;
 }
 
-static const device_scenario_t *find_scenario_by_id(const device_descriptor_t *device, const char *id)
+static esp_err_t enqueue_job(automation_image_t *image, const automation_program_t *program);
+static const char *program_label(const automation_image_t *image, const automation_program_t *program);
+
+// Trailing edge of a topic gate; runs on the timer wheel, which may take s_trigger_mutex.
+static void binding_gate_fire(dm_rate_gate_t *gate, void *arg)
 {
-    if (!device || !id || !id[0]) {
-        return NULL;
-    }
-    for (uint8_t i = 0; i < device->scenario_count; ++i) {
-        const device_scenario_t *sc = &device->scenarios[i];
-        if ((sc->id[0] && strcasecmp(sc->id, id) == 0) ||
-            (sc->name[0] && strcasecmp(sc->name, id) == 0)) {
-            return sc;
+    (void)arg;
+    automation_binding_gate_t *entry = (automation_binding_gate_t *)gate;
+    xSemaphoreTake(s_trigger_mutex, portMAX_DELAY);
+    automation_image_t *image = s_image;
+    if (image && entry->program < image->program_count) {
+        const automation_program_t *program = &image->programs[entry->program];
+        if (enqueue_job(image, program) == ESP_OK) {
+            ESP_LOGI(TAG, "queued scenario %s/%s (trailing edge)",
+                     automation_image_str(image, program->device_name),
+                     program_label(image, program));
         }
     }
-    return NULL;
+    xSemaphoreGive(s_trigger_mutex);
 }
 
-esp_err_t automation_engine_init(void)
+static automation_binding_gate_t *build_binding_gates(const automation_image_t *image)
 {
-    if (!s_trigger_mutex) {
-        s_trigger_mutex = xSemaphoreCreateMutex();
+    if (!image->binding_count) {
+        return NULL;
     }
-    if (!s_flag_mutex) {
-        s_flag_mutex = xSemaphoreCreateMutex();
+    size_t bytes = image->binding_count * sizeof(automation_binding_gate_t);
+    automation_binding_gate_t *gates = heap_caps_calloc(1, bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!gates) {
+        gates = heap_caps_calloc(1, bytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
     }
-    if (!s_context_mutex) {
-        s_context_mutex = xSemaphoreCreateMutex();
+    if (!gates) {
+        return NULL;
     }
-    if (!s_job_queue) {
-        s_job_queue = xQueueCreate(AUTOMATION_QUEUE_LENGTH, sizeof(automation_job_t));
+    for (size_t i = 0; i < image->binding_count; ++i) {
+        gates[i].program = image->bindings[i].program;
+        dm_rate_gate_init(&gates[i].gate, &image->bindings[i].limit, NULL, binding_gate_fire, NULL);
     }
-    ESP_RETURN_ON_FALSE(s_trigger_mutex && s_flag_mutex && s_job_queue, ESP_ERR_NO_MEM, TAG, "init alloc failed");
-    ESP_RETURN_ON_ERROR(event_bus_register_handler(automation_handle_event), TAG, "event reg failed");
-    return ESP_OK;
+    return gates;
 }
 
-esp_err_t automation_engine_start(void)
+// Wheel lock and s_trigger_mutex held, so no window of these gates can fire afterwards.
+static void retire_binding_gates_locked(automation_binding_gate_t *gates, size_t count)
 {
-    for (size_t i = 0; i < AUTOMATION_WORKER_COUNT; ++i) {
-        if (!s_workers[i]) {
-            char name[16];
-            snprintf(name, sizeof(name), "automation%u", (unsigned)i);
-            BaseType_t ok = xTaskCreate(automation_worker,
-                                        name,
-                                        AUTOMATION_WORKER_STACK,
-                                        NULL,
-                                        AUTOMATION_WORKER_PRIO,
-                                        &s_workers[i]);
-            ESP_RETURN_ON_FALSE(ok == pdPASS, ESP_FAIL, TAG, "worker %u create failed", (unsigned)i);
-        }
+    for (size_t i = 0; gates && i < count; ++i) {
+        dm_rate_gate_reset(&gates[i].gate);
+        s_retired_rate_passed += gates[i].gate.passed;
+        s_retired_rate_suppressed += gates[i].gate.suppressed;
     }
-    automation_engine_reload();
-    return ESP_OK;
 }
 
 void automation_engine_reload(void)
 {
-    size_t capacity = AUTOMATION_TRIGGER_CAPACITY;
-    automation_trigger_t *fresh = heap_caps_calloc(capacity, sizeof(automation_trigger_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-    if (!fresh) {
-        ESP_LOGE(TAG, "alloc triggers failed");
-        return;
-    }
-    const device_manager_config_t *cfg = device_manager_lock_config();
+    const device_manager_config_t *cfg = device_manager_acquire_config();
     if (!cfg) {
-        device_manager_unlock_config();
-        heap_caps_free(fresh);
         return;
     }
-    size_t count = 0;
-    uint8_t device_cap = cfg->device_capacity ? cfg->device_capacity : DEVICE_MANAGER_MAX_DEVICES;
-    for (uint8_t d = 0; d < cfg->device_count && d < device_cap; ++d) {
-        const device_descriptor_t *device = &cfg->devices[d];
-        for (uint8_t t = 0; t < device->topic_count && t < DEVICE_MANAGER_MAX_TOPICS_PER_DEVICE; ++t) {
-            const device_topic_binding_t *binding = &device->topics[t];
-            const device_scenario_t *scenario = find_scenario_for_binding(device, binding->name);
-            if (!scenario) {
-                ESP_LOGW(TAG, "device %s topic %s has no scenario %s", device->display_name, binding->topic, binding->name);
-                continue;
-            }
-            if (!binding->topic[0]) {
-                continue;
-            }
-            if (count >= capacity) {
-                break;
-            }
-            automation_trigger_t *tr = &fresh[count++];
-            strncpy(tr->topic, binding->topic, sizeof(tr->topic) - 1);
-            tr->device = device;
-            tr->scenario = scenario;
+    // Programs only depend on the devices' topics, scenarios and topic limits, not on templates.
+    uint8_t device_count = cfg->device_count < cfg->device_capacity ? cfg->device_count : cfg->device_capacity;
+    uint64_t source_hash = device_count;
+    for (uint8_t i = 0; i < device_count; ++i) {
+        source_hash = source_hash * 31 + dm_config_device_digest(&cfg->devices[i], false);
+    }
+    if (s_image && source_hash == s_image_source_hash) {
+        device_manager_release_config(cfg);
+        // Template edits land here too; their runtimes released the old handles.
+        if (s_trigger_mutex) {
+            xSemaphoreTake(s_trigger_mutex, portMAX_DELAY);
+            rebind_handles_locked();
+            xSemaphoreGive(s_trigger_mutex);
         }
+        ESP_LOGI(TAG, "device content unchanged, keeping compiled scenarios");
+        return;
     }
-    device_manager_unlock_config();
+    automation_image_t *fresh = NULL;
+    esp_err_t err = automation_image_build(cfg, &fresh);
+    device_manager_release_config(cfg);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "scenario compile failed: %s", esp_err_to_name(err));
+        return;
+    }
+    automation_binding_gate_t *fresh_gates = build_binding_gates(fresh);
+    if (fresh->binding_count && !fresh_gates) {
+        ESP_LOGE(TAG, "no memory for topic rate gates");
+        automation_image_release(fresh);
+        return;
+    }
+    dm_timer_wheel_lock();
     if (s_trigger_mutex) {
         xSemaphoreTake(s_trigger_mutex, portMAX_DELAY);
     }
-    if (s_triggers) {
-        heap_caps_free(s_triggers);
-    }
-    s_triggers = fresh;
-    s_trigger_count = count;
+    automation_image_t *old = s_image;
+    automation_binding_gate_t *old_gates = s_binding_gates;
+    retire_binding_gates_locked(old_gates, old ? old->binding_count : 0);
+    s_image = fresh;
+    s_binding_gates = fresh_gates;
+    s_image_source_hash = source_hash;
+    rebind_handles_locked();
     if (s_trigger_mutex) {
         xSemaphoreGive(s_trigger_mutex);
     }
-    ESP_LOGI(TAG, "automation triggers: %zu", count);
+    dm_timer_wheel_unlock();
+    heap_caps_free(old_gates);
+    automation_image_release(old);
+    automation_trace_retain(fresh);
+    ESP_LOGI(TAG, "automation triggers: %zu, programs: %zu (%zu instr, %zu bytes)",
+             fresh->binding_count,
+             fresh->program_count,
+             fresh->insn_count,
+             automation_image_footprint(fresh));
+}
+
+static const char *program_label(const automation_image_t *image, const automation_program_t *program)
+{
+    const char *name = automation_image_str(image, program->scenario_name);
+    return name[0] ? name : automation_image_str(image, program->scenario_id);
 }
 
-static esp_err_t enqueue_job(const device_descriptor_t *device, const device_scenario_t *scenario)
+static esp_err_t enqueue_job(automation_image_t *image, const automation_program_t *program)
 {
-    if (!device || !scenario || !s_job_queue) {
+    if (!image || !program) {
         return ESP_ERR_INVALID_ARG;
     }
-    automation_job_t job = {
-        .device = device,
-        .scenario = scenario,
-    };
-    if (xQueueSend(s_job_queue, &job, pdMS_TO_TICKS(10)) != pdTRUE) {
-        ESP_LOGW(TAG, "job queue full");
-        return ESP_ERR_TIMEOUT;
+    esp_err_t err = automation_scheduler_submit(image, program);
+    if (err == ESP_ERR_TIMEOUT) {
+        ESP_LOGW(TAG, "job queue full (%s)", automation_priority_to_string((automation_priority_t)program->priority));
     }
-    return ESP_OK;
+    return err;
 }
 
 bool automation_engine_handle_mqtt(const char *topic, const char *payload)
 {
     (void)payload;
-    if (!topic || !s_job_queue) {
+    if (!topic || !s_trigger_mutex) {
+        return false;
+    }
+    // Gates take the wheel lock; it ranks above s_trigger_mutex.
+    dm_timer_wheel_lock();
+    if (xSemaphoreTake(s_trigger_mutex, AUTOMATION_RELOAD_LOCK_TIMEOUT) != pdTRUE) {
+        dm_timer_wheel_unlock();
         return false;
     }
     bool handled = false;
-    if (s_trigger_mutex) {
-        xSemaphoreTake(s_trigger_mutex, AUTOMATION_RELOAD_LOCK_TIMEOUT);
-    }
-    for (size_t i = 0; i < s_trigger_count; ++i) {
-        const automation_trigger_t *tr = &s_triggers[i];
-        if (strcmp(tr->topic, topic) == 0) {
-            if (enqueue_job(tr->device, tr->scenario) == ESP_OK) {
-                handled = true;
-                ESP_LOGI(TAG, "queued scenario %s/%s for topic %s",
-                         tr->device->display_name,
-                         tr->scenario->name[0] ? tr->scenario->name : tr->scenario->id,
-                         topic);
-            } else {
-                ESP_LOGW(TAG, "job queue full for topic %s", topic);
-            }
+    automation_image_t *image = s_image;
+    for (size_t i = 0; image && i < image->binding_count; ++i) {
+        const automation_binding_t *binding = &image->bindings[i];
+        if (strcmp(automation_image_str(image, binding->topic), topic) != 0) {
+            continue;
+        }
+        const automation_program_t *program = &image->programs[binding->program];
+        if (!dm_rate_gate_admit(&s_binding_gates[i].gate)) {
+            handled = true;
+            ESP_LOGD(TAG, "topic %s rate limited for %s", topic, program_label(image, program));
+            continue;
+        }
+        if (enqueue_job(image, program) == ESP_OK) {
+            handled = true;
+            ESP_LOGI(TAG, "queued scenario %s/%s for topic %s",
+                     automation_image_str(image, program->device_name),
+                     program_label(image, program),
+                     topic);
+        } else {
+            ESP_LOGW(TAG, "job queue full for topic %s", topic);
         }
     }
-    if (s_trigger_mutex) {
-        xSemaphoreGive(s_trigger_mutex);
-    }
+    xSemaphoreGive(s_trigger_mutex);
+    dm_timer_wheel_unlock();
     return handled;
 }
 
 esp_err_t automation_engine_trigger(const char *device_id, const char *scenario_id)
 {
-    const device_descriptor_t *device = find_device_by_id(device_id);
-    if (!device) {
-        return ESP_ERR_NOT_FOUND;
+    if (!s_trigger_mutex) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(s_trigger_mutex, portMAX_DELAY);
+    automation_image_t *image = s_image;
+    const automation_program_t *program = automation_image_find(image, device_id, scenario_id);
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    if (program) {
+        ESP_LOGI(TAG, "manual trigger %s/%s",
+                 automation_image_str(image, program->device_name),
+                 program_label(image, program));
+        err = enqueue_job(image, program);
+    }
+    xSemaphoreGive(s_trigger_mutex);
+    return err;
+}
+
+automation_scenario_handle_t automation_engine_resolve(const char *device_id, const char *scenario_id)
+{
+    if (!device_id || !device_id[0] || !scenario_id || !scenario_id[0]) {
+        return AUTOMATION_SCENARIO_HANDLE_INVALID;
+    }
+    // Template runtimes register before the engine starts, so the table may be set up here first.
+    if (!s_trigger_mutex) {
+        s_trigger_mutex = xSemaphoreCreateMutex();
+        if (!s_trigger_mutex) {
+            return AUTOMATION_SCENARIO_HANDLE_INVALID;
+        }
+    }
+    xSemaphoreTake(s_trigger_mutex, portMAX_DELAY);
+    automation_scenario_handle_t handle = AUTOMATION_SCENARIO_HANDLE_INVALID;
+    if (!s_handles) {
+        s_handles = heap_caps_calloc(AUTOMATION_HANDLE_CAPACITY, sizeof(automation_handle_slot_t),
+                                     MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!s_handles) {
+            s_handles = heap_caps_calloc(AUTOMATION_HANDLE_CAPACITY, sizeof(automation_handle_slot_t),
+                                         MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        }
+    }
+    size_t free_slot = s_handle_count;
+    for (size_t i = 0; s_handles && i < s_handle_count; ++i) {
+        if (!s_handles[i].device_id[0]) {
+            free_slot = free_slot < i ? free_slot : i;
+        } else if (strcasecmp(s_handles[i].device_id, device_id) == 0 &&
+                   strcasecmp(s_handles[i].scenario_id, scenario_id) == 0) {
+            handle = (automation_scenario_handle_t)i;
+            break;
+        }
+    }
+    if (handle == AUTOMATION_SCENARIO_HANDLE_INVALID && s_handles && free_slot < AUTOMATION_HANDLE_CAPACITY) {
+        automation_handle_slot_t *slot = &s_handles[free_slot];
+        ctx_str_copy(slot->device_id, sizeof(slot->device_id), device_id);
+        ctx_str_copy(slot->scenario_id, sizeof(slot->scenario_id), scenario_id);
+        slot->program = bind_program(s_image, slot->device_id, slot->scenario_id);
+        handle = (automation_scenario_handle_t)free_slot;
+        if (free_slot == s_handle_count) {
+            ++s_handle_count;
+        }
+    }
+    if (handle != AUTOMATION_SCENARIO_HANDLE_INVALID) {
+        ++s_handles[handle].refs;
+    }
+    xSemaphoreGive(s_trigger_mutex);
+    if (handle == AUTOMATION_SCENARIO_HANDLE_INVALID) {
+        ESP_LOGW(TAG, "no handle for %s/%s", device_id, scenario_id);
+    }
+    return handle;
+}
+
+// The slot stays until the next reload, so a runtime re-registered in between gets it back.
+void automation_engine_release(automation_scenario_handle_t handle)
+{
+    if (!s_trigger_mutex || handle == AUTOMATION_SCENARIO_HANDLE_INVALID) {
+        return;
     }
-    const device_scenario_t *scenario = find_scenario_by_id(device, scenario_id);
-    if (!scenario) {
-        return ESP_ERR_NOT_FOUND;
+    xSemaphoreTake(s_trigger_mutex, portMAX_DELAY);
+    if (handle < s_handle_count && s_handles[handle].refs) {
+        --s_handles[handle].refs;
     }
-    ESP_LOGI(TAG, "manual trigger %s/%s",
-             device->display_name,
-             scenario->name[0] ? scenario->name : scenario->id);
-    return enqueue_job(device, scenario);
+    xSemaphoreGive(s_trigger_mutex);
+}
+
+esp_err_t automation_engine_trigger_handle(automation_scenario_handle_t handle)
+{
+    if (!s_trigger_mutex) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    xSemaphoreTake(s_trigger_mutex, portMAX_DELAY);
+    if (handle >= s_handle_count || !s_handles[handle].device_id[0]) {
+        xSemaphoreGive(s_trigger_mutex);
+        return ESP_ERR_INVALID_ARG;
+    }
+    automation_image_t *image = s_image;
+    int32_t index = s_handles[handle].program;
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    if (image && index != AUTOMATION_PROGRAM_UNBOUND) {
+        err = enqueue_job(image, &image->programs[index]);
+    }
+    xSemaphoreGive(s_trigger_mutex);
+    return err;
 }
 
 static void automation_worker(void *param)
 {
-    (void)param;
-    automation_job_t job;
+    automation_priority_t min_priority = (automation_priority_t)(uintptr_t)param;
     while (1) {
-        if (xQueueReceive(s_job_queue, &job, portMAX_DELAY) == pdTRUE) {
-            automation_execute_job(&job);
+        automation_job_t *job = automation_scheduler_take(min_priority, portMAX_DELAY);
+        if (job) {
+            automation_execute_job(job);
+            automation_scheduler_finish(job);
         }
     }
 }
 
-static void automation_execute_job(const automation_job_t *job)
+// Branches stop together with the job that forked them; the parent slot outlives its branches.
+static bool job_cancelled(const automation_job_t *job)
+{
+    return job && (job->cancel || (job->parent && job->parent->cancel));
+}
+
+// Closes the running step's timing; the VM calls step_begin on every step change.
+static void exec_step_close(automation_exec_t *exec, int64_t now_us)
+{
+    if (exec->step != UINT16_MAX) {
+        automation_trace_step(&exec->trace, exec->step, (uint32_t)(now_us - exec->step_us));
+    }
+    exec->step_us = now_us;
+}
+
+static void vm_step_begin(void *ctx, uint16_t step)
+{
+    automation_exec_t *exec = (automation_exec_t *)ctx;
+    exec_step_close(exec, esp_timer_get_time());
+    exec->step = step;
+}
+
+// Sleeps in slices so a replaced or cancelled job stops promptly.
+static void vm_sleep_ms(void *ctx, uint32_t ms)
+{
+    const automation_job_t *job = ((const automation_exec_t *)ctx)->job;
+    while (ms > 0 && !job_cancelled(job)) {
+        uint32_t slice = ms > AUTOMATION_SLEEP_SLICE_MS ? AUTOMATION_SLEEP_SLICE_MS : ms;
+        vTaskDelay(pdMS_TO_TICKS(slice));
+        ms -= slice;
+    }
+}
+
+static bool vm_cancelled(void *ctx)
+{
+    return job_cancelled(((const automation_exec_t *)ctx)->job);
+}
+
+static bool vm_fork(void *ctx, uint32_t start, uint32_t end)
+{
+    automation_job_t *job = ((automation_exec_t *)ctx)->job;
+    if (!job || job->parent) {
+        return false;
+    }
+    return automation_scheduler_fork(job, (uint16_t)start, (uint16_t)end) == ESP_OK;
+}
+
+// Runs the job's own queued branches while waiting so joins cannot starve the workers.
+static void vm_join(void *ctx, uint32_t timeout_ms)
 {
-    if (!job || !job->scenario || job->scenario->step_count == 0) {
+    automation_job_t *job = ((automation_exec_t *)ctx)->job;
+    if (!job) {
         return;
     }
-    const device_action_step_t *steps = job->scenario->steps;
-    uint8_t total = job->scenario->step_count;
-    uint16_t loop_counters[DEVICE_MANAGER_MAX_STEPS_PER_SCENARIO] = {0};
-    ESP_LOGI(TAG, "run scenario %s/%s (%u steps)",
-             job->device ? job->device->display_name : "device",
-             job->scenario->name[0] ? job->scenario->name : job->scenario->id,
-             total);
-    uint8_t idx = 0;
-    while (idx < total) {
-        const device_action_step_t *step = &steps[idx];
-        if (step->delay_ms > 0) {
-            vTaskDelay(pdMS_TO_TICKS(step->delay_ms));
-        }
-        switch (step->type) {
-        case DEVICE_ACTION_MQTT_PUBLISH:
-            if (step->data.mqtt.topic[0]) {
-                char topic[DEVICE_MANAGER_TOPIC_MAX_LEN];
-                char payload[DEVICE_MANAGER_PAYLOAD_MAX_LEN];
-                automation_render_template(step->data.mqtt.topic, topic, sizeof(topic));
-                automation_render_template(step->data.mqtt.payload, payload, sizeof(payload));
-                if (topic[0]) {
-                    mqtt_core_publish(topic, payload);
-                    dm_template_runtime_handle_mqtt(topic, payload);
-                } else {
-                    ESP_LOGW(TAG, "mqtt_publish skipped (empty topic)");
-                }
-            }
-            break;
-        case DEVICE_ACTION_AUDIO_PLAY:
-            if (step->data.audio.track[0]) {
-                char track[DEVICE_MANAGER_TRACK_NAME_MAX_LEN];
-                automation_render_template(step->data.audio.track, track, sizeof(track));
-                if (track[0]) {
-                    audio_player_play(track);
-                } else {
-                    ESP_LOGW(TAG, "audio_play skipped (empty track)");
-                }
-            }
-            break;
-        case DEVICE_ACTION_AUDIO_STOP:
-            audio_player_stop();
-            break;
-        case DEVICE_ACTION_SET_FLAG:
-            automation_set_flag(step->data.flag.flag, step->data.flag.value);
-            break;
-        case DEVICE_ACTION_WAIT_FLAGS:
-            automation_wait_for_flags(&step->data.wait_flags);
-            break;
-        case DEVICE_ACTION_LOOP: {
-            uint16_t target = step->data.loop.target_step;
-            uint16_t max_iter = step->data.loop.max_iterations;
-            if (target < total) {
-                uint16_t *counter = &loop_counters[idx];
-                if (max_iter == 0 || *counter < max_iter) {
-                    (*counter)++;
-                    idx = target;
-                    continue;
-                }
-            }
-            break;
-        }
-        case DEVICE_ACTION_DELAY:
-            break;
-        case DEVICE_ACTION_EVENT_BUS: {
-            event_bus_type_t type = event_name_to_type(step->data.event.event);
-            if (type == EVENT_NONE) {
-                ESP_LOGW(TAG, "unknown event action: %s", step->data.event.event);
-                break;
-            }
-            event_bus_message_t msg = {
-                .type = type,
-            };
-            if (step->data.event.topic[0]) {
-                automation_render_template(step->data.event.topic, msg.topic, sizeof(msg.topic));
-            }
-            if (step->data.event.payload[0]) {
-                automation_render_template(step->data.event.payload, msg.payload, sizeof(msg.payload));
-            }
-            event_bus_post(&msg, pdMS_TO_TICKS(50));
-            break;
+    const int64_t start = esp_timer_get_time() / 1000;
+    while (automation_scheduler_children(job) > 0 && !job_cancelled(job)) {
+        automation_job_t *branch = automation_scheduler_take_child(job);
+        if (branch) {
+            automation_execute_job(branch);
+            automation_scheduler_finish(branch);
+            continue;
         }
-        case DEVICE_ACTION_NOP:
-        default:
-            break;
+        if (timeout_ms > 0 && esp_timer_get_time() / 1000 - start >= (int64_t)timeout_ms) {
+            ESP_LOGW(TAG, "join timeout (%" PRIu32 " ms), %u branch(es) still running",
+                     timeout_ms, automation_scheduler_children(job));
+            return;
         }
-        idx++;
+        vTaskDelay(pdMS_TO_TICKS(AUTOMATION_JOIN_POLL_MS));
+    }
+}
+
+static int64_t vm_now_ms(void *ctx)
+{
+    (void)ctx;
+    return esp_timer_get_time() / 1000;
+}
+
+static void vm_mqtt_publish(void *ctx, const char *topic, const char *payload)
+{
+    (void)ctx;
+    mqtt_core_publish(topic, payload);
+    dm_template_runtime_handle_mqtt(topic, payload);
+}
+
+static void vm_audio_play(void *ctx, const char *track)
+{
+    (void)ctx;
+    audio_player_play(track);
+}
+
+static void vm_audio_stop(void *ctx)
+{
+    (void)ctx;
+    audio_player_stop();
+}
+
+static void vm_set_flag(void *ctx, const char *name, bool value)
+{
+    (void)ctx;
+    automation_set_flag(name, value);
+}
+
+static bool vm_get_flag(void *ctx, const char *name)
+{
+    (void)ctx;
+    return automation_get_flag(name);
+}
+
+static void vm_post_event(void *ctx, int type, const char *topic, const char *payload)
+{
+    (void)ctx;
+    event_bus_message_t msg = {
+        .type = (event_bus_type_t)type,
+    };
+    ctx_str_copy(msg.topic, sizeof(msg.topic), topic);
+    ctx_str_copy(msg.payload, sizeof(msg.payload), payload);
+    event_bus_post(&msg, pdMS_TO_TICKS(50));
+}
+
+static void vm_render(void *ctx, const char *src, char *dst, size_t dst_len)
+{
+    (void)ctx;
+    automation_render_template(src, dst, dst_len);
+}
+
+static const automation_vm_env_t s_vm_env = {
+    .sleep_ms = vm_sleep_ms,
+    .now_ms = vm_now_ms,
+    .mqtt_publish = vm_mqtt_publish,
+    .audio_play = vm_audio_play,
+    .audio_stop = vm_audio_stop,
+    .set_flag = vm_set_flag,
+    .get_flag = vm_get_flag,
+    .post_event = vm_post_event,
+    .render = vm_render,
+    .cancelled = vm_cancelled,
+    .fork = vm_fork,
+    .join = vm_join,
+    .step_begin = vm_step_begin,
+};
+
+static void automation_execute_job(automation_job_t *job)
+{
+    if (!job || !job->image || !job->program || job->program->step_count == 0) {
+        return;
+    }
+    automation_exec_t exec = {
+        .job = job,
+        .trace = automation_trace_lookup(job->image, job->program),
+        .step = UINT16_MAX,
+        .step_us = esp_timer_get_time(),
+    };
+    automation_vm_env_t env = s_vm_env;
+    env.ctx = &exec;
+    if (job->parent) {
+        automation_vm_run_range(job->image, job->program, job->pc_start, job->pc_end, &env);
+        exec_step_close(&exec, esp_timer_get_time());
+        return;
+    }
+    ESP_LOGI(TAG, "run scenario %s/%s (%u steps, waited %lld ms)",
+             automation_image_str(job->image, job->program->device_name),
+             program_label(job->image, job->program),
+             job->program->step_count,
+             (long long)((job->started_us - job->enqueued_us) / 1000));
+    esp_err_t err = automation_vm_run(job->image, job->program, &env);
+    int64_t done_us = esp_timer_get_time();
+    exec_step_close(&exec, done_us);
+    automation_trace_run(&exec.trace, job->started_us - job->enqueued_us, done_us - job->started_us, err);
+    if (err == ESP_ERR_INVALID_STATE) {
+        ESP_LOGI(TAG, "scenario cancelled");
+        return;
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "scenario aborted: %s", esp_err_to_name(err));
+        return;
     }
     ESP_LOGI(TAG, "scenario finished");
 }
@@ -544,7 +756,9 @@ static void automation_handle_event(const event_bus_message_t *msg)
         automation_engine_reload();
         break;
     case EVENT_MQTT_MESSAGE:
-        if (msg->topic[0]) {
+        if (strcmp(msg->topic, AUTOMATION_ROOM_RESET_TOPIC) == 0) {
+            handle_room_reset_command(msg->payload);
+        } else if (msg->topic[0]) {
             automation_engine_handle_mqtt(msg->topic, msg->payload);
         }
         break;
@@ -715,3 +929,222 @@ void automation_engine_clear_variable(const char *key)
 {
     automation_context_clear_internal(key);
 }
+
+size_t automation_engine_export_flags(automation_flag_record_t *out, size_t max)
+{
+    if (!out || !s_flag_mutex || !s_flags) {
+        return 0;
+    }
+    size_t count = 0;
+    xSemaphoreTake(s_flag_mutex, portMAX_DELAY);
+    for (size_t i = 0; i < AUTOMATION_FLAG_SLOTS && count < max; ++i) {
+        const automation_flag_t *flag = &s_flags->slots[i];
+        if (flag->in_use) {
+            memset(&out[count], 0, sizeof(out[count]));
+            memcpy(out[count].name, flag->name, sizeof(out[count].name));
+            out[count].value = flag->value;
+            count++;
+        }
+    }
+    xSemaphoreGive(s_flag_mutex);
+    return count;
+}
+
+void automation_engine_import_flags(const automation_flag_record_t *flags, size_t count)
+{
+    if (!s_flag_mutex || !s_flags) {
+        return;
+    }
+    xSemaphoreTake(s_flag_mutex, portMAX_DELAY);
+    memset(s_flags, 0, sizeof(*s_flags));
+    for (size_t i = 0; flags && i < count; ++i) {
+        char name[DEVICE_MANAGER_FLAG_NAME_MAX_LEN];
+        ctx_str_copy(name, sizeof(name), flags[i].name);
+        automation_flag_t *slot = name[0] ? flag_slot(s_flags, name) : NULL;
+        if (!slot) {
+            continue;
+        }
+        if (!slot->in_use) {
+            ctx_str_copy(slot->name, sizeof(slot->name), name);
+            slot->in_use = true;
+            s_flags->count++;
+        }
+        slot->value = flags[i].value;
+    }
+    xSemaphoreGive(s_flag_mutex);
+}
+
+size_t automation_engine_export_variables(automation_var_record_t *out, size_t max)
+{
+    if (!out || !s_context_mutex) {
+        return 0;
+    }
+    size_t count = 0;
+    xSemaphoreTake(s_context_mutex, portMAX_DELAY);
+    for (size_t i = 0; i < AUTOMATION_CONTEXT_MAX_VARS && count < max; ++i) {
+        if (s_context_vars[i].in_use) {
+            memset(&out[count], 0, sizeof(out[count]));
+            memcpy(out[count].key, s_context_vars[i].key, sizeof(out[count].key));
+            memcpy(out[count].value, s_context_vars[i].value, sizeof(out[count].value));
+            count++;
+        }
+    }
+    xSemaphoreGive(s_context_mutex);
+    return count;
+}
+
+void automation_engine_import_variables(const automation_var_record_t *vars, size_t count)
+{
+    if (!s_context_mutex) {
+        return;
+    }
+    xSemaphoreTake(s_context_mutex, portMAX_DELAY);
+    memset(s_context_vars, 0, sizeof(s_context_vars));
+    for (size_t i = 0; vars && i < count && i < AUTOMATION_CONTEXT_MAX_VARS; ++i) {
+        automation_context_var_t *var = &s_context_vars[i];
+        ctx_str_copy(var->key, sizeof(var->key), vars[i].key);
+        ctx_str_copy(var->value, sizeof(var->value), vars[i].value);
+        var->in_use = var->key[0] != 0;
+    }
+    xSemaphoreGive(s_context_mutex);
+}
+
+size_t automation_engine_save_flag_baseline(void)
+{
+    if (!s_flag_mutex || !s_flags) {
+        return 0;
+    }
+    xSemaphoreTake(s_flag_mutex, portMAX_DELAY);
+    *s_flag_baseline = *s_flags;
+    size_t count = s_flag_baseline->count;
+    xSemaphoreGive(s_flag_mutex);
+    ESP_LOGI(TAG, "flag baseline saved (%zu flags)", count);
+    return count;
+}
+
+esp_err_t automation_engine_room_reset(bool restore_baseline, automation_room_reset_report_t *out)
+{
+    if (!s_trigger_mutex || !s_flag_mutex || !s_context_mutex || !s_flags) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    automation_room_reset_report_t report = {0};
+    int64_t start_us = esp_timer_get_time();
+    automation_flag_record_t *restored = NULL;
+    if (restore_baseline) {
+        restored = heap_caps_malloc(AUTOMATION_FLAG_CAPACITY * sizeof(*restored), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!restored) {
+            restored = heap_caps_malloc(AUTOMATION_FLAG_CAPACITY * sizeof(*restored), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        }
+        ESP_RETURN_ON_FALSE(restored, ESP_ERR_NO_MEM, TAG, "reset alloc failed");
+    }
+
+    // MQTT dispatch and timer callbacks run under the wheel lock, which ranks above the trigger,
+    // flag and context mutexes; holding it throughout makes the reset one step for them.
+    dm_timer_wheel_lock();
+    xSemaphoreTake(s_trigger_mutex, portMAX_DELAY);
+    report.jobs_cancelled = automation_scheduler_cancel_all();
+    report.runtimes = (uint32_t)dm_template_runtime_reset_state();
+    for (size_t i = 0; s_image && s_binding_gates && i < s_image->binding_count; ++i) {
+        dm_rate_gate_reset(&s_binding_gates[i].gate);
+    }
+    xSemaphoreGive(s_trigger_mutex);
+
+    // Cleared flags raise no events: the runtimes that would react were just reset. Baseline
+    // flags do, once every lock is released, so triggers and conditions pick them up like
+    // any other change.
+    xSemaphoreTake(s_flag_mutex, portMAX_DELAY);
+    report.flags_cleared = (uint32_t)s_flags->count;
+    if (restore_baseline) {
+        *s_flags = *s_flag_baseline;
+    } else {
+        memset(s_flags, 0, sizeof(*s_flags));
+    }
+    for (size_t i = 0; restored && i < AUTOMATION_FLAG_SLOTS; ++i) {
+        const automation_flag_t *flag = &s_flags->slots[i];
+        if (flag->in_use) {
+            automation_flag_record_t *rec = &restored[report.baseline_flags++];
+            memcpy(rec->name, flag->name, sizeof(rec->name));
+            rec->value = flag->value;
+        }
+    }
+    xSemaphoreGive(s_flag_mutex);
+
+    xSemaphoreTake(s_context_mutex, portMAX_DELAY);
+    for (size_t i = 0; i < AUTOMATION_CONTEXT_MAX_VARS; ++i) {
+        report.variables_cleared += s_context_vars[i].in_use;
+    }
+    memset(s_context_vars, 0, sizeof(s_context_vars));
+    xSemaphoreGive(s_context_mutex);
+    dm_timer_wheel_unlock();
+
+    audio_player_stop();
+    for (uint32_t i = 0; i < report.baseline_flags; ++i) {
+        post_flag_changed(restored[i].name, restored[i].value);
+    }
+    heap_caps_free(restored);
+
+    report.duration_us = esp_timer_get_time() - start_us;
+    ESP_LOGI(TAG, "room reset in %lld us: %" PRIu32 " runtimes, %" PRIu32 " jobs, %" PRIu32 " flags, "
+             "%" PRIu32 " vars cleared, %" PRIu32 " baseline flags",
+             (long long)report.duration_us,
+             report.runtimes,
+             report.jobs_cancelled,
+             report.flags_cleared,
+             report.variables_cleared,
+             report.baseline_flags);
+    if (out) {
+        *out = report;
+    }
+    return ESP_OK;
+}
+
+// Payload "baseline" restores the saved flag set, "save_baseline" captures it instead.
+// The report goes to <topic>/done.
+static void handle_room_reset_command(const char *payload)
+{
+    const char *cmd = payload ? payload : "";
+    if (strcasecmp(cmd, "save_baseline") == 0) {
+        automation_engine_save_flag_baseline();
+        return;
+    }
+    automation_room_reset_report_t report;
+    if (automation_engine_room_reset(strcasecmp(cmd, "baseline") == 0, &report) != ESP_OK) {
+        return;
+    }
+    char reply[160];
+    snprintf(reply, sizeof(reply),
+             "{\"duration_us\":%lld,\"runtimes\":%" PRIu32 ",\"jobs_cancelled\":%" PRIu32
+             ",\"flags_cleared\":%" PRIu32 ",\"variables_cleared\":%" PRIu32 ",\"baseline_flags\":%" PRIu32 "}",
+             (long long)report.duration_us,
+             report.runtimes,
+             report.jobs_cancelled,
+             report.flags_cleared,
+             report.variables_cleared,
+             report.baseline_flags);
+    mqtt_core_publish(AUTOMATION_ROOM_RESET_TOPIC "/done", reply);
+}
+
+void automation_engine_get_scheduler_stats(automation_scheduler_stats_t *out)
+{
+    automation_scheduler_get_stats(out);
+    if (!out) {
+        return;
+    }
+    dm_template_runtime_stats_t rt;
+    dm_template_runtime_get_stats(&rt);
+    out->rate_passed = rt.rate_passed;
+    out->rate_suppressed = rt.rate_suppressed;
+    if (!s_trigger_mutex) {
+        return;
+    }
+    dm_timer_wheel_lock();
+    xSemaphoreTake(s_trigger_mutex, portMAX_DELAY);
+    out->rate_passed += s_retired_rate_passed;
+    out->rate_suppressed += s_retired_rate_suppressed;
+    for (size_t i = 0; s_image && s_binding_gates && i < s_image->binding_count; ++i) {
+        out->rate_passed += s_binding_gates[i].gate.passed;
+        out->rate_suppressed += s_binding_gates[i].gate.suppressed;
+    }
+    xSemaphoreGive(s_trigger_mutex);
+    dm_timer_wheel_unlock();
+}
@@ -0,0 +1,47 @@
+#include "automation_histogram.h"
+
+#include <stddef.h>
+
+const uint32_t automation_histogram_bucket_ms[AUTOMATION_HISTOGRAM_BUCKETS] = {
+    1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000, 30000, 60000, UINT32_MAX,
+};
+
+void automation_histogram_add(automation_histogram_t *hist, uint32_t ms)
+{
+    if (!hist) {
+        return;
+    }
+    size_t bucket = 0;
+    while (bucket + 1 < AUTOMATION_HISTOGRAM_BUCKETS && ms > automation_histogram_bucket_ms[bucket]) {
+        bucket++;
+    }
+    hist->buckets[bucket]++;
+    hist->count++;
+    hist->total_ms += ms;
+    if (ms > hist->max_ms) {
+        hist->max_ms = ms;
+    }
+}
+
+uint32_t automation_histogram_percentile(const automation_histogram_t *hist, uint8_t percentile)
+{
+    if (!hist || hist->count == 0) {
+        return 0;
+    }
+    if (percentile > 100) {
+        percentile = 100;
+    }
+    uint64_t rank = ((uint64_t)hist->count * percentile + 99) / 100;
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < AUTOMATION_HISTOGRAM_BUCKETS; ++i) {
+        seen += hist->buckets[i];
+        if (seen >= rank) {
+            uint32_t bound = automation_histogram_bucket_ms[i];
+            return bound > hist->max_ms ? hist->max_ms : bound;
+        }
+    }
+    return hist->max_ms;
+}
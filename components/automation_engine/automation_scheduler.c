@@ -0,0 +1,402 @@
+#include "automation_scheduler.h"
+
+#include <string.h>
+#include <strings.h>
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#define SCHED_POOL_SIZE (AUTOMATION_SCHED_CLASS_DEPTH * AUTOMATION_PRIORITY_COUNT + AUTOMATION_SCHED_MAX_RUNNING)
+
+typedef struct {
+    automation_job_t *head;
+    automation_job_t *tail;
+    uint32_t count;
+} sched_queue_t;
+
+static const char *TAG = "automation_sched";
+static automation_job_t s_pool[SCHED_POOL_SIZE];
+static automation_job_t *s_free;
+static sched_queue_t s_pending[AUTOMATION_PRIORITY_COUNT];
+static automation_job_t *s_running;
+static uint32_t s_running_count;
+static automation_scheduler_stats_t s_stats;
+static SemaphoreHandle_t s_lock;
+static SemaphoreHandle_t s_wake_any;
+static SemaphoreHandle_t s_wake_high;
+
+esp_err_t automation_scheduler_init(void)
+{
+    if (s_lock) {
+        return ESP_OK;
+    }
+    s_lock = xSemaphoreCreateMutex();
+    s_wake_any = xSemaphoreCreateCounting(SCHED_POOL_SIZE, 0);
+    s_wake_high = xSemaphoreCreateCounting(SCHED_POOL_SIZE, 0);
+    if (!s_lock || !s_wake_any || !s_wake_high) {
+        ESP_LOGE(TAG, "scheduler alloc failed");
+        return ESP_ERR_NO_MEM;
+    }
+    s_free = NULL;
+    for (size_t i = 0; i < SCHED_POOL_SIZE; ++i) {
+        s_pool[i].next = s_free;
+        s_free = &s_pool[i];
+    }
+    return ESP_OK;
+}
+
+const char *automation_priority_to_string(automation_priority_t priority)
+{
+    switch (priority) {
+    case AUTOMATION_PRIORITY_LOW:
+        return "low";
+    case AUTOMATION_PRIORITY_HIGH:
+        return "high";
+    case AUTOMATION_PRIORITY_CRITICAL:
+        return "critical";
+    case AUTOMATION_PRIORITY_NORMAL:
+    default:
+        return "normal";
+    }
+}
+
+static automation_priority_t job_class(const automation_program_t *program)
+{
+    return program->priority < AUTOMATION_PRIORITY_COUNT ? (automation_priority_t)program->priority
+                                                         : AUTOMATION_PRIORITY_NORMAL;
+}
+
+static const char *program_ref(const automation_image_t *image, uint32_t id, uint32_t fallback)
+{
+    const char *s = automation_image_str(image, id);
+    return s[0] ? s : automation_image_str(image, fallback);
+}
+
+// The key is only a hash; it filters quickly but two scenarios may share one. Within an image
+// a scenario is its program; across reloads it is the device and scenario the key was built from.
+static bool same_program(const automation_image_t *a_image,
+                         const automation_program_t *a,
+                         const automation_image_t *b_image,
+                         const automation_program_t *b)
+{
+    if (a == b) {
+        return true;
+    }
+    if (a->key != b->key || a_image == b_image) {
+        return false;
+    }
+    return strcasecmp(program_ref(a_image, a->device_id, a->device_name),
+                      program_ref(b_image, b->device_id, b->device_name)) == 0 &&
+           strcasecmp(program_ref(a_image, a->scenario_id, a->scenario_name),
+                      program_ref(b_image, b->scenario_id, b->scenario_name)) == 0;
+}
+
+static bool program_running(const automation_image_t *image, const automation_program_t *program)
+{
+    for (automation_job_t *job = s_running; job; job = job->next) {
+        if (same_program(job->image, job->program, image, program)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool program_pending(const sched_queue_t *queue,
+                            const automation_image_t *image,
+                            const automation_program_t *program)
+{
+    for (automation_job_t *job = queue->head; job; job = job->next) {
+        if (!job->parent && same_program(job->image, job->program, image, program)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Queue and replace policies keep one instance per scenario; others may start at once.
+static bool job_runnable(const automation_job_t *job)
+{
+    if (job->parent) {
+        return true;
+    }
+    uint8_t mode = job->program->concurrency;
+    if (mode == DEVICE_SCENARIO_CONCURRENCY_QUEUE || mode == DEVICE_SCENARIO_CONCURRENCY_REPLACE) {
+        return !program_running(job->image, job->program);
+    }
+    return true;
+}
+
+static void wake_workers(automation_priority_t cls)
+{
+    xSemaphoreGive(s_wake_any);
+    if (cls >= AUTOMATION_PRIORITY_HIGH) {
+        xSemaphoreGive(s_wake_high);
+    }
+}
+
+// s_lock must be held and a free slot available.
+static void enqueue_locked(automation_priority_t cls,
+                           automation_image_t *image,
+                           const automation_program_t *program,
+                           uint16_t pc_start,
+                           uint16_t pc_end,
+                           automation_job_t *parent)
+{
+    sched_queue_t *queue = &s_pending[cls];
+    automation_job_t *job = s_free;
+    s_free = job->next;
+    memset(job, 0, sizeof(*job));
+    automation_image_retain(image);
+    job->image = image;
+    job->program = program;
+    job->pc_start = pc_start;
+    job->pc_end = pc_end;
+    job->parent = parent;
+    job->enqueued_us = esp_timer_get_time();
+    if (queue->tail) {
+        queue->tail->next = job;
+    } else {
+        queue->head = job;
+    }
+    queue->tail = job;
+    queue->count++;
+    s_stats.classes[cls].pending = queue->count;
+}
+
+// s_lock must be held. Returns the slot to the pool; a parent whose branches are still
+// running is only marked finished and recycled by its last branch.
+static void recycle_locked(automation_job_t *job)
+{
+    while (job) {
+        if (job->children > 0) {
+            job->finished = true;
+            return;
+        }
+        automation_job_t *parent = job->parent;
+        automation_image_release(job->image);
+        job->image = NULL;
+        job->program = NULL;
+        job->parent = NULL;
+        job->next = s_free;
+        s_free = job;
+        if (!parent) {
+            return;
+        }
+        parent->children--;
+        job = parent->finished ? parent : NULL;
+    }
+}
+
+esp_err_t automation_scheduler_submit(automation_image_t *image, const automation_program_t *program)
+{
+    if (!image || !program) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    automation_priority_t cls = job_class(program);
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    automation_priority_stats_t *stats = &s_stats.classes[cls];
+    sched_queue_t *queue = &s_pending[cls];
+    stats->submitted++;
+    if (program_pending(queue, image, program)) {
+        stats->coalesced++;
+        xSemaphoreGive(s_lock);
+        return ESP_OK;
+    }
+    if (program->concurrency == DEVICE_SCENARIO_CONCURRENCY_DROP && program_running(image, program)) {
+        stats->dropped++;
+        xSemaphoreGive(s_lock);
+        return ESP_OK;
+    }
+    if (program->concurrency == DEVICE_SCENARIO_CONCURRENCY_REPLACE) {
+        for (automation_job_t *job = s_running; job; job = job->next) {
+            if (!job->cancel && same_program(job->image, job->program, image, program)) {
+                job->cancel = true;
+                stats->replaced++;
+            }
+        }
+    }
+    if (queue->count >= AUTOMATION_SCHED_CLASS_DEPTH || !s_free) {
+        stats->rejected++;
+        xSemaphoreGive(s_lock);
+        return ESP_ERR_TIMEOUT;
+    }
+    enqueue_locked(cls, image, program, 0, program->insn_count, NULL);
+    xSemaphoreGive(s_lock);
+    wake_workers(cls);
+    return ESP_OK;
+}
+
+esp_err_t automation_scheduler_fork(automation_job_t *parent, uint16_t pc_start, uint16_t pc_end)
+{
+    if (!parent || !parent->program || !s_lock) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    automation_priority_t cls = job_class(parent->program);
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_pending[cls].count >= AUTOMATION_SCHED_CLASS_DEPTH || !s_free || parent->children == UINT8_MAX) {
+        xSemaphoreGive(s_lock);
+        return ESP_ERR_TIMEOUT;
+    }
+    s_stats.classes[cls].submitted++;
+    enqueue_locked(cls, parent->image, parent->program, pc_start, pc_end, parent);
+    parent->children++;
+    xSemaphoreGive(s_lock);
+    wake_workers(cls);
+    return ESP_OK;
+}
+
+static void record_wait(automation_priority_stats_t *stats, int64_t wait_us)
+{
+    automation_histogram_add(&stats->wait, wait_us > 0 ? (uint32_t)(wait_us / 1000) : 0);
+}
+
+// s_lock must be held.
+static automation_job_t *pick_locked(automation_priority_t min_priority, const automation_job_t *parent)
+{
+    if (!parent && s_running_count >= AUTOMATION_SCHED_MAX_RUNNING) {
+        return NULL;
+    }
+    for (int cls = AUTOMATION_PRIORITY_COUNT - 1; cls >= (int)min_priority; --cls) {
+        sched_queue_t *queue = &s_pending[cls];
+        automation_job_t *prev = NULL;
+        for (automation_job_t *job = queue->head; job; prev = job, job = job->next) {
+            if (parent ? job->parent != parent : !job_runnable(job)) {
+                continue;
+            }
+            if (prev) {
+                prev->next = job->next;
+            } else {
+                queue->head = job->next;
+            }
+            if (queue->tail == job) {
+                queue->tail = prev;
+            }
+            queue->count--;
+            automation_priority_stats_t *stats = &s_stats.classes[cls];
+            stats->pending = queue->count;
+            stats->started++;
+            job->started_us = esp_timer_get_time();
+            record_wait(stats, job->started_us - job->enqueued_us);
+            job->next = s_running;
+            s_running = job;
+            s_running_count++;
+            return job;
+        }
+    }
+    return NULL;
+}
+
+automation_job_t *automation_scheduler_take(automation_priority_t min_priority, TickType_t wait)
+{
+    if (!s_lock) {
+        return NULL;
+    }
+    SemaphoreHandle_t wake = min_priority >= AUTOMATION_PRIORITY_HIGH ? s_wake_high : s_wake_any;
+    while (1) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        automation_job_t *job = pick_locked(min_priority, NULL);
+        xSemaphoreGive(s_lock);
+        if (job) {
+            return job;
+        }
+        if (xSemaphoreTake(wake, wait) != pdTRUE) {
+            return NULL;
+        }
+    }
+}
+
+automation_job_t *automation_scheduler_take_child(automation_job_t *parent)
+{
+    if (!parent || !s_lock) {
+        return NULL;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    automation_job_t *job = pick_locked(AUTOMATION_PRIORITY_LOW, parent);
+    xSemaphoreGive(s_lock);
+    return job;
+}
+
+uint8_t automation_scheduler_children(automation_job_t *parent)
+{
+    if (!parent || !s_lock) {
+        return 0;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint8_t children = parent->children;
+    xSemaphoreGive(s_lock);
+    return children;
+}
+
+void automation_scheduler_finish(automation_job_t *job)
+{
+    if (!job || !s_lock) {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    automation_job_t **link = &s_running;
+    while (*link && *link != job) {
+        link = &(*link)->next;
+    }
+    if (*link) {
+        *link = job->next;
+        s_running_count--;
+    }
+    recycle_locked(job);
+    // Jobs held back by queue/replace policies may be runnable now.
+    int highest = -1;
+    for (int cls = AUTOMATION_PRIORITY_COUNT - 1; cls >= 0; --cls) {
+        if (s_pending[cls].count > 0) {
+            highest = cls;
+            break;
+        }
+    }
+    xSemaphoreGive(s_lock);
+    if (highest >= 0) {
+        wake_workers((automation_priority_t)highest);
+    }
+}
+
+uint32_t automation_scheduler_cancel_all(void)
+{
+    if (!s_lock) {
+        return 0;
+    }
+    uint32_t cancelled = 0;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (automation_job_t *job = s_running; job; job = job->next) {
+        cancelled += !job->cancel;
+        job->cancel = true;
+    }
+    for (int cls = 0; cls < AUTOMATION_PRIORITY_COUNT; ++cls) {
+        sched_queue_t *queue = &s_pending[cls];
+        automation_job_t *job = queue->head;
+        memset(queue, 0, sizeof(*queue));
+        s_stats.classes[cls].pending = 0;
+        while (job) {
+            automation_job_t *next = job->next;
+            recycle_locked(job);
+            job = next;
+            cancelled++;
+        }
+    }
+    xSemaphoreGive(s_lock);
+    return cancelled;
+}
+
+void automation_scheduler_get_stats(automation_scheduler_stats_t *out)
+{
+    if (!out) {
+        return;
+    }
+    memset(out, 0, sizeof(*out));
+    if (!s_lock) {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *out = s_stats;
+    out->running = s_running_count;
+    xSemaphoreGive(s_lock);
+}
@@ -0,0 +1,327 @@
+#include "automation_trace.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+
+static const char *TAG = "automation_trace";
+// One entry per program of the current image; s_index maps a key hash to slot + 1.
+static automation_scenario_stats_t *s_table;
+static size_t s_count;
+static uint16_t *s_index;
+static size_t s_index_size;     // power of two, at least twice s_count
+static automation_trace_record_t s_recent[AUTOMATION_TRACE_RECENT];
+static size_t s_recent_head;
+static size_t s_recent_count;
+static SemaphoreHandle_t s_lock;
+
+static void *trace_calloc(size_t n, size_t size)
+{
+    void *ptr = heap_caps_calloc(n, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!ptr) {
+        ptr = heap_caps_calloc(n, size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    return ptr;
+}
+
+esp_err_t automation_trace_init(void)
+{
+    if (!s_lock) {
+        s_lock = xSemaphoreCreateMutex();
+    }
+    if (!s_lock) {
+        ESP_LOGE(TAG, "trace alloc failed");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+static uint32_t trace_key(const automation_program_t *program)
+{
+    // Key 0 marks "not traced".
+    return program->key ? program->key : 1;
+}
+
+static uint32_t find_slot(const automation_scenario_stats_t *table, const uint16_t *index, size_t index_size,
+                          uint32_t key)
+{
+    size_t mask = index_size - 1;
+    for (size_t probe = 0, pos = key & mask; index && probe < index_size; ++probe, pos = (pos + 1) & mask) {
+        if (!index[pos]) {
+            break;
+        }
+        if (table[index[pos] - 1].key == key) {
+            return index[pos] - 1;
+        }
+    }
+    return UINT32_MAX;
+}
+
+// s_lock must be held. The slot a ref remembers is checked against its key, since a reload
+// may have moved or dropped the entry.
+static automation_scenario_stats_t *ref_entry_locked(automation_trace_ref_t *ref)
+{
+    if (!ref || !ref->key) {
+        return NULL;
+    }
+    if (ref->slot >= s_count || s_table[ref->slot].key != ref->key) {
+        uint32_t slot = find_slot(s_table, s_index, s_index_size, ref->key);
+        if (slot == UINT32_MAX) {
+            ref->key = 0;
+            return NULL;
+        }
+        ref->slot = slot;
+    }
+    return &s_table[ref->slot];
+}
+
+static uint32_t to_ms(int64_t us)
+{
+    if (us <= 0) {
+        return 0;
+    }
+    int64_t ms = us / 1000;
+    return ms > UINT32_MAX ? UINT32_MAX : (uint32_t)ms;
+}
+
+esp_err_t automation_trace_retain(const automation_image_t *image)
+{
+    if (!image || !s_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    size_t count = image->program_count;
+    size_t index_size = 16;
+    while (index_size < count * 2) {
+        index_size <<= 1;
+    }
+    automation_scenario_stats_t *table = count ? trace_calloc(count, sizeof(*table)) : NULL;
+    uint16_t *index = trace_calloc(index_size, sizeof(*index));
+    if ((count && !table) || !index || count > UINT16_MAX) {
+        heap_caps_free(table);
+        heap_caps_free(index);
+        ESP_LOGW(TAG, "no memory to trace %u scenarios, keeping the old table", (unsigned)count);
+        return ESP_ERR_NO_MEM;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    size_t used = 0;
+    size_t kept = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const automation_program_t *program = &image->programs[i];
+        uint32_t key = trace_key(program);
+        if (find_slot(table, index, index_size, key) != UINT32_MAX) {
+            continue;
+        }
+        automation_scenario_stats_t *entry = &table[used];
+        uint32_t old = find_slot(s_table, s_index, s_index_size, key);
+        if (old != UINT32_MAX) {
+            *entry = s_table[old];
+            kept++;
+        } else {
+            entry->key = key;
+        }
+        const char *scenario = automation_image_str(image, program->scenario_id);
+        if (!scenario[0]) {
+            scenario = automation_image_str(image, program->scenario_name);
+        }
+        memset(entry->device_id, 0, sizeof(entry->device_id));
+        memset(entry->scenario_id, 0, sizeof(entry->scenario_id));
+        strncpy(entry->device_id, automation_image_str(image, program->device_id), sizeof(entry->device_id) - 1);
+        strncpy(entry->scenario_id, scenario, sizeof(entry->scenario_id) - 1);
+        entry->step_count = program->step_count > DEVICE_MANAGER_MAX_STEPS_PER_SCENARIO
+                                ? DEVICE_MANAGER_MAX_STEPS_PER_SCENARIO
+                                : (uint8_t)program->step_count;
+        size_t mask = index_size - 1;
+        size_t pos = key & mask;
+        while (index[pos]) {
+            pos = (pos + 1) & mask;
+        }
+        index[pos] = (uint16_t)(++used);
+    }
+    automation_scenario_stats_t *old_table = s_table;
+    uint16_t *old_index = s_index;
+    size_t dropped = s_count - kept;
+    s_table = table;
+    s_count = used;
+    s_index = index;
+    s_index_size = index_size;
+    xSemaphoreGive(s_lock);
+    heap_caps_free(old_table);
+    heap_caps_free(old_index);
+    ESP_LOGD(TAG, "tracing %u scenarios, %u dropped", (unsigned)used, (unsigned)dropped);
+    return ESP_OK;
+}
+
+automation_trace_ref_t automation_trace_lookup(const automation_image_t *image, const automation_program_t *program)
+{
+    automation_trace_ref_t ref = {0};
+    if (!image || !program || !s_lock) {
+        return ref;
+    }
+    ref.key = trace_key(program);
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    ref_entry_locked(&ref);
+    xSemaphoreGive(s_lock);
+    return ref;
+}
+
+void automation_trace_step(automation_trace_ref_t *ref, uint16_t step, uint32_t duration_us)
+{
+    if (!ref || !ref->key || step >= DEVICE_MANAGER_MAX_STEPS_PER_SCENARIO || !s_lock) {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    automation_scenario_stats_t *entry = ref_entry_locked(ref);
+    if (entry) {
+        automation_step_stats_t *stats = &entry->steps[step];
+        stats->count++;
+        stats->total_us += duration_us;
+        if (duration_us > stats->max_us) {
+            stats->max_us = duration_us;
+        }
+    }
+    xSemaphoreGive(s_lock);
+}
+
+void automation_trace_run(automation_trace_ref_t *ref, int64_t queue_us, int64_t run_us, esp_err_t result)
+{
+    if (!ref || !ref->key || !s_lock) {
+        return;
+    }
+    uint32_t queue_ms = to_ms(queue_us);
+    uint32_t run_ms = to_ms(run_us);
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    automation_scenario_stats_t *entry = ref_entry_locked(ref);
+    if (!entry) {
+        xSemaphoreGive(s_lock);
+        return;
+    }
+    entry->runs++;
+    if (result == ESP_ERR_INVALID_STATE) {
+        entry->cancelled++;
+    } else if (result != ESP_OK) {
+        entry->failed++;
+    }
+    automation_histogram_add(&entry->queue, queue_ms);
+    automation_histogram_add(&entry->run, run_ms);
+    s_recent[s_recent_head] = (automation_trace_record_t){
+        .key = entry->key,
+        .finished_us = esp_timer_get_time(),
+        .queue_ms = queue_ms,
+        .run_ms = run_ms,
+        .result = result,
+    };
+    s_recent_head = (s_recent_head + 1) % AUTOMATION_TRACE_RECENT;
+    if (s_recent_count < AUTOMATION_TRACE_RECENT) {
+        s_recent_count++;
+    }
+    xSemaphoreGive(s_lock);
+}
+
+void automation_trace_reset(void)
+{
+    if (!s_lock) {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    // Entries stay with the image; only their numbers start over.
+    for (size_t i = 0; i < s_count; ++i) {
+        automation_scenario_stats_t *entry = &s_table[i];
+        automation_scenario_stats_t blank = {
+            .key = entry->key,
+            .step_count = entry->step_count,
+        };
+        memcpy(blank.device_id, entry->device_id, sizeof(blank.device_id));
+        memcpy(blank.scenario_id, entry->scenario_id, sizeof(blank.scenario_id));
+        *entry = blank;
+    }
+    s_recent_head = 0;
+    s_recent_count = 0;
+    xSemaphoreGive(s_lock);
+}
+
+static int compare_busy(const void *a, const void *b)
+{
+    uint64_t ta = ((const automation_scenario_stats_t *)a)->run.total_ms;
+    uint64_t tb = ((const automation_scenario_stats_t *)b)->run.total_ms;
+    return ta < tb ? 1 : (ta > tb ? -1 : 0);
+}
+
+static bool entry_active(const automation_scenario_stats_t *entry)
+{
+    if (entry->runs) {
+        return true;
+    }
+    for (uint8_t i = 0; i < entry->step_count; ++i) {
+        if (entry->steps[i].count) {
+            return true;
+        }
+    }
+    return false;
+}
+
+esp_err_t automation_trace_snapshot(automation_trace_snapshot_t **out)
+{
+    if (!out) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *out = NULL;
+    automation_trace_snapshot_t *snap = trace_calloc(1, sizeof(*snap));
+    if (!snap) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (!s_lock) {
+        *out = snap;
+        return ESP_OK;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    size_t capacity = s_count;
+    xSemaphoreGive(s_lock);
+    snap->scenarios = capacity ? trace_calloc(capacity, sizeof(automation_scenario_stats_t)) : NULL;
+    if (capacity && !snap->scenarios) {
+        heap_caps_free(snap);
+        return ESP_ERR_NO_MEM;
+    }
+    // A reload in between may have changed the table; copy what fits.
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (size_t i = 0; i < s_count && snap->scenario_count < capacity; ++i) {
+        if (entry_active(&s_table[i])) {
+            snap->scenarios[snap->scenario_count++] = s_table[i];
+        }
+    }
+    for (size_t i = 0; i < s_recent_count; ++i) {
+        size_t idx = (s_recent_head + AUTOMATION_TRACE_RECENT - 1 - i) % AUTOMATION_TRACE_RECENT;
+        snap->recent[snap->recent_count++] = s_recent[idx];
+    }
+    xSemaphoreGive(s_lock);
+    qsort(snap->scenarios, snap->scenario_count, sizeof(automation_scenario_stats_t), compare_busy);
+    *out = snap;
+    return ESP_OK;
+}
+
+void automation_trace_snapshot_free(automation_trace_snapshot_t *snapshot)
+{
+    if (!snapshot) {
+        return;
+    }
+    heap_caps_free(snapshot->scenarios);
+    heap_caps_free(snapshot);
+}
+
+const automation_scenario_stats_t *automation_trace_snapshot_find(const automation_trace_snapshot_t *snapshot,
+                                                                  uint32_t key)
+{
+    if (!snapshot) {
+        return NULL;
+    }
+    for (size_t i = 0; i < snapshot->scenario_count; ++i) {
+        if (snapshot->scenarios[i].key == key) {
+            return &snapshot->scenarios[i];
+        }
+    }
+    return NULL;
+}
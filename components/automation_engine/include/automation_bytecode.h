@@ -0,0 +1,146 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include "esp_err.h"
+#include "device_manager.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Compiled form of device scenarios. One image is built per config reload and holds
+// every program plus a shared pool of interned strings; jobs keep it alive via refcount.
+
+typedef enum {
+    AUTOMATION_OP_SLEEP = 0,
+    AUTOMATION_OP_MQTT,
+    AUTOMATION_OP_AUDIO_PLAY,
+    AUTOMATION_OP_AUDIO_STOP,
+    AUTOMATION_OP_SET_FLAG,
+    AUTOMATION_OP_WAIT_FLAGS,
+    AUTOMATION_OP_LOOP,
+    AUTOMATION_OP_EVENT,
+    AUTOMATION_OP_FORK,
+    AUTOMATION_OP_JUMP,
+    AUTOMATION_OP_JOIN,
+} automation_op_t;
+
+// Instruction flags.
+#define AUTOMATION_INSN_A_DYNAMIC   0x01    // operand a contains {{var}} and must be rendered
+#define AUTOMATION_INSN_B_DYNAMIC   0x02    // operand b contains {{var}} and must be rendered
+#define AUTOMATION_INSN_C_DYNAMIC   0x04    // operand c contains {{var}} and must be rendered
+#define AUTOMATION_INSN_VALUE       0x08    // set_flag value
+#define AUTOMATION_INSN_MODE_ANY    0x10    // wait_flags: any requirement is enough
+
+// Operands per opcode:
+//   SLEEP       a = milliseconds
+//   MQTT        a = topic, b = payload
+//   AUDIO_PLAY  a = track
+//   SET_FLAG    a = flag name, value in flags
+//   WAIT_FLAGS  a = first requirement, b = requirement count, c = timeout ms
+//   LOOP        a = target pc, b = max iterations (0 = forever), c = counter slot
+//   EVENT       a = event_bus type, b = topic, c = payload
+//   FORK        a = branch first pc, b = branch end pc (exclusive)
+//   JUMP        a = target pc (skips the branch bodies after a fork group)
+//   JOIN        a = timeout ms (0 = no timeout)
+typedef struct {
+    uint8_t op;
+    uint8_t flags;
+    uint16_t step;
+    uint32_t a;
+    uint32_t b;
+    uint32_t c;
+} automation_insn_t;
+
+typedef struct {
+    uint32_t flag;
+    bool required_state;
+} automation_flag_req_t;
+
+typedef struct {
+    uint32_t device_id;
+    uint32_t device_name;
+    uint32_t scenario_id;
+    uint32_t scenario_name;
+    uint32_t first_insn;
+    uint32_t key;           // hash of device/scenario ids, stable across reloads; may collide
+    uint16_t insn_count;
+    uint16_t loop_slots;
+    uint16_t step_count;
+    uint8_t priority;       // automation_priority_t
+    uint8_t concurrency;    // device_scenario_concurrency_t
+    uint8_t device;         // index of the device in the config; its programs are contiguous
+} automation_program_t;
+
+typedef struct {
+    uint32_t topic;
+    uint16_t program;
+    dm_rate_limit_t limit;  // copied from the device's topic_limits[]
+} automation_binding_t;
+
+typedef struct automation_image {
+    atomic_uint refs;
+    uint32_t generation;
+    automation_program_t *programs;
+    size_t program_count;
+    automation_insn_t *insns;
+    size_t insn_count;
+    automation_flag_req_t *reqs;
+    size_t req_count;
+    automation_binding_t *bindings;
+    size_t binding_count;
+    char *strings;
+    size_t strings_len;
+} automation_image_t;
+
+// Callbacks used by the interpreter; the engine wires them to mqtt/audio/flags/event_bus.
+typedef struct {
+    void *ctx;
+    void (*sleep_ms)(void *ctx, uint32_t ms);
+    int64_t (*now_ms)(void *ctx);
+    void (*mqtt_publish)(void *ctx, const char *topic, const char *payload);
+    void (*audio_play)(void *ctx, const char *track);
+    void (*audio_stop)(void *ctx);
+    void (*set_flag)(void *ctx, const char *name, bool value);
+    bool (*get_flag)(void *ctx, const char *name);
+    void (*post_event)(void *ctx, int type, const char *topic, const char *payload);
+    void (*render)(void *ctx, const char *src, char *dst, size_t dst_len);
+    bool (*cancelled)(void *ctx);   // optional; checked between instructions
+    // Optional; start pcs [start, end) of the running program concurrently. When missing or
+    // failing the branch runs inline.
+    bool (*fork)(void *ctx, uint32_t start, uint32_t end);
+    void (*join)(void *ctx, uint32_t timeout_ms);
+    void (*step_begin)(void *ctx, uint16_t step);   // optional; called when execution enters a step
+} automation_vm_env_t;
+
+esp_err_t automation_image_build(const device_manager_config_t *cfg, automation_image_t **out);
+void automation_image_retain(automation_image_t *image);
+void automation_image_release(automation_image_t *image);
+size_t automation_image_footprint(const automation_image_t *image);
+
+static inline const char *automation_image_str(const automation_image_t *image, uint32_t ref)
+{
+    return (image && ref < image->strings_len) ? image->strings + ref : "";
+}
+
+int automation_event_type_from_name(const char *name);
+uint32_t automation_program_key(const char *device_id, const char *scenario_id);
+const automation_program_t *automation_image_find(const automation_image_t *image,
+                                                  const char *device_id,
+                                                  const char *scenario_id);
+esp_err_t automation_vm_run(const automation_image_t *image,
+                            const automation_program_t *program,
+                            const automation_vm_env_t *env);
+// Runs a pc range of a program; used for parallel branches.
+esp_err_t automation_vm_run_range(const automation_image_t *image,
+                                  const automation_program_t *program,
+                                  uint32_t start,
+                                  uint32_t end,
+                                  const automation_vm_env_t *env);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "device_manager.h"
+#include "automation_engine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Crash-safe snapshot of everything a running room accumulates: template runtime state,
+// flags and context variables. The file is preallocated once and split into fixed slots;
+// a flush rewrites only the slots whose contents changed since the last one.
+
+#ifndef AUTOMATION_CHECKPOINT_PATH
+#define AUTOMATION_CHECKPOINT_PATH "/sdcard/.dm_checkpoint.bin"
+#endif
+
+#define AUTOMATION_CONTEXT_MAX_VARS 32
+#define AUTOMATION_CONTEXT_KEY_MAX 48
+#define AUTOMATION_CONTEXT_VALUE_MAX 192
+
+typedef struct {
+    char name[DEVICE_MANAGER_FLAG_NAME_MAX_LEN];
+    bool value;
+} automation_flag_record_t;
+
+typedef struct {
+    char key[AUTOMATION_CONTEXT_KEY_MAX];
+    char value[AUTOMATION_CONTEXT_VALUE_MAX];
+} automation_var_record_t;
+
+typedef struct {
+    uint32_t flushes;           // passes that wrote at least one slot
+    uint32_t slots_written;
+    uint32_t bytes_written;
+    uint32_t failures;
+    int64_t last_flush_us;
+    uint32_t restored_runtimes;
+    uint32_t restored_flags;
+    uint32_t restored_variables;
+    int64_t restore_us;
+} automation_checkpoint_stats_t;
+
+// Applies the checkpoint left by the previous boot. Call after the templates are registered
+// and before anything runs; ESP_ERR_INVALID_STATE when it belongs to another configuration.
+esp_err_t automation_checkpoint_restore(void);
+// Starts the background writer; interval_ms 0 leaves checkpointing off.
+esp_err_t automation_checkpoint_start(uint32_t interval_ms);
+// Writes the changed slots now.
+esp_err_t automation_checkpoint_flush(void);
+void automation_checkpoint_get_stats(automation_checkpoint_stats_t *out);
+
+// Engine side of the checkpoint. Imports replace the current set and raise no events.
+size_t automation_engine_export_flags(automation_flag_record_t *out, size_t max);
+void automation_engine_import_flags(const automation_flag_record_t *flags, size_t count);
+size_t automation_engine_export_variables(automation_var_record_t *out, size_t max);
+void automation_engine_import_variables(const automation_var_record_t *vars, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,20 +1,51 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include "esp_err.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#define AUTOMATION_FLAG_CAPACITY 128          // distinct flags per room, not tied to the device ceiling
+
 esp_err_t automation_engine_init(void);
 esp_err_t automation_engine_start(void);
 void automation_engine_reload(void);
 bool automation_engine_handle_mqtt(const char *topic, const char *payload);
 esp_err_t automation_engine_trigger(const char *device_id, const char *scenario_id);
+
+// Stable reference to a (device, scenario) pair; stays valid across config reloads
+// until every holder has released it.
+typedef uint16_t automation_scenario_handle_t;
+#define AUTOMATION_SCENARIO_HANDLE_INVALID UINT16_MAX
+
+automation_scenario_handle_t automation_engine_resolve(const char *device_id, const char *scenario_id);
+esp_err_t automation_engine_trigger_handle(automation_scenario_handle_t handle);
+void automation_engine_release(automation_scenario_handle_t handle);
+
+typedef struct automation_scheduler_stats automation_scheduler_stats_t;
+void automation_engine_get_scheduler_stats(automation_scheduler_stats_t *out);
 void automation_engine_set_variable(const char *key, const char *value);
 void automation_engine_clear_variable(const char *key);
 
+typedef struct {
+    uint32_t runtimes;
+    uint32_t jobs_cancelled;
+    uint32_t flags_cleared;
+    uint32_t variables_cleared;
+    uint32_t baseline_flags;    // restored from the saved baseline
+    int64_t duration_us;
+} automation_room_reset_report_t;
+
+// Puts the room back to its start state: template runtimes, flags, context variables and
+// every running or queued scenario. Nothing is re-read from storage.
+esp_err_t automation_engine_room_reset(bool restore_baseline, automation_room_reset_report_t *out);
+// Remembers the current flags as the set a room reset can restore; returns their count.
+size_t automation_engine_save_flag_baseline(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Latency histogram shared by the scheduler's queue-wait stats and the execution trace.
+// A sample of ms lands in the first bucket whose bound is >= ms, so the bounds read as
+// Prometheus-style "le" labels.
+
+#define AUTOMATION_HISTOGRAM_BUCKETS 16
+
+// Upper bounds (ms) of the buckets; the last one is open ended.
+extern const uint32_t automation_histogram_bucket_ms[AUTOMATION_HISTOGRAM_BUCKETS];
+
+typedef struct {
+    uint32_t count;
+    uint32_t max_ms;
+    uint64_t total_ms;
+    uint32_t buckets[AUTOMATION_HISTOGRAM_BUCKETS];
+} automation_histogram_t;
+
+void automation_histogram_add(automation_histogram_t *hist, uint32_t ms);
+// Bucket upper bound reaching the given percentile (0..100); max_ms for the open bucket.
+uint32_t automation_histogram_percentile(const automation_histogram_t *hist, uint8_t percentile);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "automation_bytecode.h"
+#include "automation_histogram.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Priority classes in ascending order; workers always pick the highest class first.
+typedef enum {
+    AUTOMATION_PRIORITY_LOW = 0,
+    AUTOMATION_PRIORITY_NORMAL,
+    AUTOMATION_PRIORITY_HIGH,
+    AUTOMATION_PRIORITY_CRITICAL,
+    AUTOMATION_PRIORITY_COUNT,
+} automation_priority_t;
+
+#define AUTOMATION_SCHED_CLASS_DEPTH 16     // pending jobs per priority class
+#define AUTOMATION_SCHED_MAX_RUNNING 8
+
+typedef struct automation_job {
+    automation_image_t *image;
+    const automation_program_t *program;
+    uint16_t pc_start;
+    uint16_t pc_end;
+    int64_t enqueued_us;
+    int64_t started_us;
+    volatile bool cancel;
+    struct automation_job *parent;      // set for parallel branches
+    uint8_t children;                   // branches not finished yet
+    bool finished;                      // parent done, slot held for its branches
+    struct automation_job *next;
+} automation_job_t;
+
+typedef struct {
+    uint32_t submitted;
+    uint32_t started;
+    uint32_t coalesced;     // duplicate pending trigger merged into the queued job
+    uint32_t dropped;       // drop-if-running policy
+    uint32_t replaced;      // running instance cancelled by replace policy
+    uint32_t rejected;      // class queue full
+    uint32_t pending;
+    automation_histogram_t wait;    // submit -> start
+} automation_priority_stats_t;
+
+typedef struct automation_scheduler_stats {
+    automation_priority_stats_t classes[AUTOMATION_PRIORITY_COUNT];
+    uint32_t running;
+    // Filled by automation_engine: debounce/throttle gates on topics and template rules.
+    uint32_t rate_passed;
+    uint32_t rate_suppressed;
+} automation_scheduler_stats_t;
+
+esp_err_t automation_scheduler_init(void);
+esp_err_t automation_scheduler_submit(automation_image_t *image, const automation_program_t *program);
+automation_job_t *automation_scheduler_take(automation_priority_t min_priority, TickType_t wait);
+void automation_scheduler_finish(automation_job_t *job);
+// Parallel branches: queued at the parent's priority, bypass coalescing and concurrency policy.
+esp_err_t automation_scheduler_fork(automation_job_t *parent, uint16_t pc_start, uint16_t pc_end);
+// Lets a joining job run its own queued branches instead of blocking a worker.
+automation_job_t *automation_scheduler_take_child(automation_job_t *parent);
+uint8_t automation_scheduler_children(automation_job_t *parent);
+// Flags running jobs for cancellation and drops everything pending; returns how many jobs it hit.
+uint32_t automation_scheduler_cancel_all(void);
+void automation_scheduler_get_stats(automation_scheduler_stats_t *out);
+const char *automation_priority_to_string(automation_priority_t priority);
+
+#ifdef __cplusplus
+}
+#endif
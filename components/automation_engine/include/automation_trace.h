@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "automation_bytecode.h"
+#include "automation_histogram.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Execution tracing: per-scenario queue/run histograms, per-step durations and a ring of
+// recent executions. The table holds one entry per program of the current image and is
+// rebuilt on every reload; entries are keyed by automation_program_t.key, so a scenario
+// that is still there keeps its numbers and one that is gone is dropped.
+
+#define AUTOMATION_TRACE_RECENT    16
+
+typedef struct {
+    uint32_t count;
+    uint32_t max_us;
+    uint64_t total_us;
+} automation_step_stats_t;
+
+typedef struct {
+    uint32_t key;
+    char device_id[DEVICE_MANAGER_ID_MAX_LEN];
+    char scenario_id[DEVICE_MANAGER_ID_MAX_LEN];
+    uint32_t runs;
+    uint32_t cancelled;
+    uint32_t failed;
+    automation_histogram_t queue;   // trigger -> start
+    automation_histogram_t run;     // start -> finish
+    uint8_t step_count;
+    automation_step_stats_t steps[DEVICE_MANAGER_MAX_STEPS_PER_SCENARIO];
+} automation_scenario_stats_t;
+
+typedef struct {
+    uint32_t key;
+    int64_t finished_us;
+    uint32_t queue_ms;
+    uint32_t run_ms;
+    esp_err_t result;
+} automation_trace_record_t;
+
+typedef struct {
+    size_t scenario_count;
+    automation_scenario_stats_t *scenarios;     // sorted by total run time, busiest first
+    size_t recent_count;
+    automation_trace_record_t recent[AUTOMATION_TRACE_RECENT];   // newest first
+} automation_trace_snapshot_t;
+
+// An execution's hold on its entry; key 0 when the program is not traced. Updates check
+// that the slot still belongs to the key, so a reload mid-run never misattributes samples.
+typedef struct {
+    uint32_t key;
+    uint32_t slot;
+} automation_trace_ref_t;
+
+esp_err_t automation_trace_init(void);
+// Sizes the table for image and keeps the entries of programs it still has.
+esp_err_t automation_trace_retain(const automation_image_t *image);
+
+automation_trace_ref_t automation_trace_lookup(const automation_image_t *image, const automation_program_t *program);
+void automation_trace_step(automation_trace_ref_t *ref, uint16_t step, uint32_t duration_us);
+void automation_trace_run(automation_trace_ref_t *ref, int64_t queue_us, int64_t run_us, esp_err_t result);
+void automation_trace_reset(void);
+
+esp_err_t automation_trace_snapshot(automation_trace_snapshot_t **out);
+void automation_trace_snapshot_free(automation_trace_snapshot_t *snapshot);
+const automation_scenario_stats_t *automation_trace_snapshot_find(const automation_trace_snapshot_t *snapshot,
+                                                                  uint32_t key);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,442 @@
+#include "unity.h"
+#include "automation_bytecode.h"
+#include "dm_config.h"
+#include "event_bus.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <inttypes.h>
+
+#define BENCH_ROUNDS 2000
+
+typedef struct {
+    uint32_t publishes;
+    uint32_t events;
+    uint32_t flags;
+    uint32_t sleeps;
+    char last_payload[DEVICE_MANAGER_PAYLOAD_MAX_LEN];
+} bench_sink_t;
+
+static device_manager_config_t *s_cfg;
+static bench_sink_t s_sink;
+
+static void sink_sleep(void *ctx, uint32_t ms)
+{
+    ((bench_sink_t *)ctx)->sleeps++;
+}
+
+static int64_t sink_now(void *ctx)
+{
+    return esp_timer_get_time() / 1000;
+}
+
+static void sink_publish(void *ctx, const char *topic, const char *payload)
+{
+    bench_sink_t *sink = ctx;
+    sink->publishes++;
+    snprintf(sink->last_payload, sizeof(sink->last_payload), "%s", payload);
+}
+
+static void sink_audio(void *ctx, const char *track)
+{
+}
+
+static void sink_stop(void *ctx)
+{
+}
+
+static void sink_set_flag(void *ctx, const char *name, bool value)
+{
+    ((bench_sink_t *)ctx)->flags++;
+}
+
+static bool sink_get_flag(void *ctx, const char *name)
+{
+    return true;
+}
+
+static void sink_event(void *ctx, int type, const char *topic, const char *payload)
+{
+    ((bench_sink_t *)ctx)->events++;
+}
+
+// Copies src and expands {{n}} to "7"; stands in for the context renderer.
+static void sink_render(void *ctx, const char *src, char *dst, size_t dst_len)
+{
+    size_t out = 0;
+    for (size_t i = 0; src[i] && out + 1 < dst_len; ++i) {
+        if (src[i] == '{' && src[i + 1] == '{' && strncmp(src + i, "{{n}}", 5) == 0) {
+            dst[out++] = '7';
+            i += 4;
+        } else {
+            dst[out++] = src[i];
+        }
+    }
+    dst[out] = 0;
+}
+
+static const automation_vm_env_t s_env = {
+    .ctx = &s_sink,
+    .sleep_ms = sink_sleep,
+    .now_ms = sink_now,
+    .mqtt_publish = sink_publish,
+    .audio_play = sink_audio,
+    .audio_stop = sink_stop,
+    .set_flag = sink_set_flag,
+    .get_flag = sink_get_flag,
+    .post_event = sink_event,
+    .render = sink_render,
+};
+
+static device_scenario_t *add_scenario(device_manager_config_t *cfg, device_descriptor_t *dev, const char *id)
+{
+    device_scenario_t *sc = dm_config_add_scenario(cfg, dev);
+    TEST_ASSERT_NOT_NULL(sc);
+    strncpy(sc->id, id, sizeof(sc->id) - 1);
+    strncpy(sc->name, id, sizeof(sc->name) - 1);
+    return sc;
+}
+
+static device_action_step_t *add_step(device_manager_config_t *cfg, device_scenario_t *sc, device_action_type_t type)
+{
+    device_action_step_t *step = dm_config_add_step(cfg, sc);
+    TEST_ASSERT_NOT_NULL(step);
+    step->type = type;
+    return step;
+}
+
+static void add_mqtt(device_manager_config_t *cfg, device_scenario_t *sc, const char *topic, const char *payload)
+{
+    device_action_step_t *step = add_step(cfg, sc, DEVICE_ACTION_MQTT_PUBLISH);
+    step->data.mqtt.topic = topic;
+    step->data.mqtt.payload = payload;
+    TEST_ASSERT_EQUAL(ESP_OK, dm_config_intern_step(cfg, step));
+}
+
+static void add_event(device_manager_config_t *cfg, device_scenario_t *sc, const char *event, const char *payload)
+{
+    device_action_step_t *step = add_step(cfg, sc, DEVICE_ACTION_EVENT_BUS);
+    step->data.event.event = event;
+    step->data.event.payload = payload;
+    TEST_ASSERT_EQUAL(ESP_OK, dm_config_intern_step(cfg, step));
+}
+
+static void add_flag(device_manager_config_t *cfg, device_scenario_t *sc, const char *flag, bool value)
+{
+    device_action_step_t *step = add_step(cfg, sc, DEVICE_ACTION_SET_FLAG);
+    step->data.flag.flag = flag;
+    step->data.flag.value = value;
+    TEST_ASSERT_EQUAL(ESP_OK, dm_config_intern_step(cfg, step));
+}
+
+static void build_config(void)
+{
+    s_cfg = dm_config_create(1);
+    TEST_ASSERT_NOT_NULL(s_cfg);
+    s_cfg->device_count = 1;
+    s_cfg->generation = 3;
+    device_descriptor_t *dev = &s_cfg->devices[0];
+    strncpy(dev->id, "door", sizeof(dev->id) - 1);
+    strncpy(dev->display_name, "Door", sizeof(dev->display_name) - 1);
+    dev->topic_count = 1;
+    strncpy(dev->topics[0].name, "open", sizeof(dev->topics[0].name) - 1);
+    strncpy(dev->topics[0].topic, "door/cmd", sizeof(dev->topics[0].topic) - 1);
+
+    device_scenario_t *open = add_scenario(s_cfg, dev, "open");
+    add_mqtt(s_cfg, open, "relay/1", "ON");
+    add_mqtt(s_cfg, open, "relay/1", "count {{n}}");
+    add_event(s_cfg, open, "relay_cmd", "pulse");
+    device_action_step_t *loop = add_step(s_cfg, open, DEVICE_ACTION_LOOP);
+    loop->delay_ms = 5;
+    loop->data.loop.target_step = 1;
+    loop->data.loop.max_iterations = 2;
+
+    device_scenario_t *bench = add_scenario(s_cfg, dev, "bench");
+    for (int i = 0; i < 5; ++i) {
+        add_mqtt(s_cfg, bench, "relay/2", "ON");
+        add_event(s_cfg, bench, "relay_cmd", "pulse");
+        add_flag(s_cfg, bench, "armed", i & 1);
+    }
+    add_mqtt(s_cfg, bench, "relay/2", "{{n}}");
+}
+
+void setUp(void)
+{
+    memset(&s_sink, 0, sizeof(s_sink));
+    if (!s_cfg) {
+        build_config();
+    }
+}
+
+void tearDown(void)
+{
+}
+
+static void test_bytecode_compile(void)
+{
+    automation_image_t *image = NULL;
+    TEST_ASSERT_EQUAL(ESP_OK, automation_image_build(s_cfg, &image));
+    TEST_ASSERT_EQUAL_UINT32(3, image->generation);
+    TEST_ASSERT_EQUAL(2, image->program_count);
+    TEST_ASSERT_EQUAL(1, image->binding_count);
+    TEST_ASSERT_EQUAL_STRING("door/cmd", automation_image_str(image, image->bindings[0].topic));
+
+    const automation_program_t *open = automation_image_find(image, "DOOR", "open");
+    TEST_ASSERT_NOT_NULL(open);
+    TEST_ASSERT_EQUAL_PTR(&image->programs[image->bindings[0].program], open);
+    const automation_insn_t *code = image->insns + open->first_insn;
+    TEST_ASSERT_EQUAL(5, open->insn_count);
+    TEST_ASSERT_EQUAL(AUTOMATION_OP_MQTT, code[0].op);
+    TEST_ASSERT_EQUAL(0, code[0].flags & (AUTOMATION_INSN_A_DYNAMIC | AUTOMATION_INSN_B_DYNAMIC));
+    TEST_ASSERT_EQUAL_UINT32(code[0].a, code[1].a);
+    TEST_ASSERT_TRUE(code[1].flags & AUTOMATION_INSN_B_DYNAMIC);
+    TEST_ASSERT_EQUAL(AUTOMATION_OP_EVENT, code[2].op);
+    TEST_ASSERT_EQUAL(EVENT_RELAY_CMD, (int)code[2].a);
+    TEST_ASSERT_EQUAL(AUTOMATION_OP_SLEEP, code[3].op);
+    TEST_ASSERT_EQUAL(AUTOMATION_OP_LOOP, code[4].op);
+    TEST_ASSERT_EQUAL_UINT32(1, code[4].a);
+    TEST_ASSERT_NULL(automation_image_find(image, "door", "missing"));
+    automation_image_release(image);
+}
+
+static void test_bytecode_loop_runs(void)
+{
+    automation_image_t *image = NULL;
+    TEST_ASSERT_EQUAL(ESP_OK, automation_image_build(s_cfg, &image));
+    TEST_ASSERT_EQUAL(ESP_OK, automation_vm_run(image, automation_image_find(image, "door", "open"), &s_env));
+    TEST_ASSERT_EQUAL_UINT32(4, s_sink.publishes);
+    TEST_ASSERT_EQUAL_UINT32(3, s_sink.events);
+    TEST_ASSERT_EQUAL_UINT32(3, s_sink.sleeps);
+    TEST_ASSERT_EQUAL_STRING("count 7", s_sink.last_payload);
+    automation_image_release(image);
+}
+
+// Scenarios are not capped at the parser's step limit once they reach the compiler.
+static void test_bytecode_long_scenario(void)
+{
+    const uint8_t total = 20;
+    device_manager_config_t *cfg = dm_config_create(1);
+    TEST_ASSERT_NOT_NULL(cfg);
+    cfg->device_count = 1;
+    device_descriptor_t *dev = &cfg->devices[0];
+    strncpy(dev->id, "hall", sizeof(dev->id) - 1);
+    device_scenario_t *sc = add_scenario(cfg, dev, "long");
+    sc->steps = dm_config_alloc_steps(cfg, total);
+    TEST_ASSERT_NOT_NULL(sc->steps);
+    sc->step_count = total;
+    for (uint8_t i = 0; i + 1 < total; ++i) {
+        device_action_step_t *step = &sc->steps[i];
+        memset(step, 0, sizeof(*step));
+        step->type = DEVICE_ACTION_MQTT_PUBLISH;
+        step->data.mqtt.topic = "relay/3";
+        step->data.mqtt.payload = "ON";
+        TEST_ASSERT_EQUAL(ESP_OK, dm_config_intern_step(cfg, step));
+    }
+    device_action_step_t *loop = &sc->steps[total - 1];
+    memset(loop, 0, sizeof(*loop));
+    loop->type = DEVICE_ACTION_LOOP;
+    loop->data.loop.target_step = 17;
+    loop->data.loop.max_iterations = 1;
+
+    automation_image_t *image = NULL;
+    TEST_ASSERT_EQUAL(ESP_OK, automation_image_build(cfg, &image));
+    dm_config_destroy(cfg);
+    const automation_program_t *prog = automation_image_find(image, "hall", "long");
+    TEST_ASSERT_NOT_NULL(prog);
+    TEST_ASSERT_EQUAL(total, prog->step_count);
+    TEST_ASSERT_EQUAL(total, prog->insn_count);
+    TEST_ASSERT_EQUAL_UINT32(17, image->insns[prog->first_insn + total - 1].a);
+    TEST_ASSERT_EQUAL(ESP_OK, automation_vm_run(image, prog, &s_env));
+    // 19 publishes, then steps 17 and 18 once more.
+    TEST_ASSERT_EQUAL_UINT32(21, s_sink.publishes);
+    automation_image_release(image);
+}
+
+// Devices without an id share the empty string; a match on one must not reach the next.
+static void test_bytecode_find_stays_on_device(void)
+{
+    device_manager_config_t *cfg = dm_config_create(2);
+    TEST_ASSERT_NOT_NULL(cfg);
+    cfg->device_count = 2;
+    strncpy(cfg->devices[0].display_name, "Panel", sizeof(cfg->devices[0].display_name) - 1);
+    strncpy(cfg->devices[1].display_name, "Safe", sizeof(cfg->devices[1].display_name) - 1);
+    add_mqtt(cfg, add_scenario(cfg, &cfg->devices[0], "arm"), "panel/arm", "1");
+    add_mqtt(cfg, add_scenario(cfg, &cfg->devices[1], "open"), "safe/open", "1");
+
+    automation_image_t *image = NULL;
+    TEST_ASSERT_EQUAL(ESP_OK, automation_image_build(cfg, &image));
+    dm_config_destroy(cfg);
+    TEST_ASSERT_NOT_NULL(automation_image_find(image, "panel", "arm"));
+    TEST_ASSERT_NULL(automation_image_find(image, "panel", "open"));
+    const automation_program_t *open = automation_image_find(image, "safe", "open");
+    TEST_ASSERT_NOT_NULL(open);
+    TEST_ASSERT_EQUAL(1, open->device);
+    automation_image_release(image);
+}
+
+typedef struct {
+    uint32_t start[4];
+    uint32_t end[4];
+    uint32_t forks;
+    uint32_t joins;
+} fork_sink_t;
+
+static fork_sink_t s_forks;
+
+static bool sink_fork(void *ctx, uint32_t start, uint32_t end)
+{
+    if (s_forks.forks >= 4) {
+        return false;
+    }
+    s_forks.start[s_forks.forks] = start;
+    s_forks.end[s_forks.forks] = end;
+    s_forks.forks++;
+    return true;
+}
+
+static void sink_join(void *ctx, uint32_t timeout_ms)
+{
+    s_forks.joins++;
+}
+
+static void test_bytecode_parallel_group(void)
+{
+    device_manager_config_t *cfg = dm_config_create(1);
+    TEST_ASSERT_NOT_NULL(cfg);
+    cfg->device_count = 1;
+    device_descriptor_t *dev = &cfg->devices[0];
+    strncpy(dev->id, "stage", sizeof(dev->id) - 1);
+    device_scenario_t *cue = add_scenario(cfg, dev, "cue");
+    add_step(cfg, cue, DEVICE_ACTION_PARALLEL)->data.parallel.count = 3;
+    add_mqtt(cfg, cue, "relay/1", "ON");
+    add_mqtt(cfg, cue, "relay/2", "ON");
+    add_flag(cfg, cue, "lights", true);
+    add_step(cfg, cue, DEVICE_ACTION_JOIN)->data.join.timeout_ms = 500;
+    add_event(cfg, cue, "relay_cmd", "done");
+
+    automation_image_t *image = NULL;
+    TEST_ASSERT_EQUAL(ESP_OK, automation_image_build(cfg, &image));
+    dm_config_destroy(cfg);
+    const automation_program_t *prog = automation_image_find(image, "stage", "cue");
+    TEST_ASSERT_NOT_NULL(prog);
+    const automation_insn_t *code = image->insns + prog->first_insn;
+    TEST_ASSERT_EQUAL(AUTOMATION_OP_FORK, code[0].op);
+    TEST_ASSERT_EQUAL(AUTOMATION_OP_JUMP, code[3].op);
+    TEST_ASSERT_EQUAL_UINT32(7, code[3].a);
+    TEST_ASSERT_EQUAL(AUTOMATION_OP_JOIN, code[7].op);
+
+    // Without a fork hook the branches run inline.
+    TEST_ASSERT_EQUAL(ESP_OK, automation_vm_run(image, prog, &s_env));
+    TEST_ASSERT_EQUAL_UINT32(2, s_sink.publishes);
+    TEST_ASSERT_EQUAL_UINT32(1, s_sink.flags);
+    TEST_ASSERT_EQUAL_UINT32(1, s_sink.events);
+
+    memset(&s_sink, 0, sizeof(s_sink));
+    memset(&s_forks, 0, sizeof(s_forks));
+    automation_vm_env_t env = s_env;
+    env.fork = sink_fork;
+    env.join = sink_join;
+    TEST_ASSERT_EQUAL(ESP_OK, automation_vm_run(image, prog, &env));
+    TEST_ASSERT_EQUAL_UINT32(3, s_forks.forks);
+    TEST_ASSERT_EQUAL_UINT32(1, s_forks.joins);
+    TEST_ASSERT_EQUAL_UINT32(0, s_sink.publishes);
+    for (uint32_t i = 0; i < s_forks.forks; ++i) {
+        TEST_ASSERT_EQUAL(ESP_OK, automation_vm_run_range(image, prog, s_forks.start[i], s_forks.end[i], &s_env));
+    }
+    TEST_ASSERT_EQUAL_UINT32(2, s_sink.publishes);
+    TEST_ASSERT_EQUAL_UINT32(1, s_sink.flags);
+    automation_image_release(image);
+}
+
+// Step walker equivalent to the executor before scenarios were compiled.
+static void legacy_run(const device_scenario_t *scenario, const automation_vm_env_t *env)
+{
+    uint16_t loop_counters[DEVICE_MANAGER_MAX_STEPS_PER_SCENARIO] = {0};
+    uint8_t idx = 0;
+    while (idx < scenario->step_count) {
+        const device_action_step_t *step = &scenario->steps[idx];
+        if (step->delay_ms > 0) {
+            env->sleep_ms(env->ctx, step->delay_ms);
+        }
+        switch (step->type) {
+        case DEVICE_ACTION_MQTT_PUBLISH: {
+            char topic[DEVICE_MANAGER_TOPIC_MAX_LEN];
+            char payload[DEVICE_MANAGER_PAYLOAD_MAX_LEN];
+            env->render(env->ctx, step->data.mqtt.topic, topic, sizeof(topic));
+            env->render(env->ctx, step->data.mqtt.payload, payload, sizeof(payload));
+            env->mqtt_publish(env->ctx, topic, payload);
+            break;
+        }
+        case DEVICE_ACTION_SET_FLAG:
+            env->set_flag(env->ctx, step->data.flag.flag, step->data.flag.value);
+            break;
+        case DEVICE_ACTION_LOOP:
+            if (step->data.loop.target_step < scenario->step_count &&
+                (step->data.loop.max_iterations == 0 ||
+                 loop_counters[idx] < step->data.loop.max_iterations)) {
+                loop_counters[idx]++;
+                idx = step->data.loop.target_step;
+                continue;
+            }
+            break;
+        case DEVICE_ACTION_EVENT_BUS: {
+            int type = automation_event_type_from_name(step->data.event.event);
+            event_bus_message_t msg = {.type = type};
+            env->render(env->ctx, step->data.event.topic, msg.topic, sizeof(msg.topic));
+            env->render(env->ctx, step->data.event.payload, msg.payload, sizeof(msg.payload));
+            env->post_event(env->ctx, type, msg.topic, msg.payload);
+            break;
+        }
+        default:
+            break;
+        }
+        idx++;
+    }
+}
+
+static void test_bytecode_step_cost(void)
+{
+    const device_scenario_t *scenario = &s_cfg->devices[0].scenarios[1];
+    automation_image_t *image = NULL;
+    TEST_ASSERT_EQUAL(ESP_OK, automation_image_build(s_cfg, &image));
+    const automation_program_t *program = automation_image_find(image, "door", "bench");
+    TEST_ASSERT_NOT_NULL(program);
+
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < BENCH_ROUNDS; ++i) {
+        legacy_run(scenario, &s_env);
+    }
+    int64_t legacy_us = esp_timer_get_time() - start;
+    uint32_t legacy_publishes = s_sink.publishes;
+
+    s_sink.publishes = 0;
+    start = esp_timer_get_time();
+    for (int i = 0; i < BENCH_ROUNDS; ++i) {
+        automation_vm_run(image, program, &s_env);
+    }
+    int64_t vm_us = esp_timer_get_time() - start;
+    TEST_ASSERT_EQUAL_UINT32(legacy_publishes, s_sink.publishes);
+
+    uint32_t steps = (uint32_t)BENCH_ROUNDS * scenario->step_count;
+    printf("scenario bytes: legacy %u, compiled %u (image %u for %u programs)\n",
+           (unsigned)sizeof(device_scenario_t),
+           (unsigned)(sizeof(automation_program_t) + program->insn_count * sizeof(automation_insn_t)),
+           (unsigned)automation_image_footprint(image),
+           (unsigned)image->program_count);
+    printf("per-step cost: legacy %" PRIu32 " ns, bytecode %" PRIu32 " ns\n",
+           (uint32_t)(legacy_us * 1000 / steps),
+           (uint32_t)(vm_us * 1000 / steps));
+    automation_image_release(image);
+}
+
+void register_automation_bytecode_tests(void)
+{
+    RUN_TEST(test_bytecode_compile);
+    RUN_TEST(test_bytecode_loop_runs);
+    RUN_TEST(test_bytecode_long_scenario);
+    RUN_TEST(test_bytecode_find_stays_on_device);
+    RUN_TEST(test_bytecode_parallel_group);
+    RUN_TEST(test_bytecode_step_cost);
+}
@@ -0,0 +1,127 @@
+#include "unity.h"
+#include "automation_checkpoint.h"
+#include "automation_engine.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+static size_t find_variable(const char *key, char *value, size_t value_len)
+{
+    static automation_var_record_t vars[AUTOMATION_CONTEXT_MAX_VARS];
+    size_t count = automation_engine_export_variables(vars, AUTOMATION_CONTEXT_MAX_VARS);
+    for (size_t i = 0; i < count; ++i) {
+        if (strcmp(vars[i].key, key) == 0) {
+            snprintf(value, value_len, "%s", vars[i].value);
+            return strlen(value);
+        }
+    }
+    value[0] = 0;
+    return 0;
+}
+
+// Only changed slots hit the card; a restore brings the variables back.
+static void test_checkpoint_incremental_roundtrip(void)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, automation_engine_init());
+    remove(AUTOMATION_CHECKPOINT_PATH);
+    automation_engine_set_variable("cp_round", "3");
+    if (automation_checkpoint_flush() != ESP_OK) {
+        TEST_IGNORE_MESSAGE("no writable storage for the checkpoint");
+    }
+    automation_checkpoint_stats_t first;
+    automation_checkpoint_get_stats(&first);
+
+    // Nothing changed: no file access at all.
+    TEST_ASSERT_EQUAL(ESP_OK, automation_checkpoint_flush());
+    automation_checkpoint_stats_t stats;
+    automation_checkpoint_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(first.slots_written, stats.slots_written);
+    TEST_ASSERT_EQUAL_UINT32(first.flushes, stats.flushes);
+
+    automation_engine_set_variable("cp_round", "4");
+    TEST_ASSERT_EQUAL(ESP_OK, automation_checkpoint_flush());
+    automation_checkpoint_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(first.slots_written + 1, stats.slots_written);
+
+    automation_engine_clear_variable("cp_round");
+    char value[8];
+    TEST_ASSERT_EQUAL(0, find_variable("cp_round", value, sizeof(value)));
+    TEST_ASSERT_EQUAL(ESP_OK, automation_checkpoint_restore());
+    TEST_ASSERT_EQUAL(1, find_variable("cp_round", value, sizeof(value)));
+    TEST_ASSERT_EQUAL_STRING("4", value);
+    automation_checkpoint_get_stats(&stats);
+    TEST_ASSERT_TRUE(stats.restore_us < 1000000);
+    printf("checkpoint: %u slots / %u bytes written, restore %lld us\n",
+           (unsigned)stats.slots_written,
+           (unsigned)stats.bytes_written,
+           (long long)stats.restore_us);
+
+    automation_engine_clear_variable("cp_round");
+    remove(AUTOMATION_CHECKPOINT_PATH);
+}
+
+// A torn slot is skipped rather than applied.
+static void test_checkpoint_rejects_torn_slot(void)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, automation_engine_init());
+    remove(AUTOMATION_CHECKPOINT_PATH);
+    automation_engine_set_variable("cp_torn", "yes");
+    if (automation_checkpoint_flush() != ESP_OK) {
+        TEST_IGNORE_MESSAGE("no writable storage for the checkpoint");
+    }
+    automation_engine_clear_variable("cp_torn");
+
+    FILE *f = fopen(AUTOMATION_CHECKPOINT_PATH, "r+b");
+    TEST_ASSERT_NOT_NULL(f);
+    TEST_ASSERT_EQUAL(0, fseek(f, -1, SEEK_END));
+    long size = ftell(f) + 1;
+    // Flip a byte inside the stored value, which sits near the start of the last slot.
+    static automation_var_record_t probe;
+    long pos = size - (long)(AUTOMATION_CONTEXT_MAX_VARS * sizeof(probe)) +
+               (long)offsetof(automation_var_record_t, value);
+    TEST_ASSERT_EQUAL(0, fseek(f, pos, SEEK_SET));
+    fputc('!', f);
+    fclose(f);
+
+    char value[8];
+    TEST_ASSERT_EQUAL(ESP_OK, automation_checkpoint_restore());
+    TEST_ASSERT_EQUAL(0, find_variable("cp_torn", value, sizeof(value)));
+    remove(AUTOMATION_CHECKPOINT_PATH);
+}
+
+// Imported flags land in the hashed table: names fold case and the table stops at capacity.
+static void test_checkpoint_flag_import_caps(void)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, automation_engine_init());
+    static automation_flag_record_t flags[AUTOMATION_FLAG_CAPACITY + 4];
+    memset(flags, 0, sizeof(flags));
+    for (size_t i = 0; i < AUTOMATION_FLAG_CAPACITY + 3; ++i) {
+        snprintf(flags[i].name, sizeof(flags[i].name), "cp_flag_%u", (unsigned)i);
+        flags[i].value = true;
+    }
+    snprintf(flags[0].name, sizeof(flags[0].name), "CP_Flag_0");
+    snprintf(flags[1].name, sizeof(flags[1].name), "cp_flag_0");
+    flags[1].value = false;
+    automation_engine_import_flags(flags, AUTOMATION_FLAG_CAPACITY + 3);
+
+    static automation_flag_record_t out[AUTOMATION_FLAG_CAPACITY + 4];
+    size_t count = automation_engine_export_flags(out, AUTOMATION_FLAG_CAPACITY + 4);
+    TEST_ASSERT_EQUAL_UINT(AUTOMATION_FLAG_CAPACITY, count);
+    size_t zero = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (strcasecmp(out[i].name, "cp_flag_0") == 0) {
+            zero++;
+            TEST_ASSERT_FALSE(out[i].value);
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT(1, zero);
+    automation_engine_import_flags(NULL, 0);
+}
+
+void register_automation_checkpoint_tests(void)
+{
+    RUN_TEST(test_checkpoint_incremental_roundtrip);
+    RUN_TEST(test_checkpoint_rejects_torn_slot);
+    RUN_TEST(test_checkpoint_flag_import_caps);
+}
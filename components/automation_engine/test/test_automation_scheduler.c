@@ -0,0 +1,238 @@
+#include "unity.h"
+#include "automation_scheduler.h"
+#include "dm_config.h"
+#include "esp_heap_caps.h"
+#include <string.h>
+
+static automation_image_t *s_sched_image;
+
+static void add_policy_scenario(device_manager_config_t *cfg,
+                                device_descriptor_t *dev,
+                                const char *id,
+                                device_scenario_priority_t priority,
+                                device_scenario_concurrency_t concurrency)
+{
+    device_scenario_t *sc = dm_config_add_scenario(cfg, dev);
+    TEST_ASSERT_NOT_NULL(sc);
+    strncpy(sc->id, id, sizeof(sc->id) - 1);
+    sc->priority = priority;
+    sc->concurrency = concurrency;
+    device_action_step_t *step = dm_config_add_step(cfg, sc);
+    TEST_ASSERT_NOT_NULL(step);
+    step->type = DEVICE_ACTION_DELAY;
+    step->delay_ms = 10;
+}
+
+static automation_image_t *sched_image(void)
+{
+    if (s_sched_image) {
+        return s_sched_image;
+    }
+    device_manager_config_t *cfg = dm_config_create(1);
+    TEST_ASSERT_NOT_NULL(cfg);
+    cfg->device_count = 1;
+    device_descriptor_t *dev = &cfg->devices[0];
+    strncpy(dev->id, "hall", sizeof(dev->id) - 1);
+    add_policy_scenario(cfg, dev, "ambient", DEVICE_SCENARIO_PRIORITY_LOW, DEVICE_SCENARIO_CONCURRENCY_PARALLEL);
+    add_policy_scenario(cfg, dev, "alarm", DEVICE_SCENARIO_PRIORITY_CRITICAL, DEVICE_SCENARIO_CONCURRENCY_PARALLEL);
+    add_policy_scenario(cfg, dev, "hint", DEVICE_SCENARIO_PRIORITY_NORMAL, DEVICE_SCENARIO_CONCURRENCY_DROP);
+    add_policy_scenario(cfg, dev, "music", DEVICE_SCENARIO_PRIORITY_NORMAL, DEVICE_SCENARIO_CONCURRENCY_REPLACE);
+    TEST_ASSERT_EQUAL(ESP_OK, automation_image_build(cfg, &s_sched_image));
+    dm_config_destroy(cfg);
+    TEST_ASSERT_EQUAL(ESP_OK, automation_scheduler_init());
+    return s_sched_image;
+}
+
+static const automation_program_t *program(const char *id)
+{
+    const automation_program_t *p = automation_image_find(sched_image(), "hall", id);
+    TEST_ASSERT_NOT_NULL(p);
+    return p;
+}
+
+static automation_priority_stats_t class_stats(automation_priority_t cls)
+{
+    automation_scheduler_stats_t stats;
+    automation_scheduler_get_stats(&stats);
+    return stats.classes[cls];
+}
+
+static void drain(void)
+{
+    automation_job_t *job;
+    while ((job = automation_scheduler_take(AUTOMATION_PRIORITY_LOW, 0)) != NULL) {
+        automation_scheduler_finish(job);
+    }
+}
+
+static void test_scheduler_priority_order(void)
+{
+    automation_image_t *image = sched_image();
+    TEST_ASSERT_EQUAL(ESP_OK, automation_scheduler_submit(image, program("ambient")));
+    TEST_ASSERT_EQUAL(ESP_OK, automation_scheduler_submit(image, program("alarm")));
+
+    // Priority lane only sees the critical job.
+    automation_job_t *hi = automation_scheduler_take(AUTOMATION_PRIORITY_HIGH, 0);
+    TEST_ASSERT_NOT_NULL(hi);
+    TEST_ASSERT_EQUAL_PTR(program("alarm"), hi->program);
+    TEST_ASSERT_NULL(automation_scheduler_take(AUTOMATION_PRIORITY_HIGH, 0));
+    automation_scheduler_finish(hi);
+
+    automation_job_t *lo = automation_scheduler_take(AUTOMATION_PRIORITY_LOW, 0);
+    TEST_ASSERT_NOT_NULL(lo);
+    TEST_ASSERT_EQUAL_PTR(program("ambient"), lo->program);
+    automation_scheduler_finish(lo);
+    TEST_ASSERT_EQUAL_UINT32(1, atomic_load(&image->refs));
+}
+
+static void test_scheduler_coalesces_pending(void)
+{
+    automation_image_t *image = sched_image();
+    automation_priority_stats_t before = class_stats(AUTOMATION_PRIORITY_LOW);
+    for (int i = 0; i < 3; ++i) {
+        TEST_ASSERT_EQUAL(ESP_OK, automation_scheduler_submit(image, program("ambient")));
+    }
+    automation_priority_stats_t after = class_stats(AUTOMATION_PRIORITY_LOW);
+    TEST_ASSERT_EQUAL_UINT32(1, after.pending);
+    TEST_ASSERT_EQUAL_UINT32(before.coalesced + 2, after.coalesced);
+    drain();
+}
+
+static void test_scheduler_drop_and_replace(void)
+{
+    automation_image_t *image = sched_image();
+    automation_priority_stats_t before = class_stats(AUTOMATION_PRIORITY_NORMAL);
+
+    TEST_ASSERT_EQUAL(ESP_OK, automation_scheduler_submit(image, program("hint")));
+    automation_job_t *hint = automation_scheduler_take(AUTOMATION_PRIORITY_LOW, 0);
+    TEST_ASSERT_NOT_NULL(hint);
+    TEST_ASSERT_EQUAL(ESP_OK, automation_scheduler_submit(image, program("hint")));
+    TEST_ASSERT_EQUAL_UINT32(before.dropped + 1, class_stats(AUTOMATION_PRIORITY_NORMAL).dropped);
+
+    TEST_ASSERT_EQUAL(ESP_OK, automation_scheduler_submit(image, program("music")));
+    automation_job_t *music = automation_scheduler_take(AUTOMATION_PRIORITY_LOW, 0);
+    TEST_ASSERT_NOT_NULL(music);
+    TEST_ASSERT_EQUAL(ESP_OK, automation_scheduler_submit(image, program("music")));
+    TEST_ASSERT_TRUE(music->cancel);
+    // The replacement waits until the cancelled instance has finished.
+    TEST_ASSERT_NULL(automation_scheduler_take(AUTOMATION_PRIORITY_LOW, 0));
+    automation_scheduler_finish(music);
+    automation_job_t *next = automation_scheduler_take(AUTOMATION_PRIORITY_LOW, 0);
+    TEST_ASSERT_NOT_NULL(next);
+    TEST_ASSERT_FALSE(next->cancel);
+    automation_scheduler_finish(next);
+    automation_scheduler_finish(hint);
+    TEST_ASSERT_EQUAL_UINT32(before.replaced + 1, class_stats(AUTOMATION_PRIORITY_NORMAL).replaced);
+}
+
+static void test_scheduler_branches_outlive_parent(void)
+{
+    automation_image_t *image = sched_image();
+    TEST_ASSERT_EQUAL(ESP_OK, automation_scheduler_submit(image, program("music")));
+    automation_job_t *parent = automation_scheduler_take(AUTOMATION_PRIORITY_LOW, 0);
+    TEST_ASSERT_NOT_NULL(parent);
+    TEST_ASSERT_EQUAL(ESP_OK, automation_scheduler_fork(parent, 0, 1));
+    TEST_ASSERT_EQUAL(ESP_OK, automation_scheduler_fork(parent, 0, 1));
+    TEST_ASSERT_EQUAL_UINT8(2, automation_scheduler_children(parent));
+
+    automation_job_t *branch = automation_scheduler_take_child(parent);
+    TEST_ASSERT_NOT_NULL(branch);
+    TEST_ASSERT_EQUAL_PTR(parent, branch->parent);
+    automation_scheduler_finish(branch);
+    TEST_ASSERT_EQUAL_UINT8(1, automation_scheduler_children(parent));
+
+    // Parent ends first; its slot is held until the last branch finishes.
+    automation_scheduler_finish(parent);
+    TEST_ASSERT_TRUE(parent->finished);
+    branch = automation_scheduler_take(AUTOMATION_PRIORITY_LOW, 0);
+    TEST_ASSERT_NOT_NULL(branch);
+    TEST_ASSERT_EQUAL_PTR(parent, branch->parent);
+    automation_scheduler_finish(branch);
+    TEST_ASSERT_EQUAL_UINT32(1, atomic_load(&image->refs));
+}
+
+// Room reset: running jobs are flagged, pending ones dropped, both counted.
+static void test_scheduler_cancel_all(void)
+{
+    automation_image_t *image = sched_image();
+    TEST_ASSERT_EQUAL(ESP_OK, automation_scheduler_submit(image, program("ambient")));
+    automation_job_t *running = automation_scheduler_take(AUTOMATION_PRIORITY_LOW, 0);
+    TEST_ASSERT_NOT_NULL(running);
+    TEST_ASSERT_EQUAL(ESP_OK, automation_scheduler_submit(image, program("ambient")));
+    TEST_ASSERT_EQUAL(ESP_OK, automation_scheduler_submit(image, program("alarm")));
+
+    TEST_ASSERT_EQUAL(3, automation_scheduler_cancel_all());
+    TEST_ASSERT_TRUE(running->cancel);
+    TEST_ASSERT_EQUAL(0, class_stats(AUTOMATION_PRIORITY_CRITICAL).pending);
+    TEST_ASSERT_NULL(automation_scheduler_take(AUTOMATION_PRIORITY_LOW, 0));
+    automation_scheduler_finish(running);
+    TEST_ASSERT_EQUAL(0, automation_scheduler_cancel_all());
+}
+
+static automation_image_t *collision_image(void)
+{
+    device_manager_config_t *cfg = dm_config_create(1);
+    TEST_ASSERT_NOT_NULL(cfg);
+    cfg->device_count = 1;
+    device_descriptor_t *dev = &cfg->devices[0];
+    strncpy(dev->id, "lobby", sizeof(dev->id) - 1);
+    add_policy_scenario(cfg, dev, "music", DEVICE_SCENARIO_PRIORITY_NORMAL, DEVICE_SCENARIO_CONCURRENCY_REPLACE);
+    add_policy_scenario(cfg, dev, "chime", DEVICE_SCENARIO_PRIORITY_NORMAL, DEVICE_SCENARIO_CONCURRENCY_REPLACE);
+    automation_image_t *image = NULL;
+    TEST_ASSERT_EQUAL(ESP_OK, automation_image_build(cfg, &image));
+    dm_config_destroy(cfg);
+    TEST_ASSERT_EQUAL(2, image->program_count);
+    // Force a hash collision between the two scenarios.
+    image->programs[1].key = image->programs[0].key;
+    return image;
+}
+
+// Scenarios sharing a key hash stay independent; the same scenario from a reloaded image
+// is still recognised.
+static void test_scheduler_key_collision(void)
+{
+    sched_image();
+    automation_image_t *image = collision_image();
+    const automation_program_t *music = &image->programs[0];
+    const automation_program_t *chime = &image->programs[1];
+    automation_priority_stats_t before = class_stats(AUTOMATION_PRIORITY_NORMAL);
+
+    TEST_ASSERT_EQUAL(ESP_OK, automation_scheduler_submit(image, music));
+    TEST_ASSERT_EQUAL(ESP_OK, automation_scheduler_submit(image, chime));
+    TEST_ASSERT_EQUAL_UINT32(before.coalesced, class_stats(AUTOMATION_PRIORITY_NORMAL).coalesced);
+    automation_job_t *first = automation_scheduler_take(AUTOMATION_PRIORITY_LOW, 0);
+    automation_job_t *second = automation_scheduler_take(AUTOMATION_PRIORITY_LOW, 0);
+    TEST_ASSERT_NOT_NULL(first);
+    TEST_ASSERT_NOT_NULL(second);
+    TEST_ASSERT_EQUAL_PTR(music, first->program);
+    TEST_ASSERT_EQUAL_PTR(chime, second->program);
+
+    TEST_ASSERT_EQUAL(ESP_OK, automation_scheduler_submit(image, chime));
+    TEST_ASSERT_FALSE(first->cancel);
+    TEST_ASSERT_TRUE(second->cancel);
+    automation_scheduler_finish(second);
+    automation_job_t *next = automation_scheduler_take(AUTOMATION_PRIORITY_LOW, 0);
+    TEST_ASSERT_NOT_NULL(next);
+    TEST_ASSERT_EQUAL_PTR(chime, next->program);
+    automation_scheduler_finish(next);
+
+    automation_image_t *reloaded = collision_image();
+    TEST_ASSERT_EQUAL(ESP_OK, automation_scheduler_submit(reloaded, &reloaded->programs[0]));
+    TEST_ASSERT_TRUE(first->cancel);
+    TEST_ASSERT_NULL(automation_scheduler_take(AUTOMATION_PRIORITY_LOW, 0));
+    automation_scheduler_finish(first);
+    drain();
+    TEST_ASSERT_EQUAL_UINT32(before.replaced + 2, class_stats(AUTOMATION_PRIORITY_NORMAL).replaced);
+    automation_image_release(reloaded);
+    automation_image_release(image);
+}
+
+void register_automation_scheduler_tests(void)
+{
+    RUN_TEST(test_scheduler_priority_order);
+    RUN_TEST(test_scheduler_coalesces_pending);
+    RUN_TEST(test_scheduler_drop_and_replace);
+    RUN_TEST(test_scheduler_branches_outlive_parent);
+    RUN_TEST(test_scheduler_cancel_all);
+    RUN_TEST(test_scheduler_key_collision);
+}
@@ -0,0 +1,134 @@
+#include "unity.h"
+#include "automation_trace.h"
+#include "dm_config.h"
+#include "esp_heap_caps.h"
+#include <string.h>
+
+static void test_trace_percentiles(void)
+{
+    automation_histogram_t hist = {0};
+    // 90 fast samples (<= 2 ms bucket), 9 at ~80 ms, one outlier at 1.5 s.
+    hist.buckets[1] = 90;
+    hist.buckets[6] = 9;
+    hist.buckets[10] = 1;
+    hist.count = 100;
+    hist.max_ms = 1500;
+    TEST_ASSERT_EQUAL_UINT32(2, automation_histogram_percentile(&hist, 50));
+    TEST_ASSERT_EQUAL_UINT32(100, automation_histogram_percentile(&hist, 95));
+    TEST_ASSERT_EQUAL_UINT32(100, automation_histogram_percentile(&hist, 99));
+    TEST_ASSERT_EQUAL_UINT32(1500, automation_histogram_percentile(&hist, 100));
+    automation_histogram_t empty = {0};
+    TEST_ASSERT_EQUAL_UINT32(0, automation_histogram_percentile(&empty, 99));
+}
+
+// A sample equal to a bound belongs to that bound's bucket.
+static void test_histogram_bucket_bounds(void)
+{
+    automation_histogram_t hist = {0};
+    automation_histogram_add(&hist, 0);
+    automation_histogram_add(&hist, 1);
+    automation_histogram_add(&hist, 2);
+    automation_histogram_add(&hist, 3);
+    automation_histogram_add(&hist, UINT32_MAX);
+    TEST_ASSERT_EQUAL_UINT32(2, hist.buckets[0]);
+    TEST_ASSERT_EQUAL_UINT32(1, hist.buckets[1]);
+    TEST_ASSERT_EQUAL_UINT32(1, hist.buckets[2]);
+    TEST_ASSERT_EQUAL_UINT32(1, hist.buckets[AUTOMATION_HISTOGRAM_BUCKETS - 1]);
+    TEST_ASSERT_EQUAL_UINT32(5, hist.count);
+    TEST_ASSERT_EQUAL_UINT32(2, automation_histogram_percentile(&hist, 60));
+}
+
+static automation_image_t *build_vault(int scenarios)
+{
+    device_manager_config_t *cfg = dm_config_create(1);
+    TEST_ASSERT_NOT_NULL(cfg);
+    cfg->device_count = 1;
+    device_descriptor_t *dev = &cfg->devices[0];
+    strncpy(dev->id, "vault", sizeof(dev->id) - 1);
+    const char *ids[] = {"short", "long"};
+    for (int i = 0; i < scenarios; ++i) {
+        device_scenario_t *sc = dm_config_add_scenario(cfg, dev);
+        TEST_ASSERT_NOT_NULL(sc);
+        strncpy(sc->id, ids[i], sizeof(sc->id) - 1);
+        sc->steps = dm_config_alloc_steps(cfg, 2);
+        TEST_ASSERT_NOT_NULL(sc->steps);
+        sc->step_count = 2;
+        sc->steps[0].type = DEVICE_ACTION_DELAY;
+        sc->steps[1].type = DEVICE_ACTION_DELAY;
+    }
+    automation_image_t *image = NULL;
+    automation_image_build(cfg, &image);
+    dm_config_destroy(cfg);
+    return image;
+}
+
+static void test_trace_records_runs(void)
+{
+    automation_image_t *image = build_vault(2);
+    TEST_ASSERT_NOT_NULL(image);
+    TEST_ASSERT_EQUAL(ESP_OK, automation_trace_init());
+    TEST_ASSERT_EQUAL(ESP_OK, automation_trace_retain(image));
+    automation_trace_reset();
+    automation_trace_ref_t fast = automation_trace_lookup(image, automation_image_find(image, "vault", "short"));
+    automation_trace_ref_t slow = automation_trace_lookup(image, automation_image_find(image, "vault", "long"));
+    TEST_ASSERT_TRUE(fast.key != 0);
+    TEST_ASSERT_TRUE(slow.key != 0);
+    automation_trace_ref_t again = automation_trace_lookup(image, automation_image_find(image, "VAULT", "short"));
+    TEST_ASSERT_EQUAL_UINT32(fast.slot, again.slot);
+
+    automation_trace_run(&fast, 3000, 4000, ESP_OK);
+    automation_trace_step(&slow, 1, 250000);
+    automation_trace_run(&slow, 1000, 900000, ESP_ERR_INVALID_STATE);
+
+    automation_trace_snapshot_t *snap = NULL;
+    TEST_ASSERT_EQUAL(ESP_OK, automation_trace_snapshot(&snap));
+    TEST_ASSERT_EQUAL(2, snap->scenario_count);
+    // Busiest scenario first, newest record first.
+    TEST_ASSERT_EQUAL_STRING("long", snap->scenarios[0].scenario_id);
+    TEST_ASSERT_EQUAL_UINT32(1, snap->scenarios[0].cancelled);
+    TEST_ASSERT_EQUAL_UINT32(250000, snap->scenarios[0].steps[1].max_us);
+    TEST_ASSERT_EQUAL(2, snap->recent_count);
+    TEST_ASSERT_EQUAL_UINT32(900, snap->recent[0].run_ms);
+    TEST_ASSERT_EQUAL_UINT32(3, snap->recent[1].queue_ms);
+    automation_trace_snapshot_free(snap);
+    automation_image_release(image);
+}
+
+// A reload keeps the numbers of scenarios that remain and drops the others, even for a
+// run that was still holding its entry.
+static void test_trace_reload_drops_removed(void)
+{
+    automation_image_t *image = build_vault(2);
+    TEST_ASSERT_NOT_NULL(image);
+    TEST_ASSERT_EQUAL(ESP_OK, automation_trace_init());
+    TEST_ASSERT_EQUAL(ESP_OK, automation_trace_retain(image));
+    automation_trace_reset();
+    automation_trace_ref_t fast = automation_trace_lookup(image, automation_image_find(image, "vault", "short"));
+    automation_trace_ref_t slow = automation_trace_lookup(image, automation_image_find(image, "vault", "long"));
+    automation_trace_run(&fast, 1000, 2000, ESP_OK);
+    automation_trace_run(&slow, 1000, 2000, ESP_OK);
+
+    automation_image_t *next = build_vault(1);
+    TEST_ASSERT_NOT_NULL(next);
+    TEST_ASSERT_EQUAL(ESP_OK, automation_trace_retain(next));
+    automation_trace_run(&slow, 1000, 2000, ESP_OK);
+    TEST_ASSERT_EQUAL_UINT32(0, slow.key);
+    automation_trace_run(&fast, 1000, 2000, ESP_OK);
+
+    automation_trace_snapshot_t *snap = NULL;
+    TEST_ASSERT_EQUAL(ESP_OK, automation_trace_snapshot(&snap));
+    TEST_ASSERT_EQUAL(1, snap->scenario_count);
+    TEST_ASSERT_EQUAL_STRING("short", snap->scenarios[0].scenario_id);
+    TEST_ASSERT_EQUAL_UINT32(2, snap->scenarios[0].runs);
+    automation_trace_snapshot_free(snap);
+    automation_image_release(next);
+    automation_image_release(image);
+}
+
+void register_automation_trace_tests(void)
+{
+    RUN_TEST(test_trace_percentiles);
+    RUN_TEST(test_histogram_bucket_bounds);
+    RUN_TEST(test_trace_records_runs);
+    RUN_TEST(test_trace_reload_drops_removed);
+}
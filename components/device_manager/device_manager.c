@@ -12,191 +12,291 @@
 #include "esp_check.h"
 #include "esp_heap_caps.h"
 #include "esp_log.h"
-#include "cJSON.h"
+#include "esp_timer.h"
 #include "event_bus.h"
 #include "esp_task_wdt.h"
 
+#include "dm_bulk.h"
+#include "dm_config.h"
+#include "dm_persist.h"
+#include "dm_profile_cache.h"
 #include "dm_profiles.h"
+#include "dm_runtime_uid.h"
 #include "dm_storage.h"
+#include "dm_xref.h"
 #include "device_manager_utils.h"
 #include "dm_template_runtime.h"
 #include "device_manager_internal.h"
 
 static const char *TAG = "device_manager";
-static const char *CONFIG_BACKUP_PATH = "/sdcard/brocker_devices.json";
 
 #define DM_DEVICE_MAX            DEVICE_MANAGER_MAX_DEVICES
 #define DM_SCENARIO_MAX          DEVICE_MANAGER_MAX_SCENARIOS_PER_DEVICE
-#define DM_COPY_CHUNK_BYTES      512u   // Copy config in small chunks to feed WDT regularly.
 #define DM_LOCK_POLL_MS          50u    // Wait duration between lock polls while feeding WDT.
 #define DM_BOOT_RETRY_COUNT      10     // How many times to retry SD load during boot.
 #define DM_BOOT_RETRY_DELAY_MS   100u   // Delay between boot retries (ms).
 
+// Published configs are immutable generations. Writers serialize on s_lock, edit a private
+// copy and swap it in; readers only bump a reference count under s_config_mux.
 static SemaphoreHandle_t s_lock;
+static portMUX_TYPE s_config_mux = portMUX_INITIALIZER_UNLOCKED;
 static device_manager_config_t *s_config = NULL;
 static bool s_config_ready = false;
 
-// Returns zeroed config large enough to hold `capacity` devices in PSRAM (fallback to internal RAM).
-static device_manager_config_t *dm_config_alloc(uint8_t capacity)
+// Validator results survive between calls so unchanged devices are not checked again.
+static SemaphoreHandle_t s_xref_lock;
+static dm_xref_t *s_xref;
+
+// Hash of the template each registered runtime was built from; unchanged devices are skipped.
+typedef struct {
+    char id[DEVICE_MANAGER_ID_MAX_LEN];
+    uint64_t hash;
+} dm_runtime_digest_t;
+
+// Runtime sync runs after the writer lock is dropped; s_sync_lock keeps two syncs from
+// interleaving their diffs against these digests.
+static SemaphoreHandle_t s_sync_lock;
+static dm_runtime_digest_t s_runtime_digests[DEVICE_MANAGER_MAX_DEVICES];
+static uint8_t s_runtime_digest_count;
+
+// Deep copy of `src` into a fresh arena for `dest`; dest keeps its contents on failure.
+static esp_err_t dm_config_clone(device_manager_config_t *dest, const device_manager_config_t *src)
 {
-    if (capacity == 0) {
-        return NULL;
-    }
-    size_t bytes = sizeof(device_manager_config_t) + sizeof(device_descriptor_t) * capacity;
-    device_manager_config_t *cfg = heap_caps_calloc(1, bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-    if (!cfg) {
-        cfg = heap_caps_calloc(1, bytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    esp_err_t err = dm_config_copy(dest, src);
+    feed_wdt();
+    if (err == ESP_OK && dest->arena) {
+        dm_config_arena_stats_t stats;
+        dm_config_arena_get_stats(dest->arena, &stats);
+        ESP_LOGI(TAG, "dm_copy devices=%u arena=%zu/%zu bytes, psram_free=%u, internal_free=%u",
+                 dest->device_count,
+                 stats.reserved,
+                 stats.budget,
+                 heap_caps_get_free_size(MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT),
+                 heap_caps_get_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT));
     }
-    if (cfg) {
-        cfg->device_capacity = capacity;
+    return err;
+}
+
+static void register_templates_from_config(const device_manager_config_t *cfg);
+
+// Writer lock; poll with timeout so we can feed WDT while waiting.
+static void dm_lock(void)
+{
+    if (s_lock) {
+        while (xSemaphoreTake(s_lock, pdMS_TO_TICKS(DM_LOCK_POLL_MS)) != pdTRUE) {
+            feed_wdt();
+        }
     }
-    return cfg;
 }
 
-static void dm_config_free(device_manager_config_t *cfg)
+static void dm_unlock(void)
 {
-    if (cfg) {
-        heap_caps_free(cfg);
+    if (s_lock) {
+        xSemaphoreGive(s_lock);
     }
 }
 
-static size_t dm_config_device_bytes(const device_manager_config_t *cfg, uint8_t slots)
+static const dm_runtime_digest_t *find_runtime_digest(const dm_runtime_digest_t *list, uint8_t count, const char *id)
 {
-    if (!cfg || slots == 0) {
-        return 0;
+    for (uint8_t i = 0; i < count; ++i) {
+        if (strcmp(list[i].id, id) == 0) {
+            return &list[i];
+        }
     }
-    return sizeof(device_descriptor_t) * slots;
+    return NULL;
 }
 
-// Copies metadata + device descriptors from `src` into `dest`, throttling memcpy to avoid WDT.
-static void dm_config_clone(device_manager_config_t *dest, const device_manager_config_t *src)
+// Brings template runtimes in line with cfg: only added, changed and removed devices are
+// touched, so running puzzles on other devices keep their state and timers.
+static void register_templates_from_config(const device_manager_config_t *cfg)
 {
-    if (!dest || !src) {
+    if (!cfg) {
         return;
     }
-    uint8_t dest_cap = dest->device_capacity ? dest->device_capacity : DEVICE_MANAGER_MAX_DEVICES;
-    uint8_t src_cap = src->device_capacity ? src->device_capacity : DEVICE_MANAGER_MAX_DEVICES;
-    uint8_t src_used = src->device_count;
-    if (src_used > src_cap) {
-        src_used = src_cap;
-    }
-    uint8_t copy_slots = (dest_cap < src_used) ? dest_cap : src_used;
-    size_t meta = sizeof(device_manager_config_t);
-    size_t device_bytes = dm_config_device_bytes(src, copy_slots);
-    ESP_LOGI(TAG, "dm_copy size=%zu, psram_free=%u, internal_free=%u",
-             meta + device_bytes,
-             heap_caps_get_free_size(MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT),
-             heap_caps_get_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT));
-    const size_t chunk = DM_COPY_CHUNK_BYTES;
-    size_t offset = 0;
-    uint8_t *dst_bytes = (uint8_t *)dest;
-    const uint8_t *src_bytes = (const uint8_t *)src;
-    while (offset < meta) {
-        size_t part = chunk;
-        if (part > meta - offset) {
-            part = meta - offset;
+    int64_t start_us = esp_timer_get_time();
+    static dm_runtime_digest_t next[DEVICE_MANAGER_MAX_DEVICES];
+    uint8_t next_count = 0;
+    unsigned added = 0;
+    unsigned changed = 0;
+    unsigned kept = 0;
+    unsigned removed = 0;
+    uint8_t limit = cfg->device_capacity ? cfg->device_capacity : DEVICE_MANAGER_MAX_DEVICES;
+    for (uint8_t i = 0; i < cfg->device_count && i < limit; ++i) {
+        const device_descriptor_t *dev = &cfg->devices[i];
+        if (!dev->template_assigned || !dev->id[0] || next_count >= DEVICE_MANAGER_MAX_DEVICES) {
+            continue;
         }
-        memcpy(dst_bytes + offset, src_bytes + offset, part);
-        offset += part;
-        feed_wdt();
-    }
-    dest->device_capacity = dest_cap;
-    uint8_t *dst_devices = (uint8_t *)dest->devices;
-    const uint8_t *src_devices = (const uint8_t *)src->devices;
-    offset = 0;
-    while (offset < device_bytes) {
-        size_t part = chunk;
-        if (part > device_bytes - offset) {
-            part = device_bytes - offset;
+        uint64_t hash = dm_hash_bytes(&dev->template_config, sizeof(dev->template_config));
+        if (dev->template_config.type == DM_TEMPLATE_TYPE_UID) {
+            // Re-applying an unchanged reader picks up an edited card list.
+            hash = dm_uid_template_files_digest(&dev->template_config.data.uid, hash);
+        }
+        const dm_runtime_digest_t *prev = find_runtime_digest(s_runtime_digests, s_runtime_digest_count, dev->id);
+        if (prev && prev->hash == hash) {
+            kept++;
+        } else {
+            ESP_LOGI(TAG, "registering template for %s (type=%d)", dev->id, dev->template_config.type);
+            esp_err_t err = dm_template_runtime_register(cfg, &dev->template_config, dev->id);
+            if (err != ESP_OK) {
+                ESP_LOGW(TAG, "template runtime register failed for %s: %s", dev->id, esp_err_to_name(err));
+                continue;
+            }
+            if (prev) {
+                changed++;
+            } else {
+                added++;
+            }
+        }
+        dm_str_copy(next[next_count].id, sizeof(next[next_count].id), dev->id);
+        next[next_count].hash = hash;
+        next_count++;
+    }
+    for (uint8_t i = 0; i < s_runtime_digest_count; ++i) {
+        if (!find_runtime_digest(next, next_count, s_runtime_digests[i].id)) {
+            dm_template_runtime_unregister(s_runtime_digests[i].id);
+            removed++;
         }
-        memcpy(dst_devices + offset, src_devices + offset, part);
-        offset += part;
-        feed_wdt();
-    }
-    if (dest_cap > copy_slots) {
-        size_t remaining_bytes = dm_config_device_bytes(dest, dest_cap - copy_slots);
-        memset(dst_devices + device_bytes, 0, remaining_bytes);
-    }
-    if (dest->device_count > dest_cap) {
-        dest->device_count = dest_cap;
     }
+    memcpy(s_runtime_digests, next, sizeof(next[0]) * next_count);
+    s_runtime_digest_count = next_count;
+    // Kept runtimes move to this generation too, so the one they came from can be freed.
+    size_t adopted = dm_template_runtime_adopt(cfg);
+    dm_template_runtime_stats_t stats;
+    dm_template_runtime_get_stats(&stats);
+    ESP_LOGI(TAG,
+             "templates synced in %lld us: +%u ~%u -%u =%u, %u adopted (runtimes=%u, %u/%u arena bytes, topics=%u)",
+             (long long)(esp_timer_get_time() - start_us),
+             added,
+             changed,
+             removed,
+             kept,
+             (unsigned)adopted,
+             (unsigned)stats.runtimes,
+             (unsigned)stats.bytes,
+             (unsigned)stats.arena_bytes,
+             (unsigned)stats.topics);
 }
 
-static void *dm_cjson_malloc(size_t size);
-static void dm_cjson_free(void *ptr);
-// Install cJSON hooks so large JSON structures use PSRAM where possible.
-void dm_cjson_install_hooks(void)
+const device_manager_config_t *device_manager_acquire_config(void)
 {
-    cJSON_Hooks hooks = {
-        .malloc_fn = dm_cjson_malloc,
-        .free_fn = dm_cjson_free,
-    };
-    cJSON_InitHooks(&hooks);
+    portENTER_CRITICAL(&s_config_mux);
+    device_manager_config_t *cfg = s_config;
+    if (cfg) {
+        cfg->refs++;
+    }
+    portEXIT_CRITICAL(&s_config_mux);
+    return cfg;
 }
 
-// Restore default cJSON allocators to avoid affecting other modules.
-void dm_cjson_reset_hooks(void)
-{
-    cJSON_InitHooks(NULL);
-}
-static void *dm_cjson_malloc(size_t size)
+void device_manager_release_config(const device_manager_config_t *cfg)
 {
-    void *ptr = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-    if (!ptr) {
-        ptr = heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!cfg) {
+        return;
+    }
+    device_manager_config_t *owned = (device_manager_config_t *)cfg;
+    portENTER_CRITICAL(&s_config_mux);
+    bool last = --owned->refs == 0;
+    portEXIT_CRITICAL(&s_config_mux);
+    if (last) {
+        dm_config_destroy(owned);
     }
-    return ptr;
 }
 
-static void dm_cjson_free(void *ptr)
+void device_manager_retain_config(const device_manager_config_t *cfg)
 {
-    if (ptr) {
-        heap_caps_free(ptr);
+    if (!cfg) {
+        return;
     }
+    portENTER_CRITICAL(&s_config_mux);
+    ((device_manager_config_t *)cfg)->refs++;
+    portEXIT_CRITICAL(&s_config_mux);
 }
 
-static void register_templates_from_config(device_manager_config_t *cfg);
-
+// Writer lock held. Makes `next` the current generation; the previous one is freed by
+// whoever drops the last reference to it.
+static void dm_publish_locked(device_manager_config_t *next)
+{
+    dm_profiles_sync_to_active(next);
+    // A cached copy of the profile going live would miss the edits made from now on.
+    dm_profile_cache_drop(next->active_profile);
+    uint32_t generation = next->generation;
+    if (s_config && s_config->generation >= generation) {
+        generation = s_config->generation;
+    }
+    next->generation = generation + 1;
+    next->refs = 1;     // held by s_config
+    portENTER_CRITICAL(&s_config_mux);
+    device_manager_config_t *old = s_config;
+    s_config = next;
+    portEXIT_CRITICAL(&s_config_mux);
+    device_manager_release_config(old);
+}
 
+// Writer lock held. Private deep copy of the current generation to edit and publish.
+static device_manager_config_t *dm_draft_locked(void)
+{
+    device_manager_config_t *draft = dm_config_create(0);
+    if (draft && dm_config_clone(draft, s_config) != ESP_OK) {
+        dm_config_destroy(draft);
+        draft = NULL;
+    }
+    return draft;
+}
 
+// Writer lock held, the current generation already on the card. Keeps it for switching back
+// once another profile is published.
+static void dm_cache_outgoing_locked(void)
+{
+    dm_profile_cache_put((device_manager_config_t *)device_manager_acquire_config());
+}
 
-// Global device-manager lock; poll with timeout so we can feed WDT while waiting.
-static void dm_lock(void)
+// Writer lock held. Makes the cached generation of profile `id` the next one, with the profile
+// list of the current generation. Nobody else holding it, it is taken over as is; otherwise
+// (a reader from when it was live) it is copied, which still skips the card.
+static device_manager_config_t *dm_adopt_cached_locked(device_manager_config_t *cached, const char *id)
 {
-    if (s_lock) {
-        while (xSemaphoreTake(s_lock, pdMS_TO_TICKS(DM_LOCK_POLL_MS)) != pdTRUE) {
-            feed_wdt();
+    portENTER_CRITICAL(&s_config_mux);
+    bool shared = cached->refs > 1;
+    portEXIT_CRITICAL(&s_config_mux);
+    device_manager_config_t *next = cached;
+    if (shared) {
+        next = dm_config_create(0);
+        if (next && dm_config_clone(next, cached) != ESP_OK) {
+            dm_config_destroy(next);
+            next = NULL;
+        }
+        device_manager_release_config(cached);
+        if (!next) {
+            return NULL;
         }
     }
+    next->schema_version = s_config->schema_version;
+    next->profile_count = s_config->profile_count;
+    memcpy(next->profiles, s_config->profiles, sizeof(next->profiles));
+    dm_str_copy(next->active_profile, sizeof(next->active_profile), id);
+    return next;
 }
 
-static void dm_unlock(void)
+// The generation is taken under the sync lock, so the last sync to run sees the newest one.
+static void register_templates_from_current(void)
 {
-    if (s_lock) {
-        xSemaphoreGive(s_lock);
+    if (s_sync_lock) {
+        xSemaphoreTake(s_sync_lock, portMAX_DELAY);
+    }
+    const device_manager_config_t *cfg = device_manager_acquire_config();
+    register_templates_from_config(cfg);
+    device_manager_release_config(cfg);
+    if (s_sync_lock) {
+        xSemaphoreGive(s_sync_lock);
     }
 }
 
-// Recreate runtime instances for every template in the active config.
-static void register_templates_from_config(device_manager_config_t *cfg)
+static void post_config_changed(void)
 {
-    if (!cfg) {
-        return;
-    }
-    ESP_LOGI(TAG, "register_templates_from_config: resetting runtime");
-    dm_template_runtime_reset();
-    uint8_t limit = cfg->device_capacity ? cfg->device_capacity : DEVICE_MANAGER_MAX_DEVICES;
-    for (uint8_t i = 0; i < cfg->device_count && i < limit; ++i) {
-        device_descriptor_t *dev = &cfg->devices[i];
-        if (dev->template_assigned) {
-            ESP_LOGI(TAG, "registering template for %s (type=%d)", dev->id, dev->template_config.type);
-            esp_err_t err = dm_template_runtime_register(&dev->template_config, dev->id);
-            if (err != ESP_OK) {
-                ESP_LOGW(TAG, "template runtime register failed for %s: %s", dev->id, esp_err_to_name(err));
-            }
-        }
-    }
-    ESP_LOGI(TAG, "register_templates_from_config: done");
+    event_bus_message_t msg = {
+        .type = EVENT_DEVICE_CONFIG_CHANGED,
+    };
+    event_bus_post(&msg, 0);
 }
 
 esp_err_t device_manager_init(void)
@@ -207,57 +307,48 @@ esp_err_t device_manager_init(void)
              heap_caps_get_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT));
     ESP_LOGI(TAG, "device_manager_init start");
     if (!s_lock) { s_lock = xSemaphoreCreateMutex(); }
+    if (!s_sync_lock) { s_sync_lock = xSemaphoreCreateMutex(); }
+    if (!s_xref_lock) { s_xref_lock = xSemaphoreCreateMutex(); }
     if (s_config_ready) {
         ESP_LOGI(TAG, "device_manager already initialized");
         return ESP_OK;
     }
-    if (!s_config) {
-        s_config = dm_config_alloc(DEVICE_MANAGER_MAX_DEVICES);
-        ESP_RETURN_ON_FALSE(s_config != NULL, ESP_ERR_NO_MEM, TAG, "alloc config failed");
-        ESP_LOGI(TAG, "allocating config buffer (%zu bytes)",
-                 sizeof(device_manager_config_t) +
-                     dm_config_device_bytes(s_config, s_config->device_capacity));
-    }
-    ESP_LOGI(TAG, "loading defaults to config buffer");
-    dm_load_defaults(s_config);
+    device_manager_config_t *next = dm_config_create(0);
+    ESP_RETURN_ON_FALSE(next != NULL, ESP_ERR_NO_MEM, TAG, "alloc config failed");
+    ESP_LOGI(TAG, "config budget %zu bytes (%zu per device slot)",
+             DM_CONFIG_BUDGET_BYTES,
+             sizeof(device_descriptor_t));
     feed_wdt();
-    device_manager_config_t *temp = dm_config_alloc(DEVICE_MANAGER_MAX_DEVICES);
-    if (!temp) {
-        ESP_LOGE(TAG, "no memory for temp config");
-        return ESP_ERR_NO_MEM;
-    }
-    feed_wdt();
-    ESP_LOGI(TAG, "Expected cfg size=%zu",
-             sizeof(device_manager_config_t) +
-                 dm_config_device_bytes(temp, temp->device_capacity));
-    ESP_LOGI(TAG, "loading config from %s", CONFIG_BACKUP_PATH);
-    esp_err_t load_err = dm_storage_load(CONFIG_BACKUP_PATH, temp);
+    ESP_LOGI(TAG, "loading config from %s", DM_CONFIG_BACKUP_PATH);
+    esp_err_t load_err = dm_storage_load(DM_CONFIG_BACKUP_PATH, next);
     feed_wdt();
     if (load_err == ESP_OK) {
-        dm_lock();
-        feed_wdt();
-        dm_config_clone(s_config, temp);
-        s_config->generation++;
-        dm_unlock();
         ESP_LOGI(TAG, "device config loaded from file");
     } else {
-        dm_lock();
-        dm_load_defaults(s_config);
+        dm_load_defaults(next);
         feed_wdt();
         ESP_LOGW(TAG, "using defaults, saving to file: %s", esp_err_to_name(load_err));
-        ESP_ERROR_CHECK_WITHOUT_ABORT(dm_storage_save(CONFIG_BACKUP_PATH, s_config));
-        dm_unlock();
+        ESP_ERROR_CHECK_WITHOUT_ABORT(dm_storage_save(DM_CONFIG_BACKUP_PATH, next));
+    }
+    dm_lock();
+    dm_profiles_sync_from_active(next, true);
+    dm_publish_locked(next);
+    uint32_t generation = next->generation;
+    dm_unlock();
+    dm_profile_cache_init(DM_PROFILE_CACHE_BUDGET_BYTES, device_manager_release_config);
+    // What was just loaded (or the defaults written above) is already on the card.
+    esp_err_t persist_err = dm_persist_start(generation);
+    if (persist_err != ESP_OK) {
+        ESP_LOGW(TAG, "background persistence unavailable: %s", esp_err_to_name(persist_err));
     }
-    dm_config_free(temp);
-    dm_profiles_sync_from_active(s_config, true);
-    dm_profiles_sync_to_active(s_config);
     s_config_ready = true;
     esp_err_t rt_err = dm_template_runtime_init();
     if (rt_err != ESP_OK) {
         ESP_LOGE(TAG, "template runtime init failed: %s", esp_err_to_name(rt_err));
         return rt_err;
     }
-    register_templates_from_config(s_config);
+    s_runtime_digest_count = 0;
+    register_templates_from_current();
     ESP_LOGI(TAG, "device_manager_init finished successfully");
     for (int i = 0; i < DM_BOOT_RETRY_COUNT; ++i) {
         feed_wdt();
@@ -267,78 +358,43 @@ esp_err_t device_manager_init(void)
     return ESP_OK;
 }
 
-const device_manager_config_t *device_manager_lock_config(void)
-{
-    dm_lock();
-    return s_config;
-}
-
-void device_manager_unlock_config(void)
-{
-    dm_unlock();
-}
-
 // Re-read JSON config from SD card and swap active configuration.
 esp_err_t device_manager_reload_from_nvs(void)
 {
     if (!s_config_ready) {
         return ESP_ERR_INVALID_STATE;
     }
-    device_manager_config_t *temp = dm_config_alloc(DEVICE_MANAGER_MAX_DEVICES);
-    if (!temp) {
+    device_manager_config_t *next = dm_config_create(0);
+    if (!next) {
         return ESP_ERR_NO_MEM;
     }
     feed_wdt();
-    esp_err_t err = dm_storage_load(CONFIG_BACKUP_PATH, temp);
+    esp_err_t err = dm_storage_load(DM_CONFIG_BACKUP_PATH, next);
     feed_wdt();
     if (err != ESP_OK) {
-        dm_config_free(temp);
+        dm_config_destroy(next);
         return err;
     }
     dm_lock();
+    // Profile files may have been replaced behind our back; cached copies can't be trusted.
+    dm_profile_cache_clear();
+    dm_profiles_sync_from_active(next, true);
     feed_wdt();
-    dm_config_clone(s_config, temp);
-    s_config->generation++;
-    dm_profiles_sync_from_active(s_config, true);
-    dm_profiles_sync_to_active(s_config);
-    feed_wdt();
+    dm_publish_locked(next);
+    // Pending writes of older generations are superseded by what was just read back.
+    dm_persist_mark_clean(next->generation);
     dm_unlock();
-    dm_config_free(temp);
-    register_templates_from_config(s_config);
+    register_templates_from_current();
     return ESP_OK;
 }
 
-// s_config must be locked before calling; writes active profile + JSON backup to disk.
-static esp_err_t persist_locked(void)
-{
-    uint8_t cap = s_config ? s_config->device_capacity : DEVICE_MANAGER_MAX_DEVICES;
-    device_manager_config_t *snapshot = dm_config_alloc(cap);
-    if (!snapshot) {
-        return ESP_ERR_NO_MEM;
-    }
-    feed_wdt();
-    dm_profiles_sync_to_active(s_config);
-    esp_err_t profile_err = dm_profiles_store_active(s_config);
-    if (profile_err != ESP_OK) {
-        dm_config_free(snapshot);
-        return profile_err;
-    }
-    dm_config_clone(snapshot, s_config);
-    feed_wdt();
-    esp_err_t err = dm_storage_save(CONFIG_BACKUP_PATH, snapshot);
-    dm_config_free(snapshot);
-    return err;
-}
-
 // Persist active profile + JSON backup. Safe to call while system runs.
 esp_err_t device_manager_save_snapshot(void)
 {
     if (!s_config_ready) {
         return ESP_ERR_INVALID_STATE;
     }
-    dm_lock();
-    esp_err_t err = persist_locked();
-    dm_unlock();
+    esp_err_t err = dm_persist_flush();
     if (err == ESP_OK) {
         ESP_LOGI(TAG, "device config saved to file");
     }
@@ -351,26 +407,34 @@ esp_err_t device_manager_apply(const device_manager_config_t *next)
     if (!next || !s_config_ready) {
         return ESP_ERR_INVALID_ARG;
     }
+    // The copy is built before taking the writer lock; readers keep the old generation meanwhile.
+    device_manager_config_t *fresh = dm_config_create(0);
+    if (!fresh) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t clone_err = dm_config_clone(fresh, next);
+    if (clone_err != ESP_OK) {
+        dm_config_destroy(fresh);
+        return clone_err;
+    }
     dm_lock();
-    feed_wdt();
-    dm_config_clone(s_config, next);
-    feed_wdt();
-    s_config->generation++;
-    dm_profiles_sync_to_active(s_config);
-    feed_wdt();
-    esp_err_t err = persist_locked();
-    dm_unlock();
-    if (err == ESP_OK) {
-        ESP_LOGI(TAG, "device_manager_apply: config persisted, re-registering templates");
-        register_templates_from_config(s_config);
-        event_bus_message_t msg = {
-            .type = EVENT_DEVICE_CONFIG_CHANGED,
-        };
-        event_bus_post(&msg, 0);
-    } else {
-        ESP_LOGE(TAG, "device_manager_apply: persist failed: %s", esp_err_to_name(err));
+    if (strcmp(fresh->active_profile, s_config->active_profile) != 0) {
+        // Only the active profile is written behind; the outgoing one has to land first.
+        esp_err_t flush_err = dm_persist_flush();
+        if (flush_err != ESP_OK) {
+            dm_unlock();
+            dm_config_destroy(fresh);
+            return flush_err;
+        }
+        dm_cache_outgoing_locked();
     }
-    return err;
+    dm_publish_locked(fresh);
+    dm_unlock();
+    dm_persist_request();
+    ESP_LOGI(TAG, "device_manager_apply: config live, re-registering templates");
+    register_templates_from_current();
+    post_config_changed();
+    return ESP_OK;
 }
 
 esp_err_t device_manager_sync_file(void)
@@ -378,16 +442,12 @@ esp_err_t device_manager_sync_file(void)
     if (!s_config_ready) {
         return ESP_ERR_INVALID_STATE;
     }
-    dm_lock();
-    dm_profiles_sync_to_active(s_config);
-    esp_err_t profile_err = dm_profiles_store_active(s_config);
-    if (profile_err != ESP_OK) {
-        dm_unlock();
-        return profile_err;
-    }
-    esp_err_t err = dm_storage_save(CONFIG_BACKUP_PATH, s_config);
-    dm_unlock();
-    return err;
+    return dm_persist_flush();
+}
+
+void device_manager_get_persist_status(device_manager_persist_status_t *out)
+{
+    dm_persist_get_status(out);
 }
 
 esp_err_t device_manager_export_json(char **out_json, size_t *out_len)
@@ -400,36 +460,72 @@ esp_err_t device_manager_export_profile_json(const char *profile_id, char **out_
     if (!out_json) {
         return ESP_ERR_INVALID_ARG;
     }
-    if (!s_config) {
-        return ESP_ERR_INVALID_STATE;
-    }
     *out_json = NULL;
     if (out_len) {
         *out_len = 0;
     }
-    dm_lock();
-    dm_profiles_sync_to_active(s_config);
+    dm_json_buffer_t buf = {0};
+    esp_err_t err = device_manager_export_profile_stream(profile_id, dm_json_buffer_sink, &buf);
+    if (err != ESP_OK) {
+        heap_caps_free(buf.data);
+        return err;
+    }
+    *out_json = buf.data;
+    if (out_len) {
+        *out_len = buf.len;
+    }
+    return ESP_OK;
+}
+
+esp_err_t device_manager_export_profile_stream(const char *profile_id, dm_json_sink_fn sink, void *ctx)
+{
+    if (!sink) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const device_manager_config_t *cfg = device_manager_acquire_config();
+    if (!cfg) {
+        return ESP_ERR_INVALID_STATE;
+    }
     bool export_active = (!profile_id || !profile_id[0] ||
-                          strcasecmp(profile_id, s_config->active_profile) == 0);
+                          strcasecmp(profile_id, cfg->active_profile) == 0);
     if (export_active) {
-        esp_err_t err = dm_storage_export_json(s_config, out_json, out_len);
-        dm_unlock();
+        // The held generation stays intact however slowly the sink drains.
+        esp_err_t err = dm_storage_export_stream(cfg, sink, ctx);
+        device_manager_release_config(cfg);
         return err;
     }
-    uint8_t cap = s_config ? s_config->device_capacity : DEVICE_MANAGER_MAX_DEVICES;
-    device_manager_config_t *snapshot = dm_config_alloc(cap);
+    device_manager_config_t *snapshot = dm_config_create(0);
     if (!snapshot) {
-        dm_unlock();
+        device_manager_release_config(cfg);
         return ESP_ERR_NO_MEM;
     }
-    feed_wdt();
-    dm_config_clone(snapshot, s_config);
-    dm_unlock();
+    esp_err_t clone_err = dm_config_clone(snapshot, cfg);
+    device_manager_release_config(cfg);
+    if (clone_err != ESP_OK) {
+        dm_config_destroy(snapshot);
+        return clone_err;
+    }
     dm_str_copy(snapshot->active_profile, sizeof(snapshot->active_profile), profile_id);
     dm_profiles_ensure_active(snapshot);
     dm_profiles_sync_from_active(snapshot, false);
-    esp_err_t err = dm_storage_export_json(snapshot, out_json, out_len);
-    dm_config_free(snapshot);
+    esp_err_t err = dm_storage_export_stream(snapshot, sink, ctx);
+    dm_config_destroy(snapshot);
+    return err;
+}
+
+// Takes over a freshly parsed config as either the active profile or `profile_id`.
+static esp_err_t apply_parsed(const char *profile_id, device_manager_config_t *next, esp_err_t parse_err)
+{
+    if (parse_err != ESP_OK) {
+        dm_config_destroy(next);
+        return parse_err;
+    }
+    if (profile_id && profile_id[0]) {
+        dm_str_copy(next->active_profile, sizeof(next->active_profile), profile_id);
+    }
+    feed_wdt();
+    esp_err_t err = device_manager_apply(next);
+    dm_config_destroy(next);
     return err;
 }
 
@@ -439,31 +535,178 @@ esp_err_t device_manager_apply_profile_json(const char *profile_id, const char *
     if (!json || len == 0) {
         return ESP_ERR_INVALID_ARG;
     }
-    cJSON *root = cJSON_ParseWithLength(json, len);
-    if (!root) {
+    device_manager_config_t *next = dm_config_create(0);
+    if (!next) {
+        return ESP_ERR_NO_MEM;
+    }
+    return apply_parsed(profile_id, next, dm_storage_parse_json(json, len, next));
+}
+
+esp_err_t device_manager_apply_profile_stream(const char *profile_id, dm_json_source_fn source, void *ctx)
+{
+    if (!source) {
         return ESP_ERR_INVALID_ARG;
     }
-    uint8_t cap = s_config ? s_config->device_capacity : DEVICE_MANAGER_MAX_DEVICES;
-    device_manager_config_t *next = dm_config_alloc(cap);
+    device_manager_config_t *next = dm_config_create(0);
     if (!next) {
-        cJSON_Delete(root);
         return ESP_ERR_NO_MEM;
     }
-    bool ok = dm_populate_config_from_json(next, root);
-    cJSON_Delete(root);
-    if (!ok) {
-        dm_config_free(next);
+    return apply_parsed(profile_id, next, dm_storage_parse_stream(source, ctx, next));
+}
+
+esp_err_t device_manager_export_bulk_stream(dm_json_sink_fn sink, void *ctx)
+{
+    if (!sink) {
         return ESP_ERR_INVALID_ARG;
     }
-    if (profile_id && profile_id[0]) {
-        dm_str_copy(next->active_profile, sizeof(next->active_profile), profile_id);
+    const device_manager_config_t *cfg = device_manager_acquire_config();
+    if (!cfg) {
+        return ESP_ERR_INVALID_STATE;
     }
-    feed_wdt();
-    esp_err_t err = device_manager_apply(next);
-    dm_config_free(next);
+    esp_err_t err = dm_bulk_export(cfg, sink, ctx);
+    device_manager_release_config(cfg);
+    return err;
+}
+
+esp_err_t device_manager_validate(bool full, dm_json_sink_fn sink, void *ctx,
+                                  uint16_t *out_errors, uint16_t *out_warnings)
+{
+    if (!s_xref_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    const device_manager_config_t *cfg = device_manager_acquire_config();
+    if (!cfg) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(s_xref_lock, portMAX_DELAY);
+    if (!s_xref) {
+        s_xref = dm_xref_create();
+    }
+    esp_err_t err = s_xref ? dm_xref_run(s_xref, cfg, full) : ESP_ERR_NO_MEM;
+    if (err == ESP_OK) {
+        dm_xref_summary_t summary;
+        dm_xref_get_summary(s_xref, &summary);
+        if (out_errors) {
+            *out_errors = summary.errors;
+        }
+        if (out_warnings) {
+            *out_warnings = summary.warnings;
+        }
+        if (summary.rechecked) {
+            ESP_LOGI(TAG, "validate gen=%u: %u errors, %u warnings (%u/%u devices checked)",
+                     (unsigned)cfg->generation, summary.errors, summary.warnings,
+                     summary.rechecked, summary.devices);
+        }
+    }
+    if (err == ESP_OK && sink) {
+        dm_json_writer_t *w = heap_caps_malloc(sizeof(*w), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (w) {
+            dm_json_writer_init(w, sink, ctx);
+            dm_xref_write_json(s_xref, cfg, w);
+            err = dm_json_writer_finish(w);
+            heap_caps_free(w);
+        } else {
+            err = ESP_ERR_NO_MEM;
+        }
+    }
+    xSemaphoreGive(s_xref_lock);
+    device_manager_release_config(cfg);
     return err;
 }
 
+// Writer lock held. Files of listed profiles that `next` does not list any more go away.
+static void dm_delete_dropped_profiles_locked(const device_manager_config_t *next)
+{
+    for (uint8_t i = 0; i < s_config->profile_count; ++i) {
+        const char *id = s_config->profiles[i].id;
+        bool kept = false;
+        for (uint8_t j = 0; j < next->profile_count && !kept; ++j) {
+            kept = strcasecmp(next->profiles[j].id, id) == 0;
+        }
+        if (!kept && id[0]) {
+            esp_err_t err = dm_profiles_delete_profile_file(id);
+            if (err != ESP_OK) {
+                ESP_LOGW(TAG, "failed to remove profile %s file: %s", id, esp_err_to_name(err));
+            }
+        }
+    }
+}
+
+esp_err_t device_manager_import_bulk_stream(dm_json_source_fn source, void *ctx, uint8_t *out_profiles)
+{
+    if (!source) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_config_ready) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    // Everything is decoded into PSRAM first; nothing on the card changes until it checks out.
+    dm_bulk_set_t set;
+    esp_err_t err = dm_bulk_import(source, ctx, &set);
+    if (err != ESP_OK) {
+        return err;
+    }
+    uint8_t active = 0;
+    for (uint8_t i = 0; i < set.count; ++i) {
+        if (strcasecmp(set.profiles[i]->active_profile, set.active_profile) == 0) {
+            active = i;
+        }
+    }
+    device_manager_config_t *next = set.profiles[active];
+    set.profiles[active] = NULL;
+    // The profile list follows the stream; each document names its own profile.
+    const device_manager_profile_t *own = dm_profiles_find_by_id(next, next->active_profile);
+    char active_name[DEVICE_MANAGER_NAME_MAX_LEN];
+    dm_str_copy(active_name, sizeof(active_name), own && own->name[0] ? own->name : next->active_profile);
+    next->profile_count = set.count;
+    for (uint8_t i = 0; i < set.count; ++i) {
+        device_manager_config_t *doc = set.profiles[i] ? set.profiles[i] : next;
+        device_manager_profile_t *dst = &next->profiles[i];
+        own = doc == next ? NULL : dm_profiles_find_by_id(doc, doc->active_profile);
+        memset(dst, 0, sizeof(*dst));
+        dm_str_copy(dst->id, sizeof(dst->id), doc->active_profile);
+        dm_str_copy(dst->name, sizeof(dst->name),
+                    doc == next ? active_name : (own && own->name[0] ? own->name : doc->active_profile));
+        dst->device_count = doc->device_count;
+    }
+
+    dm_lock();
+    err = dm_persist_flush();
+    if (err == ESP_OK) {
+        // All inactive profile files change together or not at all.
+        err = dm_profiles_store_all(set.profiles, set.count);
+        feed_wdt();
+    }
+    if (err != ESP_OK) {
+        dm_unlock();
+        ESP_LOGE(TAG, "bulk import not applied: %s", esp_err_to_name(err));
+        dm_config_destroy(next);
+        dm_bulk_set_free(&set);
+        return err;
+    }
+    dm_delete_dropped_profiles_locked(next);
+    dm_profile_cache_clear();
+    dm_publish_locked(next);
+    // The decoded inactive profiles match their new files, so switching to one is a swap.
+    for (uint8_t i = 0; i < set.count; ++i) {
+        if (set.profiles[i]) {
+            set.profiles[i]->refs = 1;
+            dm_profile_cache_put(set.profiles[i]);
+            set.profiles[i] = NULL;
+        }
+    }
+    dm_unlock();
+    if (out_profiles) {
+        *out_profiles = set.count;
+    }
+    ESP_LOGI(TAG, "bulk import: %u profiles, %s active", (unsigned)set.count, set.active_profile);
+    dm_bulk_set_free(&set);
+    dm_persist_request();
+    register_templates_from_current();
+    post_config_changed();
+    return ESP_OK;
+}
+
 esp_err_t device_manager_profile_create(const char *id, const char *name, const char *clone_id)
 {
     if (!s_config_ready) {
@@ -473,48 +716,47 @@ esp_err_t device_manager_profile_create(const char *id, const char *name, const
         return ESP_ERR_INVALID_ARG;
     }
     dm_lock();
-    dm_profiles_ensure_active(s_config);
-    if (dm_profiles_find_by_id(s_config, id)) {
-        dm_unlock();
-        return ESP_ERR_INVALID_STATE;
+    // Profile files are read and written directly below; pending writes go first.
+    esp_err_t err = dm_persist_flush();
+    device_manager_config_t *draft = err == ESP_OK ? dm_draft_locked() : NULL;
+    if (err == ESP_OK && !draft) {
+        err = ESP_ERR_NO_MEM;
     }
-    if (s_config->profile_count >= DEVICE_MANAGER_MAX_PROFILES) {
-        dm_unlock();
-        return ESP_ERR_NO_MEM;
+    if (err == ESP_OK) {
+        dm_profiles_ensure_active(draft);
+        if (dm_profiles_find_by_id(draft, id)) {
+            err = ESP_ERR_INVALID_STATE;
+        } else if (draft->profile_count >= DEVICE_MANAGER_MAX_PROFILES) {
+            err = ESP_ERR_NO_MEM;
+        }
     }
-    if (clone_id && clone_id[0]) {
-        const device_manager_profile_t *clone_profile = dm_profiles_find_by_id(s_config, clone_id);
+    if (err == ESP_OK && clone_id && clone_id[0]) {
+        const device_manager_profile_t *clone_profile = dm_profiles_find_by_id(draft, clone_id);
         if (clone_profile) {
-            uint8_t cloned_count = 0;
-            esp_err_t clone_err = dm_profiles_load_profile(clone_profile->id,
-                                                           s_config->devices,
-                                                           s_config->device_capacity,
-                                                           &cloned_count);
-            if (clone_err != ESP_OK) {
-                dm_unlock();
-                return clone_err;
-            }
-            s_config->device_count = cloned_count;
+            err = dm_profiles_load_profile(clone_profile->id, draft);
         } else {
             ESP_LOGW(TAG, "clone profile %s not found, using active", clone_id);
         }
     }
-    device_manager_profile_t *dst = &s_config->profiles[s_config->profile_count++];
-    memset(dst, 0, sizeof(*dst));
-    dm_str_copy(dst->id, sizeof(dst->id), id);
-    dm_str_copy(dst->name, sizeof(dst->name), (name && name[0]) ? name : id);
-    dm_str_copy(s_config->active_profile, sizeof(s_config->active_profile), dst->id);
-    dm_profiles_sync_to_active(s_config);
-    esp_err_t store_err = dm_profiles_store_active(s_config);
-    if (store_err != ESP_OK) {
-        s_config->profile_count--;
+    if (err == ESP_OK) {
+        device_manager_profile_t *dst = &draft->profiles[draft->profile_count++];
+        memset(dst, 0, sizeof(*dst));
+        dm_str_copy(dst->id, sizeof(dst->id), id);
+        dm_str_copy(dst->name, sizeof(dst->name), (name && name[0]) ? name : id);
+        dm_str_copy(draft->active_profile, sizeof(draft->active_profile), dst->id);
+        dm_profiles_sync_to_active(draft);
+        err = dm_profiles_store_active(draft);
+    }
+    if (err != ESP_OK) {
         dm_unlock();
-        return store_err;
+        dm_config_destroy(draft);
+        return err;
     }
-    s_config->generation++;
-    esp_err_t err = persist_locked();
+    dm_cache_outgoing_locked();
+    dm_publish_locked(draft);
     dm_unlock();
-    return err;
+    dm_persist_request();
+    return ESP_OK;
 }
 
 esp_err_t device_manager_profile_delete(const char *id)
@@ -526,40 +768,53 @@ esp_err_t device_manager_profile_delete(const char *id)
         return ESP_ERR_INVALID_ARG;
     }
     dm_lock();
-    dm_profiles_ensure_active(s_config);
-    if (s_config->profile_count <= 1) {
+    esp_err_t flush_err = dm_persist_flush();
+    if (flush_err != ESP_OK) {
+        dm_unlock();
+        return flush_err;
+    }
+    device_manager_config_t *draft = dm_draft_locked();
+    if (!draft) {
         dm_unlock();
+        return ESP_ERR_NO_MEM;
+    }
+    dm_profiles_ensure_active(draft);
+    if (draft->profile_count <= 1) {
+        dm_unlock();
+        dm_config_destroy(draft);
         return ESP_ERR_INVALID_STATE;
     }
     int idx = -1;
-    for (uint8_t i = 0; i < s_config->profile_count; ++i) {
-        if (strcasecmp(s_config->profiles[i].id, id) == 0) {
+    for (uint8_t i = 0; i < draft->profile_count; ++i) {
+        if (strcasecmp(draft->profiles[i].id, id) == 0) {
             idx = i;
             break;
         }
     }
     if (idx < 0) {
         dm_unlock();
+        dm_config_destroy(draft);
         return ESP_ERR_NOT_FOUND;
     }
+    dm_profile_cache_drop(id);
     esp_err_t delete_err = dm_profiles_delete_profile_file(id);
     if (delete_err != ESP_OK) {
         ESP_LOGW(TAG, "failed to remove profile %s file: %s", id, esp_err_to_name(delete_err));
     }
-    if ((uint8_t)idx < s_config->profile_count - 1) {
-        memmove(&s_config->profiles[idx], &s_config->profiles[idx + 1],
-                sizeof(device_manager_profile_t) * (s_config->profile_count - idx - 1));
+    if ((uint8_t)idx < draft->profile_count - 1) {
+        memmove(&draft->profiles[idx], &draft->profiles[idx + 1],
+                sizeof(device_manager_profile_t) * (draft->profile_count - idx - 1));
     }
-    s_config->profile_count--;
-    if (strcasecmp(s_config->active_profile, id) == 0) {
-        s_config->active_profile[0] = 0;
+    draft->profile_count--;
+    if (strcasecmp(draft->active_profile, id) == 0) {
+        draft->active_profile[0] = 0;
     }
-    dm_profiles_ensure_active(s_config);
-    dm_profiles_sync_from_active(s_config, true);
-    s_config->generation++;
-    esp_err_t err = persist_locked();
+    dm_profiles_ensure_active(draft);
+    dm_profiles_sync_from_active(draft, true);
+    dm_publish_locked(draft);
     dm_unlock();
-    return err;
+    dm_persist_request();
+    return ESP_OK;
 }
 
 esp_err_t device_manager_profile_rename(const char *id, const char *new_name)
@@ -571,17 +826,23 @@ esp_err_t device_manager_profile_rename(const char *id, const char *new_name)
         return ESP_ERR_INVALID_ARG;
     }
     dm_lock();
-    dm_profiles_ensure_active(s_config);
-    device_manager_profile_t *profile = dm_profiles_find_by_id(s_config, id);
+    device_manager_config_t *draft = dm_draft_locked();
+    if (!draft) {
+        dm_unlock();
+        return ESP_ERR_NO_MEM;
+    }
+    dm_profiles_ensure_active(draft);
+    device_manager_profile_t *profile = dm_profiles_find_by_id(draft, id);
     if (!profile) {
         dm_unlock();
+        dm_config_destroy(draft);
         return ESP_ERR_NOT_FOUND;
     }
     dm_str_copy(profile->name, sizeof(profile->name), new_name);
-    s_config->generation++;
-    esp_err_t err = persist_locked();
+    dm_publish_locked(draft);
     dm_unlock();
-    return err;
+    dm_persist_request();
+    return ESP_OK;
 }
 
 esp_err_t device_manager_profile_activate(const char *id)
@@ -592,10 +853,10 @@ esp_err_t device_manager_profile_activate(const char *id)
     if (!id || !id[0]) {
         return ESP_ERR_INVALID_ARG;
     }
+    int64_t start_us = esp_timer_get_time();
     dm_lock();
-    dm_profiles_ensure_active(s_config);
-    device_manager_profile_t *profile = dm_profiles_find_by_id(s_config, id);
-    if (!profile) {
+    const device_manager_profile_t *current = dm_profiles_find_by_id(s_config, id);
+    if (!current) {
         dm_unlock();
         return ESP_ERR_NOT_FOUND;
     }
@@ -603,19 +864,42 @@ esp_err_t device_manager_profile_activate(const char *id)
         dm_unlock();
         return ESP_OK;
     }
-    dm_str_copy(s_config->active_profile, sizeof(s_config->active_profile), profile->id);
-    dm_profiles_sync_from_active(s_config, true);
-    s_config->generation++;
-    esp_err_t err = persist_locked();
-    dm_unlock();
-    if (err == ESP_OK) {
-        register_templates_from_config(s_config);
-        event_bus_message_t msg = {
-            .type = EVENT_DEVICE_CONFIG_CHANGED,
-        };
-        event_bus_post(&msg, 0);
+    // The outgoing profile must be on the card before its devices are swapped out.
+    esp_err_t err = dm_persist_flush();
+    if (err != ESP_OK) {
+        dm_unlock();
+        return err;
     }
-    return err;
+    device_manager_config_t *draft = NULL;
+    device_manager_config_t *cached = dm_profile_cache_take(current->id);
+    if (cached) {
+        draft = dm_adopt_cached_locked(cached, current->id);
+    }
+    bool from_cache = draft != NULL;
+    if (!draft) {
+        draft = dm_draft_locked();
+        if (!draft) {
+            dm_unlock();
+            return ESP_ERR_NO_MEM;
+        }
+        dm_str_copy(draft->active_profile, sizeof(draft->active_profile), current->id);
+        dm_profiles_sync_from_active(draft, true);
+    }
+    dm_cache_outgoing_locked();
+    dm_publish_locked(draft);
+    dm_unlock();
+    dm_persist_request();
+    register_templates_from_current();
+    int64_t switch_us = esp_timer_get_time() - start_us;
+    dm_profile_cache_note_switch(switch_us, from_cache);
+    ESP_LOGI(TAG, "profile %s active in %lld us (%s)", id, (long long)switch_us, from_cache ? "cached" : "loaded");
+    post_config_changed();
+    return ESP_OK;
+}
+
+void device_manager_get_profile_cache_status(device_manager_profile_cache_status_t *out)
+{
+    dm_profile_cache_get_status(out);
 }
 
 // Convenience wrapper for updating active profile via JSON blob.
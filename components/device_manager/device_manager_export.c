@@ -1,594 +1,332 @@
 #include "device_manager_internal.h"
 
-#include <stdlib.h>
 #include <string.h>
 #include <strings.h>
 
 #include "esp_heap_caps.h"
 
+#include "dm_json_writer.h"
 #include "dm_profiles.h"
+#include "dm_rate_gate.h"
+#include "dm_schema.h"
 #include "dm_storage.h"
 #include "device_manager_utils.h"
 #include "dm_template_runtime.h"
 
-// Helper: add string field if value is non-empty.
-static void template_to_json_string(cJSON *obj, const char *key, const char *value)
+// Written only when set, so exports of unlimited configs stay as before.
+static void rate_limit_to_json(dm_json_writer_t *w, const char *key, const dm_rate_limit_t *limit)
 {
-    if (obj && key && value && value[0]) {
-        cJSON_AddStringToObject(obj, key, value);
-    }
+    if (!limit || limit->mode == DM_RATE_MODE_DEFAULT) {
+        return;
+    }
+    dm_json_key(w, key);
+    dm_json_begin_object(w);
+    dm_json_kv_string(w, "mode", dm_rate_mode_to_string((dm_rate_mode_t)limit->mode));
+    dm_json_kv_string(w, "edges", dm_rate_edges_to_string(limit->edges));
+    dm_json_kv_number(w, "window_ms", limit->window_ms);
+    dm_json_end_object(w);
 }
 
 // Serialize scenario step into JSON representation.
-static cJSON *step_to_json(const device_action_step_t *step)
+static void step_to_json(dm_json_writer_t *w, const device_action_step_t *step)
 {
-    cJSON *obj = cJSON_CreateObject();
-    if (!obj) {
-        return NULL;
-    }
-    cJSON_AddStringToObject(obj, "type", dm_action_type_to_string(step->type));
+    dm_json_begin_object(w);
+    dm_json_kv_string(w, "type", dm_action_type_to_string(step->type));
     if (step->delay_ms > 0) {
-        cJSON_AddNumberToObject(obj, "delay_ms", (double)step->delay_ms);
+        dm_json_kv_number(w, "delay_ms", (double)step->delay_ms);
     }
     switch (step->type) {
     case DEVICE_ACTION_MQTT_PUBLISH:
-        cJSON_AddStringToObject(obj, "topic", step->data.mqtt.topic);
-        cJSON_AddStringToObject(obj, "payload", step->data.mqtt.payload);
-        cJSON_AddNumberToObject(obj, "qos", step->data.mqtt.qos);
-        cJSON_AddBoolToObject(obj, "retain", step->data.mqtt.retain);
+        dm_json_kv_string(w, "topic", step->data.mqtt.topic);
+        dm_json_kv_string(w, "payload", step->data.mqtt.payload);
+        dm_json_kv_number(w, "qos", step->data.mqtt.qos);
+        dm_json_kv_bool(w, "retain", step->data.mqtt.retain);
         break;
     case DEVICE_ACTION_AUDIO_PLAY:
-        cJSON_AddStringToObject(obj, "track", step->data.audio.track);
-        cJSON_AddBoolToObject(obj, "blocking", step->data.audio.blocking);
+        dm_json_kv_string(w, "track", step->data.audio.track);
+        dm_json_kv_bool(w, "blocking", step->data.audio.blocking);
         break;
     case DEVICE_ACTION_SET_FLAG:
-        cJSON_AddStringToObject(obj, "flag", step->data.flag.flag);
-        cJSON_AddBoolToObject(obj, "value", step->data.flag.value);
+        dm_json_kv_string(w, "flag", step->data.flag.flag);
+        dm_json_kv_bool(w, "value", step->data.flag.value);
         break;
-    case DEVICE_ACTION_WAIT_FLAGS: {
-        cJSON *wait = cJSON_CreateObject();
-        if (!wait) {
-            cJSON_Delete(obj);
-            return NULL;
-        }
-        cJSON_AddItemToObject(obj, "wait", wait);
-        cJSON_AddStringToObject(wait, "mode", dm_condition_to_string(step->data.wait_flags.mode));
+    case DEVICE_ACTION_WAIT_FLAGS:
+        dm_json_key(w, "wait");
+        dm_json_begin_object(w);
+        dm_json_kv_string(w, "mode", dm_condition_to_string(step->data.wait_flags.mode));
         if (step->data.wait_flags.timeout_ms > 0) {
-            cJSON_AddNumberToObject(wait, "timeout_ms", (double)step->data.wait_flags.timeout_ms);
-        }
-        cJSON *reqs = cJSON_AddArrayToObject(wait, "requirements");
-        if (!reqs) {
-            cJSON_Delete(obj);
-            return NULL;
+            dm_json_kv_number(w, "timeout_ms", (double)step->data.wait_flags.timeout_ms);
         }
+        dm_json_key(w, "requirements");
+        dm_json_begin_array(w);
         for (uint8_t i = 0; i < step->data.wait_flags.requirement_count; ++i) {
-            cJSON *req = cJSON_CreateObject();
-            if (!req) {
-                cJSON_Delete(obj);
-                return NULL;
-            }
-            cJSON_AddItemToArray(reqs, req);
-            cJSON_AddStringToObject(req, "flag", step->data.wait_flags.requirements[i].flag);
-            cJSON_AddBoolToObject(req, "state", step->data.wait_flags.requirements[i].required_state);
+            dm_json_begin_object(w);
+            dm_json_kv_string(w, "flag", step->data.wait_flags.requirements[i].flag);
+            dm_json_kv_bool(w, "state", step->data.wait_flags.requirements[i].required_state);
+            dm_json_end_object(w);
         }
+        dm_json_end_array(w);
+        dm_json_end_object(w);
         break;
-    }
-    case DEVICE_ACTION_LOOP: {
-        cJSON *loop = cJSON_CreateObject();
-        if (!loop) {
-            cJSON_Delete(obj);
-            return NULL;
-        }
-        cJSON_AddItemToObject(obj, "loop", loop);
-        cJSON_AddNumberToObject(loop, "target_step", step->data.loop.target_step);
-        cJSON_AddNumberToObject(loop, "max_iterations", step->data.loop.max_iterations);
+    case DEVICE_ACTION_LOOP:
+        dm_json_key(w, "loop");
+        dm_json_begin_object(w);
+        dm_json_kv_number(w, "target_step", step->data.loop.target_step);
+        dm_json_kv_number(w, "max_iterations", step->data.loop.max_iterations);
+        dm_json_end_object(w);
         break;
-    }
     case DEVICE_ACTION_EVENT_BUS:
-        cJSON_AddStringToObject(obj, "event", step->data.event.event);
+        dm_json_kv_string(w, "event", step->data.event.event);
         if (step->data.event.topic[0]) {
-            cJSON_AddStringToObject(obj, "topic", step->data.event.topic);
+            dm_json_kv_string(w, "topic", step->data.event.topic);
         }
         if (step->data.event.payload[0]) {
-            cJSON_AddStringToObject(obj, "payload", step->data.event.payload);
+            dm_json_kv_string(w, "payload", step->data.event.payload);
         }
         break;
+    case DEVICE_ACTION_PARALLEL:
+        dm_json_key(w, "parallel");
+        dm_json_begin_object(w);
+        dm_json_kv_number(w, "count", step->data.parallel.count);
+        dm_json_end_object(w);
+        break;
+    case DEVICE_ACTION_JOIN:
+        dm_json_key(w, "join");
+        dm_json_begin_object(w);
+        dm_json_kv_number(w, "timeout_ms", (double)step->data.join.timeout_ms);
+        dm_json_end_object(w);
+        break;
     case DEVICE_ACTION_AUDIO_STOP:
     case DEVICE_ACTION_DELAY:
     case DEVICE_ACTION_NOP:
     default:
         break;
     }
-    return obj;
+    dm_json_end_object(w);
 }
 
-// Convert UID template runtime state into JSON (including last-read values).
-static cJSON *uid_template_to_json(const device_descriptor_t *dev)
-{
-    if (!dev) {
-        return NULL;
-    }
-    const dm_uid_template_t *tpl = &dev->template_config.data.uid;
-    cJSON *root = cJSON_CreateObject();
-    if (!root) {
-        return NULL;
-    }
-    cJSON *slots = cJSON_AddArrayToObject(root, "slots");
-    if (!slots) {
-        cJSON_Delete(root);
-        return NULL;
-    }
-    dm_uid_runtime_snapshot_t snapshot;
-    bool have_snapshot = (dm_template_runtime_get_uid_snapshot(dev->id, &snapshot) == ESP_OK);
-    for (uint8_t i = 0; i < tpl->slot_count && i < DM_UID_TEMPLATE_MAX_SLOTS; ++i) {
-        const dm_uid_slot_t *slot = &tpl->slots[i];
-        if (!slot->source_id[0]) {
-            continue;
-        }
-        cJSON *slot_obj = cJSON_CreateObject();
-        if (!slot_obj) {
-            cJSON_Delete(root);
-            return NULL;
-        }
-        cJSON_AddItemToArray(slots, slot_obj);
-        cJSON_AddStringToObject(slot_obj, "source_id", slot->source_id);
-        if (slot->label[0]) {
-            cJSON_AddStringToObject(slot_obj, "label", slot->label);
-        }
-        cJSON *values = cJSON_AddArrayToObject(slot_obj, "values");
-        if (!values) {
-            cJSON_Delete(root);
-            return NULL;
-        }
-        for (uint8_t v = 0; v < slot->value_count && v < DM_UID_TEMPLATE_MAX_VALUES; ++v) {
-            if (slot->values[v][0]) {
-                cJSON_AddItemToArray(values, cJSON_CreateString(slot->values[v]));
-            }
-        }
-        if (have_snapshot && i < snapshot.slot_count && snapshot.slots[i].has_value) {
-            cJSON_AddStringToObject(slot_obj, "last_value", snapshot.slots[i].last_value);
-        }
-    }
-    template_to_json_string(root, "start_topic", tpl->start_topic);
-    template_to_json_string(root, "start_payload", tpl->start_payload);
-    template_to_json_string(root, "broadcast_topic", tpl->broadcast_topic);
-    template_to_json_string(root, "broadcast_payload", tpl->broadcast_payload);
-    template_to_json_string(root, "success_topic", tpl->success_topic);
-    template_to_json_string(root, "success_payload", tpl->success_payload);
-    template_to_json_string(root, "fail_topic", tpl->fail_topic);
-    template_to_json_string(root, "fail_payload", tpl->fail_payload);
-    template_to_json_string(root, "success_audio_track", tpl->success_audio_track);
-    template_to_json_string(root, "fail_audio_track", tpl->fail_audio_track);
-    template_to_json_string(root, "success_signal_topic", tpl->success_signal_topic);
-    template_to_json_string(root, "success_signal_payload", tpl->success_signal_payload);
-    template_to_json_string(root, "fail_signal_topic", tpl->fail_signal_topic);
-    template_to_json_string(root, "fail_signal_payload", tpl->fail_signal_payload);
-    return root;
-}
+typedef void (*entry_extra_fn)(dm_json_writer_t *w, const dm_field_t *list, uint8_t index, void *ctx);
 
-// Serialize signal-hold template.
-static cJSON *signal_template_to_json(const dm_signal_hold_template_t *tpl)
-{
-    if (!tpl) {
-        return NULL;
-    }
-    cJSON *root = cJSON_CreateObject();
-    if (!root) {
-        return NULL;
-    }
-    template_to_json_string(root, "signal_topic", tpl->signal_topic);
-    template_to_json_string(root, "signal_payload_on", tpl->signal_payload_on);
-    template_to_json_string(root, "signal_payload_off", tpl->signal_payload_off);
-    cJSON_AddNumberToObject(root, "signal_on_ms", (double)tpl->signal_on_ms);
-    template_to_json_string(root, "heartbeat_topic", tpl->heartbeat_topic);
-    template_to_json_string(root, "reset_topic", tpl->reset_topic);
-    cJSON_AddNumberToObject(root, "required_hold_ms", (double)tpl->required_hold_ms);
-    cJSON_AddNumberToObject(root, "heartbeat_timeout_ms", (double)tpl->heartbeat_timeout_ms);
-    template_to_json_string(root, "hold_track", tpl->hold_track);
-    cJSON_AddBoolToObject(root, "hold_track_loop", tpl->hold_track_loop);
-    template_to_json_string(root, "complete_track", tpl->complete_track);
-    return root;
-}
+static void record_to_json(dm_json_writer_t *w,
+                           const dm_record_t *rec,
+                           const void *base,
+                           uint8_t index,
+                           entry_extra_fn extra,
+                           void *ctx);
 
-static cJSON *mqtt_template_to_json(const dm_mqtt_trigger_template_t *tpl)
+// One member as the importer reads it back; members left at their zero value are skipped
+// unless the table says otherwise, which keeps the export of sparse templates short.
+static void field_to_json(dm_json_writer_t *w,
+                          const dm_field_t *f,
+                          const dm_field_t *prev,
+                          const void *base,
+                          uint8_t index,
+                          entry_extra_fn extra,
+                          void *ctx)
 {
-    if (!tpl) {
-        return NULL;
-    }
-    cJSON *root = cJSON_CreateObject();
-    if (!root) {
-        return NULL;
-    }
-    cJSON *rules = cJSON_AddArrayToObject(root, "rules");
-    if (!rules) {
-        cJSON_Delete(root);
-        return NULL;
-    }
-    for (uint8_t i = 0; i < tpl->rule_count && i < DM_MQTT_TRIGGER_MAX_RULES; ++i) {
-        const dm_mqtt_trigger_rule_t *rule = &tpl->rules[i];
-        if (!rule->topic[0] || !rule->scenario[0]) {
-            continue;
+    bool show = (f->flags & DM_FIELD_ALWAYS) || dm_field_is_set(f, base, index);
+    const void *p = dm_field_ptr(f, base, index);
+    switch (f->kind) {
+    case DM_FIELD_STR:
+        if (show) {
+            dm_json_kv_string(w, f->key, (const char *)p);
         }
-        cJSON *obj = cJSON_CreateObject();
-        if (!obj) {
-            cJSON_Delete(root);
-            return NULL;
+        break;
+    case DM_FIELD_STRS: {
+        uint8_t count = *dm_field_count(f, base, index);
+        if (!show) {
+            break;
+        }
+        dm_json_key(w, f->key);
+        dm_json_begin_array(w);
+        for (uint8_t n = 0; n < count && n < f->max; ++n) {
+            const char *value = dm_field_str(f, base, index, n);
+            if (value[0]) {
+                dm_json_string(w, value);
+            }
         }
-        cJSON_AddItemToArray(rules, obj);
-        if (rule->name[0]) {
-            cJSON_AddStringToObject(obj, "name", rule->name);
+        dm_json_end_array(w);
+        break;
+    }
+    case DM_FIELD_U32:
+        if (show) {
+            dm_json_kv_number(w, f->key, (double)*(const uint32_t *)p);
         }
-        cJSON_AddStringToObject(obj, "topic", rule->topic);
-        if (rule->payload[0]) {
-            cJSON_AddStringToObject(obj, "payload", rule->payload);
+        break;
+    case DM_FIELD_BOOL:
+        if ((f->flags & DM_FIELD_FOLLOWS) && prev) {
+            show = show || dm_field_is_set(prev, base, index);
         }
-        if (rule->payload[0] || rule->payload_required) {
-            cJSON_AddBoolToObject(obj, "payload_required", rule->payload_required);
+        if (show) {
+            dm_json_kv_bool(w, f->key, *(const bool *)p);
         }
-        cJSON_AddStringToObject(obj, "scenario", rule->scenario);
-    }
-    return root;
-}
-
-static cJSON *flag_template_to_json(const dm_flag_trigger_template_t *tpl)
-{
-    if (!tpl) {
-        return NULL;
-    }
-    cJSON *root = cJSON_CreateObject();
-    if (!root) {
-        return NULL;
-    }
-    cJSON *rules = cJSON_AddArrayToObject(root, "rules");
-    if (!rules) {
-        cJSON_Delete(root);
-        return NULL;
-    }
-    for (uint8_t i = 0; i < tpl->rule_count && i < DM_FLAG_TRIGGER_MAX_RULES; ++i) {
-        const dm_flag_trigger_rule_t *rule = &tpl->rules[i];
-        if (!rule->flag[0] || !rule->scenario[0]) {
-            continue;
+        break;
+    case DM_FIELD_FLOAT:
+        if (dm_field_is_set(f, base, index)) {
+            dm_json_kv_number(w, f->key, *(const float *)p);
         }
-        cJSON *obj = cJSON_CreateObject();
-        if (!obj) {
-            cJSON_Delete(root);
-            return NULL;
+        break;
+    case DM_FIELD_ENUM:
+        if (show) {
+            const dm_field_names_t *names = (const dm_field_names_t *)f->ref;
+            dm_json_kv_string(w, f->key, names->to_string(dm_field_get_int(f, base, index)));
         }
-        cJSON_AddItemToArray(rules, obj);
-        if (rule->name[0]) {
-            cJSON_AddStringToObject(obj, "name", rule->name);
+        break;
+    case DM_FIELD_LIMIT:
+        rate_limit_to_json(w, f->key, (const dm_rate_limit_t *)p);
+        break;
+    case DM_FIELD_LIST: {
+        const dm_record_t *entry = (const dm_record_t *)f->ref;
+        uint8_t count = *dm_field_count(f, base, 0);
+        dm_json_key(w, f->key);
+        dm_json_begin_array(w);
+        for (uint8_t n = 0; n < count && n < f->max; ++n) {
+            // Entries the importer would drop are left out as well.
+            if (!dm_record_usable(entry, base, n, false)) {
+                continue;
+            }
+            dm_json_begin_object(w);
+            record_to_json(w, entry, base, n, NULL, NULL);
+            if (extra) {
+                extra(w, f, n, ctx);
+            }
+            dm_json_end_object(w);
         }
-        cJSON_AddStringToObject(obj, "flag", rule->flag);
-        cJSON_AddBoolToObject(obj, "state", rule->required_state);
-        cJSON_AddStringToObject(obj, "scenario", rule->scenario);
+        dm_json_end_array(w);
+        break;
+    }
+    default:
+        break;
     }
-    return root;
 }
 
-static cJSON *condition_template_to_json(const dm_condition_template_t *tpl)
+// Members of a record in table order; `extra` adds to every list entry.
+static void record_to_json(dm_json_writer_t *w,
+                           const dm_record_t *rec,
+                           const void *base,
+                           uint8_t index,
+                           entry_extra_fn extra,
+                           void *ctx)
 {
-    if (!tpl) {
-        return NULL;
-    }
-    cJSON *root = cJSON_CreateObject();
-    if (!root) {
-        return NULL;
+    for (uint8_t i = 0; i < rec->count; ++i) {
+        field_to_json(w, &rec->fields[i], i ? &rec->fields[i - 1] : NULL, base, index, extra, ctx);
     }
-    cJSON_AddStringToObject(root, "mode", dm_condition_to_string(tpl->mode));
-    if (tpl->true_scenario[0]) {
-        cJSON_AddStringToObject(root, "true_scenario", tpl->true_scenario);
-    }
-    if (tpl->false_scenario[0]) {
-        cJSON_AddStringToObject(root, "false_scenario", tpl->false_scenario);
-    }
-    cJSON *rules = cJSON_AddArrayToObject(root, "rules");
-    if (!rules) {
-        cJSON_Delete(root);
-        return NULL;
-    }
-    for (uint8_t i = 0; i < tpl->rule_count && i < DM_CONDITION_TEMPLATE_MAX_RULES; ++i) {
-        const dm_condition_rule_t *rule = &tpl->rules[i];
-        if (!rule->flag[0]) {
-            continue;
-        }
-        cJSON *obj = cJSON_CreateObject();
-        if (!obj) {
-            cJSON_Delete(root);
-            return NULL;
-        }
-        cJSON_AddItemToArray(rules, obj);
-        cJSON_AddStringToObject(obj, "flag", rule->flag);
-        cJSON_AddBoolToObject(obj, "state", rule->required_state);
-    }
-    return root;
 }
 
-static cJSON *interval_template_to_json(const dm_interval_task_template_t *tpl)
+// Last UID read per slot, from the running template; not read back on import.
+static void uid_slot_last_value(dm_json_writer_t *w, const dm_field_t *list, uint8_t index, void *ctx)
 {
-    if (!tpl) {
-        return NULL;
-    }
-    cJSON *root = cJSON_CreateObject();
-    if (!root) {
-        return NULL;
+    (void)list;
+    const dm_uid_runtime_snapshot_t *snapshot = (const dm_uid_runtime_snapshot_t *)ctx;
+    if (index < snapshot->slot_count && snapshot->slots[index].has_value) {
+        dm_json_kv_string(w, "last_value", snapshot->slots[index].last_value);
     }
-    cJSON_AddNumberToObject(root, "interval_ms", (double)tpl->interval_ms);
-    template_to_json_string(root, "scenario", tpl->scenario);
-    return root;
 }
 
-static cJSON *sequence_template_to_json(const dm_sequence_template_t *tpl)
+// Template-specific structure of a device; unknown template types are left out.
+static void template_to_json(dm_json_writer_t *w, const device_descriptor_t *dev)
 {
-    if (!tpl) {
-        return NULL;
-    }
-    cJSON *root = cJSON_CreateObject();
-    if (!root) {
-        return NULL;
-    }
-    cJSON *steps = cJSON_AddArrayToObject(root, "steps");
-    if (!steps) {
-        cJSON_Delete(root);
-        return NULL;
-    }
-    for (uint8_t i = 0; i < tpl->step_count && i < DM_SEQUENCE_TEMPLATE_MAX_STEPS; ++i) {
-        const dm_sequence_step_t *step = &tpl->steps[i];
-        if (!step->topic[0]) {
-            continue;
-        }
-        cJSON *step_obj = cJSON_CreateObject();
-        if (!step_obj) {
-            cJSON_Delete(root);
-            return NULL;
-        }
-        cJSON_AddItemToArray(steps, step_obj);
-        cJSON_AddStringToObject(step_obj, "topic", step->topic);
-        if (step->payload[0]) {
-            cJSON_AddStringToObject(step_obj, "payload", step->payload);
-        }
-        cJSON_AddBoolToObject(step_obj, "payload_required", step->payload_required);
-        if (step->hint_topic[0]) {
-            cJSON_AddStringToObject(step_obj, "hint_topic", step->hint_topic);
-        }
-        if (step->hint_payload[0]) {
-            cJSON_AddStringToObject(step_obj, "hint_payload", step->hint_payload);
-        }
-        if (step->hint_audio_track[0]) {
-            cJSON_AddStringToObject(step_obj, "hint_audio_track", step->hint_audio_track);
-        }
-    }
-    if (tpl->timeout_ms > 0) {
-        cJSON_AddNumberToObject(root, "timeout_ms", (double)tpl->timeout_ms);
+    const dm_template_schema_t *schema = dm_template_schema(dev->template_config.type);
+    if (!schema) {
+        return;
+    }
+    dm_json_key(w, "template");
+    dm_json_begin_object(w);
+    dm_json_kv_string(w, "type", dm_template_type_to_string(schema->type));
+    dm_json_key(w, schema->section);
+    dm_json_begin_object(w);
+    dm_uid_runtime_snapshot_t snapshot;
+    if (schema->type == DM_TEMPLATE_TYPE_UID && dm_template_runtime_get_uid_snapshot(dev->id, &snapshot) == ESP_OK) {
+        record_to_json(w, &schema->record, &dev->template_config.data, 0, uid_slot_last_value, &snapshot);
+    } else {
+        record_to_json(w, &schema->record, &dev->template_config.data, 0, NULL, NULL);
     }
-    cJSON_AddBoolToObject(root, "reset_on_error", tpl->reset_on_error);
-    template_to_json_string(root, "success_topic", tpl->success_topic);
-    template_to_json_string(root, "success_payload", tpl->success_payload);
-    template_to_json_string(root, "success_audio_track", tpl->success_audio_track);
-    template_to_json_string(root, "success_scenario", tpl->success_scenario);
-    template_to_json_string(root, "fail_topic", tpl->fail_topic);
-    template_to_json_string(root, "fail_payload", tpl->fail_payload);
-    template_to_json_string(root, "fail_audio_track", tpl->fail_audio_track);
-    template_to_json_string(root, "fail_scenario", tpl->fail_scenario);
-    return root;
+    dm_json_end_object(w);
+    dm_json_end_object(w);
 }
 
-// Attach template-specific structure into device JSON.
-static cJSON *template_to_json(const device_descriptor_t *dev)
+static void device_to_json(dm_json_writer_t *w, const device_descriptor_t *dev)
 {
-    if (!dev || !dev->template_assigned) {
-        return NULL;
-    }
-    cJSON *root = cJSON_CreateObject();
-    if (!root) {
-        return NULL;
-    }
-    const char *type = dm_template_type_to_string(dev->template_config.type);
-    cJSON_AddStringToObject(root, "type", type);
-    cJSON *data = NULL;
-    switch (dev->template_config.type) {
-    case DM_TEMPLATE_TYPE_UID:
-        data = uid_template_to_json(dev);
-        if (data) {
-            cJSON_AddItemToObject(root, "uid", data);
-        }
-        break;
-    case DM_TEMPLATE_TYPE_SIGNAL_HOLD:
-        data = signal_template_to_json(&dev->template_config.data.signal);
-        if (data) {
-            cJSON_AddItemToObject(root, "signal", data);
-        }
-        break;
-    case DM_TEMPLATE_TYPE_MQTT_TRIGGER:
-        data = mqtt_template_to_json(&dev->template_config.data.mqtt);
-        if (data) {
-            cJSON_AddItemToObject(root, "mqtt", data);
-        }
-        break;
-    case DM_TEMPLATE_TYPE_FLAG_TRIGGER:
-        data = flag_template_to_json(&dev->template_config.data.flag);
-        if (data) {
-            cJSON_AddItemToObject(root, "flag", data);
-        }
-        break;
-    case DM_TEMPLATE_TYPE_IF_CONDITION:
-        data = condition_template_to_json(&dev->template_config.data.condition);
-        if (data) {
-            cJSON_AddItemToObject(root, "condition", data);
-        }
-        break;
-    case DM_TEMPLATE_TYPE_INTERVAL_TASK:
-        data = interval_template_to_json(&dev->template_config.data.interval);
-        if (data) {
-            cJSON_AddItemToObject(root, "interval", data);
-        }
-        break;
-    case DM_TEMPLATE_TYPE_SEQUENCE_LOCK:
-        data = sequence_template_to_json(&dev->template_config.data.sequence);
-        if (data) {
-            cJSON_AddItemToObject(root, "sequence", data);
-        }
-        break;
-    default:
-        break;
-    }
-    if (!data) {
-        cJSON_Delete(root);
-        return NULL;
+    dm_json_begin_object(w);
+    const char *display_name = dev->display_name[0] ? dev->display_name : dev->id;
+    dm_json_kv_string(w, "id", dev->id);
+    dm_json_kv_string(w, "name", display_name);
+    dm_json_kv_string(w, "display_name", display_name);
+
+    field_to_json(w, dm_schema_device_topics(), NULL, dev, 0, NULL, NULL);
+
+    dm_json_key(w, "scenarios");
+    dm_json_begin_array(w);
+    for (uint8_t s = 0; s < dev->scenario_count && s < DEVICE_MANAGER_MAX_SCENARIOS_PER_DEVICE; ++s) {
+        const device_scenario_t *sc = &dev->scenarios[s];
+        dm_json_begin_object(w);
+        record_to_json(w, dm_schema_scenario(), sc, 0, NULL, NULL);
+        dm_json_key(w, "steps");
+        dm_json_begin_array(w);
+        for (uint8_t st = 0; st < sc->step_count && st < DEVICE_MANAGER_MAX_STEPS_PER_SCENARIO; ++st) {
+            step_to_json(w, &sc->steps[st]);
+        }
+        dm_json_end_array(w);
+        dm_json_end_object(w);
+    }
+    dm_json_end_array(w);
+
+    if (dev->template_assigned) {
+        template_to_json(w, dev);
     }
-    return root;
+    dm_json_end_object(w);
 }
 
-// Build JSON snapshot of entire configuration; caller must free `*out_json`.
-esp_err_t dm_storage_internal_export(const device_manager_config_t *cfg, char **out_json, size_t *out_len)
+void dm_storage_write_config(dm_json_writer_t *w, const device_manager_config_t *cfg)
 {
-    if (!cfg || !out_json) {
-        return ESP_ERR_INVALID_ARG;
-    }
-    *out_json = NULL;
-    if (out_len) {
-        *out_len = 0;
-    }
-    esp_err_t err = ESP_OK;
-    dm_cjson_install_hooks();
-    cJSON *root = cJSON_CreateObject();
-    if (!root) {
-        dm_cjson_reset_hooks();
-        return ESP_ERR_NO_MEM;
-    }
-    cJSON_AddNumberToObject(root, "schema", cfg->schema_version);
-    cJSON_AddNumberToObject(root, "generation", cfg->generation);
+    dm_json_begin_object(w);
+    dm_json_kv_number(w, "schema", cfg->schema_version);
+    dm_json_kv_number(w, "generation", cfg->generation);
     const char *active_profile = cfg->active_profile[0] ? cfg->active_profile : DM_DEFAULT_PROFILE_ID;
-    cJSON_AddStringToObject(root, "active_profile", active_profile);
-    cJSON *profiles = cJSON_AddArrayToObject(root, "profiles");
-    if (!profiles) {
-        err = ESP_ERR_NO_MEM;
-        goto cleanup;
-    }
+    dm_json_kv_string(w, "active_profile", active_profile);
+    dm_json_key(w, "profiles");
+    dm_json_begin_array(w);
     for (uint8_t i = 0; i < cfg->profile_count && i < DEVICE_MANAGER_MAX_PROFILES; ++i) {
         const device_manager_profile_t *profile = &cfg->profiles[i];
         if (!profile->id[0]) {
             continue;
         }
-        cJSON *p = cJSON_CreateObject();
-        if (!p) {
-            err = ESP_ERR_NO_MEM;
-            goto cleanup;
-        }
-        cJSON_AddItemToArray(profiles, p);
-        cJSON_AddStringToObject(p, "id", profile->id);
-        cJSON_AddStringToObject(p, "name", profile->name[0] ? profile->name : profile->id);
-        cJSON_AddNumberToObject(p, "device_count", profile->device_count);
+        dm_json_begin_object(w);
+        dm_json_kv_string(w, "id", profile->id);
+        dm_json_kv_string(w, "name", profile->name[0] ? profile->name : profile->id);
+        dm_json_kv_number(w, "device_count", profile->device_count);
         if (strcasecmp(profile->id, active_profile) == 0) {
-            cJSON_AddBoolToObject(p, "active", true);
+            dm_json_kv_bool(w, "active", true);
         }
+        dm_json_end_object(w);
     }
+    dm_json_end_array(w);
 
-    cJSON *devices = cJSON_AddArrayToObject(root, "devices");
-    if (!devices) {
-        err = ESP_ERR_NO_MEM;
-        goto cleanup;
-    }
+    dm_json_key(w, "devices");
+    dm_json_begin_array(w);
     uint8_t device_cap = cfg->device_capacity ? cfg->device_capacity : DEVICE_MANAGER_MAX_DEVICES;
-    for (uint8_t i = 0; i < cfg->device_count && i < device_cap; ++i) {
+    for (uint8_t i = 0; i < cfg->device_count && i < device_cap && w->err == ESP_OK; ++i) {
         feed_wdt();
-        const device_descriptor_t *dev = &cfg->devices[i];
-        cJSON *d = cJSON_CreateObject();
-        if (!d) {
-            err = ESP_ERR_NO_MEM;
-            goto cleanup;
-        }
-        cJSON_AddItemToArray(devices, d);
-        const char *display_name = dev->display_name[0] ? dev->display_name : dev->id;
-        cJSON_AddStringToObject(d, "id", dev->id);
-        cJSON_AddStringToObject(d, "name", display_name);
-        cJSON_AddStringToObject(d, "display_name", display_name);
-
-        cJSON *topics = cJSON_AddArrayToObject(d, "topics");
-        if (!topics) {
-            err = ESP_ERR_NO_MEM;
-            goto cleanup;
-        }
-        for (uint8_t tp = 0; tp < dev->topic_count && tp < DEVICE_MANAGER_MAX_TOPICS_PER_DEVICE; ++tp) {
-            const device_topic_binding_t *binding = &dev->topics[tp];
-            cJSON *topic_obj = cJSON_CreateObject();
-            if (!topic_obj) {
-                err = ESP_ERR_NO_MEM;
-                goto cleanup;
-            }
-            cJSON_AddItemToArray(topics, topic_obj);
-            cJSON_AddStringToObject(topic_obj, "name", binding->name);
-            cJSON_AddStringToObject(topic_obj, "topic", binding->topic);
-            feed_wdt();
-        }
-
-        cJSON *scenarios = cJSON_AddArrayToObject(d, "scenarios");
-        if (!scenarios) {
-            err = ESP_ERR_NO_MEM;
-            goto cleanup;
-        }
-        for (uint8_t s = 0; s < dev->scenario_count && s < DEVICE_MANAGER_MAX_SCENARIOS_PER_DEVICE; ++s) {
-            const device_scenario_t *sc = &dev->scenarios[s];
-            cJSON *sc_obj = cJSON_CreateObject();
-            if (!sc_obj) {
-                err = ESP_ERR_NO_MEM;
-                goto cleanup;
-            }
-            cJSON_AddItemToArray(scenarios, sc_obj);
-            cJSON_AddStringToObject(sc_obj, "id", sc->id);
-            cJSON_AddStringToObject(sc_obj, "name", sc->name);
-            cJSON_AddBoolToObject(sc_obj, "button_enabled", sc->button_enabled);
-            cJSON_AddStringToObject(sc_obj, "button_label", sc->button_label);
-            cJSON *steps = cJSON_AddArrayToObject(sc_obj, "steps");
-            if (!steps) {
-                err = ESP_ERR_NO_MEM;
-                goto cleanup;
-            }
-            for (uint8_t st = 0; st < sc->step_count && st < DEVICE_MANAGER_MAX_STEPS_PER_SCENARIO; ++st) {
-                cJSON *step_obj = step_to_json(&sc->steps[st]);
-                if (!step_obj) {
-                    err = ESP_ERR_NO_MEM;
-                    goto cleanup;
-                }
-                cJSON_AddItemToArray(steps, step_obj);
-                feed_wdt();
-            }
-        }
-
-        if (dev->template_assigned) {
-            cJSON *tpl_obj = template_to_json(dev);
-            if (!tpl_obj) {
-                err = ESP_ERR_NO_MEM;
-                goto cleanup;
-            }
-            cJSON_AddItemToObject(d, "template", tpl_obj);
-        }
+        device_to_json(w, &cfg->devices[i]);
     }
+    dm_json_end_array(w);
+    dm_json_end_object(w);
+}
 
-    {
-        char *printed = cJSON_PrintUnformatted(root);
-        if (!printed) {
-            err = ESP_ERR_NO_MEM;
-            goto cleanup;
-        }
-        size_t len = strlen(printed);
-        char *buf = heap_caps_malloc(len + 1, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-        if (!buf) {
-            free(printed);
-            err = ESP_ERR_NO_MEM;
-            goto cleanup;
-        }
-        memcpy(buf, printed, len + 1);
-        free(printed);
-        *out_json = buf;
-        if (out_len) {
-            *out_len = len;
-        }
+// Stream the JSON document of a configuration into `sink`; nothing is built in memory
+// beyond the writer's buffer, so `cfg` must stay valid (a held generation) until return.
+esp_err_t dm_storage_internal_export_stream(const device_manager_config_t *cfg, dm_json_sink_fn sink, void *ctx)
+{
+    if (!cfg || !sink) {
+        return ESP_ERR_INVALID_ARG;
     }
-
-cleanup:
-    if (root) {
-        cJSON_Delete(root);
+    dm_json_writer_t *w = heap_caps_malloc(sizeof(*w), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!w) {
+        return ESP_ERR_NO_MEM;
     }
-    dm_cjson_reset_hooks();
+    dm_json_writer_init(w, sink, ctx);
+    dm_storage_write_config(w, cfg);
+    esp_err_t err = dm_json_writer_finish(w);
+    heap_caps_free(w);
     return err;
 }
@@ -1,7 +1,6 @@
 #pragma once
 
 #include "device_manager.h"
-#include "cJSON.h"
 #include "esp_task_wdt.h"
 
 #define DM_DEVICE_CONFIG_VERSION 1
@@ -10,15 +9,16 @@
 extern "C" {
 #endif
 
-bool dm_populate_config_from_json(device_manager_config_t *cfg, const cJSON *root);
 void dm_load_defaults(device_manager_config_t *cfg);
-void dm_cjson_install_hooks(void);
-void dm_cjson_reset_hooks(void);
 
 const char *dm_condition_to_string(device_condition_type_t cond);
 bool dm_condition_from_string(const char *name, device_condition_type_t *out);
 const char *dm_action_type_to_string(device_action_type_t type);
 bool dm_action_type_from_string(const char *name, device_action_type_t *out);
+const char *dm_scenario_priority_to_string(device_scenario_priority_t priority);
+bool dm_scenario_priority_from_string(const char *name, device_scenario_priority_t *out);
+const char *dm_scenario_concurrency_to_string(device_scenario_concurrency_t mode);
+bool dm_scenario_concurrency_from_string(const char *name, device_scenario_concurrency_t *out);
 
 #if CONFIG_ESP_TASK_WDT
 // Feed hardware watchdog if current task is subscribed; used in long loops.
@@ -1,589 +1,923 @@
 #include "device_manager_internal.h"
 
+#include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
+#include "esp_heap_caps.h"
 #include "esp_log.h"
 
+#include "dm_config.h"
+#include "dm_json_reader.h"
+#include "dm_rate_gate.h"
 #include "dm_profiles.h"
+#include "dm_schema.h"
 #include "dm_storage.h"
 #include "device_manager_utils.h"
 
+// The config document is parsed as a stream of JSON events (dm_json_reader.h) and written
+// straight into the config: each open object or array has a frame saying what it is, keys
+// are matched against the frame, and an entry is checked and committed when its object
+// closes. Only the scenario being read is staged here before it goes to the arena, so the
+// work memory is fixed whatever the document size. Template sections and the device topic
+// list are read through the field tables of dm_schema.h. The CBOR reader (dm_cbor.h) drives
+// the same builder for bulk restores.
+//
+// Keys are matched without regard to case, as cJSON_GetObjectItem() did. Fields may come in
+// any order; a template section that precedes "type" is kept only if the type matches.
+
+#define PARSE_CHUNK_SIZE        1024
+#define PARSE_KEY_MAX           32
+#define PARSE_DEVICE_GROWTH     8       // device slots added at a time while the list grows
+#define PARSE_OPTION_MAX        24      // enum names ("throttle", "leading", "gte", ...)
+
 static const char *TAG = "device_manager";
 
-// Utility: clamp JSON numeric field to uint32_t range or default.
-static uint32_t json_number_to_u32(const cJSON *item, uint32_t default_val)
+typedef enum {
+    FRAME_SKIP,                 // unknown or mistyped subtree, read and dropped
+    FRAME_ROOT,
+    FRAME_PROFILES,
+    FRAME_PROFILE,
+    FRAME_DEVICES,
+    FRAME_DEVICE,
+    FRAME_LIMIT,
+    FRAME_SCENARIOS,
+    FRAME_SCENARIO,
+    FRAME_STEPS,
+    FRAME_STEP,
+    FRAME_STEP_WAIT,
+    FRAME_STEP_WAIT_REQS,
+    FRAME_STEP_WAIT_REQ,
+    FRAME_STEP_LOOP,
+    FRAME_STEP_PARALLEL,
+    FRAME_STEP_JOIN,
+    FRAME_TEMPLATE,
+    FRAME_SECTION,              // template members, read through the schema tables
+    FRAME_LIST,                 // DM_FIELD_LIST array (template lists, device topics)
+    FRAME_ENTRY,
+    FRAME_STRS,
+} parse_frame_t;
+
+// Every field a step may carry, whatever its type; the type picks the ones used on commit.
+typedef struct {
+    bool has_type;
+    bool has_wait;
+    bool has_loop;
+    bool has_parallel;
+    device_action_type_t type;
+    uint32_t delay_ms;
+    char topic[DEVICE_MANAGER_TOPIC_MAX_LEN];
+    char payload[DEVICE_MANAGER_PAYLOAD_MAX_LEN];
+    char track[DEVICE_MANAGER_TRACK_NAME_MAX_LEN];
+    char flag[DEVICE_MANAGER_FLAG_NAME_MAX_LEN];
+    char event[DEVICE_MANAGER_NAME_MAX_LEN];
+    uint32_t qos;
+    bool retain;
+    bool blocking;
+    bool value;
+    device_condition_type_t wait_mode;
+    uint32_t wait_timeout_ms;
+    uint8_t req_count;
+    char req_flags[DEVICE_MANAGER_MAX_FLAG_RULES][DEVICE_MANAGER_FLAG_NAME_MAX_LEN];
+    bool req_states[DEVICE_MANAGER_MAX_FLAG_RULES];
+    bool req_has_flag;          // requirement being read
+    bool req_state;
+    uint16_t loop_target;
+    uint16_t loop_max;
+    uint16_t parallel_count;
+    uint32_t join_timeout_ms;
+} step_fields_t;
+
+struct dm_config_builder {
+    device_manager_config_t *cfg;
+    dm_json_reader_t reader;
+    uint8_t frames[DM_JSON_READER_MAX_DEPTH];
+    uint8_t depth;
+    char key[PARSE_KEY_MAX];
+    bool saw_root;
+    bool saw_devices;
+
+    struct {
+        char id[DEVICE_MANAGER_ID_MAX_LEN];
+        char name[DEVICE_MANAGER_NAME_MAX_LEN];
+        bool has_name;
+        bool has_count;
+        uint32_t device_count;
+    } profile;
+
+    device_descriptor_t *dev;   // open device; the array only grows between devices
+    char dev_name[DEVICE_MANAGER_NAME_MAX_LEN];
+    bool dev_has_display;
+
+    struct {
+        dm_rate_limit_t *target;
+        char mode[PARSE_OPTION_MAX];
+        char edges[PARSE_OPTION_MAX];
+        bool has_mode;
+        bool has_edges;
+        uint32_t window_ms;
+    } limit;
+
+    device_scenario_t scenarios[DEVICE_MANAGER_MAX_SCENARIOS_PER_DEVICE];
+    uint8_t scenario_count;
+    device_action_step_t steps[DEVICE_MANAGER_MAX_STEPS_PER_SCENARIO];
+    uint8_t step_count;
+    step_fields_t step;
+
+    struct {
+        bool has_type;
+        bool type_known;
+        bool has_section;
+        bool section_ok;
+        dm_template_type_t type;
+        const dm_template_schema_t *schema;     // of the section read last
+    } tpl;
+
+    // Record read through a dm_schema.h table: a template section or the device topic
+    // list. Lists do not nest, so there is at most one open list and entry.
+    struct {
+        void *base;
+        const dm_field_t *list;
+        const dm_field_t *strs;
+        uint8_t strs_index;
+        uint32_t given;         // entry members read, by table position
+        bool entry_bad;         // an entry member that makes it unusable (unknown match op)
+        bool overflow;          // more strings than a STRS member holds
+    } rec;
+
+    char chunk[PARSE_CHUNK_SIZE];
+};
+
+typedef struct dm_config_builder config_parser_t;
+
+static bool key_is(const config_parser_t *p, const char *key)
 {
-    if (!item || !cJSON_IsNumber(item) || item->valuedouble < 0) {
-        return default_val;
-    }
-    double v = item->valuedouble;
-    if (v > (double)UINT32_MAX) {
-        v = (double)UINT32_MAX;
-    }
-    return (uint32_t)v;
+    return strcasecmp(p->key, key) == 0;
 }
 
-// Utility: clamp JSON numeric field to uint16_t range or default.
-static uint16_t json_number_to_u16(const cJSON *item, uint16_t default_val)
+// Negative numbers leave the default in place; large ones are clamped.
+static void set_u32(uint32_t *dst, double v)
 {
-    if (!item || !cJSON_IsNumber(item) || item->valuedouble < 0) {
-        return default_val;
+    if (v >= 0) {
+        *dst = v > (double)UINT32_MAX ? UINT32_MAX : (uint32_t)v;
     }
-    double v = item->valuedouble;
-    if (v > (double)UINT16_MAX) {
-        v = (double)UINT16_MAX;
-    }
-    return (uint16_t)v;
 }
 
-// Return boolean value if present, otherwise fall back to default.
-static bool json_get_bool_default(const cJSON *item, bool default_val)
+static void set_u16(uint16_t *dst, double v)
 {
-    if (!item) {
-        return default_val;
-    }
-    if (cJSON_IsBool(item)) {
-        return cJSON_IsTrue(item);
+    if (v >= 0) {
+        *dst = v > (double)UINT16_MAX ? UINT16_MAX : (uint16_t)v;
     }
-    return default_val;
 }
 
-// Parse UID validator configuration from JSON into struct.
-static bool uid_template_from_json(dm_uid_template_t *tpl, const cJSON *obj)
+// Number, or a string holding one (the wizard posts input values as text).
+static bool value_to_float(dm_json_event_t event, const dm_json_value_t *value, float *out)
 {
-    if (!tpl || !obj) {
-        return false;
-    }
-    dm_uid_template_clear(tpl);
-    const cJSON *slots = cJSON_GetObjectItem(obj, "slots");
-    if (!cJSON_IsArray(slots)) {
-        return false;
+    if (event == DM_JSON_EVENT_NUMBER) {
+        *out = (float)value->number;
+        return true;
     }
-    uint8_t slot_index = 0;
-    const cJSON *slot_obj = NULL;
-    cJSON_ArrayForEach(slot_obj, slots) {
-        if (slot_index >= DM_UID_TEMPLATE_MAX_SLOTS) {
-            break;
-        }
-        const cJSON *source_id = cJSON_GetObjectItem(slot_obj, "source_id");
-        if (!cJSON_IsString(source_id) || !source_id->valuestring[0]) {
-            continue;
-        }
-        const cJSON *label = cJSON_GetObjectItem(slot_obj, "label");
-        const char *label_str = (cJSON_IsString(label) && label->valuestring) ? label->valuestring : "";
-        if (!dm_uid_template_set_slot(tpl, slot_index, source_id->valuestring, label_str)) {
-            return false;
-        }
-        const cJSON *values = cJSON_GetObjectItem(slot_obj, "values");
-        if (cJSON_IsArray(values)) {
-            const cJSON *val = NULL;
-            cJSON_ArrayForEach(val, values) {
-                if (!cJSON_IsString(val) || !val->valuestring[0]) {
-                    continue;
-                }
-                if (!dm_uid_template_add_value(tpl, slot_index, val->valuestring)) {
-                    return false;
-                }
-            }
+    if (event == DM_JSON_EVENT_STRING && value->str[0]) {
+        char *end = NULL;
+        double v = strtod(value->str, &end);
+        if (end && *end == 0) {
+            *out = (float)v;
+            return true;
         }
-        slot_index++;
-    }
-    tpl->slot_count = slot_index;
-    const cJSON *start_topic = cJSON_GetObjectItem(obj, "start_topic");
-    if (cJSON_IsString(start_topic) && start_topic->valuestring) {
-        dm_str_copy(tpl->start_topic, sizeof(tpl->start_topic), start_topic->valuestring);
-    }
-    const cJSON *start_payload = cJSON_GetObjectItem(obj, "start_payload");
-    if (cJSON_IsString(start_payload) && start_payload->valuestring) {
-        dm_str_copy(tpl->start_payload, sizeof(tpl->start_payload), start_payload->valuestring);
-    }
-    const cJSON *broadcast_topic = cJSON_GetObjectItem(obj, "broadcast_topic");
-    if (cJSON_IsString(broadcast_topic) && broadcast_topic->valuestring) {
-        dm_str_copy(tpl->broadcast_topic, sizeof(tpl->broadcast_topic), broadcast_topic->valuestring);
-    }
-    const cJSON *broadcast_payload = cJSON_GetObjectItem(obj, "broadcast_payload");
-    if (cJSON_IsString(broadcast_payload) && broadcast_payload->valuestring) {
-        dm_str_copy(tpl->broadcast_payload, sizeof(tpl->broadcast_payload), broadcast_payload->valuestring);
     }
-    const cJSON *success_topic = cJSON_GetObjectItem(obj, "success_topic");
-    if (cJSON_IsString(success_topic) && success_topic->valuestring) {
-        dm_str_copy(tpl->success_topic, sizeof(tpl->success_topic), success_topic->valuestring);
+    return false;
+}
+
+// --- commits, run when an object closes -------------------------------------------------
+
+static void commit_profile(config_parser_t *p)
+{
+    device_manager_config_t *cfg = p->cfg;
+    if (cfg->profile_count >= DEVICE_MANAGER_MAX_PROFILES || !p->profile.id[0]) {
+        return;
     }
-    const cJSON *success_payload = cJSON_GetObjectItem(obj, "success_payload");
-    if (cJSON_IsString(success_payload) && success_payload->valuestring) {
-        dm_str_copy(tpl->success_payload, sizeof(tpl->success_payload), success_payload->valuestring);
+    device_manager_profile_t *profile = dm_profiles_find_by_id(cfg, p->profile.id);
+    if (!profile) {
+        profile = &cfg->profiles[cfg->profile_count++];
+        memset(profile, 0, sizeof(*profile));
+        dm_str_copy(profile->id, sizeof(profile->id), p->profile.id);
     }
-    const cJSON *fail_topic = cJSON_GetObjectItem(obj, "fail_topic");
-    if (cJSON_IsString(fail_topic) && fail_topic->valuestring) {
-        dm_str_copy(tpl->fail_topic, sizeof(tpl->fail_topic), fail_topic->valuestring);
+    if (p->profile.has_name) {
+        dm_str_copy(profile->name, sizeof(profile->name), p->profile.name);
     }
-    const cJSON *fail_payload = cJSON_GetObjectItem(obj, "fail_payload");
-    if (cJSON_IsString(fail_payload) && fail_payload->valuestring) {
-        dm_str_copy(tpl->fail_payload, sizeof(tpl->fail_payload), fail_payload->valuestring);
+    if (p->profile.has_count) {
+        uint32_t cnt = p->profile.device_count;
+        profile->device_count = cnt > DEVICE_MANAGER_MAX_DEVICES ? DEVICE_MANAGER_MAX_DEVICES : (uint8_t)cnt;
     }
-    const cJSON *success_audio = cJSON_GetObjectItem(obj, "success_audio_track");
-    if (cJSON_IsString(success_audio) && success_audio->valuestring) {
-        dm_str_copy(tpl->success_audio_track, sizeof(tpl->success_audio_track), success_audio->valuestring);
+}
+
+// Optional "limit": {"mode","edges","window_ms"}; anything unparsable leaves it unlimited.
+static void commit_limit(config_parser_t *p)
+{
+    dm_rate_limit_t *limit = p->limit.target;
+    memset(limit, 0, sizeof(*limit));
+    dm_rate_mode_t mode = DM_RATE_MODE_DEFAULT;
+    if (p->limit.has_mode && !dm_rate_mode_from_string(p->limit.mode, &mode)) {
+        ESP_LOGW(TAG, "unknown rate limit mode '%s'", p->limit.mode);
+        return;
     }
-    const cJSON *fail_audio = cJSON_GetObjectItem(obj, "fail_audio_track");
-    if (cJSON_IsString(fail_audio) && fail_audio->valuestring) {
-        dm_str_copy(tpl->fail_audio_track, sizeof(tpl->fail_audio_track), fail_audio->valuestring);
+    uint8_t edges = DM_RATE_EDGE_LEADING;
+    if (p->limit.has_edges && !dm_rate_edges_from_string(p->limit.edges, &edges)) {
+        ESP_LOGW(TAG, "unknown rate limit edges '%s'", p->limit.edges);
+        return;
     }
-    const cJSON *success_signal_topic = cJSON_GetObjectItem(obj, "success_signal_topic");
-    if (cJSON_IsString(success_signal_topic) && success_signal_topic->valuestring) {
-        dm_str_copy(tpl->success_signal_topic, sizeof(tpl->success_signal_topic), success_signal_topic->valuestring);
+    limit->mode = (uint8_t)mode;
+    limit->edges = edges;
+    limit->window_ms = p->limit.window_ms;
+}
+
+// ESP_ERR_NO_MEM only when the config budget is spent; invalid steps are dropped.
+static esp_err_t commit_step(config_parser_t *p)
+{
+    const step_fields_t *f = &p->step;
+    const device_scenario_t *sc = &p->scenarios[p->scenario_count];
+    device_action_step_t *step = &p->steps[p->step_count];
+    memset(step, 0, sizeof(*step));
+    bool valid = f->has_type;
+    step->type = f->type;
+    step->delay_ms = f->delay_ms;
+    switch (f->type) {
+    case DEVICE_ACTION_MQTT_PUBLISH:
+        step->data.mqtt.topic = f->topic;
+        step->data.mqtt.payload = f->payload;
+        step->data.mqtt.qos = (uint8_t)f->qos;
+        step->data.mqtt.retain = f->retain;
+        break;
+    case DEVICE_ACTION_AUDIO_PLAY:
+        step->data.audio.track = f->track;
+        step->data.audio.blocking = f->blocking;
+        break;
+    case DEVICE_ACTION_SET_FLAG:
+        step->data.flag.flag = f->flag;
+        step->data.flag.value = f->value;
+        break;
+    case DEVICE_ACTION_WAIT_FLAGS:
+        valid = valid && f->has_wait;
+        step->data.wait_flags.mode = f->wait_mode;
+        step->data.wait_flags.timeout_ms = f->wait_timeout_ms;
+        step->data.wait_flags.requirement_count = f->req_count;
+        for (uint8_t i = 0; i < f->req_count; ++i) {
+            step->data.wait_flags.requirements[i].flag = f->req_flags[i];
+            step->data.wait_flags.requirements[i].required_state = f->req_states[i];
+        }
+        break;
+    case DEVICE_ACTION_LOOP:
+        valid = valid && f->has_loop;
+        step->data.loop.target_step = f->loop_target;
+        step->data.loop.max_iterations = f->loop_max;
+        break;
+    case DEVICE_ACTION_EVENT_BUS:
+        step->data.event.event = f->event;
+        step->data.event.topic = f->topic;
+        step->data.event.payload = f->payload;
+        break;
+    case DEVICE_ACTION_PARALLEL:
+        valid = valid && f->has_parallel;
+        step->data.parallel.count = f->parallel_count > DEVICE_MANAGER_MAX_STEPS_PER_SCENARIO
+                                        ? DEVICE_MANAGER_MAX_STEPS_PER_SCENARIO
+                                        : (uint8_t)f->parallel_count;
+        break;
+    case DEVICE_ACTION_JOIN:
+        step->data.join.timeout_ms = f->join_timeout_ms;
+        break;
+    default:
+        break;
     }
-    const cJSON *success_signal_payload = cJSON_GetObjectItem(obj, "success_signal_payload");
-    if (cJSON_IsString(success_signal_payload) && success_signal_payload->valuestring) {
-        dm_str_copy(tpl->success_signal_payload, sizeof(tpl->success_signal_payload), success_signal_payload->valuestring);
+    if (!valid) {
+        ESP_LOGW(TAG, "invalid step skipped in scenario %s", sc->id);
+        return ESP_OK;
     }
-    const cJSON *fail_signal_topic = cJSON_GetObjectItem(obj, "fail_signal_topic");
-    if (cJSON_IsString(fail_signal_topic) && fail_signal_topic->valuestring) {
-        dm_str_copy(tpl->fail_signal_topic, sizeof(tpl->fail_signal_topic), fail_signal_topic->valuestring);
+    // Swaps the staged strings above for pooled copies.
+    if (dm_config_intern_step(p->cfg, step) != ESP_OK) {
+        ESP_LOGE(TAG, "scenario %s exceeds the config budget", sc->id);
+        return ESP_ERR_NO_MEM;
     }
-    const cJSON *fail_signal_payload = cJSON_GetObjectItem(obj, "fail_signal_payload");
-    if (cJSON_IsString(fail_signal_payload) && fail_signal_payload->valuestring) {
-        dm_str_copy(tpl->fail_signal_payload, sizeof(tpl->fail_signal_payload), fail_signal_payload->valuestring);
+    p->step_count++;
+    return ESP_OK;
+}
+
+static esp_err_t commit_scenario(config_parser_t *p)
+{
+    device_scenario_t *sc = &p->scenarios[p->scenario_count];
+    if (p->step_count) {
+        sc->steps = dm_config_alloc_steps(p->cfg, p->step_count);
+        if (!sc->steps) {
+            ESP_LOGE(TAG, "scenario %s exceeds the config budget", sc->id);
+            return ESP_ERR_NO_MEM;
+        }
+        memcpy(sc->steps, p->steps, sizeof(p->steps[0]) * p->step_count);
+        sc->step_count = p->step_count;
     }
-    return tpl->slot_count > 0;
+    p->scenario_count++;
+    feed_wdt();
+    return ESP_OK;
 }
 
-// Parse laser/hold template from JSON object.
-static bool signal_template_from_json(dm_signal_hold_template_t *tpl, const cJSON *obj)
+static esp_err_t commit_scenarios(config_parser_t *p)
 {
-    if (!tpl || !obj) {
-        return false;
+    device_descriptor_t *dev = p->dev;
+    if (!p->scenario_count) {
+        return ESP_OK;
+    }
+    dev->scenarios = dm_config_alloc_scenarios(p->cfg, p->scenario_count);
+    if (!dev->scenarios) {
+        ESP_LOGE(TAG, "device %s exceeds the config budget", dev->id);
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(dev->scenarios, p->scenarios, sizeof(p->scenarios[0]) * p->scenario_count);
+    dev->scenario_count = p->scenario_count;
+    return ESP_OK;
+}
+
+static void commit_device(config_parser_t *p)
+{
+    device_descriptor_t *dev = p->dev;
+    if (!p->dev_has_display) {
+        dm_str_copy(dev->display_name, sizeof(dev->display_name), p->dev_name);
     }
-    dm_signal_template_clear(tpl);
-    const cJSON *signal_topic = cJSON_GetObjectItem(obj, "signal_topic");
-    if (cJSON_IsString(signal_topic) && signal_topic->valuestring) {
-        dm_str_copy(tpl->signal_topic, sizeof(tpl->signal_topic), signal_topic->valuestring);
+    if (!dev->display_name[0]) {
+        dm_str_copy(dev->display_name, sizeof(dev->display_name), dev->id);
     }
-    const cJSON *signal_on = cJSON_GetObjectItem(obj, "signal_payload_on");
-    if (cJSON_IsString(signal_on) && signal_on->valuestring) {
-        dm_str_copy(tpl->signal_payload_on, sizeof(tpl->signal_payload_on), signal_on->valuestring);
+    p->cfg->device_count++;
+    p->dev = NULL;
+    feed_wdt();
+}
+
+// A list entry is kept when it has what the table requires; otherwise its slot is cleared
+// for the next one.
+static void commit_entry(config_parser_t *p)
+{
+    const dm_field_t *list = p->rec.list;
+    const dm_record_t *entry = (const dm_record_t *)list->ref;
+    uint8_t *count = dm_field_count(list, p->rec.base, 0);
+    uint8_t idx = *count;
+    for (uint8_t i = 1; i < entry->count; ++i) {
+        const dm_field_t *f = &entry->fields[i];
+        if ((f->flags & DM_FIELD_FOLLOWS) && !(p->rec.given & (1u << i))) {
+            *(bool *)dm_field_ptr(f, p->rec.base, idx) = dm_field_is_set(&entry->fields[i - 1], p->rec.base, idx);
+        }
     }
-    const cJSON *signal_off = cJSON_GetObjectItem(obj, "signal_payload_off");
-    if (cJSON_IsString(signal_off) && signal_off->valuestring) {
-        dm_str_copy(tpl->signal_payload_off, sizeof(tpl->signal_payload_off), signal_off->valuestring);
+    if (!p->rec.entry_bad && dm_record_usable(entry, p->rec.base, idx, true)) {
+        (*count)++;
+        return;
     }
-    tpl->signal_on_ms = json_number_to_u32(cJSON_GetObjectItem(obj, "signal_on_ms"), tpl->signal_on_ms);
-    const cJSON *heartbeat = cJSON_GetObjectItem(obj, "heartbeat_topic");
-    if (cJSON_IsString(heartbeat) && heartbeat->valuestring) {
-        dm_str_copy(tpl->heartbeat_topic, sizeof(tpl->heartbeat_topic), heartbeat->valuestring);
+    dm_record_clear(entry, p->rec.base, idx);
+}
+
+static void commit_template(config_parser_t *p)
+{
+    device_descriptor_t *dev = p->dev;
+    bool ok = p->tpl.has_type && p->tpl.type_known && p->tpl.has_section &&
+              p->tpl.schema->type == p->tpl.type && p->tpl.section_ok;
+    dev->template_assigned = ok;
+    if (ok) {
+        dev->template_config.type = p->tpl.type;
+    } else {
+        ESP_LOGW(TAG, "invalid template for device %s, ignoring", dev->id);
     }
-    const cJSON *reset = cJSON_GetObjectItem(obj, "reset_topic");
-    if (cJSON_IsString(reset) && reset->valuestring) {
-        dm_str_copy(tpl->reset_topic, sizeof(tpl->reset_topic), reset->valuestring);
+}
+
+// --- frames ---------------------------------------------------------------------------
+
+static uint8_t begin_section(config_parser_t *p, const dm_template_schema_t *schema)
+{
+    if (p->tpl.has_type && (!p->tpl.type_known || p->tpl.type != schema->type)) {
+        return FRAME_SKIP;
+    }
+    dm_template_config_t *tpl = &p->dev->template_config;
+    schema->clear(tpl);
+    p->tpl.has_section = true;
+    p->tpl.section_ok = false;
+    p->tpl.schema = schema;
+    memset(&p->rec, 0, sizeof(p->rec));
+    p->rec.base = &tpl->data;
+    return FRAME_SECTION;
+}
+
+static uint8_t begin_limit(config_parser_t *p, dm_rate_limit_t *target)
+{
+    memset(&p->limit, 0, sizeof(p->limit));
+    p->limit.target = target;
+    memset(target, 0, sizeof(*target));
+    return FRAME_LIMIT;
+}
+
+// Entries after the first `max` and entries that are not objects are skipped.
+static bool entry_fits(bool object, uint8_t count, uint8_t max)
+{
+    return object && count < max;
+}
+
+static uint8_t entry_index(const config_parser_t *p)
+{
+    return *dm_field_count(p->rec.list, p->rec.base, 0);
+}
+
+// Container opened at p->key among the members of `rec` (entry `index` of a list).
+static uint8_t begin_member(config_parser_t *p, const dm_record_t *rec, uint8_t index, bool object)
+{
+    const dm_field_t *f = dm_record_find(rec, p->key);
+    if (!f) {
+        return FRAME_SKIP;
     }
-    tpl->required_hold_ms = json_number_to_u32(cJSON_GetObjectItem(obj, "required_hold_ms"), tpl->required_hold_ms);
-    tpl->heartbeat_timeout_ms = json_number_to_u32(cJSON_GetObjectItem(obj, "heartbeat_timeout_ms"), tpl->heartbeat_timeout_ms);
-    const cJSON *hold_track = cJSON_GetObjectItem(obj, "hold_track");
-    if (cJSON_IsString(hold_track) && hold_track->valuestring) {
-        dm_str_copy(tpl->hold_track, sizeof(tpl->hold_track), hold_track->valuestring);
+    if (object && f->kind == DM_FIELD_LIMIT) {
+        return begin_limit(p, (dm_rate_limit_t *)dm_field_ptr(f, p->rec.base, index));
     }
-    const cJSON *hold_loop = cJSON_GetObjectItem(obj, "hold_track_loop");
-    if (cJSON_IsBool(hold_loop)) {
-        tpl->hold_track_loop = cJSON_IsTrue(hold_loop);
+    if (!object && f->kind == DM_FIELD_STRS) {
+        p->rec.strs = f;
+        p->rec.strs_index = index;
+        return FRAME_STRS;
     }
-    const cJSON *complete = cJSON_GetObjectItem(obj, "complete_track");
-    if (cJSON_IsString(complete) && complete->valuestring) {
-        dm_str_copy(tpl->complete_track, sizeof(tpl->complete_track), complete->valuestring);
+    // A list given twice keeps the first one.
+    if (!object && f->kind == DM_FIELD_LIST && !p->rec.list && !*dm_field_count(f, p->rec.base, 0)) {
+        p->rec.list = f;
+        return FRAME_LIST;
     }
-    return tpl->signal_topic[0] && tpl->heartbeat_topic[0] && tpl->required_hold_ms > 0;
+    return FRAME_SKIP;
 }
 
-// Parse MQTT trigger rules from JSON array.
-static bool mqtt_trigger_from_json(dm_mqtt_trigger_template_t *tpl, const cJSON *obj)
+static uint8_t begin_entry(config_parser_t *p, bool object)
 {
-    if (!tpl || !obj) {
-        return false;
-    }
-    dm_mqtt_trigger_template_clear(tpl);
-    const cJSON *rules = cJSON_GetObjectItem(obj, "rules");
-    if (!cJSON_IsArray(rules)) {
-        return false;
-    }
-    uint8_t count = 0;
-    const cJSON *rule_obj = NULL;
-    cJSON_ArrayForEach(rule_obj, rules) {
-        if (count >= DM_MQTT_TRIGGER_MAX_RULES) {
-            break;
-        }
-        if (!cJSON_IsObject(rule_obj)) {
-            continue;
-        }
-        const cJSON *topic = cJSON_GetObjectItem(rule_obj, "topic");
-        const cJSON *scenario = cJSON_GetObjectItem(rule_obj, "scenario");
-        if (!cJSON_IsString(topic) || !topic->valuestring || !topic->valuestring[0] ||
-            !cJSON_IsString(scenario) || !scenario->valuestring || !scenario->valuestring[0]) {
-            continue;
-        }
-        dm_mqtt_trigger_rule_t *rule = &tpl->rules[count];
-        memset(rule, 0, sizeof(*rule));
-        dm_str_copy(rule->topic, sizeof(rule->topic), topic->valuestring);
-        dm_str_copy(rule->scenario, sizeof(rule->scenario), scenario->valuestring);
-        const cJSON *name = cJSON_GetObjectItem(rule_obj, "name");
-        if (cJSON_IsString(name) && name->valuestring) {
-            dm_str_copy(rule->name, sizeof(rule->name), name->valuestring);
+    const dm_field_t *list = p->rec.list;
+    const dm_record_t *entry = (const dm_record_t *)list->ref;
+    uint8_t idx = entry_index(p);
+    if (!entry_fits(object, idx, list->max)) {
+        return FRAME_SKIP;
+    }
+    dm_record_clear(entry, p->rec.base, idx);
+    for (uint8_t i = 0; i < entry->count; ++i) {
+        if (entry->fields[i].flags & DM_FIELD_DEFAULT_ON) {
+            *(bool *)dm_field_ptr(&entry->fields[i], p->rec.base, idx) = true;
         }
-        const cJSON *payload = cJSON_GetObjectItem(rule_obj, "payload");
-        if (cJSON_IsString(payload) && payload->valuestring) {
-            dm_str_copy(rule->payload, sizeof(rule->payload), payload->valuestring);
-        }
-        rule->payload_required = json_get_bool_default(cJSON_GetObjectItem(rule_obj, "payload_required"),
-                                                       rule->payload[0] != 0);
-        count++;
     }
-    tpl->rule_count = count;
-    return tpl->rule_count > 0;
+    p->rec.given = 0;
+    p->rec.entry_bad = false;
+    return FRAME_ENTRY;
 }
 
-// Parse flag-trigger template.
-static bool flag_trigger_from_json(dm_flag_trigger_template_t *tpl, const cJSON *obj)
+static esp_err_t begin_device(config_parser_t *p, uint8_t *frame)
 {
-    if (!tpl || !obj) {
-        return false;
-    }
-    dm_flag_trigger_template_clear(tpl);
-    const cJSON *rules = cJSON_GetObjectItem(obj, "rules");
-    if (!cJSON_IsArray(rules)) {
-        return false;
-    }
-    uint8_t count = 0;
-    const cJSON *rule_obj = NULL;
-    cJSON_ArrayForEach(rule_obj, rules) {
-        if (count >= DM_FLAG_TRIGGER_MAX_RULES) {
-            break;
+    device_manager_config_t *cfg = p->cfg;
+    if (cfg->device_count >= DEVICE_MANAGER_MAX_DEVICES) {
+        *frame = FRAME_SKIP;
+        return ESP_OK;
+    }
+    if (cfg->device_count >= cfg->device_capacity) {
+        uint32_t capacity = (uint32_t)cfg->device_capacity + PARSE_DEVICE_GROWTH;
+        if (capacity > DEVICE_MANAGER_MAX_DEVICES) {
+            capacity = DEVICE_MANAGER_MAX_DEVICES;
         }
-        if (!cJSON_IsObject(rule_obj)) {
-            continue;
+        if (dm_config_reserve_devices(cfg, (uint8_t)capacity) != ESP_OK) {
+            ESP_LOGE(TAG, "%u devices exceed the config budget", (unsigned)cfg->device_count + 1);
+            return ESP_ERR_NO_MEM;
         }
-        const cJSON *flag = cJSON_GetObjectItem(rule_obj, "flag");
-        const cJSON *scenario = cJSON_GetObjectItem(rule_obj, "scenario");
-        if (!cJSON_IsString(flag) || !flag->valuestring || !flag->valuestring[0] ||
-            !cJSON_IsString(scenario) || !scenario->valuestring || !scenario->valuestring[0]) {
-            continue;
-        }
-        dm_flag_trigger_rule_t *rule = &tpl->rules[count];
-        memset(rule, 0, sizeof(*rule));
-        dm_str_copy(rule->flag, sizeof(rule->flag), flag->valuestring);
-        dm_str_copy(rule->scenario, sizeof(rule->scenario), scenario->valuestring);
-        const cJSON *name = cJSON_GetObjectItem(rule_obj, "name");
-        if (cJSON_IsString(name) && name->valuestring) {
-            dm_str_copy(rule->name, sizeof(rule->name), name->valuestring);
-        }
-        rule->required_state = json_get_bool_default(cJSON_GetObjectItem(rule_obj, "state"), true);
-        count++;
     }
-    tpl->rule_count = count;
-    return tpl->rule_count > 0;
+    p->dev = &cfg->devices[cfg->device_count];
+    memset(p->dev, 0, sizeof(*p->dev));
+    p->dev_name[0] = 0;
+    p->dev_has_display = false;
+    p->scenario_count = 0;
+    memset(&p->tpl, 0, sizeof(p->tpl));
+    *frame = FRAME_DEVICE;
+    return ESP_OK;
 }
 
-// Parse conditional scenario template (if/then behavior).
-static bool condition_template_from_json(dm_condition_template_t *tpl, const cJSON *obj)
+// Frame for a container opened under `parent` (at p->key for object members).
+static esp_err_t begin_child(config_parser_t *p, uint8_t parent, bool object, uint8_t *frame)
 {
-    if (!tpl || !obj) {
-        return false;
-    }
-    dm_condition_template_clear(tpl);
-    const cJSON *mode = cJSON_GetObjectItem(obj, "mode");
-    if (cJSON_IsString(mode) && mode->valuestring) {
-        if (!dm_condition_from_string(mode->valuestring, &tpl->mode)) {
-            tpl->mode = DEVICE_CONDITION_ALL;
+    *frame = FRAME_SKIP;
+    step_fields_t *step = &p->step;
+    switch (parent) {
+    case FRAME_ROOT:
+        if (!object && key_is(p, "profiles")) {
+            *frame = FRAME_PROFILES;
+        } else if (!object && key_is(p, "devices") && !p->saw_devices) {
+            p->saw_devices = true;
+            *frame = FRAME_DEVICES;
         }
-    }
-    const cJSON *true_sc = cJSON_GetObjectItem(obj, "true_scenario");
-    if (cJSON_IsString(true_sc) && true_sc->valuestring) {
-        dm_str_copy(tpl->true_scenario, sizeof(tpl->true_scenario), true_sc->valuestring);
-    }
-    const cJSON *false_sc = cJSON_GetObjectItem(obj, "false_scenario");
-    if (cJSON_IsString(false_sc) && false_sc->valuestring) {
-        dm_str_copy(tpl->false_scenario, sizeof(tpl->false_scenario), false_sc->valuestring);
-    }
-    const cJSON *rules = cJSON_GetObjectItem(obj, "rules");
-    if (!cJSON_IsArray(rules)) {
-        return false;
-    }
-    uint8_t count = 0;
-    const cJSON *rule = NULL;
-    cJSON_ArrayForEach(rule, rules) {
-        if (count >= DM_CONDITION_TEMPLATE_MAX_RULES) {
+        break;
+    case FRAME_PROFILES:
+        if (object) {
+            memset(&p->profile, 0, sizeof(p->profile));
+            *frame = FRAME_PROFILE;
+        }
+        break;
+    case FRAME_DEVICES:
+        if (object) {
+            return begin_device(p, frame);
+        }
+        break;
+    case FRAME_DEVICE:
+        if (!object && key_is(p, dm_schema_device_topics()->key) && !p->dev->topic_count) {
+            memset(&p->rec, 0, sizeof(p->rec));
+            p->rec.base = p->dev;
+            p->rec.list = dm_schema_device_topics();
+            *frame = FRAME_LIST;
+        } else if (!object && key_is(p, "scenarios") && !p->dev->scenarios) {
+            p->scenario_count = 0;
+            *frame = FRAME_SCENARIOS;
+        } else if (object && key_is(p, "template")) {
+            memset(&p->tpl, 0, sizeof(p->tpl));
+            *frame = FRAME_TEMPLATE;
+        }
+        break;
+    case FRAME_SCENARIOS:
+        if (entry_fits(object, p->scenario_count, DEVICE_MANAGER_MAX_SCENARIOS_PER_DEVICE)) {
+            memset(&p->scenarios[p->scenario_count], 0, sizeof(p->scenarios[0]));
+            p->step_count = 0;
+            *frame = FRAME_SCENARIO;
+        }
+        break;
+    case FRAME_SCENARIO:
+        if (!object && key_is(p, "steps")) {
+            p->step_count = 0;
+            *frame = FRAME_STEPS;
+        }
+        break;
+    case FRAME_STEPS:
+        if (entry_fits(object, p->step_count, DEVICE_MANAGER_MAX_STEPS_PER_SCENARIO)) {
+            memset(step, 0, sizeof(*step));
+            step->wait_mode = DEVICE_CONDITION_ALL;
+            *frame = FRAME_STEP;
+        }
+        break;
+    case FRAME_STEP:
+        if (!object) {
             break;
         }
-        if (!cJSON_IsObject(rule)) {
-            continue;
+        if (key_is(p, "wait")) {
+            step->has_wait = true;
+            *frame = FRAME_STEP_WAIT;
+        } else if (key_is(p, "loop")) {
+            step->has_loop = true;
+            *frame = FRAME_STEP_LOOP;
+        } else if (key_is(p, "parallel")) {
+            step->has_parallel = true;
+            *frame = FRAME_STEP_PARALLEL;
+        } else if (key_is(p, "join")) {
+            *frame = FRAME_STEP_JOIN;
+        }
+        break;
+    case FRAME_STEP_WAIT:
+        if (!object && key_is(p, "requirements")) {
+            *frame = FRAME_STEP_WAIT_REQS;
+        }
+        break;
+    case FRAME_STEP_WAIT_REQS:
+        if (entry_fits(object, step->req_count, DEVICE_MANAGER_MAX_FLAG_RULES)) {
+            step->req_has_flag = false;
+            step->req_state = true;
+            step->req_flags[step->req_count][0] = 0;
+            *frame = FRAME_STEP_WAIT_REQ;
         }
-        const cJSON *flag = cJSON_GetObjectItem(rule, "flag");
-        if (!cJSON_IsString(flag) || !flag->valuestring[0]) {
-            continue;
+        break;
+    case FRAME_TEMPLATE:
+        if (object) {
+            const dm_template_schema_t *schema = dm_template_schema_by_section(p->key);
+            *frame = schema ? begin_section(p, schema) : FRAME_SKIP;
         }
-        dm_condition_rule_t *dst = &tpl->rules[count++];
-        dm_str_copy(dst->flag, sizeof(dst->flag), flag->valuestring);
-        dst->required_state = json_get_bool_default(cJSON_GetObjectItem(rule, "state"), true);
+        break;
+    case FRAME_SECTION:
+        *frame = begin_member(p, &p->tpl.schema->record, 0, object);
+        break;
+    case FRAME_LIST:
+        *frame = begin_entry(p, object);
+        break;
+    case FRAME_ENTRY:
+        *frame = begin_member(p, (const dm_record_t *)p->rec.list->ref, entry_index(p), object);
+        break;
+    default:
+        break;
     }
-    tpl->rule_count = count;
-    return tpl->rule_count > 0 && tpl->true_scenario[0];
+    return ESP_OK;
 }
 
-// Parse periodic task template from JSON.
-static bool interval_template_from_json(dm_interval_task_template_t *tpl, const cJSON *obj)
+static esp_err_t end_frame(config_parser_t *p, uint8_t frame)
 {
-    if (!tpl || !obj) {
-        return false;
-    }
-    dm_interval_task_template_clear(tpl);
-    tpl->interval_ms = json_number_to_u32(cJSON_GetObjectItem(obj, "interval_ms"), tpl->interval_ms);
-    const cJSON *scenario = cJSON_GetObjectItem(obj, "scenario");
-    if (cJSON_IsString(scenario) && scenario->valuestring) {
-        dm_str_copy(tpl->scenario, sizeof(tpl->scenario), scenario->valuestring);
+    switch (frame) {
+    case FRAME_PROFILE:
+        commit_profile(p);
+        break;
+    case FRAME_DEVICE:
+        commit_device(p);
+        break;
+    case FRAME_LIMIT:
+        commit_limit(p);
+        break;
+    case FRAME_SCENARIOS:
+        return commit_scenarios(p);
+    case FRAME_SCENARIO:
+        return commit_scenario(p);
+    case FRAME_STEP:
+        return commit_step(p);
+    case FRAME_STEP_WAIT_REQ:
+        if (p->step.req_has_flag) {
+            p->step.req_states[p->step.req_count++] = p->step.req_state;
+        }
+        break;
+    case FRAME_TEMPLATE:
+        commit_template(p);
+        break;
+    case FRAME_SECTION:
+        p->tpl.section_ok = !p->rec.overflow && dm_record_usable(&p->tpl.schema->record, p->rec.base, 0, true);
+        break;
+    case FRAME_LIST:
+        p->rec.list = NULL;
+        break;
+    case FRAME_ENTRY:
+        commit_entry(p);
+        break;
+    case FRAME_STRS:
+        p->rec.strs = NULL;
+        break;
+    default:
+        break;
     }
-    return tpl->interval_ms > 0 && tpl->scenario[0];
+    return ESP_OK;
 }
 
-// Parse ordered-sequence template (new puzzle) from JSON.
-static bool sequence_template_from_json(dm_sequence_template_t *tpl, const cJSON *obj)
+// --- scalar members -------------------------------------------------------------------
+
+static void step_scalar(config_parser_t *p, dm_json_event_t event, const dm_json_value_t *value)
 {
-    if (!tpl || !obj) {
-        return false;
-    }
-    dm_sequence_template_clear(tpl);
-    const cJSON *steps = cJSON_GetObjectItem(obj, "steps");
-    if (!cJSON_IsArray(steps)) {
-        return false;
-    }
-    uint8_t step_index = 0;
-    const cJSON *step_obj = NULL;
-    cJSON_ArrayForEach(step_obj, steps) {
-        if (step_index >= DM_SEQUENCE_TEMPLATE_MAX_STEPS) {
-            break;
-        }
-        if (!cJSON_IsObject(step_obj)) {
-            continue;
+    step_fields_t *f = &p->step;
+    if (event == DM_JSON_EVENT_STRING) {
+        if (key_is(p, "type")) {
+            f->has_type = dm_action_type_from_string(value->str, &f->type);
+        } else if (key_is(p, "topic")) {
+            dm_str_copy(f->topic, sizeof(f->topic), value->str);
+        } else if (key_is(p, "payload")) {
+            dm_str_copy(f->payload, sizeof(f->payload), value->str);
+        } else if (key_is(p, "track")) {
+            dm_str_copy(f->track, sizeof(f->track), value->str);
+        } else if (key_is(p, "flag")) {
+            dm_str_copy(f->flag, sizeof(f->flag), value->str);
+        } else if (key_is(p, "event")) {
+            dm_str_copy(f->event, sizeof(f->event), value->str);
         }
-        const cJSON *topic = cJSON_GetObjectItem(step_obj, "topic");
-        if (!cJSON_IsString(topic) || !topic->valuestring || !topic->valuestring[0]) {
-            continue;
+    } else if (event == DM_JSON_EVENT_NUMBER) {
+        if (key_is(p, "delay_ms")) {
+            set_u32(&f->delay_ms, value->number);
+        } else if (key_is(p, "qos")) {
+            set_u32(&f->qos, value->number);
         }
-        dm_sequence_step_t *step = &tpl->steps[step_index];
-        memset(step, 0, sizeof(*step));
-        dm_str_copy(step->topic, sizeof(step->topic), topic->valuestring);
-        const cJSON *payload = cJSON_GetObjectItem(step_obj, "payload");
-        if (cJSON_IsString(payload) && payload->valuestring) {
-            dm_str_copy(step->payload, sizeof(step->payload), payload->valuestring);
+    } else if (event == DM_JSON_EVENT_BOOL) {
+        if (key_is(p, "retain")) {
+            f->retain = value->boolean;
+        } else if (key_is(p, "blocking")) {
+            f->blocking = value->boolean;
+        } else if (key_is(p, "value")) {
+            f->value = value->boolean;
         }
-        step->payload_required =
-            json_get_bool_default(cJSON_GetObjectItem(step_obj, "payload_required"), step->payload_required);
-        const cJSON *hint_topic = cJSON_GetObjectItem(step_obj, "hint_topic");
-        if (cJSON_IsString(hint_topic) && hint_topic->valuestring) {
-            dm_str_copy(step->hint_topic, sizeof(step->hint_topic), hint_topic->valuestring);
+    }
+}
+
+// Member of a record read through its table; values of the wrong JSON type are ignored.
+static void record_scalar(config_parser_t *p,
+                          const dm_record_t *rec,
+                          void *base,
+                          uint8_t index,
+                          dm_json_event_t event,
+                          const dm_json_value_t *value)
+{
+    const dm_field_t *f = dm_record_find(rec, p->key);
+    if (!f) {
+        return;
+    }
+    void *dst = dm_field_ptr(f, base, index);
+    bool is_str = event == DM_JSON_EVENT_STRING;
+    bool given = false;
+    switch (f->kind) {
+    case DM_FIELD_STR:
+        if (is_str) {
+            dm_str_copy((char *)dst, f->size, value->str);
+            given = true;
         }
-        const cJSON *hint_payload = cJSON_GetObjectItem(step_obj, "hint_payload");
-        if (cJSON_IsString(hint_payload) && hint_payload->valuestring) {
-            dm_str_copy(step->hint_payload, sizeof(step->hint_payload), hint_payload->valuestring);
+        break;
+    case DM_FIELD_U32:
+        if (event == DM_JSON_EVENT_NUMBER) {
+            set_u32((uint32_t *)dst, value->number);
+            given = true;
         }
-        const cJSON *hint_audio = cJSON_GetObjectItem(step_obj, "hint_audio_track");
-        if (cJSON_IsString(hint_audio) && hint_audio->valuestring) {
-            dm_str_copy(step->hint_audio_track, sizeof(step->hint_audio_track), hint_audio->valuestring);
+        break;
+    case DM_FIELD_BOOL:
+        if (event == DM_JSON_EVENT_BOOL) {
+            *(bool *)dst = value->boolean;
+            given = true;
         }
-        step_index++;
-    }
-    tpl->step_count = step_index;
-    tpl->timeout_ms = json_number_to_u32(cJSON_GetObjectItem(obj, "timeout_ms"), tpl->timeout_ms);
-    tpl->reset_on_error =
-        json_get_bool_default(cJSON_GetObjectItem(obj, "reset_on_error"), tpl->reset_on_error);
-    const cJSON *success_topic = cJSON_GetObjectItem(obj, "success_topic");
-    if (cJSON_IsString(success_topic) && success_topic->valuestring) {
-        dm_str_copy(tpl->success_topic, sizeof(tpl->success_topic), success_topic->valuestring);
-    }
-    const cJSON *success_payload = cJSON_GetObjectItem(obj, "success_payload");
-    if (cJSON_IsString(success_payload) && success_payload->valuestring) {
-        dm_str_copy(tpl->success_payload, sizeof(tpl->success_payload), success_payload->valuestring);
-    }
-    const cJSON *success_audio = cJSON_GetObjectItem(obj, "success_audio_track");
-    if (cJSON_IsString(success_audio) && success_audio->valuestring) {
-        dm_str_copy(tpl->success_audio_track, sizeof(tpl->success_audio_track), success_audio->valuestring);
-    }
-    const cJSON *success_scenario = cJSON_GetObjectItem(obj, "success_scenario");
-    if (cJSON_IsString(success_scenario) && success_scenario->valuestring) {
-        dm_str_copy(tpl->success_scenario, sizeof(tpl->success_scenario), success_scenario->valuestring);
-    }
-    const cJSON *fail_topic = cJSON_GetObjectItem(obj, "fail_topic");
-    if (cJSON_IsString(fail_topic) && fail_topic->valuestring) {
-        dm_str_copy(tpl->fail_topic, sizeof(tpl->fail_topic), fail_topic->valuestring);
+        break;
+    case DM_FIELD_FLOAT: {
+        float v = 0;
+        given = value_to_float(event, value, &v);
+        *(float *)dst = given ? v : 0;
+        *(bool *)((uint8_t *)base + f->aux + (size_t)index * f->stride) = given;
+        break;
     }
-    const cJSON *fail_payload = cJSON_GetObjectItem(obj, "fail_payload");
-    if (cJSON_IsString(fail_payload) && fail_payload->valuestring) {
-        dm_str_copy(tpl->fail_payload, sizeof(tpl->fail_payload), fail_payload->valuestring);
+    case DM_FIELD_ENUM: {
+        const dm_field_names_t *names = (const dm_field_names_t *)f->ref;
+        int v = 0;
+        if (!is_str || !value->str[0]) {
+            break;
+        }
+        if (names->from_string(value->str, &v)) {
+            dm_field_set_int(f, base, index, v);
+            given = true;
+        } else if (f->flags & DM_FIELD_STRICT) {
+            ESP_LOGW(TAG, "unknown %s '%s'", f->key, value->str);
+            p->rec.entry_bad = true;
+        }
+        break;
     }
-    const cJSON *fail_audio = cJSON_GetObjectItem(obj, "fail_audio_track");
-    if (cJSON_IsString(fail_audio) && fail_audio->valuestring) {
-        dm_str_copy(tpl->fail_audio_track, sizeof(tpl->fail_audio_track), fail_audio->valuestring);
+    default:
+        break;
     }
-    const cJSON *fail_scenario = cJSON_GetObjectItem(obj, "fail_scenario");
-    if (cJSON_IsString(fail_scenario) && fail_scenario->valuestring) {
-        dm_str_copy(tpl->fail_scenario, sizeof(tpl->fail_scenario), fail_scenario->valuestring);
+    if (given) {
+        p->rec.given |= 1u << (f - rec->fields);
     }
-    return tpl->step_count > 0;
 }
 
-// Dispatch helper: parse template payload based on requested type.
-static bool template_from_json(device_descriptor_t *dev, const cJSON *obj)
+static void strs_scalar(config_parser_t *p, dm_json_event_t event, const dm_json_value_t *value)
 {
-    if (!dev || !obj) {
-        dev->template_assigned = false;
-        return false;
-    }
-    const cJSON *type_item = cJSON_GetObjectItem(obj, "type");
-    if (!cJSON_IsString(type_item) || !type_item->valuestring) {
-        dev->template_assigned = false;
-        return false;
-    }
-    dm_template_type_t type;
-    if (!dm_template_type_from_string(type_item->valuestring, &type)) {
-        dev->template_assigned = false;
-        return false;
-    }
-    dev->template_assigned = true;
-    dev->template_config.type = type;
-    bool ok = false;
-    switch (type) {
-    case DM_TEMPLATE_TYPE_UID: {
-        const cJSON *uid_obj = cJSON_GetObjectItem(obj, "uid");
-        ok = uid_template_from_json(&dev->template_config.data.uid, uid_obj);
-        break;
+    const dm_field_t *f = p->rec.strs;
+    uint8_t *count = dm_field_count(f, p->rec.base, p->rec.strs_index);
+    if (event != DM_JSON_EVENT_STRING || !value->str[0]) {
+        return;
     }
-    case DM_TEMPLATE_TYPE_SIGNAL_HOLD: {
-        const cJSON *sig_obj = cJSON_GetObjectItem(obj, "signal");
-        ok = signal_template_from_json(&dev->template_config.data.signal, sig_obj);
-        break;
+    if (*count >= f->max) {
+        p->rec.overflow = true;
+        return;
     }
-    case DM_TEMPLATE_TYPE_MQTT_TRIGGER: {
-        const cJSON *mqtt_obj = cJSON_GetObjectItem(obj, "mqtt");
-        ok = mqtt_trigger_from_json(&dev->template_config.data.mqtt, mqtt_obj);
+    dm_str_copy((char *)dm_field_str(f, p->rec.base, p->rec.strs_index, *count), f->size, value->str);
+    (*count)++;
+}
+
+static void template_scalar(config_parser_t *p, uint8_t frame, dm_json_event_t event, const dm_json_value_t *value)
+{
+    switch (frame) {
+    case FRAME_TEMPLATE:
+        if (event == DM_JSON_EVENT_STRING && key_is(p, "type")) {
+            p->tpl.has_type = true;
+            p->tpl.type_known = dm_template_type_from_string(value->str, &p->tpl.type);
+        }
         break;
-    }
-    case DM_TEMPLATE_TYPE_FLAG_TRIGGER: {
-        const cJSON *flag_obj = cJSON_GetObjectItem(obj, "flag");
-        ok = flag_trigger_from_json(&dev->template_config.data.flag, flag_obj);
+    case FRAME_SECTION:
+        record_scalar(p, &p->tpl.schema->record, p->rec.base, 0, event, value);
         break;
-    }
-    case DM_TEMPLATE_TYPE_IF_CONDITION: {
-        const cJSON *cond_obj = cJSON_GetObjectItem(obj, "condition");
-        ok = condition_template_from_json(&dev->template_config.data.condition, cond_obj);
+    case FRAME_LIST:
         break;
-    }
-    case DM_TEMPLATE_TYPE_INTERVAL_TASK: {
-        const cJSON *interval_obj = cJSON_GetObjectItem(obj, "interval");
-        ok = interval_template_from_json(&dev->template_config.data.interval, interval_obj);
+    case FRAME_ENTRY:
+        record_scalar(p, (const dm_record_t *)p->rec.list->ref, p->rec.base, entry_index(p), event, value);
         break;
-    }
-    case DM_TEMPLATE_TYPE_SEQUENCE_LOCK: {
-        const cJSON *sequence_obj = cJSON_GetObjectItem(obj, "sequence");
-        ok = sequence_template_from_json(&dev->template_config.data.sequence, sequence_obj);
+    case FRAME_STRS:
+        strs_scalar(p, event, value);
         break;
-    }
     default:
-        ok = false;
         break;
     }
-    if (!ok) {
-        dev->template_assigned = false;
-    }
-    return dev->template_assigned;
 }
 
-// Parse single scenario step (MQTT/audio/flags/etc).
-static bool step_from_json(const cJSON *obj, device_action_step_t *step)
+static void scalar(config_parser_t *p, uint8_t frame, dm_json_event_t event, const dm_json_value_t *value)
 {
-    if (!obj || !step) {
-        return false;
-    }
-    const cJSON *type_item = cJSON_GetObjectItem(obj, "type");
-    if (!cJSON_IsString(type_item)) {
-        return false;
-    }
-    device_action_type_t type;
-    if (!dm_action_type_from_string(type_item->valuestring, &type)) {
-        return false;
-    }
-    memset(step, 0, sizeof(*step));
-    step->type = type;
-    step->delay_ms = json_number_to_u32(cJSON_GetObjectItem(obj, "delay_ms"), 0);
-    switch (type) {
-    case DEVICE_ACTION_MQTT_PUBLISH:
-        dm_str_copy(step->data.mqtt.topic, sizeof(step->data.mqtt.topic),
-                    cJSON_GetStringValue(cJSON_GetObjectItem(obj, "topic")));
-        dm_str_copy(step->data.mqtt.payload, sizeof(step->data.mqtt.payload),
-                    cJSON_GetStringValue(cJSON_GetObjectItem(obj, "payload")));
-        step->data.mqtt.qos = (uint8_t)json_number_to_u32(cJSON_GetObjectItem(obj, "qos"), 0);
-        step->data.mqtt.retain = json_get_bool_default(cJSON_GetObjectItem(obj, "retain"), false);
+    device_manager_config_t *cfg = p->cfg;
+    bool is_str = event == DM_JSON_EVENT_STRING;
+    bool is_num = event == DM_JSON_EVENT_NUMBER;
+    switch (frame) {
+    case FRAME_ROOT:
+        if (is_num && key_is(p, "schema")) {
+            set_u32(&cfg->schema_version, value->number);
+        } else if (is_num && key_is(p, "generation")) {
+            set_u32(&cfg->generation, value->number);
+        } else if (is_str && key_is(p, "active_profile") && value->str[0]) {
+            dm_str_copy(cfg->active_profile, sizeof(cfg->active_profile), value->str);
+        }
         break;
-    case DEVICE_ACTION_AUDIO_PLAY:
-        dm_str_copy(step->data.audio.track, sizeof(step->data.audio.track),
-                    cJSON_GetStringValue(cJSON_GetObjectItem(obj, "track")));
-        step->data.audio.blocking = json_get_bool_default(cJSON_GetObjectItem(obj, "blocking"), false);
+    case FRAME_PROFILE:
+        if (is_str && key_is(p, "id")) {
+            dm_str_copy(p->profile.id, sizeof(p->profile.id), value->str);
+        } else if (is_str && key_is(p, "name")) {
+            p->profile.has_name = true;
+            dm_str_copy(p->profile.name, sizeof(p->profile.name), value->str);
+        } else if (is_num && key_is(p, "device_count")) {
+            p->profile.has_count = true;
+            p->profile.device_count = 0;
+            set_u32(&p->profile.device_count, value->number);
+        }
         break;
-    case DEVICE_ACTION_SET_FLAG:
-        dm_str_copy(step->data.flag.flag, sizeof(step->data.flag.flag),
-                    cJSON_GetStringValue(cJSON_GetObjectItem(obj, "flag")));
-        step->data.flag.value = json_get_bool_default(cJSON_GetObjectItem(obj, "value"), false);
-        break;
-    case DEVICE_ACTION_WAIT_FLAGS: {
-        const cJSON *wait = cJSON_GetObjectItem(obj, "wait");
-        if (!cJSON_IsObject(wait)) {
-            return false;
-        }
-        const cJSON *mode = cJSON_GetObjectItem(wait, "mode");
-        if (!mode || !cJSON_IsString(mode) ||
-            !dm_condition_from_string(mode->valuestring, &step->data.wait_flags.mode)) {
-            step->data.wait_flags.mode = DEVICE_CONDITION_ALL;
-        }
-        step->data.wait_flags.timeout_ms = json_number_to_u32(cJSON_GetObjectItem(wait, "timeout_ms"), 0);
-        const cJSON *reqs = cJSON_GetObjectItem(wait, "requirements");
-        uint8_t req_count = 0;
-        if (cJSON_IsArray(reqs)) {
-            const cJSON *req = NULL;
-            cJSON_ArrayForEach(req, reqs) {
-                if (req_count >= DEVICE_MANAGER_MAX_FLAG_RULES) {
-                    break;
-                }
-                const cJSON *flag = cJSON_GetObjectItem(req, "flag");
-                if (!cJSON_IsString(flag)) {
-                    continue;
-                }
-                device_flag_requirement_t *dst = &step->data.wait_flags.requirements[req_count++];
-                dm_str_copy(dst->flag, sizeof(dst->flag), flag->valuestring);
-                dst->required_state = json_get_bool_default(cJSON_GetObjectItem(req, "state"), true);
+    case FRAME_DEVICE:
+        if (!is_str) {
+            break;
+        }
+        if (key_is(p, "id")) {
+            dm_str_copy(p->dev->id, sizeof(p->dev->id), value->str);
+        } else if (key_is(p, "display_name")) {
+            p->dev_has_display = true;
+            dm_str_copy(p->dev->display_name, sizeof(p->dev->display_name), value->str);
+        } else if (key_is(p, "name")) {
+            dm_str_copy(p->dev_name, sizeof(p->dev_name), value->str);
+        }
+        break;
+    case FRAME_LIMIT:
+        if (is_str && key_is(p, "mode")) {
+            p->limit.has_mode = true;
+            dm_str_copy(p->limit.mode, sizeof(p->limit.mode), value->str);
+        } else if (is_str && key_is(p, "edges")) {
+            p->limit.has_edges = true;
+            dm_str_copy(p->limit.edges, sizeof(p->limit.edges), value->str);
+        } else if (is_num && key_is(p, "window_ms")) {
+            set_u32(&p->limit.window_ms, value->number);
+        }
+        break;
+    case FRAME_SCENARIO:
+        record_scalar(p, dm_schema_scenario(), &p->scenarios[p->scenario_count], 0, event, value);
+        break;
+    case FRAME_STEP:
+        step_scalar(p, event, value);
+        break;
+    case FRAME_STEP_WAIT:
+        if (is_str && key_is(p, "mode")) {
+            if (!dm_condition_from_string(value->str, &p->step.wait_mode)) {
+                p->step.wait_mode = DEVICE_CONDITION_ALL;
             }
+        } else if (is_num && key_is(p, "timeout_ms")) {
+            set_u32(&p->step.wait_timeout_ms, value->number);
         }
-        step->data.wait_flags.requirement_count = req_count;
         break;
-    }
-    case DEVICE_ACTION_LOOP: {
-        const cJSON *loop = cJSON_GetObjectItem(obj, "loop");
-        if (!cJSON_IsObject(loop)) {
-            return false;
+    case FRAME_STEP_WAIT_REQ:
+        if (is_str && key_is(p, "flag")) {
+            p->step.req_has_flag = true;
+            dm_str_copy(p->step.req_flags[p->step.req_count], sizeof(p->step.req_flags[0]), value->str);
+        } else if (event == DM_JSON_EVENT_BOOL && key_is(p, "state")) {
+            p->step.req_state = value->boolean;
+        }
+        break;
+    case FRAME_STEP_LOOP:
+        if (is_num && key_is(p, "target_step")) {
+            set_u16(&p->step.loop_target, value->number);
+        } else if (is_num && key_is(p, "max_iterations")) {
+            set_u16(&p->step.loop_max, value->number);
+        }
+        break;
+    case FRAME_STEP_PARALLEL:
+        if (is_num && key_is(p, "count")) {
+            set_u16(&p->step.parallel_count, value->number);
+        }
+        break;
+    case FRAME_STEP_JOIN:
+        if (is_num && key_is(p, "timeout_ms")) {
+            set_u32(&p->step.join_timeout_ms, value->number);
         }
-        step->data.loop.target_step = json_number_to_u16(cJSON_GetObjectItem(loop, "target_step"), 0);
-        step->data.loop.max_iterations = json_number_to_u16(cJSON_GetObjectItem(loop, "max_iterations"), 0);
         break;
-    }
-    case DEVICE_ACTION_EVENT_BUS:
-        dm_str_copy(step->data.event.event, sizeof(step->data.event.event),
-                    cJSON_GetStringValue(cJSON_GetObjectItem(obj, "event")));
-        dm_str_copy(step->data.event.topic, sizeof(step->data.event.topic),
-                    cJSON_GetStringValue(cJSON_GetObjectItem(obj, "topic")));
-        dm_str_copy(step->data.event.payload, sizeof(step->data.event.payload),
-                    cJSON_GetStringValue(cJSON_GetObjectItem(obj, "payload")));
-        break;
-    case DEVICE_ACTION_AUDIO_STOP:
-    case DEVICE_ACTION_DELAY:
-    case DEVICE_ACTION_NOP:
     default:
+        if (frame >= FRAME_TEMPLATE) {
+            template_scalar(p, frame, event, value);
+        }
         break;
     }
-    return true;
+}
+
+esp_err_t dm_config_builder_event(void *ctx, dm_json_event_t event, const dm_json_value_t *value)
+{
+    config_parser_t *p = (config_parser_t *)ctx;
+    uint8_t top = p->depth ? p->frames[p->depth - 1] : FRAME_SKIP;
+    switch (event) {
+    case DM_JSON_EVENT_KEY:
+        dm_str_copy(p->key, sizeof(p->key), value->str);
+        return ESP_OK;
+    case DM_JSON_EVENT_OBJECT_BEGIN:
+    case DM_JSON_EVENT_ARRAY_BEGIN: {
+        bool object = event == DM_JSON_EVENT_OBJECT_BEGIN;
+        uint8_t frame = FRAME_SKIP;
+        if (p->depth == 0) {
+            if (!object || p->saw_root) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            p->saw_root = true;
+            frame = FRAME_ROOT;
+        } else if (top != FRAME_SKIP) {
+            esp_err_t err = begin_child(p, top, object, &frame);
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+        p->frames[p->depth++] = frame;
+        return ESP_OK;
+    }
+    case DM_JSON_EVENT_OBJECT_END:
+    case DM_JSON_EVENT_ARRAY_END:
+        p->depth--;
+        return end_frame(p, top);
+    default:
+        if (p->depth) {
+            scalar(p, top, event, value);
+        }
+        return ESP_OK;
+    }
 }
 
 void dm_load_defaults(device_manager_config_t *cfg)
@@ -591,12 +925,14 @@ void dm_load_defaults(device_manager_config_t *cfg)
     if (!cfg) {
         return;
     }
-    uint8_t capacity = cfg->device_capacity;
+    // The config keeps its (emptied) arena; only the header is reset.
+    dm_config_reset_devices(cfg, 0);
+    struct dm_config_arena *arena = cfg->arena;
     device_descriptor_t *devices = cfg->devices;
-    if (devices && capacity > 0) {
-        memset(devices, 0, sizeof(device_descriptor_t) * capacity);
-    }
+    uint8_t capacity = cfg->device_capacity;
     memset(cfg, 0, sizeof(*cfg));
+    cfg->arena = arena;
+    cfg->devices = devices;
     cfg->device_capacity = capacity;
     cfg->schema_version = DM_DEVICE_CONFIG_VERSION;
     cfg->generation = 1;
@@ -605,173 +941,68 @@ void dm_load_defaults(device_manager_config_t *cfg)
     dm_profiles_ensure_active(cfg);
 }
 
-// Convert JSON tree into in-memory device_manager_config_t.
-bool dm_populate_config_from_json(device_manager_config_t *cfg, const cJSON *root)
+dm_config_builder_t *dm_config_builder_create(device_manager_config_t *cfg)
 {
-    if (!cfg || !root) {
-        return false;
+    if (!cfg) {
+        return NULL;
+    }
+    // Touched for every input byte, so internal RAM first.
+    config_parser_t *p = heap_caps_calloc(1, sizeof(*p), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!p) {
+        p = heap_caps_calloc(1, sizeof(*p), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
     }
+    if (!p) {
+        return NULL;
+    }
+    p->cfg = cfg;
+    dm_json_reader_init(&p->reader, dm_config_builder_event, p);
     dm_load_defaults(cfg);
-    cfg->schema_version = json_number_to_u32(cJSON_GetObjectItem(root, "schema"), DM_DEVICE_CONFIG_VERSION);
-    cfg->generation = json_number_to_u32(cJSON_GetObjectItem(root, "generation"), cfg->generation);
     cfg->profile_count = 0;
     cfg->active_profile[0] = 0;
-    // Profiles array only stores metadata and device_count, actual devices parsed below.
-    const cJSON *profiles = cJSON_GetObjectItem(root, "profiles");
-    if (cJSON_IsArray(profiles)) {
-        const cJSON *node = NULL;
-        cJSON_ArrayForEach(node, profiles) {
-            if (cfg->profile_count >= DEVICE_MANAGER_MAX_PROFILES) {
-                break;
-            }
-            if (!cJSON_IsObject(node)) {
-                continue;
-            }
-            const cJSON *id_item = cJSON_GetObjectItem(node, "id");
-            if (!cJSON_IsString(id_item) || !id_item->valuestring[0]) {
-                continue;
-            }
-            device_manager_profile_t *profile = dm_profiles_find_by_id(cfg, id_item->valuestring);
-            if (!profile && cfg->profile_count < DEVICE_MANAGER_MAX_PROFILES) {
-                profile = &cfg->profiles[cfg->profile_count++];
-                memset(profile, 0, sizeof(*profile));
-                dm_str_copy(profile->id, sizeof(profile->id), id_item->valuestring);
-            }
-            if (!profile) {
-                continue;
-            }
-            const cJSON *name_item = cJSON_GetObjectItem(node, "name");
-            if (cJSON_IsString(name_item) && name_item->valuestring) {
-                dm_str_copy(profile->name, sizeof(profile->name), name_item->valuestring);
-            }
-            const cJSON *count_item = cJSON_GetObjectItem(node, "device_count");
-            if (cJSON_IsNumber(count_item)) {
-                uint32_t cnt = json_number_to_u32(count_item, 0);
-                uint8_t cap = cfg->device_capacity ? cfg->device_capacity : DEVICE_MANAGER_MAX_DEVICES;
-                profile->device_count = (cnt > cap) ? cap : (uint8_t)cnt;
-            }
-        }
+    return p;
+}
+
+esp_err_t dm_config_builder_finish(dm_config_builder_t *p)
+{
+    if (!p) {
+        return ESP_ERR_INVALID_ARG;
     }
-    const cJSON *active = cJSON_GetObjectItem(root, "active_profile");
-    if (cJSON_IsString(active) && active->valuestring && active->valuestring[0]) {
-        dm_str_copy(cfg->active_profile, sizeof(cfg->active_profile), active->valuestring);
+    if (!p->saw_root || p->depth) {
+        return ESP_ERR_INVALID_SIZE;
     }
+    device_manager_config_t *cfg = p->cfg;
+    dm_config_trim_devices(cfg);
     dm_profiles_ensure_active(cfg);
-
-    // Parse devices with topics/scenarios/template payloads.
-    const cJSON *devices = cJSON_GetObjectItem(root, "devices");
-    if (!devices || !cJSON_IsArray(devices)) {
-        cfg->device_count = 0;
-        return true;
+    if (p->saw_devices) {
+        dm_profiles_sync_to_active(cfg);
     }
-    uint8_t dev_count = 0;
-    const cJSON *dev_node = NULL;
-    cJSON_ArrayForEach(dev_node, devices) {
-        if (cfg->device_capacity && dev_count >= cfg->device_capacity) {
-            break;
-        }
-        if (!cJSON_IsObject(dev_node)) {
-            continue;
-        }
-        device_descriptor_t *dev = &cfg->devices[dev_count];
-        memset(dev, 0, sizeof(*dev));
-        dm_str_copy(dev->id, sizeof(dev->id), cJSON_GetStringValue(cJSON_GetObjectItem(dev_node, "id")));
-        const cJSON *display_name = cJSON_GetObjectItem(dev_node, "display_name");
-        const cJSON *name = cJSON_GetObjectItem(dev_node, "name");
-        const char *display = NULL;
-        if (cJSON_IsString(display_name) && display_name->valuestring) {
-            display = display_name->valuestring;
-        } else {
-            display = cJSON_GetStringValue(name);
-        }
-        if (!display || !display[0]) {
-            display = dev->id;
-        }
-        dm_str_copy(dev->display_name, sizeof(dev->display_name), display);
-        feed_wdt();
+    return ESP_OK;
+}
 
-        const cJSON *topics = cJSON_GetObjectItem(dev_node, "topics");
-        uint8_t topic_count = 0;
-        if (cJSON_IsArray(topics)) {
-            const cJSON *topic_node = NULL;
-            cJSON_ArrayForEach(topic_node, topics) {
-                if (topic_count >= DEVICE_MANAGER_MAX_TOPICS_PER_DEVICE) {
-                    break;
-                }
-                if (!cJSON_IsObject(topic_node)) {
-                    continue;
-                }
-                device_topic_binding_t *binding = &dev->topics[topic_count++];
-                dm_str_copy(binding->name, sizeof(binding->name),
-                            cJSON_GetStringValue(cJSON_GetObjectItem(topic_node, "name")));
-                dm_str_copy(binding->topic, sizeof(binding->topic),
-                            cJSON_GetStringValue(cJSON_GetObjectItem(topic_node, "topic")));
-                feed_wdt();
-            }
-        }
-        dev->topic_count = topic_count;
-
-        const cJSON *scenarios = cJSON_GetObjectItem(dev_node, "scenarios");
-        uint8_t scenario_count = 0;
-        if (cJSON_IsArray(scenarios)) {
-            const cJSON *sc_node = NULL;
-            cJSON_ArrayForEach(sc_node, scenarios) {
-                if (scenario_count >= DEVICE_MANAGER_MAX_SCENARIOS_PER_DEVICE) {
-                    break;
-                }
-                if (!cJSON_IsObject(sc_node)) {
-                    continue;
-                }
-                device_scenario_t *sc = &dev->scenarios[scenario_count];
-                memset(sc, 0, sizeof(*sc));
-                dm_str_copy(sc->id, sizeof(sc->id), cJSON_GetStringValue(cJSON_GetObjectItem(sc_node, "id")));
-                dm_str_copy(sc->name, sizeof(sc->name), cJSON_GetStringValue(cJSON_GetObjectItem(sc_node, "name")));
-                const cJSON *button = cJSON_GetObjectItem(sc_node, "button_enabled");
-                sc->button_enabled = cJSON_IsTrue(button);
-                dm_str_copy(sc->button_label, sizeof(sc->button_label),
-                            cJSON_GetStringValue(cJSON_GetObjectItem(sc_node, "button_label")));
-                const cJSON *steps = cJSON_GetObjectItem(sc_node, "steps");
-                uint8_t step_count = 0;
-                if (cJSON_IsArray(steps)) {
-                    const cJSON *step_node = NULL;
-                    cJSON_ArrayForEach(step_node, steps) {
-                        if (step_count >= DEVICE_MANAGER_MAX_STEPS_PER_SCENARIO) {
-                            break;
-                        }
-                        if (!cJSON_IsObject(step_node)) {
-                            continue;
-                        }
-                        if (!step_from_json(step_node, &sc->steps[step_count])) {
-                            ESP_LOGW(TAG, "invalid step skipped in scenario %s", sc->id);
-                            continue;
-                        }
-                        step_count++;
-                        feed_wdt();
-                    }
-                }
-                sc->step_count = step_count;
-                scenario_count++;
-                feed_wdt();
-            }
-        }
-        dev->scenario_count = scenario_count;
+void dm_config_builder_destroy(dm_config_builder_t *p)
+{
+    heap_caps_free(p);
+}
 
-        const cJSON *template_obj = cJSON_GetObjectItem(dev_node, "template");
-        if (cJSON_IsObject(template_obj)) {
-            if (!template_from_json(dev, template_obj)) {
-                ESP_LOGW(TAG, "invalid template for device %s, ignoring", dev->id);
-                dev->template_assigned = false;
-            }
-        } else {
-            dev->template_assigned = false;
-        }
+static esp_err_t parser_feed(config_parser_t *p, const char *data, size_t len)
+{
+    if (!p) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return dm_json_reader_feed(&p->reader, data, len);
+}
 
-        dev_count++;
-        feed_wdt();
+static esp_err_t parser_finish(config_parser_t *p)
+{
+    if (!p) {
+        return ESP_ERR_INVALID_ARG;
     }
-    cfg->device_count = dev_count;
-    dm_profiles_sync_to_active(cfg);
-    return true;
+    esp_err_t err = dm_json_reader_finish(&p->reader);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "device config rejected at byte %u: %s", (unsigned)p->reader.offset, esp_err_to_name(err));
+        return err;
+    }
+    return dm_config_builder_finish(p);
 }
 
 esp_err_t dm_storage_internal_parse(const char *json, size_t len, device_manager_config_t *cfg)
@@ -779,13 +1010,46 @@ esp_err_t dm_storage_internal_parse(const char *json, size_t len, device_manager
     if (!json || len == 0 || !cfg) {
         return ESP_ERR_INVALID_ARG;
     }
-    dm_cjson_install_hooks();
-    cJSON *root = cJSON_ParseWithLength(json, len);
-    dm_cjson_reset_hooks();
-    if (!root) {
+    config_parser_t *p = dm_config_builder_create(cfg);
+    if (!p) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t err = parser_feed(p, json, len);
+    if (err == ESP_OK) {
+        err = parser_finish(p);
+    } else {
+        ESP_LOGW(TAG, "device config rejected at byte %u: %s", (unsigned)p->reader.offset, esp_err_to_name(err));
+    }
+    dm_config_builder_destroy(p);
+    return err;
+}
+
+esp_err_t dm_storage_internal_parse_stream(dm_json_source_fn source, void *ctx, device_manager_config_t *cfg)
+{
+    if (!source || !cfg) {
         return ESP_ERR_INVALID_ARG;
     }
-    bool ok = dm_populate_config_from_json(cfg, root);
-    cJSON_Delete(root);
-    return ok ? ESP_OK : ESP_ERR_INVALID_ARG;
+    config_parser_t *p = dm_config_builder_create(cfg);
+    if (!p) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t err = ESP_OK;
+    for (;;) {
+        size_t got = 0;
+        err = source(ctx, p->chunk, sizeof(p->chunk), &got);
+        if (err != ESP_OK || got == 0) {
+            break;
+        }
+        err = parser_feed(p, p->chunk, got);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "device config rejected at byte %u: %s", (unsigned)p->reader.offset, esp_err_to_name(err));
+            break;
+        }
+        feed_wdt();
+    }
+    if (err == ESP_OK) {
+        err = parser_finish(p);
+    }
+    dm_config_builder_destroy(p);
+    return err;
 }
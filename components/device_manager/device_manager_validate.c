@@ -17,8 +17,53 @@ static const action_type_map_t k_action_types[] = {
     {DEVICE_ACTION_LOOP, "loop"},
     {DEVICE_ACTION_DELAY, "delay"},
     {DEVICE_ACTION_EVENT_BUS, "event"},
+    {DEVICE_ACTION_PARALLEL, "parallel"},
+    {DEVICE_ACTION_JOIN, "join"},
 };
 
+typedef struct {
+    uint8_t value;
+    const char *name;
+} scenario_option_map_t;
+
+static const scenario_option_map_t k_scenario_priorities[] = {
+    {DEVICE_SCENARIO_PRIORITY_LOW, "low"},
+    {DEVICE_SCENARIO_PRIORITY_NORMAL, "normal"},
+    {DEVICE_SCENARIO_PRIORITY_HIGH, "high"},
+    {DEVICE_SCENARIO_PRIORITY_CRITICAL, "critical"},
+};
+
+static const scenario_option_map_t k_scenario_concurrency[] = {
+    {DEVICE_SCENARIO_CONCURRENCY_PARALLEL, "parallel"},
+    {DEVICE_SCENARIO_CONCURRENCY_QUEUE, "queue"},
+    {DEVICE_SCENARIO_CONCURRENCY_REPLACE, "replace"},
+    {DEVICE_SCENARIO_CONCURRENCY_DROP, "drop"},
+};
+
+static const char *option_to_string(const scenario_option_map_t *map, size_t count, uint8_t value)
+{
+    for (size_t i = 0; i < count; ++i) {
+        if (map[i].value == value) {
+            return map[i].name;
+        }
+    }
+    return NULL;
+}
+
+static bool option_from_string(const scenario_option_map_t *map, size_t count, const char *name, uint8_t *out)
+{
+    if (!name || !out) {
+        return false;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if (strcasecmp(map[i].name, name) == 0) {
+            *out = map[i].value;
+            return true;
+        }
+    }
+    return false;
+}
+
 const char *dm_condition_to_string(device_condition_type_t cond)
 {
     switch (cond) {
@@ -70,3 +115,45 @@ bool dm_action_type_from_string(const char *name, device_action_type_t *out)
     }
     return false;
 }
+
+const char *dm_scenario_priority_to_string(device_scenario_priority_t priority)
+{
+    const char *name = option_to_string(k_scenario_priorities,
+                                        sizeof(k_scenario_priorities) / sizeof(k_scenario_priorities[0]),
+                                        (uint8_t)priority);
+    return name ? name : "normal";
+}
+
+bool dm_scenario_priority_from_string(const char *name, device_scenario_priority_t *out)
+{
+    uint8_t value = 0;
+    if (!out || !option_from_string(k_scenario_priorities,
+                                    sizeof(k_scenario_priorities) / sizeof(k_scenario_priorities[0]),
+                                    name,
+                                    &value)) {
+        return false;
+    }
+    *out = (device_scenario_priority_t)value;
+    return true;
+}
+
+const char *dm_scenario_concurrency_to_string(device_scenario_concurrency_t mode)
+{
+    const char *name = option_to_string(k_scenario_concurrency,
+                                        sizeof(k_scenario_concurrency) / sizeof(k_scenario_concurrency[0]),
+                                        (uint8_t)mode);
+    return name ? name : "parallel";
+}
+
+bool dm_scenario_concurrency_from_string(const char *name, device_scenario_concurrency_t *out)
+{
+    uint8_t value = 0;
+    if (!out || !option_from_string(k_scenario_concurrency,
+                                    sizeof(k_scenario_concurrency) / sizeof(k_scenario_concurrency[0]),
+                                    name,
+                                    &value)) {
+        return false;
+    }
+    *out = (device_scenario_concurrency_t)value;
+    return true;
+}
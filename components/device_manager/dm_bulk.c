@@ -0,0 +1,343 @@
+#include "dm_bulk.h"
+
+#include <string.h>
+#include <strings.h>
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+#include "device_manager_internal.h"
+#include "device_manager_utils.h"
+#include "dm_config.h"
+#include "dm_profile_codec.h"
+#include "dm_profiles.h"
+#include "dm_storage.h"
+
+static const char *TAG = "dm_bulk";
+
+#define BULK_CHUNK_SIZE 1024
+#define BULK_KEY_MAX    24
+#define BULK_CRC_HEAD   ((DM_CBOR_MAJOR_BYTES << 5) | 4)   // the trailer, a 4-byte string
+
+static esp_err_t crc_sink(void *ctx, const char *data, size_t len)
+{
+    dm_bulk_writer_t *b = (dm_bulk_writer_t *)ctx;
+    b->crc = dm_profile_crc32(b->crc, data, len);
+    return b->sink(b->ctx, data, len);
+}
+
+void dm_bulk_writer_init(dm_bulk_writer_t *b, dm_json_sink_fn sink, void *ctx)
+{
+    b->sink = sink;
+    b->ctx = ctx;
+    b->crc = 0;
+    dm_json_writer_init_cbor(&b->w, sink ? crc_sink : NULL, b);
+}
+
+void dm_bulk_write_header(dm_bulk_writer_t *b, const char *active_profile, uint8_t count)
+{
+    dm_json_begin_object(&b->w);
+    dm_json_kv_string(&b->w, "format", DM_BULK_FORMAT);
+    dm_json_kv_number(&b->w, "version", DM_BULK_VERSION);
+    dm_json_kv_string(&b->w, "active_profile", active_profile);
+    dm_json_kv_number(&b->w, "count", count);
+    dm_json_end_object(&b->w);
+}
+
+esp_err_t dm_bulk_writer_finish(dm_bulk_writer_t *b)
+{
+    esp_err_t err = dm_json_writer_finish(&b->w);
+    if (err != ESP_OK) {
+        return err;
+    }
+    uint8_t trailer[DM_BULK_TRAILER_SIZE] = {
+        BULK_CRC_HEAD,
+        (uint8_t)(b->crc >> 24), (uint8_t)(b->crc >> 16), (uint8_t)(b->crc >> 8), (uint8_t)b->crc,
+    };
+    return b->sink(b->ctx, (const char *)trailer, sizeof(trailer));
+}
+
+void dm_bulk_reader_init(dm_bulk_reader_t *r, dm_json_event_fn on_event, void *ctx)
+{
+    dm_cbor_reader_init(&r->cbor, on_event, ctx);
+    r->crc = 0;
+    r->tail_len = 0;
+}
+
+static esp_err_t pass_on(dm_bulk_reader_t *r, const uint8_t *data, size_t len)
+{
+    if (!len) {
+        return r->cbor.err;
+    }
+    r->crc = dm_profile_crc32(r->crc, data, len);
+    return dm_cbor_reader_feed(&r->cbor, data, len);
+}
+
+esp_err_t dm_bulk_reader_feed(dm_bulk_reader_t *r, const uint8_t *data, size_t len)
+{
+    esp_err_t err;
+    if (len >= DM_BULK_TRAILER_SIZE) {
+        err = pass_on(r, r->tail, r->tail_len);
+        if (err == ESP_OK) {
+            err = pass_on(r, data, len - DM_BULK_TRAILER_SIZE);
+        }
+        memcpy(r->tail, data + len - DM_BULK_TRAILER_SIZE, DM_BULK_TRAILER_SIZE);
+        r->tail_len = DM_BULK_TRAILER_SIZE;
+        return err;
+    }
+    size_t over = r->tail_len + len > DM_BULK_TRAILER_SIZE ? r->tail_len + len - DM_BULK_TRAILER_SIZE : 0;
+    err = pass_on(r, r->tail, over);
+    memmove(r->tail, r->tail + over, r->tail_len - over);
+    r->tail_len -= (uint8_t)over;
+    memcpy(r->tail + r->tail_len, data, len);
+    r->tail_len += (uint8_t)len;
+    return err;
+}
+
+esp_err_t dm_bulk_reader_finish(dm_bulk_reader_t *r)
+{
+    esp_err_t err = dm_cbor_reader_finish(&r->cbor);
+    if (err != ESP_OK) {
+        return err;
+    }
+    uint32_t crc = r->tail_len == DM_BULK_TRAILER_SIZE ?
+                   ((uint32_t)r->tail[1] << 24 | (uint32_t)r->tail[2] << 16 | (uint32_t)r->tail[3] << 8 | r->tail[4]) : 0;
+    if (r->tail_len != DM_BULK_TRAILER_SIZE || r->tail[0] != BULK_CRC_HEAD || crc != r->crc) {
+        return ESP_ERR_INVALID_CRC;
+    }
+    return ESP_OK;
+}
+
+esp_err_t dm_bulk_export(const device_manager_config_t *cfg, dm_json_sink_fn sink, void *ctx)
+{
+    if (!cfg || !sink) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    dm_bulk_writer_t *b = heap_caps_malloc(sizeof(*b), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!b) {
+        return ESP_ERR_NO_MEM;
+    }
+    const char *active = cfg->active_profile[0] ? cfg->active_profile : DM_DEFAULT_PROFILE_ID;
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < cfg->profile_count && i < DEVICE_MANAGER_MAX_PROFILES; ++i) {
+        count += cfg->profiles[i].id[0] ? 1 : 0;
+    }
+    dm_bulk_writer_init(b, sink, ctx);
+    dm_bulk_write_header(b, active, count);
+    // Inactive profiles are loaded into one scratch config, one after another.
+    device_manager_config_t *scratch = NULL;
+    esp_err_t err = ESP_OK;
+    for (uint8_t i = 0; i < cfg->profile_count && i < DEVICE_MANAGER_MAX_PROFILES && err == ESP_OK; ++i) {
+        const device_manager_profile_t *profile = &cfg->profiles[i];
+        if (!profile->id[0]) {
+            continue;
+        }
+        if (strcasecmp(profile->id, active) == 0) {
+            dm_storage_write_config(&b->w, cfg);
+            err = b->w.err;
+            continue;
+        }
+        if (!scratch) {
+            scratch = dm_config_create(0);
+            if (!scratch) {
+                err = ESP_ERR_NO_MEM;
+                break;
+            }
+            scratch->schema_version = cfg->schema_version;
+            scratch->generation = cfg->generation;
+            scratch->profile_count = cfg->profile_count;
+            memcpy(scratch->profiles, cfg->profiles, sizeof(scratch->profiles));
+        }
+        err = dm_profiles_load_profile(profile->id, scratch);
+        if (err == ESP_ERR_NOT_FOUND) {
+            err = ESP_OK;   // never saved, so it has no devices
+        }
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "profile %s unreadable: %s", profile->id, esp_err_to_name(err));
+            break;
+        }
+        dm_str_copy(scratch->active_profile, sizeof(scratch->active_profile), profile->id);
+        dm_storage_write_config(&b->w, scratch);
+        err = b->w.err;
+        feed_wdt();
+    }
+    if (err == ESP_OK) {
+        err = dm_bulk_writer_finish(b);
+    }
+    dm_config_destroy(scratch);
+    heap_caps_free(b);
+    return err;
+}
+
+typedef struct {
+    dm_bulk_reader_t reader;
+    dm_bulk_set_t set;
+    uint32_t item;              // top-level item being read: 0 is the header
+    uint8_t depth;
+    dm_config_builder_t *builder;
+    char key[BULK_KEY_MAX];
+    struct {
+        bool format_ok;
+        uint32_t version;
+        uint32_t count;
+    } header;
+    char chunk[BULK_CHUNK_SIZE];
+} bulk_import_t;
+
+static esp_err_t header_event(bulk_import_t *imp, dm_json_event_t event, const dm_json_value_t *value)
+{
+    if (imp->depth != 1) {
+        return ESP_OK;  // members this version does not know
+    }
+    if (event == DM_JSON_EVENT_KEY) {
+        dm_str_copy(imp->key, sizeof(imp->key), value->str);
+    } else if (event == DM_JSON_EVENT_STRING && strcmp(imp->key, "format") == 0) {
+        imp->header.format_ok = strcmp(value->str, DM_BULK_FORMAT) == 0;
+    } else if (event == DM_JSON_EVENT_STRING && strcmp(imp->key, "active_profile") == 0) {
+        dm_str_copy(imp->set.active_profile, sizeof(imp->set.active_profile), value->str);
+    } else if (event == DM_JSON_EVENT_NUMBER && strcmp(imp->key, "version") == 0) {
+        imp->header.version = value->number > 0 ? (uint32_t)value->number : 0;
+    } else if (event == DM_JSON_EVENT_NUMBER && strcmp(imp->key, "count") == 0) {
+        imp->header.count = value->number > 0 ? (uint32_t)value->number : 0;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t header_done(bulk_import_t *imp)
+{
+    if (!imp->header.format_ok) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (imp->header.version != DM_BULK_VERSION) {
+        ESP_LOGW(TAG, "bulk format version %u not supported", (unsigned)imp->header.version);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (imp->header.count == 0 || imp->header.count > DEVICE_MANAGER_MAX_PROFILES) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t document_begin(bulk_import_t *imp)
+{
+    if (imp->item > imp->header.count) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    device_manager_config_t *cfg = dm_config_create(0);
+    if (!cfg) {
+        return ESP_ERR_NO_MEM;
+    }
+    imp->set.profiles[imp->set.count++] = cfg;
+    imp->builder = dm_config_builder_create(cfg);
+    return imp->builder ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+static esp_err_t document_done(bulk_import_t *imp)
+{
+    esp_err_t err = dm_config_builder_finish(imp->builder);
+    dm_config_builder_destroy(imp->builder);
+    imp->builder = NULL;
+    if (err != ESP_OK) {
+        return err;
+    }
+    const device_manager_config_t *cfg = imp->set.profiles[imp->set.count - 1];
+    for (uint8_t i = 0; i + 1 < imp->set.count; ++i) {
+        if (strcasecmp(imp->set.profiles[i]->active_profile, cfg->active_profile) == 0) {
+            ESP_LOGW(TAG, "profile %s given twice", cfg->active_profile);
+            return ESP_ERR_INVALID_STATE;
+        }
+    }
+    return dm_profiles_id_valid(cfg->active_profile) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+static esp_err_t import_event(void *ctx, dm_json_event_t event, const dm_json_value_t *value)
+{
+    bulk_import_t *imp = (bulk_import_t *)ctx;
+    esp_err_t err = ESP_OK;
+    if (imp->depth == 0) {
+        // Every item of the sequence is a map.
+        if (event != DM_JSON_EVENT_OBJECT_BEGIN) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        if (imp->item > 0 && (err = document_begin(imp)) != ESP_OK) {
+            return err;
+        }
+    }
+    if (event == DM_JSON_EVENT_OBJECT_BEGIN || event == DM_JSON_EVENT_ARRAY_BEGIN) {
+        imp->depth++;
+    }
+    err = imp->item > 0 ? dm_config_builder_event(imp->builder, event, value) : header_event(imp, event, value);
+    if (err != ESP_OK || (event != DM_JSON_EVENT_OBJECT_END && event != DM_JSON_EVENT_ARRAY_END)) {
+        return err;
+    }
+    if (--imp->depth) {
+        return ESP_OK;
+    }
+    err = imp->item > 0 ? document_done(imp) : header_done(imp);
+    imp->item++;
+    return err;
+}
+
+void dm_bulk_set_free(dm_bulk_set_t *set)
+{
+    if (!set) {
+        return;
+    }
+    for (uint8_t i = 0; i < set->count; ++i) {
+        dm_config_destroy(set->profiles[i]);
+    }
+    memset(set, 0, sizeof(*set));
+}
+
+esp_err_t dm_bulk_import(dm_json_source_fn source, void *ctx, dm_bulk_set_t *out)
+{
+    if (!source || !out) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(out, 0, sizeof(*out));
+    // Touched for every input byte, so internal RAM first; the configs go to PSRAM.
+    bulk_import_t *imp = heap_caps_calloc(1, sizeof(*imp), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!imp) {
+        imp = heap_caps_calloc(1, sizeof(*imp), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    }
+    if (!imp) {
+        return ESP_ERR_NO_MEM;
+    }
+    dm_bulk_reader_init(&imp->reader, import_event, imp);
+    esp_err_t err = ESP_OK;
+    for (;;) {
+        size_t got = 0;
+        err = source(ctx, imp->chunk, sizeof(imp->chunk), &got);
+        if (err != ESP_OK || got == 0) {
+            break;
+        }
+        err = dm_bulk_reader_feed(&imp->reader, (const uint8_t *)imp->chunk, got);
+        if (err != ESP_OK) {
+            break;
+        }
+        feed_wdt();
+    }
+    if (err == ESP_OK) {
+        err = dm_bulk_reader_finish(&imp->reader);
+    }
+    if (err == ESP_OK && imp->item != imp->header.count + 1) {
+        err = ESP_ERR_INVALID_SIZE;
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "bulk import rejected at byte %u: %s", (unsigned)imp->reader.cbor.offset, esp_err_to_name(err));
+        dm_config_builder_destroy(imp->builder);
+        dm_bulk_set_free(&imp->set);
+        heap_caps_free(imp);
+        return err;
+    }
+    bool active_found = false;
+    for (uint8_t i = 0; i < imp->set.count && !active_found; ++i) {
+        active_found = strcasecmp(imp->set.profiles[i]->active_profile, imp->set.active_profile) == 0;
+    }
+    if (!active_found) {
+        dm_str_copy(imp->set.active_profile, sizeof(imp->set.active_profile), imp->set.profiles[0]->active_profile);
+    }
+    *out = imp->set;
+    heap_caps_free(imp);
+    return ESP_OK;
+}
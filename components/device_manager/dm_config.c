@@ -0,0 +1,357 @@
+#include "dm_config.h"
+
+#include <string.h>
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+#include "device_manager_utils.h"
+
+#define STEP_STRINGS_MAX DEVICE_MANAGER_MAX_FLAG_RULES
+
+static const char *TAG = "dm_config";
+
+typedef struct {
+    const char **slot;
+    size_t max_len;
+} step_string_t;
+
+// String fields of the step's action type.
+static size_t step_strings(device_action_step_t *step, step_string_t out[STEP_STRINGS_MAX])
+{
+    size_t n = 0;
+    switch (step->type) {
+    case DEVICE_ACTION_MQTT_PUBLISH:
+        out[n++] = (step_string_t){&step->data.mqtt.topic, DEVICE_MANAGER_TOPIC_MAX_LEN};
+        out[n++] = (step_string_t){&step->data.mqtt.payload, DEVICE_MANAGER_PAYLOAD_MAX_LEN};
+        break;
+    case DEVICE_ACTION_AUDIO_PLAY:
+        out[n++] = (step_string_t){&step->data.audio.track, DEVICE_MANAGER_TRACK_NAME_MAX_LEN};
+        break;
+    case DEVICE_ACTION_SET_FLAG:
+        out[n++] = (step_string_t){&step->data.flag.flag, DEVICE_MANAGER_FLAG_NAME_MAX_LEN};
+        break;
+    case DEVICE_ACTION_WAIT_FLAGS: {
+        device_wait_flags_t *wait = &step->data.wait_flags;
+        if (wait->requirement_count > DEVICE_MANAGER_MAX_FLAG_RULES) {
+            wait->requirement_count = DEVICE_MANAGER_MAX_FLAG_RULES;
+        }
+        for (uint8_t i = 0; i < wait->requirement_count; ++i) {
+            out[n++] = (step_string_t){&wait->requirements[i].flag, DEVICE_MANAGER_FLAG_NAME_MAX_LEN};
+        }
+        break;
+    }
+    case DEVICE_ACTION_EVENT_BUS:
+        out[n++] = (step_string_t){&step->data.event.event, DEVICE_MANAGER_NAME_MAX_LEN};
+        out[n++] = (step_string_t){&step->data.event.topic, DEVICE_MANAGER_TOPIC_MAX_LEN};
+        out[n++] = (step_string_t){&step->data.event.payload, DEVICE_MANAGER_PAYLOAD_MAX_LEN};
+        break;
+    default:
+        break;
+    }
+    return n;
+}
+
+static esp_err_t intern_step(dm_config_arena_t *arena, device_action_step_t *step)
+{
+    step_string_t fields[STEP_STRINGS_MAX];
+    size_t n = step_strings(step, fields);
+    for (size_t i = 0; i < n; ++i) {
+        const char *pooled = dm_config_arena_intern(arena, *fields[i].slot, fields[i].max_len);
+        if (!pooled) {
+            return ESP_ERR_NO_MEM;
+        }
+        *fields[i].slot = pooled;
+    }
+    return ESP_OK;
+}
+
+// dst must not be src; the fixed part is copied as is, arrays and strings go to `arena`.
+static esp_err_t copy_device_into(dm_config_arena_t *arena, device_descriptor_t *dst, const device_descriptor_t *src)
+{
+    memcpy(dst, src, sizeof(*dst));
+    dst->scenarios = NULL;
+    dst->scenario_count = 0;
+    uint8_t scenario_count = src->scenarios ? src->scenario_count : 0;
+    if (scenario_count > DEVICE_MANAGER_MAX_SCENARIOS_PER_DEVICE) {
+        scenario_count = DEVICE_MANAGER_MAX_SCENARIOS_PER_DEVICE;
+    }
+    if (scenario_count == 0) {
+        return ESP_OK;
+    }
+    device_scenario_t *scenarios = dm_config_arena_alloc(arena, sizeof(*scenarios) * scenario_count);
+    if (!scenarios) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (uint8_t s = 0; s < scenario_count; ++s) {
+        const device_scenario_t *from = &src->scenarios[s];
+        device_scenario_t *to = &scenarios[s];
+        *to = *from;
+        to->steps = NULL;
+        to->step_count = 0;
+        uint8_t step_count = from->steps ? from->step_count : 0;
+        if (step_count > DEVICE_MANAGER_MAX_STEPS_PER_SCENARIO) {
+            step_count = DEVICE_MANAGER_MAX_STEPS_PER_SCENARIO;
+        }
+        if (step_count == 0) {
+            continue;
+        }
+        device_action_step_t *steps = dm_config_arena_alloc(arena, sizeof(*steps) * step_count);
+        if (!steps) {
+            return ESP_ERR_NO_MEM;
+        }
+        memcpy(steps, from->steps, sizeof(*steps) * step_count);
+        for (uint8_t i = 0; i < step_count; ++i) {
+            esp_err_t err = intern_step(arena, &steps[i]);
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+        to->steps = steps;
+        to->step_count = step_count;
+    }
+    dst->scenarios = scenarios;
+    dst->scenario_count = scenario_count;
+    return ESP_OK;
+}
+
+device_manager_config_t *dm_config_create(uint8_t device_capacity)
+{
+    device_manager_config_t *cfg = heap_caps_calloc(1, sizeof(*cfg), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!cfg) {
+        cfg = heap_caps_calloc(1, sizeof(*cfg), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    if (cfg && dm_config_reset_devices(cfg, device_capacity) != ESP_OK) {
+        heap_caps_free(cfg);
+        cfg = NULL;
+    }
+    return cfg;
+}
+
+void dm_config_destroy(device_manager_config_t *cfg)
+{
+    if (cfg) {
+        dm_config_arena_destroy(cfg->arena);
+        heap_caps_free(cfg);
+    }
+}
+
+esp_err_t dm_config_reset_devices(device_manager_config_t *cfg, uint8_t device_capacity)
+{
+    if (!cfg) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (device_capacity > DEVICE_MANAGER_MAX_DEVICES) {
+        device_capacity = DEVICE_MANAGER_MAX_DEVICES;
+    }
+    dm_config_arena_t *arena = dm_config_arena_create(DM_CONFIG_BUDGET_BYTES);
+    if (!arena) {
+        return ESP_ERR_NO_MEM;
+    }
+    device_descriptor_t *devices = NULL;
+    if (device_capacity > 0) {
+        devices = dm_config_arena_alloc(arena, sizeof(*devices) * device_capacity);
+        if (!devices) {
+            ESP_LOGE(TAG, "%u devices exceed the config budget (%zu bytes)", device_capacity, DM_CONFIG_BUDGET_BYTES);
+            dm_config_arena_destroy(arena);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    dm_config_arena_destroy(cfg->arena);
+    cfg->arena = arena;
+    cfg->devices = devices;
+    cfg->device_capacity = device_capacity;
+    cfg->device_count = 0;
+    return ESP_OK;
+}
+
+esp_err_t dm_config_reserve_devices(device_manager_config_t *cfg, uint8_t device_capacity)
+{
+    if (!cfg || !cfg->arena) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (device_capacity <= cfg->device_capacity) {
+        return ESP_OK;
+    }
+    if (device_capacity > DEVICE_MANAGER_MAX_DEVICES) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    device_descriptor_t *devices = dm_config_arena_grow(cfg->arena,
+                                                        cfg->devices,
+                                                        sizeof(*devices) * cfg->device_capacity,
+                                                        sizeof(*devices) * device_capacity);
+    if (!devices) {
+        return ESP_ERR_NO_MEM;
+    }
+    cfg->devices = devices;
+    cfg->device_capacity = device_capacity;
+    return ESP_OK;
+}
+
+void dm_config_trim_devices(device_manager_config_t *cfg)
+{
+    if (!cfg || !cfg->devices || cfg->device_count == 0 || cfg->device_count >= cfg->device_capacity) {
+        return;
+    }
+    size_t entry = sizeof(device_descriptor_t);
+    cfg->devices = dm_config_arena_shrink(cfg->arena,
+                                          cfg->devices,
+                                          entry * cfg->device_capacity,
+                                          entry * cfg->device_count);
+    cfg->device_capacity = cfg->device_count;
+}
+
+device_scenario_t *dm_config_alloc_scenarios(device_manager_config_t *cfg, uint8_t count)
+{
+    if (!cfg || count == 0) {
+        return NULL;
+    }
+    return dm_config_arena_alloc(cfg->arena, sizeof(device_scenario_t) * count);
+}
+
+device_action_step_t *dm_config_alloc_steps(device_manager_config_t *cfg, uint8_t count)
+{
+    if (!cfg || count == 0) {
+        return NULL;
+    }
+    return dm_config_arena_alloc(cfg->arena, sizeof(device_action_step_t) * count);
+}
+
+device_scenario_t *dm_config_add_scenario(device_manager_config_t *cfg, device_descriptor_t *dev)
+{
+    if (!cfg || !dev || dev->scenario_count >= DEVICE_MANAGER_MAX_SCENARIOS_PER_DEVICE) {
+        return NULL;
+    }
+    size_t entry = sizeof(device_scenario_t);
+    uint8_t count = dev->scenarios ? dev->scenario_count : 0;
+    device_scenario_t *scenarios =
+        dm_config_arena_grow(cfg->arena, dev->scenarios, entry * count, entry * (count + 1));
+    if (!scenarios) {
+        return NULL;
+    }
+    dev->scenarios = scenarios;
+    dev->scenario_count = count + 1;
+    return &scenarios[count];
+}
+
+device_action_step_t *dm_config_add_step(device_manager_config_t *cfg, device_scenario_t *scenario)
+{
+    if (!cfg || !scenario || scenario->step_count >= DEVICE_MANAGER_MAX_STEPS_PER_SCENARIO) {
+        return NULL;
+    }
+    size_t entry = sizeof(device_action_step_t);
+    uint8_t count = scenario->steps ? scenario->step_count : 0;
+    device_action_step_t *steps =
+        dm_config_arena_grow(cfg->arena, scenario->steps, entry * count, entry * (count + 1));
+    if (!steps) {
+        return NULL;
+    }
+    scenario->steps = steps;
+    scenario->step_count = count + 1;
+    return &steps[count];
+}
+
+const char *dm_config_str(device_manager_config_t *cfg, const char *str, size_t max_len)
+{
+    return dm_config_arena_intern(cfg ? cfg->arena : NULL, str, max_len);
+}
+
+esp_err_t dm_config_intern_step(device_manager_config_t *cfg, device_action_step_t *step)
+{
+    if (!cfg || !step) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return intern_step(cfg->arena, step);
+}
+
+esp_err_t dm_config_copy(device_manager_config_t *dest, const device_manager_config_t *src)
+{
+    if (!dest || !src) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (dest == src) {
+        return ESP_OK;
+    }
+    uint8_t count = src->device_count < src->device_capacity ? src->device_count : src->device_capacity;
+    dm_config_arena_t *arena = dm_config_arena_create(DM_CONFIG_BUDGET_BYTES);
+    if (!arena) {
+        return ESP_ERR_NO_MEM;
+    }
+    device_descriptor_t *devices = count ? dm_config_arena_alloc(arena, sizeof(*devices) * count) : NULL;
+    esp_err_t err = (count && !devices) ? ESP_ERR_NO_MEM : ESP_OK;
+    for (uint8_t i = 0; err == ESP_OK && i < count; ++i) {
+        err = copy_device_into(arena, &devices[i], &src->devices[i]);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "config copy failed: %s", esp_err_to_name(err));
+        dm_config_arena_destroy(arena);
+        return err;
+    }
+    dm_config_arena_t *old = dest->arena;
+    memcpy(dest, src, sizeof(*dest));
+    dest->refs = 0;
+    dest->arena = arena;
+    dest->devices = devices;
+    dest->device_capacity = count;
+    dest->device_count = count;
+    dm_config_arena_destroy(old);
+    return ESP_OK;
+}
+
+esp_err_t dm_config_copy_device(device_manager_config_t *cfg,
+                                device_descriptor_t *dst,
+                                const device_descriptor_t *src)
+{
+    if (!cfg || !dst || !src || dst == src) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return copy_device_into(cfg->arena, dst, src);
+}
+
+static uint64_t step_digest(const device_action_step_t *step)
+{
+    device_action_step_t copy;
+    memcpy(&copy, step, sizeof(copy));
+    step_string_t fields[STEP_STRINGS_MAX];
+    size_t n = step_strings(&copy, fields);
+    uint64_t h = n;
+    for (size_t i = 0; i < n; ++i) {
+        const char *str = *fields[i].slot ? *fields[i].slot : "";
+        h = h * 31 + dm_hash_bytes(str, strlen(str));
+        *fields[i].slot = NULL;
+    }
+    return h * 31 + dm_hash_bytes(&copy, sizeof(copy));
+}
+
+uint64_t dm_config_device_digest(const device_descriptor_t *dev, bool with_template)
+{
+    if (!dev) {
+        return 0;
+    }
+    uint64_t h = dm_hash_bytes(dev, offsetof(device_descriptor_t, scenarios));
+    for (uint8_t s = 0; dev->scenarios && s < dev->scenario_count; ++s) {
+        const device_scenario_t *sc = &dev->scenarios[s];
+        h = h * 31 + dm_hash_bytes(sc, offsetof(device_scenario_t, steps));
+        for (uint8_t i = 0; sc->steps && i < sc->step_count; ++i) {
+            h = h * 31 + step_digest(&sc->steps[i]);
+        }
+    }
+    h = h * 31 + dm_hash_bytes(dev->topic_limits, sizeof(dev->topic_limits));
+    if (with_template) {
+        h = h * 31 + dev->template_assigned;
+        h = h * 31 + dm_hash_bytes(&dev->template_config, sizeof(dev->template_config));
+    }
+    return h;
+}
+
+size_t dm_config_device_bytes(const device_descriptor_t *dev)
+{
+    if (!dev) {
+        return 0;
+    }
+    size_t bytes = sizeof(*dev);
+    for (uint8_t s = 0; dev->scenarios && s < dev->scenario_count; ++s) {
+        bytes += sizeof(device_scenario_t) + sizeof(device_action_step_t) * dev->scenarios[s].step_count;
+    }
+    return bytes;
+}
@@ -0,0 +1,297 @@
+#include "dm_config_arena.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "esp_heap_caps.h"
+
+#define ARENA_CHUNK_BYTES   4096u
+#define ARENA_ALIGN         sizeof(void *)
+#define ARENA_TABLE_MIN     64u     // string slots; power of two
+
+typedef struct dm_arena_chunk {
+    struct dm_arena_chunk *next;
+    size_t size;
+    size_t used;
+    // Data follows, aligned by the header size.
+} dm_arena_chunk_t;
+
+struct dm_config_arena {
+    dm_arena_chunk_t *head;         // newest chunk, the only one still filling
+    size_t budget;
+    size_t reserved;
+    size_t used;
+    const char **table;             // open addressing, NULL = free slot
+    uint32_t table_slots;
+    uint32_t strings;
+    size_t string_bytes;
+    uint32_t string_hits;
+};
+
+static const char s_empty[] = "";
+
+static size_t align_up(size_t n)
+{
+    return (n + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+static size_t chunk_header_size(void)
+{
+    return align_up(sizeof(dm_arena_chunk_t));
+}
+
+static uint8_t *chunk_data(dm_arena_chunk_t *chunk)
+{
+    return (uint8_t *)chunk + chunk_header_size();
+}
+
+static void *arena_heap_alloc(size_t size)
+{
+    void *ptr = heap_caps_calloc(1, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!ptr) {
+        ptr = heap_caps_calloc(1, size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    return ptr;
+}
+
+dm_config_arena_t *dm_config_arena_create(size_t budget)
+{
+    dm_config_arena_t *arena = arena_heap_alloc(sizeof(*arena));
+    if (arena) {
+        arena->budget = budget;
+        arena->reserved = sizeof(*arena);
+    }
+    return arena;
+}
+
+void dm_config_arena_destroy(dm_config_arena_t *arena)
+{
+    if (!arena) {
+        return;
+    }
+    dm_arena_chunk_t *chunk = arena->head;
+    while (chunk) {
+        dm_arena_chunk_t *next = chunk->next;
+        heap_caps_free(chunk);
+        chunk = next;
+    }
+    heap_caps_free(arena->table);
+    heap_caps_free(arena);
+}
+
+void *dm_config_arena_alloc(dm_config_arena_t *arena, size_t size)
+{
+    if (!arena) {
+        return NULL;
+    }
+    size = align_up(size ? size : 1);
+    dm_arena_chunk_t *chunk = arena->head;
+    if (!chunk || chunk->size - chunk->used < size) {
+        // Oversized blocks get a chunk of their own; the filling chunk stays current.
+        size_t data_size = size > ARENA_CHUNK_BYTES ? size : ARENA_CHUNK_BYTES;
+        size_t bytes = chunk_header_size() + data_size;
+        if (arena->reserved + bytes > arena->budget) {
+            return NULL;
+        }
+        dm_arena_chunk_t *fresh = arena_heap_alloc(bytes);
+        if (!fresh) {
+            return NULL;
+        }
+        fresh->size = data_size;
+        arena->reserved += bytes;
+        if (chunk && data_size > ARENA_CHUNK_BYTES) {
+            fresh->next = chunk->next;
+            chunk->next = fresh;
+        } else {
+            fresh->next = chunk;
+            arena->head = fresh;
+        }
+        chunk = fresh;
+    }
+    void *ptr = chunk_data(chunk) + chunk->used;
+    chunk->used += size;
+    arena->used += size;
+    return ptr;
+}
+
+// Link to the chunk that holds nothing but the block at `ptr`, NULL if it shares its chunk.
+static dm_arena_chunk_t **sole_block_link(dm_config_arena_t *arena, const void *ptr, size_t aligned)
+{
+    for (dm_arena_chunk_t **link = &arena->head; *link; link = &(*link)->next) {
+        if (chunk_data(*link) == ptr && (*link)->used == aligned) {
+            return link;
+        }
+    }
+    return NULL;
+}
+
+// Reallocates such a chunk to fit `new_aligned` bytes of data; the block may move.
+static void *resize_sole_block(dm_config_arena_t *arena, dm_arena_chunk_t **link, size_t new_aligned)
+{
+    dm_arena_chunk_t *chunk = *link;
+    size_t old_size = chunk->size;
+    size_t old_used = chunk->used;
+    if (new_aligned > old_size && arena->reserved + (new_aligned - old_size) > arena->budget) {
+        return NULL;
+    }
+    size_t bytes = chunk_header_size() + new_aligned;
+    dm_arena_chunk_t *moved = heap_caps_realloc(chunk, bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!moved) {
+        moved = heap_caps_realloc(chunk, bytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    if (!moved) {
+        return NULL;
+    }
+    arena->reserved = arena->reserved - old_size + new_aligned;
+    arena->used = arena->used - old_used + new_aligned;
+    moved->size = new_aligned;
+    moved->used = new_aligned;
+    *link = moved;
+    return chunk_data(moved);
+}
+
+void *dm_config_arena_grow(dm_config_arena_t *arena, void *ptr, size_t old_size, size_t new_size)
+{
+    if (!ptr || old_size == 0) {
+        return dm_config_arena_alloc(arena, new_size);
+    }
+    if (!arena || new_size <= old_size) {
+        return ptr;
+    }
+    size_t old_aligned = align_up(old_size);
+    size_t new_aligned = align_up(new_size);
+    dm_arena_chunk_t *chunk = arena->head;
+    if (chunk && (uint8_t *)ptr + old_aligned == chunk_data(chunk) + chunk->used &&
+        chunk->size - chunk->used >= new_aligned - old_aligned) {
+        chunk->used += new_aligned - old_aligned;
+        arena->used += new_aligned - old_aligned;
+        memset((uint8_t *)ptr + old_size, 0, new_size - old_size);
+        return ptr;
+    }
+    // A block with a chunk of its own (a large device array) is resized without a second copy.
+    dm_arena_chunk_t **link = sole_block_link(arena, ptr, old_aligned);
+    if (link) {
+        uint8_t *moved = resize_sole_block(arena, link, new_aligned);
+        if (moved) {
+            memset(moved + old_size, 0, new_size - old_size);
+        }
+        return moved;
+    }
+    void *fresh = dm_config_arena_alloc(arena, new_size);
+    if (fresh) {
+        memcpy(fresh, ptr, old_size);
+    }
+    return fresh;
+}
+
+void *dm_config_arena_shrink(dm_config_arena_t *arena, void *ptr, size_t old_size, size_t new_size)
+{
+    if (!arena || !ptr || new_size == 0 || new_size >= old_size) {
+        return ptr;
+    }
+    size_t old_aligned = align_up(old_size);
+    size_t new_aligned = align_up(new_size);
+    if (new_aligned == old_aligned) {
+        return ptr;
+    }
+    dm_arena_chunk_t *chunk = arena->head;
+    if (chunk && (uint8_t *)ptr + old_aligned == chunk_data(chunk) + chunk->used) {
+        chunk->used -= old_aligned - new_aligned;
+        arena->used -= old_aligned - new_aligned;
+        return ptr;
+    }
+    dm_arena_chunk_t **link = sole_block_link(arena, ptr, old_aligned);
+    void *moved = link ? resize_sole_block(arena, link, new_aligned) : NULL;
+    return moved ? moved : ptr;
+}
+
+static uint32_t hash_text(const char *str, size_t len)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (uint8_t)str[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static bool table_grow(dm_config_arena_t *arena)
+{
+    uint32_t slots = arena->table_slots ? arena->table_slots * 2 : ARENA_TABLE_MIN;
+    size_t bytes = sizeof(const char *) * slots;
+    size_t old_bytes = sizeof(const char *) * arena->table_slots;
+    if (arena->reserved - old_bytes + bytes > arena->budget) {
+        return false;
+    }
+    const char **table = arena_heap_alloc(bytes);
+    if (!table) {
+        return false;
+    }
+    for (uint32_t i = 0; i < arena->table_slots; ++i) {
+        const char *str = arena->table[i];
+        if (!str) {
+            continue;
+        }
+        uint32_t idx = hash_text(str, strlen(str)) & (slots - 1);
+        while (table[idx]) {
+            idx = (idx + 1) & (slots - 1);
+        }
+        table[idx] = str;
+    }
+    heap_caps_free(arena->table);
+    arena->table = table;
+    arena->table_slots = slots;
+    arena->reserved = arena->reserved - old_bytes + bytes;
+    return true;
+}
+
+const char *dm_config_arena_intern(dm_config_arena_t *arena, const char *str, size_t max_len)
+{
+    if (!str || !str[0] || max_len <= 1) {
+        return s_empty;
+    }
+    if (!arena) {
+        return NULL;
+    }
+    size_t len = strnlen(str, max_len - 1);
+    // Keep the load factor under 3/4 so probes stay short.
+    if ((arena->strings + 1) * 4 > arena->table_slots * 3 && !table_grow(arena)) {
+        return NULL;
+    }
+    uint32_t mask = arena->table_slots - 1;
+    uint32_t idx = hash_text(str, len) & mask;
+    while (arena->table[idx]) {
+        const char *cur = arena->table[idx];
+        if (strncmp(cur, str, len) == 0 && cur[len] == 0) {
+            arena->string_hits++;
+            return cur;
+        }
+        idx = (idx + 1) & mask;
+    }
+    char *copy = dm_config_arena_alloc(arena, len + 1);
+    if (!copy) {
+        return NULL;
+    }
+    memcpy(copy, str, len);
+    arena->table[idx] = copy;
+    arena->strings++;
+    arena->string_bytes += len + 1;
+    return copy;
+}
+
+void dm_config_arena_get_stats(const dm_config_arena_t *arena, dm_config_arena_stats_t *out)
+{
+    if (!out) {
+        return;
+    }
+    memset(out, 0, sizeof(*out));
+    if (!arena) {
+        return;
+    }
+    out->budget = arena->budget;
+    out->reserved = arena->reserved;
+    out->used = arena->used;
+    out->strings = arena->strings;
+    out->string_bytes = arena->string_bytes;
+    out->string_hits = arena->string_hits;
+}
@@ -0,0 +1,154 @@
+#include "dm_persist.h"
+
+#include <inttypes.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_check.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "dm_profiles.h"
+#include "dm_storage.h"
+
+#define DM_PERSIST_TASK_STACK    6144
+#define DM_PERSIST_TASK_PRIO     2
+#define DM_PERSIST_SETTLE_MS     300u     // applies arriving within this window share one write
+#define DM_PERSIST_RETRY_MIN_MS  1000u
+#define DM_PERSIST_RETRY_MAX_MS  30000u
+
+static const char *TAG = "dm_persist";
+
+static TaskHandle_t s_task;
+static SemaphoreHandle_t s_io_lock;     // one writer of the config files at a time
+static portMUX_TYPE s_status_mux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t s_persisted_generation;
+static uint32_t s_writes;
+static uint32_t s_failures;
+static uint32_t s_requests;
+static esp_err_t s_last_error = ESP_OK;
+
+static esp_err_t write_config(const device_manager_config_t *cfg)
+{
+    esp_err_t err = dm_profiles_store_active(cfg);
+    if (err == ESP_OK) {
+        err = dm_storage_save(DM_CONFIG_BACKUP_PATH, cfg);
+    }
+    return err;
+}
+
+esp_err_t dm_persist_flush(void)
+{
+    if (!s_io_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(s_io_lock, portMAX_DELAY);
+    const device_manager_config_t *cfg = device_manager_acquire_config();
+    esp_err_t err = ESP_OK;
+    if (cfg && cfg->generation != s_persisted_generation) {
+        int64_t start_us = esp_timer_get_time();
+        err = write_config(cfg);
+        portENTER_CRITICAL(&s_status_mux);
+        if (err == ESP_OK) {
+            s_persisted_generation = cfg->generation;
+            s_writes++;
+        } else {
+            s_failures++;
+        }
+        s_last_error = err;
+        portEXIT_CRITICAL(&s_status_mux);
+        if (err == ESP_OK) {
+            ESP_LOGI(TAG, "generation %" PRIu32 " written in %lld ms",
+                     cfg->generation,
+                     (long long)((esp_timer_get_time() - start_us) / 1000));
+        } else {
+            ESP_LOGW(TAG, "writing generation %" PRIu32 " failed: %s", cfg->generation, esp_err_to_name(err));
+        }
+    }
+    device_manager_release_config(cfg);
+    xSemaphoreGive(s_io_lock);
+    return err;
+}
+
+static void persist_task(void *arg)
+{
+    uint32_t retry_ms = 0;
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, retry_ms ? pdMS_TO_TICKS(retry_ms) : portMAX_DELAY);
+        vTaskDelay(pdMS_TO_TICKS(DM_PERSIST_SETTLE_MS));
+        ulTaskNotifyTake(pdTRUE, 0);
+        if (dm_persist_flush() == ESP_OK) {
+            retry_ms = 0;
+        } else {
+            // SD card busy, full or pulled: keep the newest generation and try again later.
+            retry_ms = retry_ms ? retry_ms * 2 : DM_PERSIST_RETRY_MIN_MS;
+            if (retry_ms > DM_PERSIST_RETRY_MAX_MS) {
+                retry_ms = DM_PERSIST_RETRY_MAX_MS;
+            }
+        }
+    }
+}
+
+esp_err_t dm_persist_start(uint32_t persisted_generation)
+{
+    if (!s_io_lock) {
+        s_io_lock = xSemaphoreCreateMutex();
+        ESP_RETURN_ON_FALSE(s_io_lock != NULL, ESP_ERR_NO_MEM, TAG, "lock alloc failed");
+    }
+    portENTER_CRITICAL(&s_status_mux);
+    s_persisted_generation = persisted_generation;
+    portEXIT_CRITICAL(&s_status_mux);
+    if (s_task) {
+        return ESP_OK;
+    }
+    BaseType_t ok = xTaskCreate(persist_task, "dm_persist", DM_PERSIST_TASK_STACK, NULL, DM_PERSIST_TASK_PRIO, &s_task);
+    ESP_RETURN_ON_FALSE(ok == pdPASS, ESP_FAIL, TAG, "task create failed");
+    return ESP_OK;
+}
+
+void dm_persist_request(void)
+{
+    portENTER_CRITICAL(&s_status_mux);
+    s_requests++;
+    portEXIT_CRITICAL(&s_status_mux);
+    if (s_task) {
+        xTaskNotifyGive(s_task);
+    } else {
+        // No task (start failed): write in the caller instead of losing the change.
+        dm_persist_flush();
+    }
+}
+
+void dm_persist_mark_clean(uint32_t generation)
+{
+    if (!s_io_lock) {
+        return;
+    }
+    xSemaphoreTake(s_io_lock, portMAX_DELAY);
+    portENTER_CRITICAL(&s_status_mux);
+    s_persisted_generation = generation;
+    s_last_error = ESP_OK;
+    portEXIT_CRITICAL(&s_status_mux);
+    xSemaphoreGive(s_io_lock);
+}
+
+void dm_persist_get_status(device_manager_persist_status_t *out)
+{
+    if (!out) {
+        return;
+    }
+    memset(out, 0, sizeof(*out));
+    const device_manager_config_t *cfg = device_manager_acquire_config();
+    out->generation = cfg ? cfg->generation : 0;
+    device_manager_release_config(cfg);
+    portENTER_CRITICAL(&s_status_mux);
+    out->persisted_generation = s_persisted_generation;
+    out->writes = s_writes;
+    out->failures = s_failures;
+    out->requests = s_requests;
+    out->last_error = s_last_error;
+    portEXIT_CRITICAL(&s_status_mux);
+    out->persist_pending = out->generation != out->persisted_generation;
+}
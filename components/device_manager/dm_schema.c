@@ -0,0 +1,457 @@
+#include "dm_schema.h"
+
+#include <string.h>
+#include <strings.h>
+
+#include "esp_log.h"
+
+#include "device_manager_internal.h"
+#include "dm_payload_match.h"
+
+static const char *TAG = "dm_schema";
+
+#define MEMBER_SIZE(type, member) sizeof(((type *)0)->member)
+#define ARRAY_LEN(type, member) (MEMBER_SIZE(type, member) / MEMBER_SIZE(type, member[0]))
+
+// Member of the record itself.
+#define FIELD(key, kind, type, member, flags) \
+    {key, kind, flags, 0, offsetof(type, member), 0, MEMBER_SIZE(type, member), 0, NULL}
+#define FIELD_ENUM(key, type, member, names, flags) \
+    {key, DM_FIELD_ENUM, flags, 0, offsetof(type, member), 0, MEMBER_SIZE(type, member), 0, &names}
+#define FIELD_LIST(key, type, array, count, record, flags)                                \
+    {key, DM_FIELD_LIST, flags, ARRAY_LEN(type, array), offsetof(type, array), 0,        \
+     MEMBER_SIZE(type, array[0]), offsetof(type, count), &record}
+
+// Member of entry `index` of `array`.
+#define ENTRY(key, kind, type, array, member, flags)                                      \
+    {key, kind, flags, 0, offsetof(type, array[0].member), MEMBER_SIZE(type, array[0]),  \
+     MEMBER_SIZE(type, array[0].member), 0, NULL}
+#define ENTRY_WHOLE(key, kind, type, array, flags) \
+    {key, kind, flags, 0, offsetof(type, array), MEMBER_SIZE(type, array[0]), MEMBER_SIZE(type, array[0]), 0, NULL}
+#define ENTRY_ENUM(key, type, array, member, names, flags)                                      \
+    {key, DM_FIELD_ENUM, flags, 0, offsetof(type, array[0].member), MEMBER_SIZE(type, array[0]), \
+     MEMBER_SIZE(type, array[0].member), 0, &names}
+#define ENTRY_FLOAT(key, type, array, member, given, flags)                                       \
+    {key, DM_FIELD_FLOAT, flags, 0, offsetof(type, array[0].member), MEMBER_SIZE(type, array[0]), \
+     MEMBER_SIZE(type, array[0].member), offsetof(type, array[0].given), NULL}
+#define ENTRY_STRS(key, type, array, member, count, flags)                                 \
+    {key, DM_FIELD_STRS, flags, ARRAY_LEN(type, array[0].member),                          \
+     offsetof(type, array[0].member), MEMBER_SIZE(type, array[0]),                          \
+     MEMBER_SIZE(type, array[0].member[0]), offsetof(type, array[0].count), NULL}
+
+#define RECORD(fields, check) {fields, sizeof(fields) / sizeof((fields)[0]), check}
+
+// int-typed views of the typed name helpers.
+#define FIELD_NAMES(name, type, to_fn, from_fn)                      \
+    static const char *name##_to_string(int value)                  \
+    {                                                                \
+        return to_fn((type)value);                                   \
+    }                                                                \
+    static bool name##_from_string(const char *str, int *out)       \
+    {                                                                \
+        type value;                                                  \
+        if (!from_fn(str, &value)) {                                 \
+            return false;                                            \
+        }                                                            \
+        *out = (int)value;                                           \
+        return true;                                                 \
+    }                                                                \
+    static const dm_field_names_t name = {name##_to_string, name##_from_string};
+
+FIELD_NAMES(k_condition_names, device_condition_type_t, dm_condition_to_string, dm_condition_from_string)
+FIELD_NAMES(k_match_names, dm_mqtt_match_op_t, dm_mqtt_match_op_to_string, dm_mqtt_match_op_from_string)
+FIELD_NAMES(k_priority_names, device_scenario_priority_t, dm_scenario_priority_to_string,
+            dm_scenario_priority_from_string)
+FIELD_NAMES(k_concurrency_names, device_scenario_concurrency_t, dm_scenario_concurrency_to_string,
+            dm_scenario_concurrency_from_string)
+
+// Tables are in export order.
+
+static const dm_field_t k_uid_slot_fields[] = {
+    ENTRY("source_id", DM_FIELD_STR, dm_uid_template_t, slots, source_id, DM_FIELD_ALWAYS | DM_FIELD_REQUIRED),
+    ENTRY("label", DM_FIELD_STR, dm_uid_template_t, slots, label, 0),
+    ENTRY_STRS("values", dm_uid_template_t, slots, values, value_count, DM_FIELD_ALWAYS),
+};
+static const dm_record_t k_uid_slot_record = RECORD(k_uid_slot_fields, NULL);
+
+static const dm_field_t k_uid_fields[] = {
+    FIELD_LIST("slots", dm_uid_template_t, slots, slot_count, k_uid_slot_record,
+               DM_FIELD_ALWAYS | DM_FIELD_REQUIRED),
+    FIELD("start_topic", DM_FIELD_STR, dm_uid_template_t, start_topic, 0),
+    FIELD("start_payload", DM_FIELD_STR, dm_uid_template_t, start_payload, 0),
+    FIELD("start_limit", DM_FIELD_LIMIT, dm_uid_template_t, start_limit, 0),
+    FIELD("broadcast_topic", DM_FIELD_STR, dm_uid_template_t, broadcast_topic, 0),
+    FIELD("broadcast_payload", DM_FIELD_STR, dm_uid_template_t, broadcast_payload, 0),
+    FIELD("success_topic", DM_FIELD_STR, dm_uid_template_t, success_topic, 0),
+    FIELD("success_payload", DM_FIELD_STR, dm_uid_template_t, success_payload, 0),
+    FIELD("fail_topic", DM_FIELD_STR, dm_uid_template_t, fail_topic, 0),
+    FIELD("fail_payload", DM_FIELD_STR, dm_uid_template_t, fail_payload, 0),
+    FIELD("success_audio_track", DM_FIELD_STR, dm_uid_template_t, success_audio_track, 0),
+    FIELD("fail_audio_track", DM_FIELD_STR, dm_uid_template_t, fail_audio_track, 0),
+    FIELD("success_signal_topic", DM_FIELD_STR, dm_uid_template_t, success_signal_topic, 0),
+    FIELD("success_signal_payload", DM_FIELD_STR, dm_uid_template_t, success_signal_payload, 0),
+    FIELD("fail_signal_topic", DM_FIELD_STR, dm_uid_template_t, fail_signal_topic, 0),
+    FIELD("fail_signal_payload", DM_FIELD_STR, dm_uid_template_t, fail_signal_payload, 0),
+};
+
+static const dm_field_t k_signal_fields[] = {
+    FIELD("signal_topic", DM_FIELD_STR, dm_signal_hold_template_t, signal_topic, DM_FIELD_REQUIRED),
+    FIELD("signal_payload_on", DM_FIELD_STR, dm_signal_hold_template_t, signal_payload_on, 0),
+    FIELD("signal_payload_off", DM_FIELD_STR, dm_signal_hold_template_t, signal_payload_off, 0),
+    FIELD("signal_on_ms", DM_FIELD_U32, dm_signal_hold_template_t, signal_on_ms, DM_FIELD_ALWAYS),
+    FIELD("heartbeat_topic", DM_FIELD_STR, dm_signal_hold_template_t, heartbeat_topic, DM_FIELD_REQUIRED),
+    FIELD("reset_topic", DM_FIELD_STR, dm_signal_hold_template_t, reset_topic, 0),
+    FIELD("required_hold_ms", DM_FIELD_U32, dm_signal_hold_template_t, required_hold_ms,
+          DM_FIELD_ALWAYS | DM_FIELD_REQUIRED),
+    FIELD("heartbeat_timeout_ms", DM_FIELD_U32, dm_signal_hold_template_t, heartbeat_timeout_ms, DM_FIELD_ALWAYS),
+    FIELD("hold_track", DM_FIELD_STR, dm_signal_hold_template_t, hold_track, 0),
+    FIELD("hold_track_loop", DM_FIELD_BOOL, dm_signal_hold_template_t, hold_track_loop, DM_FIELD_ALWAYS),
+    FIELD("complete_track", DM_FIELD_STR, dm_signal_hold_template_t, complete_track, 0),
+};
+
+// A rule spans rules[i], matches[i] and limits[i].
+static const dm_field_t k_mqtt_rule_fields[] = {
+    ENTRY("name", DM_FIELD_STR, dm_mqtt_trigger_template_t, rules, name, 0),
+    ENTRY("topic", DM_FIELD_STR, dm_mqtt_trigger_template_t, rules, topic, DM_FIELD_ALWAYS | DM_FIELD_REQUIRED),
+    ENTRY("payload", DM_FIELD_STR, dm_mqtt_trigger_template_t, rules, payload, 0),
+    ENTRY("payload_required", DM_FIELD_BOOL, dm_mqtt_trigger_template_t, rules, payload_required, DM_FIELD_FOLLOWS),
+    ENTRY_ENUM("match", dm_mqtt_trigger_template_t, matches, op, k_match_names, DM_FIELD_STRICT),
+    ENTRY("field", DM_FIELD_STR, dm_mqtt_trigger_template_t, matches, field, 0),
+    ENTRY_FLOAT("min", dm_mqtt_trigger_template_t, matches, min, has_min, 0),
+    ENTRY_FLOAT("max", dm_mqtt_trigger_template_t, matches, max, has_max, 0),
+    ENTRY_WHOLE("limit", DM_FIELD_LIMIT, dm_mqtt_trigger_template_t, limits, 0),
+    ENTRY("scenario", DM_FIELD_STR, dm_mqtt_trigger_template_t, rules, scenario, DM_FIELD_ALWAYS | DM_FIELD_REQUIRED),
+};
+
+// The payload condition must compile, or the rule could never fire.
+static bool mqtt_rule_check(const void *base, uint8_t index)
+{
+    const dm_mqtt_trigger_template_t *tpl = (const dm_mqtt_trigger_template_t *)base;
+    dm_payload_program_t probe;
+    if (dm_payload_program_compile(&probe, &tpl->rules[index], &tpl->matches[index]) != ESP_OK) {
+        ESP_LOGW(TAG, "mqtt rule %s: invalid field path '%s'", tpl->rules[index].topic, tpl->matches[index].field);
+        return false;
+    }
+    return true;
+}
+static const dm_record_t k_mqtt_rule_record = RECORD(k_mqtt_rule_fields, mqtt_rule_check);
+
+static const dm_field_t k_mqtt_fields[] = {
+    FIELD_LIST("rules", dm_mqtt_trigger_template_t, rules, rule_count, k_mqtt_rule_record,
+               DM_FIELD_ALWAYS | DM_FIELD_REQUIRED),
+};
+
+static const dm_field_t k_flag_rule_fields[] = {
+    ENTRY("name", DM_FIELD_STR, dm_flag_trigger_template_t, rules, name, 0),
+    ENTRY("flag", DM_FIELD_STR, dm_flag_trigger_template_t, rules, flag, DM_FIELD_ALWAYS | DM_FIELD_REQUIRED),
+    ENTRY("state", DM_FIELD_BOOL, dm_flag_trigger_template_t, rules, required_state,
+          DM_FIELD_ALWAYS | DM_FIELD_DEFAULT_ON),
+    ENTRY_WHOLE("limit", DM_FIELD_LIMIT, dm_flag_trigger_template_t, limits, 0),
+    ENTRY("scenario", DM_FIELD_STR, dm_flag_trigger_template_t, rules, scenario, DM_FIELD_ALWAYS | DM_FIELD_REQUIRED),
+};
+static const dm_record_t k_flag_rule_record = RECORD(k_flag_rule_fields, NULL);
+
+static const dm_field_t k_flag_fields[] = {
+    FIELD_LIST("rules", dm_flag_trigger_template_t, rules, rule_count, k_flag_rule_record,
+               DM_FIELD_ALWAYS | DM_FIELD_REQUIRED),
+};
+
+static const dm_field_t k_condition_rule_fields[] = {
+    ENTRY("flag", DM_FIELD_STR, dm_condition_template_t, rules, flag, DM_FIELD_ALWAYS | DM_FIELD_REQUIRED),
+    ENTRY("state", DM_FIELD_BOOL, dm_condition_template_t, rules, required_state,
+          DM_FIELD_ALWAYS | DM_FIELD_DEFAULT_ON),
+};
+static const dm_record_t k_condition_rule_record = RECORD(k_condition_rule_fields, NULL);
+
+static const dm_field_t k_condition_fields[] = {
+    FIELD_ENUM("mode", dm_condition_template_t, mode, k_condition_names, DM_FIELD_ALWAYS),
+    FIELD("true_scenario", DM_FIELD_STR, dm_condition_template_t, true_scenario, DM_FIELD_REQUIRED),
+    FIELD("false_scenario", DM_FIELD_STR, dm_condition_template_t, false_scenario, 0),
+    FIELD_LIST("rules", dm_condition_template_t, rules, rule_count, k_condition_rule_record,
+               DM_FIELD_ALWAYS | DM_FIELD_REQUIRED),
+};
+
+static const dm_field_t k_interval_fields[] = {
+    FIELD("interval_ms", DM_FIELD_U32, dm_interval_task_template_t, interval_ms, DM_FIELD_ALWAYS | DM_FIELD_REQUIRED),
+    FIELD("scenario", DM_FIELD_STR, dm_interval_task_template_t, scenario, DM_FIELD_REQUIRED),
+};
+
+static const dm_field_t k_sequence_step_fields[] = {
+    ENTRY("topic", DM_FIELD_STR, dm_sequence_template_t, steps, topic, DM_FIELD_ALWAYS | DM_FIELD_REQUIRED),
+    ENTRY("payload", DM_FIELD_STR, dm_sequence_template_t, steps, payload, 0),
+    ENTRY("payload_required", DM_FIELD_BOOL, dm_sequence_template_t, steps, payload_required, DM_FIELD_ALWAYS),
+    ENTRY("hint_topic", DM_FIELD_STR, dm_sequence_template_t, steps, hint_topic, 0),
+    ENTRY("hint_payload", DM_FIELD_STR, dm_sequence_template_t, steps, hint_payload, 0),
+    ENTRY("hint_audio_track", DM_FIELD_STR, dm_sequence_template_t, steps, hint_audio_track, 0),
+};
+static const dm_record_t k_sequence_step_record = RECORD(k_sequence_step_fields, NULL);
+
+static const dm_field_t k_sequence_fields[] = {
+    FIELD_LIST("steps", dm_sequence_template_t, steps, step_count, k_sequence_step_record,
+               DM_FIELD_ALWAYS | DM_FIELD_REQUIRED),
+    FIELD("timeout_ms", DM_FIELD_U32, dm_sequence_template_t, timeout_ms, 0),
+    FIELD("reset_on_error", DM_FIELD_BOOL, dm_sequence_template_t, reset_on_error, DM_FIELD_ALWAYS),
+    FIELD("success_topic", DM_FIELD_STR, dm_sequence_template_t, success_topic, 0),
+    FIELD("success_payload", DM_FIELD_STR, dm_sequence_template_t, success_payload, 0),
+    FIELD("success_audio_track", DM_FIELD_STR, dm_sequence_template_t, success_audio_track, 0),
+    FIELD("success_scenario", DM_FIELD_STR, dm_sequence_template_t, success_scenario, 0),
+    FIELD("fail_topic", DM_FIELD_STR, dm_sequence_template_t, fail_topic, 0),
+    FIELD("fail_payload", DM_FIELD_STR, dm_sequence_template_t, fail_payload, 0),
+    FIELD("fail_audio_track", DM_FIELD_STR, dm_sequence_template_t, fail_audio_track, 0),
+    FIELD("fail_scenario", DM_FIELD_STR, dm_sequence_template_t, fail_scenario, 0),
+};
+
+static void uid_clear(dm_template_config_t *tpl)
+{
+    dm_uid_template_clear(&tpl->data.uid);
+}
+
+static void signal_clear(dm_template_config_t *tpl)
+{
+    dm_signal_template_clear(&tpl->data.signal);
+}
+
+static void mqtt_clear(dm_template_config_t *tpl)
+{
+    dm_mqtt_trigger_template_clear(&tpl->data.mqtt);
+}
+
+static void flag_clear(dm_template_config_t *tpl)
+{
+    dm_flag_trigger_template_clear(&tpl->data.flag);
+}
+
+static void condition_clear(dm_template_config_t *tpl)
+{
+    dm_condition_template_clear(&tpl->data.condition);
+}
+
+static void interval_clear(dm_template_config_t *tpl)
+{
+    dm_interval_task_template_clear(&tpl->data.interval);
+}
+
+static void sequence_clear(dm_template_config_t *tpl)
+{
+    dm_sequence_template_clear(&tpl->data.sequence);
+}
+
+static const dm_template_schema_t s_templates[DM_TEMPLATE_TYPE_COUNT] = {
+    [DM_TEMPLATE_TYPE_UID] = {DM_TEMPLATE_TYPE_UID, "uid", uid_clear, RECORD(k_uid_fields, NULL)},
+    [DM_TEMPLATE_TYPE_SIGNAL_HOLD] = {DM_TEMPLATE_TYPE_SIGNAL_HOLD, "signal", signal_clear,
+                                      RECORD(k_signal_fields, NULL)},
+    [DM_TEMPLATE_TYPE_MQTT_TRIGGER] = {DM_TEMPLATE_TYPE_MQTT_TRIGGER, "mqtt", mqtt_clear,
+                                       RECORD(k_mqtt_fields, NULL)},
+    [DM_TEMPLATE_TYPE_FLAG_TRIGGER] = {DM_TEMPLATE_TYPE_FLAG_TRIGGER, "flag", flag_clear,
+                                       RECORD(k_flag_fields, NULL)},
+    [DM_TEMPLATE_TYPE_IF_CONDITION] = {DM_TEMPLATE_TYPE_IF_CONDITION, "condition", condition_clear,
+                                       RECORD(k_condition_fields, NULL)},
+    [DM_TEMPLATE_TYPE_INTERVAL_TASK] = {DM_TEMPLATE_TYPE_INTERVAL_TASK, "interval", interval_clear,
+                                        RECORD(k_interval_fields, NULL)},
+    [DM_TEMPLATE_TYPE_SEQUENCE_LOCK] = {DM_TEMPLATE_TYPE_SEQUENCE_LOCK, "sequence", sequence_clear,
+                                        RECORD(k_sequence_fields, NULL)},
+};
+
+// Device and scenario members with a fixed layout; the rest of them are handled by hand.
+// These two tables are also the stored profile layout (dm_profile_codec.c): reordering or
+// inserting members changes the file format.
+
+static const dm_field_t k_topic_fields[] = {
+    ENTRY("name", DM_FIELD_STR, device_descriptor_t, topics, name, DM_FIELD_ALWAYS),
+    ENTRY("topic", DM_FIELD_STR, device_descriptor_t, topics, topic, DM_FIELD_ALWAYS),
+    ENTRY_WHOLE("limit", DM_FIELD_LIMIT, device_descriptor_t, topic_limits, 0),
+};
+static const dm_record_t k_topic_record = RECORD(k_topic_fields, NULL);
+
+static const dm_field_t k_device_topics =
+    FIELD_LIST("topics", device_descriptor_t, topics, topic_count, k_topic_record, DM_FIELD_ALWAYS);
+
+static const dm_field_t k_scenario_fields[] = {
+    FIELD("id", DM_FIELD_STR, device_scenario_t, id, DM_FIELD_ALWAYS),
+    FIELD("name", DM_FIELD_STR, device_scenario_t, name, DM_FIELD_ALWAYS),
+    FIELD("button_enabled", DM_FIELD_BOOL, device_scenario_t, button_enabled, DM_FIELD_ALWAYS),
+    FIELD("button_label", DM_FIELD_STR, device_scenario_t, button_label, DM_FIELD_ALWAYS),
+    FIELD_ENUM("priority", device_scenario_t, priority, k_priority_names, DM_FIELD_ALWAYS),
+    FIELD_ENUM("concurrency", device_scenario_t, concurrency, k_concurrency_names, DM_FIELD_ALWAYS),
+};
+static const dm_record_t k_scenario_record = RECORD(k_scenario_fields, NULL);
+
+const dm_template_schema_t *dm_template_schema(dm_template_type_t type)
+{
+    if ((unsigned)type >= DM_TEMPLATE_TYPE_COUNT) {
+        return NULL;
+    }
+    return &s_templates[type];
+}
+
+const dm_template_schema_t *dm_template_schema_by_section(const char *section)
+{
+    for (size_t i = 0; section && i < DM_TEMPLATE_TYPE_COUNT; ++i) {
+        if (strcasecmp(s_templates[i].section, section) == 0) {
+            return &s_templates[i];
+        }
+    }
+    return NULL;
+}
+
+const dm_field_t *dm_schema_device_topics(void)
+{
+    return &k_device_topics;
+}
+
+const dm_record_t *dm_schema_scenario(void)
+{
+    return &k_scenario_record;
+}
+
+// Keys are matched without regard to case, as the JSON importer always did.
+const dm_field_t *dm_record_find(const dm_record_t *rec, const char *key)
+{
+    for (uint8_t i = 0; i < rec->count; ++i) {
+        if (strcasecmp(rec->fields[i].key, key) == 0) {
+            return &rec->fields[i];
+        }
+    }
+    return NULL;
+}
+
+void *dm_field_ptr(const dm_field_t *field, const void *base, uint8_t index)
+{
+    return (uint8_t *)base + field->offset + (size_t)index * field->stride;
+}
+
+// String `n` of a STRS member, or the STR member itself.
+const char *dm_field_str(const dm_field_t *field, const void *base, uint8_t index, uint8_t n)
+{
+    return (const char *)dm_field_ptr(field, base, index) + (size_t)n * field->size;
+}
+
+uint8_t *dm_field_count(const dm_field_t *field, const void *base, uint8_t index)
+{
+    return (uint8_t *)base + field->aux + (size_t)index * field->stride;
+}
+
+int dm_field_get_int(const dm_field_t *field, const void *base, uint8_t index)
+{
+    const void *p = dm_field_ptr(field, base, index);
+    if (field->size == sizeof(uint8_t)) {
+        return *(const uint8_t *)p;
+    }
+    int32_t v;
+    memcpy(&v, p, sizeof(v));
+    return (int)v;
+}
+
+void dm_field_set_int(const dm_field_t *field, void *base, uint8_t index, int value)
+{
+    void *p = dm_field_ptr(field, base, index);
+    if (field->size == sizeof(uint8_t)) {
+        *(uint8_t *)p = (uint8_t)value;
+    } else {
+        int32_t v = value;
+        memcpy(p, &v, sizeof(v));
+    }
+}
+
+bool dm_field_is_set(const dm_field_t *field, const void *base, uint8_t index)
+{
+    const void *p = dm_field_ptr(field, base, index);
+    switch (field->kind) {
+    case DM_FIELD_STR:
+        return ((const char *)p)[0] != 0;
+    case DM_FIELD_STRS:
+        return *dm_field_count(field, base, index) > 0;
+    case DM_FIELD_U32:
+        return *(const uint32_t *)p != 0;
+    case DM_FIELD_BOOL:
+        return *(const bool *)p;
+    case DM_FIELD_FLOAT:
+        return *(const bool *)((const uint8_t *)base + field->aux + (size_t)index * field->stride);
+    case DM_FIELD_ENUM:
+        return dm_field_get_int(field, base, index) != 0;
+    case DM_FIELD_LIMIT:
+        return ((const dm_rate_limit_t *)p)->mode != DM_RATE_MODE_DEFAULT;
+    case DM_FIELD_LIST:
+        return *dm_field_count(field, base, 0) > 0;
+    default:
+        return false;
+    }
+}
+
+void dm_record_clear(const dm_record_t *rec, void *base, uint8_t index)
+{
+    for (uint8_t i = 0; i < rec->count; ++i) {
+        const dm_field_t *f = &rec->fields[i];
+        if (f->kind == DM_FIELD_LIST) {
+            continue;
+        }
+        memset(dm_field_ptr(f, base, index), 0, (size_t)f->size * (f->kind == DM_FIELD_STRS ? f->max : 1));
+        if (f->kind == DM_FIELD_STRS) {
+            *dm_field_count(f, base, index) = 0;
+        } else if (f->kind == DM_FIELD_FLOAT) {
+            *(bool *)((uint8_t *)base + f->aux + (size_t)index * f->stride) = false;
+        }
+    }
+}
+
+bool dm_record_usable(const dm_record_t *rec, const void *base, uint8_t index, bool check)
+{
+    for (uint8_t i = 0; i < rec->count; ++i) {
+        const dm_field_t *f = &rec->fields[i];
+        if ((f->flags & DM_FIELD_REQUIRED) && !dm_field_is_set(f, base, index)) {
+            return false;
+        }
+    }
+    return !check || !rec->check || rec->check(base, index);
+}
+
+// Also holds the members to their bounds, for blocks that did not come through the importer.
+static bool record_sound(const dm_record_t *rec, const void *base, uint8_t index)
+{
+    if (!dm_record_usable(rec, base, index, true)) {
+        return false;
+    }
+    for (uint8_t i = 0; i < rec->count; ++i) {
+        const dm_field_t *f = &rec->fields[i];
+        switch (f->kind) {
+        case DM_FIELD_STR:
+            if (!memchr(dm_field_ptr(f, base, index), 0, f->size)) {
+                return false;
+            }
+            break;
+        case DM_FIELD_STRS: {
+            uint8_t count = *dm_field_count(f, base, index);
+            if (count > f->max) {
+                return false;
+            }
+            for (uint8_t n = 0; n < count; ++n) {
+                if (!memchr(dm_field_str(f, base, index, n), 0, f->size)) {
+                    return false;
+                }
+            }
+            break;
+        }
+        case DM_FIELD_LIST: {
+            uint8_t count = *dm_field_count(f, base, 0);
+            if (count > f->max) {
+                return false;
+            }
+            for (uint8_t n = 0; n < count; ++n) {
+                if (!record_sound((const dm_record_t *)f->ref, base, n)) {
+                    return false;
+                }
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    return true;
+}
+
+bool dm_template_config_usable(const dm_template_config_t *tpl)
+{
+    const dm_template_schema_t *schema = tpl ? dm_template_schema(tpl->type) : NULL;
+    return schema && record_sound(&schema->record, &tpl->data, 0);
+}
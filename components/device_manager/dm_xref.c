@@ -0,0 +1,777 @@
+#include "dm_xref.h"
+
+#include <ctype.h>
+#include <inttypes.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+#include "device_manager_utils.h"
+#include "dm_config.h"
+
+static const char *TAG = "dm_xref";
+
+#define XREF_MIN_SLOTS  256u
+#define XREF_NO_OWNER   0xFF
+
+typedef enum {
+    XREF_SCENARIO = 1,      // scenario id or name of the owner; aux: scenario index
+    XREF_FLAG_SET,          // flag a set_flag step of the owner writes
+    XREF_LISTEN,            // exact topic that starts scenario aux of the owner
+    XREF_FILE,              // path on the card, no owner; aux: it exists
+} xref_kind_t;
+
+typedef struct {
+    uint32_t hash;          // 0: free slot
+    uint32_t key;           // offset into the string pool
+    uint32_t stamp;         // the owner's stamp when added; entries of an older one are stale
+    uint8_t kind;
+    uint8_t device;
+    uint8_t aux;
+} xref_entry_t;
+
+// A flag the device reads; resolved against the whole index every run.
+typedef struct {
+    uint32_t hash;
+    uint32_t key;
+    int8_t scenario;
+    int8_t step;
+    int8_t item;
+    const char *field;
+} xref_read_t;
+
+typedef struct {
+    uint64_t digest;
+    uint32_t stamp;         // 0: not indexed
+    uint32_t entries;       // slots its entries take
+    uint32_t key_bytes;     // pool bytes they and its reads hold
+    uint16_t issue_count;
+    uint16_t issue_cap;
+    uint16_t read_count;
+    uint16_t read_cap;
+    dm_xref_issue_t *issues;
+    xref_read_t *reads;
+} xref_device_t;
+
+struct dm_xref {
+    esp_err_t err;
+    xref_entry_t *slots;
+    uint32_t slot_count;    // power of two
+    uint32_t used;          // taken slots, stale ones included
+    uint32_t stale;
+    char *pool;
+    uint32_t pool_len;
+    uint32_t pool_cap;
+    uint32_t pool_stale;
+    uint32_t next_stamp;
+    uint8_t device_count;
+    uint8_t rechecked;
+    bool files_checked;
+    xref_device_t devices[DEVICE_MANAGER_MAX_DEVICES];
+    dm_xref_issue_t *issues;    // result of the last run, flattened
+    uint16_t issue_count;
+    uint16_t issue_cap;
+    uint16_t errors;
+    uint16_t warnings;
+};
+
+static const char *const k_code_names[DM_XREF_CODE_COUNT] = {
+    [DM_XREF_MISSING_SCENARIO] = "missing_scenario",
+    [DM_XREF_DUPLICATE_SCENARIO] = "duplicate_scenario",
+    [DM_XREF_FLAG_NEVER_SET] = "flag_never_set",
+    [DM_XREF_MISSING_FILE] = "missing_file",
+    [DM_XREF_BAD_TOPIC] = "bad_topic",
+    [DM_XREF_SELF_TRIGGER] = "self_trigger",
+};
+
+static void *xref_realloc(void *ptr, size_t size)
+{
+    void *next = heap_caps_realloc(ptr, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!next) {
+        next = heap_caps_realloc(ptr, size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    return next;
+}
+
+// Grows `*arr` to hold `need` elements; sets x->err on failure.
+static bool reserve(dm_xref_t *x, void **arr, uint16_t *cap, size_t need, size_t elem)
+{
+    if (need <= *cap) {
+        return true;
+    }
+    size_t next = *cap ? (size_t)*cap * 2 : 8;
+    while (next < need) {
+        next *= 2;
+    }
+    if (next > UINT16_MAX) {
+        next = UINT16_MAX;
+    }
+    void *grown = next >= need ? xref_realloc(*arr, next * elem) : NULL;
+    if (!grown) {
+        x->err = ESP_ERR_NO_MEM;
+        return false;
+    }
+    *arr = grown;
+    *cap = (uint16_t)next;
+    return true;
+}
+
+// Scenario ids and flags match without case, like the runtime; topics and paths exactly.
+static bool kind_folds(uint8_t kind)
+{
+    return kind == XREF_SCENARIO || kind == XREF_FLAG_SET;
+}
+
+// Scenarios and listeners are looked up per device; flags and files across the config, so
+// their hash leaves the owner out.
+static uint32_t key_hash(uint8_t kind, uint8_t device, const char *key)
+{
+    uint32_t h = 2166136261u;
+    h = (h ^ kind) * 16777619u;
+    if (kind == XREF_SCENARIO || kind == XREF_LISTEN) {
+        h = (h ^ device) * 16777619u;
+    }
+    bool fold = kind_folds(kind);
+    for (const unsigned char *p = (const unsigned char *)key; *p; ++p) {
+        h = (h ^ (fold ? (unsigned char)tolower(*p) : *p)) * 16777619u;
+    }
+    return h ? h : 1;
+}
+
+static bool entry_live(const dm_xref_t *x, const xref_entry_t *e)
+{
+    if (e->device == XREF_NO_OWNER) {
+        return true;
+    }
+    return e->device < x->device_count && e->stamp == x->devices[e->device].stamp;
+}
+
+static bool key_equal(const dm_xref_t *x, uint32_t key, uint8_t kind, const char *name)
+{
+    const char *stored = x->pool + key;
+    return kind_folds(kind) ? strcasecmp(stored, name) == 0 : strcmp(stored, name) == 0;
+}
+
+// Walks the live entries stored under (kind, device, name); *pos starts at UINT32_MAX.
+static const xref_entry_t *next_match(const dm_xref_t *x, uint8_t kind, uint8_t device,
+                                      const char *name, uint32_t hash, uint32_t *pos)
+{
+    uint32_t mask = x->slot_count - 1;
+    uint32_t i = *pos == UINT32_MAX ? hash & mask : (*pos + 1) & mask;
+    for (;; i = (i + 1) & mask) {
+        const xref_entry_t *e = &x->slots[i];
+        if (!e->hash) {
+            return NULL;
+        }
+        if (e->hash == hash && e->kind == kind && e->device == device && entry_live(x, e) &&
+            key_equal(x, e->key, kind, name)) {
+            *pos = i;
+            return e;
+        }
+    }
+}
+
+static const xref_entry_t *find(const dm_xref_t *x, uint8_t kind, uint8_t device, const char *name)
+{
+    uint32_t pos = UINT32_MAX;
+    return next_match(x, kind, device, name, key_hash(kind, device, name), &pos);
+}
+
+static bool pool_add(dm_xref_t *x, const char *str, uint32_t *out)
+{
+    size_t len = strlen(str) + 1;
+    if (x->pool_len + len > x->pool_cap) {
+        size_t cap = x->pool_cap ? x->pool_cap : 1024;
+        while (cap < x->pool_len + len) {
+            cap *= 2;
+        }
+        char *grown = xref_realloc(x->pool, cap);
+        if (!grown) {
+            x->err = ESP_ERR_NO_MEM;
+            return false;
+        }
+        x->pool = grown;
+        x->pool_cap = (uint32_t)cap;
+    }
+    memcpy(x->pool + x->pool_len, str, len);
+    *out = x->pool_len;
+    x->pool_len += (uint32_t)len;
+    return true;
+}
+
+// Rehashes the live entries into a table at most half full; stale ones are dropped here.
+static bool rehash(dm_xref_t *x)
+{
+    uint32_t live = x->used - x->stale;
+    uint32_t count = XREF_MIN_SLOTS;
+    while (count < (live + 1) * 2) {
+        count *= 2;
+    }
+    xref_entry_t *slots = xref_realloc(NULL, count * sizeof(*slots));
+    if (!slots) {
+        x->err = ESP_ERR_NO_MEM;
+        return false;
+    }
+    memset(slots, 0, count * sizeof(*slots));
+    for (uint32_t i = 0; i < x->slot_count; ++i) {
+        const xref_entry_t *e = &x->slots[i];
+        if (!e->hash || !entry_live(x, e)) {
+            continue;
+        }
+        uint32_t j = e->hash & (count - 1);
+        while (slots[j].hash) {
+            j = (j + 1) & (count - 1);
+        }
+        slots[j] = *e;
+    }
+    heap_caps_free(x->slots);
+    x->slots = slots;
+    x->slot_count = count;
+    x->used = live;
+    x->stale = 0;
+    return true;
+}
+
+static bool insert(dm_xref_t *x, uint8_t kind, uint8_t device, const char *name, uint8_t aux)
+{
+    if ((x->used + 1) * 4 > x->slot_count * 3 && !rehash(x)) {
+        return false;
+    }
+    uint32_t key;
+    if (!pool_add(x, name, &key)) {
+        return false;
+    }
+    uint32_t hash = key_hash(kind, device, name);
+    uint32_t i = hash & (x->slot_count - 1);
+    while (x->slots[i].hash) {
+        i = (i + 1) & (x->slot_count - 1);
+    }
+    x->slots[i] = (xref_entry_t){
+        .hash = hash,
+        .key = key,
+        .stamp = device == XREF_NO_OWNER ? 0 : x->devices[device].stamp,
+        .kind = kind,
+        .device = device,
+        .aux = aux,
+    };
+    x->used++;
+    if (device != XREF_NO_OWNER) {
+        x->devices[device].entries++;
+        x->devices[device].key_bytes += (uint32_t)strlen(name) + 1;
+    }
+    return true;
+}
+
+// The device's entries go stale and its results are dropped.
+static void retire(dm_xref_t *x, xref_device_t *rec)
+{
+    x->stale += rec->entries;
+    x->pool_stale += rec->key_bytes;
+    rec->stamp = 0;
+    rec->entries = 0;
+    rec->key_bytes = 0;
+    rec->issue_count = 0;
+    rec->read_count = 0;
+}
+
+static void reset(dm_xref_t *x)
+{
+    for (size_t i = 0; i < DEVICE_MANAGER_MAX_DEVICES; ++i) {
+        retire(x, &x->devices[i]);
+        x->devices[i].digest = 0;
+    }
+    if (x->slots) {
+        memset(x->slots, 0, x->slot_count * sizeof(*x->slots));
+    }
+    x->used = 0;
+    x->stale = 0;
+    x->pool_len = 0;
+    x->pool_stale = 0;
+    x->device_count = 0;
+    struct stat st;
+    x->files_checked = stat(DM_XREF_FILE_ROOT, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+static void add_issue(dm_xref_t *x, uint8_t device, dm_xref_code_t code, int scenario, int step, int item,
+                      const char *field, const char *ref)
+{
+    xref_device_t *rec = &x->devices[device];
+    if (!reserve(x, (void **)&rec->issues, &rec->issue_cap, rec->issue_count + 1u, sizeof(*rec->issues))) {
+        return;
+    }
+    dm_xref_issue_t *issue = &rec->issues[rec->issue_count++];
+    issue->code = (uint8_t)code;
+    issue->severity = code == DM_XREF_FLAG_NEVER_SET || code == DM_XREF_SELF_TRIGGER ? DM_XREF_WARNING : DM_XREF_ERROR;
+    issue->device = device;
+    issue->scenario = (int8_t)scenario;
+    issue->step = (int8_t)step;
+    issue->item = (int8_t)item;
+    issue->field = field;
+    dm_str_copy(issue->ref, sizeof(issue->ref), ref);
+}
+
+// Indexing ---------------------------------------------------------------------
+
+static void index_listen(dm_xref_t *x, uint8_t d, const char *topic, const char *scenario)
+{
+    const xref_entry_t *target = scenario[0] ? find(x, XREF_SCENARIO, d, scenario) : NULL;
+    if (topic[0] && target && !strpbrk(topic, "+#")) {
+        insert(x, XREF_LISTEN, d, topic, target->aux);
+    }
+}
+
+static void index_device(dm_xref_t *x, uint8_t d, const device_descriptor_t *dev)
+{
+    for (uint8_t s = 0; s < dev->scenario_count && dev->scenarios; ++s) {
+        const device_scenario_t *sc = &dev->scenarios[s];
+        if (sc->id[0]) {
+            // The runtime takes the first scenario whose id or name matches.
+            if (find(x, XREF_SCENARIO, d, sc->id)) {
+                add_issue(x, d, DM_XREF_DUPLICATE_SCENARIO, s, -1, -1, "scenarios.id", sc->id);
+            } else {
+                insert(x, XREF_SCENARIO, d, sc->id, s);
+            }
+        }
+        if (sc->name[0] && strcasecmp(sc->name, sc->id) != 0 && !find(x, XREF_SCENARIO, d, sc->name)) {
+            insert(x, XREF_SCENARIO, d, sc->name, s);
+        }
+        for (uint8_t i = 0; i < sc->step_count && sc->steps; ++i) {
+            const device_action_step_t *step = &sc->steps[i];
+            if (step->type == DEVICE_ACTION_SET_FLAG && step->data.flag.flag[0] &&
+                !find(x, XREF_FLAG_SET, d, step->data.flag.flag)) {
+                insert(x, XREF_FLAG_SET, d, step->data.flag.flag, 0);
+            }
+        }
+    }
+    for (uint8_t t = 0; t < dev->topic_count && t < DEVICE_MANAGER_MAX_TOPICS_PER_DEVICE; ++t) {
+        index_listen(x, d, dev->topics[t].topic, dev->topics[t].name);
+    }
+    if (dev->template_assigned && dev->template_config.type == DM_TEMPLATE_TYPE_MQTT_TRIGGER) {
+        const dm_mqtt_trigger_template_t *mqtt = &dev->template_config.data.mqtt;
+        for (uint8_t r = 0; r < mqtt->rule_count && r < DM_MQTT_TRIGGER_MAX_RULES; ++r) {
+            // Only rules that fire on any payload are sure to answer a publish.
+            if (mqtt->matches[r].op == DM_MQTT_MATCH_EXACT && !mqtt->rules[r].payload_required) {
+                index_listen(x, d, mqtt->rules[r].topic, mqtt->rules[r].scenario);
+            }
+        }
+    }
+}
+
+// Checks -------------------------------------------------------------------------
+
+typedef struct {
+    dm_xref_t *x;
+    uint8_t device;
+    int scenario;
+    int step;
+} xref_at_t;
+
+static void check_scenario(const xref_at_t *at, int item, const char *field, const char *name)
+{
+    if (name[0] && !find(at->x, XREF_SCENARIO, at->device, name)) {
+        add_issue(at->x, at->device, DM_XREF_MISSING_SCENARIO, at->scenario, at->step, item, field, name);
+    }
+}
+
+static void check_file(const xref_at_t *at, int item, const char *field, const char *path)
+{
+    dm_xref_t *x = at->x;
+    size_t root_len = strlen(DM_XREF_FILE_ROOT);
+    if (!x->files_checked || strncmp(path, DM_XREF_FILE_ROOT, root_len) != 0 || path[root_len] != '/') {
+        return;
+    }
+    const xref_entry_t *e = find(x, XREF_FILE, XREF_NO_OWNER, path);
+    bool exists;
+    if (e) {
+        exists = e->aux;
+    } else {
+        struct stat st;
+        exists = stat(path, &st) == 0;
+        insert(x, XREF_FILE, XREF_NO_OWNER, path, exists);
+    }
+    if (!exists) {
+        add_issue(x, at->device, DM_XREF_MISSING_FILE, at->scenario, at->step, item, field, path);
+    }
+}
+
+// '+' and '#' must fill a whole level, '#' only the last one.
+static bool topic_filter_valid(const char *topic)
+{
+    for (const char *p = topic; *p; ++p) {
+        if (*p != '+' && *p != '#') {
+            continue;
+        }
+        bool level_start = p == topic || p[-1] == '/';
+        bool level_end = p[1] == '\0' || p[1] == '/';
+        if (!level_start || !level_end || (*p == '#' && p[1] != '\0')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void check_filter(const xref_at_t *at, int item, const char *field, const char *topic)
+{
+    if (topic[0] && !topic_filter_valid(topic)) {
+        add_issue(at->x, at->device, DM_XREF_BAD_TOPIC, at->scenario, at->step, item, field, topic);
+    }
+}
+
+static void check_publish(const xref_at_t *at, int item, const char *field, const char *topic)
+{
+    if (topic[0] && strpbrk(topic, "+#")) {
+        add_issue(at->x, at->device, DM_XREF_BAD_TOPIC, at->scenario, at->step, item, field, topic);
+    }
+}
+
+static void add_read(const xref_at_t *at, int item, const char *field, const char *flag)
+{
+    dm_xref_t *x = at->x;
+    xref_device_t *rec = &x->devices[at->device];
+    uint32_t key;
+    if (!flag[0] || !reserve(x, (void **)&rec->reads, &rec->read_cap, rec->read_count + 1u, sizeof(*rec->reads)) ||
+        !pool_add(x, flag, &key)) {
+        return;
+    }
+    rec->key_bytes += (uint32_t)strlen(flag) + 1;
+    rec->reads[rec->read_count++] = (xref_read_t){
+        .hash = key_hash(XREF_FLAG_SET, XREF_NO_OWNER, flag),
+        .key = key,
+        .scenario = (int8_t)at->scenario,
+        .step = (int8_t)at->step,
+        .item = (int8_t)item,
+        .field = field,
+    };
+}
+
+static void check_steps(dm_xref_t *x, uint8_t d, const device_descriptor_t *dev)
+{
+    for (uint8_t s = 0; s < dev->scenario_count && dev->scenarios; ++s) {
+        const device_scenario_t *sc = &dev->scenarios[s];
+        for (uint8_t i = 0; i < sc->step_count && sc->steps; ++i) {
+            const device_action_step_t *step = &sc->steps[i];
+            xref_at_t at = {.x = x, .device = d, .scenario = s, .step = i};
+            switch (step->type) {
+            case DEVICE_ACTION_MQTT_PUBLISH: {
+                const char *topic = step->data.mqtt.topic;
+                check_publish(&at, -1, "steps.topic", topic);
+                uint32_t pos = UINT32_MAX;
+                uint32_t hash = key_hash(XREF_LISTEN, d, topic);
+                for (const xref_entry_t *e; (e = next_match(x, XREF_LISTEN, d, topic, hash, &pos)) != NULL;) {
+                    if (e->aux == s) {
+                        add_issue(x, d, DM_XREF_SELF_TRIGGER, s, i, -1, "steps.topic", topic);
+                        break;
+                    }
+                }
+                break;
+            }
+            case DEVICE_ACTION_AUDIO_PLAY:
+                check_file(&at, -1, "steps.track", step->data.audio.track);
+                break;
+            case DEVICE_ACTION_WAIT_FLAGS:
+                for (uint8_t r = 0; r < step->data.wait_flags.requirement_count && r < DEVICE_MANAGER_MAX_FLAG_RULES; ++r) {
+                    add_read(&at, r, "steps.requirements.flag", step->data.wait_flags.requirements[r].flag);
+                }
+                break;
+            default:
+                break;
+            }
+        }
+    }
+}
+
+static void check_template(dm_xref_t *x, uint8_t d, const device_descriptor_t *dev)
+{
+    const dm_template_config_t *tpl = &dev->template_config;
+    xref_at_t at = {.x = x, .device = d, .scenario = -1, .step = -1};
+    switch (tpl->type) {
+    case DM_TEMPLATE_TYPE_UID: {
+        const dm_uid_template_t *uid = &tpl->data.uid;
+        for (uint8_t i = 0; i < uid->slot_count && i < DM_UID_TEMPLATE_MAX_SLOTS; ++i) {
+            const dm_uid_slot_t *slot = &uid->slots[i];
+            for (uint8_t v = 0; v < slot->value_count && v < DM_UID_TEMPLATE_MAX_VALUES; ++v) {
+                if (slot->values[v][0] == DM_UID_VALUE_FILE_PREFIX) {
+                    check_file(&at, i, "template.slots.values", slot->values[v] + 1);
+                }
+            }
+        }
+        check_filter(&at, -1, "template.start_topic", uid->start_topic);
+        check_publish(&at, -1, "template.broadcast_topic", uid->broadcast_topic);
+        check_publish(&at, -1, "template.success_topic", uid->success_topic);
+        check_publish(&at, -1, "template.fail_topic", uid->fail_topic);
+        check_publish(&at, -1, "template.success_signal_topic", uid->success_signal_topic);
+        check_publish(&at, -1, "template.fail_signal_topic", uid->fail_signal_topic);
+        check_file(&at, -1, "template.success_audio_track", uid->success_audio_track);
+        check_file(&at, -1, "template.fail_audio_track", uid->fail_audio_track);
+        break;
+    }
+    case DM_TEMPLATE_TYPE_SIGNAL_HOLD: {
+        const dm_signal_hold_template_t *sig = &tpl->data.signal;
+        check_publish(&at, -1, "template.signal_topic", sig->signal_topic);
+        check_filter(&at, -1, "template.heartbeat_topic", sig->heartbeat_topic);
+        check_filter(&at, -1, "template.reset_topic", sig->reset_topic);
+        check_file(&at, -1, "template.hold_track", sig->hold_track);
+        check_file(&at, -1, "template.complete_track", sig->complete_track);
+        break;
+    }
+    case DM_TEMPLATE_TYPE_MQTT_TRIGGER: {
+        const dm_mqtt_trigger_template_t *mqtt = &tpl->data.mqtt;
+        for (uint8_t r = 0; r < mqtt->rule_count && r < DM_MQTT_TRIGGER_MAX_RULES; ++r) {
+            check_filter(&at, r, "template.rules.topic", mqtt->rules[r].topic);
+            check_scenario(&at, r, "template.rules.scenario", mqtt->rules[r].scenario);
+        }
+        break;
+    }
+    case DM_TEMPLATE_TYPE_FLAG_TRIGGER: {
+        const dm_flag_trigger_template_t *flag = &tpl->data.flag;
+        for (uint8_t r = 0; r < flag->rule_count && r < DM_FLAG_TRIGGER_MAX_RULES; ++r) {
+            add_read(&at, r, "template.rules.flag", flag->rules[r].flag);
+            check_scenario(&at, r, "template.rules.scenario", flag->rules[r].scenario);
+        }
+        break;
+    }
+    case DM_TEMPLATE_TYPE_IF_CONDITION: {
+        const dm_condition_template_t *cond = &tpl->data.condition;
+        for (uint8_t r = 0; r < cond->rule_count && r < DM_CONDITION_TEMPLATE_MAX_RULES; ++r) {
+            add_read(&at, r, "template.rules.flag", cond->rules[r].flag);
+        }
+        check_scenario(&at, -1, "template.true_scenario", cond->true_scenario);
+        check_scenario(&at, -1, "template.false_scenario", cond->false_scenario);
+        break;
+    }
+    case DM_TEMPLATE_TYPE_INTERVAL_TASK:
+        check_scenario(&at, -1, "template.scenario", tpl->data.interval.scenario);
+        break;
+    case DM_TEMPLATE_TYPE_SEQUENCE_LOCK: {
+        const dm_sequence_template_t *seq = &tpl->data.sequence;
+        for (uint8_t i = 0; i < seq->step_count && i < DM_SEQUENCE_TEMPLATE_MAX_STEPS; ++i) {
+            check_filter(&at, i, "template.steps.topic", seq->steps[i].topic);
+            check_publish(&at, i, "template.steps.hint_topic", seq->steps[i].hint_topic);
+            check_file(&at, i, "template.steps.hint_audio_track", seq->steps[i].hint_audio_track);
+        }
+        check_publish(&at, -1, "template.success_topic", seq->success_topic);
+        check_publish(&at, -1, "template.fail_topic", seq->fail_topic);
+        check_file(&at, -1, "template.success_audio_track", seq->success_audio_track);
+        check_file(&at, -1, "template.fail_audio_track", seq->fail_audio_track);
+        check_scenario(&at, -1, "template.success_scenario", seq->success_scenario);
+        check_scenario(&at, -1, "template.fail_scenario", seq->fail_scenario);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+static void check_device(dm_xref_t *x, uint8_t d, const device_descriptor_t *dev)
+{
+    // Topic bindings start the scenario they name; automation_engine_reload() skips the rest.
+    xref_at_t at = {.x = x, .device = d, .scenario = -1, .step = -1};
+    for (uint8_t t = 0; t < dev->topic_count && t < DEVICE_MANAGER_MAX_TOPICS_PER_DEVICE; ++t) {
+        check_filter(&at, t, "topics.topic", dev->topics[t].topic);
+        check_scenario(&at, t, "topics.name", dev->topics[t].name);
+    }
+    check_steps(x, d, dev);
+    if (dev->template_assigned) {
+        check_template(x, d, dev);
+    }
+}
+
+// Result -------------------------------------------------------------------------
+
+static bool flag_is_set(const dm_xref_t *x, const xref_read_t *read)
+{
+    const char *name = x->pool + read->key;
+    uint32_t mask = x->slot_count - 1;
+    for (uint32_t i = read->hash & mask;; i = (i + 1) & mask) {
+        const xref_entry_t *e = &x->slots[i];
+        if (!e->hash) {
+            return false;
+        }
+        if (e->kind == XREF_FLAG_SET && entry_live(x, e) && strcasecmp(x->pool + e->key, name) == 0) {
+            return true;
+        }
+    }
+}
+
+static bool push_issue(dm_xref_t *x, const dm_xref_issue_t *issue)
+{
+    if (!reserve(x, (void **)&x->issues, &x->issue_cap, x->issue_count + 1u, sizeof(*x->issues))) {
+        return false;
+    }
+    x->issues[x->issue_count++] = *issue;
+    if (issue->severity == DM_XREF_ERROR) {
+        x->errors++;
+    } else {
+        x->warnings++;
+    }
+    return true;
+}
+
+static void collect(dm_xref_t *x)
+{
+    x->issue_count = 0;
+    x->errors = 0;
+    x->warnings = 0;
+    for (uint8_t d = 0; d < x->device_count && x->err == ESP_OK; ++d) {
+        const xref_device_t *rec = &x->devices[d];
+        for (uint16_t i = 0; i < rec->issue_count; ++i) {
+            push_issue(x, &rec->issues[i]);
+        }
+        for (uint16_t i = 0; i < rec->read_count; ++i) {
+            const xref_read_t *read = &rec->reads[i];
+            if (flag_is_set(x, read)) {
+                continue;
+            }
+            dm_xref_issue_t issue = {
+                .code = DM_XREF_FLAG_NEVER_SET,
+                .severity = DM_XREF_WARNING,
+                .device = d,
+                .scenario = read->scenario,
+                .step = read->step,
+                .item = read->item,
+                .field = read->field,
+            };
+            dm_str_copy(issue.ref, sizeof(issue.ref), x->pool + read->key);
+            push_issue(x, &issue);
+        }
+    }
+}
+
+// API ----------------------------------------------------------------------------
+
+dm_xref_t *dm_xref_create(void)
+{
+    dm_xref_t *x = xref_realloc(NULL, sizeof(*x));
+    if (x) {
+        memset(x, 0, sizeof(*x));
+    }
+    return x;
+}
+
+void dm_xref_destroy(dm_xref_t *x)
+{
+    if (!x) {
+        return;
+    }
+    for (size_t i = 0; i < DEVICE_MANAGER_MAX_DEVICES; ++i) {
+        heap_caps_free(x->devices[i].issues);
+        heap_caps_free(x->devices[i].reads);
+    }
+    heap_caps_free(x->slots);
+    heap_caps_free(x->pool);
+    heap_caps_free(x->issues);
+    heap_caps_free(x);
+}
+
+esp_err_t dm_xref_run(dm_xref_t *x, const device_manager_config_t *cfg, bool full)
+{
+    if (!x || !cfg) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    x->err = ESP_OK;
+    // Strings of replaced devices stay in the pool until the next full build.
+    if (full || !x->slots || x->pool_stale > x->pool_len / 2) {
+        reset(x);
+        if (!x->slots && !rehash(x)) {
+            return x->err;
+        }
+    }
+    uint8_t count = cfg->device_count < DEVICE_MANAGER_MAX_DEVICES ? cfg->device_count : DEVICE_MANAGER_MAX_DEVICES;
+    for (uint8_t d = count; d < x->device_count; ++d) {
+        retire(x, &x->devices[d]);
+    }
+    x->device_count = count;
+    x->rechecked = 0;
+    for (uint8_t d = 0; d < count && x->err == ESP_OK; ++d) {
+        const device_descriptor_t *dev = &cfg->devices[d];
+        xref_device_t *rec = &x->devices[d];
+        uint64_t digest = dm_config_device_digest(dev, true);
+        if (rec->stamp && rec->digest == digest) {
+            continue;
+        }
+        retire(x, rec);
+        rec->stamp = ++x->next_stamp;
+        rec->digest = digest;
+        index_device(x, d, dev);
+        check_device(x, d, dev);
+        x->rechecked++;
+    }
+    if (x->err == ESP_OK) {
+        collect(x);
+    }
+    if (x->err != ESP_OK) {
+        ESP_LOGW(TAG, "cross-reference check failed: %s", esp_err_to_name(x->err));
+        reset(x);
+        x->issue_count = 0;
+        return x->err;
+    }
+    ESP_LOGD(TAG, "checked %u/%u devices: %u errors, %u warnings, %" PRIu32 " index slots",
+             x->rechecked, count, x->errors, x->warnings, x->slot_count);
+    return ESP_OK;
+}
+
+const dm_xref_issue_t *dm_xref_issues(const dm_xref_t *x, size_t *count)
+{
+    if (count) {
+        *count = x ? x->issue_count : 0;
+    }
+    return x ? x->issues : NULL;
+}
+
+void dm_xref_get_summary(const dm_xref_t *x, dm_xref_summary_t *out)
+{
+    if (!out) {
+        return;
+    }
+    memset(out, 0, sizeof(*out));
+    if (x) {
+        out->errors = x->errors;
+        out->warnings = x->warnings;
+        out->devices = x->device_count;
+        out->rechecked = x->rechecked;
+        out->files_checked = x->files_checked;
+    }
+}
+
+const char *dm_xref_code_name(dm_xref_code_t code)
+{
+    return code < DM_XREF_CODE_COUNT ? k_code_names[code] : "unknown";
+}
+
+void dm_xref_write_json(const dm_xref_t *x, const device_manager_config_t *cfg, dm_json_writer_t *w)
+{
+    dm_json_begin_object(w);
+    dm_json_kv_number(w, "generation", cfg->generation);
+    dm_json_kv_bool(w, "files_checked", x->files_checked);
+    dm_json_kv_number(w, "devices", x->device_count);
+    dm_json_kv_number(w, "rechecked", x->rechecked);
+    dm_json_kv_number(w, "errors", x->errors);
+    dm_json_kv_number(w, "warnings", x->warnings);
+    dm_json_key(w, "issues");
+    dm_json_begin_array(w);
+    for (uint16_t i = 0; i < x->issue_count; ++i) {
+        const dm_xref_issue_t *issue = &x->issues[i];
+        const device_descriptor_t *dev = issue->device < cfg->device_count ? &cfg->devices[issue->device] : NULL;
+        dm_json_begin_object(w);
+        dm_json_kv_string(w, "severity", issue->severity == DM_XREF_ERROR ? "error" : "warning");
+        dm_json_kv_string(w, "code", dm_xref_code_name((dm_xref_code_t)issue->code));
+        dm_json_kv_string(w, "device", dev ? dev->id : "");
+        if (dev && issue->scenario >= 0 && issue->scenario < dev->scenario_count) {
+            dm_json_kv_string(w, "scenario", dev->scenarios[issue->scenario].id);
+        }
+        if (issue->step >= 0) {
+            dm_json_kv_number(w, "step", issue->step);
+        }
+        if (issue->item >= 0) {
+            dm_json_kv_number(w, "item", issue->item);
+        }
+        dm_json_kv_string(w, "field", issue->field);
+        dm_json_kv_string(w, "ref", issue->ref);
+        dm_json_end_object(w);
+    }
+    dm_json_end_array(w);
+    dm_json_end_object(w);
+}
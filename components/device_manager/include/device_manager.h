@@ -10,6 +10,8 @@ extern "C" {
 #endif
 
 #include "dm_limits.h"
+#include "dm_json_reader.h"
+#include "dm_json_writer.h"
 #include "dm_template_registry.h"
 
 typedef struct {
@@ -27,10 +29,14 @@ typedef enum {
     DEVICE_ACTION_LOOP,
     DEVICE_ACTION_DELAY,
     DEVICE_ACTION_EVENT_BUS,
+    DEVICE_ACTION_PARALLEL,     // next data.parallel.count steps start concurrently
+    DEVICE_ACTION_JOIN,         // wait for branches started by earlier parallel steps
 } device_action_type_t;
 
+// Step strings are pooled in the config arena (dm_config.h): never NULL, cut to the
+// *_MAX_LEN limits below, shared between steps that use the same text.
 typedef struct {
-    char flag[DEVICE_MANAGER_FLAG_NAME_MAX_LEN];
+    const char *flag;               // DEVICE_MANAGER_FLAG_NAME_MAX_LEN
     bool required_state;
 } device_flag_requirement_t;
 
@@ -42,21 +48,21 @@ typedef struct {
 } device_wait_flags_t;
 
 typedef struct {
-    char topic[DEVICE_MANAGER_TOPIC_MAX_LEN];
-    char payload[DEVICE_MANAGER_PAYLOAD_MAX_LEN];
+    const char *topic;              // DEVICE_MANAGER_TOPIC_MAX_LEN
+    const char *payload;            // DEVICE_MANAGER_PAYLOAD_MAX_LEN
     uint8_t qos;
     bool retain;
 } device_mqtt_publish_t;
 
 typedef struct {
-    char track[DEVICE_MANAGER_TRACK_NAME_MAX_LEN];
+    const char *track;              // DEVICE_MANAGER_TRACK_NAME_MAX_LEN
     bool blocking;
 } device_audio_action_t;
 
 typedef struct {
-    char event[DEVICE_MANAGER_NAME_MAX_LEN];
-    char topic[DEVICE_MANAGER_TOPIC_MAX_LEN];
-    char payload[DEVICE_MANAGER_PAYLOAD_MAX_LEN];
+    const char *event;              // DEVICE_MANAGER_NAME_MAX_LEN
+    const char *topic;
+    const char *payload;
 } device_event_action_t;
 
 typedef struct {
@@ -69,22 +75,45 @@ typedef struct {
         device_mqtt_publish_t mqtt;
         device_audio_action_t audio;
         struct {
-            char flag[DEVICE_MANAGER_FLAG_NAME_MAX_LEN];
+            const char *flag;
             bool value;
         } flag;
         device_event_action_t event;
+        struct {
+            uint8_t count;
+        } parallel;
+        struct {
+            uint32_t timeout_ms;    // 0 = wait for all branches
+        } join;
     } data;
     uint32_t delay_ms;
     device_action_type_t type;
 } device_action_step_t;
 
+// Zero values are the defaults so profiles written before these fields existed stay valid.
+typedef enum {
+    DEVICE_SCENARIO_PRIORITY_NORMAL = 0,
+    DEVICE_SCENARIO_PRIORITY_LOW,
+    DEVICE_SCENARIO_PRIORITY_HIGH,
+    DEVICE_SCENARIO_PRIORITY_CRITICAL,
+} device_scenario_priority_t;
+
+typedef enum {
+    DEVICE_SCENARIO_CONCURRENCY_PARALLEL = 0,
+    DEVICE_SCENARIO_CONCURRENCY_QUEUE,
+    DEVICE_SCENARIO_CONCURRENCY_REPLACE,
+    DEVICE_SCENARIO_CONCURRENCY_DROP,
+} device_scenario_concurrency_t;
+
 typedef struct {
     char id[DEVICE_MANAGER_ID_MAX_LEN];
     char name[DEVICE_MANAGER_NAME_MAX_LEN];
     bool button_enabled;
     char button_label[DEVICE_MANAGER_BUTTON_LABEL_MAX_LEN];
     uint8_t step_count;
-    device_action_step_t steps[DEVICE_MANAGER_MAX_STEPS_PER_SCENARIO];
+    uint8_t priority;       // device_scenario_priority_t
+    uint8_t concurrency;    // device_scenario_concurrency_t
+    device_action_step_t *steps;    // step_count entries in the config arena
 } device_scenario_t;
 
 typedef struct {
@@ -93,9 +122,10 @@ typedef struct {
     uint8_t topic_count;
     device_topic_binding_t topics[DEVICE_MANAGER_MAX_TOPICS_PER_DEVICE];
     uint8_t scenario_count;
-    device_scenario_t scenarios[DEVICE_MANAGER_MAX_SCENARIOS_PER_DEVICE];
+    device_scenario_t *scenarios;   // scenario_count entries in the config arena
     bool template_assigned;
     dm_template_config_t template_config;
+    dm_rate_limit_t topic_limits[DEVICE_MANAGER_MAX_TOPICS_PER_DEVICE];    // per topics[] entry
 } device_descriptor_t;
 
 typedef struct {
@@ -112,24 +142,74 @@ typedef struct {
     char active_profile[DEVICE_MANAGER_ID_MAX_LEN];
     device_manager_profile_t profiles[DEVICE_MANAGER_MAX_PROFILES];
     uint8_t device_capacity;
-    device_descriptor_t devices[];
+    device_descriptor_t *devices;       // device_capacity slots in `arena`
+    struct dm_config_arena *arena;      // owns devices, scenarios, steps and step strings
+    uint32_t refs;                      // readers of a published generation
 } device_manager_config_t;
 
+typedef struct {
+    uint32_t generation;                // live config
+    uint32_t persisted_generation;      // newest one fully written to the SD card
+    bool persist_pending;
+    esp_err_t last_error;               // of the latest write attempt
+    uint32_t requests;                  // changes queued for writing
+    uint32_t writes;                    // writes completed; requests - writes were coalesced or retried
+    uint32_t failures;
+} device_manager_persist_status_t;
+
+typedef struct {
+    uint32_t hits;                      // switches served from memory
+    uint32_t misses;                    // switches that read the profile file
+    uint32_t evictions;                 // entries dropped to stay within the budget
+    uint8_t entries;
+    size_t bytes;                       // held by the cached generations
+    size_t budget;
+    uint32_t switches;
+    uint32_t last_switch_us;
+    bool last_switch_cached;
+    uint32_t hit_avg_us;                // mean switch time per kind
+    uint32_t miss_avg_us;
+} device_manager_profile_cache_status_t;
+
 esp_err_t device_manager_init(void);
 esp_err_t device_manager_reload_from_nvs(void);
 esp_err_t device_manager_save_snapshot(void);
-const device_manager_config_t *device_manager_lock_config(void);
-void device_manager_unlock_config(void);
+// Current config generation. It is never modified and stays valid until released; taking
+// it does not block on writers. Do not keep pointers into it after the release.
+const device_manager_config_t *device_manager_acquire_config(void);
+void device_manager_release_config(const device_manager_config_t *cfg);
+// One more reference on a generation the caller already holds one on.
+void device_manager_retain_config(const device_manager_config_t *cfg);
+// Makes `next` live; the SD copy is written in the background (see device_manager_get_persist_status()).
 esp_err_t device_manager_apply(const device_manager_config_t *next);
+// Writes the live config to the SD card now if it is not there yet.
 esp_err_t device_manager_sync_file(void);
+void device_manager_get_persist_status(device_manager_persist_status_t *out);
 esp_err_t device_manager_export_json(char **out_json, size_t *out_len);
 esp_err_t device_manager_export_profile_json(const char *profile_id, char **out_json, size_t *out_len);
+// Streams the JSON of the active (NULL/"") or given profile into `sink` as it is produced.
+esp_err_t device_manager_export_profile_stream(const char *profile_id, dm_json_sink_fn sink, void *ctx);
 esp_err_t device_manager_apply_json(const char *json, size_t len);
 esp_err_t device_manager_apply_profile_json(const char *profile_id, const char *json, size_t len);
+// Same as device_manager_apply_profile_json() for a document read from `source` in chunks.
+esp_err_t device_manager_apply_profile_stream(const char *profile_id, dm_json_source_fn source, void *ctx);
+// Every profile as one checksummed CBOR stream (dm_bulk.h), for backup and migration.
+esp_err_t device_manager_export_bulk_stream(dm_json_sink_fn sink, void *ctx);
+// Restores such a stream: the profile list, the profile files and the live config are replaced
+// only after the whole stream decoded and its checksum matched. Profiles it does not carry
+// are deleted.
+esp_err_t device_manager_import_bulk_stream(dm_json_source_fn source, void *ctx, uint8_t *out_profiles);
+// Checks every scenario, flag, topic and file reference of the live config (dm_xref.h) and
+// streams the report into `sink` when given. Only devices edited since the last call are
+// checked again unless `full` is set.
+esp_err_t device_manager_validate(bool full, dm_json_sink_fn sink, void *ctx,
+                                  uint16_t *out_errors, uint16_t *out_warnings);
 esp_err_t device_manager_profile_create(const char *id, const char *name, const char *clone_id);
 esp_err_t device_manager_profile_delete(const char *id);
 esp_err_t device_manager_profile_rename(const char *id, const char *new_name);
+// Inactive profiles stay decoded in a PSRAM cache, so switching back to one is a swap.
 esp_err_t device_manager_profile_activate(const char *id);
+void device_manager_get_profile_cache_status(device_manager_profile_cache_status_t *out);
 
 #ifdef __cplusplus
 }
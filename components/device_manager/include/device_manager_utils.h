@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 
 static inline void dm_str_copy(char *dst, size_t dst_len, const char *src)
@@ -15,3 +16,15 @@ static inline void dm_str_copy(char *dst, size_t dst_len, const char *src)
     strncpy(dst, src, dst_len - 1);
     dst[dst_len - 1] = 0;
 }
+
+// FNV-1a over raw bytes; configs are built in zeroed buffers, so padding hashes stably.
+static inline uint64_t dm_hash_bytes(const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "device_manager.h"
+#include "dm_cbor.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Backup of every profile in one binary stream, a CBOR sequence (RFC 8742) of
+//   header    {"format": DM_BULK_FORMAT, "version", "active_profile", "count"}
+//   count x   a config document as the JSON export has it, one per profile in list order;
+//             its "active_profile" names the profile it carries
+//   trailer   4-byte string: dm_profile_crc32() of every byte before it, big-endian
+// Both directions stream: export loads one inactive profile at a time and import decodes
+// each document straight into a config while the bytes arrive.
+
+#define DM_BULK_FORMAT          "broker-devices"
+#define DM_BULK_VERSION         1
+#define DM_BULK_TRAILER_SIZE    5
+
+// CBOR writer whose output is checksummed on its way to `sink`.
+typedef struct {
+    dm_json_writer_t w;
+    dm_json_sink_fn sink;
+    void *ctx;
+    uint32_t crc;
+} dm_bulk_writer_t;
+
+void dm_bulk_writer_init(dm_bulk_writer_t *b, dm_json_sink_fn sink, void *ctx);
+void dm_bulk_write_header(dm_bulk_writer_t *b, const char *active_profile, uint8_t count);
+// Flushes the documents and appends the trailer.
+esp_err_t dm_bulk_writer_finish(dm_bulk_writer_t *b);
+
+// CBOR reader that holds back the last bytes seen until the input ends, so the trailer is
+// checked instead of decoded.
+typedef struct {
+    dm_cbor_reader_t cbor;
+    uint32_t crc;
+    uint8_t tail[DM_BULK_TRAILER_SIZE];
+    uint8_t tail_len;
+} dm_bulk_reader_t;
+
+void dm_bulk_reader_init(dm_bulk_reader_t *r, dm_json_event_fn on_event, void *ctx);
+esp_err_t dm_bulk_reader_feed(dm_bulk_reader_t *r, const uint8_t *data, size_t len);
+// ESP_ERR_INVALID_CRC when the trailer is missing or does not match.
+esp_err_t dm_bulk_reader_finish(dm_bulk_reader_t *r);
+
+// Every profile of the held generation `cfg`: the live one from `cfg`, the others from
+// their files.
+esp_err_t dm_bulk_export(const device_manager_config_t *cfg, dm_json_sink_fn sink, void *ctx);
+
+typedef struct {
+    char active_profile[DEVICE_MANAGER_ID_MAX_LEN];
+    uint8_t count;
+    device_manager_config_t *profiles[DEVICE_MANAGER_MAX_PROFILES];    // owned, in stream order
+} dm_bulk_set_t;
+
+// Decodes a whole stream; `out` is filled only once the checksum matched.
+esp_err_t dm_bulk_import(dm_json_source_fn source, void *ctx, dm_bulk_set_t *out);
+void dm_bulk_set_free(dm_bulk_set_t *set);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#include "dm_json_reader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// CBOR (RFC 8949) form of the config documents, for bulk backup and restore. It is written by
+// dm_json_writer_init_cbor(): the calls that print JSON emit CBOR with containers of
+// indefinite length, and member names found in the key table below as small integers. The
+// reader turns CBOR back into the events of dm_json_reader.h, so whatever consumes those (the
+// config importer, a JSON writer) takes either format.
+//
+// The key table is part of the file format: entries are only ever appended.
+
+#define DM_CBOR_MAJOR_UINT      0
+#define DM_CBOR_MAJOR_NEGINT    1
+#define DM_CBOR_MAJOR_BYTES     2
+#define DM_CBOR_MAJOR_TEXT      3
+#define DM_CBOR_MAJOR_ARRAY     4
+#define DM_CBOR_MAJOR_MAP       5
+#define DM_CBOR_MAJOR_TAG       6
+#define DM_CBOR_MAJOR_SIMPLE    7
+
+#define DM_CBOR_ARRAY_OPEN      0x9F    // indefinite length
+#define DM_CBOR_MAP_OPEN        0xBF
+#define DM_CBOR_FALSE           0xF4
+#define DM_CBOR_TRUE            0xF5
+#define DM_CBOR_NULL            0xF6
+#define DM_CBOR_FLOAT32         0xFA
+#define DM_CBOR_FLOAT64         0xFB
+#define DM_CBOR_BREAK           0xFF
+
+// Table index of `name`, or -1 when it is written as text.
+int dm_cbor_key_id(const char *name);
+// NULL for an index this firmware does not know.
+const char *dm_cbor_key_name(uint32_t id);
+
+// Streaming decoder. Input is fed in pieces of any size; a sequence of top-level items
+// (RFC 8742) is read one after another. Text is cut to DM_JSON_READER_TOKEN_MAX - 1 bytes
+// like the JSON reader does; byte strings are reported as null and tags are ignored. Map keys
+// must be text or table indexes; an index this firmware does not know is reported as "#<n>",
+// which the importer skips like any unknown member. The first error sticks.
+typedef struct {
+    uint32_t remaining;         // items left in a definite container
+    bool map;
+    bool indefinite;
+    bool key_next;              // map: the next item is a member name
+} dm_cbor_frame_t;
+
+typedef struct {
+    dm_json_event_fn on_event;
+    void *ctx;
+    esp_err_t err;
+    size_t offset;              // input bytes consumed, for error messages
+    uint32_t items;             // top-level items completed
+    uint8_t depth;
+    uint8_t head_len;           // bytes of the item head collected so far
+    uint8_t head_need;
+    bool key_token;             // the text being collected is a member name
+    uint8_t head[9];
+    uint64_t str_left;          // text bytes still to come
+    uint64_t skip;              // byte string bytes still to come
+    size_t used;
+    dm_cbor_frame_t frames[DM_JSON_READER_MAX_DEPTH];
+    char token[DM_JSON_READER_TOKEN_MAX];
+} dm_cbor_reader_t;
+
+void dm_cbor_reader_init(dm_cbor_reader_t *r, dm_json_event_fn on_event, void *ctx);
+esp_err_t dm_cbor_reader_feed(dm_cbor_reader_t *r, const uint8_t *data, size_t len);
+// End of input: ESP_OK when at least one item was read and none is left open.
+esp_err_t dm_cbor_reader_finish(dm_cbor_reader_t *r);
+
+#ifdef __cplusplus
+}
+#endif
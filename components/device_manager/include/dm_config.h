@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "device_manager.h"
+#include "dm_config_arena.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A config generation is the device_manager_config_t header plus one arena holding the
+// device array, the scenario and step arrays (sized to what is used) and the pooled step
+// strings. Replacing the devices starts a new arena, so nothing is freed piecemeal.
+
+#ifdef CONFIG_BROKER_DM_CONFIG_BUDGET_KB
+#define DM_CONFIG_BUDGET_BYTES ((size_t)CONFIG_BROKER_DM_CONFIG_BUDGET_KB * 1024u)
+#else
+#define DM_CONFIG_BUDGET_BYTES ((size_t)512u * 1024u)
+#endif
+
+// Zeroed header with room for `device_capacity` devices (may be 0).
+device_manager_config_t *dm_config_create(uint8_t device_capacity);
+void dm_config_destroy(device_manager_config_t *cfg);
+
+// Drops every device and starts a fresh arena with `device_capacity` zeroed slots.
+esp_err_t dm_config_reset_devices(device_manager_config_t *cfg, uint8_t device_capacity);
+// Grows the device array, keeping its contents.
+esp_err_t dm_config_reserve_devices(device_manager_config_t *cfg, uint8_t device_capacity);
+// Drops the unused slots past device_count once the device list is complete.
+void dm_config_trim_devices(device_manager_config_t *cfg);
+
+// Zeroed arrays from the config arena; NULL when `count` is 0 or the budget is spent.
+device_scenario_t *dm_config_alloc_scenarios(device_manager_config_t *cfg, uint8_t count);
+device_action_step_t *dm_config_alloc_steps(device_manager_config_t *cfg, uint8_t count);
+// Append one zeroed entry, growing the array; NULL at the per-device/per-scenario limit.
+device_scenario_t *dm_config_add_scenario(device_manager_config_t *cfg, device_descriptor_t *dev);
+device_action_step_t *dm_config_add_step(device_manager_config_t *cfg, device_scenario_t *scenario);
+
+// Pooled string, see dm_config_arena_intern(). NULL only when the budget is spent.
+const char *dm_config_str(device_manager_config_t *cfg, const char *str, size_t max_len);
+// Re-pools the strings of the step's action type in cfg; missing ones become "".
+esp_err_t dm_config_intern_step(device_manager_config_t *cfg, device_action_step_t *step);
+
+// Deep copies; dest gets a new arena and keeps its own on failure.
+esp_err_t dm_config_copy(device_manager_config_t *dest, const device_manager_config_t *src);
+esp_err_t dm_config_copy_device(device_manager_config_t *cfg,
+                                device_descriptor_t *dst,
+                                const device_descriptor_t *src);
+
+// Content hash that follows the scenario/step arrays and strings instead of their
+// addresses. The template block is included on request.
+uint64_t dm_config_device_digest(const device_descriptor_t *dev, bool with_template);
+// Bytes one device takes: its slot plus the arrays it owns (pooled strings excluded).
+size_t dm_config_device_bytes(const device_descriptor_t *dev);
+
+#ifdef __cplusplus
+}
+#endif
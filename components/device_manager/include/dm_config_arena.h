@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Bump allocator behind one config generation. Memory comes from PSRAM in chunks, is only
+// released all at once, and the total is capped by a byte budget so a large room fails
+// cleanly instead of starving the heap. Strings are interned: equal text is stored once.
+
+typedef struct dm_config_arena dm_config_arena_t;
+
+typedef struct {
+    size_t budget;
+    size_t reserved;            // heap bytes held: chunks plus the string table
+    size_t used;                // bytes handed out
+    uint32_t strings;           // distinct pooled strings
+    size_t string_bytes;        // their text, terminators included
+    uint32_t string_hits;       // lookups answered by an existing copy
+} dm_config_arena_stats_t;
+
+dm_config_arena_t *dm_config_arena_create(size_t budget);
+void dm_config_arena_destroy(dm_config_arena_t *arena);
+
+// Zeroed and pointer aligned; NULL once the budget is spent.
+void *dm_config_arena_alloc(dm_config_arena_t *arena, size_t size);
+// Extends the newest block in place when possible, otherwise copies; the tail is zeroed.
+// A block that has a chunk to itself is reallocated instead, so it may move.
+void *dm_config_arena_grow(dm_config_arena_t *arena, void *ptr, size_t old_size, size_t new_size);
+// Gives back the end of the newest block or of a block with its own chunk (which may move);
+// anything else is returned unchanged.
+void *dm_config_arena_shrink(dm_config_arena_t *arena, void *ptr, size_t old_size, size_t new_size);
+// Pooled copy of `str` cut to `max_len - 1` bytes; NULL and "" map to a shared "".
+// Returns NULL only when the budget is spent.
+const char *dm_config_arena_intern(dm_config_arena_t *arena, const char *str, size_t max_len);
+
+void dm_config_arena_get_stats(const dm_config_arena_t *arena, dm_config_arena_stats_t *out);
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "esp_err.h"
+
+// Crash-safe file replace for config files on the SD card. Data goes to "<path>.tmp", is
+// fsynced, and then takes the place of <path>. FAT cannot rename over an existing file,
+// so the old file is removed first; dm_file_recover() finishes a replace cut off between
+// those two steps.
+
+#define DM_FILE_PATH_MAX 160
+
+typedef struct {
+    const void *data;
+    size_t len;
+} dm_file_part_t;
+
+esp_err_t dm_file_write_atomic(const char *path, const dm_file_part_t *parts, size_t count);
+
+// The same replace for data produced piecewise: begin, any number of writes, then commit
+// (or abort, which leaves <path> untouched). A failed write makes commit fail.
+typedef struct {
+    FILE *fp;
+    bool failed;
+    char path[DM_FILE_PATH_MAX];
+    char tmp[DM_FILE_PATH_MAX];
+} dm_file_atomic_t;
+
+esp_err_t dm_file_atomic_begin(dm_file_atomic_t *file, const char *path);
+esp_err_t dm_file_atomic_write(dm_file_atomic_t *file, const void *data, size_t len);
+esp_err_t dm_file_atomic_commit(dm_file_atomic_t *file);
+void dm_file_atomic_abort(dm_file_atomic_t *file);
+// Call before reading <path>: promotes a complete temp file left by an interrupted replace,
+// drops a stale one otherwise.
+void dm_file_recover(const char *path);
+// Removes <path> and any temp or staged file; a missing file is not an error.
+esp_err_t dm_file_remove(const char *path);
+
+// Replacing several files together: dm_file_stage() writes "<path>.new" and leaves <path>
+// alone; once every file is staged, dm_file_promote() moves each into place through the
+// same temp-file replace, or dm_file_unstage() drops them all.
+esp_err_t dm_file_stage(const char *path, const dm_file_part_t *parts, size_t count);
+esp_err_t dm_file_promote(const char *path);
+void dm_file_unstage(const char *path);
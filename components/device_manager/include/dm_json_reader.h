@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// Incremental JSON tokenizer, the reading side of dm_json_writer.h. Input is fed in pieces
+// of any size (an HTTP body as it arrives, a file read in blocks) and every key and value is
+// handed to a callback as soon as it is complete; no tree is built and nothing is allocated.
+//
+// Strings are decoded (escapes, \u sequences as UTF-8) into a fixed token buffer and cut to
+// DM_JSON_READER_TOKEN_MAX - 1 bytes, which is more than any config field holds. The first
+// syntax or callback error sticks and is reported again by every later call.
+
+#define DM_JSON_READER_TOKEN_MAX 256
+#define DM_JSON_READER_MAX_DEPTH 32
+
+typedef enum {
+    DM_JSON_EVENT_OBJECT_BEGIN,
+    DM_JSON_EVENT_OBJECT_END,
+    DM_JSON_EVENT_ARRAY_BEGIN,
+    DM_JSON_EVENT_ARRAY_END,
+    DM_JSON_EVENT_KEY,          // str holds the member name; its value follows
+    DM_JSON_EVENT_STRING,
+    DM_JSON_EVENT_NUMBER,
+    DM_JSON_EVENT_BOOL,
+    DM_JSON_EVENT_NULL,
+} dm_json_event_t;
+
+typedef struct {
+    const char *str;            // KEY/STRING: NUL-terminated, valid during the callback only
+    size_t len;
+    double number;
+    bool boolean;
+} dm_json_value_t;
+
+// Anything but ESP_OK stops the reader with that error.
+typedef esp_err_t (*dm_json_event_fn)(void *ctx, dm_json_event_t event, const dm_json_value_t *value);
+
+// Pull side for stream importers: fills `buf` with up to `cap` bytes; *out_len == 0 marks the end.
+typedef esp_err_t (*dm_json_source_fn)(void *ctx, char *buf, size_t cap, size_t *out_len);
+
+typedef struct {
+    dm_json_event_fn on_event;
+    void *ctx;
+    esp_err_t err;
+    size_t offset;              // input bytes consumed, for error messages
+    uint32_t in_object;         // bit per open container: object (1) or array (0)
+    uint8_t depth;
+    uint8_t expect;             // grammar position, see dm_json_reader.c
+    uint8_t lex;                // token being collected
+    bool key_token;             // the string being collected is a member name
+    uint8_t hex_digits;
+    uint16_t hex;               // \u escape being read
+    uint16_t high_surrogate;    // first half of a \u pair, waiting for the second
+    size_t used;
+    char token[DM_JSON_READER_TOKEN_MAX];
+} dm_json_reader_t;
+
+void dm_json_reader_init(dm_json_reader_t *r, dm_json_event_fn on_event, void *ctx);
+esp_err_t dm_json_reader_feed(dm_json_reader_t *r, const char *data, size_t len);
+// End of input: ESP_OK only when exactly one complete document was read.
+esp_err_t dm_json_reader_finish(dm_json_reader_t *r);
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// Streaming JSON emitter. Output collects in a small fixed buffer that is handed to a sink
+// (HTTP chunk, file) whenever it fills, so no document tree or full-size string is built.
+// Numbers and string escapes are formatted the way cJSON_PrintUnformatted() does.
+//
+// A writer set up with dm_json_writer_init_cbor() takes the same calls and emits CBOR
+// instead (see dm_cbor.h).
+//
+// The first sink or nesting error sticks: later calls do nothing and
+// dm_json_writer_finish() reports it.
+
+#define DM_JSON_WRITER_BUF_SIZE  512
+#define DM_JSON_WRITER_MAX_DEPTH 32
+
+typedef esp_err_t (*dm_json_sink_fn)(void *ctx, const char *data, size_t len);
+
+typedef struct {
+    dm_json_sink_fn sink;
+    void *ctx;
+    esp_err_t err;
+    uint32_t need_comma;    // bit per open container: a value was already written there
+    uint8_t depth;
+    bool after_key;
+    bool cbor;
+    size_t used;
+    size_t total;           // bytes handed to the sink so far
+    char buf[DM_JSON_WRITER_BUF_SIZE];
+} dm_json_writer_t;
+
+void dm_json_writer_init(dm_json_writer_t *w, dm_json_sink_fn sink, void *ctx);
+void dm_json_writer_init_cbor(dm_json_writer_t *w, dm_json_sink_fn sink, void *ctx);
+// Flushes the buffer; returns the first error seen.
+esp_err_t dm_json_writer_finish(dm_json_writer_t *w);
+
+void dm_json_begin_object(dm_json_writer_t *w);
+void dm_json_end_object(dm_json_writer_t *w);
+void dm_json_begin_array(dm_json_writer_t *w);
+void dm_json_end_array(dm_json_writer_t *w);
+void dm_json_key(dm_json_writer_t *w, const char *key);
+// NULL is written as an empty string.
+void dm_json_string(dm_json_writer_t *w, const char *value);
+void dm_json_number(dm_json_writer_t *w, double value);
+void dm_json_bool(dm_json_writer_t *w, bool value);
+void dm_json_null(dm_json_writer_t *w);
+
+static inline void dm_json_kv_string(dm_json_writer_t *w, const char *key, const char *value)
+{
+    dm_json_key(w, key);
+    dm_json_string(w, value);
+}
+
+static inline void dm_json_kv_number(dm_json_writer_t *w, const char *key, double value)
+{
+    dm_json_key(w, key);
+    dm_json_number(w, value);
+}
+
+static inline void dm_json_kv_bool(dm_json_writer_t *w, const char *key, bool value)
+{
+    dm_json_key(w, key);
+    dm_json_bool(w, value);
+}
+
+// Sink that collects the document in one growing PSRAM buffer, for callers that need a string.
+typedef struct {
+    char *data;             // NUL-terminated; owned by the caller once filled (heap_caps_free)
+    size_t len;
+    size_t cap;
+} dm_json_buffer_t;
+
+esp_err_t dm_json_buffer_sink(void *ctx, const char *data, size_t len);
@@ -1,6 +1,8 @@
 #pragma once
 
-#define DEVICE_MANAGER_MAX_DEVICES               12
+// Ceiling for the uint8_t device counts and per-device runtime tables; how many devices
+// actually fit is decided by the config memory budget (dm_config.h).
+#define DEVICE_MANAGER_MAX_DEVICES               64
 #define DEVICE_MANAGER_MAX_TOPICS_PER_DEVICE     6
 #define DEVICE_MANAGER_MAX_SCENARIOS_PER_DEVICE  8
 #define DEVICE_MANAGER_MAX_STEPS_PER_SCENARIO   16
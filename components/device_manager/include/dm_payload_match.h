@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "dm_templates.h"
+
+// MQTT trigger rule conditions compiled into a short instruction list at registration.
+// Evaluation walks the payload bytes in place: path steps narrow a cursor onto one JSON
+// value, compare steps test it. Nothing is allocated and no cJSON tree is built.
+// Operand strings are borrowed from the rule and must outlive the program.
+
+#define DM_PAYLOAD_PATH_MAX_DEPTH 4
+#define DM_PAYLOAD_PROGRAM_MAX    (DM_PAYLOAD_PATH_MAX_DEPTH + 2)
+
+typedef enum {
+    DM_PAYLOAD_OP_ACCEPT = 0,
+    DM_PAYLOAD_OP_REJECT,
+    DM_PAYLOAD_OP_KEY,          // descend into object member `str`
+    DM_PAYLOAD_OP_INDEX,        // descend into array element `index`
+    DM_PAYLOAD_OP_EQ,
+    DM_PAYLOAD_OP_EQ_NOCASE,
+    DM_PAYLOAD_OP_PREFIX,
+    DM_PAYLOAD_OP_CONTAINS,
+    DM_PAYLOAD_OP_MIN,          // value is a number >= num
+    DM_PAYLOAD_OP_MAX,          // value is a number <= num
+    DM_PAYLOAD_OP_NUMBER,       // value is a number
+} dm_payload_op_t;
+
+typedef struct {
+    uint8_t op;
+    uint8_t len;
+    uint16_t index;
+    union {
+        const char *str;
+        float num;
+    };
+} dm_payload_insn_t;
+
+typedef struct {
+    uint8_t count;
+    dm_payload_insn_t insns[DM_PAYLOAD_PROGRAM_MAX];
+} dm_payload_program_t;
+
+// ESP_ERR_INVALID_ARG for an unknown op or a path that does not parse.
+esp_err_t dm_payload_program_compile(dm_payload_program_t *prog,
+                                     const dm_mqtt_trigger_rule_t *rule,
+                                     const dm_mqtt_rule_match_t *match);
+bool dm_payload_program_run(const dm_payload_program_t *prog, const char *payload);
+
+const char *dm_mqtt_match_op_to_string(dm_mqtt_match_op_t op);
+bool dm_mqtt_match_op_from_string(const char *name, dm_mqtt_match_op_t *out);
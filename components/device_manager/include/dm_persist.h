@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "device_manager.h"
+
+#define DM_CONFIG_BACKUP_PATH "/sdcard/brocker_devices.json"
+
+// Write-behind persistence of the published config: the active profile file and the JSON
+// backup. Requests only wake a background task, which waits for a burst of changes to
+// settle and then writes the newest generation once; failed writes are retried with backoff.
+
+// `persisted_generation` is the generation already on the card.
+esp_err_t dm_persist_start(uint32_t persisted_generation);
+// Schedules a write of whatever generation is published when the task runs.
+void dm_persist_request(void);
+// Writes the published generation now unless it is already on the card. Also waits for a
+// write in progress, so profile files can be read or switched safely afterwards.
+esp_err_t dm_persist_flush(void);
+// The published generation came from the card (reload), nothing to write for it.
+void dm_persist_mark_clean(uint32_t generation);
+void dm_persist_get_status(device_manager_persist_status_t *out);
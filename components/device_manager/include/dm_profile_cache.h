@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "device_manager.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Decoded generations of inactive profiles, kept in PSRAM so switching back to one skips the
+// SD read and the decode. Entries are whole refcounted generations keyed by their
+// active_profile; the least recently used ones go first once the byte budget is exceeded.
+// Every call except dm_profile_cache_get_status() is made under the device manager writer
+// lock.
+
+#ifdef CONFIG_BROKER_PROFILE_CACHE_KB
+#define DM_PROFILE_CACHE_BUDGET_BYTES ((size_t)CONFIG_BROKER_PROFILE_CACHE_KB * 1024u)
+#else
+#define DM_PROFILE_CACHE_BUDGET_BYTES ((size_t)1024u * 1024u)
+#endif
+
+// Drops one reference to a generation that left the cache.
+typedef void (*dm_profile_cache_release_fn)(const device_manager_config_t *cfg);
+
+// A budget of 0 disables the cache; entries above the new budget are dropped.
+void dm_profile_cache_init(size_t budget, dm_profile_cache_release_fn release);
+// Keeps `cfg` for profile cfg->active_profile, taking over one reference to it. It must match
+// that profile's file on the card. Replaces an older entry of the profile.
+void dm_profile_cache_put(device_manager_config_t *cfg);
+// Hands the reference kept for `id` back to the caller (a hit) or returns NULL (a miss).
+device_manager_config_t *dm_profile_cache_take(const char *id);
+// Forgets `id`, e.g. once it is live again, edited or deleted.
+void dm_profile_cache_drop(const char *id);
+void dm_profile_cache_clear(void);
+// Records how long one profile switch took, from request to runtimes in place.
+void dm_profile_cache_note_switch(int64_t duration_us, bool cached);
+void dm_profile_cache_get_status(device_manager_profile_cache_status_t *out);
+
+#ifdef __cplusplus
+}
+#endif
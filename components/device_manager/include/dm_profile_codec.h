@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "device_manager.h"
+
+// Compact profile body (file format v5). Each device is one length-prefixed record holding
+// only the used topics, scenarios and steps; strings carry their length and unions are
+// stored as zero-run encoded blobs, so unused rules and string padding cost a few bytes.
+// Readers skip bytes past the fields they know, and blobs shorter than the struct read
+// as zero-extended, so fields appended later stay readable both ways.
+
+#define DM_PROFILE_BODY_LZ      0x01u   // body is LZ block compressed
+
+// Encodes `count` descriptors; *out is heap allocated and released with heap_caps_free().
+esp_err_t dm_profile_encode(const device_descriptor_t *devices, uint8_t count, uint8_t **out, size_t *out_len);
+// Replaces the devices of cfg with `record_count` decoded records (the ones past
+// DEVICE_MANAGER_MAX_DEVICES are skipped); on failure cfg is left without devices.
+esp_err_t dm_profile_decode(const uint8_t *data, size_t len, uint32_t record_count, device_manager_config_t *cfg);
+
+// LZ4-style block codec. Returns the compressed size, or 0 when the result would not fit
+// `dst_cap` (store uncompressed then).
+size_t dm_profile_lz_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t dst_cap);
+// Fails unless exactly `dst_len` bytes are produced.
+esp_err_t dm_profile_lz_decompress(const uint8_t *src, size_t len, uint8_t *dst, size_t dst_len);
+
+uint32_t dm_profile_crc32(uint32_t crc, const void *data, size_t len);
@@ -12,9 +12,9 @@ void dm_profiles_sync_from_active(device_manager_config_t *cfg, bool create_if_m
 void dm_profiles_sync_to_active(device_manager_config_t *cfg);
 bool dm_profiles_id_valid(const char *id);
 esp_err_t dm_profiles_store_active(const device_manager_config_t *cfg);
-esp_err_t dm_profiles_load_profile(const char *profile_id,
-                                   device_descriptor_t *devices,
-                                   uint8_t capacity,
-                                   uint8_t *device_count);
+// Writes the active profile of each non-NULL config; a failed write changes none of the files.
+esp_err_t dm_profiles_store_all(device_manager_config_t *const *cfgs, size_t count);
+// Replaces the devices of cfg with the stored ones; cfg is left without devices on failure.
+esp_err_t dm_profiles_load_profile(const char *profile_id, device_manager_config_t *cfg);
 esp_err_t dm_profiles_delete_profile_file(const char *profile_id);
 esp_err_t dm_profiles_export_raw(const char *profile_id, uint8_t **out_data, size_t *out_size);
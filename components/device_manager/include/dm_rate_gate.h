@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "dm_templates.h"
+#include "dm_timer_wheel.h"
+
+// Runtime side of a dm_rate_limit_t: decides per event whether its owner acts now, and for
+// trailing edges calls `fire` from the timer wheel when the window closes. Decisions are
+// taken under the wheel lock, so they never interleave with a trailing fire.
+
+struct dm_rate_gate;
+typedef void (*dm_rate_fire_cb_t)(struct dm_rate_gate *gate, void *arg);
+
+typedef struct dm_rate_gate {
+    dm_rate_limit_t limit;
+    dm_timer_t window;
+    bool pending;               // a trailing fire is owed when the window closes
+    uint32_t passed;            // events acted on, leading or trailing
+    uint32_t suppressed;        // events dropped or merged into a trailing fire
+    dm_rate_fire_cb_t fire;
+    void *arg;
+} dm_rate_gate_t;
+
+// `limit` may be NULL or DEFAULT, in which case `fallback` applies (NULL: no limit).
+void dm_rate_gate_init(dm_rate_gate_t *gate,
+                       const dm_rate_limit_t *limit,
+                       const dm_rate_limit_t *fallback,
+                       dm_rate_fire_cb_t fire,
+                       void *arg);
+// True when the caller should act on this event now.
+bool dm_rate_gate_admit(dm_rate_gate_t *gate);
+// Closes the window and forgets a pending trailing fire; counters are kept.
+void dm_rate_gate_reset(dm_rate_gate_t *gate);
+bool dm_rate_gate_active(const dm_rate_gate_t *gate);
+
+const char *dm_rate_mode_to_string(dm_rate_mode_t mode);
+bool dm_rate_mode_from_string(const char *name, dm_rate_mode_t *out);
+// "leading", "trailing" or "both".
+const char *dm_rate_edges_to_string(uint8_t edges);
+bool dm_rate_edges_from_string(const char *name, uint8_t *out);
@@ -4,7 +4,7 @@
 #include "dm_templates.h"
 
 typedef struct {
-    dm_condition_template_t config;
+    const dm_condition_template_t *config;
     struct {
         bool valid;
         bool state;
@@ -6,7 +6,7 @@
 #include "dm_templates.h"
 
 typedef struct {
-    dm_flag_trigger_template_t config;
+    const dm_flag_trigger_template_t *config;
     struct {
         bool valid;
         bool last_state;
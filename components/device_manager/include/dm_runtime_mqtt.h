@@ -2,9 +2,11 @@
 
 #include "device_manager.h"
 #include "dm_templates.h"
+#include "dm_payload_match.h"
 
 typedef struct {
-    dm_mqtt_trigger_template_t config;
+    const dm_mqtt_trigger_template_t *config;
+    dm_payload_program_t programs[DM_MQTT_TRIGGER_MAX_RULES];
 } dm_mqtt_trigger_runtime_t;
 
 void dm_mqtt_trigger_runtime_init(dm_mqtt_trigger_runtime_t *rt, const dm_mqtt_trigger_template_t *tpl);
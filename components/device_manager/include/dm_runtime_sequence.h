@@ -14,7 +14,7 @@ typedef enum {
 } dm_sequence_event_type_t;
 
 typedef struct {
-    dm_sequence_template_t config;
+    const dm_sequence_template_t *config;
     uint8_t current_index;
     uint64_t last_step_ms;
 } dm_sequence_runtime_t;
@@ -31,3 +31,5 @@ dm_sequence_action_t dm_sequence_runtime_handle(dm_sequence_runtime_t *rt,
                                                 const char *topic,
                                                 const char *payload,
                                                 uint64_t now_ms);
+// Step deadline passed: resets a sequence in progress and reports a timeout failure.
+dm_sequence_action_t dm_sequence_runtime_timeout(dm_sequence_runtime_t *rt);
@@ -4,7 +4,7 @@
 #include "dm_templates.h"
 
 typedef struct {
-    dm_signal_hold_template_t config;
+    const dm_signal_hold_template_t *config;
     dm_signal_state_t state;
 } dm_signal_runtime_t;
 
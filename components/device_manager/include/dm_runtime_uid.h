@@ -2,9 +2,11 @@
 
 #include "device_manager.h"
 #include "dm_templates.h"
+#include "dm_uid_set.h"
 
 typedef struct {
-    dm_uid_template_t config;
+    const dm_uid_template_t *config;
+    dm_uid_set_t values[DM_UID_TEMPLATE_MAX_SLOTS];     // accepted UIDs, inline and from files
     dm_uid_state_t state;
     struct {
         bool has_value;
@@ -28,7 +30,12 @@ typedef struct {
 } dm_uid_action_t;
 
 void dm_uid_runtime_init(dm_uid_runtime_t *rt, const dm_uid_template_t *tpl);
+// Folds the size and mtime of every '@' list file into `hash`, so a runtime built from an
+// older copy of a file no longer matches the digest of the same template.
+uint64_t dm_uid_template_files_digest(const dm_uid_template_t *tpl, uint64_t hash);
 void dm_uid_runtime_set_template(dm_uid_runtime_t *rt, const dm_uid_template_t *tpl);
+// Frees the value sets built by init/set_template.
+void dm_uid_runtime_deinit(dm_uid_runtime_t *rt);
 void dm_uid_runtime_reset(dm_uid_runtime_t *rt);
 dm_uid_action_t dm_uid_runtime_handle_value(dm_uid_runtime_t *rt,
                                             const char *source_id,
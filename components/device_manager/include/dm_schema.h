@@ -0,0 +1,95 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "device_manager.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Field tables for the fixed-layout config structs: the templates of dm_templates.h, the
+// device topic list and the scenario header. The JSON importer, the JSON exporter and the
+// checks on imported or decoded templates walk these tables instead of knowing each
+// struct, so a template type is added by describing it here once.
+//
+// A member sits at base + offset + index * stride: records that are entries of a list pass
+// their index, and a list entry may span parallel arrays (mqtt rules, matches and limits),
+// each member with the stride of its own array.
+
+typedef enum {
+    DM_FIELD_STR,       // char[size]
+    DM_FIELD_STRS,      // char[max][size] filled in order, uint8_t count at `aux`
+    DM_FIELD_U32,
+    DM_FIELD_BOOL,
+    DM_FIELD_FLOAT,     // float with a bool "given" flag at `aux`
+    DM_FIELD_ENUM,      // 1 or 4 byte integer, named through `ref` (dm_field_names_t)
+    DM_FIELD_LIMIT,     // dm_rate_limit_t, a {"mode","edges","window_ms"} object in JSON
+    DM_FIELD_LIST,      // up to `max` entries of record `ref`, uint8_t count at `aux`
+} dm_field_kind_t;
+
+#define DM_FIELD_ALWAYS     0x01    // exported even when empty, zero or false
+#define DM_FIELD_REQUIRED   0x02    // non-empty / non-zero, or the record is unusable
+#define DM_FIELD_STRICT     0x04    // ENUM: a name that does not parse makes the record unusable
+#define DM_FIELD_FOLLOWS    0x08    // BOOL: defaults to whether the field before it is set
+#define DM_FIELD_DEFAULT_ON 0x10    // BOOL: true unless given
+
+typedef struct {
+    const char *(*to_string)(int value);
+    bool (*from_string)(const char *name, int *out);
+} dm_field_names_t;
+
+typedef struct {
+    const char *key;        // JSON member name
+    uint8_t kind;           // dm_field_kind_t
+    uint8_t flags;          // DM_FIELD_*
+    uint8_t max;            // STRS, LIST: capacity
+    uint16_t offset;        // from the record base
+    uint16_t stride;        // entry size of the array the member is in (list entries)
+    uint16_t size;          // sizeof the member; one string for STRS
+    uint16_t aux;           // see dm_field_kind_t
+    const void *ref;
+} dm_field_t;
+
+typedef struct {
+    const dm_field_t *fields;
+    uint8_t count;
+    // Test beyond the REQUIRED flags, run on a record that has them all; may log why.
+    bool (*check)(const void *base, uint8_t index);
+} dm_record_t;
+
+typedef struct {
+    dm_template_type_t type;
+    const char *section;    // member of "template" holding the fields
+    void (*clear)(dm_template_config_t *tpl);   // defaults before the fields are read
+    dm_record_t record;     // members of tpl->data
+} dm_template_schema_t;
+
+// NULL for an unknown type.
+const dm_template_schema_t *dm_template_schema(dm_template_type_t type);
+const dm_template_schema_t *dm_template_schema_by_section(const char *section);
+
+// "topics" of a device (device_descriptor_t base) and the scalar members of a scenario.
+const dm_field_t *dm_schema_device_topics(void);
+const dm_record_t *dm_schema_scenario(void);
+
+const dm_field_t *dm_record_find(const dm_record_t *rec, const char *key);
+void *dm_field_ptr(const dm_field_t *field, const void *base, uint8_t index);
+const char *dm_field_str(const dm_field_t *field, const void *base, uint8_t index, uint8_t n);
+uint8_t *dm_field_count(const dm_field_t *field, const void *base, uint8_t index);
+int dm_field_get_int(const dm_field_t *field, const void *base, uint8_t index);
+void dm_field_set_int(const dm_field_t *field, void *base, uint8_t index, int value);
+bool dm_field_is_set(const dm_field_t *field, const void *base, uint8_t index);
+
+// Zeroes the members of one list entry (DEFAULT_ON is left to the importer).
+void dm_record_clear(const dm_record_t *rec, void *base, uint8_t index);
+// Every REQUIRED member set; with `check`, also the record's own test.
+bool dm_record_usable(const dm_record_t *rec, const void *base, uint8_t index, bool check);
+// The template is of a known type and would be accepted by the importer.
+bool dm_template_config_usable(const dm_template_config_t *tpl);
+
+#ifdef __cplusplus
+}
+#endif
@@ -3,12 +3,31 @@
 #include <stddef.h>
 #include "esp_err.h"
 #include "device_manager.h"
+#include "dm_json_reader.h"
+#include "dm_json_writer.h"
 
 esp_err_t dm_storage_load(const char *path, device_manager_config_t *cfg);
 esp_err_t dm_storage_save(const char *path, const device_manager_config_t *cfg);
 esp_err_t dm_storage_export_json(const device_manager_config_t *cfg, char **out_json, size_t *out_len);
+// Same document as dm_storage_export_json(), handed to `sink` piecewise.
+esp_err_t dm_storage_export_stream(const device_manager_config_t *cfg, dm_json_sink_fn sink, void *ctx);
 esp_err_t dm_storage_parse_json(const char *json, size_t len, device_manager_config_t *cfg);
+// Parses a document pulled from `source` a chunk at a time; the whole text is never held.
+esp_err_t dm_storage_parse_stream(dm_json_source_fn source, void *ctx, device_manager_config_t *cfg);
+
+// Fills `cfg` from the events of one config document (dm_json_reader.h, dm_cbor.h), the
+// importer behind dm_storage_parse_stream() for other event sources.
+typedef struct dm_config_builder dm_config_builder_t;
+dm_config_builder_t *dm_config_builder_create(device_manager_config_t *cfg);
+esp_err_t dm_config_builder_event(void *builder, dm_json_event_t event, const dm_json_value_t *value);
+// After the document closed: trims the device list and settles the profile entry.
+esp_err_t dm_config_builder_finish(dm_config_builder_t *builder);
+void dm_config_builder_destroy(dm_config_builder_t *builder);
+
+// Writes the document of `cfg` into an open writer, JSON or CBOR.
+void dm_storage_write_config(dm_json_writer_t *w, const device_manager_config_t *cfg);
 
 // Internal hooks implemented in core (JSON serializers)
 esp_err_t dm_storage_internal_parse(const char *json, size_t len, device_manager_config_t *cfg);
-esp_err_t dm_storage_internal_export(const device_manager_config_t *cfg, char **out_json, size_t *out_len);
+esp_err_t dm_storage_internal_parse_stream(dm_json_source_fn source, void *ctx, device_manager_config_t *cfg);
+esp_err_t dm_storage_internal_export_stream(const device_manager_config_t *cfg, dm_json_sink_fn sink, void *ctx);
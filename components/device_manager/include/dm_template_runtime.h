@@ -3,13 +3,59 @@
 #include <stdbool.h>
 #include "esp_err.h"
 
+#include "device_manager.h"
 #include "dm_template_registry.h"
 
 esp_err_t dm_template_runtime_init(void);
 void dm_template_runtime_reset(void);
-esp_err_t dm_template_runtime_register(const dm_template_config_t *tpl, const char *device_id);
+// Replaces any runtime already registered for device_id. The runtime reads tpl in place and
+// holds a reference on owner, the generation tpl lives in; a NULL owner means the caller
+// keeps tpl alive until the runtime is replaced or dropped.
+esp_err_t dm_template_runtime_register(const device_manager_config_t *owner,
+                                       const dm_template_config_t *tpl,
+                                       const char *device_id);
+// Points runtimes whose template is unchanged in cfg at cfg's copy, so the generations they
+// were registered from can be freed. Returns the number of runtimes moved.
+size_t dm_template_runtime_adopt(const device_manager_config_t *cfg);
+// Drops one device's runtime; the others keep their state and timers.
+void dm_template_runtime_unregister(const char *device_id);
+// Returns every registered runtime to its just-registered state without re-reading the
+// config or rebuilding the topic index. Returns the number of runtimes reset.
+size_t dm_template_runtime_reset_state(void);
 bool dm_template_runtime_handle_mqtt(const char *topic, const char *payload);
 bool dm_template_runtime_handle_flag(const char *flag_name, bool state);
+
+typedef struct {
+    uint32_t generation;        // bumped whenever the runtime set changes
+    size_t runtimes;
+    size_t bytes;               // runtime entries
+    size_t arena_bytes;         // runtime arena chunks held, free blocks included
+    size_t topics;
+    size_t bindings;
+    uint32_t rate_passed;       // events let through by rate gates
+    uint32_t rate_suppressed;   // events dropped by debounce/throttle windows
+} dm_template_runtime_stats_t;
+
+void dm_template_runtime_get_stats(dm_template_runtime_stats_t *out);
+
+// Mutable state of one runtime in a flat record, for checkpoints. Stateless templates
+// (mqtt_trigger, interval_task) are not exported.
+#define DM_RUNTIME_STATE_MAX 288
+
+typedef struct {
+    char device_id[DEVICE_MANAGER_ID_MAX_LEN];
+    uint8_t type;               // dm_template_type_t
+    uint16_t len;
+    uint64_t config_hash;       // template the state was taken from
+    uint8_t data[DM_RUNTIME_STATE_MAX];
+} dm_runtime_state_t;
+
+// Fills out with up to max records; returns how many were written.
+size_t dm_template_runtime_export_state(dm_runtime_state_t *out, size_t max);
+// Applies a record to the runtime of the same device, type and template; ESP_ERR_NOT_FOUND
+// when there is none, ESP_ERR_INVALID_STATE when the template changed since.
+esp_err_t dm_template_runtime_import_state(const dm_runtime_state_t *state);
+
 typedef struct {
     char device_id[DEVICE_MANAGER_ID_MAX_LEN];
     uint8_t slot_count;
@@ -10,11 +10,33 @@ typedef enum {
     DEVICE_CONDITION_ANY,
 } device_condition_type_t;
 
+// Rate limiting -------------------------------------------------------------------
+
+typedef enum {
+    DM_RATE_MODE_DEFAULT = 0,   // whatever the owner does without a setting (usually no limit)
+    DM_RATE_MODE_NONE,
+    DM_RATE_MODE_DEBOUNCE,      // the window restarts on every event
+    DM_RATE_MODE_THROTTLE,      // the window opens on the first event and is not extended
+    DM_RATE_MODE_COUNT,
+} dm_rate_mode_t;
+
+#define DM_RATE_EDGE_LEADING   0x01    // act on the event that opens a window
+#define DM_RATE_EDGE_TRAILING  0x02    // act once more when a window closes on held-back events
+
+typedef struct {
+    uint8_t mode;               // dm_rate_mode_t
+    uint8_t edges;              // DM_RATE_EDGE_*, 0 reads as leading
+    uint16_t reserved;
+    uint32_t window_ms;
+} dm_rate_limit_t;
+
 // Generic UID validation template ------------------------------------------------
 
 #define DM_UID_TEMPLATE_MAX_SLOTS      8
 #define DM_UID_TEMPLATE_MAX_VALUES     8
 #define DM_UID_TEMPLATE_VALUE_MAX_LEN  32
+// A value of the form "@/sdcard/cards.csv" pulls the slot's accepted UIDs from that file.
+#define DM_UID_VALUE_FILE_PREFIX       '@'
 
 typedef struct {
     char source_id[DEVICE_MANAGER_ID_MAX_LEN];
@@ -45,6 +67,7 @@ typedef struct {
     char success_signal_payload[DEVICE_MANAGER_PAYLOAD_MAX_LEN];
     char fail_signal_topic[DEVICE_MANAGER_TOPIC_MAX_LEN];
     char fail_signal_payload[DEVICE_MANAGER_PAYLOAD_MAX_LEN];
+    dm_rate_limit_t start_limit;    // DEFAULT keeps the 300 ms start throttle
 } dm_uid_template_t;
 
 typedef enum {
@@ -73,10 +96,16 @@ bool dm_uid_template_set_slot(dm_uid_template_t *tpl, uint8_t index, const char
 bool dm_uid_template_add_value(dm_uid_template_t *tpl, uint8_t slot_index, const char *value);
 
 void dm_uid_state_reset(dm_uid_state_t *state);
+int dm_uid_find_slot(const dm_uid_template_t *tpl, const char *source_id);
 dm_uid_event_t dm_uid_handle_value(dm_uid_state_t *state,
                                    const dm_uid_template_t *tpl,
                                    const char *source_id,
                                    const char *value);
+// Same state machine as dm_uid_handle_value for callers that match values themselves.
+dm_uid_event_t dm_uid_handle_match(dm_uid_state_t *state,
+                                   const dm_uid_template_t *tpl,
+                                   int slot_index,
+                                   bool matched);
 bool dm_uid_state_is_complete(const dm_uid_state_t *state, const dm_uid_template_t *tpl);
 
 // Signal hold template -----------------------------------------------------------
@@ -138,9 +167,35 @@ typedef struct {
     bool payload_required;
 } dm_mqtt_trigger_rule_t;
 
+// How a rule looks at the payload. EXACT keeps the plain payload/payload_required check;
+// the others always apply and compare against `payload` (or min/max for RANGE).
+typedef enum {
+    DM_MQTT_MATCH_EXACT = 0,
+    DM_MQTT_MATCH_PREFIX,
+    DM_MQTT_MATCH_CONTAINS,
+    DM_MQTT_MATCH_EQUALS_NOCASE,
+    DM_MQTT_MATCH_RANGE,
+    DM_MQTT_MATCH_COUNT,
+} dm_mqtt_match_op_t;
+
+#define DM_MQTT_MATCH_FIELD_MAX_LEN 48
+
+typedef struct {
+    uint8_t op;                                 // dm_mqtt_match_op_t
+    bool has_min;
+    bool has_max;
+    char field[DM_MQTT_MATCH_FIELD_MAX_LEN];    // JSON path such as "dist" or "pos.x" or "list[2]"
+    float min;
+    float max;
+} dm_mqtt_rule_match_t;
+
 typedef struct {
     dm_mqtt_trigger_rule_t rules[DM_MQTT_TRIGGER_MAX_RULES];
     uint8_t rule_count;
+    // Kept after rule_count so rules[] and rule_count stay where v3 profiles stored them;
+    // the zeroed tail of an old record reads back as plain EXACT matching.
+    dm_mqtt_rule_match_t matches[DM_MQTT_TRIGGER_MAX_RULES];
+    dm_rate_limit_t limits[DM_MQTT_TRIGGER_MAX_RULES];
 } dm_mqtt_trigger_template_t;
 
 void dm_mqtt_trigger_template_clear(dm_mqtt_trigger_template_t *tpl);
@@ -159,6 +214,7 @@ typedef struct {
 typedef struct {
     dm_flag_trigger_rule_t rules[DM_FLAG_TRIGGER_MAX_RULES];
     uint8_t rule_count;
+    dm_rate_limit_t limits[DM_FLAG_TRIGGER_MAX_RULES];     // after rule_count, like the mqtt extras
 } dm_flag_trigger_template_t;
 
 void dm_flag_trigger_template_clear(dm_flag_trigger_template_t *tpl);
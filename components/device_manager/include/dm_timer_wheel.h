@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// Hashed timer wheel shared by the template runtimes. One esp_timer drives the wheel while
+// any deadline is armed; arming, re-arming and disarming are O(1). Callbacks run on the
+// esp_timer task with the wheel lock held, so disarm() never races a callback in flight.
+
+#define DM_TIMER_WHEEL_TICK_MS 10
+#define DM_TIMER_WHEEL_SLOTS   256     // power of two; one revolution is 2.56 s
+
+typedef void (*dm_timer_cb_t)(void *arg);
+
+typedef struct dm_timer {
+    struct dm_timer *next;
+    struct dm_timer *prev;
+    struct dm_timer *fire_next;
+    uint64_t deadline;          // absolute wheel tick
+    uint32_t period_ticks;      // 0 for one-shot timers
+    dm_timer_cb_t cb;
+    void *arg;
+    bool armed;
+    bool firing;
+} dm_timer_t;
+
+esp_err_t dm_timer_wheel_init(void);
+void dm_timer_init(dm_timer_t *timer, dm_timer_cb_t cb, void *arg);
+// Re-arming an armed timer moves its deadline.
+void dm_timer_arm(dm_timer_t *timer, uint32_t delay_ms);
+void dm_timer_arm_periodic(dm_timer_t *timer, uint32_t period_ms);
+void dm_timer_disarm(dm_timer_t *timer);
+bool dm_timer_armed(const dm_timer_t *timer);
+// Holds off callbacks while several timers change together; the lock is recursive.
+void dm_timer_wheel_lock(void);
+void dm_timer_wheel_unlock(void);
+// Fires everything due up to now_us; called by the driver timer, exposed for tests.
+void dm_timer_wheel_advance(int64_t now_us);
+// Moves the wheel clock to now_us, backwards too, without firing anything; armed timers
+// keep their remaining delay. For tests that drive the wheel with their own clock.
+void dm_timer_wheel_rebase(int64_t now_us);
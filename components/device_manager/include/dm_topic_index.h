@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// Topic -> (runtime, role) dispatch index built while template runtimes register.
+// Topic strings are borrowed from the runtime entries and must outlive the index.
+
+#define DM_TOPIC_INDEX_END 0xFFFFu
+
+typedef struct {
+    void *runtime;
+    uint8_t role;
+    uint16_t next;      // next binding for the same topic, DM_TOPIC_INDEX_END terminates
+} dm_topic_binding_t;
+
+typedef struct {
+    const char *topic;
+    uint32_t hash;
+    uint16_t head;
+    uint16_t tail;
+} dm_topic_slot_t;
+
+typedef struct {
+    dm_topic_slot_t *slots;
+    size_t slot_cap;            // power of two
+    size_t topic_count;
+    dm_topic_binding_t *bindings;
+    size_t binding_count;
+    size_t binding_cap;
+} dm_topic_index_t;
+
+// Empty topics are ignored; a (runtime, role) pair is stored once per topic.
+esp_err_t dm_topic_index_add(dm_topic_index_t *index, const char *topic, void *runtime, uint8_t role);
+// First binding for a topic in registration order, NULL when nothing listens on it.
+const dm_topic_binding_t *dm_topic_index_find(const dm_topic_index_t *index, const char *topic);
+const dm_topic_binding_t *dm_topic_index_next(const dm_topic_index_t *index, const dm_topic_binding_t *binding);
+void dm_topic_index_clear(dm_topic_index_t *index);
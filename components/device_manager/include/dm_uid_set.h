@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// Case-insensitive set of UID strings for one reader slot. Keys are folded to lower case,
+// packed into a single PSRAM string pool and found through an open-addressed hash table,
+// so a lookup costs the same for 5 cards as for 5000.
+
+typedef struct {
+    uint32_t hash;
+    uint32_t key;       // pool offset + 1, 0 marks an empty slot
+} dm_uid_set_entry_t;
+
+typedef struct {
+    dm_uid_set_entry_t *table;
+    size_t table_cap;
+    size_t count;
+    char *pool;
+    size_t pool_len;
+    size_t pool_cap;
+} dm_uid_set_t;
+
+// Values longer than DM_UID_TEMPLATE_VALUE_MAX_LEN - 1 are truncated like incoming reads.
+esp_err_t dm_uid_set_add(dm_uid_set_t *set, const char *value);
+bool dm_uid_set_contains(const dm_uid_set_t *set, const char *value);
+// One UID per line, taken from the first CSV column. Blank lines, '#' comments and a
+// leading "uid" header are skipped. `added` counts new keys.
+esp_err_t dm_uid_set_load_csv(dm_uid_set_t *set, const char *path, size_t *added);
+size_t dm_uid_set_footprint(const dm_uid_set_t *set);
+void dm_uid_set_clear(dm_uid_set_t *set);
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "device_manager.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Cross-reference check of a config generation. Indexing a device records what it defines
+// (scenario ids and names, flags its steps set, topics that start its scenarios) in one hash
+// table; checking looks every reference up there once, so a whole config costs time linear
+// in its size. Audio tracks and UID lists under DM_XREF_FILE_ROOT are looked for on the card
+// once per path and the answer is kept.
+//
+// Results are kept per device together with its dm_config_device_digest(): the next run
+// indexes and checks again only the devices whose content changed. Flag references span
+// devices, so "never set" is decided from the index each run.
+//
+// Not thread safe; the owner serializes runs.
+
+#ifndef DM_XREF_FILE_ROOT
+#define DM_XREF_FILE_ROOT "/sdcard"
+#endif
+
+typedef enum {
+    DM_XREF_MISSING_SCENARIO = 0,   // a topic or template names no scenario of the device
+    DM_XREF_DUPLICATE_SCENARIO,     // the id is taken by an earlier scenario, so it never runs
+    DM_XREF_FLAG_NEVER_SET,         // waited on or watched, but no set_flag step writes it
+    DM_XREF_MISSING_FILE,           // audio track or UID list not on the card
+    DM_XREF_BAD_TOPIC,              // wildcard in a publish topic, or a malformed filter
+    DM_XREF_SELF_TRIGGER,           // scenario publishes to a topic that starts it again
+    DM_XREF_CODE_COUNT,
+} dm_xref_code_t;
+
+typedef enum {
+    DM_XREF_ERROR = 0,
+    DM_XREF_WARNING,
+} dm_xref_severity_t;
+
+typedef struct {
+    uint8_t code;               // dm_xref_code_t
+    uint8_t severity;           // dm_xref_severity_t
+    uint8_t device;             // index into cfg->devices
+    int8_t scenario;            // -1 outside scenarios
+    int8_t step;                // -1 outside steps
+    int8_t item;                // topic, rule, slot or requirement index; -1 when none
+    const char *field;          // static, e.g. "template.rules.scenario"
+    char ref[DEVICE_MANAGER_TOPIC_MAX_LEN];     // the name that did not resolve
+} dm_xref_issue_t;
+
+typedef struct {
+    uint16_t errors;
+    uint16_t warnings;
+    uint8_t devices;
+    uint8_t rechecked;          // devices indexed and checked by the last run
+    bool files_checked;         // DM_XREF_FILE_ROOT was there when the index was built
+} dm_xref_summary_t;
+
+typedef struct dm_xref dm_xref_t;
+
+dm_xref_t *dm_xref_create(void);
+void dm_xref_destroy(dm_xref_t *x);
+// Checks `cfg`, reusing what the previous run found for unchanged devices. `full` drops the
+// index first, which also asks the card again about every file.
+esp_err_t dm_xref_run(dm_xref_t *x, const device_manager_config_t *cfg, bool full);
+// Issues of the last run, ordered by device; valid until the next run.
+const dm_xref_issue_t *dm_xref_issues(const dm_xref_t *x, size_t *count);
+void dm_xref_get_summary(const dm_xref_t *x, dm_xref_summary_t *out);
+const char *dm_xref_code_name(dm_xref_code_t code);
+// Report of the last run for the UI; `cfg` is the generation that was checked.
+void dm_xref_write_json(const dm_xref_t *x, const device_manager_config_t *cfg, dm_json_writer_t *w);
+
+#ifdef __cplusplus
+}
+#endif
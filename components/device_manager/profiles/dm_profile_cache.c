@@ -0,0 +1,191 @@
+#include "dm_profile_cache.h"
+
+#include <string.h>
+#include <strings.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+
+#include "dm_config.h"
+
+static const char *TAG = "dm_profile_cache";
+
+typedef struct {
+    device_manager_config_t *cfg;
+    size_t bytes;
+    uint32_t last_use;
+} dm_profile_cache_entry_t;
+
+// The entries are only touched under the writer lock; the mux guards what status readers see.
+static dm_profile_cache_entry_t s_entries[DEVICE_MANAGER_MAX_PROFILES];
+static dm_profile_cache_release_fn s_release;
+static uint32_t s_clock;
+static portMUX_TYPE s_status_mux = portMUX_INITIALIZER_UNLOCKED;
+static device_manager_profile_cache_status_t s_status;
+static uint64_t s_hit_us;           // switch time summed per kind, for the means
+static uint64_t s_miss_us;
+static uint32_t s_hit_switches;
+
+static size_t generation_bytes(const device_manager_config_t *cfg)
+{
+    dm_config_arena_stats_t stats = {0};
+    if (cfg->arena) {
+        dm_config_arena_get_stats(cfg->arena, &stats);
+    }
+    return sizeof(*cfg) + stats.reserved;
+}
+
+static dm_profile_cache_entry_t *find_entry(const char *id)
+{
+    for (size_t i = 0; i < DEVICE_MANAGER_MAX_PROFILES; ++i) {
+        if (s_entries[i].cfg && strcasecmp(s_entries[i].cfg->active_profile, id) == 0) {
+            return &s_entries[i];
+        }
+    }
+    return NULL;
+}
+
+// Empties the slot and hands its generation back to the caller.
+static device_manager_config_t *detach(dm_profile_cache_entry_t *entry)
+{
+    device_manager_config_t *cfg = entry->cfg;
+    portENTER_CRITICAL(&s_status_mux);
+    s_status.entries--;
+    s_status.bytes -= entry->bytes;
+    portEXIT_CRITICAL(&s_status_mux);
+    memset(entry, 0, sizeof(*entry));
+    return cfg;
+}
+
+static void release(device_manager_config_t *cfg)
+{
+    if (cfg && s_release) {
+        s_release(cfg);
+    }
+}
+
+static void evict_over(size_t budget)
+{
+    for (;;) {
+        portENTER_CRITICAL(&s_status_mux);
+        bool over = s_status.bytes > budget;
+        portEXIT_CRITICAL(&s_status_mux);
+        dm_profile_cache_entry_t *oldest = NULL;
+        for (size_t i = 0; over && i < DEVICE_MANAGER_MAX_PROFILES; ++i) {
+            if (s_entries[i].cfg && (!oldest || s_entries[i].last_use < oldest->last_use)) {
+                oldest = &s_entries[i];
+            }
+        }
+        if (!oldest) {
+            return;
+        }
+        ESP_LOGI(TAG, "evicting profile %s (%zu bytes)", oldest->cfg->active_profile, oldest->bytes);
+        portENTER_CRITICAL(&s_status_mux);
+        s_status.evictions++;
+        portEXIT_CRITICAL(&s_status_mux);
+        release(detach(oldest));
+    }
+}
+
+void dm_profile_cache_init(size_t budget, dm_profile_cache_release_fn release_fn)
+{
+    s_release = release_fn;
+    portENTER_CRITICAL(&s_status_mux);
+    s_status.budget = budget;
+    portEXIT_CRITICAL(&s_status_mux);
+    evict_over(budget);
+}
+
+void dm_profile_cache_put(device_manager_config_t *cfg)
+{
+    if (!cfg) {
+        return;
+    }
+    dm_profile_cache_drop(cfg->active_profile);
+    size_t bytes = generation_bytes(cfg);
+    portENTER_CRITICAL(&s_status_mux);
+    size_t budget = s_status.budget;
+    portEXIT_CRITICAL(&s_status_mux);
+    dm_profile_cache_entry_t *slot = NULL;
+    for (size_t i = 0; i < DEVICE_MANAGER_MAX_PROFILES && !slot; ++i) {
+        if (!s_entries[i].cfg) {
+            slot = &s_entries[i];
+        }
+    }
+    if (!cfg->active_profile[0] || bytes > budget || !slot) {
+        release(cfg);
+        return;
+    }
+    slot->cfg = cfg;
+    slot->bytes = bytes;
+    slot->last_use = ++s_clock;
+    portENTER_CRITICAL(&s_status_mux);
+    s_status.entries++;
+    s_status.bytes += bytes;
+    portEXIT_CRITICAL(&s_status_mux);
+    ESP_LOGD(TAG, "keeping profile %s (%zu bytes)", cfg->active_profile, bytes);
+    // The newest entry has the highest stamp, so it is the last one to go.
+    evict_over(budget);
+}
+
+device_manager_config_t *dm_profile_cache_take(const char *id)
+{
+    dm_profile_cache_entry_t *entry = id && id[0] ? find_entry(id) : NULL;
+    portENTER_CRITICAL(&s_status_mux);
+    if (entry) {
+        s_status.hits++;
+    } else {
+        s_status.misses++;
+    }
+    portEXIT_CRITICAL(&s_status_mux);
+    return entry ? detach(entry) : NULL;
+}
+
+void dm_profile_cache_drop(const char *id)
+{
+    dm_profile_cache_entry_t *entry = id && id[0] ? find_entry(id) : NULL;
+    if (entry) {
+        release(detach(entry));
+    }
+}
+
+void dm_profile_cache_clear(void)
+{
+    for (size_t i = 0; i < DEVICE_MANAGER_MAX_PROFILES; ++i) {
+        if (s_entries[i].cfg) {
+            release(detach(&s_entries[i]));
+        }
+    }
+}
+
+void dm_profile_cache_note_switch(int64_t duration_us, bool cached)
+{
+    uint32_t us = duration_us > 0 ? (uint32_t)duration_us : 0;
+    portENTER_CRITICAL(&s_status_mux);
+    s_status.switches++;
+    s_status.last_switch_us = us;
+    s_status.last_switch_cached = cached;
+    if (cached) {
+        s_hit_us += us;
+        s_hit_switches++;
+    } else {
+        s_miss_us += us;
+    }
+    portEXIT_CRITICAL(&s_status_mux);
+}
+
+void dm_profile_cache_get_status(device_manager_profile_cache_status_t *out)
+{
+    if (!out) {
+        return;
+    }
+    portENTER_CRITICAL(&s_status_mux);
+    *out = s_status;
+    uint64_t hit_us = s_hit_us;
+    uint64_t miss_us = s_miss_us;
+    uint32_t hit_switches = s_hit_switches;
+    portEXIT_CRITICAL(&s_status_mux);
+    uint32_t miss_switches = out->switches - hit_switches;
+    out->hit_avg_us = hit_switches ? (uint32_t)(hit_us / hit_switches) : 0;
+    out->miss_avg_us = miss_switches ? (uint32_t)(miss_us / miss_switches) : 0;
+}
@@ -0,0 +1,705 @@
+#include "dm_profile_codec.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+
+#include "dm_config.h"
+#include "dm_profile_legacy.h"
+#include "dm_schema.h"
+
+static const char *TAG = "dm_profile_codec";
+
+// Zero runs shorter than this stay inside a literal; a run costs at least two varints.
+#define BLOB_MIN_ZERO_RUN 4
+
+#define LZ_MIN_MATCH     4
+#define LZ_HASH_BITS     12
+#define LZ_LAST_LITERALS 5      // the block always ends with literals
+#define LZ_MFLIMIT       12     // no match starts this close to the end
+#define LZ_MAX_OFFSET    65535
+
+// Writer ---------------------------------------------------------------------------
+
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+    bool failed;
+} codec_buf_t;
+
+static bool buf_reserve(codec_buf_t *b, size_t extra)
+{
+    if (b->failed) {
+        return false;
+    }
+    if (b->len + extra <= b->cap) {
+        return true;
+    }
+    size_t cap = b->cap ? b->cap : 1024;
+    while (cap < b->len + extra) {
+        cap *= 2;
+    }
+    uint8_t *next = heap_caps_realloc(b->data, cap, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!next) {
+        next = heap_caps_realloc(b->data, cap, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    if (!next) {
+        b->failed = true;
+        return false;
+    }
+    b->data = next;
+    b->cap = cap;
+    return true;
+}
+
+static void put_bytes(codec_buf_t *b, const void *src, size_t len)
+{
+    if (len && buf_reserve(b, len)) {
+        memcpy(b->data + b->len, src, len);
+        b->len += len;
+    }
+}
+
+static void put_u8(codec_buf_t *b, uint8_t v)
+{
+    put_bytes(b, &v, 1);
+}
+
+static void put_u32(codec_buf_t *b, uint32_t v)
+{
+    uint8_t raw[4] = {(uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24)};
+    put_bytes(b, raw, sizeof(raw));
+}
+
+static void put_varint(codec_buf_t *b, uint32_t v)
+{
+    while (v >= 0x80) {
+        put_u8(b, (uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    put_u8(b, (uint8_t)v);
+}
+
+static void put_str(codec_buf_t *b, const char *s, size_t cap)
+{
+    size_t len = strnlen(s, cap);
+    if (len > UINT8_MAX) {
+        len = UINT8_MAX;
+    }
+    put_u8(b, (uint8_t)len);
+    put_bytes(b, s, len);
+}
+
+// Trailing zeros are dropped; inner zero runs become (run, literal) pairs.
+static void put_blob(codec_buf_t *b, const void *src, size_t size)
+{
+    const uint8_t *p = (const uint8_t *)src;
+    size_t total = size;
+    while (total && p[total - 1] == 0) {
+        total--;
+    }
+    put_varint(b, (uint32_t)total);
+    size_t pos = 0;
+    while (pos < total) {
+        size_t zeros = 0;
+        while (pos + zeros < total && p[pos + zeros] == 0) {
+            zeros++;
+        }
+        size_t start = pos + zeros;
+        size_t end = start;
+        while (end < total) {
+            if (p[end] != 0) {
+                end++;
+                continue;
+            }
+            size_t run = 0;
+            while (end + run < total && p[end + run] == 0) {
+                run++;
+            }
+            if (run >= BLOB_MIN_ZERO_RUN) {
+                break;
+            }
+            end += run;
+        }
+        put_varint(b, (uint32_t)zeros);
+        put_varint(b, (uint32_t)(end - start));
+        put_bytes(b, p + start, end - start);
+        pos = end;
+    }
+}
+
+static void put_record(codec_buf_t *b, const dm_record_t *rec, const void *base, uint8_t index);
+
+// Members described in dm_schema.h: strings carry their length, bools and enums take a
+// byte, numbers a varint, limits a blob and lists a count followed by their entries.
+static void put_field(codec_buf_t *b, const dm_field_t *f, const void *base, uint8_t index)
+{
+    const void *p = dm_field_ptr(f, base, index);
+    switch (f->kind) {
+    case DM_FIELD_STR:
+        put_str(b, (const char *)p, f->size);
+        break;
+    case DM_FIELD_STRS: {
+        uint8_t count = *dm_field_count(f, base, index);
+        if (count > f->max) {
+            count = f->max;
+        }
+        put_u8(b, count);
+        for (uint8_t n = 0; n < count; ++n) {
+            put_str(b, dm_field_str(f, base, index, n), f->size);
+        }
+        break;
+    }
+    case DM_FIELD_U32:
+        put_varint(b, *(const uint32_t *)p);
+        break;
+    case DM_FIELD_BOOL:
+        put_u8(b, *(const bool *)p ? 1 : 0);
+        break;
+    case DM_FIELD_FLOAT: {
+        uint32_t bits;
+        memcpy(&bits, p, sizeof(bits));
+        put_u8(b, dm_field_is_set(f, base, index) ? 1 : 0);
+        put_u32(b, bits);
+        break;
+    }
+    case DM_FIELD_ENUM:
+        put_u8(b, (uint8_t)dm_field_get_int(f, base, index));
+        break;
+    case DM_FIELD_LIMIT:
+        put_blob(b, p, f->size);
+        break;
+    case DM_FIELD_LIST: {
+        uint8_t count = *dm_field_count(f, base, 0);
+        if (count > f->max) {
+            count = f->max;
+        }
+        put_u8(b, count);
+        for (uint8_t n = 0; n < count; ++n) {
+            put_record(b, (const dm_record_t *)f->ref, base, n);
+        }
+        break;
+    }
+    default:
+        b->failed = true;
+        break;
+    }
+}
+
+static void put_record(codec_buf_t *b, const dm_record_t *rec, const void *base, uint8_t index)
+{
+    for (uint8_t i = 0; i < rec->count; ++i) {
+        put_field(b, &rec->fields[i], base, index);
+    }
+}
+
+static void put_device(codec_buf_t *b, const device_descriptor_t *dev)
+{
+    size_t len_at = b->len;
+    put_u32(b, 0);
+    put_str(b, dev->id, sizeof(dev->id));
+    put_str(b, dev->display_name, sizeof(dev->display_name));
+    put_field(b, dm_schema_device_topics(), dev, 0);
+
+    uint8_t scenario_count = dev->scenarios ? dev->scenario_count : 0;
+    if (scenario_count > DEVICE_MANAGER_MAX_SCENARIOS_PER_DEVICE) {
+        scenario_count = DEVICE_MANAGER_MAX_SCENARIOS_PER_DEVICE;
+    }
+    put_u8(b, scenario_count);
+    for (uint8_t s = 0; s < scenario_count; ++s) {
+        const device_scenario_t *sc = &dev->scenarios[s];
+        put_record(b, dm_schema_scenario(), sc, 0);
+        uint8_t step_count = sc->steps ? sc->step_count : 0;
+        if (step_count > DEVICE_MANAGER_MAX_STEPS_PER_SCENARIO) {
+            step_count = DEVICE_MANAGER_MAX_STEPS_PER_SCENARIO;
+        }
+        put_u8(b, step_count);
+        for (uint8_t i = 0; i < step_count; ++i) {
+            const device_action_step_t *step = &sc->steps[i];
+            // Step data keeps the inline-string layout on disk; see dm_profile_legacy.h.
+            dm_legacy_step_data_t data;
+            dm_legacy_step_data_from_config(step, &data);
+            put_u8(b, (uint8_t)step->type);
+            put_varint(b, step->delay_ms);
+            put_blob(b, &data, sizeof(data));
+        }
+    }
+
+    put_u8(b, dev->template_assigned ? 1 : 0);
+    if (dev->template_assigned) {
+        put_blob(b, &dev->template_config, sizeof(dev->template_config));
+    }
+    if (!b->failed) {
+        uint32_t rec_len = (uint32_t)(b->len - len_at - 4);
+        uint8_t *at = b->data + len_at;
+        at[0] = (uint8_t)rec_len;
+        at[1] = (uint8_t)(rec_len >> 8);
+        at[2] = (uint8_t)(rec_len >> 16);
+        at[3] = (uint8_t)(rec_len >> 24);
+    }
+}
+
+esp_err_t dm_profile_encode(const device_descriptor_t *devices, uint8_t count, uint8_t **out, size_t *out_len)
+{
+    if ((!devices && count) || !out || !out_len) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *out = NULL;
+    *out_len = 0;
+    codec_buf_t b = {0};
+    buf_reserve(&b, 256 + (size_t)count * 512);
+    for (uint8_t i = 0; i < count; ++i) {
+        put_device(&b, &devices[i]);
+    }
+    if (b.failed) {
+        heap_caps_free(b.data);
+        return ESP_ERR_NO_MEM;
+    }
+    *out = b.data;
+    *out_len = b.len;
+    return ESP_OK;
+}
+
+// Reader ---------------------------------------------------------------------------
+
+typedef struct {
+    const uint8_t *p;
+    size_t len;
+    size_t pos;
+    bool bad;
+    bool no_mem;                // config budget ran out; also sets `bad`
+} codec_rd_t;
+
+static const uint8_t *rd_bytes(codec_rd_t *r, size_t n)
+{
+    if (r->bad || n > r->len - r->pos) {
+        r->bad = true;
+        return NULL;
+    }
+    const uint8_t *at = r->p + r->pos;
+    r->pos += n;
+    return at;
+}
+
+static uint8_t rd_u8(codec_rd_t *r)
+{
+    const uint8_t *at = rd_bytes(r, 1);
+    return at ? at[0] : 0;
+}
+
+static uint32_t rd_u32(codec_rd_t *r)
+{
+    const uint8_t *at = rd_bytes(r, 4);
+    return at ? (uint32_t)at[0] | ((uint32_t)at[1] << 8) | ((uint32_t)at[2] << 16) | ((uint32_t)at[3] << 24) : 0;
+}
+
+static uint32_t rd_varint(codec_rd_t *r)
+{
+    uint32_t v = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        uint8_t byte = rd_u8(r);
+        if (r->bad) {
+            return 0;
+        }
+        v |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return v;
+        }
+    }
+    r->bad = true;
+    return 0;
+}
+
+// dst may be NULL to skip the field; longer strings are cut to fit.
+static void rd_str(codec_rd_t *r, char *dst, size_t cap)
+{
+    uint8_t len = rd_u8(r);
+    const uint8_t *src = rd_bytes(r, len);
+    if (!src || !dst || !cap) {
+        return;
+    }
+    size_t n = len < cap ? len : cap - 1;
+    memcpy(dst, src, n);
+    dst[n] = 0;
+}
+
+// dst must be zeroed; bytes past `size` (a newer, longer struct) are dropped.
+static void rd_blob(codec_rd_t *r, void *dst, size_t size)
+{
+    uint8_t *out = (uint8_t *)dst;
+    uint32_t total = rd_varint(r);
+    size_t pos = 0;
+    while (!r->bad && pos < total) {
+        uint32_t zeros = rd_varint(r);
+        uint32_t lit = rd_varint(r);
+        if (r->bad || zeros > total - pos || lit > total - pos - zeros || zeros + lit == 0) {
+            r->bad = true;
+            return;
+        }
+        pos += zeros;
+        const uint8_t *src = rd_bytes(r, lit);
+        if (src && out && pos < size) {
+            memcpy(out + pos, src, lit < size - pos ? lit : size - pos);
+        }
+        pos += lit;
+    }
+}
+
+static void rd_fail_no_mem(codec_rd_t *r)
+{
+    r->no_mem = true;
+    r->bad = true;
+}
+
+static void rd_record(codec_rd_t *r, const dm_record_t *rec, void *base, uint8_t index);
+
+// Reverse of put_field(); base == NULL skips the member, entries past a list's capacity
+// are read and dropped.
+static void rd_field(codec_rd_t *r, const dm_field_t *f, void *base, uint8_t index)
+{
+    void *p = base ? dm_field_ptr(f, base, index) : NULL;
+    switch (f->kind) {
+    case DM_FIELD_STR:
+        rd_str(r, (char *)p, f->size);
+        break;
+    case DM_FIELD_STRS: {
+        uint8_t count = rd_u8(r);
+        uint8_t kept = count < f->max ? count : f->max;
+        for (uint8_t n = 0; n < count && !r->bad; ++n) {
+            rd_str(r, p && n < kept ? (char *)p + (size_t)n * f->size : NULL, f->size);
+        }
+        if (base) {
+            *dm_field_count(f, base, index) = kept;
+        }
+        break;
+    }
+    case DM_FIELD_U32: {
+        uint32_t v = rd_varint(r);
+        if (p) {
+            *(uint32_t *)p = v;
+        }
+        break;
+    }
+    case DM_FIELD_BOOL: {
+        bool v = rd_u8(r) != 0;
+        if (p) {
+            *(bool *)p = v;
+        }
+        break;
+    }
+    case DM_FIELD_FLOAT: {
+        bool given = rd_u8(r) != 0;
+        uint32_t bits = rd_u32(r);
+        if (p) {
+            memcpy(p, &bits, sizeof(bits));
+            *(bool *)((uint8_t *)base + f->aux + (size_t)index * f->stride) = given;
+        }
+        break;
+    }
+    case DM_FIELD_ENUM: {
+        uint8_t v = rd_u8(r);
+        if (base) {
+            dm_field_set_int(f, base, index, v);
+        }
+        break;
+    }
+    case DM_FIELD_LIMIT:
+        rd_blob(r, p, f->size);
+        break;
+    case DM_FIELD_LIST: {
+        uint8_t count = rd_u8(r);
+        uint8_t kept = count < f->max ? count : f->max;
+        for (uint8_t n = 0; n < count && !r->bad; ++n) {
+            rd_record(r, (const dm_record_t *)f->ref, n < kept ? base : NULL, n);
+        }
+        if (base) {
+            *dm_field_count(f, base, 0) = kept;
+        }
+        break;
+    }
+    default:
+        r->bad = true;
+        break;
+    }
+}
+
+static void rd_record(codec_rd_t *r, const dm_record_t *rec, void *base, uint8_t index)
+{
+    for (uint8_t i = 0; i < rec->count && !r->bad; ++i) {
+        rd_field(r, &rec->fields[i], base, index);
+    }
+}
+
+// dev == NULL skips the record; arrays and step strings go to the cfg arena.
+static void rd_device(codec_rd_t *r, device_manager_config_t *cfg, device_descriptor_t *dev)
+{
+    rd_str(r, dev ? dev->id : NULL, sizeof(dev->id));
+    rd_str(r, dev ? dev->display_name : NULL, sizeof(dev->display_name));
+    rd_field(r, dm_schema_device_topics(), dev, 0);
+
+    uint8_t scenario_count = rd_u8(r);
+    uint8_t scenarios_kept = scenario_count < DEVICE_MANAGER_MAX_SCENARIOS_PER_DEVICE
+                                 ? scenario_count
+                                 : DEVICE_MANAGER_MAX_SCENARIOS_PER_DEVICE;
+    if (dev && scenarios_kept) {
+        dev->scenarios = dm_config_alloc_scenarios(cfg, scenarios_kept);
+        if (!dev->scenarios) {
+            rd_fail_no_mem(r);
+            return;
+        }
+        dev->scenario_count = scenarios_kept;
+    }
+    for (uint8_t s = 0; s < scenario_count && !r->bad; ++s) {
+        device_scenario_t *sc = dev && s < scenarios_kept ? &dev->scenarios[s] : NULL;
+        rd_record(r, dm_schema_scenario(), sc, 0);
+        uint8_t step_count = rd_u8(r);
+        uint8_t steps_kept = step_count < DEVICE_MANAGER_MAX_STEPS_PER_SCENARIO ? step_count
+                                                                                : DEVICE_MANAGER_MAX_STEPS_PER_SCENARIO;
+        if (sc && steps_kept && !r->bad) {
+            sc->steps = dm_config_alloc_steps(cfg, steps_kept);
+            if (!sc->steps) {
+                rd_fail_no_mem(r);
+                return;
+            }
+            sc->step_count = steps_kept;
+        }
+        for (uint8_t i = 0; i < step_count && !r->bad; ++i) {
+            device_action_step_t *step = sc && i < steps_kept ? &sc->steps[i] : NULL;
+            uint8_t type = rd_u8(r);
+            uint32_t delay_ms = rd_varint(r);
+            dm_legacy_step_data_t data = {0};
+            rd_blob(r, step ? &data : NULL, sizeof(data));
+            if (step && !r->bad) {
+                step->delay_ms = delay_ms;
+                if (dm_legacy_step_to_config(cfg, (device_action_type_t)type, &data, step) != ESP_OK) {
+                    rd_fail_no_mem(r);
+                }
+            }
+        }
+    }
+
+    bool template_assigned = rd_u8(r) != 0;
+    if (template_assigned) {
+        rd_blob(r, dev ? &dev->template_config : NULL, sizeof(dev->template_config));
+    }
+    if (dev) {
+        dev->template_assigned = template_assigned;
+        // The block is stored raw, so hold it to what the JSON importer would accept.
+        if (template_assigned && !r->bad && !dm_template_config_usable(&dev->template_config)) {
+            ESP_LOGW(TAG, "device %s: stored template is not usable, dropped", dev->id);
+            dev->template_assigned = false;
+        }
+    }
+}
+
+esp_err_t dm_profile_decode(const uint8_t *data, size_t len, uint32_t record_count, device_manager_config_t *cfg)
+{
+    if ((!data && len) || !cfg) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint8_t capacity = record_count < DEVICE_MANAGER_MAX_DEVICES ? (uint8_t)record_count : DEVICE_MANAGER_MAX_DEVICES;
+    esp_err_t err = dm_config_reset_devices(cfg, capacity);
+    if (err != ESP_OK) {
+        return err;
+    }
+    codec_rd_t r = {.p = data, .len = len};
+    for (uint32_t i = 0; i < record_count; ++i) {
+        uint32_t rec_len = rd_u32(&r);
+        const uint8_t *rec = rd_bytes(&r, rec_len);
+        if (!rec) {
+            ESP_LOGE(TAG, "record %" PRIu32 " truncated", i);
+            break;
+        }
+        codec_rd_t sub = {.p = rec, .len = rec_len};
+        rd_device(&sub, cfg, i < capacity ? &cfg->devices[i] : NULL);
+        if (sub.bad) {
+            ESP_LOGE(TAG, "record %" PRIu32 " %s", i, sub.no_mem ? "exceeds the config budget" : "malformed");
+            r.bad = true;
+            r.no_mem = sub.no_mem;
+            break;
+        }
+    }
+    if (r.bad) {
+        dm_config_reset_devices(cfg, 0);
+        return r.no_mem ? ESP_ERR_NO_MEM : ESP_ERR_INVALID_SIZE;
+    }
+    cfg->device_count = capacity;
+    return ESP_OK;
+}
+
+// LZ block codec -------------------------------------------------------------------
+// LZ4 block layout: token (literal length << 4 | match length - 4), length extension
+// bytes, literals, 16-bit offset, match extension bytes. The last sequence has no match.
+
+static uint32_t lz_read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t lz_hash(uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static bool lz_put_length(uint8_t *dst, size_t cap, size_t *op, size_t n)
+{
+    while (n >= 255) {
+        if (*op >= cap) {
+            return false;
+        }
+        dst[(*op)++] = 255;
+        n -= 255;
+    }
+    if (*op >= cap) {
+        return false;
+    }
+    dst[(*op)++] = (uint8_t)n;
+    return true;
+}
+
+// match_len 0 writes the closing literal-only sequence.
+static bool lz_emit(uint8_t *dst, size_t cap, size_t *op, const uint8_t *lit, size_t lit_len, size_t offset, size_t match_len)
+{
+    if (*op >= cap) {
+        return false;
+    }
+    size_t ml = match_len ? match_len - LZ_MIN_MATCH : 0;
+    dst[(*op)++] = (uint8_t)(((lit_len < 15 ? lit_len : 15) << 4) | (ml < 15 ? ml : 15));
+    if (lit_len >= 15 && !lz_put_length(dst, cap, op, lit_len - 15)) {
+        return false;
+    }
+    if (lit_len > cap - *op) {
+        return false;
+    }
+    memcpy(dst + *op, lit, lit_len);
+    *op += lit_len;
+    if (!match_len) {
+        return true;
+    }
+    if (cap - *op < 2) {
+        return false;
+    }
+    dst[(*op)++] = (uint8_t)offset;
+    dst[(*op)++] = (uint8_t)(offset >> 8);
+    return ml < 15 || lz_put_length(dst, cap, op, ml - 15);
+}
+
+size_t dm_profile_lz_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t dst_cap)
+{
+    if ((!src && len) || !dst) {
+        return 0;
+    }
+    // Positions are stored +1 so zero marks an empty slot.
+    uint32_t *table = heap_caps_calloc(1u << LZ_HASH_BITS, sizeof(uint32_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!table) {
+        table = heap_caps_calloc(1u << LZ_HASH_BITS, sizeof(uint32_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    }
+    if (!table) {
+        return 0;
+    }
+    size_t ip = 0;
+    size_t anchor = 0;
+    size_t op = 0;
+    bool ok = true;
+    if (len >= LZ_MFLIMIT) {
+        size_t limit = len - LZ_MFLIMIT;
+        size_t match_limit = len - LZ_LAST_LITERALS;
+        while (ok && ip <= limit) {
+            uint32_t seq = lz_read32(src + ip);
+            uint32_t h = lz_hash(seq);
+            size_t cand = table[h];
+            table[h] = (uint32_t)(ip + 1);
+            if (!cand || ip - (cand - 1) > LZ_MAX_OFFSET || lz_read32(src + cand - 1) != seq) {
+                ip++;
+                continue;
+            }
+            size_t ref = cand - 1;
+            size_t match_len = LZ_MIN_MATCH;
+            while (ip + match_len < match_limit && src[ref + match_len] == src[ip + match_len]) {
+                match_len++;
+            }
+            while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1]) {
+                ip--;
+                ref--;
+                match_len++;
+            }
+            ok = lz_emit(dst, dst_cap, &op, src + anchor, ip - anchor, ip - ref, match_len);
+            ip += match_len;
+            anchor = ip;
+        }
+    }
+    if (ok) {
+        ok = lz_emit(dst, dst_cap, &op, src + anchor, len - anchor, 0, 0);
+    }
+    heap_caps_free(table);
+    return ok ? op : 0;
+}
+
+static bool lz_get_length(const uint8_t *src, size_t len, size_t *ip, size_t *n)
+{
+    uint8_t byte;
+    do {
+        if (*ip >= len) {
+            return false;
+        }
+        byte = src[(*ip)++];
+        *n += byte;
+    } while (byte == 255);
+    return true;
+}
+
+esp_err_t dm_profile_lz_decompress(const uint8_t *src, size_t len, uint8_t *dst, size_t dst_len)
+{
+    if ((!src && len) || (!dst && dst_len)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    size_t ip = 0;
+    size_t op = 0;
+    while (ip < len) {
+        uint8_t token = src[ip++];
+        size_t lit = token >> 4;
+        if (lit == 15 && !lz_get_length(src, len, &ip, &lit)) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        if (lit > len - ip || lit > dst_len - op) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        memcpy(dst + op, src + ip, lit);
+        ip += lit;
+        op += lit;
+        if (ip == len) {
+            break;
+        }
+        if (len - ip < 2) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        size_t offset = (size_t)src[ip] | ((size_t)src[ip + 1] << 8);
+        ip += 2;
+        size_t match_len = token & 0x0F;
+        if (match_len == 15 && !lz_get_length(src, len, &ip, &match_len)) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        match_len += LZ_MIN_MATCH;
+        if (offset == 0 || offset > op || match_len > dst_len - op) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        // Overlapping copies repeat the last `offset` bytes, so go byte by byte.
+        for (size_t i = 0; i < match_len; ++i, ++op) {
+            dst[op] = dst[op - offset];
+        }
+    }
+    return op == dst_len ? ESP_OK : ESP_ERR_INVALID_SIZE;
+}
+
+// CRC-32 (IEEE, reflected) from the ROM table; the bulk backup streams every byte through it.
+uint32_t dm_profile_crc32(uint32_t crc, const void *data, size_t len)
+{
+    return esp_rom_crc32_le(crc, (const uint8_t *)data, (uint32_t)len);
+}
@@ -0,0 +1,174 @@
+#include "dm_profile_legacy.h"
+
+#include <string.h>
+
+#include "device_manager_utils.h"
+#include "dm_config.h"
+#include "dm_schema.h"
+
+void dm_legacy_step_data_from_config(const device_action_step_t *src, dm_legacy_step_data_t *dst)
+{
+    memset(dst, 0, sizeof(*dst));
+    switch (src->type) {
+    case DEVICE_ACTION_LOOP:
+        dst->loop.target_step = src->data.loop.target_step;
+        dst->loop.max_iterations = src->data.loop.max_iterations;
+        break;
+    case DEVICE_ACTION_WAIT_FLAGS: {
+        uint8_t count = src->data.wait_flags.requirement_count;
+        if (count > DM_LEGACY_MAX_FLAG_RULES) {
+            count = DM_LEGACY_MAX_FLAG_RULES;
+        }
+        dst->wait_flags.mode = src->data.wait_flags.mode;
+        dst->wait_flags.requirement_count = count;
+        dst->wait_flags.timeout_ms = src->data.wait_flags.timeout_ms;
+        for (uint8_t i = 0; i < count; ++i) {
+            dm_str_copy(dst->wait_flags.requirements[i].flag,
+                        sizeof(dst->wait_flags.requirements[i].flag),
+                        src->data.wait_flags.requirements[i].flag);
+            dst->wait_flags.requirements[i].required_state = src->data.wait_flags.requirements[i].required_state;
+        }
+        break;
+    }
+    case DEVICE_ACTION_MQTT_PUBLISH:
+        dm_str_copy(dst->mqtt.topic, sizeof(dst->mqtt.topic), src->data.mqtt.topic);
+        dm_str_copy(dst->mqtt.payload, sizeof(dst->mqtt.payload), src->data.mqtt.payload);
+        dst->mqtt.qos = src->data.mqtt.qos;
+        dst->mqtt.retain = src->data.mqtt.retain;
+        break;
+    case DEVICE_ACTION_AUDIO_PLAY:
+        dm_str_copy(dst->audio.track, sizeof(dst->audio.track), src->data.audio.track);
+        dst->audio.blocking = src->data.audio.blocking;
+        break;
+    case DEVICE_ACTION_SET_FLAG:
+        dm_str_copy(dst->flag.flag, sizeof(dst->flag.flag), src->data.flag.flag);
+        dst->flag.value = src->data.flag.value;
+        break;
+    case DEVICE_ACTION_EVENT_BUS:
+        dm_str_copy(dst->event.event, sizeof(dst->event.event), src->data.event.event);
+        dm_str_copy(dst->event.topic, sizeof(dst->event.topic), src->data.event.topic);
+        dm_str_copy(dst->event.payload, sizeof(dst->event.payload), src->data.event.payload);
+        break;
+    case DEVICE_ACTION_PARALLEL:
+        dst->parallel.count = src->data.parallel.count;
+        break;
+    case DEVICE_ACTION_JOIN:
+        dst->join.timeout_ms = src->data.join.timeout_ms;
+        break;
+    default:
+        break;
+    }
+}
+
+esp_err_t dm_legacy_step_to_config(device_manager_config_t *cfg,
+                                   device_action_type_t type,
+                                   const dm_legacy_step_data_t *src,
+                                   device_action_step_t *dst)
+{
+    memset(&dst->data, 0, sizeof(dst->data));
+    dst->type = type;
+    switch (type) {
+    case DEVICE_ACTION_LOOP:
+        dst->data.loop.target_step = src->loop.target_step;
+        dst->data.loop.max_iterations = src->loop.max_iterations;
+        break;
+    case DEVICE_ACTION_WAIT_FLAGS: {
+        uint8_t count = src->wait_flags.requirement_count;
+        if (count > DEVICE_MANAGER_MAX_FLAG_RULES) {
+            count = DEVICE_MANAGER_MAX_FLAG_RULES;
+        }
+        dst->data.wait_flags.mode = src->wait_flags.mode;
+        dst->data.wait_flags.requirement_count = count;
+        dst->data.wait_flags.timeout_ms = src->wait_flags.timeout_ms;
+        for (uint8_t i = 0; i < count; ++i) {
+            dst->data.wait_flags.requirements[i].flag = src->wait_flags.requirements[i].flag;
+            dst->data.wait_flags.requirements[i].required_state = src->wait_flags.requirements[i].required_state;
+        }
+        break;
+    }
+    case DEVICE_ACTION_MQTT_PUBLISH:
+        dst->data.mqtt.topic = src->mqtt.topic;
+        dst->data.mqtt.payload = src->mqtt.payload;
+        dst->data.mqtt.qos = src->mqtt.qos;
+        dst->data.mqtt.retain = src->mqtt.retain;
+        break;
+    case DEVICE_ACTION_AUDIO_PLAY:
+        dst->data.audio.track = src->audio.track;
+        dst->data.audio.blocking = src->audio.blocking;
+        break;
+    case DEVICE_ACTION_SET_FLAG:
+        dst->data.flag.flag = src->flag.flag;
+        dst->data.flag.value = src->flag.value;
+        break;
+    case DEVICE_ACTION_EVENT_BUS:
+        dst->data.event.event = src->event.event;
+        dst->data.event.topic = src->event.topic;
+        dst->data.event.payload = src->event.payload;
+        break;
+    case DEVICE_ACTION_PARALLEL:
+        dst->data.parallel.count = src->parallel.count;
+        break;
+    case DEVICE_ACTION_JOIN:
+        dst->data.join.timeout_ms = src->join.timeout_ms;
+        break;
+    default:
+        break;
+    }
+    // The pointers above still refer to the legacy buffers; pooling replaces them.
+    return dm_config_intern_step(cfg, dst);
+}
+
+esp_err_t dm_legacy_device_to_config(device_manager_config_t *cfg,
+                                     const dm_legacy_descriptor_t *src,
+                                     device_descriptor_t *dst)
+{
+    memset(dst, 0, sizeof(*dst));
+    dm_str_copy(dst->id, sizeof(dst->id), src->id);
+    dm_str_copy(dst->display_name, sizeof(dst->display_name), src->display_name);
+    dst->topic_count = src->topic_count < DEVICE_MANAGER_MAX_TOPICS_PER_DEVICE ? src->topic_count
+                                                                              : DEVICE_MANAGER_MAX_TOPICS_PER_DEVICE;
+    memcpy(dst->topics, src->topics, sizeof(dst->topics));
+    memcpy(dst->topic_limits, src->topic_limits, sizeof(dst->topic_limits));
+    memcpy(&dst->template_config, &src->template_config, sizeof(dst->template_config));
+    // Same test as for current profiles: a block the importer would reject is dropped.
+    dst->template_assigned = src->template_assigned && dm_template_config_usable(&dst->template_config);
+
+    uint8_t scenario_count = src->scenario_count < DM_LEGACY_MAX_SCENARIOS ? src->scenario_count
+                                                                           : DM_LEGACY_MAX_SCENARIOS;
+    if (scenario_count == 0) {
+        return ESP_OK;
+    }
+    device_scenario_t *scenarios = dm_config_alloc_scenarios(cfg, scenario_count);
+    if (!scenarios) {
+        return ESP_ERR_NO_MEM;
+    }
+    dst->scenarios = scenarios;
+    dst->scenario_count = scenario_count;
+    for (uint8_t s = 0; s < scenario_count; ++s) {
+        const dm_legacy_scenario_t *from = &src->scenarios[s];
+        device_scenario_t *sc = &scenarios[s];
+        dm_str_copy(sc->id, sizeof(sc->id), from->id);
+        dm_str_copy(sc->name, sizeof(sc->name), from->name);
+        sc->button_enabled = from->button_enabled;
+        dm_str_copy(sc->button_label, sizeof(sc->button_label), from->button_label);
+        sc->priority = from->priority;
+        sc->concurrency = from->concurrency;
+        uint8_t step_count = from->step_count < DM_LEGACY_MAX_STEPS ? from->step_count : DM_LEGACY_MAX_STEPS;
+        if (step_count == 0) {
+            continue;
+        }
+        sc->steps = dm_config_alloc_steps(cfg, step_count);
+        if (!sc->steps) {
+            return ESP_ERR_NO_MEM;
+        }
+        sc->step_count = step_count;
+        for (uint8_t i = 0; i < step_count; ++i) {
+            sc->steps[i].delay_ms = from->steps[i].delay_ms;
+            esp_err_t err = dm_legacy_step_to_config(cfg, from->steps[i].type, &from->steps[i].data, &sc->steps[i]);
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+    }
+    return ESP_OK;
+}
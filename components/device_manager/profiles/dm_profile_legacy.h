@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "device_manager.h"
+
+// Descriptor layout as stored by profile versions 2-4 and inside v5 step blobs, from before
+// scenarios and steps moved into the config arena. Sizes are spelled out so later changes
+// to dm_limits.h or device_manager.h cannot shift the on-disk format.
+
+#define DM_LEGACY_MAX_SCENARIOS     8
+#define DM_LEGACY_MAX_STEPS         16
+#define DM_LEGACY_MAX_FLAG_RULES    4
+#define DM_LEGACY_MAX_TOPICS        6
+
+typedef union {
+    struct {
+        uint16_t target_step;
+        uint16_t max_iterations;
+    } loop;
+    struct {
+        device_condition_type_t mode;
+        uint8_t requirement_count;
+        struct {
+            char flag[32];
+            bool required_state;
+        } requirements[DM_LEGACY_MAX_FLAG_RULES];
+        uint32_t timeout_ms;
+    } wait_flags;
+    struct {
+        char topic[96];
+        char payload[160];
+        uint8_t qos;
+        bool retain;
+    } mqtt;
+    struct {
+        char track[64];
+        bool blocking;
+    } audio;
+    struct {
+        char flag[32];
+        bool value;
+    } flag;
+    struct {
+        char event[48];
+        char topic[96];
+        char payload[160];
+    } event;
+    struct {
+        uint8_t count;
+    } parallel;
+    struct {
+        uint32_t timeout_ms;
+    } join;
+} dm_legacy_step_data_t;
+
+typedef struct {
+    dm_legacy_step_data_t data;
+    uint32_t delay_ms;
+    device_action_type_t type;
+} dm_legacy_step_t;
+
+typedef struct {
+    char id[32];
+    char name[48];
+    bool button_enabled;
+    char button_label[48];
+    uint8_t step_count;
+    uint8_t priority;
+    uint8_t concurrency;
+    dm_legacy_step_t steps[DM_LEGACY_MAX_STEPS];
+} dm_legacy_scenario_t;
+
+typedef struct {
+    char id[32];
+    char display_name[48];
+    uint8_t topic_count;
+    device_topic_binding_t topics[DM_LEGACY_MAX_TOPICS];
+    uint8_t scenario_count;
+    dm_legacy_scenario_t scenarios[DM_LEGACY_MAX_SCENARIOS];
+    bool template_assigned;
+    dm_template_config_t template_config;
+    dm_rate_limit_t topic_limits[DM_LEGACY_MAX_TOPICS];
+} dm_legacy_descriptor_t;
+
+// v2/v3 records end where topic_limits begins.
+#define DM_LEGACY_V3_RECORD_SIZE offsetof(dm_legacy_descriptor_t, topic_limits)
+
+void dm_legacy_step_data_from_config(const device_action_step_t *src, dm_legacy_step_data_t *dst);
+// Strings are pooled in cfg.
+esp_err_t dm_legacy_step_to_config(device_manager_config_t *cfg,
+                                   device_action_type_t type,
+                                   const dm_legacy_step_data_t *src,
+                                   device_action_step_t *dst);
+esp_err_t dm_legacy_device_to_config(device_manager_config_t *cfg,
+                                     const dm_legacy_descriptor_t *src,
+                                     device_descriptor_t *dst);
@@ -1,5 +1,6 @@
 #include "dm_profiles.h"
 
+#include <stddef.h>
 #include <string.h>
 #include <strings.h>
 #include <ctype.h>
@@ -14,13 +15,24 @@
 #include "esp_heap_caps.h"
 
 #include "device_manager_utils.h"
+#include "dm_config.h"
+#include "dm_file.h"
+#include "dm_profile_codec.h"
+#include "dm_profile_legacy.h"
 
+#ifndef DM_PROFILE_STORAGE_DIR
 #define DM_PROFILE_STORAGE_DIR "/sdcard/.dm_profiles"
+#endif
 #define DM_PROFILE_STORAGE_EXT ".bin"
 #define DM_PROFILE_MAGIC       0x44504647u
-#define DM_PROFILE_VERSION     3u
+#define DM_PROFILE_VERSION     5u
 #define DM_PROFILE_PATH_MAX    128
 #define DM_PROFILE_LEGACY_MAX_TABS 12
+#ifdef CONFIG_BROKER_PROFILE_COMPRESS
+#define DM_PROFILE_BODY_FLAGS  DM_PROFILE_BODY_LZ
+#else
+#define DM_PROFILE_BODY_FLAGS  0u
+#endif
 
 typedef struct {
     uint32_t magic;
@@ -28,6 +40,14 @@ typedef struct {
     uint32_t device_count;
 } dm_profile_file_header_t;
 
+// v5: follows the file header, then `stored_len` bytes of (possibly compressed) records.
+typedef struct {
+    uint32_t flags;             // DM_PROFILE_BODY_*
+    uint32_t body_len;          // encoded records before compression
+    uint32_t stored_len;
+    uint32_t crc32;             // of the stored bytes
+} dm_profile_body_header_t;
+
 static const char *TAG = "dm_profiles";
 
 // Ensure SD card directory exists for profile binaries.
@@ -65,60 +85,68 @@ static esp_err_t make_profile_path(const char *id, char *out, size_t out_size)
     return ESP_OK;
 }
 
-typedef void (*dm_profile_record_converter_t)(const void *src, device_descriptor_t *dst);
+typedef esp_err_t (*dm_profile_record_converter_t)(device_manager_config_t *cfg,
+                                                   dm_legacy_descriptor_t *src,
+                                                   device_descriptor_t *dst);
 
-// Current record matches struct layout.
-static void convert_device_current(const void *src, device_descriptor_t *dst)
+// v4 records are whole legacy descriptors.
+static esp_err_t convert_device_v4(device_manager_config_t *cfg, dm_legacy_descriptor_t *src, device_descriptor_t *dst)
 {
-    if (!src || !dst) {
-        return;
-    }
-    const device_descriptor_t *cur = (const device_descriptor_t *)src;
-    memcpy(dst, cur, sizeof(device_descriptor_t));
+    return dm_legacy_device_to_config(cfg, src, dst);
+}
+
+// v2/v3 records lack the rate limit tail; zero reads as "default" for every topic.
+static esp_err_t convert_device_v3(device_manager_config_t *cfg, dm_legacy_descriptor_t *src, device_descriptor_t *dst)
+{
+    memset(src->topic_limits, 0, sizeof(src->topic_limits));
+    return dm_legacy_device_to_config(cfg, src, dst);
 }
 
 // Generic reader that streams `raw_count` records of size `record_size`
-// and invokes `convert` to expand them into current descriptors.
+// and invokes `convert` to expand them into the devices of cfg.
 static esp_err_t read_device_records(FILE *fp,
                                      const char *path,
                                      uint32_t raw_count,
                                      size_t record_size,
-                                     device_descriptor_t *devices,
-                                     uint8_t capacity,
-                                     uint8_t *out_count,
+                                     device_manager_config_t *cfg,
                                      dm_profile_record_converter_t convert)
 {
-    if (!fp || !path || !devices || !out_count || !convert || record_size == 0) {
+    if (!fp || !path || !cfg || !convert || record_size == 0) {
         return ESP_ERR_INVALID_ARG;
     }
-    uint8_t *raw_buf = malloc(record_size);
+    uint8_t capacity = raw_count < DEVICE_MANAGER_MAX_DEVICES ? (uint8_t)raw_count : DEVICE_MANAGER_MAX_DEVICES;
+    esp_err_t err = dm_config_reset_devices(cfg, capacity);
+    if (err != ESP_OK) {
+        return err;
+    }
+    // Records never outgrow the legacy struct they were written from; shorter ones leave
+    // the zeroed tail alone.
+    size_t buf_size = record_size > sizeof(dm_legacy_descriptor_t) ? record_size : sizeof(dm_legacy_descriptor_t);
+    uint8_t *raw_buf = heap_caps_calloc(1, buf_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
     if (!raw_buf) {
-        ESP_LOGE(TAG, "profile %s no memory for temp buffer (%zu bytes)", path, record_size);
+        raw_buf = heap_caps_calloc(1, buf_size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    if (!raw_buf) {
+        ESP_LOGE(TAG, "profile %s no memory for temp buffer (%zu bytes)", path, buf_size);
         return ESP_ERR_NO_MEM;
     }
-    uint32_t stored = raw_count;
-    if (stored > capacity) {
+    if (raw_count > capacity) {
         ESP_LOGW(TAG, "profile %s truncated (%" PRIu32 " -> %u)", path, raw_count, capacity);
-        stored = capacity;
     }
-    for (uint32_t i = 0; i < raw_count; ++i) {
+    for (uint32_t i = 0; i < raw_count && err == ESP_OK; ++i) {
         if (fread(raw_buf, 1, record_size, fp) != record_size) {
             ESP_LOGE(TAG, "profile %s truncated body", path);
-            memset(devices, 0, sizeof(device_descriptor_t) * capacity);
-            free(raw_buf);
-            *out_count = 0;
-            return ESP_ERR_INVALID_SIZE;
-        }
-        if (i < capacity) {
-            convert(raw_buf, &devices[i]);
+            err = ESP_ERR_INVALID_SIZE;
+        } else if (i < capacity) {
+            err = convert(cfg, (dm_legacy_descriptor_t *)raw_buf, &cfg->devices[i]);
         }
     }
-    if (stored < capacity) {
-        memset(&devices[stored], 0,
-               sizeof(device_descriptor_t) * (capacity - stored));
+    heap_caps_free(raw_buf);
+    if (err != ESP_OK) {
+        dm_config_reset_devices(cfg, 0);
+        return err;
     }
-    free(raw_buf);
-    *out_count = (uint8_t)stored;
+    cfg->device_count = capacity;
     return ESP_OK;
 }
 
@@ -126,9 +154,7 @@ static esp_err_t read_variable_records(FILE *fp,
                                        const char *path,
                                        uint32_t raw_count,
                                        size_t expected_size,
-                                       device_descriptor_t *devices,
-                                       uint8_t capacity,
-                                       uint8_t *out_count,
+                                       device_manager_config_t *cfg,
                                        dm_profile_record_converter_t convert)
 {
     long data_start = ftell(fp);
@@ -150,9 +176,7 @@ static esp_err_t read_variable_records(FILE *fp,
         return ESP_ERR_INVALID_STATE;
     }
     if (raw_count == 0) {
-        *out_count = 0;
-        memset(devices, 0, sizeof(device_descriptor_t) * capacity);
-        return ESP_OK;
+        return dm_config_reset_devices(cfg, 0);
     }
     size_t bytes = (size_t)(data_end - data_start);
     size_t record_size = bytes / raw_count;
@@ -171,18 +195,48 @@ static esp_err_t read_variable_records(FILE *fp,
                  record_size,
                  expected_size);
     }
-    return read_device_records(fp,
-                               path,
-                               raw_count,
-                               record_size,
-                               devices,
-                               capacity,
-                               out_count,
-                               convert);
+    return read_device_records(fp, path, raw_count, record_size, cfg, convert);
+}
+
+// Encodes the records and compresses them when that pays off; *out is heap allocated.
+static esp_err_t build_body(const device_descriptor_t *devices,
+                            uint8_t count,
+                            dm_profile_body_header_t *body_hdr,
+                            uint8_t **out)
+{
+    uint8_t *records = NULL;
+    size_t records_len = 0;
+    esp_err_t err = dm_profile_encode(devices, count, &records, &records_len);
+    if (err != ESP_OK) {
+        return err;
+    }
+    *body_hdr = (dm_profile_body_header_t){
+        .body_len = (uint32_t)records_len,
+        .stored_len = (uint32_t)records_len,
+    };
+    *out = records;
+    if ((DM_PROFILE_BODY_FLAGS & DM_PROFILE_BODY_LZ) && records_len > 64) {
+        uint8_t *packed = heap_caps_malloc(records_len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!packed) {
+            packed = heap_caps_malloc(records_len, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        }
+        size_t packed_len = packed ? dm_profile_lz_compress(records, records_len, packed, records_len - 1) : 0;
+        if (packed_len) {
+            heap_caps_free(records);
+            *out = packed;
+            body_hdr->flags |= DM_PROFILE_BODY_LZ;
+            body_hdr->stored_len = (uint32_t)packed_len;
+        } else {
+            heap_caps_free(packed);
+        }
+    }
+    body_hdr->crc32 = dm_profile_crc32(0, *out, body_hdr->stored_len);
+    return ESP_OK;
 }
 
 // Persist `count` descriptors for profile `id` to the SD card.
-static esp_err_t write_devices(const char *id, const device_descriptor_t *devices, uint8_t count)
+// staged: write "<file>.new" for dm_file_promote() instead of replacing the profile file.
+static esp_err_t write_devices(const char *id, const device_descriptor_t *devices, uint8_t count, bool staged)
 {
     if (!id || !id[0] || !devices || count > DEVICE_MANAGER_MAX_DEVICES) {
         return ESP_ERR_INVALID_ARG;
@@ -196,40 +250,103 @@ static esp_err_t write_devices(const char *id, const device_descriptor_t *device
     if (err != ESP_OK) {
         return err;
     }
-    FILE *fp = fopen(path, "wb");
-    if (!fp) {
-        ESP_LOGE(TAG, "open %s for write failed: %d", path, errno);
-        return ESP_FAIL;
+    dm_profile_body_header_t body_hdr;
+    uint8_t *body = NULL;
+    err = build_body(devices, count, &body_hdr, &body);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "encode profile %s failed: %s", id, esp_err_to_name(err));
+        return err;
     }
     dm_profile_file_header_t hdr = {
         .magic = DM_PROFILE_MAGIC,
         .version = DM_PROFILE_VERSION,
         .device_count = count,
     };
-    if (fwrite(&hdr, 1, sizeof(hdr), fp) != sizeof(hdr)) {
-        ESP_LOGE(TAG, "write header to %s failed: %d", path, errno);
-        fclose(fp);
-        return ESP_FAIL;
+    const dm_file_part_t parts[] = {
+        {&hdr, sizeof(hdr)},
+        {&body_hdr, sizeof(body_hdr)},
+        {body, body_hdr.stored_len},
+    };
+    err = staged ? dm_file_stage(path, parts, sizeof(parts) / sizeof(parts[0]))
+                 : dm_file_write_atomic(path, parts, sizeof(parts) / sizeof(parts[0]));
+    heap_caps_free(body);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "write profile %s failed", path);
+        return err;
+    }
+    ESP_LOGD(TAG,
+             "profile %s: %u devices, %" PRIu32 " bytes stored (%" PRIu32 " encoded)",
+             id,
+             count,
+             body_hdr.stored_len,
+             body_hdr.body_len);
+    return ESP_OK;
+}
+
+static void *profile_buf_alloc(size_t size)
+{
+    void *buf = heap_caps_malloc(size ? size : 1, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!buf) {
+        buf = heap_caps_malloc(size ? size : 1, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    return buf;
+}
+
+// v5 body: CRC over what is on disk, then optional decompression, then record decoding.
+static esp_err_t read_compact_records(FILE *fp, const char *path, uint32_t raw_count, device_manager_config_t *cfg)
+{
+    dm_profile_body_header_t body_hdr;
+    if (fread(&body_hdr, 1, sizeof(body_hdr), fp) != sizeof(body_hdr)) {
+        ESP_LOGE(TAG, "profile %s truncated body header", path);
+        return ESP_ERR_INVALID_SIZE;
     }
-    if (count > 0) {
-        size_t written = fwrite(devices, sizeof(device_descriptor_t), count, fp);
-        if (written != count) {
-            ESP_LOGE(TAG, "write devices to %s failed: %d", path, errno);
-            fclose(fp);
-            return ESP_FAIL;
+    // Compact records are never larger than the raw structs they came from.
+    size_t body_max = (size_t)raw_count * sizeof(dm_legacy_descriptor_t) + 1024;
+    if (raw_count > UINT8_MAX || body_hdr.body_len > body_max || body_hdr.stored_len > body_max ||
+        (body_hdr.flags & ~DM_PROFILE_BODY_LZ) ||
+        (!(body_hdr.flags & DM_PROFILE_BODY_LZ) && body_hdr.stored_len != body_hdr.body_len)) {
+        ESP_LOGE(TAG, "profile %s invalid body header", path);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    uint8_t *stored = profile_buf_alloc(body_hdr.stored_len);
+    if (!stored) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (fread(stored, 1, body_hdr.stored_len, fp) != body_hdr.stored_len) {
+        ESP_LOGE(TAG, "profile %s truncated body", path);
+        heap_caps_free(stored);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (dm_profile_crc32(0, stored, body_hdr.stored_len) != body_hdr.crc32) {
+        ESP_LOGE(TAG, "profile %s CRC mismatch", path);
+        heap_caps_free(stored);
+        return ESP_ERR_INVALID_CRC;
+    }
+    uint8_t *records = stored;
+    if (body_hdr.flags & DM_PROFILE_BODY_LZ) {
+        records = profile_buf_alloc(body_hdr.body_len);
+        esp_err_t err = records ? dm_profile_lz_decompress(stored, body_hdr.stored_len, records, body_hdr.body_len)
+                                : ESP_ERR_NO_MEM;
+        heap_caps_free(stored);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "profile %s decompress failed: %s", path, esp_err_to_name(err));
+            heap_caps_free(records);
+            return err;
         }
     }
-    fclose(fp);
-    return ESP_OK;
+    esp_err_t err = dm_profile_decode(records, body_hdr.body_len, raw_count, cfg);
+    heap_caps_free(records);
+    if (err == ESP_OK && raw_count > cfg->device_count) {
+        ESP_LOGW(TAG, "profile %s truncated (%" PRIu32 " -> %u)", path, raw_count, cfg->device_count);
+    }
+    return err;
 }
 
-// Load profile binary, supporting all known on-disk versions.
-static esp_err_t read_devices(const char *id,
-                              device_descriptor_t *devices,
-                              uint8_t capacity,
-                              uint8_t *out_count)
+// Load profile binary, supporting all known on-disk versions. Replaces the devices of
+// cfg; it is left without devices on failure.
+static esp_err_t read_devices(const char *id, device_manager_config_t *cfg)
 {
-    if (!id || !id[0] || !devices || !out_count || capacity == 0) {
+    if (!id || !id[0] || !cfg) {
         return ESP_ERR_INVALID_ARG;
     }
     char path[DM_PROFILE_PATH_MAX];
@@ -237,11 +354,11 @@ static esp_err_t read_devices(const char *id,
     if (err != ESP_OK) {
         return err;
     }
+    dm_file_recover(path);
     FILE *fp = fopen(path, "rb");
     if (!fp) {
         ESP_LOGW(TAG, "profile %s missing", path);
-        *out_count = 0;
-        memset(devices, 0, sizeof(device_descriptor_t) * capacity);
+        dm_config_reset_devices(cfg, 0);
         return ESP_ERR_NOT_FOUND;
     }
     esp_err_t result = ESP_OK;
@@ -250,31 +367,20 @@ static esp_err_t read_devices(const char *id,
         ESP_LOGE(TAG, "profile %s invalid header", path);
         result = ESP_ERR_INVALID_STATE;
     } else if (hdr.version == DM_PROFILE_VERSION) {
-        result = read_device_records(fp,
-                                     path,
-                                     hdr.device_count,
-                                     sizeof(device_descriptor_t),
-                                     devices,
-                                     capacity,
-                                     out_count,
-                                     convert_device_current);
+        result = read_compact_records(fp, path, hdr.device_count, cfg);
+    } else if (hdr.version == 4u) {
+        result = read_device_records(fp, path, hdr.device_count, sizeof(dm_legacy_descriptor_t), cfg, convert_device_v4);
+    } else if (hdr.version == 3u) {
+        result = read_device_records(fp, path, hdr.device_count, DM_LEGACY_V3_RECORD_SIZE, cfg, convert_device_v3);
     } else if (hdr.version == 2u) {
-        result = read_variable_records(fp,
-                                       path,
-                                       hdr.device_count,
-                                       sizeof(device_descriptor_t),
-                                       devices,
-                                       capacity,
-                                       out_count,
-                                       convert_device_current);
+        result = read_variable_records(fp, path, hdr.device_count, DM_LEGACY_V3_RECORD_SIZE, cfg, convert_device_v3);
     } else {
         ESP_LOGE(TAG, "profile %s unsupported version %" PRIu32, path, hdr.version);
         result = ESP_ERR_INVALID_VERSION;
     }
     fclose(fp);
     if (result != ESP_OK) {
-        memset(devices, 0, sizeof(device_descriptor_t) * capacity);
-        *out_count = 0;
+        dm_config_reset_devices(cfg, 0);
     }
     return result;
 }
@@ -327,10 +433,8 @@ void dm_profiles_sync_from_active(device_manager_config_t *cfg, bool create_if_m
     if (!cfg || !profile) {
         return;
     }
-    uint8_t count = 0;
-    esp_err_t err = read_devices(profile->id, cfg->devices, cfg->device_capacity, &count);
+    esp_err_t err = read_devices(profile->id, cfg);
     if (err != ESP_OK) {
-        memset(cfg->devices, 0, sizeof(device_descriptor_t) * cfg->device_capacity);
         cfg->device_count = 0;
         profile->device_count = 0;
         if (create_if_missing && err == ESP_ERR_NOT_FOUND) {
@@ -344,8 +448,7 @@ void dm_profiles_sync_from_active(device_manager_config_t *cfg, bool create_if_m
         }
         return;
     }
-    cfg->device_count = count;
-    profile->device_count = count;
+    profile->device_count = cfg->device_count;
 }
 
 // Copy current in-memory device list counts back into the active profile entry.
@@ -391,16 +494,50 @@ esp_err_t dm_profiles_store_active(const device_manager_config_t *cfg)
     if (count > cfg->device_capacity) {
         count = cfg->device_capacity;
     }
-    return write_devices(cfg->active_profile, cfg->devices, count);
+    return write_devices(cfg->active_profile, cfg->devices, count, false);
 }
 
-// Load arbitrary profile file into caller-provided buffer.
-esp_err_t dm_profiles_load_profile(const char *profile_id,
-                                   device_descriptor_t *devices,
-                                   uint8_t capacity,
-                                   uint8_t *device_count)
+// Every file is staged before any is replaced, so a write failure leaves all of them as
+// they were.
+esp_err_t dm_profiles_store_all(device_manager_config_t *const *cfgs, size_t count)
 {
-    if (!profile_id || !profile_id[0] || !devices || !device_count || capacity == 0) {
+    if (!cfgs) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = ESP_OK;
+    size_t staged = 0;
+    for (; staged < count && err == ESP_OK; ++staged) {
+        const device_manager_config_t *cfg = cfgs[staged];
+        if (!cfg) {
+            continue;
+        }
+        if (!cfg->active_profile[0]) {
+            err = ESP_ERR_INVALID_ARG;
+            break;
+        }
+        uint8_t devices = cfg->device_count < cfg->device_capacity ? cfg->device_count : cfg->device_capacity;
+        err = write_devices(cfg->active_profile, cfg->devices, devices, true);
+    }
+    char path[DM_PROFILE_PATH_MAX];
+    for (size_t i = 0; i < staged; ++i) {
+        if (!cfgs[i] || make_profile_path(cfgs[i]->active_profile, path, sizeof(path)) != ESP_OK) {
+            continue;
+        }
+        if (err != ESP_OK) {
+            dm_file_unstage(path);
+        } else if (dm_file_promote(path) != ESP_OK) {
+            // Only a failed rename gets here; the profiles still staged are dropped.
+            ESP_LOGE(TAG, "promote profile %s failed", path);
+            err = ESP_FAIL;
+        }
+    }
+    return err;
+}
+
+// Load arbitrary profile file into the devices of cfg (profile list untouched).
+esp_err_t dm_profiles_load_profile(const char *profile_id, device_manager_config_t *cfg)
+{
+    if (!profile_id || !profile_id[0] || !cfg) {
         return ESP_ERR_INVALID_ARG;
     }
     char path[DM_PROFILE_PATH_MAX];
@@ -408,8 +545,7 @@ esp_err_t dm_profiles_load_profile(const char *profile_id,
     if (err != ESP_OK) {
         return err;
     }
-    esp_err_t result = read_devices(profile_id, devices, capacity, device_count);
-    return result;
+    return read_devices(profile_id, cfg);
 }
 
 // Remove on-disk profile, ignoring ENOENT.
@@ -423,14 +559,7 @@ esp_err_t dm_profiles_delete_profile_file(const char *profile_id)
     if (err != ESP_OK) {
         return err;
     }
-    if (unlink(path) != 0) {
-        if (errno == ENOENT) {
-            return ESP_OK;
-        }
-        ESP_LOGW(TAG, "unlink %s failed: %d", path, errno);
-        return ESP_FAIL;
-    }
-    return ESP_OK;
+    return dm_file_remove(path);
 }
 
 esp_err_t dm_profiles_export_raw(const char *profile_id, uint8_t **out_data, size_t *out_size)
@@ -448,6 +577,7 @@ esp_err_t dm_profiles_export_raw(const char *profile_id, uint8_t **out_data, siz
     if (err != ESP_OK) {
         return err;
     }
+    dm_file_recover(path);
     FILE *fp = fopen(path, "rb");
     if (!fp) {
         ESP_LOGE(TAG, "profile %s not found", path);
@@ -0,0 +1,397 @@
+#include "dm_payload_match.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+typedef struct {
+    const char *p;
+    size_t len;
+    bool json;      // cursor sits on a JSON value rather than the raw payload
+} payload_cursor_t;
+
+static const char *const s_match_names[DM_MQTT_MATCH_COUNT] = {
+    [DM_MQTT_MATCH_EXACT] = "exact",
+    [DM_MQTT_MATCH_PREFIX] = "prefix",
+    [DM_MQTT_MATCH_CONTAINS] = "contains",
+    [DM_MQTT_MATCH_EQUALS_NOCASE] = "equals_nocase",
+    [DM_MQTT_MATCH_RANGE] = "range",
+};
+
+const char *dm_mqtt_match_op_to_string(dm_mqtt_match_op_t op)
+{
+    return op < DM_MQTT_MATCH_COUNT ? s_match_names[op] : s_match_names[DM_MQTT_MATCH_EXACT];
+}
+
+bool dm_mqtt_match_op_from_string(const char *name, dm_mqtt_match_op_t *out)
+{
+    if (!name || !out) {
+        return false;
+    }
+    for (int i = 0; i < DM_MQTT_MATCH_COUNT; ++i) {
+        if (strcasecmp(s_match_names[i], name) == 0) {
+            *out = (dm_mqtt_match_op_t)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// JSON scanning -----------------------------------------------------------------
+
+static const char *skip_ws(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) {
+        ++p;
+    }
+    return p;
+}
+
+// `p` on the opening quote; returns the byte after the closing quote.
+static const char *scan_string(const char *p, const char *end)
+{
+    for (++p; p < end; ++p) {
+        if (*p == '\\') {
+            ++p;
+        } else if (*p == '"') {
+            return p + 1;
+        }
+    }
+    return NULL;
+}
+
+static const char *scan_value(const char *p, const char *end)
+{
+    if (p >= end) {
+        return NULL;
+    }
+    if (*p == '"') {
+        return scan_string(p, end);
+    }
+    if (*p == '{' || *p == '[') {
+        int depth = 0;
+        while (p < end) {
+            char c = *p;
+            if (c == '"') {
+                p = scan_string(p, end);
+                if (!p) {
+                    return NULL;
+                }
+                continue;
+            }
+            if (c == '{' || c == '[') {
+                depth++;
+            } else if (c == '}' || c == ']') {
+                if (--depth == 0) {
+                    return p + 1;
+                }
+            }
+            ++p;
+        }
+        return NULL;
+    }
+    const char *start = p;
+    while (p < end && *p != ',' && *p != '}' && *p != ']' &&
+           *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') {
+        ++p;
+    }
+    return p > start ? p : NULL;
+}
+
+// Narrows `cur` onto member `key` of the object it points at.
+static bool select_key(payload_cursor_t *cur, const char *key, size_t key_len)
+{
+    const char *end = cur->p + cur->len;
+    const char *p = skip_ws(cur->p, end);
+    if (p >= end || *p != '{') {
+        return false;
+    }
+    p = skip_ws(p + 1, end);
+    while (p < end && *p == '"') {
+        const char *name = p + 1;
+        p = scan_string(p, end);
+        if (!p) {
+            return false;
+        }
+        bool hit = (size_t)(p - 1 - name) == key_len && memcmp(name, key, key_len) == 0;
+        p = skip_ws(p, end);
+        if (p >= end || *p != ':') {
+            return false;
+        }
+        p = skip_ws(p + 1, end);
+        const char *value_end = scan_value(p, end);
+        if (!value_end) {
+            return false;
+        }
+        if (hit) {
+            cur->p = p;
+            cur->len = (size_t)(value_end - p);
+            cur->json = true;
+            return true;
+        }
+        p = skip_ws(value_end, end);
+        if (p >= end || *p != ',') {
+            return false;
+        }
+        p = skip_ws(p + 1, end);
+    }
+    return false;
+}
+
+static bool select_index(payload_cursor_t *cur, uint16_t index)
+{
+    const char *end = cur->p + cur->len;
+    const char *p = skip_ws(cur->p, end);
+    if (p >= end || *p != '[') {
+        return false;
+    }
+    p = skip_ws(p + 1, end);
+    for (uint16_t i = 0; p < end && *p != ']'; ++i) {
+        const char *value_end = scan_value(p, end);
+        if (!value_end) {
+            return false;
+        }
+        if (i == index) {
+            cur->p = p;
+            cur->len = (size_t)(value_end - p);
+            cur->json = true;
+            return true;
+        }
+        p = skip_ws(value_end, end);
+        if (p >= end || *p != ',') {
+            return false;
+        }
+        p = skip_ws(p + 1, end);
+    }
+    return false;
+}
+
+// Text a compare step sees: JSON strings lose their quotes (escapes stay as sent).
+static void cursor_text(const payload_cursor_t *cur, const char **text, size_t *len)
+{
+    *text = cur->p;
+    *len = cur->len;
+    if (cur->json && cur->len >= 2 && cur->p[0] == '"') {
+        *text = cur->p + 1;
+        *len = cur->len - 2;
+    }
+}
+
+static bool cursor_number(const payload_cursor_t *cur, double *out)
+{
+    const char *text;
+    size_t len;
+    cursor_text(cur, &text, &len);
+    const char *end = text + len;
+    const char *p = skip_ws(text, end);
+    if (p >= end || !(*p == '-' || *p == '+' || *p == '.' || (*p >= '0' && *p <= '9'))) {
+        return false;
+    }
+    // Every span ends at a delimiter or the payload terminator, so strtod stays inside it.
+    char *num_end = NULL;
+    double value = strtod(p, &num_end);
+    if (num_end == p || num_end > end || skip_ws(num_end, end) != end || isnan(value)) {
+        return false;
+    }
+    *out = value;
+    return true;
+}
+
+static bool span_contains(const char *text, size_t len, const char *needle, size_t needle_len)
+{
+    if (needle_len == 0) {
+        return true;
+    }
+    for (size_t i = 0; i + needle_len <= len; ++i) {
+        if (text[i] == needle[0] && memcmp(text + i, needle, needle_len) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool dm_payload_program_run(const dm_payload_program_t *prog, const char *payload)
+{
+    if (!prog) {
+        return false;
+    }
+    if (!payload) {
+        payload = "";
+    }
+    payload_cursor_t cur = {.p = payload, .len = strlen(payload), .json = false};
+    for (uint8_t i = 0; i < prog->count; ++i) {
+        const dm_payload_insn_t *insn = &prog->insns[i];
+        const char *text;
+        size_t len;
+        double value;
+        bool ok;
+        switch (insn->op) {
+        case DM_PAYLOAD_OP_ACCEPT:
+            return true;
+        case DM_PAYLOAD_OP_KEY:
+            ok = select_key(&cur, insn->str, insn->len);
+            break;
+        case DM_PAYLOAD_OP_INDEX:
+            ok = select_index(&cur, insn->index);
+            break;
+        case DM_PAYLOAD_OP_EQ:
+            cursor_text(&cur, &text, &len);
+            ok = len == insn->len && memcmp(text, insn->str, len) == 0;
+            break;
+        case DM_PAYLOAD_OP_EQ_NOCASE:
+            cursor_text(&cur, &text, &len);
+            ok = len == insn->len && strncasecmp(text, insn->str, len) == 0;
+            break;
+        case DM_PAYLOAD_OP_PREFIX:
+            cursor_text(&cur, &text, &len);
+            ok = len >= insn->len && memcmp(text, insn->str, insn->len) == 0;
+            break;
+        case DM_PAYLOAD_OP_CONTAINS:
+            cursor_text(&cur, &text, &len);
+            ok = span_contains(text, len, insn->str, insn->len);
+            break;
+        case DM_PAYLOAD_OP_MIN:
+            ok = cursor_number(&cur, &value) && value >= (double)insn->num;
+            break;
+        case DM_PAYLOAD_OP_MAX:
+            ok = cursor_number(&cur, &value) && value <= (double)insn->num;
+            break;
+        case DM_PAYLOAD_OP_NUMBER:
+            ok = cursor_number(&cur, &value);
+            break;
+        case DM_PAYLOAD_OP_REJECT:
+        default:
+            ok = false;
+            break;
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Compilation -------------------------------------------------------------------
+
+static bool emit(dm_payload_program_t *prog, uint8_t op, const char *str, size_t len)
+{
+    if (prog->count >= DM_PAYLOAD_PROGRAM_MAX || len > UINT8_MAX) {
+        return false;
+    }
+    dm_payload_insn_t *insn = &prog->insns[prog->count++];
+    memset(insn, 0, sizeof(*insn));
+    insn->op = op;
+    insn->str = str;
+    insn->len = (uint8_t)len;
+    return true;
+}
+
+// "a.b[2].c" -> KEY a, KEY b, INDEX 2, KEY c. A leading "[n]" indexes a top-level array.
+static bool compile_path(dm_payload_program_t *prog, const char *path)
+{
+    const char *p = path;
+    uint8_t depth = 0;
+    while (*p) {
+        if (*p == '[') {
+            char *num_end = NULL;
+            long index = strtol(p + 1, &num_end, 10);
+            if (num_end == p + 1 || *num_end != ']' || index < 0 || index > UINT16_MAX ||
+                ++depth > DM_PAYLOAD_PATH_MAX_DEPTH || !emit(prog, DM_PAYLOAD_OP_INDEX, NULL, 0)) {
+                return false;
+            }
+            prog->insns[prog->count - 1].index = (uint16_t)index;
+            p = num_end + 1;
+        } else {
+            const char *key = p;
+            while (*p && *p != '.' && *p != '[') {
+                ++p;
+            }
+            if (p == key || ++depth > DM_PAYLOAD_PATH_MAX_DEPTH ||
+                !emit(prog, DM_PAYLOAD_OP_KEY, key, (size_t)(p - key))) {
+                return false;
+            }
+        }
+        if (*p == '.') {
+            if (!*++p) {
+                return false;
+            }
+        } else if (*p && *p != '[') {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool emit_bound(dm_payload_program_t *prog, uint8_t op, float bound)
+{
+    if (!emit(prog, op, NULL, 0)) {
+        return false;
+    }
+    prog->insns[prog->count - 1].num = bound;
+    return true;
+}
+
+esp_err_t dm_payload_program_compile(dm_payload_program_t *prog,
+                                     const dm_mqtt_trigger_rule_t *rule,
+                                     const dm_mqtt_rule_match_t *match)
+{
+    if (!prog || !rule) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(prog, 0, sizeof(*prog));
+    uint8_t op = match ? match->op : DM_MQTT_MATCH_EXACT;
+    bool has_path = match && match->field[0];
+    if (op >= DM_MQTT_MATCH_COUNT ||
+        (has_path && (strnlen(match->field, sizeof(match->field)) >= sizeof(match->field) ||
+                      !compile_path(prog, match->field)))) {
+        memset(prog, 0, sizeof(*prog));
+        emit(prog, DM_PAYLOAD_OP_REJECT, NULL, 0);
+        return ESP_ERR_INVALID_ARG;
+    }
+    size_t len = strnlen(rule->payload, sizeof(rule->payload));
+    bool ok = true;
+    switch (op) {
+    case DM_MQTT_MATCH_EXACT:
+        if (has_path) {
+            // A bare field path only asks for the field to be present.
+            ok = (len || rule->payload_required) ? emit(prog, DM_PAYLOAD_OP_EQ, rule->payload, len)
+                                                 : emit(prog, DM_PAYLOAD_OP_ACCEPT, NULL, 0);
+        } else if (!len) {
+            ok = emit(prog, rule->payload_required ? DM_PAYLOAD_OP_REJECT : DM_PAYLOAD_OP_ACCEPT, NULL, 0);
+        } else {
+            ok = emit(prog, rule->payload_required ? DM_PAYLOAD_OP_EQ : DM_PAYLOAD_OP_ACCEPT,
+                      rule->payload, rule->payload_required ? len : 0);
+        }
+        break;
+    case DM_MQTT_MATCH_PREFIX:
+        ok = emit(prog, DM_PAYLOAD_OP_PREFIX, rule->payload, len);
+        break;
+    case DM_MQTT_MATCH_CONTAINS:
+        ok = emit(prog, DM_PAYLOAD_OP_CONTAINS, rule->payload, len);
+        break;
+    case DM_MQTT_MATCH_EQUALS_NOCASE:
+        ok = emit(prog, DM_PAYLOAD_OP_EQ_NOCASE, rule->payload, len);
+        break;
+    case DM_MQTT_MATCH_RANGE:
+        if (match->has_min) {
+            ok = emit_bound(prog, DM_PAYLOAD_OP_MIN, match->min);
+        }
+        if (ok && match->has_max) {
+            ok = emit_bound(prog, DM_PAYLOAD_OP_MAX, match->max);
+        }
+        if (ok && !match->has_min && !match->has_max) {
+            ok = emit(prog, DM_PAYLOAD_OP_NUMBER, NULL, 0);
+        }
+        break;
+    default:
+        ok = false;
+        break;
+    }
+    if (!ok) {
+        memset(prog, 0, sizeof(*prog));
+        emit(prog, DM_PAYLOAD_OP_REJECT, NULL, 0);
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,153 @@
+#include "dm_rate_gate.h"
+
+#include <string.h>
+#include <strings.h>
+
+static const char *const s_mode_names[DM_RATE_MODE_COUNT] = {
+    [DM_RATE_MODE_DEFAULT] = "default",
+    [DM_RATE_MODE_NONE] = "none",
+    [DM_RATE_MODE_DEBOUNCE] = "debounce",
+    [DM_RATE_MODE_THROTTLE] = "throttle",
+};
+
+const char *dm_rate_mode_to_string(dm_rate_mode_t mode)
+{
+    return mode < DM_RATE_MODE_COUNT ? s_mode_names[mode] : s_mode_names[DM_RATE_MODE_DEFAULT];
+}
+
+bool dm_rate_mode_from_string(const char *name, dm_rate_mode_t *out)
+{
+    if (!name || !out) {
+        return false;
+    }
+    for (int i = 0; i < DM_RATE_MODE_COUNT; ++i) {
+        if (strcasecmp(s_mode_names[i], name) == 0) {
+            *out = (dm_rate_mode_t)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *dm_rate_edges_to_string(uint8_t edges)
+{
+    switch (edges & (DM_RATE_EDGE_LEADING | DM_RATE_EDGE_TRAILING)) {
+    case DM_RATE_EDGE_TRAILING:
+        return "trailing";
+    case DM_RATE_EDGE_LEADING | DM_RATE_EDGE_TRAILING:
+        return "both";
+    default:
+        return "leading";
+    }
+}
+
+bool dm_rate_edges_from_string(const char *name, uint8_t *out)
+{
+    if (!name || !out) {
+        return false;
+    }
+    if (strcasecmp(name, "leading") == 0) {
+        *out = DM_RATE_EDGE_LEADING;
+    } else if (strcasecmp(name, "trailing") == 0) {
+        *out = DM_RATE_EDGE_TRAILING;
+    } else if (strcasecmp(name, "both") == 0) {
+        *out = DM_RATE_EDGE_LEADING | DM_RATE_EDGE_TRAILING;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static uint8_t gate_edges(const dm_rate_gate_t *gate)
+{
+    return gate->limit.edges ? gate->limit.edges : DM_RATE_EDGE_LEADING;
+}
+
+// Window closed: pay out a held-back event. A throttle keeps its pace by opening a new window.
+static void gate_window_closed(void *arg)
+{
+    dm_rate_gate_t *gate = (dm_rate_gate_t *)arg;
+    if (!gate->pending) {
+        return;
+    }
+    gate->pending = false;
+    gate->passed++;
+    if (gate->limit.mode == DM_RATE_MODE_THROTTLE) {
+        dm_timer_arm(&gate->window, gate->limit.window_ms);
+    }
+    if (gate->fire) {
+        gate->fire(gate, gate->arg);
+    }
+}
+
+void dm_rate_gate_init(dm_rate_gate_t *gate,
+                       const dm_rate_limit_t *limit,
+                       const dm_rate_limit_t *fallback,
+                       dm_rate_fire_cb_t fire,
+                       void *arg)
+{
+    if (!gate) {
+        return;
+    }
+    memset(gate, 0, sizeof(*gate));
+    if (limit && limit->mode != DM_RATE_MODE_DEFAULT) {
+        gate->limit = *limit;
+    } else if (fallback) {
+        gate->limit = *fallback;
+    }
+    gate->fire = fire;
+    gate->arg = arg;
+    dm_timer_init(&gate->window, gate_window_closed, gate);
+}
+
+bool dm_rate_gate_active(const dm_rate_gate_t *gate)
+{
+    return gate && gate->limit.window_ms &&
+           (gate->limit.mode == DM_RATE_MODE_DEBOUNCE || gate->limit.mode == DM_RATE_MODE_THROTTLE);
+}
+
+bool dm_rate_gate_admit(dm_rate_gate_t *gate)
+{
+    if (!gate) {
+        return false;
+    }
+    if (!dm_rate_gate_active(gate)) {
+        gate->passed++;
+        return true;
+    }
+    uint8_t edges = gate_edges(gate);
+    bool admit = false;
+    dm_timer_wheel_lock();
+    if (!dm_timer_armed(&gate->window)) {
+        dm_timer_arm(&gate->window, gate->limit.window_ms);
+        if (edges & DM_RATE_EDGE_LEADING) {
+            gate->passed++;
+            admit = true;
+        } else {
+            gate->pending = true;
+        }
+    } else {
+        if (gate->limit.mode == DM_RATE_MODE_DEBOUNCE) {
+            dm_timer_arm(&gate->window, gate->limit.window_ms);
+        }
+        // With a trailing edge the newest event replaces the one already owed.
+        if ((edges & DM_RATE_EDGE_TRAILING) && !gate->pending) {
+            gate->pending = true;
+        } else {
+            gate->suppressed++;
+        }
+    }
+    dm_timer_wheel_unlock();
+    return admit;
+}
+
+void dm_rate_gate_reset(dm_rate_gate_t *gate)
+{
+    if (!gate) {
+        return;
+    }
+    dm_timer_wheel_lock();
+    dm_timer_disarm(&gate->window);
+    gate->pending = false;
+    dm_timer_wheel_unlock();
+}
@@ -5,9 +5,11 @@
 
 #include "device_manager_utils.h"
 
+static const dm_condition_template_t s_empty_template;
+
 static bool evaluate_condition(const dm_condition_runtime_t *rt, bool *ready)
 {
-    if (!rt || rt->config.rule_count == 0) {
+    if (!rt || rt->config->rule_count == 0) {
         if (ready) {
             *ready = false;
         }
@@ -16,8 +18,8 @@ static bool evaluate_condition(const dm_condition_runtime_t *rt, bool *ready)
     bool have_ready = true;
     bool any_true = false;
     bool all_true = true;
-    for (uint8_t i = 0; i < rt->config.rule_count && i < DM_CONDITION_TEMPLATE_MAX_RULES; ++i) {
-        const dm_condition_rule_t *rule = &rt->config.rules[i];
+    for (uint8_t i = 0; i < rt->config->rule_count && i < DM_CONDITION_TEMPLATE_MAX_RULES; ++i) {
+        const dm_condition_rule_t *rule = &rt->config->rules[i];
         bool state_valid = rt->rules[i].valid;
         bool state = rt->rules[i].state;
         if (!state_valid) {
@@ -27,14 +29,14 @@ static bool evaluate_condition(const dm_condition_runtime_t *rt, bool *ready)
         bool matches = state == rule->required_state;
         any_true |= matches;
         all_true &= matches;
-        if (rt->config.mode == DEVICE_CONDITION_ALL && !matches) {
+        if (rt->config->mode == DEVICE_CONDITION_ALL && !matches) {
             // continue to ensure ready flag computed
         }
     }
     if (ready) {
         *ready = have_ready;
     }
-    return (rt->config.mode == DEVICE_CONDITION_ALL) ? all_true : any_true;
+    return (rt->config->mode == DEVICE_CONDITION_ALL) ? all_true : any_true;
 }
 
 void dm_condition_runtime_init(dm_condition_runtime_t *rt, const dm_condition_template_t *tpl)
@@ -42,11 +44,7 @@ void dm_condition_runtime_init(dm_condition_runtime_t *rt, const dm_condition_te
     if (!rt) {
         return;
     }
-    if (tpl) {
-        memcpy(&rt->config, tpl, sizeof(*tpl));
-    } else {
-        memset(&rt->config, 0, sizeof(rt->config));
-    }
+    rt->config = tpl ? tpl : &s_empty_template;
     memset(rt->rules, 0, sizeof(rt->rules));
     rt->has_last_result = false;
     rt->last_result = false;
@@ -65,9 +63,9 @@ bool dm_condition_runtime_handle_flag(dm_condition_runtime_t *rt,
         return false;
     }
     bool matched = false;
-    for (uint8_t i = 0; i < rt->config.rule_count && i < DM_CONDITION_TEMPLATE_MAX_RULES; ++i) {
-        if (rt->config.rules[i].flag[0] &&
-            strcasecmp(rt->config.rules[i].flag, flag_name) == 0) {
+    for (uint8_t i = 0; i < rt->config->rule_count && i < DM_CONDITION_TEMPLATE_MAX_RULES; ++i) {
+        if (rt->config->rules[i].flag[0] &&
+            strcasecmp(rt->config->rules[i].flag, flag_name) == 0) {
             rt->rules[i].valid = true;
             rt->rules[i].state = new_state;
             matched = true;
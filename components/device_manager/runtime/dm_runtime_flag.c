@@ -5,16 +5,14 @@
 
 #include "device_manager_utils.h"
 
+static const dm_flag_trigger_template_t s_empty_template;
+
 void dm_flag_trigger_runtime_init(dm_flag_trigger_runtime_t *rt, const dm_flag_trigger_template_t *tpl)
 {
     if (!rt) {
         return;
     }
-    if (tpl) {
-        memcpy(&rt->config, tpl, sizeof(*tpl));
-    } else {
-        memset(&rt->config, 0, sizeof(rt->config));
-    }
+    rt->config = tpl ? tpl : &s_empty_template;
     memset(rt->rules, 0, sizeof(rt->rules));
 }
 
@@ -25,8 +23,8 @@ const dm_flag_trigger_rule_t *dm_flag_trigger_runtime_handle(dm_flag_trigger_run
     if (!rt || !flag_name || !flag_name[0]) {
         return NULL;
     }
-    for (uint8_t i = 0; i < rt->config.rule_count && i < DM_FLAG_TRIGGER_MAX_RULES; ++i) {
-        const dm_flag_trigger_rule_t *rule = &rt->config.rules[i];
+    for (uint8_t i = 0; i < rt->config->rule_count && i < DM_FLAG_TRIGGER_MAX_RULES; ++i) {
+        const dm_flag_trigger_rule_t *rule = &rt->config->rules[i];
         if (!rule->flag[0] || !rule->scenario[0]) {
             continue;
         }
@@ -2,35 +2,25 @@
 
 #include <string.h>
 
+#include "esp_log.h"
+
 #include "device_manager_utils.h"
 
+static const char *TAG = "dm_runtime_mqtt";
+static const dm_mqtt_trigger_template_t s_empty_template;
+
 void dm_mqtt_trigger_runtime_init(dm_mqtt_trigger_runtime_t *rt, const dm_mqtt_trigger_template_t *tpl)
 {
     if (!rt) {
         return;
     }
-    if (tpl) {
-        memcpy(&rt->config, tpl, sizeof(*tpl));
-    } else {
-        memset(&rt->config, 0, sizeof(rt->config));
-    }
-}
-
-static bool payload_matches(const dm_mqtt_trigger_rule_t *rule, const char *payload)
-{
-    if (!rule) {
-        return false;
-    }
-    if (!rule->payload[0]) {
-        return !rule->payload_required;
-    }
-    if (!rule->payload_required) {
-        return true;
-    }
-    if (!payload) {
-        payload = "";
+    rt->config = tpl ? tpl : &s_empty_template;
+    for (uint8_t i = 0; i < rt->config->rule_count && i < DM_MQTT_TRIGGER_MAX_RULES; ++i) {
+        const dm_mqtt_trigger_rule_t *rule = &rt->config->rules[i];
+        if (dm_payload_program_compile(&rt->programs[i], rule, &rt->config->matches[i]) != ESP_OK) {
+            ESP_LOGW(TAG, "rule %u (%s) has an invalid condition and never matches", i, rule->topic);
+        }
     }
-    return strcmp(rule->payload, payload) == 0;
 }
 
 const dm_mqtt_trigger_rule_t *dm_mqtt_trigger_runtime_match(dm_mqtt_trigger_runtime_t *rt,
@@ -40,15 +30,15 @@ const dm_mqtt_trigger_rule_t *dm_mqtt_trigger_runtime_match(dm_mqtt_trigger_runt
     if (!rt || !topic || !topic[0]) {
         return NULL;
     }
-    for (uint8_t i = 0; i < rt->config.rule_count && i < DM_MQTT_TRIGGER_MAX_RULES; ++i) {
-        const dm_mqtt_trigger_rule_t *rule = &rt->config.rules[i];
+    for (uint8_t i = 0; i < rt->config->rule_count && i < DM_MQTT_TRIGGER_MAX_RULES; ++i) {
+        const dm_mqtt_trigger_rule_t *rule = &rt->config->rules[i];
         if (!rule->topic[0] || !rule->scenario[0]) {
             continue;
         }
         if (strcmp(rule->topic, topic) != 0) {
             continue;
         }
-        if (!payload_matches(rule, payload)) {
+        if (!dm_payload_program_run(&rt->programs[i], payload)) {
             continue;
         }
         return rule;
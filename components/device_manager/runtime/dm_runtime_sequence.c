@@ -4,6 +4,8 @@
 
 #include "device_manager_utils.h"
 
+static const dm_sequence_template_t s_empty_template;
+
 static bool payload_matches(const dm_sequence_step_t *step, const char *payload)
 {
     if (!step) {
@@ -34,11 +36,7 @@ void dm_sequence_runtime_init(dm_sequence_runtime_t *rt, const dm_sequence_templ
     if (!rt) {
         return;
     }
-    if (tpl) {
-        memcpy(&rt->config, tpl, sizeof(*tpl));
-    } else {
-        memset(&rt->config, 0, sizeof(rt->config));
-    }
+    rt->config = tpl ? tpl : &s_empty_template;
     rt->current_index = 0;
     rt->last_step_ms = 0;
 }
@@ -80,7 +78,7 @@ dm_sequence_action_t dm_sequence_runtime_handle(dm_sequence_runtime_t *rt,
     if (!rt || !topic || !topic[0]) {
         return action;
     }
-    const dm_sequence_template_t *cfg = &rt->config;
+    const dm_sequence_template_t *cfg = rt->config;
     if (cfg->step_count == 0) {
         return action;
     }
@@ -126,3 +124,19 @@ dm_sequence_action_t dm_sequence_runtime_handle(dm_sequence_runtime_t *rt,
     }
     return action;
 }
+
+dm_sequence_action_t dm_sequence_runtime_timeout(dm_sequence_runtime_t *rt)
+{
+    dm_sequence_action_t action = {
+        .type = DM_SEQUENCE_EVENT_NONE,
+        .step = NULL,
+        .timeout = false,
+    };
+    if (!rt || rt->current_index == 0) {
+        return action;
+    }
+    dm_sequence_runtime_reset(rt);
+    action.type = DM_SEQUENCE_EVENT_FAILED;
+    action.timeout = true;
+    return action;
+}
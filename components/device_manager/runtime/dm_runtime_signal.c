@@ -4,6 +4,8 @@
 
 #include "device_manager_utils.h"
 
+static const dm_signal_hold_template_t s_empty_template;
+
 static void fill_signal_payloads(const dm_signal_hold_template_t *tpl,
                                  dm_signal_action_t *action,
                                  bool success)
@@ -36,11 +38,7 @@ void dm_signal_runtime_init(dm_signal_runtime_t *rt, const dm_signal_hold_templa
     if (!rt) {
         return;
     }
-    if (tpl) {
-        memcpy(&rt->config, tpl, sizeof(*tpl));
-    } else {
-        memset(&rt->config, 0, sizeof(rt->config));
-    }
+    rt->config = tpl ? tpl : &s_empty_template;
     dm_signal_state_reset(&rt->state);
 }
 
@@ -49,7 +47,7 @@ void dm_signal_runtime_set_template(dm_signal_runtime_t *rt, const dm_signal_hol
     if (!rt || !tpl) {
         return;
     }
-    memcpy(&rt->config, tpl, sizeof(*tpl));
+    rt->config = tpl;
     dm_signal_state_reset(&rt->state);
 }
 
@@ -59,26 +57,26 @@ dm_signal_action_t dm_signal_runtime_handle_tick(dm_signal_runtime_t *rt, uint64
     if (!rt) {
         return action;
     }
-    dm_signal_event_t ev = dm_signal_handle_tick(&rt->state, &rt->config, now_ms);
+    dm_signal_event_t ev = dm_signal_handle_tick(&rt->state, rt->config, now_ms);
     action.event = ev.type;
     action.accumulated_ms = ev.accumulated_ms;
 
     switch (ev.type) {
     case DM_SIGNAL_EVENT_START:
-        if (rt->config.hold_track[0]) {
+        if (rt->config->hold_track[0]) {
             action.audio_play = true;
-            dm_str_copy(action.audio_track, sizeof(action.audio_track), rt->config.hold_track);
+            dm_str_copy(action.audio_track, sizeof(action.audio_track), rt->config->hold_track);
         }
         break;
     case DM_SIGNAL_EVENT_STOP:
         action.audio_pause = true;
         break;
     case DM_SIGNAL_EVENT_COMPLETED:
-        if (rt->config.complete_track[0]) {
+        if (rt->config->complete_track[0]) {
             action.audio_play = true;
-            dm_str_copy(action.audio_track, sizeof(action.audio_track), rt->config.complete_track);
+            dm_str_copy(action.audio_track, sizeof(action.audio_track), rt->config->complete_track);
         }
-        fill_signal_payloads(&rt->config, &action, true);
+        fill_signal_payloads(rt->config, &action, true);
         break;
     default:
         break;
@@ -93,7 +91,7 @@ dm_signal_action_t dm_signal_runtime_handle_timeout(dm_signal_runtime_t *rt)
     if (!rt) {
         return action;
     }
-    dm_signal_event_t ev = dm_signal_handle_timeout(&rt->state, &rt->config);
+    dm_signal_event_t ev = dm_signal_handle_timeout(&rt->state, rt->config);
     action.event = ev.type;
     action.accumulated_ms = ev.accumulated_ms;
     if (ev.type == DM_SIGNAL_EVENT_STOP) {
@@ -2,11 +2,14 @@
 
 #include <string.h>
 #include <ctype.h>
+#include <sys/stat.h>
 
 #include "esp_log.h"
 
 #include "device_manager_utils.h"
 
+static const dm_uid_template_t s_empty_template;
+
 static const char *TAG = "dm_runtime_uid";
 
 static void fill_action(const dm_uid_template_t *tpl, bool success, dm_uid_action_t *action)
@@ -36,16 +39,65 @@ static void fill_action(const dm_uid_template_t *tpl, bool success, dm_uid_actio
     }
 }
 
+static void build_value_sets(dm_uid_runtime_t *rt)
+{
+    const dm_uid_template_t *tpl = rt->config;
+    for (uint8_t i = 0; i < tpl->slot_count && i < DM_UID_TEMPLATE_MAX_SLOTS; ++i) {
+        const dm_uid_slot_t *slot = &tpl->slots[i];
+        dm_uid_set_t *set = &rt->values[i];
+        esp_err_t err = ESP_OK;
+        for (uint8_t v = 0; err == ESP_OK && v < slot->value_count && v < DM_UID_TEMPLATE_MAX_VALUES; ++v) {
+            const char *value = slot->values[v];
+            if (value[0] == DM_UID_VALUE_FILE_PREFIX) {
+                size_t added = 0;
+                err = dm_uid_set_load_csv(set, value + 1, &added);
+                if (err == ESP_OK) {
+                    ESP_LOGI(TAG, "slot %s: %u uids from %s", slot->source_id, (unsigned)added, value + 1);
+                } else if (err == ESP_ERR_NOT_FOUND) {
+                    err = ESP_OK;
+                }
+            } else {
+                err = dm_uid_set_add(set, value);
+            }
+        }
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "slot %s value set incomplete: %s", slot->source_id, esp_err_to_name(err));
+        }
+    }
+}
+
+uint64_t dm_uid_template_files_digest(const dm_uid_template_t *tpl, uint64_t hash)
+{
+    if (!tpl) {
+        return hash;
+    }
+    for (uint8_t i = 0; i < tpl->slot_count && i < DM_UID_TEMPLATE_MAX_SLOTS; ++i) {
+        const dm_uid_slot_t *slot = &tpl->slots[i];
+        for (uint8_t v = 0; v < slot->value_count && v < DM_UID_TEMPLATE_MAX_VALUES; ++v) {
+            if (slot->values[v][0] != DM_UID_VALUE_FILE_PREFIX) {
+                continue;
+            }
+            // A missing file stamps as zeros; it is picked up once it appears.
+            struct stat st;
+            uint64_t stamp[3] = {hash, 0, 0};
+            if (stat(slot->values[v] + 1, &st) == 0) {
+                stamp[1] = (uint64_t)st.st_size;
+                stamp[2] = (uint64_t)st.st_mtime;
+            }
+            hash = dm_hash_bytes(stamp, sizeof(stamp));
+        }
+    }
+    return hash;
+}
+
 void dm_uid_runtime_init(dm_uid_runtime_t *rt, const dm_uid_template_t *tpl)
 {
     if (!rt) {
         return;
     }
-    if (tpl) {
-        memcpy(&rt->config, tpl, sizeof(*tpl));
-    } else {
-        memset(&rt->config, 0, sizeof(rt->config));
-    }
+    rt->config = tpl ? tpl : &s_empty_template;
+    memset(rt->values, 0, sizeof(rt->values));
+    build_value_sets(rt);
     dm_uid_runtime_reset(rt);
 }
 
@@ -54,10 +106,22 @@ void dm_uid_runtime_set_template(dm_uid_runtime_t *rt, const dm_uid_template_t *
     if (!rt || !tpl) {
         return;
     }
-    memcpy(&rt->config, tpl, sizeof(*tpl));
+    dm_uid_runtime_deinit(rt);
+    rt->config = tpl;
+    build_value_sets(rt);
     dm_uid_runtime_reset(rt);
 }
 
+void dm_uid_runtime_deinit(dm_uid_runtime_t *rt)
+{
+    if (!rt) {
+        return;
+    }
+    for (size_t i = 0; i < DM_UID_TEMPLATE_MAX_SLOTS; ++i) {
+        dm_uid_set_clear(&rt->values[i]);
+    }
+}
+
 void dm_uid_runtime_reset(dm_uid_runtime_t *rt)
 {
     if (!rt) {
@@ -118,9 +182,11 @@ dm_uid_action_t dm_uid_runtime_handle_value(dm_uid_runtime_t *rt,
              source_id ? source_id : "(null)",
              value ? value : "",
              cleaned_value);
-    dm_uid_event_t ev = dm_uid_handle_value(&rt->state, &rt->config, source_id, cleaned_value);
+    int slot_index = dm_uid_find_slot(rt->config, source_id);
+    bool matched = slot_index >= 0 && dm_uid_set_contains(&rt->values[slot_index], cleaned_value);
+    dm_uid_event_t ev = dm_uid_handle_match(&rt->state, rt->config, slot_index, matched);
     if (ev.slot) {
-        int idx = (int)(ev.slot - rt->config.slots);
+        int idx = (int)(ev.slot - rt->config->slots);
         if (idx >= 0 && idx < DM_UID_TEMPLATE_MAX_SLOTS) {
             if (cleaned_value[0]) {
                 dm_str_copy(rt->slots[idx].value, sizeof(rt->slots[idx].value), cleaned_value);
@@ -135,7 +201,7 @@ dm_uid_action_t dm_uid_runtime_handle_value(dm_uid_runtime_t *rt,
                      uid_event_str(ev.type),
                      rt->slots[idx].has_value ? rt->slots[idx].value : "",
                      (unsigned)rt->state.ok_count,
-                     (unsigned)rt->config.slot_count,
+                     (unsigned)rt->config->slot_count,
                      rt->state.invalid_seen);
         }
     } else {
@@ -144,11 +210,11 @@ dm_uid_action_t dm_uid_runtime_handle_value(dm_uid_runtime_t *rt,
     action.event = ev.type;
     switch (ev.type) {
     case DM_UID_EVENT_INVALID:
-        fill_action(&rt->config, false, &action);
+        fill_action(rt->config, false, &action);
         dm_uid_state_reset(&rt->state);
         break;
     case DM_UID_EVENT_SUCCESS:
-        fill_action(&rt->config, true, &action);
+        fill_action(rt->config, true, &action);
         dm_uid_state_reset(&rt->state);
         break;
     default:
@@ -0,0 +1,251 @@
+#include "dm_timer_wheel.h"
+
+#include <stddef.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#define WHEEL_MASK (DM_TIMER_WHEEL_SLOTS - 1)
+
+static const char *TAG = "dm_timer_wheel";
+static dm_timer_t *s_slots[DM_TIMER_WHEEL_SLOTS];
+static uint64_t s_current;          // last processed tick
+static uint32_t s_armed;
+static bool s_running;
+static esp_timer_handle_t s_driver;
+static SemaphoreHandle_t s_lock;
+
+static uint64_t tick_of(int64_t us)
+{
+    return us > 0 ? (uint64_t)us / (DM_TIMER_WHEEL_TICK_MS * 1000ULL) : 0;
+}
+
+static uint32_t ms_to_ticks(uint32_t ms)
+{
+    uint32_t ticks = (ms + DM_TIMER_WHEEL_TICK_MS - 1) / DM_TIMER_WHEEL_TICK_MS;
+    return ticks ? ticks : 1;
+}
+
+static void driver_cb(void *arg)
+{
+    (void)arg;
+    dm_timer_wheel_advance(esp_timer_get_time());
+}
+
+esp_err_t dm_timer_wheel_init(void)
+{
+    if (!s_lock) {
+        s_lock = xSemaphoreCreateRecursiveMutex();
+        if (!s_lock) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    if (!s_driver) {
+        esp_timer_create_args_t args = {
+            .callback = driver_cb,
+            .name = "dm_timer_wheel",
+            .dispatch_method = ESP_TIMER_TASK,
+        };
+        esp_err_t err = esp_timer_create(&args, &s_driver);
+        if (err != ESP_OK) {
+            s_driver = NULL;
+            ESP_LOGE(TAG, "driver timer create failed: %s", esp_err_to_name(err));
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+static void link_timer(dm_timer_t *timer)
+{
+    dm_timer_t **head = &s_slots[timer->deadline & WHEEL_MASK];
+    timer->prev = NULL;
+    timer->next = *head;
+    if (*head) {
+        (*head)->prev = timer;
+    }
+    *head = timer;
+}
+
+static void unlink_timer(dm_timer_t *timer)
+{
+    if (timer->prev) {
+        timer->prev->next = timer->next;
+    } else {
+        s_slots[timer->deadline & WHEEL_MASK] = timer->next;
+    }
+    if (timer->next) {
+        timer->next->prev = timer->prev;
+    }
+    timer->next = NULL;
+    timer->prev = NULL;
+}
+
+void dm_timer_init(dm_timer_t *timer, dm_timer_cb_t cb, void *arg)
+{
+    if (!timer) {
+        return;
+    }
+    *timer = (dm_timer_t){
+        .cb = cb,
+        .arg = arg,
+    };
+}
+
+static void arm_timer(dm_timer_t *timer, uint32_t delay_ms, uint32_t period_ms)
+{
+    if (!timer || !timer->cb) {
+        return;
+    }
+    if (!s_lock && dm_timer_wheel_init() != ESP_OK) {
+        return;
+    }
+    xSemaphoreTakeRecursive(s_lock, portMAX_DELAY);
+    if (!s_running) {
+        // Slots between the last processed tick and now are empty while the wheel is idle.
+        uint64_t now = tick_of(esp_timer_get_time());
+        if (now > s_current) {
+            s_current = now;
+        }
+        if (s_driver && esp_timer_start_periodic(s_driver, DM_TIMER_WHEEL_TICK_MS * 1000ULL) == ESP_OK) {
+            s_running = true;
+        }
+    }
+    if (timer->armed) {
+        unlink_timer(timer);
+    } else {
+        s_armed++;
+    }
+    timer->deadline = s_current + ms_to_ticks(delay_ms);
+    timer->period_ticks = period_ms ? ms_to_ticks(period_ms) : 0;
+    timer->armed = true;
+    timer->firing = false;
+    link_timer(timer);
+    xSemaphoreGiveRecursive(s_lock);
+}
+
+void dm_timer_arm(dm_timer_t *timer, uint32_t delay_ms)
+{
+    arm_timer(timer, delay_ms, 0);
+}
+
+void dm_timer_arm_periodic(dm_timer_t *timer, uint32_t period_ms)
+{
+    arm_timer(timer, period_ms, period_ms);
+}
+
+void dm_timer_disarm(dm_timer_t *timer)
+{
+    if (!timer || !s_lock) {
+        return;
+    }
+    xSemaphoreTakeRecursive(s_lock, portMAX_DELAY);
+    if (timer->armed) {
+        unlink_timer(timer);
+        timer->armed = false;
+        s_armed--;
+    }
+    timer->firing = false;
+    xSemaphoreGiveRecursive(s_lock);
+}
+
+bool dm_timer_armed(const dm_timer_t *timer)
+{
+    return timer && timer->armed;
+}
+
+void dm_timer_wheel_lock(void)
+{
+    if (s_lock || dm_timer_wheel_init() == ESP_OK) {
+        xSemaphoreTakeRecursive(s_lock, portMAX_DELAY);
+    }
+}
+
+void dm_timer_wheel_unlock(void)
+{
+    if (s_lock) {
+        xSemaphoreGiveRecursive(s_lock);
+    }
+}
+
+void dm_timer_wheel_advance(int64_t now_us)
+{
+    if (!s_lock) {
+        return;
+    }
+    xSemaphoreTakeRecursive(s_lock, portMAX_DELAY);
+    uint64_t target = tick_of(now_us);
+    dm_timer_t *fire_head = NULL;
+    dm_timer_t **fire_tail = &fire_head;
+    if (target > s_current) {
+        // After a stall longer than one revolution every slot is visited once.
+        uint64_t steps = target - s_current;
+        if (steps > DM_TIMER_WHEEL_SLOTS) {
+            steps = DM_TIMER_WHEEL_SLOTS;
+        }
+        for (uint64_t i = 1; i <= steps; ++i) {
+            dm_timer_t *timer = s_slots[(s_current + i) & WHEEL_MASK];
+            while (timer) {
+                dm_timer_t *next = timer->next;
+                if (timer->deadline <= target) {
+                    unlink_timer(timer);
+                    if (timer->period_ticks) {
+                        // Keep the phase, skip periods missed during a stall.
+                        uint64_t missed = (target - timer->deadline) / timer->period_ticks;
+                        timer->deadline += (missed + 1) * timer->period_ticks;
+                        link_timer(timer);
+                    } else {
+                        timer->armed = false;
+                        s_armed--;
+                    }
+                    timer->firing = true;
+                    timer->fire_next = NULL;
+                    *fire_tail = timer;
+                    fire_tail = &timer->fire_next;
+                }
+                timer = next;
+            }
+        }
+        s_current = target;
+    }
+    // Callbacks may arm or disarm any timer; either clears a pending fire.
+    for (dm_timer_t *timer = fire_head; timer;) {
+        dm_timer_t *next = timer->fire_next;
+        if (timer->firing) {
+            timer->firing = false;
+            timer->cb(timer->arg);
+        }
+        timer = next;
+    }
+    if (s_armed == 0 && s_running) {
+        esp_timer_stop(s_driver);
+        s_running = false;
+    }
+    xSemaphoreGiveRecursive(s_lock);
+}
+
+void dm_timer_wheel_rebase(int64_t now_us)
+{
+    if (!s_lock) {
+        return;
+    }
+    xSemaphoreTakeRecursive(s_lock, portMAX_DELAY);
+    uint64_t target = tick_of(now_us);
+    dm_timer_t *moved = NULL;
+    for (size_t i = 0; i < DM_TIMER_WHEEL_SLOTS; ++i) {
+        while (s_slots[i]) {
+            dm_timer_t *timer = s_slots[i];
+            unlink_timer(timer);
+            timer->deadline = target + (timer->deadline > s_current ? timer->deadline - s_current : 1);
+            timer->fire_next = moved;
+            moved = timer;
+        }
+    }
+    for (dm_timer_t *timer = moved; timer; timer = timer->fire_next) {
+        link_timer(timer);
+    }
+    s_current = target;
+    xSemaphoreGiveRecursive(s_lock);
+}
@@ -0,0 +1,164 @@
+#include "dm_topic_index.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "esp_heap_caps.h"
+
+#define TOPIC_INDEX_MIN_SLOTS    64
+#define TOPIC_INDEX_MIN_BINDINGS 32
+
+static void *index_calloc(size_t n, size_t size)
+{
+    void *ptr = heap_caps_calloc(n, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!ptr) {
+        ptr = heap_caps_calloc(n, size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    return ptr;
+}
+
+static void *index_realloc(void *ptr, size_t size)
+{
+    void *next = heap_caps_realloc(ptr, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!next) {
+        next = heap_caps_realloc(ptr, size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    return next;
+}
+
+static uint32_t topic_hash(const char *s)
+{
+    uint32_t h = 2166136261u;
+    while (*s) {
+        h ^= (uint8_t)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Returns the slot holding topic, or the empty slot where it belongs.
+static dm_topic_slot_t *find_slot(dm_topic_slot_t *slots, size_t cap, const char *topic, uint32_t hash)
+{
+    size_t mask = cap - 1;
+    size_t pos = hash & mask;
+    while (slots[pos].topic) {
+        if (slots[pos].hash == hash && strcmp(slots[pos].topic, topic) == 0) {
+            break;
+        }
+        pos = (pos + 1) & mask;
+    }
+    return &slots[pos];
+}
+
+static esp_err_t grow_slots(dm_topic_index_t *index)
+{
+    size_t next_cap = index->slot_cap ? index->slot_cap * 2 : TOPIC_INDEX_MIN_SLOTS;
+    dm_topic_slot_t *next = index_calloc(next_cap, sizeof(dm_topic_slot_t));
+    if (!next) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (size_t i = 0; i < index->slot_cap; ++i) {
+        const dm_topic_slot_t *slot = &index->slots[i];
+        if (slot->topic) {
+            *find_slot(next, next_cap, slot->topic, slot->hash) = *slot;
+        }
+    }
+    heap_caps_free(index->slots);
+    index->slots = next;
+    index->slot_cap = next_cap;
+    return ESP_OK;
+}
+
+static esp_err_t reserve_binding(dm_topic_index_t *index)
+{
+    if (index->binding_count < index->binding_cap) {
+        return ESP_OK;
+    }
+    size_t next_cap = index->binding_cap ? index->binding_cap * 2 : TOPIC_INDEX_MIN_BINDINGS;
+    if (next_cap > DM_TOPIC_INDEX_END) {
+        next_cap = DM_TOPIC_INDEX_END;
+    }
+    if (next_cap <= index->binding_count) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    dm_topic_binding_t *next = index_realloc(index->bindings, next_cap * sizeof(dm_topic_binding_t));
+    if (!next) {
+        return ESP_ERR_NO_MEM;
+    }
+    index->bindings = next;
+    index->binding_cap = next_cap;
+    return ESP_OK;
+}
+
+esp_err_t dm_topic_index_add(dm_topic_index_t *index, const char *topic, void *runtime, uint8_t role)
+{
+    if (!index || !runtime) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!topic || !topic[0]) {
+        return ESP_OK;
+    }
+    // Keep the load factor at or below one half.
+    if ((index->topic_count + 1) * 2 > index->slot_cap) {
+        esp_err_t err = grow_slots(index);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    uint32_t hash = topic_hash(topic);
+    dm_topic_slot_t *slot = find_slot(index->slots, index->slot_cap, topic, hash);
+    if (slot->topic) {
+        for (uint16_t i = slot->head; i != DM_TOPIC_INDEX_END; i = index->bindings[i].next) {
+            if (index->bindings[i].runtime == runtime && index->bindings[i].role == role) {
+                return ESP_OK;
+            }
+        }
+    }
+    esp_err_t err = reserve_binding(index);
+    if (err != ESP_OK) {
+        return err;
+    }
+    uint16_t id = (uint16_t)index->binding_count++;
+    index->bindings[id] = (dm_topic_binding_t){
+        .runtime = runtime,
+        .role = role,
+        .next = DM_TOPIC_INDEX_END,
+    };
+    if (!slot->topic) {
+        slot->topic = topic;
+        slot->hash = hash;
+        slot->head = id;
+        index->topic_count++;
+    } else {
+        index->bindings[slot->tail].next = id;
+    }
+    slot->tail = id;
+    return ESP_OK;
+}
+
+const dm_topic_binding_t *dm_topic_index_find(const dm_topic_index_t *index, const char *topic)
+{
+    if (!index || !index->slots || !topic || !topic[0]) {
+        return NULL;
+    }
+    const dm_topic_slot_t *slot = find_slot(index->slots, index->slot_cap, topic, topic_hash(topic));
+    return slot->topic ? &index->bindings[slot->head] : NULL;
+}
+
+const dm_topic_binding_t *dm_topic_index_next(const dm_topic_index_t *index, const dm_topic_binding_t *binding)
+{
+    if (!index || !binding || binding->next == DM_TOPIC_INDEX_END) {
+        return NULL;
+    }
+    return &index->bindings[binding->next];
+}
+
+void dm_topic_index_clear(dm_topic_index_t *index)
+{
+    if (!index) {
+        return;
+    }
+    heap_caps_free(index->slots);
+    heap_caps_free(index->bindings);
+    memset(index, 0, sizeof(*index));
+}
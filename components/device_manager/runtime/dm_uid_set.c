@@ -0,0 +1,209 @@
+#include "dm_uid_set.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+#include "dm_templates.h"
+
+#define UID_SET_MIN_TABLE 16
+#define UID_SET_MIN_POOL  256
+#define UID_SET_LINE_MAX  128
+
+static const char *TAG = "dm_uid_set";
+
+static void *set_realloc(void *ptr, size_t size)
+{
+    void *next = heap_caps_realloc(ptr, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!next) {
+        next = heap_caps_realloc(ptr, size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    return next;
+}
+
+// Lower-cases value into out and returns its FNV-1a hash.
+static uint32_t fold_value(const char *value, char *out, size_t out_len)
+{
+    uint32_t h = 2166136261u;
+    size_t pos = 0;
+    while (value[pos] && pos < out_len - 1) {
+        char c = (char)tolower((unsigned char)value[pos]);
+        out[pos++] = c;
+        h ^= (uint8_t)c;
+        h *= 16777619u;
+    }
+    out[pos] = '\0';
+    return h;
+}
+
+static dm_uid_set_entry_t *find_entry(dm_uid_set_entry_t *table, size_t cap, const char *pool,
+                                      const char *key, uint32_t hash)
+{
+    size_t mask = cap - 1;
+    size_t pos = hash & mask;
+    while (table[pos].key) {
+        if (table[pos].hash == hash && strcmp(pool + table[pos].key - 1, key) == 0) {
+            break;
+        }
+        pos = (pos + 1) & mask;
+    }
+    return &table[pos];
+}
+
+static esp_err_t grow_table(dm_uid_set_t *set)
+{
+    size_t next_cap = set->table_cap ? set->table_cap * 2 : UID_SET_MIN_TABLE;
+    dm_uid_set_entry_t *next = set_realloc(NULL, next_cap * sizeof(dm_uid_set_entry_t));
+    if (!next) {
+        return ESP_ERR_NO_MEM;
+    }
+    memset(next, 0, next_cap * sizeof(dm_uid_set_entry_t));
+    for (size_t i = 0; i < set->table_cap; ++i) {
+        const dm_uid_set_entry_t *entry = &set->table[i];
+        if (entry->key) {
+            *find_entry(next, next_cap, set->pool, set->pool + entry->key - 1, entry->hash) = *entry;
+        }
+    }
+    heap_caps_free(set->table);
+    set->table = next;
+    set->table_cap = next_cap;
+    return ESP_OK;
+}
+
+static esp_err_t reserve_pool(dm_uid_set_t *set, size_t len)
+{
+    if (set->pool_len + len <= set->pool_cap) {
+        return ESP_OK;
+    }
+    size_t next_cap = set->pool_cap ? set->pool_cap : UID_SET_MIN_POOL;
+    while (next_cap < set->pool_len + len) {
+        next_cap *= 2;
+    }
+    char *next = set_realloc(set->pool, next_cap);
+    if (!next) {
+        return ESP_ERR_NO_MEM;
+    }
+    set->pool = next;
+    set->pool_cap = next_cap;
+    return ESP_OK;
+}
+
+esp_err_t dm_uid_set_add(dm_uid_set_t *set, const char *value)
+{
+    if (!set || !value) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    char key[DM_UID_TEMPLATE_VALUE_MAX_LEN];
+    uint32_t hash = fold_value(value, key, sizeof(key));
+    if (!key[0]) {
+        return ESP_OK;
+    }
+    // Keep the load factor at or below one half.
+    if ((set->count + 1) * 2 > set->table_cap) {
+        esp_err_t err = grow_table(set);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    dm_uid_set_entry_t *entry = find_entry(set->table, set->table_cap, set->pool, key, hash);
+    if (entry->key) {
+        return ESP_OK;
+    }
+    size_t len = strlen(key) + 1;
+    esp_err_t err = reserve_pool(set, len);
+    if (err != ESP_OK) {
+        return err;
+    }
+    memcpy(set->pool + set->pool_len, key, len);
+    entry->hash = hash;
+    entry->key = (uint32_t)set->pool_len + 1;
+    set->pool_len += len;
+    set->count++;
+    return ESP_OK;
+}
+
+bool dm_uid_set_contains(const dm_uid_set_t *set, const char *value)
+{
+    if (!set || !set->count || !value) {
+        return false;
+    }
+    char key[DM_UID_TEMPLATE_VALUE_MAX_LEN];
+    uint32_t hash = fold_value(value, key, sizeof(key));
+    if (!key[0]) {
+        return false;
+    }
+    return find_entry(set->table, set->table_cap, set->pool, key, hash)->key != 0;
+}
+
+static char *trim(char *s)
+{
+    while (*s && isspace((unsigned char)*s)) {
+        ++s;
+    }
+    size_t len = strlen(s);
+    while (len > 0 && isspace((unsigned char)s[len - 1])) {
+        s[--len] = '\0';
+    }
+    return s;
+}
+
+esp_err_t dm_uid_set_load_csv(dm_uid_set_t *set, const char *path, size_t *added)
+{
+    if (!set || !path || !path[0]) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        ESP_LOGW(TAG, "uid list %s not found", path);
+        return ESP_ERR_NOT_FOUND;
+    }
+    size_t before = set->count;
+    char line[UID_SET_LINE_MAX];
+    bool first = true;
+    esp_err_t err = ESP_OK;
+    while (err == ESP_OK && fgets(line, sizeof(line), fp)) {
+        if (!strchr(line, '\n')) {
+            // Drop the tail of an overlong line; the UID is in its first column anyway.
+            int c;
+            while ((c = fgetc(fp)) != EOF && c != '\n') {
+            }
+        }
+        char *field = line;
+        field[strcspn(field, ",;\r\n")] = '\0';
+        field = trim(field);
+        if (field[0] == '"') {
+            field++;
+            field[strcspn(field, "\"")] = '\0';
+        }
+        bool header = first && strcasecmp(field, "uid") == 0;
+        first = false;
+        if (!field[0] || field[0] == '#' || header) {
+            continue;
+        }
+        err = dm_uid_set_add(set, field);
+    }
+    fclose(fp);
+    if (added) {
+        *added = set->count - before;
+    }
+    return err;
+}
+
+size_t dm_uid_set_footprint(const dm_uid_set_t *set)
+{
+    return set ? set->table_cap * sizeof(dm_uid_set_entry_t) + set->pool_cap : 0;
+}
+
+void dm_uid_set_clear(dm_uid_set_t *set)
+{
+    if (!set) {
+        return;
+    }
+    heap_caps_free(set->table);
+    heap_caps_free(set->pool);
+    memset(set, 0, sizeof(*set));
+}
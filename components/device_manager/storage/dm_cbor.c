@@ -0,0 +1,309 @@
+#include "dm_cbor.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+// Member names of the config documents and the bulk header. The first 24 take one byte on
+// the wire, so the ones repeated per step, scenario and topic come first. Append only.
+static const char *const k_keys[] = {
+    "type", "topic", "payload", "delay_ms", "id", "name", "steps", "flag",
+    "value", "track", "qos", "retain", "blocking", "event", "button_enabled", "button_label",
+    "priority", "concurrency", "scenarios", "display_name", "topics", "limit", "scenario", "template",
+    // 24 on: two bytes each
+    "mode", "edges", "window_ms", "wait", "timeout_ms", "requirements", "state", "loop",
+    "target_step", "max_iterations", "parallel", "count", "join", "last_value", "schema", "generation",
+    "active_profile", "profiles", "device_count", "active", "devices", "format", "version", "rules",
+    "payload_required", "match", "field", "min", "max", "uid", "signal", "mqtt",
+    "condition", "interval", "sequence", "source_id", "label", "values", "slots", "start_topic",
+    "start_payload", "start_limit", "broadcast_topic", "broadcast_payload", "success_topic", "success_payload",
+    "fail_topic", "fail_payload", "success_audio_track", "fail_audio_track", "success_signal_topic",
+    "success_signal_payload", "fail_signal_topic", "fail_signal_payload", "signal_topic", "signal_payload_on",
+    "signal_payload_off", "signal_on_ms", "heartbeat_topic", "reset_topic", "required_hold_ms",
+    "heartbeat_timeout_ms", "hold_track", "hold_track_loop", "complete_track", "true_scenario",
+    "false_scenario", "interval_ms", "hint_topic", "hint_payload", "hint_audio_track", "reset_on_error",
+    "success_scenario", "fail_scenario",
+};
+
+#define KEY_COUNT (sizeof(k_keys) / sizeof(k_keys[0]))
+
+int dm_cbor_key_id(const char *name)
+{
+    if (!name) {
+        return -1;
+    }
+    for (size_t i = 0; i < KEY_COUNT; ++i) {
+        if (k_keys[i][0] == name[0] && strcmp(k_keys[i], name) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+const char *dm_cbor_key_name(uint32_t id)
+{
+    return id < KEY_COUNT ? k_keys[id] : NULL;
+}
+
+static void fail(dm_cbor_reader_t *r, esp_err_t err)
+{
+    if (r->err == ESP_OK) {
+        r->err = err;
+    }
+}
+
+static void emit(dm_cbor_reader_t *r, dm_json_event_t event, const dm_json_value_t *value)
+{
+    static const dm_json_value_t empty = {0};
+    if (r->err != ESP_OK) {
+        return;
+    }
+    esp_err_t err = r->on_event(r->ctx, event, value ? value : &empty);
+    if (err != ESP_OK) {
+        fail(r, err);
+    }
+}
+
+static void emit_number(dm_cbor_reader_t *r, double number)
+{
+    dm_json_value_t value = {.number = number};
+    emit(r, DM_JSON_EVENT_NUMBER, &value);
+}
+
+static void close_container(dm_cbor_reader_t *r);
+
+// One data item is complete: counts it against its container, closing definite ones that
+// are full.
+static void item_done(dm_cbor_reader_t *r)
+{
+    if (r->depth == 0) {
+        r->items++;
+        return;
+    }
+    dm_cbor_frame_t *top = &r->frames[r->depth - 1];
+    if (top->map) {
+        top->key_next = !top->key_next;
+    }
+    if (!top->indefinite && --top->remaining == 0) {
+        close_container(r);
+    }
+}
+
+static void close_container(dm_cbor_reader_t *r)
+{
+    dm_cbor_frame_t *top = &r->frames[r->depth - 1];
+    if (top->map && !top->key_next) {
+        fail(r, ESP_ERR_INVALID_ARG);   // a member name without its value
+        return;
+    }
+    emit(r, top->map ? DM_JSON_EVENT_OBJECT_END : DM_JSON_EVENT_ARRAY_END, NULL);
+    r->depth--;
+    item_done(r);
+}
+
+static void open_container(dm_cbor_reader_t *r, bool map, bool indefinite, uint64_t count)
+{
+    if (r->depth >= DM_JSON_READER_MAX_DEPTH || (!indefinite && count > UINT32_MAX / 2)) {
+        fail(r, ESP_ERR_INVALID_SIZE);
+        return;
+    }
+    emit(r, map ? DM_JSON_EVENT_OBJECT_BEGIN : DM_JSON_EVENT_ARRAY_BEGIN, NULL);
+    dm_cbor_frame_t *frame = &r->frames[r->depth++];
+    frame->map = map;
+    frame->indefinite = indefinite;
+    frame->key_next = map;
+    frame->remaining = (uint32_t)(map ? count * 2 : count);
+    if (!indefinite && count == 0) {
+        close_container(r);
+    }
+}
+
+static void text_done(dm_cbor_reader_t *r)
+{
+    r->token[r->used] = '\0';
+    dm_json_value_t value = {.str = r->token, .len = r->used};
+    emit(r, r->key_token ? DM_JSON_EVENT_KEY : DM_JSON_EVENT_STRING, &value);
+    item_done(r);
+}
+
+static double half_to_double(uint16_t half)
+{
+    int exp = (half >> 10) & 0x1F;
+    int mant = half & 0x3FF;
+    double v;
+    if (exp == 0) {
+        v = ldexp(mant, -24);
+    } else if (exp != 31) {
+        v = ldexp(mant + 1024, exp - 25);
+    } else {
+        v = mant == 0 ? INFINITY : NAN;
+    }
+    return (half & 0x8000) ? -v : v;
+}
+
+static void simple_value(dm_cbor_reader_t *r, uint8_t info, uint64_t arg)
+{
+    dm_json_value_t value = {0};
+    switch (info) {
+    case 20:
+    case 21:
+        value.boolean = info == 21;
+        emit(r, DM_JSON_EVENT_BOOL, &value);
+        break;
+    case 25:
+        emit_number(r, half_to_double((uint16_t)arg));
+        break;
+    case 26: {
+        uint32_t bits = (uint32_t)arg;
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        emit_number(r, f);
+        break;
+    }
+    case 27: {
+        double d;
+        memcpy(&d, &arg, sizeof(d));
+        emit_number(r, d);
+        break;
+    }
+    default:
+        // null, undefined and unassigned simple values
+        emit(r, DM_JSON_EVENT_NULL, NULL);
+        break;
+    }
+    item_done(r);
+}
+
+static void head_done(dm_cbor_reader_t *r)
+{
+    uint8_t major = r->head[0] >> 5;
+    uint8_t info = r->head[0] & 0x1F;
+    bool indefinite = info == 31;
+    uint64_t arg = info < 24 ? info : 0;
+    for (uint8_t i = 1; i < r->head_need; ++i) {
+        arg = (arg << 8) | r->head[i];
+    }
+    dm_cbor_frame_t *top = r->depth ? &r->frames[r->depth - 1] : NULL;
+    bool key_pos = top && top->map && top->key_next;
+    if (major == DM_CBOR_MAJOR_SIMPLE && indefinite) {
+        if (!top || !top->indefinite) {
+            fail(r, ESP_ERR_INVALID_ARG);
+            return;
+        }
+        close_container(r);
+        return;
+    }
+    if (major == DM_CBOR_MAJOR_TAG) {
+        return;     // the tagged item follows and is read as it is
+    }
+    if (key_pos && major != DM_CBOR_MAJOR_UINT && major != DM_CBOR_MAJOR_TEXT) {
+        fail(r, ESP_ERR_INVALID_ARG);
+        return;
+    }
+    if (indefinite && (major == DM_CBOR_MAJOR_BYTES || major == DM_CBOR_MAJOR_TEXT)) {
+        fail(r, ESP_ERR_NOT_SUPPORTED);     // chunked strings are never written
+        return;
+    }
+    switch (major) {
+    case DM_CBOR_MAJOR_UINT:
+        if (key_pos) {
+            const char *name = dm_cbor_key_name(arg > UINT32_MAX ? UINT32_MAX : (uint32_t)arg);
+            int len = name ? (int)strlen(name) : snprintf(r->token, sizeof(r->token), "#%llu", (unsigned long long)arg);
+            dm_json_value_t value = {.str = name ? name : r->token, .len = (size_t)len};
+            emit(r, DM_JSON_EVENT_KEY, &value);
+        } else {
+            emit_number(r, (double)arg);
+        }
+        item_done(r);
+        break;
+    case DM_CBOR_MAJOR_NEGINT:
+        emit_number(r, -1.0 - (double)arg);
+        item_done(r);
+        break;
+    case DM_CBOR_MAJOR_BYTES:
+        emit(r, DM_JSON_EVENT_NULL, NULL);
+        r->skip = arg;
+        if (!arg) {
+            item_done(r);
+        }
+        break;
+    case DM_CBOR_MAJOR_TEXT:
+        r->used = 0;
+        r->key_token = key_pos;
+        r->str_left = arg;
+        if (!arg) {
+            text_done(r);
+        }
+        break;
+    case DM_CBOR_MAJOR_ARRAY:
+    case DM_CBOR_MAJOR_MAP:
+        open_container(r, major == DM_CBOR_MAJOR_MAP, indefinite, arg);
+        break;
+    default:
+        simple_value(r, info, arg);
+        break;
+    }
+}
+
+void dm_cbor_reader_init(dm_cbor_reader_t *r, dm_json_event_fn on_event, void *ctx)
+{
+    memset(r, 0, offsetof(dm_cbor_reader_t, frames));
+    r->on_event = on_event;
+    r->ctx = ctx;
+    r->err = on_event ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t dm_cbor_reader_feed(dm_cbor_reader_t *r, const uint8_t *data, size_t len)
+{
+    const uint8_t *end = data + len;
+    while (r->err == ESP_OK && data < end) {
+        size_t avail = (size_t)(end - data);
+        if (r->str_left) {
+            size_t n = r->str_left < avail ? (size_t)r->str_left : avail;
+            size_t room = sizeof(r->token) - 1 - r->used;
+            memcpy(r->token + r->used, data, n < room ? n : room);
+            r->used += n < room ? n : room;
+            r->str_left -= n;
+            data += n;
+            r->offset += n;
+            if (!r->str_left) {
+                text_done(r);
+            }
+            continue;
+        }
+        if (r->skip) {
+            size_t n = r->skip < avail ? (size_t)r->skip : avail;
+            r->skip -= n;
+            data += n;
+            r->offset += n;
+            if (!r->skip) {
+                item_done(r);
+            }
+            continue;
+        }
+        uint8_t byte = *data++;
+        r->offset++;
+        r->head[r->head_len++] = byte;
+        if (r->head_len == 1) {
+            uint8_t info = byte & 0x1F;
+            if (info >= 28 && info <= 30) {
+                fail(r, ESP_ERR_INVALID_ARG);
+                break;
+            }
+            r->head_need = 1 + (info < 24 || info == 31 ? 0 : 1u << (info - 24));
+        }
+        if (r->head_len == r->head_need) {
+            r->head_len = 0;
+            head_done(r);
+        }
+    }
+    return r->err;
+}
+
+esp_err_t dm_cbor_reader_finish(dm_cbor_reader_t *r)
+{
+    if (r->err == ESP_OK && (r->depth || r->head_len || r->str_left || r->skip || !r->items)) {
+        fail(r, ESP_ERR_INVALID_SIZE);
+    }
+    return r->err;
+}
@@ -0,0 +1,196 @@
+#include "dm_file.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+
+#define DM_FILE_TMP_SUFFIX ".tmp"
+#define DM_FILE_STAGED_SUFFIX ".new"
+
+static const char *TAG = "dm_file";
+
+static esp_err_t tmp_path(const char *path, char *out, size_t out_len)
+{
+    int written = snprintf(out, out_len, "%s" DM_FILE_TMP_SUFFIX, path);
+    return (written > 0 && (size_t)written < out_len) ? ESP_OK : ESP_ERR_INVALID_SIZE;
+}
+
+static esp_err_t staged_path(const char *path, char *out, size_t out_len)
+{
+    int written = snprintf(out, out_len, "%s" DM_FILE_STAGED_SUFFIX, path);
+    return (written > 0 && (size_t)written < out_len) ? ESP_OK : ESP_ERR_INVALID_SIZE;
+}
+
+static bool file_exists(const char *path)
+{
+    struct stat st;
+    return stat(path, &st) == 0;
+}
+
+// Moves a complete, synced temp file over path.
+static esp_err_t replace_with_tmp(const char *tmp, const char *path)
+{
+    if (rename(tmp, path) == 0) {
+        return ESP_OK;
+    }
+    if (unlink(path) != 0 && errno != ENOENT) {
+        ESP_LOGE(TAG, "unlink %s failed: %d", path, errno);
+        unlink(tmp);
+        return ESP_FAIL;
+    }
+    if (rename(tmp, path) != 0) {
+        // Left in place on purpose: dm_file_recover() promotes it on the next read.
+        ESP_LOGE(TAG, "rename %s failed: %d", tmp, errno);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t dm_file_atomic_begin(dm_file_atomic_t *file, const char *path)
+{
+    if (!file || !path) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    file->fp = NULL;
+    file->failed = false;
+    int written = snprintf(file->path, sizeof(file->path), "%s", path);
+    if (written <= 0 || (size_t)written >= sizeof(file->path) ||
+        tmp_path(path, file->tmp, sizeof(file->tmp)) != ESP_OK) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    file->fp = fopen(file->tmp, "wb");
+    if (!file->fp) {
+        ESP_LOGE(TAG, "open %s failed: %d", file->tmp, errno);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t dm_file_atomic_write(dm_file_atomic_t *file, const void *data, size_t len)
+{
+    if (!file || !file->fp || file->failed) {
+        return ESP_FAIL;
+    }
+    if (len && fwrite(data, 1, len, file->fp) != len) {
+        ESP_LOGE(TAG, "write %s failed: %d", file->tmp, errno);
+        file->failed = true;
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+void dm_file_atomic_abort(dm_file_atomic_t *file)
+{
+    if (file && file->fp) {
+        fclose(file->fp);
+        file->fp = NULL;
+        unlink(file->tmp);
+    }
+}
+
+esp_err_t dm_file_atomic_commit(dm_file_atomic_t *file)
+{
+    if (!file || !file->fp) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    // The temp file must be on the card before the old one goes away.
+    bool ok = !file->failed && fflush(file->fp) == 0 && fsync(fileno(file->fp)) == 0;
+    if (fclose(file->fp) != 0) {
+        ok = false;
+    }
+    file->fp = NULL;
+    if (!ok) {
+        ESP_LOGE(TAG, "write %s failed: %d", file->tmp, errno);
+        unlink(file->tmp);
+        return ESP_FAIL;
+    }
+    return replace_with_tmp(file->tmp, file->path);
+}
+
+esp_err_t dm_file_write_atomic(const char *path, const dm_file_part_t *parts, size_t count)
+{
+    if (!path || (!parts && count)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    dm_file_atomic_t file;
+    esp_err_t err = dm_file_atomic_begin(&file, path);
+    if (err != ESP_OK) {
+        return err;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        dm_file_atomic_write(&file, parts[i].data, parts[i].len);
+    }
+    return dm_file_atomic_commit(&file);
+}
+
+void dm_file_recover(const char *path)
+{
+    char tmp[DM_FILE_PATH_MAX];
+    if (!path || tmp_path(path, tmp, sizeof(tmp)) != ESP_OK || !file_exists(tmp)) {
+        return;
+    }
+    if (file_exists(path)) {
+        // The write never got as far as removing the old file, which is still intact.
+        ESP_LOGW(TAG, "dropping incomplete %s", tmp);
+        unlink(tmp);
+        return;
+    }
+    if (rename(tmp, path) == 0) {
+        ESP_LOGW(TAG, "recovered %s from interrupted write", path);
+    } else {
+        ESP_LOGE(TAG, "recover %s failed: %d", path, errno);
+    }
+}
+
+esp_err_t dm_file_remove(const char *path)
+{
+    char tmp[DM_FILE_PATH_MAX];
+    if (!path || tmp_path(path, tmp, sizeof(tmp)) != ESP_OK) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    unlink(tmp);
+    dm_file_unstage(path);
+    if (unlink(path) != 0 && errno != ENOENT) {
+        ESP_LOGW(TAG, "unlink %s failed: %d", path, errno);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t dm_file_stage(const char *path, const dm_file_part_t *parts, size_t count)
+{
+    char staged[DM_FILE_PATH_MAX];
+    if (!path || staged_path(path, staged, sizeof(staged)) != ESP_OK) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return dm_file_write_atomic(staged, parts, count);
+}
+
+esp_err_t dm_file_promote(const char *path)
+{
+    char staged[DM_FILE_PATH_MAX];
+    char tmp[DM_FILE_PATH_MAX];
+    if (!path || staged_path(path, staged, sizeof(staged)) != ESP_OK ||
+        tmp_path(path, tmp, sizeof(tmp)) != ESP_OK) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // Becoming the temp file first keeps dm_file_recover() right if power fails midway.
+    unlink(tmp);
+    if (rename(staged, tmp) != 0) {
+        ESP_LOGE(TAG, "rename %s failed: %d", staged, errno);
+        return ESP_FAIL;
+    }
+    return replace_with_tmp(tmp, path);
+}
+
+void dm_file_unstage(const char *path)
+{
+    char staged[DM_FILE_PATH_MAX];
+    if (path && staged_path(path, staged, sizeof(staged)) == ESP_OK) {
+        unlink(staged);
+    }
+}
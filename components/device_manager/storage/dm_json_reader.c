@@ -0,0 +1,411 @@
+#include "dm_json_reader.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define NUMBER_MAX_CHARS 63
+
+enum {
+    EXPECT_VALUE,           // document start, after ':' or after ',' in an array
+    EXPECT_FIRST_VALUE,     // after '[': a value or ']'
+    EXPECT_FIRST_KEY,       // after '{': a member name or '}'
+    EXPECT_KEY,             // after ',' in an object
+    EXPECT_COLON,
+    EXPECT_NEXT,            // after a value in a container: ',' or the closing bracket
+    EXPECT_DONE,            // top-level value complete, only whitespace may follow
+};
+
+enum {
+    LEX_NONE,
+    LEX_STRING,
+    LEX_ESCAPE,
+    LEX_UNICODE,
+    LEX_NUMBER,
+    LEX_LITERAL,
+};
+
+static void fail(dm_json_reader_t *r, esp_err_t err)
+{
+    if (r->err == ESP_OK) {
+        r->err = err;
+    }
+}
+
+static void emit(dm_json_reader_t *r, dm_json_event_t event, const dm_json_value_t *value)
+{
+    static const dm_json_value_t empty = {0};
+    esp_err_t err = r->on_event(r->ctx, event, value ? value : &empty);
+    if (err != ESP_OK) {
+        fail(r, err);
+    }
+}
+
+static inline bool top_is_object(const dm_json_reader_t *r)
+{
+    return r->depth && (r->in_object & (1u << (r->depth - 1)));
+}
+
+static void value_done(dm_json_reader_t *r)
+{
+    r->expect = r->depth ? EXPECT_NEXT : EXPECT_DONE;
+}
+
+static inline void put(dm_json_reader_t *r, char c)
+{
+    if (r->used < sizeof(r->token) - 1) {
+        r->token[r->used++] = c;
+    }
+}
+
+static void put_utf8(dm_json_reader_t *r, uint32_t cp)
+{
+    if (cp < 0x80) {
+        put(r, (char)cp);
+    } else if (cp < 0x800) {
+        put(r, (char)(0xC0 | (cp >> 6)));
+        put(r, (char)(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+        put(r, (char)(0xE0 | (cp >> 12)));
+        put(r, (char)(0x80 | ((cp >> 6) & 0x3F)));
+        put(r, (char)(0x80 | (cp & 0x3F)));
+    } else {
+        put(r, (char)(0xF0 | (cp >> 18)));
+        put(r, (char)(0x80 | ((cp >> 12) & 0x3F)));
+        put(r, (char)(0x80 | ((cp >> 6) & 0x3F)));
+        put(r, (char)(0x80 | (cp & 0x3F)));
+    }
+}
+
+static void begin_token(dm_json_reader_t *r, uint8_t lex)
+{
+    r->lex = lex;
+    r->used = 0;
+}
+
+static void finish_string(dm_json_reader_t *r)
+{
+    r->lex = LEX_NONE;
+    r->token[r->used] = '\0';
+    dm_json_value_t value = {.str = r->token, .len = r->used};
+    if (r->key_token) {
+        emit(r, DM_JSON_EVENT_KEY, &value);
+        r->expect = EXPECT_COLON;
+    } else {
+        emit(r, DM_JSON_EVENT_STRING, &value);
+        value_done(r);
+    }
+}
+
+static void finish_number(dm_json_reader_t *r)
+{
+    r->lex = LEX_NONE;
+    r->token[r->used] = '\0';
+    char *end = NULL;
+    dm_json_value_t value = {.number = strtod(r->token, &end)};
+    if (!end || end != r->token + r->used) {
+        fail(r, ESP_ERR_INVALID_ARG);
+        return;
+    }
+    emit(r, DM_JSON_EVENT_NUMBER, &value);
+    value_done(r);
+}
+
+static void finish_literal(dm_json_reader_t *r)
+{
+    r->lex = LEX_NONE;
+    r->token[r->used] = '\0';
+    if (strcmp(r->token, "true") == 0 || strcmp(r->token, "false") == 0) {
+        dm_json_value_t value = {.boolean = r->token[0] == 't'};
+        emit(r, DM_JSON_EVENT_BOOL, &value);
+    } else if (strcmp(r->token, "null") == 0) {
+        emit(r, DM_JSON_EVENT_NULL, NULL);
+    } else {
+        fail(r, ESP_ERR_INVALID_ARG);
+        return;
+    }
+    value_done(r);
+}
+
+static void open_container(dm_json_reader_t *r, bool object)
+{
+    if (r->depth >= DM_JSON_READER_MAX_DEPTH) {
+        fail(r, ESP_ERR_INVALID_SIZE);
+        return;
+    }
+    uint32_t bit = 1u << r->depth;
+    r->in_object = object ? (r->in_object | bit) : (r->in_object & ~bit);
+    r->depth++;
+    r->expect = object ? EXPECT_FIRST_KEY : EXPECT_FIRST_VALUE;
+    emit(r, object ? DM_JSON_EVENT_OBJECT_BEGIN : DM_JSON_EVENT_ARRAY_BEGIN, NULL);
+}
+
+static void close_container(dm_json_reader_t *r, bool object)
+{
+    if (!r->depth || top_is_object(r) != object) {
+        fail(r, ESP_ERR_INVALID_ARG);
+        return;
+    }
+    r->depth--;
+    emit(r, object ? DM_JSON_EVENT_OBJECT_END : DM_JSON_EVENT_ARRAY_END, NULL);
+    value_done(r);
+}
+
+static void begin_value(dm_json_reader_t *r, char c)
+{
+    switch (c) {
+    case '{':
+        open_container(r, true);
+        break;
+    case '[':
+        open_container(r, false);
+        break;
+    case '"':
+        r->key_token = false;
+        begin_token(r, LEX_STRING);
+        break;
+    case 't':
+    case 'f':
+    case 'n':
+        begin_token(r, LEX_LITERAL);
+        put(r, c);
+        break;
+    default:
+        if (c == '-' || (c >= '0' && c <= '9')) {
+            begin_token(r, LEX_NUMBER);
+            put(r, c);
+        } else {
+            fail(r, ESP_ERR_INVALID_ARG);
+        }
+        break;
+    }
+}
+
+static void structural(dm_json_reader_t *r, char c)
+{
+    if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+        return;
+    }
+    switch (r->expect) {
+    case EXPECT_FIRST_VALUE:
+        if (c == ']') {
+            close_container(r, false);
+            return;
+        }
+        begin_value(r, c);
+        return;
+    case EXPECT_VALUE:
+        begin_value(r, c);
+        return;
+    case EXPECT_FIRST_KEY:
+        if (c == '}') {
+            close_container(r, true);
+            return;
+        }
+        // fall through
+    case EXPECT_KEY:
+        if (c != '"') {
+            fail(r, ESP_ERR_INVALID_ARG);
+            return;
+        }
+        r->key_token = true;
+        begin_token(r, LEX_STRING);
+        return;
+    case EXPECT_COLON:
+        if (c != ':') {
+            fail(r, ESP_ERR_INVALID_ARG);
+            return;
+        }
+        r->expect = EXPECT_VALUE;
+        return;
+    case EXPECT_NEXT:
+        if (c == ',') {
+            r->expect = top_is_object(r) ? EXPECT_KEY : EXPECT_VALUE;
+        } else if (c == '}' || c == ']') {
+            close_container(r, c == '}');
+        } else {
+            fail(r, ESP_ERR_INVALID_ARG);
+        }
+        return;
+    default:
+        fail(r, ESP_ERR_INVALID_ARG);
+        return;
+    }
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+static void unicode_escape_done(dm_json_reader_t *r)
+{
+    uint32_t cp = r->hex;
+    r->lex = LEX_STRING;
+    if (r->high_surrogate) {
+        if (cp < 0xDC00 || cp > 0xDFFF) {
+            fail(r, ESP_ERR_INVALID_ARG);
+            return;
+        }
+        put_utf8(r, 0x10000 + (((uint32_t)r->high_surrogate - 0xD800) << 10) + (cp - 0xDC00));
+        r->high_surrogate = 0;
+    } else if (cp >= 0xD800 && cp <= 0xDBFF) {
+        r->high_surrogate = (uint16_t)cp;
+    } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+        fail(r, ESP_ERR_INVALID_ARG);
+    } else {
+        put_utf8(r, cp);
+    }
+}
+
+static void escape(dm_json_reader_t *r, char c)
+{
+    r->lex = LEX_STRING;
+    if (r->high_surrogate && c != 'u') {
+        fail(r, ESP_ERR_INVALID_ARG);
+        return;
+    }
+    switch (c) {
+    case '"': put(r, '"'); break;
+    case '\\': put(r, '\\'); break;
+    case '/': put(r, '/'); break;
+    case 'b': put(r, '\b'); break;
+    case 'f': put(r, '\f'); break;
+    case 'n': put(r, '\n'); break;
+    case 'r': put(r, '\r'); break;
+    case 't': put(r, '\t'); break;
+    case 'u':
+        r->lex = LEX_UNICODE;
+        r->hex = 0;
+        r->hex_digits = 0;
+        break;
+    default:
+        fail(r, ESP_ERR_INVALID_ARG);
+        break;
+    }
+}
+
+void dm_json_reader_init(dm_json_reader_t *r, dm_json_event_fn on_event, void *ctx)
+{
+    memset(r, 0, offsetof(dm_json_reader_t, token));
+    r->on_event = on_event;
+    r->ctx = ctx;
+    r->err = on_event ? ESP_OK : ESP_ERR_INVALID_ARG;
+    r->expect = EXPECT_VALUE;
+    r->lex = LEX_NONE;
+}
+
+esp_err_t dm_json_reader_feed(dm_json_reader_t *r, const char *data, size_t len)
+{
+    if (!data && len) {
+        fail(r, ESP_ERR_INVALID_ARG);
+    }
+    size_t i = 0;
+    while (r->err == ESP_OK && i < len) {
+        char c = data[i];
+        switch (r->lex) {
+        case LEX_STRING:
+            if (c == '"' || c == '\\' || r->high_surrogate) {
+                if (c == '"') {
+                    if (r->high_surrogate) {
+                        fail(r, ESP_ERR_INVALID_ARG);
+                        break;
+                    }
+                    finish_string(r);
+                } else if (c == '\\') {
+                    r->lex = LEX_ESCAPE;
+                } else {
+                    fail(r, ESP_ERR_INVALID_ARG);
+                    break;
+                }
+                i++;
+                break;
+            }
+            // Copy the plain run up to the next quote or escape in one go.
+            {
+                size_t run = i;
+                while (run < len && data[run] != '"' && data[run] != '\\') {
+                    run++;
+                }
+                size_t room = sizeof(r->token) - 1 - r->used;
+                size_t n = run - i < room ? run - i : room;
+                memcpy(r->token + r->used, data + i, n);
+                r->used += n;
+                i = run;
+            }
+            break;
+        case LEX_ESCAPE:
+            escape(r, c);
+            i++;
+            break;
+        case LEX_UNICODE: {
+            int v = hex_value(c);
+            if (v < 0) {
+                fail(r, ESP_ERR_INVALID_ARG);
+                break;
+            }
+            r->hex = (uint16_t)((r->hex << 4) | (uint16_t)v);
+            if (++r->hex_digits == 4) {
+                unicode_escape_done(r);
+            }
+            i++;
+            break;
+        }
+        case LEX_NUMBER:
+            if ((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E') {
+                if (r->used >= NUMBER_MAX_CHARS) {
+                    fail(r, ESP_ERR_INVALID_ARG);
+                    break;
+                }
+                put(r, c);
+                i++;
+            } else {
+                // The byte ending a number belongs to the structure; look at it again.
+                finish_number(r);
+            }
+            break;
+        case LEX_LITERAL:
+            if (c >= 'a' && c <= 'z') {
+                if (r->used >= 5) {
+                    fail(r, ESP_ERR_INVALID_ARG);
+                    break;
+                }
+                put(r, c);
+                i++;
+            } else {
+                finish_literal(r);
+            }
+            break;
+        default:
+            structural(r, c);
+            i++;
+            break;
+        }
+    }
+    r->offset += i;
+    return r->err;
+}
+
+esp_err_t dm_json_reader_finish(dm_json_reader_t *r)
+{
+    if (r->err == ESP_OK && r->depth == 0) {
+        // A bare top-level number or literal has nothing after it to end it.
+        if (r->lex == LEX_NUMBER) {
+            finish_number(r);
+        } else if (r->lex == LEX_LITERAL) {
+            finish_literal(r);
+        }
+    }
+    if (r->err == ESP_OK && (r->lex != LEX_NONE || r->expect != EXPECT_DONE)) {
+        fail(r, ESP_ERR_INVALID_ARG);
+    }
+    return r->err;
+}
@@ -0,0 +1,318 @@
+#include "dm_json_writer.h"
+
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_heap_caps.h"
+
+#include "dm_cbor.h"
+
+static void flush_buf(dm_json_writer_t *w)
+{
+    if (w->err == ESP_OK && w->used) {
+        w->err = w->sink(w->ctx, w->buf, w->used);
+        w->total += w->used;
+    }
+    w->used = 0;
+}
+
+static void put(dm_json_writer_t *w, const char *data, size_t len)
+{
+    while (w->err == ESP_OK && len) {
+        size_t room = sizeof(w->buf) - w->used;
+        size_t n = len < room ? len : room;
+        memcpy(w->buf + w->used, data, n);
+        w->used += n;
+        data += n;
+        len -= n;
+        if (w->used == sizeof(w->buf)) {
+            flush_buf(w);
+        }
+    }
+}
+
+static inline void put_char(dm_json_writer_t *w, char c)
+{
+    if (w->used == sizeof(w->buf)) {
+        flush_buf(w);
+    }
+    if (w->err == ESP_OK) {
+        w->buf[w->used++] = c;
+    }
+}
+
+// Separator before a value (or key) in the current container.
+static void value_prefix(dm_json_writer_t *w)
+{
+    if (w->after_key) {
+        w->after_key = false;
+        return;
+    }
+    if (w->depth == 0 || w->cbor) {
+        return;
+    }
+    uint32_t bit = 1u << (w->depth - 1);
+    if (w->need_comma & bit) {
+        put_char(w, ',');
+    }
+    w->need_comma |= bit;
+}
+
+static void put_quoted(dm_json_writer_t *w, const char *s)
+{
+    static const char hex[] = "0123456789abcdef";
+    put_char(w, '"');
+    const char *run = s;
+    for (; s && *s; ++s) {
+        unsigned char c = (unsigned char)*s;
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        put(w, run, (size_t)(s - run));
+        run = s + 1;
+        char esc[6] = {'\\', 0};
+        size_t esc_len = 2;
+        switch (c) {
+        case '"': esc[1] = '"'; break;
+        case '\\': esc[1] = '\\'; break;
+        case '\b': esc[1] = 'b'; break;
+        case '\f': esc[1] = 'f'; break;
+        case '\n': esc[1] = 'n'; break;
+        case '\r': esc[1] = 'r'; break;
+        case '\t': esc[1] = 't'; break;
+        default:
+            esc[1] = 'u';
+            esc[2] = '0';
+            esc[3] = '0';
+            esc[4] = hex[c >> 4];
+            esc[5] = hex[c & 0x0F];
+            esc_len = 6;
+            break;
+        }
+        put(w, esc, esc_len);
+    }
+    if (s) {
+        put(w, run, (size_t)(s - run));
+    }
+    put_char(w, '"');
+}
+
+// CBOR data item head: major type and argument in the shortest form.
+static void put_head(dm_json_writer_t *w, uint8_t major, uint64_t arg)
+{
+    uint8_t head[9];
+    size_t bytes = arg < 24 ? 0 : arg <= 0xFF ? 1 : arg <= 0xFFFF ? 2 : arg <= 0xFFFFFFFFu ? 4 : 8;
+    static const uint8_t info[9] = {0, 24, 25, 0, 26, 0, 0, 0, 27};
+    head[0] = (uint8_t)(major << 5) | (bytes ? info[bytes] : (uint8_t)arg);
+    for (size_t i = 0; i < bytes; ++i) {
+        head[bytes - i] = (uint8_t)(arg >> (8 * i));
+    }
+    put(w, (const char *)head, bytes + 1);
+}
+
+static void put_cbor_text(dm_json_writer_t *w, const char *s)
+{
+    size_t len = s ? strlen(s) : 0;
+    put_head(w, DM_CBOR_MAJOR_TEXT, len);
+    put(w, s, len);
+}
+
+// Integral values as integers, the rest as the narrowest float that holds them exactly.
+static void put_cbor_number(dm_json_writer_t *w, double value)
+{
+    if (isnan(value) || isinf(value)) {
+        put_char(w, (char)DM_CBOR_NULL);
+    } else if (fabs(value) < 9223372036854775808.0 && value == floor(value)) {
+        if (value >= 0) {
+            put_head(w, DM_CBOR_MAJOR_UINT, (uint64_t)value);
+        } else {
+            put_head(w, DM_CBOR_MAJOR_NEGINT, (uint64_t)(-1.0 - value));
+        }
+    } else if ((double)(float)value == value) {
+        float f = (float)value;
+        uint32_t bits;
+        memcpy(&bits, &f, sizeof(bits));
+        uint8_t be[5] = {DM_CBOR_FLOAT32, (uint8_t)(bits >> 24), (uint8_t)(bits >> 16),
+                         (uint8_t)(bits >> 8), (uint8_t)bits};
+        put(w, (const char *)be, sizeof(be));
+    } else {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        uint8_t be[9] = {DM_CBOR_FLOAT64};
+        for (int i = 0; i < 8; ++i) {
+            be[8 - i] = (uint8_t)(bits >> (8 * i));
+        }
+        put(w, (const char *)be, sizeof(be));
+    }
+}
+
+void dm_json_writer_init(dm_json_writer_t *w, dm_json_sink_fn sink, void *ctx)
+{
+    memset(w, 0, offsetof(dm_json_writer_t, buf));
+    w->sink = sink;
+    w->ctx = ctx;
+    w->err = sink ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+void dm_json_writer_init_cbor(dm_json_writer_t *w, dm_json_sink_fn sink, void *ctx)
+{
+    dm_json_writer_init(w, sink, ctx);
+    w->cbor = true;
+}
+
+esp_err_t dm_json_writer_finish(dm_json_writer_t *w)
+{
+    if (w->err == ESP_OK && (w->depth || w->after_key)) {
+        w->err = ESP_ERR_INVALID_STATE;
+    }
+    flush_buf(w);
+    return w->err;
+}
+
+static void open_container(dm_json_writer_t *w, char c)
+{
+    value_prefix(w);
+    if (w->depth >= DM_JSON_WRITER_MAX_DEPTH) {
+        w->err = ESP_ERR_INVALID_STATE;
+        return;
+    }
+    w->depth++;
+    w->need_comma &= ~(1u << (w->depth - 1));
+    if (w->cbor) {
+        put_char(w, (char)(c == '{' ? DM_CBOR_MAP_OPEN : DM_CBOR_ARRAY_OPEN));
+    } else {
+        put_char(w, c);
+    }
+}
+
+static void close_container(dm_json_writer_t *w, char c)
+{
+    if (w->depth == 0 || w->after_key) {
+        w->err = ESP_ERR_INVALID_STATE;
+        return;
+    }
+    w->depth--;
+    put_char(w, w->cbor ? (char)DM_CBOR_BREAK : c);
+}
+
+void dm_json_begin_object(dm_json_writer_t *w)
+{
+    open_container(w, '{');
+}
+
+void dm_json_end_object(dm_json_writer_t *w)
+{
+    close_container(w, '}');
+}
+
+void dm_json_begin_array(dm_json_writer_t *w)
+{
+    open_container(w, '[');
+}
+
+void dm_json_end_array(dm_json_writer_t *w)
+{
+    close_container(w, ']');
+}
+
+void dm_json_key(dm_json_writer_t *w, const char *key)
+{
+    value_prefix(w);
+    if (w->cbor) {
+        int id = dm_cbor_key_id(key);
+        if (id >= 0) {
+            put_head(w, DM_CBOR_MAJOR_UINT, (uint64_t)id);
+        } else {
+            put_cbor_text(w, key);
+        }
+    } else {
+        put_quoted(w, key);
+        put_char(w, ':');
+    }
+    w->after_key = true;
+}
+
+void dm_json_string(dm_json_writer_t *w, const char *value)
+{
+    value_prefix(w);
+    if (w->cbor) {
+        put_cbor_text(w, value);
+    } else {
+        put_quoted(w, value);
+    }
+}
+
+void dm_json_number(dm_json_writer_t *w, double value)
+{
+    char num[26];
+    int len;
+    value_prefix(w);
+    if (w->cbor) {
+        put_cbor_number(w, value);
+        return;
+    }
+    if (isnan(value) || isinf(value)) {
+        len = snprintf(num, sizeof(num), "null");
+    } else if (value > INT_MIN && value < INT_MAX && value == (double)(int)value) {
+        len = snprintf(num, sizeof(num), "%d", (int)value);
+    } else {
+        // Shortest form that reads back to the same double.
+        len = snprintf(num, sizeof(num), "%1.15g", value);
+        if (strtod(num, NULL) != value) {
+            len = snprintf(num, sizeof(num), "%1.17g", value);
+        }
+    }
+    put(w, num, (size_t)len);
+}
+
+void dm_json_bool(dm_json_writer_t *w, bool value)
+{
+    value_prefix(w);
+    if (w->cbor) {
+        put_char(w, (char)(value ? DM_CBOR_TRUE : DM_CBOR_FALSE));
+    } else if (value) {
+        put(w, "true", 4);
+    } else {
+        put(w, "false", 5);
+    }
+}
+
+void dm_json_null(dm_json_writer_t *w)
+{
+    value_prefix(w);
+    if (w->cbor) {
+        put_char(w, (char)DM_CBOR_NULL);
+    } else {
+        put(w, "null", 4);
+    }
+}
+
+esp_err_t dm_json_buffer_sink(void *ctx, const char *data, size_t len)
+{
+    dm_json_buffer_t *out = (dm_json_buffer_t *)ctx;
+    if (!out) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (out->len + len + 1 > out->cap) {
+        size_t cap = out->cap ? out->cap : 4096;
+        while (cap < out->len + len + 1) {
+            cap *= 2;
+        }
+        char *grown = heap_caps_realloc(out->data, cap, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!grown) {
+            grown = heap_caps_realloc(out->data, cap, MALLOC_CAP_8BIT);
+        }
+        if (!grown) {
+            return ESP_ERR_NO_MEM;
+        }
+        out->data = grown;
+        out->cap = cap;
+    }
+    memcpy(out->data + out->len, data, len);
+    out->len += len;
+    out->data[out->len] = '\0';
+    return ESP_OK;
+}
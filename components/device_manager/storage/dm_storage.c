@@ -7,79 +7,104 @@
 #include "esp_heap_caps.h"
 
 #include "device_manager.h"
+#include "dm_file.h"
 
 static const char *TAG = "dm_storage";
 
+typedef struct {
+    FILE *f;
+    size_t total;
+} file_source_t;
+
+static esp_err_t file_source(void *ctx, char *buf, size_t cap, size_t *out_len)
+{
+    file_source_t *src = (file_source_t *)ctx;
+    *out_len = fread(buf, 1, cap, src->f);
+    if (*out_len == 0 && ferror(src->f)) {
+        return ESP_FAIL;
+    }
+    if (*out_len == 0 && src->total == 0) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    src->total += *out_len;
+    return ESP_OK;
+}
+
+// The file is parsed as it is read, so its size does not matter for memory.
 esp_err_t dm_storage_load(const char *path, device_manager_config_t *cfg)
 {
     if (!path || !cfg) {
         return ESP_ERR_INVALID_ARG;
     }
+    dm_file_recover(path);
     FILE *f = fopen(path, "rb");
     if (!f) {
         ESP_LOGW(TAG, "config file %s not found", path);
         return ESP_FAIL;
     }
-    if (fseek(f, 0, SEEK_END) != 0) {
-        fclose(f);
-        return ESP_FAIL;
-    }
-    long size = ftell(f);
-    if (size <= 0) {
-        fclose(f);
-        return ESP_ERR_INVALID_SIZE;
-    }
-    rewind(f);
-    char *buf = heap_caps_malloc((size_t)size + 1, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-    if (!buf) {
-        fclose(f);
-        return ESP_ERR_NO_MEM;
-    }
-    size_t read_bytes = fread(buf, 1, (size_t)size, f);
+    file_source_t src = {.f = f};
+    esp_err_t err = dm_storage_internal_parse_stream(file_source, &src, cfg);
     fclose(f);
-    if (read_bytes != (size_t)size) {
-        free(buf);
-        return ESP_FAIL;
-    }
-    buf[size] = '\0';
-    esp_err_t err = dm_storage_internal_parse(buf, (size_t)size, cfg);
-    free(buf);
     return err;
 }
 
+static esp_err_t file_sink(void *ctx, const char *data, size_t len)
+{
+    return dm_file_atomic_write((dm_file_atomic_t *)ctx, data, len);
+}
+
 esp_err_t dm_storage_save(const char *path, const device_manager_config_t *cfg)
 {
     if (!path || !cfg) {
         return ESP_ERR_INVALID_ARG;
     }
-    char *json = NULL;
-    size_t len = 0;
-    esp_err_t err = dm_storage_internal_export(cfg, &json, &len);
+    dm_file_atomic_t file;
+    esp_err_t err = dm_file_atomic_begin(&file, path);
     if (err != ESP_OK) {
         return err;
     }
-    FILE *f = fopen(path, "wb");
-    if (!f) {
-        free(json);
-        ESP_LOGE(TAG, "failed to open %s for write", path);
-        return ESP_FAIL;
+    err = dm_storage_internal_export_stream(cfg, file_sink, &file);
+    if (err != ESP_OK) {
+        dm_file_atomic_abort(&file);
+        ESP_LOGE(TAG, "failed to write config file %s: %s", path, esp_err_to_name(err));
+        return err;
     }
-    size_t written = fwrite(json, 1, len, f);
-    fclose(f);
-    free(json);
-    if (written != len) {
-        ESP_LOGE(TAG, "failed to write config file (%zu/%zu)", written, len);
-        return ESP_FAIL;
+    return dm_file_atomic_commit(&file);
+}
+
+esp_err_t dm_storage_export_json(const device_manager_config_t *cfg, char **out_json, size_t *out_len)
+{
+    if (!out_json) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *out_json = NULL;
+    if (out_len) {
+        *out_len = 0;
+    }
+    dm_json_buffer_t buf = {0};
+    esp_err_t err = dm_storage_internal_export_stream(cfg, dm_json_buffer_sink, &buf);
+    if (err != ESP_OK) {
+        heap_caps_free(buf.data);
+        return err;
+    }
+    *out_json = buf.data;
+    if (out_len) {
+        *out_len = buf.len;
     }
     return ESP_OK;
 }
 
-esp_err_t dm_storage_export_json(const device_manager_config_t *cfg, char **out_json, size_t *out_len)
+esp_err_t dm_storage_export_stream(const device_manager_config_t *cfg, dm_json_sink_fn sink, void *ctx)
 {
-    return dm_storage_internal_export(cfg, out_json, out_len);
+    return dm_storage_internal_export_stream(cfg, sink, ctx);
 }
 
 esp_err_t dm_storage_parse_json(const char *json, size_t len, device_manager_config_t *cfg)
 {
     return dm_storage_internal_parse(json, len, cfg);
 }
+
+esp_err_t dm_storage_parse_stream(dm_json_source_fn source, void *ctx, device_manager_config_t *cfg)
+{
+    return dm_storage_internal_parse_stream(source, ctx, cfg);
+}
@@ -3,6 +3,7 @@
 #include <string.h>
 #include <strings.h>
 
+#include "esp_check.h"
 #include "esp_log.h"
 #include "esp_timer.h"
 #include "esp_heap_caps.h"
@@ -14,6 +15,9 @@
 #include "dm_runtime_condition.h"
 #include "dm_runtime_interval.h"
 #include "dm_runtime_sequence.h"
+#include "dm_topic_index.h"
+#include "dm_rate_gate.h"
+#include "dm_timer_wheel.h"
 #include "device_manager_utils.h"
 #include "audio_player.h"
 #include "automation_engine.h"
@@ -23,61 +27,88 @@
 
 static const char *TAG = "template_runtime";
 
+// Start messages used to be debounced by a fixed 300 ms; still the default.
+static const dm_rate_limit_t k_uid_start_limit = {
+    .mode = DM_RATE_MODE_THROTTLE,
+    .edges = DM_RATE_EDGE_LEADING,
+    .window_ms = 300,
+};
+
+// What a runtime does with a message on an indexed topic.
+typedef enum {
+    TOPIC_ROLE_UID_START = 0,
+    TOPIC_ROLE_UID_SLOT,
+    TOPIC_ROLE_SIGNAL_RESET,
+    TOPIC_ROLE_SIGNAL_HEARTBEAT,
+    TOPIC_ROLE_MQTT_RULE,
+    TOPIC_ROLE_SEQUENCE_STEP,
+} topic_role_t;
+
 typedef struct uid_runtime_entry {
     char device_id[DEVICE_MANAGER_ID_MAX_LEN];
+    const device_manager_config_t *owner;   // generation runtime.config points into
     dm_uid_runtime_t runtime;
-    char topics[DM_UID_TEMPLATE_MAX_SLOTS][DEVICE_MANAGER_TOPIC_MAX_LEN];
-    size_t topic_count;
     dm_uid_event_type_t last_action_event;
     uint64_t last_action_ts_ms;
-    uint64_t last_start_ts_ms;
-    char start_topic[DEVICE_MANAGER_TOPIC_MAX_LEN];
-    char start_payload[DEVICE_MANAGER_PAYLOAD_MAX_LEN];
-    char broadcast_topic[DEVICE_MANAGER_TOPIC_MAX_LEN];
-    char broadcast_payload[DEVICE_MANAGER_PAYLOAD_MAX_LEN];
+    dm_rate_gate_t start_gate;      // repeated start messages within the window are ignored
     struct uid_runtime_entry *next;
 } uid_runtime_entry_t;
 
 typedef struct signal_runtime_entry {
     char device_id[DEVICE_MANAGER_ID_MAX_LEN];
+    const device_manager_config_t *owner;   // generation runtime.config points into
     dm_signal_runtime_t runtime;
-    char heartbeat_topic[DEVICE_MANAGER_TOPIC_MAX_LEN];
-    char reset_topic[DEVICE_MANAGER_TOPIC_MAX_LEN];
     bool hold_started;
     bool hold_paused;
     bool hold_active;
-    esp_timer_handle_t timeout_timer;
+    dm_timer_t timeout_timer;
+    automation_scenario_handle_t complete_scenario;
     struct signal_runtime_entry *next;
 } signal_runtime_entry_t;
 
 typedef struct mqtt_runtime_entry {
     char device_id[DEVICE_MANAGER_ID_MAX_LEN];
+    const device_manager_config_t *owner;   // generation runtime.config points into
     dm_mqtt_trigger_runtime_t runtime;
+    automation_scenario_handle_t scenarios[DM_MQTT_TRIGGER_MAX_RULES];
+    dm_rate_gate_t gates[DM_MQTT_TRIGGER_MAX_RULES];
     struct mqtt_runtime_entry *next;
 } mqtt_runtime_entry_t;
 
 typedef struct flag_runtime_entry {
     char device_id[DEVICE_MANAGER_ID_MAX_LEN];
+    const device_manager_config_t *owner;   // generation runtime.config points into
     dm_flag_trigger_runtime_t runtime;
+    automation_scenario_handle_t scenarios[DM_FLAG_TRIGGER_MAX_RULES];
+    dm_rate_gate_t gates[DM_FLAG_TRIGGER_MAX_RULES];
     struct flag_runtime_entry *next;
 } flag_runtime_entry_t;
 
 typedef struct condition_runtime_entry {
     char device_id[DEVICE_MANAGER_ID_MAX_LEN];
+    const device_manager_config_t *owner;   // generation runtime.config points into
     dm_condition_runtime_t runtime;
+    automation_scenario_handle_t true_scenario;
+    automation_scenario_handle_t false_scenario;
     struct condition_runtime_entry *next;
 } condition_runtime_entry_t;
 
 typedef struct interval_runtime_entry {
     char device_id[DEVICE_MANAGER_ID_MAX_LEN];
-   dm_interval_task_runtime_t runtime;
-    esp_timer_handle_t timer;
+    const device_manager_config_t *owner;   // generation runtime.config points into
+    dm_interval_task_runtime_t runtime;
+    dm_timer_t timer;
+    automation_scenario_handle_t scenario;
     struct interval_runtime_entry *next;
 } interval_runtime_entry_t;
 
 typedef struct sequence_runtime_entry {
     char device_id[DEVICE_MANAGER_ID_MAX_LEN];
+    const device_manager_config_t *owner;   // generation runtime.config points into
     dm_sequence_runtime_t runtime;
+    automation_scenario_handle_t success_scenario;
+    automation_scenario_handle_t fail_scenario;
+    dm_timer_t step_timer;
     struct sequence_runtime_entry *next;
 } sequence_runtime_entry_t;
 
@@ -88,7 +119,86 @@ static flag_runtime_entry_t *s_flag_entries;
 static condition_runtime_entry_t *s_condition_entries;
 static interval_runtime_entry_t *s_interval_entries;
 static sequence_runtime_entry_t *s_sequence_entries;
+static dm_topic_index_t s_topic_index;
 static bool s_event_handler_registered = false;
+// The lists, the topic index and runtime state are used by the event-bus task (dispatch),
+// the esp_timer task (wheel callbacks) and config writers (register). All of them hold the
+// recursive wheel lock while they do.
+
+// Each runtime is a single block in the runtime arena holding only its mutable state; the
+// template stays in the config generation, which the entry keeps a reference on. Blocks are
+// carved from 32 KB chunks (PSRAM first); a dropped device's block goes on a free list and is
+// handed to the next runtime of the same size, so replacing a device reuses its memory. A
+// chunk with no live block left is returned to the heap.
+#define RUNTIME_BLOCK_ALIGN(n) (((n) + 7) & ~(size_t)7)
+#define RUNTIME_ARENA_CHUNK (32 * 1024)
+
+typedef struct runtime_arena_chunk {
+    struct runtime_arena_chunk *next;
+    size_t size;
+    size_t used;
+    size_t live;                // blocks handed out and not freed
+    uint8_t data[];
+} runtime_arena_chunk_t;
+
+typedef struct runtime_free_block {
+    struct runtime_free_block *next;
+    size_t size;
+} runtime_free_block_t;
+
+static runtime_arena_chunk_t *s_arena;
+static runtime_free_block_t *s_free_blocks;
+static size_t s_arena_capacity;
+#define RUNTIME_FREE(entry) runtime_free((entry), sizeof(*(entry)), (entry)->owner)
+
+// Unlinks and releases every entry registered for device_id (all entries when NULL).
+#define REMOVE_DEVICE_ENTRIES(list, device_id, release)                          \
+    do {                                                                         \
+        __typeof__(list) *link_ = &(list);                                       \
+        while (*link_) {                                                         \
+            __typeof__(list) entry_ = *link_;                                    \
+            if (!(device_id) || strcmp(entry_->device_id, (device_id)) == 0) {   \
+                *link_ = entry_->next;                                           \
+                release(entry_);                                                 \
+            } else {                                                             \
+                link_ = &entry_->next;                                           \
+            }                                                                    \
+        }                                                                        \
+    } while (0)
+
+// Checkpoint records per template type.
+typedef struct {
+    dm_uid_state_t state;
+    uint8_t slots[sizeof(((dm_uid_runtime_t *)0)->slots)];
+} uid_state_rec_t;
+
+typedef struct {
+    uint32_t accumulated_ms;
+    bool finished;
+    bool signal_sent;
+} signal_state_rec_t;
+
+typedef struct {
+    bool valid[DM_FLAG_TRIGGER_MAX_RULES];
+    bool last_state[DM_FLAG_TRIGGER_MAX_RULES];
+} flag_state_rec_t;
+
+typedef struct {
+    bool valid[DM_CONDITION_TEMPLATE_MAX_RULES];
+    bool state[DM_CONDITION_TEMPLATE_MAX_RULES];
+    bool last_result;
+    bool has_last_result;
+} condition_state_rec_t;
+
+typedef struct {
+    uint8_t current_index;
+} sequence_state_rec_t;
+
+_Static_assert(sizeof(uid_state_rec_t) <= DM_RUNTIME_STATE_MAX, "uid state record too large");
+
+static size_t s_runtime_count;
+static size_t s_runtime_bytes;
+static uint32_t s_generation;
 
 static const char *signal_event_str(dm_signal_event_type_t ev);
 static bool diagnostics_verbose_enabled(void);
@@ -160,71 +270,269 @@ static void template_event_handler(const event_bus_message_t *msg)
     }
 }
 
-static void *runtime_alloc(size_t size)
+static esp_err_t index_topic(const char *topic, void *entry, topic_role_t role)
+{
+    return dm_topic_index_add(&s_topic_index, topic, entry, (uint8_t)role);
+}
+
+static esp_err_t index_uid_topics(uid_runtime_entry_t *entry)
+{
+    const dm_uid_template_t *cfg = entry->runtime.config;
+    // Start binding first so a start message on a slot topic is not also read as a value.
+    esp_err_t err = index_topic(cfg->start_topic, entry, TOPIC_ROLE_UID_START);
+    for (uint8_t i = 0; err == ESP_OK && i < cfg->slot_count && i < DM_UID_TEMPLATE_MAX_SLOTS; ++i) {
+        err = index_topic(cfg->slots[i].source_id, entry, TOPIC_ROLE_UID_SLOT);
+    }
+    return err;
+}
+
+static esp_err_t index_signal_topics(signal_runtime_entry_t *entry)
+{
+    const dm_signal_hold_template_t *cfg = entry->runtime.config;
+    esp_err_t err = index_topic(cfg->reset_topic, entry, TOPIC_ROLE_SIGNAL_RESET);
+    if (err == ESP_OK) {
+        err = index_topic(cfg->heartbeat_topic, entry, TOPIC_ROLE_SIGNAL_HEARTBEAT);
+    }
+    return err;
+}
+
+static esp_err_t index_mqtt_topics(mqtt_runtime_entry_t *entry)
+{
+    const dm_mqtt_trigger_template_t *cfg = entry->runtime.config;
+    esp_err_t err = ESP_OK;
+    for (uint8_t i = 0; err == ESP_OK && i < cfg->rule_count && i < DM_MQTT_TRIGGER_MAX_RULES; ++i) {
+        if (cfg->rules[i].scenario[0]) {
+            err = index_topic(cfg->rules[i].topic, entry, TOPIC_ROLE_MQTT_RULE);
+        }
+    }
+    return err;
+}
+
+static esp_err_t index_sequence_topics(sequence_runtime_entry_t *entry)
+{
+    const dm_sequence_template_t *cfg = entry->runtime.config;
+    esp_err_t err = ESP_OK;
+    for (uint8_t i = 0; err == ESP_OK && i < cfg->step_count && i < DM_SEQUENCE_TEMPLATE_MAX_STEPS; ++i) {
+        err = index_topic(cfg->steps[i].topic, entry, TOPIC_ROLE_SEQUENCE_STEP);
+    }
+    return err;
+}
+
+// The index borrows topic strings from snapshots, so it is rebuilt whenever a runtime goes away.
+static esp_err_t rebuild_topic_index(void)
+{
+    dm_topic_index_clear(&s_topic_index);
+    esp_err_t err = ESP_OK;
+    for (uid_runtime_entry_t *entry = s_uid_entries; entry && err == ESP_OK; entry = entry->next) {
+        err = index_uid_topics(entry);
+    }
+    for (signal_runtime_entry_t *entry = s_signal_entries; entry && err == ESP_OK; entry = entry->next) {
+        err = index_signal_topics(entry);
+    }
+    for (mqtt_runtime_entry_t *entry = s_mqtt_entries; entry && err == ESP_OK; entry = entry->next) {
+        err = index_mqtt_topics(entry);
+    }
+    for (sequence_runtime_entry_t *entry = s_sequence_entries; entry && err == ESP_OK; entry = entry->next) {
+        err = index_sequence_topics(entry);
+    }
+    return err;
+}
+
+static runtime_arena_chunk_t *arena_chunk_of(const void *block)
+{
+    for (runtime_arena_chunk_t *chunk = s_arena; chunk; chunk = chunk->next) {
+        if ((const uint8_t *)block >= chunk->data && (const uint8_t *)block < chunk->data + chunk->used) {
+            return chunk;
+        }
+    }
+    return NULL;
+}
+
+static void *arena_take_free(size_t size)
+{
+    for (runtime_free_block_t **link = &s_free_blocks; *link; link = &(*link)->next) {
+        runtime_free_block_t *block = *link;
+        if (block->size == size) {
+            *link = block->next;
+            return block;
+        }
+    }
+    return NULL;
+}
+
+static void *arena_bump(size_t size)
 {
-    void *ptr = heap_caps_calloc(1, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-    if (!ptr) {
-        ptr = heap_caps_calloc(1, size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    runtime_arena_chunk_t *chunk = s_arena;
+    if (!chunk || chunk->size - chunk->used < size) {
+        size_t chunk_size = size > RUNTIME_ARENA_CHUNK ? size : RUNTIME_ARENA_CHUNK;
+        size_t total = sizeof(runtime_arena_chunk_t) + chunk_size;
+        chunk = heap_caps_malloc(total, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!chunk) {
+            chunk = heap_caps_malloc(total, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        }
+        if (!chunk) {
+            return NULL;
+        }
+        *chunk = (runtime_arena_chunk_t){.next = s_arena, .size = chunk_size};
+        s_arena = chunk;
+        s_arena_capacity += chunk_size;
     }
+    void *ptr = chunk->data + chunk->used;
+    chunk->used += size;
     return ptr;
 }
 
-static void free_uid_entries(void)
+static void arena_drop_free_blocks(const runtime_arena_chunk_t *chunk)
 {
-    uid_runtime_entry_t *entry = s_uid_entries;
-    while (entry) {
-        uid_runtime_entry_t *next = entry->next;
-        heap_caps_free(entry);
-        entry = next;
+    for (runtime_free_block_t **link = &s_free_blocks; *link;) {
+        if (arena_chunk_of(*link) == chunk) {
+            *link = (*link)->next;
+        } else {
+            link = &(*link)->next;
+        }
     }
-    s_uid_entries = NULL;
 }
 
-static void free_signal_entries(void)
+static void arena_chunk_release(runtime_arena_chunk_t *chunk)
 {
-    signal_runtime_entry_t *entry = s_signal_entries;
-    while (entry) {
-        signal_runtime_entry_t *next = entry->next;
-        if (entry->timeout_timer) {
-            esp_timer_stop(entry->timeout_timer);
-            esp_timer_delete(entry->timeout_timer);
+    arena_drop_free_blocks(chunk);
+    for (runtime_arena_chunk_t **link = &s_arena; *link; link = &(*link)->next) {
+        if (*link == chunk) {
+            *link = chunk->next;
+            break;
         }
-        heap_caps_free(entry);
-        entry = next;
     }
-    s_signal_entries = NULL;
+    s_arena_capacity -= chunk->size;
+    heap_caps_free(chunk);
 }
 
-static uint64_t signal_timeout_interval_us(const signal_runtime_entry_t *entry)
+static void retain_owner(const device_manager_config_t *owner)
 {
-    if (!entry) {
-        return 0;
+    if (owner) {
+        device_manager_retain_config(owner);
     }
-    uint32_t timeout_ms = entry->runtime.config.heartbeat_timeout_ms
-                              ? entry->runtime.config.heartbeat_timeout_ms
-                              : 1000;
-    return (uint64_t)timeout_ms * 1000ULL;
 }
 
-static void restart_signal_timeout_timer(signal_runtime_entry_t *entry)
+static void release_owner(const device_manager_config_t *owner)
+{
+    if (owner) {
+        device_manager_release_config(owner);
+    }
+}
+
+// Zeroed entry referencing `owner`; the caller stores owner in the entry.
+static void *runtime_alloc(size_t entry_size, const device_manager_config_t *owner)
+{
+    size_t total = RUNTIME_BLOCK_ALIGN(entry_size);
+    uint8_t *block = arena_take_free(total);
+    if (!block) {
+        block = arena_bump(total);
+    }
+    if (!block) {
+        return NULL;
+    }
+    arena_chunk_of(block)->live++;
+    memset(block, 0, total);
+    retain_owner(owner);
+    s_runtime_count++;
+    s_runtime_bytes += total;
+    return block;
+}
+
+static void runtime_free(void *entry, size_t entry_size, const device_manager_config_t *owner)
 {
-    if (!entry || !entry->timeout_timer) {
+    size_t total = RUNTIME_BLOCK_ALIGN(entry_size);
+    release_owner(owner);
+    runtime_arena_chunk_t *chunk = arena_chunk_of(entry);
+    s_runtime_count--;
+    s_runtime_bytes -= total;
+    if (!chunk) {
         return;
     }
-    uint64_t timeout_us = signal_timeout_interval_us(entry);
-    if (timeout_us == 0) {
+    runtime_free_block_t *block = entry;
+    *block = (runtime_free_block_t){.next = s_free_blocks, .size = total};
+    s_free_blocks = block;
+    if (--chunk->live > 0) {
         return;
     }
-    esp_timer_stop(entry->timeout_timer);
-    esp_timer_start_once(entry->timeout_timer, timeout_us);
+    // The newest chunk is rewound rather than freed, so replacing the only device of a small
+    // room does not give 32 KB back and take it again.
+    if (chunk == s_arena) {
+        arena_drop_free_blocks(chunk);
+        chunk->used = 0;
+    } else {
+        arena_chunk_release(chunk);
+    }
+}
+
+static void arena_release(void)
+{
+    while (s_arena) {
+        arena_chunk_release(s_arena);
+    }
+}
+
+static automation_scenario_handle_t resolve_scenario(const char *device_id, const char *scenario_id)
+{
+    if (!scenario_id || !scenario_id[0]) {
+        return AUTOMATION_SCENARIO_HANDLE_INVALID;
+    }
+    return automation_engine_resolve(device_id, scenario_id);
+}
+
+// Handles are resolved at registration; fall back to a name lookup if the handle table was full.
+static esp_err_t trigger_scenario(automation_scenario_handle_t handle, const char *device_id, const char *scenario_id)
+{
+    if (handle != AUTOMATION_SCENARIO_HANDLE_INVALID) {
+        return automation_engine_trigger_handle(handle);
+    }
+    return automation_engine_trigger(device_id, scenario_id);
+}
+
+static void release_scenarios(automation_scenario_handle_t *handles, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        automation_engine_release(handles[i]);
+        handles[i] = AUTOMATION_SCENARIO_HANDLE_INVALID;
+    }
+}
+
+static void release_uid_entry(uid_runtime_entry_t *entry)
+{
+    dm_rate_gate_reset(&entry->start_gate);
+    dm_uid_runtime_deinit(&entry->runtime);
+    RUNTIME_FREE(entry);
+}
+
+static void release_signal_entry(signal_runtime_entry_t *entry)
+{
+    dm_timer_disarm(&entry->timeout_timer);
+    release_scenarios(&entry->complete_scenario, 1);
+    RUNTIME_FREE(entry);
+}
+
+static uint32_t signal_timeout_ms(const signal_runtime_entry_t *entry)
+{
+    return entry->runtime.config->heartbeat_timeout_ms
+               ? entry->runtime.config->heartbeat_timeout_ms
+               : 1000;
+}
+
+// Every heartbeat only moves the deadline on the shared wheel.
+static void restart_signal_timeout_timer(signal_runtime_entry_t *entry)
+{
+    if (!entry) {
+        return;
+    }
+    dm_timer_arm(&entry->timeout_timer, signal_timeout_ms(entry));
 }
 
 static void stop_signal_timeout_timer(signal_runtime_entry_t *entry)
 {
-    if (!entry || !entry->timeout_timer) {
+    if (!entry) {
         return;
     }
-    esp_timer_stop(entry->timeout_timer);
+    dm_timer_disarm(&entry->timeout_timer);
 }
 
 static void signal_timeout_timer_cb(void *arg)
@@ -237,9 +545,7 @@ static void signal_timeout_timer_cb(void *arg)
     if (action.event != DM_SIGNAL_EVENT_STOP) {
         return;
     }
-    uint32_t timeout_ms = entry->runtime.config.heartbeat_timeout_ms
-                              ? entry->runtime.config.heartbeat_timeout_ms
-                              : 1000;
+    uint32_t timeout_ms = signal_timeout_ms(entry);
     if (diagnostics_verbose_enabled()) {
         ESP_LOGW(TAG,
                  "[Signal] dev=%s heartbeat timeout>%ums event=%s acc=%ums",
@@ -252,16 +558,21 @@ static void signal_timeout_timer_cb(void *arg)
     apply_signal_mqtt_action(entry, &action);
 }
 
-static void reset_signal_entry(signal_runtime_entry_t *entry, const char *topic)
+static void clear_signal_entry(signal_runtime_entry_t *entry)
 {
-    if (!entry) {
-        return;
-    }
     dm_signal_state_reset(&entry->runtime.state);
     entry->hold_started = false;
     entry->hold_paused = false;
     entry->hold_active = false;
     stop_signal_timeout_timer(entry);
+}
+
+static void reset_signal_entry(signal_runtime_entry_t *entry, const char *topic)
+{
+    if (!entry) {
+        return;
+    }
+    clear_signal_entry(entry);
     audio_player_stop();
     if (diagnostics_verbose_enabled()) {
         ESP_LOGI(TAG,
@@ -271,63 +582,60 @@ static void reset_signal_entry(signal_runtime_entry_t *entry, const char *topic)
     }
 }
 
-static void free_mqtt_entries(void)
+static void reset_rule_gates(dm_rate_gate_t *gates, size_t count)
 {
-    mqtt_runtime_entry_t *entry = s_mqtt_entries;
-    while (entry) {
-        mqtt_runtime_entry_t *next = entry->next;
-        heap_caps_free(entry);
-        entry = next;
+    for (size_t i = 0; i < count; ++i) {
+        dm_rate_gate_reset(&gates[i]);
     }
-    s_mqtt_entries = NULL;
 }
 
-static void free_flag_entries(void)
+static void release_mqtt_entry(mqtt_runtime_entry_t *entry)
 {
-    flag_runtime_entry_t *entry = s_flag_entries;
-    while (entry) {
-        flag_runtime_entry_t *next = entry->next;
-        heap_caps_free(entry);
-        entry = next;
-    }
-    s_flag_entries = NULL;
+    reset_rule_gates(entry->gates, DM_MQTT_TRIGGER_MAX_RULES);
+    uint8_t rules = entry->runtime.config->rule_count;
+    release_scenarios(entry->scenarios, rules < DM_MQTT_TRIGGER_MAX_RULES ? rules : DM_MQTT_TRIGGER_MAX_RULES);
+    RUNTIME_FREE(entry);
 }
 
-static void free_condition_entries(void)
+static void release_flag_entry(flag_runtime_entry_t *entry)
 {
-    condition_runtime_entry_t *entry = s_condition_entries;
-    while (entry) {
-        condition_runtime_entry_t *next = entry->next;
-        heap_caps_free(entry);
-        entry = next;
-    }
-    s_condition_entries = NULL;
+    reset_rule_gates(entry->gates, DM_FLAG_TRIGGER_MAX_RULES);
+    uint8_t rules = entry->runtime.config->rule_count;
+    release_scenarios(entry->scenarios, rules < DM_FLAG_TRIGGER_MAX_RULES ? rules : DM_FLAG_TRIGGER_MAX_RULES);
+    RUNTIME_FREE(entry);
 }
 
-static void free_interval_entries(void)
+static void release_condition_entry(condition_runtime_entry_t *entry)
 {
-    interval_runtime_entry_t *entry = s_interval_entries;
-    while (entry) {
-        interval_runtime_entry_t *next = entry->next;
-        if (entry->timer) {
-            esp_timer_stop(entry->timer);
-            esp_timer_delete(entry->timer);
-        }
-        heap_caps_free(entry);
-        entry = next;
-    }
-    s_interval_entries = NULL;
+    release_scenarios(&entry->true_scenario, 1);
+    release_scenarios(&entry->false_scenario, 1);
+    RUNTIME_FREE(entry);
 }
 
-static void free_sequence_entries(void)
+static void release_interval_entry(interval_runtime_entry_t *entry)
 {
-    sequence_runtime_entry_t *entry = s_sequence_entries;
-    while (entry) {
-        sequence_runtime_entry_t *next = entry->next;
-        heap_caps_free(entry);
-        entry = next;
-    }
-    s_sequence_entries = NULL;
+    dm_timer_disarm(&entry->timer);
+    release_scenarios(&entry->scenario, 1);
+    RUNTIME_FREE(entry);
+}
+
+static void release_sequence_entry(sequence_runtime_entry_t *entry)
+{
+    dm_timer_disarm(&entry->step_timer);
+    release_scenarios(&entry->success_scenario, 1);
+    release_scenarios(&entry->fail_scenario, 1);
+    RUNTIME_FREE(entry);
+}
+
+static void remove_device_entries(const char *device_id)
+{
+    REMOVE_DEVICE_ENTRIES(s_uid_entries, device_id, release_uid_entry);
+    REMOVE_DEVICE_ENTRIES(s_signal_entries, device_id, release_signal_entry);
+    REMOVE_DEVICE_ENTRIES(s_mqtt_entries, device_id, release_mqtt_entry);
+    REMOVE_DEVICE_ENTRIES(s_flag_entries, device_id, release_flag_entry);
+    REMOVE_DEVICE_ENTRIES(s_condition_entries, device_id, release_condition_entry);
+    REMOVE_DEVICE_ENTRIES(s_interval_entries, device_id, release_interval_entry);
+    REMOVE_DEVICE_ENTRIES(s_sequence_entries, device_id, release_sequence_entry);
 }
 
 static const char *uid_event_str(dm_uid_event_type_t type)
@@ -348,13 +656,17 @@ static const char *uid_event_str(dm_uid_event_type_t type)
 
 esp_err_t dm_template_runtime_init(void)
 {
-    free_uid_entries();
-    free_signal_entries();
-    free_mqtt_entries();
-    free_flag_entries();
-    free_condition_entries();
-    free_interval_entries();
-    free_sequence_entries();
+    esp_err_t wheel_err = dm_timer_wheel_init();
+    if (wheel_err != ESP_OK) {
+        ESP_LOGE(TAG, "timer wheel init failed: %s", esp_err_to_name(wheel_err));
+        return wheel_err;
+    }
+    dm_timer_wheel_lock();
+    dm_topic_index_clear(&s_topic_index);
+    remove_device_entries(NULL);
+    arena_release();
+    s_generation++;
+    dm_timer_wheel_unlock();
     if (!s_event_handler_registered) {
         esp_err_t err = event_bus_register_handler(template_event_handler);
         if (err != ESP_OK) {
@@ -371,117 +683,161 @@ void dm_template_runtime_reset(void)
     dm_template_runtime_init();
 }
 
-static esp_err_t register_uid_runtime(const dm_uid_template_t *tpl, const char *device_id)
+void dm_template_runtime_get_stats(dm_template_runtime_stats_t *out)
+{
+    if (!out) {
+        return;
+    }
+    *out = (dm_template_runtime_stats_t){
+        .generation = s_generation,
+        .runtimes = s_runtime_count,
+        .bytes = s_runtime_bytes,
+        .arena_bytes = s_arena_capacity,
+        .topics = s_topic_index.topic_count,
+        .bindings = s_topic_index.binding_count,
+    };
+    dm_timer_wheel_lock();
+    for (uid_runtime_entry_t *entry = s_uid_entries; entry; entry = entry->next) {
+        out->rate_passed += entry->start_gate.passed;
+        out->rate_suppressed += entry->start_gate.suppressed;
+    }
+    for (mqtt_runtime_entry_t *entry = s_mqtt_entries; entry; entry = entry->next) {
+        for (size_t i = 0; i < DM_MQTT_TRIGGER_MAX_RULES; ++i) {
+            out->rate_passed += entry->gates[i].passed;
+            out->rate_suppressed += entry->gates[i].suppressed;
+        }
+    }
+    for (flag_runtime_entry_t *entry = s_flag_entries; entry; entry = entry->next) {
+        for (size_t i = 0; i < DM_FLAG_TRIGGER_MAX_RULES; ++i) {
+            out->rate_passed += entry->gates[i].passed;
+            out->rate_suppressed += entry->gates[i].suppressed;
+        }
+    }
+    dm_timer_wheel_unlock();
+}
+
+static void uid_start_gate_fire(dm_rate_gate_t *gate, void *arg);
+static void mqtt_rule_gate_fire(dm_rate_gate_t *gate, void *arg);
+static void flag_rule_gate_fire(dm_rate_gate_t *gate, void *arg);
+
+static esp_err_t register_uid_runtime(const device_manager_config_t *owner,
+                                      const dm_uid_template_t *tpl,
+                                      const char *device_id)
 {
     if (!tpl || tpl->slot_count == 0) {
         return ESP_ERR_INVALID_ARG;
     }
-    uid_runtime_entry_t *entry = runtime_alloc(sizeof(*entry));
+    uid_runtime_entry_t *entry = runtime_alloc(sizeof(*entry), owner);
     if (!entry) {
         ESP_LOGE(TAG, "no memory for uid runtime");
         return ESP_ERR_NO_MEM;
     }
     dm_str_copy(entry->device_id, sizeof(entry->device_id), device_id);
+    entry->owner = owner;
     dm_uid_runtime_init(&entry->runtime, tpl);
-    entry->topic_count = tpl->slot_count;
-    for (uint8_t i = 0; i < tpl->slot_count && i < DM_UID_TEMPLATE_MAX_SLOTS; ++i) {
-        dm_str_copy(entry->topics[i], sizeof(entry->topics[i]), tpl->slots[i].source_id);
-    }
-    dm_str_copy(entry->start_topic, sizeof(entry->start_topic), tpl->start_topic);
-    dm_str_copy(entry->start_payload, sizeof(entry->start_payload), tpl->start_payload);
-    dm_str_copy(entry->broadcast_topic, sizeof(entry->broadcast_topic), tpl->broadcast_topic);
-    dm_str_copy(entry->broadcast_payload, sizeof(entry->broadcast_payload), tpl->broadcast_payload);
+    dm_rate_gate_init(&entry->start_gate, &tpl->start_limit, &k_uid_start_limit, uid_start_gate_fire, entry);
     entry->next = s_uid_entries;
     s_uid_entries = entry;
-    ESP_LOGI(TAG, "registered UID runtime for device %s with %zu slots", entry->device_id, entry->topic_count);
+    ESP_RETURN_ON_ERROR(index_uid_topics(entry), TAG, "index uid topics for %s", entry->device_id);
+    ESP_LOGI(TAG, "registered UID runtime for device %s with %u slots", entry->device_id, (unsigned)tpl->slot_count);
     return ESP_OK;
 }
 
-static esp_err_t register_signal_runtime(const dm_signal_hold_template_t *tpl, const char *device_id)
+static esp_err_t register_signal_runtime(const device_manager_config_t *owner,
+                                         const dm_signal_hold_template_t *tpl,
+                                         const char *device_id)
 {
     if (!tpl || !tpl->heartbeat_topic[0]) {
         return ESP_ERR_INVALID_ARG;
     }
-    signal_runtime_entry_t *entry = runtime_alloc(sizeof(*entry));
+    signal_runtime_entry_t *entry = runtime_alloc(sizeof(*entry), owner);
     if (!entry) {
         ESP_LOGE(TAG, "no memory for signal runtime");
         return ESP_ERR_NO_MEM;
     }
     dm_str_copy(entry->device_id, sizeof(entry->device_id), device_id);
+    entry->owner = owner;
     dm_signal_runtime_init(&entry->runtime, tpl);
-    dm_str_copy(entry->heartbeat_topic, sizeof(entry->heartbeat_topic), tpl->heartbeat_topic);
-    dm_str_copy(entry->reset_topic, sizeof(entry->reset_topic), tpl->reset_topic);
     entry->hold_started = false;
     entry->hold_paused = false;
     entry->hold_active = false;
-    entry->timeout_timer = NULL;
-    esp_timer_create_args_t args = {
-        .callback = signal_timeout_timer_cb,
-        .arg = entry,
-        .name = "dm_signal_timeout",
-        .dispatch_method = ESP_TIMER_TASK,
-    };
-    esp_err_t timer_err = esp_timer_create(&args, &entry->timeout_timer);
-    if (timer_err != ESP_OK) {
-        entry->timeout_timer = NULL;
-        ESP_LOGW(TAG, "signal timeout timer create failed for %s: %s",
-                 entry->device_id,
-                 esp_err_to_name(timer_err));
-    }
+    entry->complete_scenario = resolve_scenario(entry->device_id, "signal_complete");
+    dm_timer_init(&entry->timeout_timer, signal_timeout_timer_cb, entry);
     entry->next = s_signal_entries;
     s_signal_entries = entry;
-    ESP_LOGI(TAG, "registered signal runtime for device %s topic %s", entry->device_id, entry->heartbeat_topic);
+    ESP_RETURN_ON_ERROR(index_signal_topics(entry), TAG, "index signal topics for %s", entry->device_id);
+    ESP_LOGI(TAG, "registered signal runtime for device %s topic %s", entry->device_id, tpl->heartbeat_topic);
     return ESP_OK;
 }
 
-static esp_err_t register_mqtt_runtime(const dm_mqtt_trigger_template_t *tpl, const char *device_id)
+static esp_err_t register_mqtt_runtime(const device_manager_config_t *owner,
+                                       const dm_mqtt_trigger_template_t *tpl,
+                                       const char *device_id)
 {
     if (!tpl || tpl->rule_count == 0) {
         return ESP_ERR_INVALID_ARG;
     }
-    mqtt_runtime_entry_t *entry = runtime_alloc(sizeof(*entry));
+    mqtt_runtime_entry_t *entry = runtime_alloc(sizeof(*entry), owner);
     if (!entry) {
         ESP_LOGE(TAG, "no memory for mqtt trigger runtime");
         return ESP_ERR_NO_MEM;
     }
     dm_str_copy(entry->device_id, sizeof(entry->device_id), device_id);
+    entry->owner = owner;
     dm_mqtt_trigger_runtime_init(&entry->runtime, tpl);
+    for (uint8_t i = 0; i < tpl->rule_count && i < DM_MQTT_TRIGGER_MAX_RULES; ++i) {
+        entry->scenarios[i] = resolve_scenario(entry->device_id, entry->runtime.config->rules[i].scenario);
+        dm_rate_gate_init(&entry->gates[i], &tpl->limits[i], NULL, mqtt_rule_gate_fire, entry);
+    }
     entry->next = s_mqtt_entries;
     s_mqtt_entries = entry;
+    ESP_RETURN_ON_ERROR(index_mqtt_topics(entry), TAG, "index mqtt rule topics for %s", entry->device_id);
     ESP_LOGI(TAG, "registered MQTT trigger runtime for %s (%u rules)", entry->device_id, tpl->rule_count);
     return ESP_OK;
 }
 
-static esp_err_t register_flag_runtime(const dm_flag_trigger_template_t *tpl, const char *device_id)
+static esp_err_t register_flag_runtime(const device_manager_config_t *owner,
+                                       const dm_flag_trigger_template_t *tpl,
+                                       const char *device_id)
 {
     if (!tpl || tpl->rule_count == 0) {
         return ESP_ERR_INVALID_ARG;
     }
-    flag_runtime_entry_t *entry = runtime_alloc(sizeof(*entry));
+    flag_runtime_entry_t *entry = runtime_alloc(sizeof(*entry), owner);
     if (!entry) {
         ESP_LOGE(TAG, "no memory for flag trigger runtime");
         return ESP_ERR_NO_MEM;
     }
     dm_str_copy(entry->device_id, sizeof(entry->device_id), device_id);
+    entry->owner = owner;
     dm_flag_trigger_runtime_init(&entry->runtime, tpl);
+    for (uint8_t i = 0; i < tpl->rule_count && i < DM_FLAG_TRIGGER_MAX_RULES; ++i) {
+        entry->scenarios[i] = resolve_scenario(entry->device_id, entry->runtime.config->rules[i].scenario);
+        dm_rate_gate_init(&entry->gates[i], &tpl->limits[i], NULL, flag_rule_gate_fire, entry);
+    }
     entry->next = s_flag_entries;
     s_flag_entries = entry;
     ESP_LOGI(TAG, "registered flag trigger runtime for %s (%u rules)", entry->device_id, tpl->rule_count);
     return ESP_OK;
 }
 
-static esp_err_t register_condition_runtime(const dm_condition_template_t *tpl, const char *device_id)
+static esp_err_t register_condition_runtime(const device_manager_config_t *owner,
+                                            const dm_condition_template_t *tpl,
+                                            const char *device_id)
 {
     if (!tpl || tpl->rule_count == 0) {
         return ESP_ERR_INVALID_ARG;
     }
-    condition_runtime_entry_t *entry = runtime_alloc(sizeof(*entry));
+    condition_runtime_entry_t *entry = runtime_alloc(sizeof(*entry), owner);
     if (!entry) {
         ESP_LOGE(TAG, "no memory for condition runtime");
         return ESP_ERR_NO_MEM;
     }
     dm_str_copy(entry->device_id, sizeof(entry->device_id), device_id);
+    entry->owner = owner;
     dm_condition_runtime_init(&entry->runtime, tpl);
+    entry->true_scenario = resolve_scenario(entry->device_id, entry->runtime.config->true_scenario);
+    entry->false_scenario = resolve_scenario(entry->device_id, entry->runtime.config->false_scenario);
     entry->next = s_condition_entries;
     s_condition_entries = entry;
     ESP_LOGI(TAG, "registered condition runtime for %s (%u rules)", entry->device_id, tpl->rule_count);
@@ -494,11 +850,11 @@ static void interval_timer_callback(void *arg)
     if (!entry) {
         return;
     }
-    const char *scenario = entry->runtime.config.scenario;
+    const char *scenario = entry->runtime.config->scenario;
     if (!scenario[0]) {
         return;
     }
-    esp_err_t err = automation_engine_trigger(entry->device_id, scenario);
+    esp_err_t err = trigger_scenario(entry->scenario, entry->device_id, scenario);
     if (err != ESP_OK) {
         ESP_LOGW(TAG, "interval trigger %s/%s failed: %s",
                  entry->device_id,
@@ -509,111 +865,390 @@ static void interval_timer_callback(void *arg)
     }
 }
 
-static esp_err_t register_interval_runtime(const dm_interval_task_template_t *tpl, const char *device_id)
+static esp_err_t register_interval_runtime(const device_manager_config_t *owner,
+                                           const dm_interval_task_template_t *tpl,
+                                           const char *device_id)
 {
     if (!tpl || tpl->interval_ms == 0 || !tpl->scenario[0]) {
         return ESP_ERR_INVALID_ARG;
     }
-    interval_runtime_entry_t *entry = runtime_alloc(sizeof(*entry));
+    interval_runtime_entry_t *entry = runtime_alloc(sizeof(*entry), owner);
     if (!entry) {
         ESP_LOGE(TAG, "no memory for interval runtime");
         return ESP_ERR_NO_MEM;
     }
     dm_str_copy(entry->device_id, sizeof(entry->device_id), device_id);
+    entry->owner = owner;
     dm_interval_task_runtime_init(&entry->runtime, tpl);
-    esp_timer_create_args_t args = {
-        .callback = interval_timer_callback,
-        .arg = entry,
-        .name = "dm_interval",
-        .dispatch_method = ESP_TIMER_TASK,
-    };
-    esp_err_t err = esp_timer_create(&args, &entry->timer);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "interval timer create failed: %s", esp_err_to_name(err));
-        heap_caps_free(entry);
-        return err;
-    }
-    uint64_t interval_us = (uint64_t)entry->runtime.config.interval_ms * 1000ULL;
-    if (interval_us < 1000ULL) {
-        interval_us = 1000ULL;
-    }
-    err = esp_timer_start_periodic(entry->timer, interval_us);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "interval timer start failed: %s", esp_err_to_name(err));
-        esp_timer_delete(entry->timer);
-        heap_caps_free(entry);
-        return err;
-    }
+    entry->scenario = resolve_scenario(entry->device_id, entry->runtime.config->scenario);
+    dm_timer_init(&entry->timer, interval_timer_callback, entry);
+    dm_timer_arm_periodic(&entry->timer, entry->runtime.config->interval_ms);
     entry->next = s_interval_entries;
     s_interval_entries = entry;
     ESP_LOGI(TAG, "registered interval runtime for %s every %u ms",
              entry->device_id,
-             (unsigned)entry->runtime.config.interval_ms);
+             (unsigned)entry->runtime.config->interval_ms);
     return ESP_OK;
 }
 
-static esp_err_t register_sequence_runtime(const dm_sequence_template_t *tpl, const char *device_id)
+static void sequence_timeout_cb(void *arg);
+
+static esp_err_t register_sequence_runtime(const device_manager_config_t *owner,
+                                           const dm_sequence_template_t *tpl,
+                                           const char *device_id)
 {
     if (!tpl || tpl->step_count == 0) {
         return ESP_ERR_INVALID_ARG;
     }
-    sequence_runtime_entry_t *entry = runtime_alloc(sizeof(*entry));
+    sequence_runtime_entry_t *entry = runtime_alloc(sizeof(*entry), owner);
     if (!entry) {
         ESP_LOGE(TAG, "no memory for sequence runtime");
         return ESP_ERR_NO_MEM;
     }
     dm_str_copy(entry->device_id, sizeof(entry->device_id), device_id);
+    entry->owner = owner;
     dm_sequence_runtime_init(&entry->runtime, tpl);
+    entry->success_scenario = resolve_scenario(entry->device_id, entry->runtime.config->success_scenario);
+    entry->fail_scenario = resolve_scenario(entry->device_id, entry->runtime.config->fail_scenario);
+    dm_timer_init(&entry->step_timer, sequence_timeout_cb, entry);
     entry->next = s_sequence_entries;
     s_sequence_entries = entry;
+    ESP_RETURN_ON_ERROR(index_sequence_topics(entry), TAG, "index sequence topics for %s", entry->device_id);
     ESP_LOGI(TAG, "registered sequence runtime for %s (%u steps)",
              entry->device_id,
              (unsigned)tpl->step_count);
     return ESP_OK;
 }
 
-esp_err_t dm_template_runtime_register(const dm_template_config_t *tpl, const char *device_id)
+void dm_template_runtime_unregister(const char *device_id)
 {
-    if (!tpl || !device_id) {
-        return ESP_ERR_INVALID_ARG;
+    if (!device_id || !device_id[0]) {
+        return;
     }
+    dm_timer_wheel_lock();
+    size_t before = s_runtime_count;
+    remove_device_entries(device_id);
+    if (s_runtime_count != before) {
+        s_generation++;
+        esp_err_t err = rebuild_topic_index();
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "topic index rebuild failed: %s", esp_err_to_name(err));
+        }
+    }
+    dm_timer_wheel_unlock();
+}
+
+static esp_err_t register_runtime(const device_manager_config_t *owner,
+                                  const dm_template_config_t *tpl,
+                                  const char *device_id)
+{
     switch (tpl->type) {
     case DM_TEMPLATE_TYPE_UID:
-        return register_uid_runtime(&tpl->data.uid, device_id);
+        return register_uid_runtime(owner, &tpl->data.uid, device_id);
     case DM_TEMPLATE_TYPE_SIGNAL_HOLD:
-        return register_signal_runtime(&tpl->data.signal, device_id);
+        return register_signal_runtime(owner, &tpl->data.signal, device_id);
     case DM_TEMPLATE_TYPE_MQTT_TRIGGER:
-        return register_mqtt_runtime(&tpl->data.mqtt, device_id);
+        return register_mqtt_runtime(owner, &tpl->data.mqtt, device_id);
     case DM_TEMPLATE_TYPE_FLAG_TRIGGER:
-        return register_flag_runtime(&tpl->data.flag, device_id);
+        return register_flag_runtime(owner, &tpl->data.flag, device_id);
     case DM_TEMPLATE_TYPE_IF_CONDITION:
-        return register_condition_runtime(&tpl->data.condition, device_id);
+        return register_condition_runtime(owner, &tpl->data.condition, device_id);
     case DM_TEMPLATE_TYPE_INTERVAL_TASK:
-        return register_interval_runtime(&tpl->data.interval, device_id);
+        return register_interval_runtime(owner, &tpl->data.interval, device_id);
     case DM_TEMPLATE_TYPE_SEQUENCE_LOCK:
-        return register_sequence_runtime(&tpl->data.sequence, device_id);
+        return register_sequence_runtime(owner, &tpl->data.sequence, device_id);
     default:
         return ESP_ERR_NOT_SUPPORTED;
     }
 }
 
+esp_err_t dm_template_runtime_register(const device_manager_config_t *owner,
+                                       const dm_template_config_t *tpl,
+                                       const char *device_id)
+{
+    if (!tpl || !device_id) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    dm_timer_wheel_lock();
+    // A device carries one template; registering again replaces its runtime.
+    dm_template_runtime_unregister(device_id);
+    s_generation++;
+    esp_err_t err = register_runtime(owner, tpl, device_id);
+    dm_timer_wheel_unlock();
+    return err;
+}
+
+// Template of device_id in cfg when it is byte for byte the one a runtime already runs.
+static const dm_template_config_t *same_template(const device_manager_config_t *cfg,
+                                                const char *device_id,
+                                                dm_template_type_t type,
+                                                const void *current,
+                                                size_t size)
+{
+    uint8_t limit = cfg->device_capacity ? cfg->device_capacity : DEVICE_MANAGER_MAX_DEVICES;
+    for (uint8_t i = 0; i < cfg->device_count && i < limit; ++i) {
+        const device_descriptor_t *dev = &cfg->devices[i];
+        if (dev->template_assigned && dev->template_config.type == type && strcmp(dev->id, device_id) == 0) {
+            return memcmp(&dev->template_config.data, current, size) == 0 ? &dev->template_config : NULL;
+        }
+    }
+    return NULL;
+}
+
+// Moves entries whose template is unchanged in cfg over to cfg's copy and its reference.
+#define ADOPT_ENTRIES(list, cfg, type, member, adopted)                                          \
+    for (__typeof__(list) entry_ = (list); entry_; entry_ = entry_->next) {                     \
+        const dm_template_config_t *tpl_ = entry_->owner == (cfg) ? NULL :                       \
+            same_template((cfg), entry_->device_id, (type), entry_->runtime.config,              \
+                          sizeof(*entry_->runtime.config));                                      \
+        if (tpl_) {                                                                              \
+            entry_->runtime.config = &tpl_->data.member;                                         \
+            retain_owner(cfg);                                                                   \
+            release_owner(entry_->owner);                                                        \
+            entry_->owner = (cfg);                                                               \
+            (adopted)++;                                                                         \
+        }                                                                                        \
+    }
+
+size_t dm_template_runtime_adopt(const device_manager_config_t *cfg)
+{
+    if (!cfg) {
+        return 0;
+    }
+    size_t adopted = 0;
+    dm_timer_wheel_lock();
+    ADOPT_ENTRIES(s_uid_entries, cfg, DM_TEMPLATE_TYPE_UID, uid, adopted);
+    ADOPT_ENTRIES(s_signal_entries, cfg, DM_TEMPLATE_TYPE_SIGNAL_HOLD, signal, adopted);
+    ADOPT_ENTRIES(s_mqtt_entries, cfg, DM_TEMPLATE_TYPE_MQTT_TRIGGER, mqtt, adopted);
+    ADOPT_ENTRIES(s_flag_entries, cfg, DM_TEMPLATE_TYPE_FLAG_TRIGGER, flag, adopted);
+    ADOPT_ENTRIES(s_condition_entries, cfg, DM_TEMPLATE_TYPE_IF_CONDITION, condition, adopted);
+    ADOPT_ENTRIES(s_interval_entries, cfg, DM_TEMPLATE_TYPE_INTERVAL_TASK, interval, adopted);
+    ADOPT_ENTRIES(s_sequence_entries, cfg, DM_TEMPLATE_TYPE_SEQUENCE_LOCK, sequence, adopted);
+    // The index keys on topic strings inside the templates.
+    if (adopted) {
+        esp_err_t err = rebuild_topic_index();
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "topic index rebuild failed: %s", esp_err_to_name(err));
+        }
+    }
+    dm_timer_wheel_unlock();
+    return adopted;
+}
+
+size_t dm_template_runtime_reset_state(void)
+{
+    // Keep timer callbacks out until every runtime is back at its starting point.
+    dm_timer_wheel_lock();
+    for (uid_runtime_entry_t *entry = s_uid_entries; entry; entry = entry->next) {
+        dm_rate_gate_reset(&entry->start_gate);
+        dm_uid_runtime_reset(&entry->runtime);
+        entry->last_action_event = DM_UID_EVENT_NONE;
+        entry->last_action_ts_ms = 0;
+    }
+    for (signal_runtime_entry_t *entry = s_signal_entries; entry; entry = entry->next) {
+        clear_signal_entry(entry);
+    }
+    // MQTT trigger runtimes only keep their rate windows between messages.
+    for (mqtt_runtime_entry_t *entry = s_mqtt_entries; entry; entry = entry->next) {
+        reset_rule_gates(entry->gates, DM_MQTT_TRIGGER_MAX_RULES);
+    }
+    for (flag_runtime_entry_t *entry = s_flag_entries; entry; entry = entry->next) {
+        dm_flag_trigger_runtime_init(&entry->runtime, entry->runtime.config);
+        reset_rule_gates(entry->gates, DM_FLAG_TRIGGER_MAX_RULES);
+    }
+    for (condition_runtime_entry_t *entry = s_condition_entries; entry; entry = entry->next) {
+        dm_condition_runtime_init(&entry->runtime, entry->runtime.config);
+    }
+    for (interval_runtime_entry_t *entry = s_interval_entries; entry; entry = entry->next) {
+        // Restart the period so the first tick comes a full interval after the reset.
+        dm_timer_arm_periodic(&entry->timer, entry->runtime.config->interval_ms);
+    }
+    for (sequence_runtime_entry_t *entry = s_sequence_entries; entry; entry = entry->next) {
+        dm_timer_disarm(&entry->step_timer);
+        dm_sequence_runtime_reset(&entry->runtime);
+    }
+    dm_timer_wheel_unlock();
+    return s_runtime_count;
+}
+
+// Starts a checkpoint record and returns its data area.
+static void *begin_state_record(dm_runtime_state_t *rec, const char *device_id, dm_template_type_t type,
+                                size_t len, const void *config, size_t config_size)
+{
+    memset(rec, 0, sizeof(*rec));
+    dm_str_copy(rec->device_id, sizeof(rec->device_id), device_id);
+    rec->type = (uint8_t)type;
+    rec->len = (uint16_t)len;
+    rec->config_hash = dm_hash_bytes(config, config_size);
+    return rec->data;
+}
+
+#define BEGIN_STATE_RECORD(out, entry, type, rec_type)                                    \
+    begin_state_record((out), (entry)->device_id, (type), sizeof(rec_type),               \
+                       (entry)->runtime.config, sizeof(*(entry)->runtime.config))
+
+size_t dm_template_runtime_export_state(dm_runtime_state_t *out, size_t max)
+{
+    if (!out) {
+        return 0;
+    }
+    size_t count = 0;
+    // Timer callbacks change state too; take a consistent picture.
+    dm_timer_wheel_lock();
+    for (uid_runtime_entry_t *entry = s_uid_entries; entry && count < max; entry = entry->next) {
+        uid_state_rec_t *rec = BEGIN_STATE_RECORD(&out[count++], entry, DM_TEMPLATE_TYPE_UID, uid_state_rec_t);
+        rec->state = entry->runtime.state;
+        memcpy(rec->slots, entry->runtime.slots, sizeof(rec->slots));
+    }
+    for (signal_runtime_entry_t *entry = s_signal_entries; entry && count < max; entry = entry->next) {
+        signal_state_rec_t *rec = BEGIN_STATE_RECORD(&out[count++], entry, DM_TEMPLATE_TYPE_SIGNAL_HOLD, signal_state_rec_t);
+        rec->accumulated_ms = entry->runtime.state.accumulated_ms;
+        rec->finished = entry->runtime.state.finished;
+        rec->signal_sent = entry->runtime.state.signal_sent;
+    }
+    for (flag_runtime_entry_t *entry = s_flag_entries; entry && count < max; entry = entry->next) {
+        flag_state_rec_t *rec = BEGIN_STATE_RECORD(&out[count++], entry, DM_TEMPLATE_TYPE_FLAG_TRIGGER, flag_state_rec_t);
+        for (size_t i = 0; i < DM_FLAG_TRIGGER_MAX_RULES; ++i) {
+            rec->valid[i] = entry->runtime.rules[i].valid;
+            rec->last_state[i] = entry->runtime.rules[i].last_state;
+        }
+    }
+    for (condition_runtime_entry_t *entry = s_condition_entries; entry && count < max; entry = entry->next) {
+        condition_state_rec_t *rec = BEGIN_STATE_RECORD(&out[count++], entry, DM_TEMPLATE_TYPE_IF_CONDITION, condition_state_rec_t);
+        for (size_t i = 0; i < DM_CONDITION_TEMPLATE_MAX_RULES; ++i) {
+            rec->valid[i] = entry->runtime.rules[i].valid;
+            rec->state[i] = entry->runtime.rules[i].state;
+        }
+        rec->last_result = entry->runtime.last_result;
+        rec->has_last_result = entry->runtime.has_last_result;
+    }
+    for (sequence_runtime_entry_t *entry = s_sequence_entries; entry && count < max; entry = entry->next) {
+        sequence_state_rec_t *rec = BEGIN_STATE_RECORD(&out[count++], entry, DM_TEMPLATE_TYPE_SEQUENCE_LOCK, sequence_state_rec_t);
+        rec->current_index = entry->runtime.current_index;
+    }
+    dm_timer_wheel_unlock();
+    return count;
+}
+
+#define FIND_DEVICE_ENTRY(list, id)                                  \
+    ({                                                               \
+        __typeof__(list) e_ = (list);                                \
+        while (e_ && strcmp(e_->device_id, (id)) != 0) {             \
+            e_ = e_->next;                                           \
+        }                                                            \
+        e_;                                                          \
+    })
+
+// A record only applies to the template it was taken from.
+static esp_err_t check_state_record(const dm_runtime_state_t *state, size_t rec_size,
+                                    const void *config, size_t config_size)
+{
+    if (state->len != rec_size || state->config_hash != dm_hash_bytes(config, config_size)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return ESP_OK;
+}
+
+#define CHECK_STATE_RECORD(state, entry, rec_type)                                              \
+    ((entry) ? check_state_record((state), sizeof(rec_type), (entry)->runtime.config,           \
+                                  sizeof(*(entry)->runtime.config))                            \
+             : ESP_ERR_NOT_FOUND)
+
+esp_err_t dm_template_runtime_import_state(const dm_runtime_state_t *state)
+{
+    if (!state || state->len > sizeof(state->data)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = ESP_ERR_NOT_SUPPORTED;
+    dm_timer_wheel_lock();
+    switch ((dm_template_type_t)state->type) {
+    case DM_TEMPLATE_TYPE_UID: {
+        uid_runtime_entry_t *entry = FIND_DEVICE_ENTRY(s_uid_entries, state->device_id);
+        err = CHECK_STATE_RECORD(state, entry, uid_state_rec_t);
+        if (err == ESP_OK) {
+            const uid_state_rec_t *rec = (const uid_state_rec_t *)state->data;
+            entry->runtime.state = rec->state;
+            memcpy(entry->runtime.slots, rec->slots, sizeof(rec->slots));
+        }
+        break;
+    }
+    case DM_TEMPLATE_TYPE_SIGNAL_HOLD: {
+        signal_runtime_entry_t *entry = FIND_DEVICE_ENTRY(s_signal_entries, state->device_id);
+        err = CHECK_STATE_RECORD(state, entry, signal_state_rec_t);
+        if (err == ESP_OK) {
+            // The hold resumes on the next heartbeat; the hold track starts over.
+            const signal_state_rec_t *rec = (const signal_state_rec_t *)state->data;
+            clear_signal_entry(entry);
+            entry->runtime.state.accumulated_ms = rec->accumulated_ms;
+            entry->runtime.state.finished = rec->finished;
+            entry->runtime.state.signal_sent = rec->signal_sent;
+        }
+        break;
+    }
+    case DM_TEMPLATE_TYPE_FLAG_TRIGGER: {
+        flag_runtime_entry_t *entry = FIND_DEVICE_ENTRY(s_flag_entries, state->device_id);
+        err = CHECK_STATE_RECORD(state, entry, flag_state_rec_t);
+        if (err == ESP_OK) {
+            const flag_state_rec_t *rec = (const flag_state_rec_t *)state->data;
+            for (size_t i = 0; i < DM_FLAG_TRIGGER_MAX_RULES; ++i) {
+                entry->runtime.rules[i].valid = rec->valid[i];
+                entry->runtime.rules[i].last_state = rec->last_state[i];
+            }
+        }
+        break;
+    }
+    case DM_TEMPLATE_TYPE_IF_CONDITION: {
+        condition_runtime_entry_t *entry = FIND_DEVICE_ENTRY(s_condition_entries, state->device_id);
+        err = CHECK_STATE_RECORD(state, entry, condition_state_rec_t);
+        if (err == ESP_OK) {
+            const condition_state_rec_t *rec = (const condition_state_rec_t *)state->data;
+            for (size_t i = 0; i < DM_CONDITION_TEMPLATE_MAX_RULES; ++i) {
+                entry->runtime.rules[i].valid = rec->valid[i];
+                entry->runtime.rules[i].state = rec->state[i];
+            }
+            entry->runtime.last_result = rec->last_result;
+            entry->runtime.has_last_result = rec->has_last_result;
+        }
+        break;
+    }
+    case DM_TEMPLATE_TYPE_SEQUENCE_LOCK: {
+        sequence_runtime_entry_t *entry = FIND_DEVICE_ENTRY(s_sequence_entries, state->device_id);
+        err = CHECK_STATE_RECORD(state, entry, sequence_state_rec_t);
+        if (err == ESP_OK) {
+            // The step deadline restarts from now rather than from before the reboot.
+            const sequence_state_rec_t *rec = (const sequence_state_rec_t *)state->data;
+            dm_timer_disarm(&entry->step_timer);
+            entry->runtime.current_index = rec->current_index;
+            entry->runtime.last_step_ms = (uint64_t)(esp_timer_get_time() / 1000);
+            if (rec->current_index > 0 && entry->runtime.config->timeout_ms) {
+                dm_timer_arm(&entry->step_timer, entry->runtime.config->timeout_ms);
+            }
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    dm_timer_wheel_unlock();
+    return err;
+}
+
 esp_err_t dm_template_runtime_get_uid_snapshot(const char *device_id, dm_uid_runtime_snapshot_t *out)
 {
     if (!device_id || !out) {
         return ESP_ERR_INVALID_ARG;
     }
     memset(out, 0, sizeof(*out));
-    for (uid_runtime_entry_t *entry = s_uid_entries; entry; entry = entry->next) {
-        if (strcmp(entry->device_id, device_id) != 0) {
-            continue;
-        }
+    dm_timer_wheel_lock();
+    uid_runtime_entry_t *entry = FIND_DEVICE_ENTRY(s_uid_entries, device_id);
+    if (entry) {
         dm_str_copy(out->device_id, sizeof(out->device_id), entry->device_id);
-        out->slot_count = entry->runtime.config.slot_count;
+        out->slot_count = entry->runtime.config->slot_count;
         if (out->slot_count > DM_UID_TEMPLATE_MAX_SLOTS) {
             out->slot_count = DM_UID_TEMPLATE_MAX_SLOTS;
         }
         for (uint8_t s = 0; s < out->slot_count; ++s) {
-            const dm_uid_slot_t *slot = &entry->runtime.config.slots[s];
+            const dm_uid_slot_t *slot = &entry->runtime.config->slots[s];
             dm_str_copy(out->slots[s].source_id, sizeof(out->slots[s].source_id), slot->source_id);
             dm_str_copy(out->slots[s].label, sizeof(out->slots[s].label), slot->label);
             out->slots[s].has_value = entry->runtime.slots[s].has_value;
@@ -622,9 +1257,9 @@ esp_err_t dm_template_runtime_get_uid_snapshot(const char *device_id, dm_uid_run
                             entry->runtime.slots[s].value);
             }
         }
-        return ESP_OK;
     }
-    return ESP_ERR_NOT_FOUND;
+    dm_timer_wheel_unlock();
+    return entry ? ESP_OK : ESP_ERR_NOT_FOUND;
 }
 
 static void publish_mqtt_payload(const char *topic, const char *payload)
@@ -659,45 +1294,57 @@ static void reset_uid_entry(uid_runtime_entry_t *entry)
     dm_uid_runtime_reset(&entry->runtime);
 }
 
+static void apply_uid_start(uid_runtime_entry_t *entry)
+{
+    const dm_uid_template_t *cfg = entry->runtime.config;
+    reset_uid_entry(entry);
+    if (cfg->broadcast_topic[0]) {
+        publish_mqtt_payload(cfg->broadcast_topic, cfg->broadcast_payload);
+    }
+}
+
+// Trailing start edge, from the timer wheel.
+static void uid_start_gate_fire(dm_rate_gate_t *gate, void *arg)
+{
+    (void)gate;
+    uid_runtime_entry_t *entry = (uid_runtime_entry_t *)arg;
+    ESP_LOGI(TAG, "[UID] dev=%s start (trailing edge)", entry->device_id);
+    apply_uid_start(entry);
+}
+
 static bool handle_uid_start_event(uid_runtime_entry_t *entry, const char *topic, const char *payload)
 {
-    if (!entry || !entry->start_topic[0] || !topic) {
+    const dm_uid_template_t *cfg = entry ? entry->runtime.config : NULL;
+    if (!cfg || !cfg->start_topic[0] || !topic) {
         return false;
     }
-    if (strcmp(entry->start_topic, topic) != 0) {
+    if (strcmp(cfg->start_topic, topic) != 0) {
         return false;
     }
-    if (!payload_matches(entry->start_payload, payload)) {
+    if (!payload_matches(cfg->start_payload, payload)) {
         return false;
     }
-    uint64_t now_ms = (uint64_t)(esp_timer_get_time() / 1000);
-    if (entry->last_start_ts_ms > 0) {
-        uint64_t delta = (now_ms > entry->last_start_ts_ms) ? (now_ms - entry->last_start_ts_ms) : 0;
-        if (delta < 300) {
-            ESP_LOGW(TAG,
-                     "[UID] dev=%s start topic=%s suppressed (delta %llu ms)",
-                     entry->device_id,
-                     topic,
-                     (unsigned long long)delta);
-            return true;
-        }
+    if (!dm_rate_gate_admit(&entry->start_gate)) {
+        ESP_LOGW(TAG,
+                 "[UID] dev=%s start topic=%s held back (%s %u ms)",
+                 entry->device_id,
+                 topic,
+                 dm_rate_mode_to_string((dm_rate_mode_t)entry->start_gate.limit.mode),
+                 (unsigned)entry->start_gate.limit.window_ms);
+        return true;
     }
-    entry->last_start_ts_ms = now_ms;
     ESP_LOGI(TAG,
              "[UID] dev=%s start topic=%s payload='%s'",
              entry->device_id,
              topic,
              payload ? payload : "");
-    reset_uid_entry(entry);
-    if (entry->broadcast_topic[0]) {
-        publish_mqtt_payload(entry->broadcast_topic, entry->broadcast_payload);
-    }
+    apply_uid_start(entry);
     return true;
 }
 
-static void trigger_uid_scenario(const char *device_id, const char *scenario_id)
+static void trigger_uid_scenario(automation_scenario_handle_t handle, const char *device_id, const char *scenario_id)
 {
-    esp_err_t err = automation_engine_trigger(device_id, scenario_id);
+    esp_err_t err = trigger_scenario(handle, device_id, scenario_id);
     if (err == ESP_ERR_NOT_FOUND) {
         ESP_LOGD(TAG, "scenario %s/%s not found", device_id, scenario_id);
     } else if (err != ESP_OK) {
@@ -705,12 +1352,12 @@ static void trigger_uid_scenario(const char *device_id, const char *scenario_id)
     }
 }
 
-static void trigger_device_scenario(const char *device_id, const char *scenario_id)
+static void trigger_device_scenario(automation_scenario_handle_t handle, const char *device_id, const char *scenario_id)
 {
     if (!scenario_id || !scenario_id[0]) {
         return;
     }
-    esp_err_t err = automation_engine_trigger(device_id, scenario_id);
+    esp_err_t err = trigger_scenario(handle, device_id, scenario_id);
     if (err != ESP_OK) {
         ESP_LOGW(TAG, "scenario %s/%s failed: %s", device_id, scenario_id, esp_err_to_name(err));
     }
@@ -752,38 +1399,24 @@ static bool uid_action_is_duplicate(uid_runtime_entry_t *entry, dm_uid_event_typ
     return false;
 }
 
-static bool handle_uid_message(const char *topic, const char *payload)
+static void handle_uid_value(uid_runtime_entry_t *entry, const char *topic, const char *body)
 {
-    bool handled = false;
-    const char *body = payload ? payload : "";
-    for (uid_runtime_entry_t *entry = s_uid_entries; entry; entry = entry->next) {
-        if (handle_uid_start_event(entry, topic, body)) {
-            handled = true;
-            continue;
-        }
-        for (size_t t = 0; t < entry->topic_count; ++t) {
-            if (entry->topics[t][0] && strcmp(entry->topics[t], topic) == 0) {
-                handled = true;
-                dm_uid_action_t action = dm_uid_runtime_handle_value(&entry->runtime, topic, body);
-                ESP_LOGD(TAG, "[UID] dev=%s topic=%s event=%s payload='%s'",
-                         entry->device_id,
-                         topic,
-                         uid_event_str(action.event),
-                         body);
-                if (uid_action_is_duplicate(entry, action.event)) {
-                    ESP_LOGD(TAG, "[UID] dev=%s suppress duplicate event=%s", entry->device_id, uid_event_str(action.event));
-                    continue;
-                }
-                apply_uid_action(&action);
-            }
-        }
+    dm_uid_action_t action = dm_uid_runtime_handle_value(&entry->runtime, topic, body);
+    ESP_LOGD(TAG, "[UID] dev=%s topic=%s event=%s payload='%s'",
+             entry->device_id,
+             topic,
+             uid_event_str(action.event),
+             body);
+    if (uid_action_is_duplicate(entry, action.event)) {
+        ESP_LOGD(TAG, "[UID] dev=%s suppress duplicate event=%s", entry->device_id, uid_event_str(action.event));
+        return;
     }
-    return handled;
+    apply_uid_action(&action);
 }
 
 static void handle_signal_audio(signal_runtime_entry_t *entry, dm_signal_event_type_t ev)
 {
-    const dm_signal_hold_template_t *cfg = &entry->runtime.config;
+    const dm_signal_hold_template_t *cfg = entry->runtime.config;
     if (!cfg->hold_track[0]) {
         return;
     }
@@ -891,12 +1524,12 @@ static void apply_sequence_success(sequence_runtime_entry_t *entry)
     if (!entry) {
         return;
     }
-    const dm_sequence_template_t *cfg = &entry->runtime.config;
+    const dm_sequence_template_t *cfg = entry->runtime.config;
     publish_mqtt_payload(cfg->success_topic, cfg->success_payload);
     if (cfg->success_audio_track[0]) {
         audio_player_play(cfg->success_audio_track);
     }
-    trigger_device_scenario(entry->device_id, cfg->success_scenario);
+    trigger_device_scenario(entry->success_scenario, entry->device_id, cfg->success_scenario);
 }
 
 static void apply_sequence_fail(sequence_runtime_entry_t *entry)
@@ -904,131 +1537,209 @@ static void apply_sequence_fail(sequence_runtime_entry_t *entry)
     if (!entry) {
         return;
     }
-    const dm_sequence_template_t *cfg = &entry->runtime.config;
+    const dm_sequence_template_t *cfg = entry->runtime.config;
     publish_mqtt_payload(cfg->fail_topic, cfg->fail_payload);
     if (cfg->fail_audio_track[0]) {
         audio_player_play(cfg->fail_audio_track);
     }
-    trigger_device_scenario(entry->device_id, cfg->fail_scenario);
+    trigger_device_scenario(entry->fail_scenario, entry->device_id, cfg->fail_scenario);
 }
 
-static bool handle_sequence_message(const char *topic, const char *payload)
+static void sequence_timeout_cb(void *arg)
 {
-    if (!topic || !topic[0]) {
+    sequence_runtime_entry_t *entry = (sequence_runtime_entry_t *)arg;
+    if (!entry) {
+        return;
+    }
+    dm_sequence_action_t action = dm_sequence_runtime_timeout(&entry->runtime);
+    if (action.type != DM_SEQUENCE_EVENT_FAILED) {
+        return;
+    }
+    ESP_LOGW(TAG, "[Sequence] dev=%s failed (timeout>%ums)",
+             entry->device_id,
+             (unsigned)entry->runtime.config->timeout_ms);
+    apply_sequence_fail(entry);
+}
+
+static bool handle_sequence_step(sequence_runtime_entry_t *entry, const char *topic, const char *payload,
+                                 uint64_t now_ms)
+{
+    dm_sequence_action_t action =
+        dm_sequence_runtime_handle(&entry->runtime, topic, payload, now_ms);
+    if (action.type == DM_SEQUENCE_EVENT_NONE && !action.step) {
         return false;
     }
-    bool handled = false;
-    uint64_t now_ms = (uint64_t)(esp_timer_get_time() / 1000);
-    for (sequence_runtime_entry_t *entry = s_sequence_entries; entry; entry = entry->next) {
-        dm_sequence_action_t action =
-            dm_sequence_runtime_handle(&entry->runtime, topic, payload, now_ms);
-        if (action.type == DM_SEQUENCE_EVENT_NONE && !action.step) {
-            continue;
+    if (action.type == DM_SEQUENCE_EVENT_STEP_OK && entry->runtime.config->timeout_ms) {
+        dm_timer_arm(&entry->step_timer, entry->runtime.config->timeout_ms);
+    } else if (action.type != DM_SEQUENCE_EVENT_NONE) {
+        dm_timer_disarm(&entry->step_timer);
+    }
+    const char *step_topic = action.step && action.step->topic[0] ? action.step->topic : topic;
+    switch (action.type) {
+    case DM_SEQUENCE_EVENT_STEP_OK:
+        ESP_LOGI(TAG, "[Sequence] dev=%s step ok topic=%s payload='%s'",
+                 entry->device_id,
+                 step_topic,
+                 payload ? payload : "");
+        if (action.step) {
+            apply_sequence_step_hint(action.step);
         }
-        handled = true;
-        const char *step_topic = action.step && action.step->topic[0] ? action.step->topic : topic;
-        switch (action.type) {
-        case DM_SEQUENCE_EVENT_STEP_OK:
-            ESP_LOGI(TAG, "[Sequence] dev=%s step ok topic=%s payload='%s'",
-                     entry->device_id,
-                     step_topic,
-                     payload ? payload : "");
-            if (action.step) {
-                apply_sequence_step_hint(action.step);
-            }
-            break;
-        case DM_SEQUENCE_EVENT_COMPLETED:
-            ESP_LOGI(TAG, "[Sequence] dev=%s completed topic=%s payload='%s'",
-                     entry->device_id,
-                     step_topic,
-                     payload ? payload : "");
-            if (action.step) {
-                apply_sequence_step_hint(action.step);
-            }
-            apply_sequence_success(entry);
-            break;
-        case DM_SEQUENCE_EVENT_FAILED:
-            ESP_LOGW(TAG, "[Sequence] dev=%s failed topic=%s payload='%s'%s",
-                     entry->device_id,
-                     step_topic,
-                     payload ? payload : "",
-                     action.timeout ? " (timeout)" : "");
-            apply_sequence_fail(entry);
-            break;
-        case DM_SEQUENCE_EVENT_NONE:
-        default:
-            ESP_LOGD(TAG, "[Sequence] dev=%s ignored topic=%s payload='%s'",
-                     entry->device_id,
-                     step_topic,
-                     payload ? payload : "");
-            break;
+        break;
+    case DM_SEQUENCE_EVENT_COMPLETED:
+        ESP_LOGI(TAG, "[Sequence] dev=%s completed topic=%s payload='%s'",
+                 entry->device_id,
+                 step_topic,
+                 payload ? payload : "");
+        if (action.step) {
+            apply_sequence_step_hint(action.step);
         }
+        apply_sequence_success(entry);
+        break;
+    case DM_SEQUENCE_EVENT_FAILED:
+        ESP_LOGW(TAG, "[Sequence] dev=%s failed topic=%s payload='%s'%s",
+                 entry->device_id,
+                 step_topic,
+                 payload ? payload : "",
+                 action.timeout ? " (timeout)" : "");
+        apply_sequence_fail(entry);
+        break;
+    case DM_SEQUENCE_EVENT_NONE:
+    default:
+        ESP_LOGD(TAG, "[Sequence] dev=%s ignored topic=%s payload='%s'",
+                 entry->device_id,
+                 step_topic,
+                 payload ? payload : "");
+        break;
     }
-    return handled;
+    return true;
 }
 
-static bool handle_signal_message(const char *topic, const char *payload)
+static void handle_signal_heartbeat(signal_runtime_entry_t *entry, const char *topic, const char *payload,
+                                    uint64_t now_ms)
 {
-    bool handled = false;
-    uint64_t now_ms = (uint64_t)(esp_timer_get_time() / 1000);
-    for (signal_runtime_entry_t *entry = s_signal_entries; entry; entry = entry->next) {
-        if (entry->reset_topic[0] && strcmp(entry->reset_topic, topic) == 0) {
-            handled = true;
-            reset_signal_entry(entry, topic);
-            continue;
-        }
-        if (entry->heartbeat_topic[0] && strcmp(entry->heartbeat_topic, topic) == 0) {
-            handled = true;
-            dm_signal_action_t action = dm_signal_runtime_handle_tick(&entry->runtime, now_ms);
-            if (action.event == DM_SIGNAL_EVENT_COMPLETED || action.event == DM_SIGNAL_EVENT_STOP) {
-                stop_signal_timeout_timer(entry);
-            } else if (action.event != DM_SIGNAL_EVENT_NONE) {
-                restart_signal_timeout_timer(entry);
-            }
-            if (diagnostics_verbose_enabled()) {
-                ESP_LOGI(TAG,
-                         "[Signal] dev=%s heartbeat topic=%s payload='%s' event=%s acc=%ums",
-                         entry->device_id,
-                         topic,
-                         payload ? payload : "",
-                         signal_event_str(action.event),
-                         (unsigned)action.accumulated_ms);
-            }
-            handle_signal_audio(entry, action.event);
-            apply_signal_mqtt_action(entry, &action);
-            if (action.event == DM_SIGNAL_EVENT_COMPLETED) {
-                trigger_uid_scenario(entry->device_id, "signal_complete");
-            }
-        }
+    dm_signal_action_t action = dm_signal_runtime_handle_tick(&entry->runtime, now_ms);
+    if (action.event == DM_SIGNAL_EVENT_COMPLETED || action.event == DM_SIGNAL_EVENT_STOP) {
+        stop_signal_timeout_timer(entry);
+    } else if (action.event != DM_SIGNAL_EVENT_NONE) {
+        restart_signal_timeout_timer(entry);
+    }
+    if (diagnostics_verbose_enabled()) {
+        ESP_LOGI(TAG,
+                 "[Signal] dev=%s heartbeat topic=%s payload='%s' event=%s acc=%ums",
+                 entry->device_id,
+                 topic,
+                 payload ? payload : "",
+                 signal_event_str(action.event),
+                 (unsigned)action.accumulated_ms);
+    }
+    handle_signal_audio(entry, action.event);
+    apply_signal_mqtt_action(entry, &action);
+    if (action.event == DM_SIGNAL_EVENT_COMPLETED) {
+        trigger_uid_scenario(entry->complete_scenario, entry->device_id, "signal_complete");
     }
-    return handled;
 }
 
-static bool handle_mqtt_trigger_message(const char *topic, const char *payload)
+static void trigger_rule_scenario(automation_scenario_handle_t handle, const char *device_id, const char *scenario)
 {
-    bool handled = false;
-    for (mqtt_runtime_entry_t *entry = s_mqtt_entries; entry; entry = entry->next) {
-        const dm_mqtt_trigger_rule_t *rule =
-            dm_mqtt_trigger_runtime_match(&entry->runtime, topic, payload);
-        if (!rule) {
-            ESP_LOGD(TAG, "[MQTT trigger] dev=%s no match topic=%s payload='%s'",
-                     entry->device_id,
-                     topic,
-                     payload ? payload : "");
-            continue;
-        }
-        handled = true;
-        ESP_LOGI(TAG, "[MQTT trigger] dev=%s topic=%s scenario=%s payload='%s'",
+    esp_err_t err = trigger_scenario(handle, device_id, scenario);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "scenario %s/%s failed: %s", device_id, scenario, esp_err_to_name(err));
+    }
+}
+
+static void mqtt_rule_gate_fire(dm_rate_gate_t *gate, void *arg)
+{
+    mqtt_runtime_entry_t *entry = (mqtt_runtime_entry_t *)arg;
+    size_t rule_idx = (size_t)(gate - entry->gates);
+    const dm_mqtt_trigger_rule_t *rule = &entry->runtime.config->rules[rule_idx];
+    ESP_LOGI(TAG, "[MQTT trigger] dev=%s scenario=%s (trailing edge)", entry->device_id, rule->scenario);
+    trigger_rule_scenario(entry->scenarios[rule_idx], entry->device_id, rule->scenario);
+}
+
+static void flag_rule_gate_fire(dm_rate_gate_t *gate, void *arg)
+{
+    flag_runtime_entry_t *entry = (flag_runtime_entry_t *)arg;
+    size_t rule_idx = (size_t)(gate - entry->gates);
+    const dm_flag_trigger_rule_t *rule = &entry->runtime.config->rules[rule_idx];
+    ESP_LOGI(TAG, "[Flag trigger] dev=%s flag=%s scenario=%s (trailing edge)",
+             entry->device_id,
+             rule->flag,
+             rule->scenario);
+    trigger_rule_scenario(entry->scenarios[rule_idx], entry->device_id, rule->scenario);
+}
+
+static bool handle_mqtt_rule(mqtt_runtime_entry_t *entry, const char *topic, const char *payload)
+{
+    const dm_mqtt_trigger_rule_t *rule =
+        dm_mqtt_trigger_runtime_match(&entry->runtime, topic, payload);
+    if (!rule) {
+        ESP_LOGD(TAG, "[MQTT trigger] dev=%s no match topic=%s payload='%s'",
                  entry->device_id,
                  topic,
-                 rule->scenario,
                  payload ? payload : "");
-        esp_err_t err = automation_engine_trigger(entry->device_id, rule->scenario);
-        if (err != ESP_OK) {
-            ESP_LOGW(TAG, "scenario %s/%s failed: %s",
-                     entry->device_id,
-                     rule->scenario,
-                     esp_err_to_name(err));
+        return false;
+    }
+    size_t rule_idx = (size_t)(rule - entry->runtime.config->rules);
+    if (!dm_rate_gate_admit(&entry->gates[rule_idx])) {
+        ESP_LOGD(TAG, "[MQTT trigger] dev=%s topic=%s scenario=%s rate limited",
+                 entry->device_id,
+                 topic,
+                 rule->scenario);
+        return true;
+    }
+    ESP_LOGI(TAG, "[MQTT trigger] dev=%s topic=%s scenario=%s payload='%s'",
+             entry->device_id,
+             topic,
+             rule->scenario,
+             payload ? payload : "");
+    trigger_rule_scenario(entry->scenarios[rule_idx], entry->device_id, rule->scenario);
+    return true;
+}
+
+// Only runtimes indexed under this topic are visited, in registration order.
+static bool handle_mqtt_locked(const char *topic, const char *payload)
+{
+    const dm_topic_binding_t *binding = dm_topic_index_find(&s_topic_index, topic);
+    if (!binding) {
+        return false;
+    }
+    const char *body = payload ? payload : "";
+    uint64_t now_ms = (uint64_t)(esp_timer_get_time() / 1000);
+    // A UID start or signal reset consumes the message for the rest of that runtime's bindings.
+    const void *consumed = NULL;
+    bool handled = false;
+    for (; binding; binding = dm_topic_index_next(&s_topic_index, binding)) {
+        if (binding->runtime == consumed) {
+            continue;
+        }
+        switch ((topic_role_t)binding->role) {
+        case TOPIC_ROLE_UID_START:
+            if (handle_uid_start_event(binding->runtime, topic, body)) {
+                consumed = binding->runtime;
+                handled = true;
+            }
+            break;
+        case TOPIC_ROLE_UID_SLOT:
+            handle_uid_value(binding->runtime, topic, body);
+            handled = true;
+            break;
+        case TOPIC_ROLE_SIGNAL_RESET:
+            reset_signal_entry(binding->runtime, topic);
+            consumed = binding->runtime;
+            handled = true;
+            break;
+        case TOPIC_ROLE_SIGNAL_HEARTBEAT:
+            handle_signal_heartbeat(binding->runtime, topic, payload, now_ms);
+            handled = true;
+            break;
+        case TOPIC_ROLE_MQTT_RULE:
+            handled |= handle_mqtt_rule(binding->runtime, topic, payload);
+            break;
+        case TOPIC_ROLE_SEQUENCE_STEP:
+            handled |= handle_sequence_step(binding->runtime, topic, payload, now_ms);
+            break;
+        default:
+            break;
         }
     }
     return handled;
@@ -1039,19 +1750,14 @@ bool dm_template_runtime_handle_mqtt(const char *topic, const char *payload)
     if (!topic) {
         return false;
     }
-    bool handled = false;
-    handled |= handle_uid_message(topic, payload);
-    handled |= handle_signal_message(topic, payload);
-    handled |= handle_mqtt_trigger_message(topic, payload);
-    handled |= handle_sequence_message(topic, payload);
+    dm_timer_wheel_lock();
+    bool handled = handle_mqtt_locked(topic, payload);
+    dm_timer_wheel_unlock();
     return handled;
 }
 
-bool dm_template_runtime_handle_flag(const char *flag_name, bool state)
+static bool handle_flag_locked(const char *flag_name, bool state)
 {
-    if (!flag_name) {
-        return false;
-    }
     bool handled = false;
     for (flag_runtime_entry_t *entry = s_flag_entries; entry; entry = entry->next) {
         const dm_flag_trigger_rule_t *rule =
@@ -1060,18 +1766,17 @@ bool dm_template_runtime_handle_flag(const char *flag_name, bool state)
             continue;
         }
         handled = true;
+        size_t rule_idx = (size_t)(rule - entry->runtime.config->rules);
+        if (!dm_rate_gate_admit(&entry->gates[rule_idx])) {
+            ESP_LOGD(TAG, "[Flag trigger] dev=%s flag=%s rate limited", entry->device_id, rule->flag);
+            continue;
+        }
         ESP_LOGI(TAG, "[Flag trigger] dev=%s flag=%s state=%d scenario=%s",
                  entry->device_id,
                  rule->flag,
                  (int)state,
                  rule->scenario);
-        esp_err_t err = automation_engine_trigger(entry->device_id, rule->scenario);
-        if (err != ESP_OK) {
-            ESP_LOGW(TAG, "scenario %s/%s failed: %s",
-                     entry->device_id,
-                     rule->scenario,
-                     esp_err_to_name(err));
-        }
+        trigger_rule_scenario(entry->scenarios[rule_idx], entry->device_id, rule->scenario);
     }
     for (condition_runtime_entry_t *entry = s_condition_entries; entry; entry = entry->next) {
         bool changed = false;
@@ -1081,10 +1786,12 @@ bool dm_template_runtime_handle_flag(const char *flag_name, bool state)
             if (!changed) {
                 continue;
             }
-            const char *scenario = result ? entry->runtime.config.true_scenario
-                                          : entry->runtime.config.false_scenario;
+            const char *scenario = result ? entry->runtime.config->true_scenario
+                                          : entry->runtime.config->false_scenario;
             if (scenario[0]) {
-                esp_err_t err = automation_engine_trigger(entry->device_id, scenario);
+                esp_err_t err = trigger_scenario(result ? entry->true_scenario : entry->false_scenario,
+                                                 entry->device_id,
+                                                 scenario);
                 if (err != ESP_OK) {
                     ESP_LOGW(TAG, "if_condition trigger %s/%s failed: %s",
                              entry->device_id,
@@ -1096,3 +1803,14 @@ bool dm_template_runtime_handle_flag(const char *flag_name, bool state)
     }
     return handled;
 }
+
+bool dm_template_runtime_handle_flag(const char *flag_name, bool state)
+{
+    if (!flag_name) {
+        return false;
+    }
+    dm_timer_wheel_lock();
+    bool handled = handle_flag_locked(flag_name, state);
+    dm_timer_wheel_unlock();
+    return handled;
+}
@@ -11,14 +11,15 @@ static bool uid_matches(const dm_uid_slot_t *slot, const char *value)
         return false;
     }
     for (uint8_t i = 0; i < slot->value_count && i < DM_UID_TEMPLATE_MAX_VALUES; ++i) {
-        if (slot->values[i][0] && strcasecmp(slot->values[i], value) == 0) {
+        if (slot->values[i][0] && slot->values[i][0] != DM_UID_VALUE_FILE_PREFIX &&
+            strcasecmp(slot->values[i], value) == 0) {
             return true;
         }
     }
     return false;
 }
 
-static int find_slot_index(const dm_uid_template_t *tpl, const char *source_id)
+int dm_uid_find_slot(const dm_uid_template_t *tpl, const char *source_id)
 {
     if (!tpl || !source_id || !source_id[0]) {
         return -1;
@@ -122,11 +123,26 @@ dm_uid_event_t dm_uid_handle_value(dm_uid_state_t *state,
     if (!state || !tpl || !source_id || !source_id[0]) {
         return event;
     }
-    if (tpl->slot_count == 0 || tpl->slot_count > DM_UID_TEMPLATE_MAX_SLOTS) {
+    int slot_index = dm_uid_find_slot(tpl, source_id);
+    if (slot_index < 0) {
         return event;
     }
-    int slot_index = find_slot_index(tpl, source_id);
-    if (slot_index < 0) {
+    return dm_uid_handle_match(state, tpl, slot_index, uid_matches(&tpl->slots[slot_index], value));
+}
+
+dm_uid_event_t dm_uid_handle_match(dm_uid_state_t *state,
+                                   const dm_uid_template_t *tpl,
+                                   int slot_index,
+                                   bool matched)
+{
+    dm_uid_event_t event = {
+        .type = DM_UID_EVENT_NONE,
+        .slot = NULL,
+    };
+    if (!state || !tpl || slot_index < 0 || slot_index >= tpl->slot_count) {
+        return event;
+    }
+    if (tpl->slot_count == 0 || tpl->slot_count > DM_UID_TEMPLATE_MAX_SLOTS) {
         return event;
     }
     const dm_uid_slot_t *slot = &tpl->slots[slot_index];
@@ -136,7 +152,7 @@ dm_uid_event_t dm_uid_handle_value(dm_uid_state_t *state,
         slot_set_seen(state, (uint8_t)slot_index);
         state->seen_count++;
     }
-    if (!uid_matches(slot, value)) {
+    if (!matched) {
         state->invalid_seen = true;
         event.type = DM_UID_EVENT_NONE;
     } else if (slot_marked_ok(state, (uint8_t)slot_index)) {
@@ -245,6 +261,14 @@ dm_signal_event_t dm_signal_handle_timeout(dm_signal_state_t *state,
     return event;
 }
 
+// Profile records store dm_template_config_t verbatim; the mqtt variant must not widen it.
+_Static_assert(sizeof(dm_mqtt_trigger_template_t) <= sizeof(dm_sequence_template_t),
+               "mqtt trigger template grew past the template union");
+_Static_assert(sizeof(dm_flag_trigger_template_t) <= sizeof(dm_sequence_template_t),
+               "flag trigger template grew past the template union");
+_Static_assert(sizeof(dm_uid_template_t) <= sizeof(dm_sequence_template_t),
+               "uid template grew past the template union");
+
 void dm_mqtt_trigger_template_clear(dm_mqtt_trigger_template_t *tpl)
 {
     if (!tpl) {
@@ -0,0 +1,220 @@
+#include "unity.h"
+#include "dm_bulk.h"
+#include "dm_config.h"
+#include "dm_storage.h"
+#include "esp_heap_caps.h"
+#include <stdio.h>
+#include <string.h>
+
+typedef struct {
+    uint8_t data[4096];
+    size_t len;
+} bytes_sink_t;
+
+static esp_err_t bytes_sink(void *ctx, const char *data, size_t len)
+{
+    bytes_sink_t *out = (bytes_sink_t *)ctx;
+    if (out->len + len > sizeof(out->data)) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(out->data + out->len, data, len);
+    out->len += len;
+    return ESP_OK;
+}
+
+// Events written back as compact text, as in the JSON reader tests.
+typedef struct {
+    char text[512];
+    size_t len;
+} trace_t;
+
+static esp_err_t trace_event(void *ctx, dm_json_event_t event, const dm_json_value_t *value)
+{
+    trace_t *t = (trace_t *)ctx;
+    static const char *const marks[] = {"{", "}", "[", "]"};
+    char *at = t->text + t->len;
+    size_t room = sizeof(t->text) - t->len;
+    int w;
+    switch (event) {
+    case DM_JSON_EVENT_KEY: w = snprintf(at, room, "k:%s ", value->str); break;
+    case DM_JSON_EVENT_STRING: w = snprintf(at, room, "s:%s ", value->str); break;
+    case DM_JSON_EVENT_NUMBER: w = snprintf(at, room, "n:%g ", value->number); break;
+    case DM_JSON_EVENT_BOOL: w = snprintf(at, room, "%s ", value->boolean ? "true" : "false"); break;
+    case DM_JSON_EVENT_NULL: w = snprintf(at, room, "null "); break;
+    default: w = snprintf(at, room, "%s", marks[event]); break;
+    }
+    TEST_ASSERT_TRUE(w >= 0 && (size_t)w < room);
+    t->len += (size_t)w;
+    return ESP_OK;
+}
+
+// Feeds `data` one byte at a time, the worst split there is.
+static esp_err_t trace_cbor(trace_t *t, const uint8_t *data, size_t len)
+{
+    static dm_cbor_reader_t r;
+    memset(t, 0, sizeof(*t));
+    dm_cbor_reader_init(&r, trace_event, t);
+    for (size_t i = 0; i < len; ++i) {
+        esp_err_t err = dm_cbor_reader_feed(&r, data + i, 1);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return dm_cbor_reader_finish(&r);
+}
+
+static void test_cbor_writer_encoding(void)
+{
+    static bytes_sink_t out;
+    static dm_json_writer_t w;
+    memset(&out, 0, sizeof(out));
+    dm_json_writer_init_cbor(&w, bytes_sink, &out);
+    dm_json_begin_object(&w);
+    dm_json_key(&w, "type");
+    dm_json_begin_array(&w);
+    dm_json_number(&w, 1000);
+    dm_json_number(&w, -2);
+    dm_json_number(&w, 0.5);
+    dm_json_number(&w, 1.1);
+    dm_json_bool(&w, true);
+    dm_json_string(&w, "ab");
+    dm_json_end_array(&w);
+    dm_json_key(&w, "zz");
+    dm_json_begin_object(&w);
+    dm_json_end_object(&w);
+    dm_json_end_object(&w);
+    TEST_ASSERT_EQUAL(ESP_OK, dm_json_writer_finish(&w));
+    static const uint8_t expected[] = {
+        0xBF, 0x00, 0x9F, 0x19, 0x03, 0xE8, 0x21, 0xFA, 0x3F, 0x00, 0x00, 0x00,
+        0xFB, 0x3F, 0xF1, 0x99, 0x99, 0x99, 0x99, 0x99, 0x9A, 0xF5, 0x62, 'a', 'b', 0xFF,
+        0x62, 'z', 'z', 0xBF, 0xFF, 0xFF,
+    };
+    TEST_ASSERT_EQUAL(sizeof(expected), out.len);
+    TEST_ASSERT_EQUAL_MEMORY(expected, out.data, sizeof(expected));
+
+    static trace_t t;
+    TEST_ASSERT_EQUAL(ESP_OK, trace_cbor(&t, out.data, out.len));
+    TEST_ASSERT_EQUAL_STRING("{k:type [n:1000 n:-2 n:0.5 n:1.1 true s:ab ]k:zz {}}", t.text);
+}
+
+// Encodings the writer never produces but other CBOR tools do.
+static void test_cbor_reader_foreign_forms(void)
+{
+    static const uint8_t doc[] = {
+        0xA4,                                   // map of 4
+        0x19, 0x01, 0xF4, 0xF9, 0x3C, 0x00,     // key 500 (unknown): half 1.0
+        0x00, 0xC1, 0x1A, 0x00, 0x00, 0x00, 0x05,   // "type": tag 1, uint32 5
+        0x63, 'a', 'b', 'c', 0x83, 0x01, 0x42, 0x01, 0x02, 0xA0,    // "abc": [1, h'0102', {}]
+        0x01, 0xF6,                             // "topic": null
+        0x20,                                   // second item of the sequence: -1
+    };
+    static trace_t t;
+    TEST_ASSERT_EQUAL(ESP_OK, trace_cbor(&t, doc, sizeof(doc)));
+    TEST_ASSERT_EQUAL_STRING("{k:#500 n:1 k:type n:5 k:abc [n:1 null {}]k:topic null }n:-1 ", t.text);
+
+    static const uint8_t truncated[] = {0xBF, 0x00, 0x63, 'a'};
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, trace_cbor(&t, truncated, sizeof(truncated)));
+    static const uint8_t stray_break[] = {0x01, 0xFF};
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, trace_cbor(&t, stray_break, sizeof(stray_break)));
+    static const uint8_t array_key[] = {0xA1, 0x80, 0x01};
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, trace_cbor(&t, array_key, sizeof(array_key)));
+    static const uint8_t reserved[] = {0x1C};
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, trace_cbor(&t, reserved, sizeof(reserved)));
+}
+
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+    size_t pos;
+} chunk_source_t;
+
+static esp_err_t chunk_source(void *ctx, char *buf, size_t cap, size_t *out_len)
+{
+    chunk_source_t *src = (chunk_source_t *)ctx;
+    size_t n = src->len - src->pos < 7 ? src->len - src->pos : 7;
+    memcpy(buf, src->data + src->pos, n);
+    src->pos += n;
+    *out_len = n;
+    return ESP_OK;
+}
+
+static esp_err_t import_bytes(const uint8_t *data, size_t len, dm_bulk_set_t *set)
+{
+    chunk_source_t src = {.data = data, .len = len};
+    return dm_bulk_import(chunk_source, &src, set);
+}
+
+static const char *const k_profiles[] = {
+    "{\"active_profile\":\"game\",\"profiles\":[{\"id\":\"game\",\"name\":\"Game\"},{\"id\":\"maint\"}],"
+    "\"devices\":[{\"id\":\"door\",\"display_name\":\"Lobby door\",\"topics\":[{\"name\":\"state\","
+    "\"topic\":\"room/door\"}],\"scenarios\":[{\"id\":\"open\",\"steps\":[{\"type\":\"delay\",\"delay_ms\":250}]}]}]}",
+    "{\"active_profile\":\"maint\",\"profiles\":[{\"id\":\"game\"},{\"id\":\"maint\",\"name\":\"Service\"}],"
+    "\"devices\":[]}",
+};
+
+static void test_bulk_roundtrip_and_checksum(void)
+{
+    device_manager_config_t *src[2];
+    char *json[2];
+    static bytes_sink_t out;
+    static dm_bulk_writer_t b;
+    memset(&out, 0, sizeof(out));
+    dm_bulk_writer_init(&b, bytes_sink, &out);
+    dm_bulk_write_header(&b, "maint", 2);
+    for (int i = 0; i < 2; ++i) {
+        src[i] = dm_config_create(0);
+        TEST_ASSERT_NOT_NULL(src[i]);
+        TEST_ASSERT_EQUAL(ESP_OK, dm_storage_parse_json(k_profiles[i], strlen(k_profiles[i]), src[i]));
+        TEST_ASSERT_EQUAL(ESP_OK, dm_storage_export_json(src[i], &json[i], NULL));
+        dm_storage_write_config(&b.w, src[i]);
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, dm_bulk_writer_finish(&b));
+    TEST_ASSERT_TRUE(out.len < strlen(json[0]) + strlen(json[1]));
+
+    dm_bulk_set_t set;
+    TEST_ASSERT_EQUAL(ESP_OK, import_bytes(out.data, out.len, &set));
+    TEST_ASSERT_EQUAL_UINT8(2, set.count);
+    TEST_ASSERT_EQUAL_STRING("maint", set.active_profile);
+    for (int i = 0; i < 2; ++i) {
+        char *back = NULL;
+        TEST_ASSERT_EQUAL(ESP_OK, dm_storage_export_json(set.profiles[i], &back, NULL));
+        TEST_ASSERT_EQUAL_STRING(json[i], back);
+        heap_caps_free(back);
+    }
+    dm_bulk_set_free(&set);
+    TEST_ASSERT_EQUAL_UINT8(0, set.count);
+
+    // A changed byte anywhere, even inside a string that still decodes, fails the checksum.
+    uint8_t *lobby = NULL;
+    for (size_t i = 0; i + 5 <= out.len && !lobby; ++i) {
+        lobby = memcmp(out.data + i, "Lobby", 5) == 0 ? out.data + i : NULL;
+    }
+    TEST_ASSERT_NOT_NULL(lobby);
+    lobby[0] = 'l';
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_CRC, import_bytes(out.data, out.len, &set));
+    TEST_ASSERT_EQUAL_UINT8(0, set.count);
+    lobby[0] = 'L';
+    // Cut short, the last document is still open when the bytes held back run out.
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, import_bytes(out.data, out.len - 1, &set));
+
+    // The header has to announce what follows.
+    memset(&out, 0, sizeof(out));
+    dm_bulk_writer_init(&b, bytes_sink, &out);
+    dm_bulk_write_header(&b, "game", 3);
+    dm_storage_write_config(&b.w, src[0]);
+    dm_storage_write_config(&b.w, src[1]);
+    TEST_ASSERT_EQUAL(ESP_OK, dm_bulk_writer_finish(&b));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, import_bytes(out.data, out.len, &set));
+
+    for (int i = 0; i < 2; ++i) {
+        heap_caps_free(json[i]);
+        dm_config_destroy(src[i]);
+    }
+}
+
+void register_cbor_tests(void)
+{
+    RUN_TEST(test_cbor_writer_encoding);
+    RUN_TEST(test_cbor_reader_foreign_forms);
+    RUN_TEST(test_bulk_roundtrip_and_checksum);
+}
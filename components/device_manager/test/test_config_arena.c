@@ -0,0 +1,163 @@
+#include "unity.h"
+#include "dm_config.h"
+#include "dm_config_arena.h"
+#include <string.h>
+
+static void test_config_arena_interns_strings(void)
+{
+    dm_config_arena_t *arena = dm_config_arena_create(64 * 1024);
+    TEST_ASSERT_NOT_NULL(arena);
+
+    char topic[32];
+    strcpy(topic, "room/door/cmd");
+    const char *a = dm_config_arena_intern(arena, topic, DEVICE_MANAGER_TOPIC_MAX_LEN);
+    // The caller's buffer is not referenced afterwards.
+    strcpy(topic, "room/door/xxx");
+    const char *b = dm_config_arena_intern(arena, "room/door/cmd", DEVICE_MANAGER_TOPIC_MAX_LEN);
+    TEST_ASSERT_EQUAL_STRING("room/door/cmd", a);
+    TEST_ASSERT_TRUE(a == b);
+    TEST_ASSERT_EQUAL_STRING("", dm_config_arena_intern(arena, NULL, 8));
+    TEST_ASSERT_TRUE(dm_config_arena_intern(arena, NULL, 8) == dm_config_arena_intern(arena, "", 8));
+    TEST_ASSERT_EQUAL_STRING("abc", dm_config_arena_intern(arena, "abcdef", 4));
+
+    dm_config_arena_stats_t stats;
+    dm_config_arena_get_stats(arena, &stats);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.strings);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.string_hits);
+    TEST_ASSERT_EQUAL(sizeof("room/door/cmd") + sizeof("abc"), stats.string_bytes);
+    dm_config_arena_destroy(arena);
+}
+
+static void test_config_arena_budget_and_grow(void)
+{
+    dm_config_arena_t *arena = dm_config_arena_create(16 * 1024);
+    TEST_ASSERT_NOT_NULL(arena);
+
+    uint8_t *block = dm_config_arena_alloc(arena, 100);
+    TEST_ASSERT_NOT_NULL(block);
+    memset(block, 0xAB, 100);
+    uint8_t *grown = dm_config_arena_grow(arena, block, 100, 300);
+    TEST_ASSERT_TRUE(grown == block);
+    TEST_ASSERT_EQUAL_HEX8(0xAB, grown[99]);
+    TEST_ASSERT_EACH_EQUAL_UINT8(0, grown + 100, 200);
+
+    // Something allocated after the block forces a copy.
+    TEST_ASSERT_NOT_NULL(dm_config_arena_alloc(arena, 8));
+    uint8_t *moved = dm_config_arena_grow(arena, grown, 300, 400);
+    TEST_ASSERT_NOT_NULL(moved);
+    TEST_ASSERT_TRUE(moved != grown);
+    TEST_ASSERT_EQUAL_HEX8(0xAB, moved[0]);
+
+    TEST_ASSERT_NULL(dm_config_arena_alloc(arena, 32 * 1024));
+    dm_config_arena_stats_t stats;
+    dm_config_arena_get_stats(arena, &stats);
+    TEST_ASSERT_LESS_OR_EQUAL(stats.budget, stats.reserved);
+    dm_config_arena_destroy(arena);
+}
+
+static void test_config_arena_sole_block_resize(void)
+{
+    dm_config_arena_t *arena = dm_config_arena_create(64 * 1024);
+    TEST_ASSERT_NOT_NULL(arena);
+    TEST_ASSERT_NOT_NULL(dm_config_arena_alloc(arena, 16));
+
+    // Blocks over a chunk get their own allocation, resized without a copy in the arena.
+    uint8_t *big = dm_config_arena_alloc(arena, 6000);
+    TEST_ASSERT_NOT_NULL(big);
+    memset(big, 0x5A, 6000);
+    dm_config_arena_stats_t before;
+    dm_config_arena_get_stats(arena, &before);
+    uint8_t *grown = dm_config_arena_grow(arena, big, 6000, 12000);
+    TEST_ASSERT_NOT_NULL(grown);
+    TEST_ASSERT_EACH_EQUAL_UINT8(0x5A, grown, 6000);
+    TEST_ASSERT_EACH_EQUAL_UINT8(0, grown + 6000, 6000);
+    dm_config_arena_stats_t after;
+    dm_config_arena_get_stats(arena, &after);
+    TEST_ASSERT_EQUAL(before.reserved + 6000, after.reserved);
+    TEST_ASSERT_EQUAL(before.used + 6000, after.used);
+
+    uint8_t *trimmed = dm_config_arena_shrink(arena, grown, 12000, 5000);
+    TEST_ASSERT_NOT_NULL(trimmed);
+    TEST_ASSERT_EACH_EQUAL_UINT8(0x5A, trimmed, 5000);
+    dm_config_arena_get_stats(arena, &after);
+    TEST_ASSERT_EQUAL(before.reserved - 1000, after.reserved);
+
+    // The tail of the current chunk is handed back in place.
+    uint8_t *small = dm_config_arena_alloc(arena, 256);
+    TEST_ASSERT_TRUE(dm_config_arena_shrink(arena, small, 256, 64) == small);
+    TEST_ASSERT_TRUE(dm_config_arena_alloc(arena, 8) == small + 64);
+    dm_config_arena_destroy(arena);
+}
+
+static void test_config_copy_is_deep(void)
+{
+    device_manager_config_t *src = dm_config_create(2);
+    device_manager_config_t *dst = dm_config_create(0);
+    TEST_ASSERT_NOT_NULL(src);
+    TEST_ASSERT_NOT_NULL(dst);
+    src->device_count = 2;
+    for (uint8_t i = 0; i < 2; ++i) {
+        device_descriptor_t *dev = &src->devices[i];
+        snprintf(dev->id, sizeof(dev->id), "dev_%u", i);
+        device_scenario_t *sc = dm_config_add_scenario(src, dev);
+        TEST_ASSERT_NOT_NULL(sc);
+        strcpy(sc->id, "go");
+        device_action_step_t *step = dm_config_add_step(src, sc);
+        TEST_ASSERT_NOT_NULL(step);
+        step->type = DEVICE_ACTION_EVENT_BUS;
+        step->data.event.event = "relay_cmd";
+        step->data.event.payload = i ? "on" : "off";
+        TEST_ASSERT_EQUAL(ESP_OK, dm_config_intern_step(src, step));
+        TEST_ASSERT_EQUAL_STRING("", step->data.event.topic);
+    }
+
+    TEST_ASSERT_EQUAL(ESP_OK, dm_config_copy(dst, src));
+    TEST_ASSERT_EQUAL_UINT8(2, dst->device_count);
+    TEST_ASSERT_TRUE(dst->arena != src->arena);
+    for (uint8_t i = 0; i < 2; ++i) {
+        TEST_ASSERT_TRUE(dst->devices[i].scenarios != src->devices[i].scenarios);
+        TEST_ASSERT_TRUE(dm_config_device_digest(&dst->devices[i], true) ==
+                         dm_config_device_digest(&src->devices[i], true));
+    }
+    // Same text, different generation.
+    const char *copied = dst->devices[0].scenarios[0].steps[0].data.event.event;
+    TEST_ASSERT_TRUE(copied != src->devices[0].scenarios[0].steps[0].data.event.event);
+    TEST_ASSERT_TRUE(copied == dst->devices[1].scenarios[0].steps[0].data.event.event);
+
+    // The digest follows content, not addresses.
+    uint64_t before = dm_config_device_digest(&src->devices[0], false);
+    src->devices[0].scenarios[0].steps[0].data.event.payload = dm_config_str(src, "on", DEVICE_MANAGER_PAYLOAD_MAX_LEN);
+    TEST_ASSERT_FALSE(before == dm_config_device_digest(&src->devices[0], false));
+
+    dm_config_destroy(src);
+    TEST_ASSERT_EQUAL_STRING("relay_cmd", copied);
+    dm_config_destroy(dst);
+}
+
+static void test_config_limits(void)
+{
+    device_manager_config_t *cfg = dm_config_create(1);
+    TEST_ASSERT_NOT_NULL(cfg);
+    device_descriptor_t *dev = &cfg->devices[0];
+    for (int i = 0; i < DEVICE_MANAGER_MAX_SCENARIOS_PER_DEVICE; ++i) {
+        TEST_ASSERT_NOT_NULL(dm_config_add_scenario(cfg, dev));
+    }
+    TEST_ASSERT_NULL(dm_config_add_scenario(cfg, dev));
+    for (int i = 0; i < DEVICE_MANAGER_MAX_STEPS_PER_SCENARIO; ++i) {
+        TEST_ASSERT_NOT_NULL(dm_config_add_step(cfg, &dev->scenarios[0]));
+    }
+    TEST_ASSERT_NULL(dm_config_add_step(cfg, &dev->scenarios[0]));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, dm_config_reserve_devices(cfg, DEVICE_MANAGER_MAX_DEVICES + 1));
+    TEST_ASSERT_EQUAL(ESP_OK, dm_config_reserve_devices(cfg, 4));
+    TEST_ASSERT_EQUAL_UINT8(DEVICE_MANAGER_MAX_SCENARIOS_PER_DEVICE, cfg->devices[0].scenario_count);
+    dm_config_destroy(cfg);
+}
+
+void register_config_arena_tests(void)
+{
+    RUN_TEST(test_config_arena_interns_strings);
+    RUN_TEST(test_config_arena_budget_and_grow);
+    RUN_TEST(test_config_arena_sole_block_resize);
+    RUN_TEST(test_config_copy_is_deep);
+    RUN_TEST(test_config_limits);
+}
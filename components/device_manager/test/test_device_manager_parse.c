@@ -0,0 +1,173 @@
+#include "unity.h"
+#include "device_manager_internal.h"
+#include "dm_config.h"
+#include "dm_storage.h"
+#include "esp_heap_caps.h"
+#include <string.h>
+
+typedef struct {
+    const char *data;
+    size_t len;
+    size_t pos;
+    size_t step;
+} chunk_source_t;
+
+static esp_err_t chunk_source(void *ctx, char *buf, size_t cap, size_t *out_len)
+{
+    chunk_source_t *src = (chunk_source_t *)ctx;
+    size_t n = src->len - src->pos;
+    if (n > src->step) {
+        n = src->step;
+    }
+    if (n > cap) {
+        n = cap;
+    }
+    memcpy(buf, src->data + src->pos, n);
+    src->pos += n;
+    *out_len = n;
+    return ESP_OK;
+}
+
+static esp_err_t parse_chunked(const char *json, size_t step, device_manager_config_t *cfg)
+{
+    chunk_source_t src = {.data = json, .len = strlen(json), .step = step};
+    return dm_storage_parse_stream(chunk_source, &src, cfg);
+}
+
+// Template sections before "type", fields in odd order and entries that must be dropped.
+static const char *k_room =
+    "{\"schema\":1,\"generation\":9,\"active_profile\":\"night\","
+    "\"profiles\":[{\"id\":\"night\",\"name\":\"Night\",\"device_count\":2},{\"id\":\"\"},3],"
+    "\"devices\":["
+    "{\"name\":\"Door\",\"id\":\"door\","
+    " \"topics\":[{\"name\":\"cmd\",\"topic\":\"room/door/cmd\","
+    "             \"limit\":{\"window_ms\":500,\"mode\":\"debounce\",\"edges\":\"trailing\"}}],"
+    " \"template\":{\"mqtt\":{\"rules\":["
+    "     {\"topic\":\"room/door/state\",\"payload\":\"open\",\"scenario\":\"alarm\"},"
+    "     {\"topic\":\"room/door/temp\",\"scenario\":\"alarm\",\"field\":\"t\",\"match\":\"range\",\"min\":\"21.5\",\"max\":30},"
+    "     {\"topic\":\"\",\"scenario\":\"lost\"},"
+    "     {\"topic\":\"room/door/x\",\"scenario\":\"alarm\",\"match\":\"nonsense\"}]},"
+    "   \"type\":\"on_mqtt_event\"},"
+    " \"scenarios\":[{\"id\":\"alarm\",\"priority\":\"high\",\"steps\":["
+    "     {\"topic\":\"room/siren\",\"type\":\"mqtt_publish\",\"payload\":\"on\",\"qos\":1,\"retain\":true},"
+    "     {\"type\":\"teleport\"},"
+    "     {\"type\":\"wait_flags\",\"wait\":{\"mode\":\"any\",\"timeout_ms\":3000,"
+    "         \"requirements\":[{\"flag\":\"a\"},{\"flag\":\"b\",\"state\":false},{\"state\":true}]}},"
+    "     {\"type\":\"loop\"},"
+    "     {\"type\":\"delay\",\"delay_ms\":-5},"
+    "     {\"type\":\"audio_play\",\"track\":\"alarm.mp3\",\"blocking\":true}]}]},"
+    "{\"id\":\"clock\",\"display_name\":\"Clock\",\"extra\":{\"nested\":[1,{\"a\":[]}]},"
+    " \"template\":{\"type\":\"interval_task\",\"uid\":{\"slots\":[{\"source_id\":\"x\"}]},"
+    "   \"interval\":{\"interval_ms\":60000,\"scenario\":\"tick\"}}},"
+    "{\"id\":\"broken\",\"template\":{\"type\":\"if_condition\",\"condition\":{\"rules\":[]}}}"
+    "]}";
+
+static void check_room(const device_manager_config_t *cfg)
+{
+    TEST_ASSERT_EQUAL_UINT32(9, cfg->generation);
+    TEST_ASSERT_EQUAL_STRING("night", cfg->active_profile);
+    TEST_ASSERT_EQUAL_UINT8(1, cfg->profile_count);
+    TEST_ASSERT_EQUAL_UINT8(3, cfg->device_count);
+    TEST_ASSERT_EQUAL_UINT8(3, cfg->device_capacity);
+
+    const device_descriptor_t *door = &cfg->devices[0];
+    TEST_ASSERT_EQUAL_STRING("Door", door->display_name);
+    TEST_ASSERT_EQUAL_UINT8(1, door->topic_count);
+    TEST_ASSERT_EQUAL_UINT32(500, door->topic_limits[0].window_ms);
+    TEST_ASSERT_TRUE(door->template_assigned);
+    TEST_ASSERT_EQUAL(DM_TEMPLATE_TYPE_MQTT_TRIGGER, door->template_config.type);
+    const dm_mqtt_trigger_template_t *mqtt = &door->template_config.data.mqtt;
+    TEST_ASSERT_EQUAL_UINT8(2, mqtt->rule_count);
+    TEST_ASSERT_TRUE(mqtt->rules[0].payload_required);
+    TEST_ASSERT_FALSE(mqtt->rules[1].payload_required);
+    TEST_ASSERT_TRUE(mqtt->matches[1].has_min);
+    TEST_ASSERT_EQUAL_FLOAT(21.5f, mqtt->matches[1].min);
+
+    TEST_ASSERT_EQUAL_UINT8(1, door->scenario_count);
+    const device_scenario_t *sc = &door->scenarios[0];
+    TEST_ASSERT_EQUAL_UINT8(DEVICE_SCENARIO_PRIORITY_HIGH, sc->priority);
+    // The unknown step and the loop without its object are skipped.
+    TEST_ASSERT_EQUAL_UINT8(4, sc->step_count);
+    TEST_ASSERT_EQUAL_STRING("room/siren", sc->steps[0].data.mqtt.topic);
+    TEST_ASSERT_TRUE(sc->steps[0].data.mqtt.retain);
+    TEST_ASSERT_EQUAL(DEVICE_ACTION_WAIT_FLAGS, sc->steps[1].type);
+    TEST_ASSERT_EQUAL(DEVICE_CONDITION_ANY, sc->steps[1].data.wait_flags.mode);
+    TEST_ASSERT_EQUAL_UINT8(2, sc->steps[1].data.wait_flags.requirement_count);
+    TEST_ASSERT_FALSE(sc->steps[1].data.wait_flags.requirements[1].required_state);
+    TEST_ASSERT_EQUAL_UINT32(0, sc->steps[2].delay_ms);
+    TEST_ASSERT_EQUAL_STRING("alarm.mp3", sc->steps[3].data.audio.track);
+
+    // A section of another type than the template's is ignored, wherever it stands.
+    const device_descriptor_t *clock = &cfg->devices[1];
+    TEST_ASSERT_EQUAL_STRING("Clock", clock->display_name);
+    TEST_ASSERT_TRUE(clock->template_assigned);
+    TEST_ASSERT_EQUAL_UINT32(60000, clock->template_config.data.interval.interval_ms);
+
+    TEST_ASSERT_EQUAL_STRING("broken", cfg->devices[2].display_name);
+    TEST_ASSERT_FALSE(cfg->devices[2].template_assigned);
+}
+
+static void test_parse_chunked_matches_whole(void)
+{
+    device_manager_config_t *whole = dm_config_create(0);
+    TEST_ASSERT_NOT_NULL(whole);
+    TEST_ASSERT_EQUAL(ESP_OK, dm_storage_parse_json(k_room, strlen(k_room), whole));
+    check_room(whole);
+    char *expected = NULL;
+    size_t expected_len = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, dm_storage_export_json(whole, &expected, &expected_len));
+
+    static const size_t steps[] = {1, 7, 64, 1024};
+    for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); ++i) {
+        device_manager_config_t *cfg = dm_config_create(0);
+        TEST_ASSERT_NOT_NULL(cfg);
+        TEST_ASSERT_EQUAL(ESP_OK, parse_chunked(k_room, steps[i], cfg));
+        check_room(cfg);
+        char *json = NULL;
+        size_t len = 0;
+        TEST_ASSERT_EQUAL(ESP_OK, dm_storage_export_json(cfg, &json, &len));
+        TEST_ASSERT_EQUAL(expected_len, len);
+        TEST_ASSERT_EQUAL_MEMORY(expected, json, len);
+        heap_caps_free(json);
+        dm_config_destroy(cfg);
+    }
+
+    // The exported text reads back to itself.
+    device_manager_config_t *again = dm_config_create(0);
+    TEST_ASSERT_EQUAL(ESP_OK, parse_chunked(expected, 100, again));
+    char *json = NULL;
+    size_t len = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, dm_storage_export_json(again, &json, &len));
+    TEST_ASSERT_EQUAL(expected_len, len);
+    TEST_ASSERT_EQUAL_MEMORY(expected, json, len);
+    heap_caps_free(json);
+    dm_config_destroy(again);
+    heap_caps_free(expected);
+    dm_config_destroy(whole);
+}
+
+static void test_parse_rejects_broken_documents(void)
+{
+    static const char *bad[] = {
+        "[]",
+        "{\"devices\":[{\"id\":\"a\"}]",
+        "{\"devices\":[{\"id\":\"a\",}]}",
+        "{\"schema\":1} trailing",
+    };
+    device_manager_config_t *cfg = dm_config_create(0);
+    TEST_ASSERT_NOT_NULL(cfg);
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i) {
+        TEST_ASSERT_EQUAL_MESSAGE(ESP_ERR_INVALID_ARG, parse_chunked(bad[i], 3, cfg), bad[i]);
+    }
+    // Without a devices array the config is empty but valid.
+    TEST_ASSERT_EQUAL(ESP_OK, parse_chunked("{\"schema\":1}", 3, cfg));
+    TEST_ASSERT_EQUAL_UINT8(0, cfg->device_count);
+    TEST_ASSERT_EQUAL_UINT8(1, cfg->profile_count);
+    dm_config_destroy(cfg);
+}
+
+void register_device_manager_parse_tests(void)
+{
+    RUN_TEST(test_parse_chunked_matches_whole);
+    RUN_TEST(test_parse_rejects_broken_documents);
+}
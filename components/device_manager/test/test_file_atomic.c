@@ -0,0 +1,106 @@
+#include "unity.h"
+#include "dm_file.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifndef DM_FILE_TEST_PATH
+#define DM_FILE_TEST_PATH "/sdcard/dm_file_test.bin"
+#endif
+
+#define DM_FILE_TEST_TMP DM_FILE_TEST_PATH ".tmp"
+#define DM_FILE_TEST_STAGED DM_FILE_TEST_PATH ".new"
+
+static size_t read_back(const char *path, char *buf, size_t len)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        return 0;
+    }
+    size_t got = fread(buf, 1, len, fp);
+    fclose(fp);
+    return got;
+}
+
+static void write_raw(const char *path, const char *text)
+{
+    FILE *fp = fopen(path, "wb");
+    TEST_ASSERT_NOT_NULL(fp);
+    fputs(text, fp);
+    fclose(fp);
+}
+
+static void test_file_write_atomic_replaces(void)
+{
+    FILE *probe = fopen(DM_FILE_TEST_PATH, "wb");
+    if (!probe) {
+        TEST_IGNORE_MESSAGE("no writable storage for the file fixture");
+    }
+    fclose(probe);
+
+    const dm_file_part_t parts[] = {
+        {.data = "head:", .len = 5},
+        {.data = NULL, .len = 0},
+        {.data = "body", .len = 4},
+    };
+    TEST_ASSERT_EQUAL(ESP_OK, dm_file_write_atomic(DM_FILE_TEST_PATH, parts, 3));
+    char buf[32] = {0};
+    TEST_ASSERT_EQUAL(9, read_back(DM_FILE_TEST_PATH, buf, sizeof(buf)));
+    TEST_ASSERT_EQUAL_STRING("head:body", buf);
+    TEST_ASSERT_NULL(fopen(DM_FILE_TEST_TMP, "rb"));
+
+    TEST_ASSERT_EQUAL(ESP_OK, dm_file_remove(DM_FILE_TEST_PATH));
+    TEST_ASSERT_NULL(fopen(DM_FILE_TEST_PATH, "rb"));
+    TEST_ASSERT_EQUAL(ESP_OK, dm_file_remove(DM_FILE_TEST_PATH));
+}
+
+static void test_file_recover_after_cut_write(void)
+{
+    char buf[32] = {0};
+    // Cut between unlinking the old file and the rename: the temp file is the only copy.
+    write_raw(DM_FILE_TEST_TMP, "new");
+    dm_file_recover(DM_FILE_TEST_PATH);
+    TEST_ASSERT_EQUAL(3, read_back(DM_FILE_TEST_PATH, buf, sizeof(buf)));
+    TEST_ASSERT_EQUAL_STRING("new", buf);
+    TEST_ASSERT_NULL(fopen(DM_FILE_TEST_TMP, "rb"));
+
+    // Cut while the temp file was written: the old file wins.
+    write_raw(DM_FILE_TEST_TMP, "partial");
+    dm_file_recover(DM_FILE_TEST_PATH);
+    memset(buf, 0, sizeof(buf));
+    TEST_ASSERT_EQUAL(3, read_back(DM_FILE_TEST_PATH, buf, sizeof(buf)));
+    TEST_ASSERT_EQUAL_STRING("new", buf);
+    TEST_ASSERT_NULL(fopen(DM_FILE_TEST_TMP, "rb"));
+    dm_file_remove(DM_FILE_TEST_PATH);
+}
+
+// A staged file leaves the current one alone until it is promoted.
+static void test_file_stage_promote(void)
+{
+    char buf[32] = {0};
+    write_raw(DM_FILE_TEST_PATH, "old");
+    const dm_file_part_t part = {.data = "staged", .len = 6};
+    TEST_ASSERT_EQUAL(ESP_OK, dm_file_stage(DM_FILE_TEST_PATH, &part, 1));
+    TEST_ASSERT_EQUAL(3, read_back(DM_FILE_TEST_PATH, buf, sizeof(buf)));
+    TEST_ASSERT_EQUAL_STRING("old", buf);
+
+    dm_file_unstage(DM_FILE_TEST_PATH);
+    TEST_ASSERT_NULL(fopen(DM_FILE_TEST_STAGED, "rb"));
+    TEST_ASSERT_NOT_EQUAL(ESP_OK, dm_file_promote(DM_FILE_TEST_PATH));
+    TEST_ASSERT_EQUAL(3, read_back(DM_FILE_TEST_PATH, buf, sizeof(buf)));
+
+    TEST_ASSERT_EQUAL(ESP_OK, dm_file_stage(DM_FILE_TEST_PATH, &part, 1));
+    TEST_ASSERT_EQUAL(ESP_OK, dm_file_promote(DM_FILE_TEST_PATH));
+    memset(buf, 0, sizeof(buf));
+    TEST_ASSERT_EQUAL(6, read_back(DM_FILE_TEST_PATH, buf, sizeof(buf)));
+    TEST_ASSERT_EQUAL_STRING("staged", buf);
+    TEST_ASSERT_NULL(fopen(DM_FILE_TEST_STAGED, "rb"));
+    TEST_ASSERT_NULL(fopen(DM_FILE_TEST_TMP, "rb"));
+    dm_file_remove(DM_FILE_TEST_PATH);
+}
+
+void register_file_atomic_tests(void)
+{
+    RUN_TEST(test_file_write_atomic_replaces);
+    RUN_TEST(test_file_recover_after_cut_write);
+    RUN_TEST(test_file_stage_promote);
+}
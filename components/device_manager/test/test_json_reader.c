@@ -0,0 +1,128 @@
+#include "unity.h"
+#include "dm_json_reader.h"
+#include <stdio.h>
+#include <string.h>
+
+// Events written back as compact text, so a whole document is checked in one compare.
+typedef struct {
+    char text[1024];
+    size_t len;
+    size_t fail_at;         // 0: never
+    size_t events;
+} trace_t;
+
+static void trace_put(trace_t *t, const char *fmt, const char *s, double n)
+{
+    int w = snprintf(t->text + t->len, sizeof(t->text) - t->len, fmt, s ? s : "", n);
+    TEST_ASSERT_TRUE(w >= 0 && t->len + (size_t)w < sizeof(t->text));
+    t->len += (size_t)w;
+}
+
+static esp_err_t trace_event(void *ctx, dm_json_event_t event, const dm_json_value_t *value)
+{
+    trace_t *t = (trace_t *)ctx;
+    if (t->fail_at && ++t->events >= t->fail_at) {
+        return ESP_ERR_NO_MEM;
+    }
+    switch (event) {
+    case DM_JSON_EVENT_OBJECT_BEGIN: trace_put(t, "{%s", NULL, 0); break;
+    case DM_JSON_EVENT_OBJECT_END: trace_put(t, "}%s", NULL, 0); break;
+    case DM_JSON_EVENT_ARRAY_BEGIN: trace_put(t, "[%s", NULL, 0); break;
+    case DM_JSON_EVENT_ARRAY_END: trace_put(t, "]%s", NULL, 0); break;
+    case DM_JSON_EVENT_KEY: trace_put(t, "k:%s ", value->str, 0); break;
+    case DM_JSON_EVENT_STRING: trace_put(t, "s:%s ", value->str, 0); break;
+    case DM_JSON_EVENT_NUMBER: trace_put(t, "%sn:%g ", NULL, value->number); break;
+    case DM_JSON_EVENT_BOOL: trace_put(t, value->boolean ? "true%s " : "false%s ", NULL, 0); break;
+    case DM_JSON_EVENT_NULL: trace_put(t, "null%s ", NULL, 0); break;
+    }
+    return ESP_OK;
+}
+
+// Feeds `doc` in pieces of `step` bytes (0: all at once).
+static esp_err_t read_doc(trace_t *t, const char *doc, size_t step)
+{
+    static dm_json_reader_t r;
+    dm_json_reader_init(&r, trace_event, t);
+    size_t len = strlen(doc);
+    size_t pos = 0;
+    while (pos < len) {
+        size_t n = step && len - pos > step ? step : len - pos;
+        esp_err_t err = dm_json_reader_feed(&r, doc + pos, n);
+        if (err != ESP_OK) {
+            return err;
+        }
+        pos += n;
+    }
+    return dm_json_reader_finish(&r);
+}
+
+static const char *k_doc =
+    " {\"a\": [1, -2.5e1, 0.125, true, false, null],\n"
+    "  \"s\": \"x\\\"y\\\\z\\/\\n\\u00e9\\ud83d\\ude00\", \"o\": {}, \"e\": []} ";
+
+static const char *k_trace =
+    "{k:a [n:1 n:-25 n:0.125 true false null ]"
+    "k:s s:x\"y\\z/\n\xc3\xa9\xf0\x9f\x98\x80 k:o {}k:e []}";
+
+static void test_json_reader_events(void)
+{
+    static trace_t t;
+    memset(&t, 0, sizeof(t));
+    TEST_ASSERT_EQUAL(ESP_OK, read_doc(&t, k_doc, 0));
+    TEST_ASSERT_EQUAL_STRING(k_trace, t.text);
+
+    // Split points inside tokens, escapes and \u sequences change nothing.
+    memset(&t, 0, sizeof(t));
+    TEST_ASSERT_EQUAL(ESP_OK, read_doc(&t, k_doc, 1));
+    TEST_ASSERT_EQUAL_STRING(k_trace, t.text);
+
+    memset(&t, 0, sizeof(t));
+    TEST_ASSERT_EQUAL(ESP_OK, read_doc(&t, "42", 1));
+    TEST_ASSERT_EQUAL_STRING("n:42 ", t.text);
+}
+
+static void test_json_reader_long_string_is_cut(void)
+{
+    static char doc[DM_JSON_READER_TOKEN_MAX * 2 + 8];
+    static trace_t t;
+    memset(&t, 0, sizeof(t));
+    doc[0] = '[';
+    doc[1] = '"';
+    memset(doc + 2, 'q', DM_JSON_READER_TOKEN_MAX * 2);
+    strcpy(doc + 2 + DM_JSON_READER_TOKEN_MAX * 2, "\",7]");
+    TEST_ASSERT_EQUAL(ESP_OK, read_doc(&t, doc, 100));
+    TEST_ASSERT_EQUAL(1 + 2 + DM_JSON_READER_TOKEN_MAX - 1 + 1 + 5, t.len);
+    TEST_ASSERT_EQUAL_STRING("n:7 ]", t.text + t.len - 5);
+}
+
+static void test_json_reader_rejects_bad_input(void)
+{
+    static const char *bad[] = {
+        "", "{", "{\"a\" 1}", "{\"a\":1,}", "[1 2]", "[1,]", "{1:2}", "tru", "[01x]",
+        "\"\\q\"", "\"\\u12g4\"", "{} {}", "[1]]", "\"open",
+    };
+    static trace_t t;
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i) {
+        memset(&t, 0, sizeof(t));
+        TEST_ASSERT_EQUAL_MESSAGE(ESP_ERR_INVALID_ARG, read_doc(&t, bad[i], 1), bad[i]);
+    }
+
+    char deep[DM_JSON_READER_MAX_DEPTH + 2];
+    memset(deep, '[', sizeof(deep) - 1);
+    deep[sizeof(deep) - 1] = '\0';
+    memset(&t, 0, sizeof(t));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, read_doc(&t, deep, 0));
+
+    // A callback error stops the reader and is what every later call reports.
+    memset(&t, 0, sizeof(t));
+    t.fail_at = 3;
+    TEST_ASSERT_EQUAL(ESP_ERR_NO_MEM, read_doc(&t, k_doc, 4));
+    TEST_ASSERT_EQUAL_STRING("{k:a ", t.text);
+}
+
+void register_json_reader_tests(void)
+{
+    RUN_TEST(test_json_reader_events);
+    RUN_TEST(test_json_reader_long_string_is_cut);
+    RUN_TEST(test_json_reader_rejects_bad_input);
+}
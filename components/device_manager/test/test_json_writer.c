@@ -0,0 +1,118 @@
+#include "unity.h"
+#include "dm_json_writer.h"
+#include "esp_heap_caps.h"
+#include <string.h>
+
+typedef struct {
+    char text[2048];
+    size_t len;
+    size_t calls;
+    size_t fail_after;      // 0: never
+} capture_sink_t;
+
+static esp_err_t capture(void *ctx, const char *data, size_t len)
+{
+    capture_sink_t *out = (capture_sink_t *)ctx;
+    out->calls++;
+    if (out->fail_after && out->calls > out->fail_after) {
+        return ESP_FAIL;
+    }
+    TEST_ASSERT_TRUE(out->len + len < sizeof(out->text));
+    memcpy(out->text + out->len, data, len);
+    out->len += len;
+    out->text[out->len] = '\0';
+    return ESP_OK;
+}
+
+static void test_json_writer_document(void)
+{
+    static capture_sink_t out;
+    static dm_json_writer_t w;
+    memset(&out, 0, sizeof(out));
+    dm_json_writer_init(&w, capture, &out);
+    dm_json_begin_object(&w);
+    dm_json_kv_number(&w, "schema", 5);
+    dm_json_kv_number(&w, "min", -2.5);
+    dm_json_kv_number(&w, "big", 4294967295.0);
+    dm_json_kv_number(&w, "third", 1.0 / 3.0);
+    dm_json_kv_string(&w, "esc", "a\"b\\c\n\x01");
+    dm_json_kv_string(&w, "null", NULL);
+    dm_json_key(&w, "list");
+    dm_json_begin_array(&w);
+    dm_json_bool(&w, true);
+    dm_json_begin_object(&w);
+    dm_json_end_object(&w);
+    dm_json_begin_array(&w);
+    dm_json_end_array(&w);
+    dm_json_string(&w, "x");
+    dm_json_end_array(&w);
+    dm_json_end_object(&w);
+    TEST_ASSERT_EQUAL(ESP_OK, dm_json_writer_finish(&w));
+    TEST_ASSERT_EQUAL_STRING("{\"schema\":5,\"min\":-2.5,\"big\":4294967295,\"third\":0.33333333333333331,"
+                             "\"esc\":\"a\\\"b\\\\c\\n\\u0001\",\"null\":\"\","
+                             "\"list\":[true,{},[],\"x\"]}",
+                             out.text);
+    TEST_ASSERT_EQUAL(out.len, w.total);
+}
+
+static void test_json_writer_chunks_and_errors(void)
+{
+    static capture_sink_t out;
+    static dm_json_writer_t w;
+    char value[200];
+    memset(value, 'v', sizeof(value) - 1);
+    value[sizeof(value) - 1] = '\0';
+
+    memset(&out, 0, sizeof(out));
+    dm_json_writer_init(&w, capture, &out);
+    dm_json_begin_array(&w);
+    for (int i = 0; i < 8; ++i) {
+        dm_json_string(&w, value);
+    }
+    dm_json_end_array(&w);
+    TEST_ASSERT_EQUAL(ESP_OK, dm_json_writer_finish(&w));
+    TEST_ASSERT_EQUAL(2 + 8 * 201 + 7, out.len);
+    // Full buffers go out as they fill, the rest on finish.
+    TEST_ASSERT_EQUAL((out.len + DM_JSON_WRITER_BUF_SIZE - 1) / DM_JSON_WRITER_BUF_SIZE, out.calls);
+
+    // A failing sink stops the writer for good.
+    memset(&out, 0, sizeof(out));
+    out.fail_after = 1;
+    dm_json_writer_init(&w, capture, &out);
+    dm_json_begin_array(&w);
+    for (int i = 0; i < 8; ++i) {
+        dm_json_string(&w, value);
+    }
+    dm_json_end_array(&w);
+    TEST_ASSERT_EQUAL(ESP_FAIL, dm_json_writer_finish(&w));
+    TEST_ASSERT_EQUAL(2, out.calls);
+    TEST_ASSERT_EQUAL(DM_JSON_WRITER_BUF_SIZE, out.len);
+
+    // Unbalanced nesting is reported.
+    memset(&out, 0, sizeof(out));
+    dm_json_writer_init(&w, capture, &out);
+    dm_json_begin_object(&w);
+    dm_json_key(&w, "open");
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, dm_json_writer_finish(&w));
+}
+
+static void test_json_buffer_sink(void)
+{
+    dm_json_buffer_t buf = {0};
+    char part[3000];
+    memset(part, 'p', sizeof(part));
+    TEST_ASSERT_EQUAL(ESP_OK, dm_json_buffer_sink(&buf, "{", 1));
+    TEST_ASSERT_EQUAL(ESP_OK, dm_json_buffer_sink(&buf, part, sizeof(part)));
+    TEST_ASSERT_EQUAL(ESP_OK, dm_json_buffer_sink(&buf, part, sizeof(part)));
+    TEST_ASSERT_EQUAL(1 + 2 * sizeof(part), buf.len);
+    TEST_ASSERT_EQUAL('{', buf.data[0]);
+    TEST_ASSERT_EQUAL('\0', buf.data[buf.len]);
+    heap_caps_free(buf.data);
+}
+
+void register_json_writer_tests(void)
+{
+    RUN_TEST(test_json_writer_document);
+    RUN_TEST(test_json_writer_chunks_and_errors);
+    RUN_TEST(test_json_buffer_sink);
+}
@@ -0,0 +1,134 @@
+#include "unity.h"
+#include "dm_payload_match.h"
+#include "dm_runtime_mqtt.h"
+#include "esp_timer.h"
+#include <stdio.h>
+#include <string.h>
+
+#define PAYLOAD_BENCH_RUNS 20000
+
+static bool rule_matches(const char *payload_op, const char *field, uint8_t op, const char *payload)
+{
+    dm_mqtt_trigger_rule_t rule = {0};
+    dm_mqtt_rule_match_t match = {0};
+    strcpy(rule.payload, payload_op);
+    rule.payload_required = payload_op[0] != 0;
+    strcpy(match.field, field);
+    match.op = op;
+    dm_payload_program_t prog;
+    TEST_ASSERT_EQUAL(ESP_OK, dm_payload_program_compile(&prog, &rule, &match));
+    return dm_payload_program_run(&prog, payload);
+}
+
+static bool range_matches(const char *field, bool has_min, float min, bool has_max, float max, const char *payload)
+{
+    dm_mqtt_trigger_rule_t rule = {0};
+    dm_mqtt_rule_match_t match = {.op = DM_MQTT_MATCH_RANGE, .has_min = has_min, .has_max = has_max,
+                                  .min = min, .max = max};
+    strcpy(match.field, field);
+    dm_payload_program_t prog;
+    TEST_ASSERT_EQUAL(ESP_OK, dm_payload_program_compile(&prog, &rule, &match));
+    return dm_payload_program_run(&prog, payload);
+}
+
+static void test_payload_match_string_ops(void)
+{
+    // Plain EXACT keeps the old rule semantics.
+    TEST_ASSERT_TRUE(rule_matches("open", "", DM_MQTT_MATCH_EXACT, "open"));
+    TEST_ASSERT_FALSE(rule_matches("open", "", DM_MQTT_MATCH_EXACT, "open "));
+    TEST_ASSERT_TRUE(rule_matches("", "", DM_MQTT_MATCH_EXACT, "anything"));
+    TEST_ASSERT_TRUE(rule_matches("card:", "", DM_MQTT_MATCH_PREFIX, "card:04AA"));
+    TEST_ASSERT_FALSE(rule_matches("card:", "", DM_MQTT_MATCH_PREFIX, "car"));
+    TEST_ASSERT_TRUE(rule_matches("err", "", DM_MQTT_MATCH_CONTAINS, "motor err 4"));
+    TEST_ASSERT_FALSE(rule_matches("err", "", DM_MQTT_MATCH_CONTAINS, "motor ok"));
+    TEST_ASSERT_TRUE(rule_matches("ON", "", DM_MQTT_MATCH_EQUALS_NOCASE, "on"));
+    TEST_ASSERT_FALSE(rule_matches("ON", "", DM_MQTT_MATCH_EQUALS_NOCASE, "one"));
+}
+
+static void test_payload_match_json_fields(void)
+{
+    const char *msg = "{\"id\":\"door\",\"pos\":{\"x\":12.5,\"tags\":[\"a\",\"b,c\"]},\"state\":\"Open\"}";
+    TEST_ASSERT_TRUE(rule_matches("door", "id", DM_MQTT_MATCH_EXACT, msg));
+    TEST_ASSERT_TRUE(rule_matches("open", "state", DM_MQTT_MATCH_EQUALS_NOCASE, msg));
+    TEST_ASSERT_TRUE(rule_matches("b,c", "pos.tags[1]", DM_MQTT_MATCH_EXACT, msg));
+    TEST_ASSERT_FALSE(rule_matches("a", "pos.tags[2]", DM_MQTT_MATCH_EXACT, msg));
+    TEST_ASSERT_FALSE(rule_matches("door", "missing", DM_MQTT_MATCH_EXACT, msg));
+    // A field path without payload only asks for the field.
+    TEST_ASSERT_TRUE(rule_matches("", "pos.x", DM_MQTT_MATCH_EXACT, msg));
+    TEST_ASSERT_FALSE(rule_matches("", "pos.y", DM_MQTT_MATCH_EXACT, msg));
+    TEST_ASSERT_FALSE(rule_matches("door", "id", DM_MQTT_MATCH_EXACT, "not json"));
+    // The scanner stops once the field is found, so only what precedes it has to be well formed.
+    TEST_ASSERT_FALSE(rule_matches("door", "id", DM_MQTT_MATCH_EXACT, "{\"id\":\"door"));
+    TEST_ASSERT_FALSE(rule_matches("door", "id", DM_MQTT_MATCH_EXACT, "{\"x\":[1,\"id\":\"door\"}"));
+
+    TEST_ASSERT_TRUE(range_matches("dist", true, 40, true, 50, "{\"dist\":42}"));
+    TEST_ASSERT_TRUE(range_matches("dist", true, 40, true, 50, "{ \"dist\" : \"50\" }"));
+    TEST_ASSERT_FALSE(range_matches("dist", true, 40, true, 50, "{\"dist\":50.5}"));
+    TEST_ASSERT_FALSE(range_matches("dist", true, 40, false, 0, "{\"dist\":\"far\"}"));
+    TEST_ASSERT_TRUE(range_matches("pos.x", false, 0, true, 20, "{\"pos\":{\"x\":-3}}"));
+    TEST_ASSERT_TRUE(range_matches("", true, 18, true, 26, "21.5"));
+    TEST_ASSERT_FALSE(range_matches("", false, 0, false, 0, "21.5C"));
+}
+
+static void test_payload_match_rejects_bad_paths(void)
+{
+    dm_mqtt_trigger_rule_t rule = {0};
+    dm_mqtt_rule_match_t match = {0};
+    dm_payload_program_t prog;
+    const char *bad[] = {"a..b", "a.", "[x]", "a[1", "a[1]b", "a.b.c.d.e"};
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i) {
+        strcpy(match.field, bad[i]);
+        TEST_ASSERT_EQUAL_MESSAGE(ESP_ERR_INVALID_ARG, dm_payload_program_compile(&prog, &rule, &match), bad[i]);
+        TEST_ASSERT_FALSE(dm_payload_program_run(&prog, "{}"));
+    }
+    match.field[0] = 0;
+    match.op = DM_MQTT_MATCH_COUNT;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, dm_payload_program_compile(&prog, &rule, &match));
+}
+
+// First matching rule wins; compiled once at init, evaluated without allocating.
+static void test_payload_match_runtime_rules(void)
+{
+    static dm_mqtt_trigger_template_t tpl;
+    dm_mqtt_trigger_template_clear(&tpl);
+    tpl.rule_count = 3;
+    for (int i = 0; i < 3; ++i) {
+        strcpy(tpl.rules[i].topic, "lab/laser");
+        snprintf(tpl.rules[i].scenario, sizeof(tpl.rules[i].scenario), "s%d", i);
+    }
+    tpl.matches[0] = (dm_mqtt_rule_match_t){.op = DM_MQTT_MATCH_RANGE, .has_max = true, .max = 10};
+    strcpy(tpl.matches[0].field, "dist");
+    tpl.matches[1] = (dm_mqtt_rule_match_t){.op = DM_MQTT_MATCH_RANGE, .has_min = true, .min = 10};
+    strcpy(tpl.matches[1].field, "dist");
+    strcpy(tpl.rules[2].payload, "reset");
+    tpl.rules[2].payload_required = true;
+
+    static dm_mqtt_trigger_runtime_t rt;
+    dm_mqtt_trigger_runtime_init(&rt, &tpl);
+    TEST_ASSERT_EQUAL_PTR(&tpl.rules[0], dm_mqtt_trigger_runtime_match(&rt, "lab/laser", "{\"dist\":4}"));
+    TEST_ASSERT_EQUAL_PTR(&tpl.rules[1], dm_mqtt_trigger_runtime_match(&rt, "lab/laser", "{\"dist\":42}"));
+    TEST_ASSERT_EQUAL_PTR(&tpl.rules[2], dm_mqtt_trigger_runtime_match(&rt, "lab/laser", "reset"));
+    TEST_ASSERT_NULL(dm_mqtt_trigger_runtime_match(&rt, "lab/laser", "{\"range\":4}"));
+    TEST_ASSERT_NULL(dm_mqtt_trigger_runtime_match(&rt, "lab/other", "{\"dist\":4}"));
+
+    const char *payload = "{\"id\":\"sensor-7\",\"battery\":88,\"dist\":42,\"ts\":1712000000}";
+    int hits = 0;
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < PAYLOAD_BENCH_RUNS; ++i) {
+        hits += dm_mqtt_trigger_runtime_match(&rt, "lab/laser", payload) == &tpl.rules[1];
+    }
+    int64_t elapsed = esp_timer_get_time() - start;
+    TEST_ASSERT_EQUAL(PAYLOAD_BENCH_RUNS, hits);
+    printf("payload match: %d JSON evaluations in %lld us (%.2f us each)\n",
+           PAYLOAD_BENCH_RUNS,
+           (long long)elapsed,
+           (double)elapsed / PAYLOAD_BENCH_RUNS);
+}
+
+void register_payload_match_tests(void)
+{
+    RUN_TEST(test_payload_match_string_ops);
+    RUN_TEST(test_payload_match_json_fields);
+    RUN_TEST(test_payload_match_rejects_bad_paths);
+    RUN_TEST(test_payload_match_runtime_rules);
+}
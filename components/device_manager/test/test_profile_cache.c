@@ -0,0 +1,113 @@
+#include "unity.h"
+#include "dm_config.h"
+#include "dm_profile_cache.h"
+#include <stdio.h>
+#include <string.h>
+
+static unsigned s_released;
+
+static void release_generation(const device_manager_config_t *cfg)
+{
+    device_manager_config_t *owned = (device_manager_config_t *)cfg;
+    if (--owned->refs == 0) {
+        dm_config_destroy(owned);
+    }
+    s_released++;
+}
+
+static device_manager_config_t *make_generation(const char *profile, uint8_t devices)
+{
+    device_manager_config_t *cfg = dm_config_create(devices);
+    TEST_ASSERT_NOT_NULL(cfg);
+    cfg->device_count = devices;
+    for (uint8_t i = 0; i < devices; ++i) {
+        snprintf(cfg->devices[i].id, sizeof(cfg->devices[i].id), "%s_%u", profile, i);
+    }
+    strcpy(cfg->active_profile, profile);
+    cfg->refs = 1;
+    return cfg;
+}
+
+static size_t generation_bytes(const device_manager_config_t *cfg)
+{
+    dm_config_arena_stats_t stats;
+    dm_config_arena_get_stats(cfg->arena, &stats);
+    return sizeof(*cfg) + stats.reserved;
+}
+
+static void test_profile_cache_hits_and_lru(void)
+{
+    device_manager_config_t *game = make_generation("game", 4);
+    device_manager_config_t *maint = make_generation("maint", 4);
+    device_manager_config_t *demo = make_generation("demo", 4);
+    size_t each = generation_bytes(game);
+    s_released = 0;
+    // Room for two of the three.
+    dm_profile_cache_init(each * 2 + each / 2, release_generation);
+    device_manager_profile_cache_status_t before;
+    dm_profile_cache_get_status(&before);
+
+    dm_profile_cache_put(game);
+    dm_profile_cache_put(maint);
+    TEST_ASSERT_NULL(dm_profile_cache_take("lobby"));
+    device_manager_config_t *back = dm_profile_cache_take("GAME");
+    TEST_ASSERT_EQUAL_PTR(game, back);
+    TEST_ASSERT_EQUAL_STRING("game_3", back->devices[3].id);
+    TEST_ASSERT_NULL(dm_profile_cache_take("game"));
+    dm_profile_cache_put(back);
+
+    // maint was kept longest ago, so it makes room for demo.
+    dm_profile_cache_put(demo);
+    TEST_ASSERT_EQUAL(1, s_released);
+    device_manager_profile_cache_status_t st;
+    dm_profile_cache_get_status(&st);
+    TEST_ASSERT_EQUAL_UINT8(2, st.entries);
+    TEST_ASSERT_EQUAL(each * 2, st.bytes);
+    TEST_ASSERT_EQUAL_UINT32(before.hits + 1, st.hits);
+    TEST_ASSERT_EQUAL_UINT32(before.misses + 2, st.misses);
+    TEST_ASSERT_EQUAL_UINT32(before.evictions + 1, st.evictions);
+    TEST_ASSERT_NULL(dm_profile_cache_take("maint"));
+
+    dm_profile_cache_drop("demo");
+    TEST_ASSERT_EQUAL(2, s_released);
+    dm_profile_cache_clear();
+    TEST_ASSERT_EQUAL(3, s_released);
+    dm_profile_cache_get_status(&st);
+    TEST_ASSERT_EQUAL_UINT8(0, st.entries);
+    TEST_ASSERT_EQUAL(0, st.bytes);
+}
+
+static void test_profile_cache_budget_and_switch_times(void)
+{
+    s_released = 0;
+    dm_profile_cache_init(0, release_generation);
+    // A reader still holds this one; the cache only drops its own reference.
+    device_manager_config_t *held = make_generation("game", 2);
+    held->refs = 2;
+    dm_profile_cache_put(held);
+    TEST_ASSERT_EQUAL(1, s_released);
+    TEST_ASSERT_EQUAL_UINT32(1, held->refs);
+    release_generation(held);
+
+    device_manager_profile_cache_status_t before;
+    dm_profile_cache_get_status(&before);
+    dm_profile_cache_note_switch(300, true);
+    dm_profile_cache_note_switch(100, true);
+    dm_profile_cache_note_switch(9000, false);
+    device_manager_profile_cache_status_t st;
+    dm_profile_cache_get_status(&st);
+    TEST_ASSERT_EQUAL_UINT32(before.switches + 3, st.switches);
+    TEST_ASSERT_EQUAL_UINT32(9000, st.last_switch_us);
+    TEST_ASSERT_FALSE(st.last_switch_cached);
+    if (before.switches == 0) {
+        TEST_ASSERT_EQUAL_UINT32(200, st.hit_avg_us);
+        TEST_ASSERT_EQUAL_UINT32(9000, st.miss_avg_us);
+    }
+    dm_profile_cache_init(DM_PROFILE_CACHE_BUDGET_BYTES, release_generation);
+}
+
+void register_profile_cache_tests(void)
+{
+    RUN_TEST(test_profile_cache_hits_and_lru);
+    RUN_TEST(test_profile_cache_budget_and_switch_times);
+}
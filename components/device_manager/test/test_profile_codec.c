@@ -0,0 +1,178 @@
+#include "unity.h"
+#include "dm_profile_codec.h"
+#include "dm_config.h"
+#include "esp_heap_caps.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Built field by field into a fresh config, so unused slots and string tails are zero
+// exactly like the parser leaves them.
+static device_manager_config_t *build_config(uint8_t count)
+{
+    device_manager_config_t *cfg = dm_config_create(count);
+    TEST_ASSERT_NOT_NULL(cfg);
+    cfg->device_count = count;
+    for (uint8_t i = 0; i < count; ++i) {
+        device_descriptor_t *dev = &cfg->devices[i];
+        snprintf(dev->id, sizeof(dev->id), "dev_%u", i);
+        snprintf(dev->display_name, sizeof(dev->display_name), "Device %u", i);
+        dev->topic_count = 2;
+        strcpy(dev->topics[0].name, "state");
+        snprintf(dev->topics[0].topic, sizeof(dev->topics[0].topic), "room/dev_%u/state", i);
+        strcpy(dev->topics[1].name, "cmd");
+        snprintf(dev->topics[1].topic, sizeof(dev->topics[1].topic), "room/dev_%u/cmd", i);
+        dev->topic_limits[1].mode = DM_RATE_MODE_DEBOUNCE;
+        dev->topic_limits[1].window_ms = 250;
+
+        device_scenario_t *sc = dm_config_add_scenario(cfg, dev);
+        TEST_ASSERT_NOT_NULL(sc);
+        strcpy(sc->id, "open");
+        strcpy(sc->name, "Open door");
+        sc->button_enabled = true;
+        strcpy(sc->button_label, "Open");
+        sc->priority = DEVICE_SCENARIO_PRIORITY_HIGH;
+        sc->concurrency = DEVICE_SCENARIO_CONCURRENCY_DROP;
+        sc->steps = dm_config_alloc_steps(cfg, 3);
+        TEST_ASSERT_NOT_NULL(sc->steps);
+        sc->step_count = 3;
+        sc->steps[0].type = DEVICE_ACTION_MQTT_PUBLISH;
+        sc->steps[0].data.mqtt.topic = "room/door/cmd";
+        sc->steps[0].data.mqtt.payload = "open";
+        sc->steps[0].data.mqtt.qos = 1;
+        sc->steps[1].type = DEVICE_ACTION_DELAY;
+        sc->steps[1].delay_ms = 1500;
+        sc->steps[2].type = DEVICE_ACTION_AUDIO_PLAY;
+        sc->steps[2].data.audio.track = "/sdcard/door.mp3";
+        for (uint8_t s = 0; s < sc->step_count; ++s) {
+            TEST_ASSERT_EQUAL(ESP_OK, dm_config_intern_step(cfg, &sc->steps[s]));
+        }
+
+        if (i & 1) {
+            dev->template_assigned = true;
+            dev->template_config.type = DM_TEMPLATE_TYPE_UID;
+            dm_uid_template_t *uid = &dev->template_config.data.uid;
+            uid->slot_count = 1;
+            strcpy(uid->slots[0].source_id, "reader1");
+            uid->slots[0].value_count = 2;
+            strcpy(uid->slots[0].values[0], "04AABB");
+            strcpy(uid->slots[0].values[1], "04CCDD");
+            strcpy(uid->success_topic, "room/uid/ok");
+        }
+    }
+    return cfg;
+}
+
+static void assert_same_devices(const device_manager_config_t *a, const device_manager_config_t *b, uint8_t count)
+{
+    for (uint8_t i = 0; i < count; ++i) {
+        TEST_ASSERT_EQUAL_STRING(a->devices[i].id, b->devices[i].id);
+        TEST_ASSERT_TRUE(dm_config_device_digest(&a->devices[i], true) ==
+                         dm_config_device_digest(&b->devices[i], true));
+    }
+}
+
+static void test_profile_codec_roundtrip(void)
+{
+    const uint8_t count = 4;
+    device_manager_config_t *src = build_config(count);
+    device_manager_config_t *dst = dm_config_create(0);
+    TEST_ASSERT_NOT_NULL(dst);
+
+    uint8_t *body = NULL;
+    size_t body_len = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, dm_profile_encode(src->devices, count, &body, &body_len));
+    // Unused rules and string padding must not reach the file.
+    TEST_ASSERT_LESS_THAN(sizeof(device_descriptor_t) * count / 4, body_len);
+
+    TEST_ASSERT_EQUAL(ESP_OK, dm_profile_decode(body, body_len, count, dst));
+    TEST_ASSERT_EQUAL_UINT8(count, dst->device_count);
+    assert_same_devices(src, dst, count);
+    const device_action_step_t *step = &dst->devices[0].scenarios[0].steps[0];
+    TEST_ASSERT_EQUAL_STRING("room/door/cmd", step->data.mqtt.topic);
+    // Decoded strings live in the destination arena and repeat text is stored once.
+    TEST_ASSERT_TRUE(step->data.mqtt.topic != src->devices[0].scenarios[0].steps[0].data.mqtt.topic);
+    TEST_ASSERT_TRUE(step->data.mqtt.topic == dst->devices[1].scenarios[0].steps[0].data.mqtt.topic);
+
+    heap_caps_free(body);
+    dm_config_destroy(src);
+    dm_config_destroy(dst);
+}
+
+static void test_profile_codec_rejects_corrupt(void)
+{
+    device_manager_config_t *src = build_config(2);
+    device_manager_config_t *dst = dm_config_create(0);
+    TEST_ASSERT_NOT_NULL(dst);
+    uint8_t *body = NULL;
+    size_t body_len = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, dm_profile_encode(src->devices, 2, &body, &body_len));
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, dm_profile_decode(body, body_len - 3, 2, dst));
+    TEST_ASSERT_EQUAL_UINT8(0, dst->device_count);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, dm_profile_decode(body, body_len, 3, dst));
+    TEST_ASSERT_EQUAL(ESP_OK, dm_profile_decode(body, body_len, 2, dst));
+    TEST_ASSERT_EQUAL_UINT8(2, dst->device_count);
+    // A record length pointing past the body.
+    body[3] = 0x7F;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, dm_profile_decode(body, body_len, 2, dst));
+    TEST_ASSERT_EQUAL_UINT8(0, dst->device_count);
+
+    heap_caps_free(body);
+    dm_config_destroy(src);
+    dm_config_destroy(dst);
+}
+
+static void test_profile_codec_lz(void)
+{
+    enum { LEN = 6000 };
+    uint8_t *src = malloc(LEN);
+    uint8_t *packed = malloc(LEN);
+    uint8_t *out = malloc(LEN);
+    TEST_ASSERT_NOT_NULL(src);
+    TEST_ASSERT_NOT_NULL(packed);
+    TEST_ASSERT_NOT_NULL(out);
+
+    for (size_t i = 0; i < LEN; ++i) {
+        src[i] = (uint8_t)("room/dev/state"[i % 14] + (i / 700));
+    }
+    size_t packed_len = dm_profile_lz_compress(src, LEN, packed, LEN);
+    TEST_ASSERT_NOT_EQUAL(0, packed_len);
+    TEST_ASSERT_LESS_THAN(LEN / 4, packed_len);
+    TEST_ASSERT_EQUAL(ESP_OK, dm_profile_lz_decompress(packed, packed_len, out, LEN));
+    TEST_ASSERT_EQUAL_MEMORY(src, out, LEN);
+    // The exact length is part of the contract.
+    TEST_ASSERT_NOT_EQUAL(ESP_OK, dm_profile_lz_decompress(packed, packed_len, out, LEN - 1));
+    TEST_ASSERT_NOT_EQUAL(ESP_OK, dm_profile_lz_decompress(packed, packed_len - 1, out, LEN));
+
+    // Noise does not shrink; the caller is told to store it as is.
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < LEN; ++i) {
+        seed = seed * 1103515245u + 12345u;
+        src[i] = (uint8_t)(seed >> 16);
+    }
+    TEST_ASSERT_EQUAL(0, dm_profile_lz_compress(src, LEN, packed, LEN - 1));
+    packed_len = dm_profile_lz_compress(src, 10, packed, LEN);
+    TEST_ASSERT_NOT_EQUAL(0, packed_len);
+    TEST_ASSERT_EQUAL(ESP_OK, dm_profile_lz_decompress(packed, packed_len, out, 10));
+    TEST_ASSERT_EQUAL_MEMORY(src, out, 10);
+
+    free(src);
+    free(packed);
+    free(out);
+}
+
+static void test_profile_codec_crc(void)
+{
+    TEST_ASSERT_EQUAL_HEX32(0xCBF43926u, dm_profile_crc32(0, "123456789", 9));
+    uint32_t crc = dm_profile_crc32(0, "12345", 5);
+    TEST_ASSERT_EQUAL_HEX32(0xCBF43926u, dm_profile_crc32(crc, "6789", 4));
+    TEST_ASSERT_EQUAL_HEX32(0, dm_profile_crc32(0, NULL, 0));
+}
+
+void register_profile_codec_tests(void)
+{
+    RUN_TEST(test_profile_codec_roundtrip);
+    RUN_TEST(test_profile_codec_rejects_corrupt);
+    RUN_TEST(test_profile_codec_lz);
+    RUN_TEST(test_profile_codec_crc);
+}
@@ -0,0 +1,160 @@
+#include "unity.h"
+#include "dm_rate_gate.h"
+#include "esp_timer.h"
+
+// Same scheme as the timer wheel tests.
+static int64_t s_clock_us;
+
+static void clock_start(void)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, dm_timer_wheel_init());
+    s_clock_us = esp_timer_get_time() + 3600LL * 1000000LL;
+    s_clock_us -= s_clock_us % (DM_TIMER_WHEEL_TICK_MS * 1000);
+    dm_timer_wheel_rebase(s_clock_us);
+}
+
+static void step_ms(uint32_t ms)
+{
+    s_clock_us += (int64_t)ms * 1000;
+    dm_timer_wheel_advance(s_clock_us);
+}
+
+static void count_fire(dm_rate_gate_t *gate, void *arg)
+{
+    (void)gate;
+    (*(int *)arg)++;
+}
+
+static void gate_setup(dm_rate_gate_t *gate, dm_rate_mode_t mode, uint8_t edges, uint32_t window_ms, int *fired)
+{
+    dm_rate_limit_t limit = {.mode = (uint8_t)mode, .edges = edges, .window_ms = window_ms};
+    dm_rate_gate_init(gate, &limit, NULL, count_fire, fired);
+}
+
+static void test_rate_gate_default_and_fallback(void)
+{
+    clock_start();
+    int fired = 0;
+    dm_rate_gate_t gate;
+    dm_rate_gate_init(&gate, NULL, NULL, count_fire, &fired);
+    TEST_ASSERT_FALSE(dm_rate_gate_active(&gate));
+    for (int i = 0; i < 5; ++i) {
+        TEST_ASSERT_TRUE(dm_rate_gate_admit(&gate));
+    }
+    TEST_ASSERT_EQUAL_UINT32(5, gate.passed);
+
+    // DEFAULT picks the owner's fallback, NONE overrides it.
+    dm_rate_limit_t fallback = {.mode = DM_RATE_MODE_THROTTLE, .window_ms = 300};
+    dm_rate_limit_t unset = {0};
+    dm_rate_gate_init(&gate, &unset, &fallback, count_fire, &fired);
+    TEST_ASSERT_TRUE(dm_rate_gate_active(&gate));
+    dm_rate_limit_t none = {.mode = DM_RATE_MODE_NONE, .window_ms = 300};
+    dm_rate_gate_init(&gate, &none, &fallback, count_fire, &fired);
+    TEST_ASSERT_FALSE(dm_rate_gate_active(&gate));
+    TEST_ASSERT_EQUAL(0, fired);
+}
+
+static void test_rate_gate_throttle_leading(void)
+{
+    clock_start();
+    int fired = 0;
+    dm_rate_gate_t gate;
+    gate_setup(&gate, DM_RATE_MODE_THROTTLE, DM_RATE_EDGE_LEADING, 300, &fired);
+
+    TEST_ASSERT_TRUE(dm_rate_gate_admit(&gate));
+    step_ms(100);
+    TEST_ASSERT_FALSE(dm_rate_gate_admit(&gate));
+    step_ms(150);
+    TEST_ASSERT_FALSE(dm_rate_gate_admit(&gate));
+    // The window is not extended by the dropped events.
+    step_ms(60);
+    TEST_ASSERT_TRUE(dm_rate_gate_admit(&gate));
+    TEST_ASSERT_EQUAL_UINT32(2, gate.passed);
+    TEST_ASSERT_EQUAL_UINT32(2, gate.suppressed);
+    TEST_ASSERT_EQUAL(0, fired);
+    dm_rate_gate_reset(&gate);
+}
+
+static void test_rate_gate_debounce_trailing(void)
+{
+    clock_start();
+    int fired = 0;
+    dm_rate_gate_t gate;
+    gate_setup(&gate, DM_RATE_MODE_DEBOUNCE, DM_RATE_EDGE_TRAILING, 200, &fired);
+
+    // A burst settles into one fire, 200 ms after its last event.
+    for (int i = 0; i < 5; ++i) {
+        TEST_ASSERT_FALSE(dm_rate_gate_admit(&gate));
+        step_ms(100);
+    }
+    TEST_ASSERT_EQUAL(0, fired);
+    step_ms(110);
+    TEST_ASSERT_EQUAL(1, fired);
+    TEST_ASSERT_EQUAL_UINT32(1, gate.passed);
+    TEST_ASSERT_EQUAL_UINT32(4, gate.suppressed);
+
+    step_ms(1000);
+    TEST_ASSERT_EQUAL(1, fired);
+}
+
+static void test_rate_gate_throttle_both_edges(void)
+{
+    clock_start();
+    int fired = 0;
+    dm_rate_gate_t gate;
+    gate_setup(&gate, DM_RATE_MODE_THROTTLE, DM_RATE_EDGE_LEADING | DM_RATE_EDGE_TRAILING, 100, &fired);
+
+    TEST_ASSERT_TRUE(dm_rate_gate_admit(&gate));
+    step_ms(20);
+    TEST_ASSERT_FALSE(dm_rate_gate_admit(&gate));
+    step_ms(20);
+    TEST_ASSERT_FALSE(dm_rate_gate_admit(&gate));
+    step_ms(70);
+    TEST_ASSERT_EQUAL(1, fired);
+    // The trailing fire opened a new window; an event inside it is owed again.
+    TEST_ASSERT_FALSE(dm_rate_gate_admit(&gate));
+    step_ms(110);
+    TEST_ASSERT_EQUAL(2, fired);
+    step_ms(110);
+    TEST_ASSERT_TRUE(dm_rate_gate_admit(&gate));
+    TEST_ASSERT_EQUAL_UINT32(4, gate.passed);
+    TEST_ASSERT_EQUAL_UINT32(1, gate.suppressed);
+    dm_rate_gate_reset(&gate);
+}
+
+static void test_rate_gate_reset_drops_pending(void)
+{
+    clock_start();
+    int fired = 0;
+    dm_rate_gate_t gate;
+    gate_setup(&gate, DM_RATE_MODE_DEBOUNCE, DM_RATE_EDGE_TRAILING, 100, &fired);
+
+    TEST_ASSERT_FALSE(dm_rate_gate_admit(&gate));
+    dm_rate_gate_reset(&gate);
+    step_ms(200);
+    TEST_ASSERT_EQUAL(0, fired);
+    TEST_ASSERT_FALSE(gate.pending);
+}
+
+static void test_rate_gate_names(void)
+{
+    dm_rate_mode_t mode;
+    uint8_t edges;
+    TEST_ASSERT_TRUE(dm_rate_mode_from_string("Throttle", &mode));
+    TEST_ASSERT_EQUAL(DM_RATE_MODE_THROTTLE, mode);
+    TEST_ASSERT_FALSE(dm_rate_mode_from_string("burst", &mode));
+    TEST_ASSERT_TRUE(dm_rate_edges_from_string("both", &edges));
+    TEST_ASSERT_EQUAL_STRING("both", dm_rate_edges_to_string(edges));
+    TEST_ASSERT_EQUAL_STRING("leading", dm_rate_edges_to_string(0));
+    TEST_ASSERT_FALSE(dm_rate_edges_from_string("middle", &edges));
+}
+
+void register_rate_gate_tests(void)
+{
+    RUN_TEST(test_rate_gate_default_and_fallback);
+    RUN_TEST(test_rate_gate_throttle_leading);
+    RUN_TEST(test_rate_gate_debounce_trailing);
+    RUN_TEST(test_rate_gate_throttle_both_edges);
+    RUN_TEST(test_rate_gate_reset_drops_pending);
+    RUN_TEST(test_rate_gate_names);
+}
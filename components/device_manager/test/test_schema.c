@@ -0,0 +1,154 @@
+#include "unity.h"
+#include "dm_config.h"
+#include "dm_schema.h"
+#include "dm_storage.h"
+#include "esp_heap_caps.h"
+#include <stdio.h>
+#include <string.h>
+
+#define TEMPLATE_DATA_SIZE sizeof(((dm_template_config_t *)0)->data)
+
+static void check_record(const dm_record_t *rec, size_t bound)
+{
+    TEST_ASSERT_NOT_NULL(rec->fields);
+    TEST_ASSERT_TRUE(rec->count > 0 && rec->count <= 32);
+    for (uint8_t i = 0; i < rec->count; ++i) {
+        const dm_field_t *f = &rec->fields[i];
+        TEST_ASSERT_EQUAL_PTR_MESSAGE(f, dm_record_find(rec, f->key), f->key);
+        if (f->kind == DM_FIELD_LIST) {
+            TEST_ASSERT_TRUE(f->max > 0);
+            check_record((const dm_record_t *)f->ref, bound);
+            TEST_ASSERT_TRUE(f->aux < bound);
+            continue;
+        }
+        if (f->kind == DM_FIELD_ENUM) {
+            TEST_ASSERT_NOT_NULL(f->ref);
+            TEST_ASSERT_TRUE(f->size == 1 || f->size == 4);
+        }
+        size_t span = (size_t)f->size * (f->kind == DM_FIELD_STRS ? f->max : 1);
+        TEST_ASSERT_TRUE_MESSAGE(f->offset + span <= bound, f->key);
+        TEST_ASSERT_TRUE_MESSAGE(!f->stride || span <= f->stride, f->key);
+    }
+}
+
+static void test_schema_tables_are_consistent(void)
+{
+    for (int t = 0; t < DM_TEMPLATE_TYPE_COUNT; ++t) {
+        const dm_template_schema_t *schema = dm_template_schema((dm_template_type_t)t);
+        TEST_ASSERT_NOT_NULL(schema);
+        TEST_ASSERT_EQUAL(t, schema->type);
+        TEST_ASSERT_EQUAL_PTR(schema, dm_template_schema_by_section(schema->section));
+        check_record(&schema->record, TEMPLATE_DATA_SIZE);
+    }
+    TEST_ASSERT_NULL(dm_template_schema(DM_TEMPLATE_TYPE_COUNT));
+    TEST_ASSERT_NULL(dm_template_schema_by_section("nope"));
+    check_record(dm_schema_scenario(), sizeof(device_scenario_t));
+}
+
+// Gives every member of entry `index` a value of its own, through the table alone.
+static void fill_record(const dm_record_t *rec, void *base, uint8_t index)
+{
+    for (uint8_t i = 0; i < rec->count; ++i) {
+        const dm_field_t *f = &rec->fields[i];
+        void *p = dm_field_ptr(f, base, index);
+        switch (f->kind) {
+        case DM_FIELD_STR:
+            snprintf((char *)p, f->size, "%s_%u", f->key, index);
+            break;
+        case DM_FIELD_STRS:
+            for (uint8_t n = 0; n < 2; ++n) {
+                snprintf((char *)dm_field_str(f, base, index, n), f->size, "v%u_%u", index, n);
+            }
+            *dm_field_count(f, base, index) = 2;
+            break;
+        case DM_FIELD_U32:
+            *(uint32_t *)p = 1000u + i;
+            break;
+        case DM_FIELD_BOOL:
+            *(bool *)p = (i + index) & 1;
+            break;
+        case DM_FIELD_FLOAT:
+            *(float *)p = 0.5f + i;
+            *(bool *)((uint8_t *)base + f->aux + (size_t)index * f->stride) = true;
+            break;
+        case DM_FIELD_ENUM:
+            dm_field_set_int(f, base, index, 1);
+            break;
+        case DM_FIELD_LIMIT: {
+            dm_rate_limit_t *limit = (dm_rate_limit_t *)p;
+            limit->mode = DM_RATE_MODE_THROTTLE;
+            limit->edges = DM_RATE_EDGE_LEADING;
+            limit->window_ms = 100u + i;
+            break;
+        }
+        case DM_FIELD_LIST:
+            for (uint8_t n = 0; n < 2; ++n) {
+                fill_record((const dm_record_t *)f->ref, base, n);
+            }
+            *dm_field_count(f, base, 0) = 2;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+// Every member of every template survives export and import, without per-template code.
+static void test_schema_template_roundtrip(void)
+{
+    for (int t = 0; t < DM_TEMPLATE_TYPE_COUNT; ++t) {
+        const dm_template_schema_t *schema = dm_template_schema((dm_template_type_t)t);
+        device_manager_config_t *cfg = dm_config_create(1);
+        TEST_ASSERT_NOT_NULL(cfg);
+        device_descriptor_t *dev = &cfg->devices[0];
+        cfg->device_count = 1;
+        strcpy(dev->id, "dev");
+        strcpy(dev->display_name, "dev");
+        dev->template_assigned = true;
+        dev->template_config.type = schema->type;
+        fill_record(&schema->record, &dev->template_config.data, 0);
+        TEST_ASSERT_TRUE_MESSAGE(dm_template_config_usable(&dev->template_config), schema->section);
+
+        char *json = NULL;
+        size_t len = 0;
+        TEST_ASSERT_EQUAL(ESP_OK, dm_storage_export_json(cfg, &json, &len));
+        device_manager_config_t *back = dm_config_create(0);
+        TEST_ASSERT_NOT_NULL(back);
+        TEST_ASSERT_EQUAL(ESP_OK, dm_storage_parse_json(json, len, back));
+        TEST_ASSERT_EQUAL_UINT8(1, back->device_count);
+        TEST_ASSERT_TRUE_MESSAGE(back->devices[0].template_assigned, schema->section);
+        TEST_ASSERT_EQUAL_MEMORY_MESSAGE(&dev->template_config, &back->devices[0].template_config,
+                                         sizeof(dev->template_config), schema->section);
+        heap_caps_free(json);
+        dm_config_destroy(back);
+        dm_config_destroy(cfg);
+    }
+}
+
+static void test_schema_rejects_broken_blocks(void)
+{
+    static dm_template_config_t tpl;
+    memset(&tpl, 0, sizeof(tpl));
+    tpl.type = DM_TEMPLATE_TYPE_SEQUENCE_LOCK;
+    dm_sequence_template_clear(&tpl.data.sequence);
+    TEST_ASSERT_FALSE(dm_template_config_usable(&tpl));     // no steps
+    strcpy(tpl.data.sequence.steps[0].topic, "room/a");
+    tpl.data.sequence.step_count = 1;
+    TEST_ASSERT_TRUE(dm_template_config_usable(&tpl));
+
+    tpl.data.sequence.step_count = DM_SEQUENCE_TEMPLATE_MAX_STEPS + 1;
+    TEST_ASSERT_FALSE(dm_template_config_usable(&tpl));
+    tpl.data.sequence.step_count = 1;
+    memset(tpl.data.sequence.success_topic, 'x', sizeof(tpl.data.sequence.success_topic));
+    TEST_ASSERT_FALSE(dm_template_config_usable(&tpl));     // unterminated text
+
+    tpl.type = DM_TEMPLATE_TYPE_COUNT;
+    TEST_ASSERT_FALSE(dm_template_config_usable(&tpl));
+}
+
+void register_schema_tests(void)
+{
+    RUN_TEST(test_schema_tables_are_consistent);
+    RUN_TEST(test_schema_template_roundtrip);
+    RUN_TEST(test_schema_rejects_broken_blocks);
+}
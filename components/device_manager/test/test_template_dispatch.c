@@ -0,0 +1,435 @@
+#include "unity.h"
+#include "dm_config.h"
+#include "dm_topic_index.h"
+#include "dm_template_runtime.h"
+#include "dm_timer_wheel.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <stdio.h>
+#include <string.h>
+
+#define BENCH_DEVICES      DEVICE_MANAGER_MAX_DEVICES
+#define BENCH_UID_SLOTS    4
+#define BENCH_RULES        4
+#define BENCH_SEQ_STEPS    4
+#define BENCH_ROUNDS       50
+
+static void test_topic_index_bindings(void)
+{
+    dm_topic_index_t index = {0};
+    int a = 0;
+    int b = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, dm_topic_index_add(&index, "room/door", &a, 1));
+    TEST_ASSERT_EQUAL(ESP_OK, dm_topic_index_add(&index, "room/door", &b, 2));
+    TEST_ASSERT_EQUAL(ESP_OK, dm_topic_index_add(&index, "room/door", &a, 1));
+    TEST_ASSERT_EQUAL(ESP_OK, dm_topic_index_add(&index, "", &a, 1));
+
+    // Enough distinct topics to force a couple of table resizes.
+    static char topics[200][24];
+    for (int i = 0; i < 200; ++i) {
+        snprintf(topics[i], sizeof(topics[i]), "noise/%d", i);
+        TEST_ASSERT_EQUAL(ESP_OK, dm_topic_index_add(&index, topics[i], &b, 3));
+    }
+    TEST_ASSERT_EQUAL(201, index.topic_count);
+
+    const dm_topic_binding_t *hit = dm_topic_index_find(&index, "room/door");
+    TEST_ASSERT_NOT_NULL(hit);
+    TEST_ASSERT_EQUAL_PTR(&a, hit->runtime);
+    hit = dm_topic_index_next(&index, hit);
+    TEST_ASSERT_NOT_NULL(hit);
+    TEST_ASSERT_EQUAL_PTR(&b, hit->runtime);
+    TEST_ASSERT_EQUAL_UINT8(2, hit->role);
+    TEST_ASSERT_NULL(dm_topic_index_next(&index, hit));
+    TEST_ASSERT_NOT_NULL(dm_topic_index_find(&index, "noise/199"));
+    TEST_ASSERT_NULL(dm_topic_index_find(&index, "room/window"));
+
+    dm_topic_index_clear(&index);
+    TEST_ASSERT_NULL(dm_topic_index_find(&index, "room/door"));
+}
+
+// Every template sits on its own device, as it does in a real config.
+static void bench_id(char *out, size_t len, int dev, dm_template_type_t type)
+{
+    snprintf(out, len, "room%02d_t%d", dev, (int)type);
+}
+
+// Runtimes read their template in place; these stand in for the config generation.
+static dm_template_config_t *s_bench_templates;
+
+static void register_bench_template(const dm_template_config_t *tpl, int dev)
+{
+    char id[DEVICE_MANAGER_ID_MAX_LEN];
+    bench_id(id, sizeof(id), dev, tpl->type);
+    if (!s_bench_templates) {
+        s_bench_templates = heap_caps_calloc(BENCH_DEVICES * DM_TEMPLATE_TYPE_COUNT, sizeof(*tpl),
+                                             MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!s_bench_templates) {
+            s_bench_templates = heap_caps_calloc(BENCH_DEVICES * DM_TEMPLATE_TYPE_COUNT, sizeof(*tpl),
+                                                 MALLOC_CAP_DEFAULT);
+        }
+    }
+    TEST_ASSERT_NOT_NULL(s_bench_templates);
+    dm_template_config_t *slot = &s_bench_templates[dev * DM_TEMPLATE_TYPE_COUNT + tpl->type];
+    // The runtime being replaced may still be reading the old copy from a timer callback.
+    dm_timer_wheel_lock();
+    *slot = *tpl;
+    esp_err_t err = dm_template_runtime_register(NULL, slot, id);
+    dm_timer_wheel_unlock();
+    TEST_ASSERT_EQUAL(ESP_OK, err);
+}
+
+static void build_uid_template(dm_template_config_t *tpl, int dev)
+{
+    memset(tpl, 0, sizeof(*tpl));
+    tpl->type = DM_TEMPLATE_TYPE_UID;
+    tpl->data.uid.slot_count = BENCH_UID_SLOTS;
+    for (int s = 0; s < BENCH_UID_SLOTS; ++s) {
+        snprintf(tpl->data.uid.slots[s].source_id, sizeof(tpl->data.uid.slots[s].source_id), "r%02d/reader%d", dev, s);
+        tpl->data.uid.slots[s].value_count = 1;
+        snprintf(tpl->data.uid.slots[s].values[0], sizeof(tpl->data.uid.slots[s].values[0]), "CARD%d", s);
+    }
+    snprintf(tpl->data.uid.start_topic, sizeof(tpl->data.uid.start_topic), "r%02d/uid/start", dev);
+}
+
+static void register_bench_templates(int dev)
+{
+    static dm_template_config_t tpl;
+
+    build_uid_template(&tpl, dev);
+    register_bench_template(&tpl, dev);
+
+    memset(&tpl, 0, sizeof(tpl));
+    tpl.type = DM_TEMPLATE_TYPE_SIGNAL_HOLD;
+    snprintf(tpl.data.signal.heartbeat_topic, sizeof(tpl.data.signal.heartbeat_topic), "r%02d/hb", dev);
+    tpl.data.signal.required_hold_ms = 3600000;
+    tpl.data.signal.heartbeat_timeout_ms = 1000;
+    register_bench_template(&tpl, dev);
+
+    memset(&tpl, 0, sizeof(tpl));
+    tpl.type = DM_TEMPLATE_TYPE_MQTT_TRIGGER;
+    tpl.data.mqtt.rule_count = BENCH_RULES;
+    for (int r = 0; r < BENCH_RULES; ++r) {
+        dm_mqtt_trigger_rule_t *rule = &tpl.data.mqtt.rules[r];
+        snprintf(rule->topic, sizeof(rule->topic), "r%02d/button%d", dev, r);
+        strcpy(rule->payload, "pressed");
+        rule->payload_required = true;
+        strcpy(rule->scenario, "on_button");
+    }
+    register_bench_template(&tpl, dev);
+
+    memset(&tpl, 0, sizeof(tpl));
+    tpl.type = DM_TEMPLATE_TYPE_FLAG_TRIGGER;
+    tpl.data.flag.rule_count = 1;
+    snprintf(tpl.data.flag.rules[0].flag, sizeof(tpl.data.flag.rules[0].flag), "r%02d_done", dev);
+    tpl.data.flag.rules[0].required_state = true;
+    strcpy(tpl.data.flag.rules[0].scenario, "on_done");
+    register_bench_template(&tpl, dev);
+
+    memset(&tpl, 0, sizeof(tpl));
+    tpl.type = DM_TEMPLATE_TYPE_IF_CONDITION;
+    tpl.data.condition.rule_count = 1;
+    snprintf(tpl.data.condition.rules[0].flag, sizeof(tpl.data.condition.rules[0].flag), "r%02d_done", dev);
+    tpl.data.condition.rules[0].required_state = true;
+    register_bench_template(&tpl, dev);
+
+    memset(&tpl, 0, sizeof(tpl));
+    tpl.type = DM_TEMPLATE_TYPE_INTERVAL_TASK;
+    tpl.data.interval.interval_ms = 3600000;
+    strcpy(tpl.data.interval.scenario, "tick");
+    register_bench_template(&tpl, dev);
+
+    memset(&tpl, 0, sizeof(tpl));
+    tpl.type = DM_TEMPLATE_TYPE_SEQUENCE_LOCK;
+    tpl.data.sequence.step_count = BENCH_SEQ_STEPS;
+    for (int s = 0; s < BENCH_SEQ_STEPS; ++s) {
+        snprintf(tpl.data.sequence.steps[s].topic, sizeof(tpl.data.sequence.steps[s].topic), "r%02d/lever%d", dev, s);
+    }
+    register_bench_template(&tpl, dev);
+}
+
+// One simulated second of broker traffic per room: 10 Hz heartbeat, two UID reads, one
+// button press, one lever and 20 unrelated telemetry messages nobody listens to.
+static void bench_second(int round, uint32_t *messages, uint32_t *handled, uint32_t *ignored)
+{
+    char topic[DEVICE_MANAGER_TOPIC_MAX_LEN];
+    char payload[16];
+    for (int dev = 0; dev < BENCH_DEVICES; ++dev) {
+        for (int i = 0; i < 10; ++i) {
+            snprintf(topic, sizeof(topic), "r%02d/hb", dev);
+            *handled += dm_template_runtime_handle_mqtt(topic, "1");
+        }
+        for (int i = 0; i < 2; ++i) {
+            int slot = (round * 2 + i) % BENCH_UID_SLOTS;
+            snprintf(topic, sizeof(topic), "r%02d/reader%d", dev, slot);
+            snprintf(payload, sizeof(payload), "CARD%d", slot);
+            *handled += dm_template_runtime_handle_mqtt(topic, payload);
+        }
+        snprintf(topic, sizeof(topic), "r%02d/button%d", dev, round % BENCH_RULES);
+        *handled += dm_template_runtime_handle_mqtt(topic, "pressed");
+        snprintf(topic, sizeof(topic), "r%02d/lever%d", dev, round % BENCH_SEQ_STEPS);
+        *handled += dm_template_runtime_handle_mqtt(topic, "");
+        for (int i = 0; i < 20; ++i) {
+            snprintf(topic, sizeof(topic), "r%02d/telemetry/%d", dev, i);
+            *ignored += !dm_template_runtime_handle_mqtt(topic, "21.5");
+        }
+        *messages += 10 + 2 + 1 + 1 + 20;
+    }
+}
+
+static void test_template_runtime_footprint(void)
+{
+    esp_log_level_set("*", ESP_LOG_ERROR);
+    TEST_ASSERT_EQUAL(ESP_OK, dm_template_runtime_init());
+    dm_template_runtime_stats_t stats;
+    dm_template_runtime_get_stats(&stats);
+    uint32_t generation = stats.generation;
+
+    int64_t start = esp_timer_get_time();
+    for (int dev = 0; dev < BENCH_DEVICES; ++dev) {
+        register_bench_templates(dev);
+    }
+    int64_t register_us = esp_timer_get_time() - start;
+    dm_template_runtime_get_stats(&stats);
+    TEST_ASSERT_EQUAL(BENCH_DEVICES * DM_TEMPLATE_TYPE_COUNT, stats.runtimes);
+    TEST_ASSERT_TRUE(stats.generation != generation);
+    size_t bytes = stats.bytes;
+
+    start = esp_timer_get_time();
+    dm_template_runtime_reset();
+    int64_t reset_us = esp_timer_get_time() - start;
+    esp_log_level_set("*", ESP_LOG_INFO);
+    dm_template_runtime_get_stats(&stats);
+    TEST_ASSERT_EQUAL(0, stats.runtimes);
+    TEST_ASSERT_EQUAL(0, stats.bytes);
+    TEST_ASSERT_EQUAL(0, stats.arena_bytes);
+    TEST_ASSERT_EQUAL(0, stats.topics);
+    printf("template runtimes: %u runtimes, %u bytes, register %lld us, reset %lld us\n",
+           (unsigned)(BENCH_DEVICES * DM_TEMPLATE_TYPE_COUNT),
+           (unsigned)bytes,
+           (long long)register_us,
+           (long long)reset_us);
+}
+
+// Replacing one device keeps every other runtime's state; compares against a full rebuild.
+static void test_template_runtime_incremental(void)
+{
+    static dm_template_config_t tpl;
+    char uid0[DEVICE_MANAGER_ID_MAX_LEN];
+    bench_id(uid0, sizeof(uid0), 0, DM_TEMPLATE_TYPE_UID);
+    esp_log_level_set("*", ESP_LOG_ERROR);
+
+    int64_t start = esp_timer_get_time();
+    TEST_ASSERT_EQUAL(ESP_OK, dm_template_runtime_init());
+    for (int dev = 0; dev < BENCH_DEVICES; ++dev) {
+        register_bench_templates(dev);
+    }
+    int64_t full_us = esp_timer_get_time() - start;
+    TEST_ASSERT_TRUE(dm_template_runtime_handle_mqtt("r00/reader1", "CARD1"));
+    dm_template_runtime_stats_t stats;
+    dm_template_runtime_get_stats(&stats);
+    size_t arena_bytes = stats.arena_bytes;
+    TEST_ASSERT_TRUE(arena_bytes >= stats.bytes);
+
+    // One-field change on another room's reader.
+    build_uid_template(&tpl, 1);
+    strcpy(tpl.data.uid.slots[0].values[0], "CARD9");
+    start = esp_timer_get_time();
+    register_bench_template(&tpl, 1);
+    int64_t one_us = esp_timer_get_time() - start;
+
+    // The replacement took the block the old runtime left.
+    dm_template_runtime_get_stats(&stats);
+    TEST_ASSERT_EQUAL(BENCH_DEVICES * DM_TEMPLATE_TYPE_COUNT, stats.runtimes);
+    TEST_ASSERT_EQUAL(arena_bytes, stats.arena_bytes);
+    dm_uid_runtime_snapshot_t snap;
+    TEST_ASSERT_EQUAL(ESP_OK, dm_template_runtime_get_uid_snapshot(uid0, &snap));
+    TEST_ASSERT_TRUE(snap.slots[1].has_value);
+    TEST_ASSERT_TRUE(dm_template_runtime_handle_mqtt("r01/reader0", "CARD9"));
+
+    // Changing the room itself starts it over; removing it drops its topics.
+    build_uid_template(&tpl, 0);
+    register_bench_template(&tpl, 0);
+    TEST_ASSERT_EQUAL(ESP_OK, dm_template_runtime_get_uid_snapshot(uid0, &snap));
+    TEST_ASSERT_FALSE(snap.slots[1].has_value);
+    dm_template_runtime_unregister(uid0);
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, dm_template_runtime_get_uid_snapshot(uid0, &snap));
+    TEST_ASSERT_FALSE(dm_template_runtime_handle_mqtt("r00/reader1", "CARD1"));
+    TEST_ASSERT_TRUE(dm_template_runtime_handle_mqtt("r01/hb", "1"));
+    dm_template_runtime_get_stats(&stats);
+    TEST_ASSERT_EQUAL(BENCH_DEVICES * DM_TEMPLATE_TYPE_COUNT - 1, stats.runtimes);
+
+    dm_template_runtime_reset();
+    esp_log_level_set("*", ESP_LOG_INFO);
+    printf("template apply: full rebuild %lld us, one device %lld us\n",
+           (long long)full_us,
+           (long long)one_us);
+}
+
+// An unchanged runtime moves to the next generation and lets go of the one it came from.
+static void test_template_runtime_adopt(void)
+{
+    esp_log_level_set("*", ESP_LOG_ERROR);
+    TEST_ASSERT_EQUAL(ESP_OK, dm_template_runtime_init());
+    device_manager_config_t *old = dm_config_create(1);
+    TEST_ASSERT_NOT_NULL(old);
+    old->refs = 1;
+    old->device_count = 1;
+    device_descriptor_t *dev = &old->devices[0];
+    strcpy(dev->id, "door");
+    dev->template_assigned = true;
+    build_uid_template(&dev->template_config, 0);
+    TEST_ASSERT_EQUAL(ESP_OK, dm_template_runtime_register(old, &dev->template_config, dev->id));
+    TEST_ASSERT_EQUAL_UINT32(2, old->refs);
+
+    device_manager_config_t *next = dm_config_create(0);
+    TEST_ASSERT_NOT_NULL(next);
+    TEST_ASSERT_EQUAL(ESP_OK, dm_config_copy(next, old));
+    next->refs = 1;
+    TEST_ASSERT_EQUAL(1, dm_template_runtime_adopt(next));
+    TEST_ASSERT_EQUAL(0, dm_template_runtime_adopt(next));
+    TEST_ASSERT_EQUAL_UINT32(1, old->refs);
+    TEST_ASSERT_EQUAL_UINT32(2, next->refs);
+    // The topic index must not point into the freed generation.
+    device_manager_release_config(old);
+    TEST_ASSERT_TRUE(dm_template_runtime_handle_mqtt("r00/reader1", "CARD1"));
+
+    dm_template_runtime_reset();
+    esp_log_level_set("*", ESP_LOG_INFO);
+    TEST_ASSERT_EQUAL_UINT32(1, next->refs);
+    device_manager_release_config(next);
+}
+
+// Room reset: state goes back to registration without touching the index.
+static void test_template_runtime_reset_state(void)
+{
+    char uid0[DEVICE_MANAGER_ID_MAX_LEN];
+    bench_id(uid0, sizeof(uid0), 0, DM_TEMPLATE_TYPE_UID);
+    esp_log_level_set("*", ESP_LOG_ERROR);
+    TEST_ASSERT_EQUAL(ESP_OK, dm_template_runtime_init());
+    for (int dev = 0; dev < BENCH_DEVICES; ++dev) {
+        register_bench_templates(dev);
+    }
+    TEST_ASSERT_TRUE(dm_template_runtime_handle_mqtt("r00/reader1", "CARD1"));
+    dm_template_runtime_stats_t before;
+    dm_template_runtime_get_stats(&before);
+
+    int64_t start = esp_timer_get_time();
+    size_t count = dm_template_runtime_reset_state();
+    int64_t reset_us = esp_timer_get_time() - start;
+
+    dm_template_runtime_stats_t after;
+    dm_template_runtime_get_stats(&after);
+    TEST_ASSERT_EQUAL(before.runtimes, count);
+    TEST_ASSERT_EQUAL(before.generation, after.generation);
+    TEST_ASSERT_EQUAL(before.bindings, after.bindings);
+    dm_uid_runtime_snapshot_t snap;
+    TEST_ASSERT_EQUAL(ESP_OK, dm_template_runtime_get_uid_snapshot(uid0, &snap));
+    TEST_ASSERT_FALSE(snap.slots[1].has_value);
+    TEST_ASSERT_TRUE(dm_template_runtime_handle_mqtt("r00/reader1", "CARD1"));
+
+    dm_template_runtime_reset();
+    esp_log_level_set("*", ESP_LOG_INFO);
+    printf("template state reset: %u runtimes in %lld us\n", (unsigned)count, (long long)reset_us);
+}
+
+// Checkpoint records survive a state reset and refuse a changed template.
+static void test_template_runtime_state_roundtrip(void)
+{
+    static dm_runtime_state_t states[BENCH_DEVICES * DM_TEMPLATE_TYPE_COUNT];
+    static dm_template_config_t tpl;
+    char uid0[DEVICE_MANAGER_ID_MAX_LEN];
+    bench_id(uid0, sizeof(uid0), 0, DM_TEMPLATE_TYPE_UID);
+    esp_log_level_set("*", ESP_LOG_ERROR);
+    TEST_ASSERT_EQUAL(ESP_OK, dm_template_runtime_init());
+    for (int dev = 0; dev < BENCH_DEVICES; ++dev) {
+        register_bench_templates(dev);
+    }
+    TEST_ASSERT_TRUE(dm_template_runtime_handle_mqtt("r00/reader1", "CARD1"));
+
+    int64_t start = esp_timer_get_time();
+    size_t count = dm_template_runtime_export_state(states, BENCH_DEVICES * DM_TEMPLATE_TYPE_COUNT);
+    int64_t export_us = esp_timer_get_time() - start;
+    // mqtt_trigger and interval_task carry no state.
+    TEST_ASSERT_EQUAL(BENCH_DEVICES * (DM_TEMPLATE_TYPE_COUNT - 2), count);
+
+    dm_template_runtime_reset_state();
+    dm_uid_runtime_snapshot_t snap;
+    TEST_ASSERT_EQUAL(ESP_OK, dm_template_runtime_get_uid_snapshot(uid0, &snap));
+    TEST_ASSERT_FALSE(snap.slots[1].has_value);
+    start = esp_timer_get_time();
+    for (size_t i = 0; i < count; ++i) {
+        TEST_ASSERT_EQUAL(ESP_OK, dm_template_runtime_import_state(&states[i]));
+    }
+    int64_t import_us = esp_timer_get_time() - start;
+    TEST_ASSERT_EQUAL(ESP_OK, dm_template_runtime_get_uid_snapshot(uid0, &snap));
+    TEST_ASSERT_TRUE(snap.slots[1].has_value);
+
+    const dm_runtime_state_t *uid_state = NULL;
+    for (size_t i = 0; i < count && !uid_state; ++i) {
+        if (strcmp(states[i].device_id, uid0) == 0) {
+            uid_state = &states[i];
+        }
+    }
+    TEST_ASSERT_NOT_NULL(uid_state);
+
+    build_uid_template(&tpl, 0);
+    strcpy(tpl.data.uid.slots[0].values[0], "CARD9");
+    register_bench_template(&tpl, 0);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, dm_template_runtime_import_state(uid_state));
+    dm_template_runtime_unregister(uid0);
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, dm_template_runtime_import_state(uid_state));
+
+    dm_template_runtime_reset();
+    esp_log_level_set("*", ESP_LOG_INFO);
+    printf("template state: %u records (%u bytes), export %lld us, import %lld us\n",
+           (unsigned)count,
+           (unsigned)(count * sizeof(dm_runtime_state_t)),
+           (long long)export_us,
+           (long long)import_us);
+}
+
+static void test_template_dispatch_benchmark(void)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, dm_template_runtime_init());
+    for (int dev = 0; dev < BENCH_DEVICES; ++dev) {
+        register_bench_templates(dev);
+    }
+    // Keep per-message logs out of the measurement.
+    esp_log_level_set("*", ESP_LOG_ERROR);
+    uint32_t messages = 0;
+    uint32_t handled = 0;
+    uint32_t ignored = 0;
+    int64_t start = esp_timer_get_time();
+    for (int round = 0; round < BENCH_ROUNDS; ++round) {
+        bench_second(round, &messages, &handled, &ignored);
+    }
+    int64_t elapsed_us = esp_timer_get_time() - start;
+    esp_log_level_set("*", ESP_LOG_INFO);
+    dm_template_runtime_reset();
+
+    uint32_t per_round = BENCH_DEVICES * (10 + 2 + 1 + 1);
+    TEST_ASSERT_EQUAL_UINT32(BENCH_ROUNDS * per_round, handled);
+    TEST_ASSERT_EQUAL_UINT32(BENCH_ROUNDS * BENCH_DEVICES * 20, ignored);
+    if (elapsed_us <= 0) {
+        elapsed_us = 1;
+    }
+    printf("template dispatch: %u devices x %d templates, %u msgs in %lld us (%.2f us/msg, %.0f msgs/s)\n",
+           (unsigned)BENCH_DEVICES,
+           (int)DM_TEMPLATE_TYPE_COUNT,
+           (unsigned)messages,
+           (long long)elapsed_us,
+           (double)elapsed_us / messages,
+           messages * 1000000.0 / elapsed_us);
+}
+
+void register_template_dispatch_tests(void)
+{
+    RUN_TEST(test_topic_index_bindings);
+    RUN_TEST(test_template_runtime_footprint);
+    RUN_TEST(test_template_runtime_incremental);
+    RUN_TEST(test_template_runtime_adopt);
+    RUN_TEST(test_template_runtime_reset_state);
+    RUN_TEST(test_template_runtime_state_roundtrip);
+    RUN_TEST(test_template_dispatch_benchmark);
+}
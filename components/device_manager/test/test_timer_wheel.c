@@ -0,0 +1,113 @@
+#include "unity.h"
+#include "dm_timer_wheel.h"
+#include "esp_timer.h"
+
+// Tests drive the wheel with their own clock, well ahead of esp_timer, so the real driver
+// never fires anything underneath them. The runner's tearDown() puts the wheel back.
+static int64_t s_clock_us;
+
+static void clock_start(void)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, dm_timer_wheel_init());
+    s_clock_us = esp_timer_get_time() + 3600LL * 1000000LL;
+    s_clock_us -= s_clock_us % (DM_TIMER_WHEEL_TICK_MS * 1000);
+    dm_timer_wheel_rebase(s_clock_us);
+}
+
+static void step_ms(uint32_t ms)
+{
+    s_clock_us += (int64_t)ms * 1000;
+    dm_timer_wheel_advance(s_clock_us);
+}
+
+static void count_cb(void *arg)
+{
+    (*(int *)arg)++;
+}
+
+static void test_timer_wheel_one_shot(void)
+{
+    clock_start();
+    int fired = 0;
+    dm_timer_t timer;
+    dm_timer_init(&timer, count_cb, &fired);
+
+    dm_timer_arm(&timer, 100);
+    step_ms(90);
+    TEST_ASSERT_EQUAL(0, fired);
+    step_ms(10);
+    TEST_ASSERT_EQUAL(1, fired);
+    TEST_ASSERT_FALSE(dm_timer_armed(&timer));
+
+    // Re-arming moves the deadline, like a heartbeat would.
+    dm_timer_arm(&timer, 50);
+    step_ms(40);
+    dm_timer_arm(&timer, 50);
+    step_ms(20);
+    TEST_ASSERT_EQUAL(1, fired);
+    step_ms(30);
+    TEST_ASSERT_EQUAL(2, fired);
+
+    // Deadlines beyond one revolution wait for their own lap.
+    dm_timer_arm(&timer, 3000);
+    step_ms(2600);
+    TEST_ASSERT_EQUAL(2, fired);
+    step_ms(400);
+    TEST_ASSERT_EQUAL(3, fired);
+
+    dm_timer_arm(&timer, 20);
+    dm_timer_disarm(&timer);
+    step_ms(100);
+    TEST_ASSERT_EQUAL(3, fired);
+}
+
+static void test_timer_wheel_periodic(void)
+{
+    clock_start();
+    int fired = 0;
+    dm_timer_t timer;
+    dm_timer_init(&timer, count_cb, &fired);
+    dm_timer_arm_periodic(&timer, 30);
+    step_ms(30);
+    step_ms(30);
+    TEST_ASSERT_EQUAL(2, fired);
+    // A stall of several revolutions fires once and keeps the phase.
+    step_ms(10000);
+    TEST_ASSERT_EQUAL(3, fired);
+    TEST_ASSERT_TRUE(dm_timer_armed(&timer));
+    step_ms(20);
+    TEST_ASSERT_EQUAL(4, fired);
+    dm_timer_disarm(&timer);
+    step_ms(100);
+    TEST_ASSERT_EQUAL(4, fired);
+}
+
+static dm_timer_t s_victim;
+
+static void disarm_victim_cb(void *arg)
+{
+    (*(int *)arg)++;
+    dm_timer_disarm(&s_victim);
+}
+
+static void test_timer_wheel_callback_disarms(void)
+{
+    clock_start();
+    int first = 0;
+    int victim = 0;
+    dm_timer_t timer;
+    dm_timer_init(&timer, disarm_victim_cb, &first);
+    dm_timer_init(&s_victim, count_cb, &victim);
+    dm_timer_arm(&timer, 40);
+    dm_timer_arm(&s_victim, 45);
+    step_ms(50);
+    TEST_ASSERT_EQUAL(1, first);
+    TEST_ASSERT_EQUAL(0, victim);
+}
+
+void register_timer_wheel_tests(void)
+{
+    RUN_TEST(test_timer_wheel_one_shot);
+    RUN_TEST(test_timer_wheel_periodic);
+    RUN_TEST(test_timer_wheel_callback_disarms);
+}
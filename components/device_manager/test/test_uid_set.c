@@ -0,0 +1,107 @@
+#include "unity.h"
+#include "dm_uid_set.h"
+#include "dm_runtime_uid.h"
+#include "esp_timer.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifndef UID_SET_TEST_CSV
+#define UID_SET_TEST_CSV "/sdcard/dm_uid_set_test.csv"
+#endif
+
+#define UID_SET_BENCH_LOOKUPS 20000
+
+static void test_uid_set_case_folding(void)
+{
+    dm_uid_set_t set = {0};
+    TEST_ASSERT_EQUAL(ESP_OK, dm_uid_set_add(&set, "04A1B2C3"));
+    TEST_ASSERT_EQUAL(ESP_OK, dm_uid_set_add(&set, "04a1b2c3"));
+    TEST_ASSERT_EQUAL(ESP_OK, dm_uid_set_add(&set, ""));
+    TEST_ASSERT_EQUAL(1, set.count);
+    TEST_ASSERT_TRUE(dm_uid_set_contains(&set, "04a1B2c3"));
+    TEST_ASSERT_FALSE(dm_uid_set_contains(&set, "04A1B2C4"));
+    TEST_ASSERT_FALSE(dm_uid_set_contains(&set, ""));
+    dm_uid_set_clear(&set);
+    TEST_ASSERT_FALSE(dm_uid_set_contains(&set, "04A1B2C3"));
+}
+
+// Half of the probes miss, half hit.
+static int64_t time_lookups(const dm_uid_set_t *set, int size, int *hits)
+{
+    char uid[16];
+    *hits = 0;
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < UID_SET_BENCH_LOOKUPS; ++i) {
+        snprintf(uid, sizeof(uid), "CARD%05d", (i * 7919) % (size * 2));
+        *hits += dm_uid_set_contains(set, uid);
+    }
+    return esp_timer_get_time() - start;
+}
+
+// Lookup cost should not follow the list length.
+static void test_uid_set_large_lists(void)
+{
+    static const int sizes[] = {8, 64, 4096};
+    char uid[16];
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        dm_uid_set_t set = {0};
+        for (int i = 0; i < sizes[s]; ++i) {
+            snprintf(uid, sizeof(uid), "card%05d", i);
+            TEST_ASSERT_EQUAL(ESP_OK, dm_uid_set_add(&set, uid));
+        }
+        TEST_ASSERT_EQUAL(sizes[s], set.count);
+        TEST_ASSERT_TRUE(dm_uid_set_contains(&set, "CARD00000"));
+        snprintf(uid, sizeof(uid), "CARD%05d", sizes[s] - 1);
+        TEST_ASSERT_TRUE(dm_uid_set_contains(&set, uid));
+        int hits = 0;
+        int64_t us = time_lookups(&set, sizes[s], &hits);
+        TEST_ASSERT_TRUE(hits > 0 && hits < UID_SET_BENCH_LOOKUPS);
+        printf("uid set: %d uids, %u bytes, %.3f us/lookup\n",
+               sizes[s],
+               (unsigned)dm_uid_set_footprint(&set),
+               (double)us / UID_SET_BENCH_LOOKUPS);
+        dm_uid_set_clear(&set);
+    }
+}
+
+static void test_uid_runtime_csv_values(void)
+{
+    FILE *fp = fopen(UID_SET_TEST_CSV, "w");
+    if (!fp) {
+        TEST_IGNORE_MESSAGE("no writable storage for the CSV fixture");
+    }
+    fputs("uid,label\n# lobby tokens\n04AA0001,red\n\n \"04aa0002\" ;blue\n04AA0003\r\n", fp);
+    fclose(fp);
+
+    static dm_uid_template_t tpl;
+    dm_uid_template_clear(&tpl);
+    TEST_ASSERT_TRUE(dm_uid_template_set_slot(&tpl, 0, "lobby/reader", "Reader"));
+    TEST_ASSERT_TRUE(dm_uid_template_add_value(&tpl, 0, "INLINE01"));
+    TEST_ASSERT_TRUE(dm_uid_template_add_value(&tpl, 0, "@" UID_SET_TEST_CSV));
+
+    static dm_uid_runtime_t rt;
+    dm_uid_runtime_init(&rt, &tpl);
+    TEST_ASSERT_EQUAL(4, rt.values[0].count);
+    TEST_ASSERT_FALSE(dm_uid_set_contains(&rt.values[0], "uid"));
+    TEST_ASSERT_EQUAL(DM_UID_EVENT_SUCCESS, dm_uid_runtime_handle_value(&rt, "lobby/reader", "04aa0002").event);
+    TEST_ASSERT_EQUAL(DM_UID_EVENT_SUCCESS, dm_uid_runtime_handle_value(&rt, "lobby/reader", " inline01 ").event);
+    TEST_ASSERT_EQUAL(DM_UID_EVENT_INVALID, dm_uid_runtime_handle_value(&rt, "lobby/reader", "04AA0009").event);
+    dm_uid_runtime_deinit(&rt);
+
+    // An edited list changes the digest the apply path compares, so the reader is rebuilt.
+    uint64_t digest = dm_uid_template_files_digest(&tpl, 1);
+    TEST_ASSERT_TRUE(digest == dm_uid_template_files_digest(&tpl, 1));
+    fp = fopen(UID_SET_TEST_CSV, "a");
+    TEST_ASSERT_NOT_NULL(fp);
+    fputs("04AA0009\n", fp);
+    fclose(fp);
+    TEST_ASSERT_TRUE(digest != dm_uid_template_files_digest(&tpl, 1));
+    remove(UID_SET_TEST_CSV);
+}
+
+void register_uid_set_tests(void)
+{
+    RUN_TEST(test_uid_set_case_folding);
+    RUN_TEST(test_uid_set_large_lists);
+    RUN_TEST(test_uid_runtime_csv_values);
+}
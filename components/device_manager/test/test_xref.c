@@ -0,0 +1,165 @@
+#include "unity.h"
+#include "dm_config.h"
+#include "dm_storage.h"
+#include "dm_xref.h"
+#include "esp_heap_caps.h"
+#include <string.h>
+
+#define MISSING_TRACK DM_XREF_FILE_ROOT "/dm_xref_missing.mp3"
+
+static const char *k_room =
+    "{\"devices\":["
+    "{\"id\":\"door\",\"topics\":[{\"name\":\"open\",\"topic\":\"room/door/cmd\"},"
+    "                             {\"name\":\"nope\",\"topic\":\"room/door/+/x#\"}],"
+    " \"scenarios\":[{\"id\":\"open\",\"steps\":["
+    "     {\"type\":\"mqtt_publish\",\"topic\":\"room/door/cmd\",\"payload\":\"1\"},"
+    "     {\"type\":\"set_flag\",\"flag\":\"Door_Open\",\"value\":true},"
+    "     {\"type\":\"audio_play\",\"track\":\"" MISSING_TRACK "\"}]},"
+    "   {\"id\":\"OPEN\",\"steps\":[{\"type\":\"delay\",\"delay_ms\":5}]}],"
+    " \"template\":{\"type\":\"on_mqtt_event\",\"mqtt\":{\"rules\":["
+    "     {\"topic\":\"room/door/state\",\"payload\":\"x\",\"scenario\":\"ghost\"}]}}},"
+    "{\"id\":\"panel\",\"scenarios\":[{\"id\":\"go\",\"name\":\"Go now\",\"steps\":["
+    "     {\"type\":\"wait_flags\",\"wait\":{\"requirements\":[{\"flag\":\"door_open\"}]}}]}],"
+    " \"template\":{\"type\":\"on_flag\",\"flag\":{\"rules\":["
+    "     {\"flag\":\"door_open\",\"scenario\":\"Go now\"},"
+    "     {\"flag\":\"never\",\"scenario\":\"go\"}]}}}"
+    "]}";
+
+static const dm_xref_issue_t *find_issue(const dm_xref_t *x, dm_xref_code_t code, const char *ref)
+{
+    size_t count = 0;
+    const dm_xref_issue_t *issues = dm_xref_issues(x, &count);
+    for (size_t i = 0; i < count; ++i) {
+        if (issues[i].code == code && strcmp(issues[i].ref, ref) == 0) {
+            return &issues[i];
+        }
+    }
+    return NULL;
+}
+
+static size_t count_code(const dm_xref_t *x, dm_xref_code_t code)
+{
+    size_t count = 0, n = 0;
+    const dm_xref_issue_t *issues = dm_xref_issues(x, &count);
+    for (size_t i = 0; i < count; ++i) {
+        n += issues[i].code == code;
+    }
+    return n;
+}
+
+static device_manager_config_t *load_room(void)
+{
+    device_manager_config_t *cfg = dm_config_create(0);
+    if (cfg && dm_storage_parse_json(k_room, strlen(k_room), cfg) != ESP_OK) {
+        dm_config_destroy(cfg);
+        cfg = NULL;
+    }
+    return cfg;
+}
+
+static void test_xref_reports_broken_references(void)
+{
+    device_manager_config_t *cfg = load_room();
+    TEST_ASSERT_NOT_NULL(cfg);
+    TEST_ASSERT_EQUAL_UINT8(2, cfg->device_count);
+    dm_xref_t *x = dm_xref_create();
+    TEST_ASSERT_NOT_NULL(x);
+    TEST_ASSERT_EQUAL(ESP_OK, dm_xref_run(x, cfg, true));
+
+    const dm_xref_issue_t *issue = find_issue(x, DM_XREF_DUPLICATE_SCENARIO, "OPEN");
+    TEST_ASSERT_NOT_NULL(issue);
+    TEST_ASSERT_EQUAL_INT8(1, issue->scenario);
+    issue = find_issue(x, DM_XREF_MISSING_SCENARIO, "nope");
+    TEST_ASSERT_NOT_NULL(issue);
+    TEST_ASSERT_EQUAL_STRING("topics.name", issue->field);
+    TEST_ASSERT_EQUAL_INT8(1, issue->item);
+    TEST_ASSERT_NOT_NULL(find_issue(x, DM_XREF_BAD_TOPIC, "room/door/+/x#"));
+    issue = find_issue(x, DM_XREF_MISSING_SCENARIO, "ghost");
+    TEST_ASSERT_NOT_NULL(issue);
+    TEST_ASSERT_EQUAL_STRING("template.rules.scenario", issue->field);
+    issue = find_issue(x, DM_XREF_SELF_TRIGGER, "room/door/cmd");
+    TEST_ASSERT_NOT_NULL(issue);
+    TEST_ASSERT_EQUAL(DM_XREF_WARNING, issue->severity);
+    TEST_ASSERT_EQUAL_INT8(0, issue->step);
+    // Set on another device, in another case: only "never" is left unset.
+    issue = find_issue(x, DM_XREF_FLAG_NEVER_SET, "never");
+    TEST_ASSERT_NOT_NULL(issue);
+    TEST_ASSERT_EQUAL_UINT8(1, issue->device);
+    TEST_ASSERT_EQUAL_UINT(1, count_code(x, DM_XREF_FLAG_NEVER_SET));
+
+    dm_xref_summary_t summary;
+    dm_xref_get_summary(x, &summary);
+    TEST_ASSERT_EQUAL_UINT8(2, summary.rechecked);
+    if (summary.files_checked) {
+        TEST_ASSERT_NOT_NULL(find_issue(x, DM_XREF_MISSING_FILE, MISSING_TRACK));
+    }
+    TEST_ASSERT_EQUAL_UINT16(summary.files_checked ? 5 : 4, summary.errors);
+    TEST_ASSERT_EQUAL_UINT16(2, summary.warnings);
+
+    dm_json_buffer_t out = {0};
+    dm_json_writer_t w;
+    dm_json_writer_init(&w, dm_json_buffer_sink, &out);
+    dm_xref_write_json(x, cfg, &w);
+    TEST_ASSERT_EQUAL(ESP_OK, dm_json_writer_finish(&w));
+    TEST_ASSERT_NOT_NULL(strstr(out.data, "{\"severity\":\"error\",\"code\":\"missing_scenario\",\"device\":\"door\","
+                                          "\"item\":0,\"field\":\"template.rules.scenario\",\"ref\":\"ghost\"}"));
+    TEST_ASSERT_NOT_NULL(strstr(out.data, "\"code\":\"flag_never_set\",\"device\":\"panel\",\"item\":1,"));
+    heap_caps_free(out.data);
+
+    dm_xref_destroy(x);
+    dm_config_destroy(cfg);
+}
+
+static void test_xref_rechecks_only_changed_devices(void)
+{
+    device_manager_config_t *cfg = load_room();
+    TEST_ASSERT_NOT_NULL(cfg);
+    dm_xref_t *x = dm_xref_create();
+    TEST_ASSERT_EQUAL(ESP_OK, dm_xref_run(x, cfg, false));
+    size_t first = 0;
+    dm_xref_issues(x, &first);
+
+    // A new generation with the same content checks nothing again.
+    device_manager_config_t *next = dm_config_create(0);
+    TEST_ASSERT_EQUAL(ESP_OK, dm_config_copy(next, cfg));
+    dm_config_destroy(cfg);
+    dm_xref_summary_t summary;
+    TEST_ASSERT_EQUAL(ESP_OK, dm_xref_run(x, next, false));
+    dm_xref_get_summary(x, &summary);
+    TEST_ASSERT_EQUAL_UINT8(0, summary.rechecked);
+    size_t count = 0;
+    dm_xref_issues(x, &count);
+    TEST_ASSERT_EQUAL_UINT(first, count);
+
+    // The door stops setting the flag: only the door is checked, the panel's reads follow.
+    device_descriptor_t *door = &next->devices[0];
+    door->scenarios[0].steps[1].type = DEVICE_ACTION_DELAY;
+    TEST_ASSERT_EQUAL(ESP_OK, dm_xref_run(x, next, false));
+    dm_xref_get_summary(x, &summary);
+    TEST_ASSERT_EQUAL_UINT8(1, summary.rechecked);
+    TEST_ASSERT_EQUAL_UINT(3, count_code(x, DM_XREF_FLAG_NEVER_SET));
+
+    strcpy(door->template_config.data.mqtt.rules[0].scenario, "open");
+    TEST_ASSERT_EQUAL(ESP_OK, dm_xref_run(x, next, false));
+    dm_xref_get_summary(x, &summary);
+    TEST_ASSERT_EQUAL_UINT8(1, summary.rechecked);
+    TEST_ASSERT_NULL(find_issue(x, DM_XREF_MISSING_SCENARIO, "ghost"));
+    TEST_ASSERT_NOT_NULL(find_issue(x, DM_XREF_MISSING_SCENARIO, "nope"));
+
+    // Dropping the last device drops its results.
+    next->device_count = 1;
+    TEST_ASSERT_EQUAL(ESP_OK, dm_xref_run(x, next, false));
+    dm_xref_get_summary(x, &summary);
+    TEST_ASSERT_EQUAL_UINT8(0, summary.rechecked);
+    TEST_ASSERT_EQUAL_UINT(0, count_code(x, DM_XREF_FLAG_NEVER_SET));
+    next->device_count = 2;
+
+    dm_xref_destroy(x);
+    dm_config_destroy(next);
+}
+
+void register_xref_tests(void)
+{
+    RUN_TEST(test_xref_reports_broken_references);
+    RUN_TEST(test_xref_rechecks_only_changed_devices);
+}
@@ -1,7 +1,7 @@
 // NOTE: This bundle is generated from assets/wizard/*.js via build_devices_wizard.py.
 //       Edit the source modules rather than the assembled devices_wizard.js.
 (() => {
-const ACTION_TYPES = ['mqtt_publish','audio_play','audio_stop','set_flag','wait_flags','loop','delay','event','nop'];
+const ACTION_TYPES = ['mqtt_publish','audio_play','audio_stop','set_flag','wait_flags','loop','delay','event','parallel','join','nop'];
 const TEMPLATE_TYPES = [
   {value: '', label: 'No template'},
   {value: 'uid_validator', label: 'UID validator'},
@@ -286,7 +286,7 @@ function handleDetailInput(ev) {
   }
   validateRequiredFields();
 }
-function loadModel() {
+function loadModel(doneMsg) {
   setStatus('Loading...', '#fbbf24');
   state.busy = true;
   fetch('/api/devices/config')
@@ -306,7 +306,7 @@ function loadModel() {
       state.dirty = false;
       state.busy = false;
       renderAll();
-      setStatus('Loaded', '#22c55e');
+      setStatus(doneMsg || 'Loaded', '#22c55e');
     })
     .catch(err => {
       console.error(err);
@@ -330,10 +330,15 @@ function saveModel() {
       if (!r.ok) throw new Error('HTTP ' + r.status);
       return r.json().catch(() => ({}));
     })
-    .then(() => {
+    .then(resp => {
       state.busy = false;
       state.dirty = false;
-      setStatus('Saved', '#22c55e');
+      if (resp && resp.persist_pending) {
+        setStatus('Applied, saving to SD...', '#fbbf24');
+        waitPersisted(resp.generation || 0, 0);
+      } else {
+        setStatus('Saved', '#22c55e');
+      }
       renderActions();
     })
     .catch(err => {
@@ -342,6 +347,31 @@ function saveModel() {
     });
 }
 
+// The device writes the SD copy in the background after apply; follow it via /api/status.
+function waitPersisted(generation, attempt) {
+  if (attempt >= 20) {
+    setStatus('Applied, SD write still pending', '#fbbf24');
+    return;
+  }
+  setTimeout(() => {
+    fetch('/api/status')
+      .then(r => r.ok ? r.json() : null)
+      .then(st => {
+        const dev = st && st.devices;
+        if (!dev) return;
+        if (dev.persisted_generation >= generation) {
+          setStatus('Saved', '#22c55e');
+        } else if (dev.persist_error) {
+          setStatus('Applied, SD write failed: ' + dev.persist_error + ' (retrying)', '#f87171');
+          waitPersisted(generation, attempt + 1);
+        } else {
+          waitPersisted(generation, attempt + 1);
+        }
+      })
+      .catch(() => waitPersisted(generation, attempt + 1));
+  }, 500);
+}
+
 function markDirty() {
   state.dirty = true;
   renderJson();
@@ -564,11 +594,49 @@ function renderSignalTemplate(dev) {
     </div>`;
 }
 
+const RATE_LIMIT_MODES = [
+  ['default', 'No limit'],
+  ['debounce', 'Debounce'],
+  ['throttle', 'Throttle'],
+];
+const RATE_LIMIT_EDGES = [
+  ['leading', 'First event'],
+  ['trailing', 'Last event'],
+  ['both', 'First and last'],
+];
+
+// attrs: data-* attributes that route the input back to its rule or topic.
+function renderRateLimitFields(attrs, limit) {
+  const lim = limit || {};
+  const mode = lim.mode || 'default';
+  const options = (list, current) => list.map(([value, label]) =>
+    `<option value="${value}" ${value === current ? 'selected' : ''}>${label}</option>`).join('');
+  const field = sub => attrs.replace('{sub}', sub);
+  if (mode === 'default' || mode === 'none') {
+    return `<div class="dw-field"><label>Rate limit</label><select ${field('limit_mode')}>${options(RATE_LIMIT_MODES, mode)}</select></div>`;
+  }
+  return `
+      <div class="dw-field"><label>Rate limit</label><select ${field('limit_mode')}>${options(RATE_LIMIT_MODES, mode)}</select></div>
+      <div class="dw-field"><label>Window, ms</label><input type="number" min="0" ${field('limit_window_ms')} value="${escapeAttr(lim.window_ms ?? '')}" placeholder="300"></div>
+      <div class="dw-field"><label>Act on</label><select ${field('limit_edges')}>${options(RATE_LIMIT_EDGES, lim.edges || 'leading')}</select></div>`;
+}
+
+const MQTT_MATCH_MODES = [
+  ['exact', 'Exact payload'],
+  ['prefix', 'Starts with payload'],
+  ['contains', 'Contains payload'],
+  ['equals_nocase', 'Equals payload (any case)'],
+  ['range', 'Number in range'],
+];
+
 function renderMqttTemplate(dev) {
   ensureMqttTemplate(dev);
   const tpl = dev.template?.mqtt || {rules: []};
   const rules = (tpl.rules || []).map((rule, idx) => {
     const checked = rule.payload_required ? 'checked' : '';
+    const match = rule.match || 'exact';
+    const matchOptions = MQTT_MATCH_MODES.map(([value, label]) =>
+      `<option value="${value}" ${value === match ? 'selected' : ''}>${label}</option>`).join('');
     return `
     <div class="dw-slot">
       <div class="dw-slot-head">Rule ${idx + 1}<button class="danger small" data-action="mqtt-rule-remove" data-index="${idx}">&times;</button></div>
@@ -576,6 +644,12 @@ function renderMqttTemplate(dev) {
       <div class="dw-field"><label>Topic</label><input data-template-field="mqtt-rule" data-subfield="topic" data-index="${idx}" value="${escapeAttr(rule.topic || '')}" placeholder="sensor/topic"></div>
       <div class="dw-field"><label>Payload</label><input data-template-field="mqtt-rule" data-subfield="payload" data-index="${idx}" value="${escapeAttr(rule.payload || '')}" placeholder="payload"></div>
       <div class="dw-field dw-checkbox-field"><label><input type="checkbox" data-template-field="mqtt-rule" data-subfield="payload_required" data-index="${idx}" ${checked}>Match payload</label></div>
+      <div class="dw-field"><label>Match</label><select data-template-field="mqtt-rule" data-subfield="match" data-index="${idx}">${matchOptions}</select></div>
+      <div class="dw-field"><label>JSON field</label><input data-template-field="mqtt-rule" data-subfield="field" data-index="${idx}" value="${escapeAttr(rule.field || '')}" placeholder="whole payload, or e.g. dist / pos.x / list[0]"></div>
+      ${match === 'range' ? `
+      <div class="dw-field"><label>Min</label><input type="number" step="any" data-template-field="mqtt-rule" data-subfield="min" data-index="${idx}" value="${escapeAttr(rule.min ?? '')}" placeholder="no lower bound"></div>
+      <div class="dw-field"><label>Max</label><input type="number" step="any" data-template-field="mqtt-rule" data-subfield="max" data-index="${idx}" value="${escapeAttr(rule.max ?? '')}" placeholder="no upper bound"></div>` : ''}
+      ${renderRateLimitFields(`data-template-field="mqtt-rule" data-subfield="{sub}" data-index="${idx}"`, rule.limit)}
       <div class="dw-field"><label>Scenario ID</label><input data-template-field="mqtt-rule" data-subfield="scenario" data-index="${idx}" value="${escapeAttr(rule.scenario || '')}" placeholder="scenario_id"></div>
     </div>`;
   }).join('');
@@ -606,6 +680,7 @@ function renderFlagTemplate(dev) {
           <option value="false" ${!rule.required_state ? 'selected' : ''}>Flag becomes FALSE</option>
         </select>
       </div>
+      ${renderRateLimitFields(`data-template-field="flag-rule" data-subfield="{sub}" data-index="${idx}"`, rule.limit)}
       <div class="dw-field"><label>Scenario ID</label><input data-template-field="flag-rule" data-subfield="scenario" data-index="${idx}" value="${escapeAttr(rule.scenario || '')}" placeholder="scenario_id"></div>
     </div>`;
   }).join('');
@@ -722,6 +797,7 @@ function renderTopicsSection(dev) {
     <tr>
       <td><input data-topic-field="name" data-index="${idx}" value="${escapeAttr(topic.name || '')}" placeholder="Name"></td>
       <td><input data-topic-field="topic" data-index="${idx}" value="${escapeAttr(topic.topic || '')}" placeholder="mqtt/topic"></td>
+      <td>${renderRateLimitFields(`data-topic-field="{sub}" data-index="${idx}"`, topic.limit)}</td>
       <td><button class="danger small" data-action="remove-topic" data-index="${idx}">&times;</button></td>
     </tr>`).join('');
   return `
@@ -731,8 +807,8 @@ function renderTopicsSection(dev) {
         <div class="dw-table-actions"><button data-action="add-topic">Add topic</button></div>
       </div>
       <table class="dw-mini-table">
-        <thead><tr><th>Name</th><th>Topic</th><th></th></tr></thead>
-        <tbody>${rows || "<tr><td colspan='3' class='muted small'>No topics</td></tr>"}</tbody>
+        <thead><tr><th>Name</th><th>Topic</th><th>Limit</th><th></th></tr></thead>
+        <tbody>${rows || "<tr><td colspan='4' class='muted small'>No topics</td></tr>"}</tbody>
       </table>
     </div>`;
 }
@@ -869,6 +945,14 @@ function renderStepFields(step, idx) {
         <div class="dw-field"><label>Event</label><input data-step-field="data.event.event" data-index="${idx}" value="${escapeAttr(step.data.event.event || '')}"></div>
         <div class="dw-field"><label>Topic</label><input data-step-field="data.event.topic" data-index="${idx}" value="${escapeAttr(step.data.event.topic || '')}"></div>
         <div class="dw-field"><label>Payload</label><input data-step-field="data.event.payload" data-index="${idx}" value="${escapeAttr(step.data.event.payload || '')}"></div>`;
+    case 'parallel':
+      ensure(step, ['data','parallel']);
+      return `
+        <div class="dw-field"><label>Steps in group</label><input type="number" min="1" data-step-field="data.parallel.count" data-index="${idx}" value="${step.data.parallel.count || 0}"></div>`;
+    case 'join':
+      ensure(step, ['data','join']);
+      return `
+        <div class="dw-field"><label>Timeout ms</label><input type="number" data-step-field="data.join.timeout_ms" data-index="${idx}" value="${step.data.join.timeout_ms || 0}"></div>`;
     default:
       return '';
   }
@@ -1065,11 +1149,34 @@ function updateDeviceField(field, value) {
   refreshRequiredIndicators();
 }
 
+// limit_* inputs edit owner.limit; returns false for any other field.
+function applyRateLimitField(owner, field, value) {
+  if (!field.startsWith('limit_')) return false;
+  const key = field.slice('limit_'.length);
+  const limit = owner.limit || {mode: 'default', edges: 'leading', window_ms: 300};
+  if (key === 'window_ms') {
+    limit.window_ms = Math.max(parseInt(value, 10) || 0, 0);
+  } else {
+    limit[key] = value;
+  }
+  if (limit.mode === 'default') {
+    delete owner.limit;
+  } else {
+    owner.limit = limit;
+  }
+  if (key === 'mode') {
+    renderDeviceDetail();
+  }
+  return true;
+}
+
 function updateTopicField(indexStr, field, value) {
   const idx = parseInt(indexStr, 10);
   const dev = currentDevice();
   if (!dev || isNaN(idx) || !dev.topics || !dev.topics[idx]) return;
-  dev.topics[idx][field] = value;
+  if (!applyRateLimitField(dev.topics[idx], field, value)) {
+    dev.topics[idx][field] = value;
+  }
   markDirty();
 }
 
@@ -1134,10 +1241,23 @@ function updateTemplateField(el) {
       const idx = parseInt(el.dataset.index, 10);
       if (Number.isNaN(idx) || !tpl.rules[idx]) return;
       const sub = el.dataset.subfield;
+      if (applyRateLimitField(tpl.rules[idx], sub, el.value)) {
+        break;
+      }
       if (sub === 'payload_required') {
         tpl.rules[idx].payload_required = el.type === 'checkbox' ? el.checked : el.value === 'true';
+      } else if (sub === 'min' || sub === 'max') {
+        const num = parseFloat(el.value);
+        if (Number.isNaN(num)) {
+          delete tpl.rules[idx][sub];
+        } else {
+          tpl.rules[idx][sub] = num;
+        }
       } else {
         tpl.rules[idx][sub] = el.value;
+        if (sub === 'match') {
+          renderDeviceDetail();
+        }
       }
       break;
     }
@@ -1148,6 +1268,9 @@ function updateTemplateField(el) {
       const idx = parseInt(el.dataset.index, 10);
       if (Number.isNaN(idx) || !tpl.rules[idx]) return;
       const sub = el.dataset.subfield;
+      if (applyRateLimitField(tpl.rules[idx], sub, el.value)) {
+        break;
+      }
       if (sub === 'state') {
         tpl.rules[idx].required_state = el.value === 'true';
       } else {
@@ -1515,6 +1638,8 @@ function ensureMqttTemplate(dev) {
     rule.payload = rule.payload || '';
     rule.scenario = rule.scenario || '';
     rule.payload_required = !!rule.payload_required;
+    rule.match = rule.match || 'exact';
+    rule.field = rule.field || '';
   });
 }
 
@@ -1902,6 +2027,20 @@ function normalizeStepForEditing(step) {
       if (event.payload === undefined) event.payload = step.payload || '';
       break;
     }
+    case 'parallel': {
+      const parallel = step.data.parallel = step.data.parallel || {};
+      if (parallel.count === undefined) {
+        parallel.count = (step.parallel && typeof step.parallel.count === 'number') ? step.parallel.count : 0;
+      }
+      break;
+    }
+    case 'join': {
+      const join = step.data.join = step.data.join || {};
+      if (join.timeout_ms === undefined) {
+        join.timeout_ms = (step.join && typeof step.join.timeout_ms === 'number') ? step.join.timeout_ms : 0;
+      }
+      break;
+    }
     default:
       break;
   }
@@ -2001,6 +2140,16 @@ function serializeStepForSave(step) {
       out.payload = event.payload || '';
       break;
     }
+    case 'parallel': {
+      const parallel = (safe.data && safe.data.parallel) || {};
+      out.parallel = {count: toInt(parallel.count)};
+      break;
+    }
+    case 'join': {
+      const join = (safe.data && safe.data.join) || {};
+      out.join = {timeout_ms: toInt(join.timeout_ms)};
+      break;
+    }
     case 'audio_stop':
     case 'delay':
     case 'nop':
@@ -2319,7 +2468,15 @@ function activateProfile(id) {
   state.activeProfile = id;
   renderProfiles();
   fetch('/api/devices/profile/activate?id=' + encodeURIComponent(id), {method: 'POST'})
-    .then(() => loadModel())
+    .then(r => r.ok ? r.json() : {})
+    .then(resp => {
+      let msg = '';
+      if (resp && typeof resp.switch_us === 'number') {
+        msg = 'Switched in ' + (resp.switch_us / 1000).toFixed(1) + ' ms (' +
+          (resp.cached ? 'cached' : 'from SD') + ', cache ' + resp.hits + ' hits / ' + resp.misses + ' misses)';
+      }
+      loadModel(msg);
+    })
     .catch(err => setStatus('Activate failed: ' + err.message, '#f87171'));
 }
 
@@ -1,7 +1,7 @@
 // NOTE: This bundle is generated from assets/wizard/*.js via build_devices_wizard.py.
 //       Edit the source modules rather than the assembled devices_wizard.js.
 (() => {
-const ACTION_TYPES = ['mqtt_publish','audio_play','audio_stop','set_flag','wait_flags','loop','delay','event','nop'];
+const ACTION_TYPES = ['mqtt_publish','audio_play','audio_stop','set_flag','wait_flags','loop','delay','event','parallel','join','nop'];
 const TEMPLATE_TYPES = [
   {value: '', label: 'No template'},
   {value: 'uid_validator', label: 'UID validator'},
@@ -1,4 +1,4 @@
-function loadModel() {
+function loadModel(doneMsg) {
   setStatus('Loading...', '#fbbf24');
   state.busy = true;
   fetch('/api/devices/config')
@@ -18,7 +18,7 @@ function loadModel() {
       state.dirty = false;
       state.busy = false;
       renderAll();
-      setStatus('Loaded', '#22c55e');
+      setStatus(doneMsg || 'Loaded', '#22c55e');
     })
     .catch(err => {
       console.error(err);
@@ -42,10 +42,15 @@ function saveModel() {
       if (!r.ok) throw new Error('HTTP ' + r.status);
       return r.json().catch(() => ({}));
     })
-    .then(() => {
+    .then(resp => {
       state.busy = false;
       state.dirty = false;
-      setStatus('Saved', '#22c55e');
+      if (resp && resp.persist_pending) {
+        setStatus('Applied, saving to SD...', '#fbbf24');
+        waitPersisted(resp.generation || 0, 0);
+      } else {
+        setStatus('Saved', '#22c55e');
+      }
       renderActions();
     })
     .catch(err => {
@@ -54,6 +59,31 @@ function saveModel() {
     });
 }
 
+// The device writes the SD copy in the background after apply; follow it via /api/status.
+function waitPersisted(generation, attempt) {
+  if (attempt >= 20) {
+    setStatus('Applied, SD write still pending', '#fbbf24');
+    return;
+  }
+  setTimeout(() => {
+    fetch('/api/status')
+      .then(r => r.ok ? r.json() : null)
+      .then(st => {
+        const dev = st && st.devices;
+        if (!dev) return;
+        if (dev.persisted_generation >= generation) {
+          setStatus('Saved', '#22c55e');
+        } else if (dev.persist_error) {
+          setStatus('Applied, SD write failed: ' + dev.persist_error + ' (retrying)', '#f87171');
+          waitPersisted(generation, attempt + 1);
+        } else {
+          waitPersisted(generation, attempt + 1);
+        }
+      })
+      .catch(() => waitPersisted(generation, attempt + 1));
+  }, 500);
+}
+
 function markDirty() {
   state.dirty = true;
   renderJson();
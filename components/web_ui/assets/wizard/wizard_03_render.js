@@ -177,11 +177,49 @@ function renderSignalTemplate(dev) {
     </div>`;
 }
 
+const RATE_LIMIT_MODES = [
+  ['default', 'No limit'],
+  ['debounce', 'Debounce'],
+  ['throttle', 'Throttle'],
+];
+const RATE_LIMIT_EDGES = [
+  ['leading', 'First event'],
+  ['trailing', 'Last event'],
+  ['both', 'First and last'],
+];
+
+// attrs: data-* attributes that route the input back to its rule or topic.
+function renderRateLimitFields(attrs, limit) {
+  const lim = limit || {};
+  const mode = lim.mode || 'default';
+  const options = (list, current) => list.map(([value, label]) =>
+    `<option value="${value}" ${value === current ? 'selected' : ''}>${label}</option>`).join('');
+  const field = sub => attrs.replace('{sub}', sub);
+  if (mode === 'default' || mode === 'none') {
+    return `<div class="dw-field"><label>Rate limit</label><select ${field('limit_mode')}>${options(RATE_LIMIT_MODES, mode)}</select></div>`;
+  }
+  return `
+      <div class="dw-field"><label>Rate limit</label><select ${field('limit_mode')}>${options(RATE_LIMIT_MODES, mode)}</select></div>
+      <div class="dw-field"><label>Window, ms</label><input type="number" min="0" ${field('limit_window_ms')} value="${escapeAttr(lim.window_ms ?? '')}" placeholder="300"></div>
+      <div class="dw-field"><label>Act on</label><select ${field('limit_edges')}>${options(RATE_LIMIT_EDGES, lim.edges || 'leading')}</select></div>`;
+}
+
+const MQTT_MATCH_MODES = [
+  ['exact', 'Exact payload'],
+  ['prefix', 'Starts with payload'],
+  ['contains', 'Contains payload'],
+  ['equals_nocase', 'Equals payload (any case)'],
+  ['range', 'Number in range'],
+];
+
 function renderMqttTemplate(dev) {
   ensureMqttTemplate(dev);
   const tpl = dev.template?.mqtt || {rules: []};
   const rules = (tpl.rules || []).map((rule, idx) => {
     const checked = rule.payload_required ? 'checked' : '';
+    const match = rule.match || 'exact';
+    const matchOptions = MQTT_MATCH_MODES.map(([value, label]) =>
+      `<option value="${value}" ${value === match ? 'selected' : ''}>${label}</option>`).join('');
     return `
     <div class="dw-slot">
       <div class="dw-slot-head">Rule ${idx + 1}<button class="danger small" data-action="mqtt-rule-remove" data-index="${idx}">&times;</button></div>
@@ -189,6 +227,12 @@ function renderMqttTemplate(dev) {
       <div class="dw-field"><label>Topic</label><input data-template-field="mqtt-rule" data-subfield="topic" data-index="${idx}" value="${escapeAttr(rule.topic || '')}" placeholder="sensor/topic"></div>
       <div class="dw-field"><label>Payload</label><input data-template-field="mqtt-rule" data-subfield="payload" data-index="${idx}" value="${escapeAttr(rule.payload || '')}" placeholder="payload"></div>
       <div class="dw-field dw-checkbox-field"><label><input type="checkbox" data-template-field="mqtt-rule" data-subfield="payload_required" data-index="${idx}" ${checked}>Match payload</label></div>
+      <div class="dw-field"><label>Match</label><select data-template-field="mqtt-rule" data-subfield="match" data-index="${idx}">${matchOptions}</select></div>
+      <div class="dw-field"><label>JSON field</label><input data-template-field="mqtt-rule" data-subfield="field" data-index="${idx}" value="${escapeAttr(rule.field || '')}" placeholder="whole payload, or e.g. dist / pos.x / list[0]"></div>
+      ${match === 'range' ? `
+      <div class="dw-field"><label>Min</label><input type="number" step="any" data-template-field="mqtt-rule" data-subfield="min" data-index="${idx}" value="${escapeAttr(rule.min ?? '')}" placeholder="no lower bound"></div>
+      <div class="dw-field"><label>Max</label><input type="number" step="any" data-template-field="mqtt-rule" data-subfield="max" data-index="${idx}" value="${escapeAttr(rule.max ?? '')}" placeholder="no upper bound"></div>` : ''}
+      ${renderRateLimitFields(`data-template-field="mqtt-rule" data-subfield="{sub}" data-index="${idx}"`, rule.limit)}
       <div class="dw-field"><label>Scenario ID</label><input data-template-field="mqtt-rule" data-subfield="scenario" data-index="${idx}" value="${escapeAttr(rule.scenario || '')}" placeholder="scenario_id"></div>
     </div>`;
   }).join('');
@@ -219,6 +263,7 @@ function renderFlagTemplate(dev) {
           <option value="false" ${!rule.required_state ? 'selected' : ''}>Flag becomes FALSE</option>
         </select>
       </div>
+      ${renderRateLimitFields(`data-template-field="flag-rule" data-subfield="{sub}" data-index="${idx}"`, rule.limit)}
       <div class="dw-field"><label>Scenario ID</label><input data-template-field="flag-rule" data-subfield="scenario" data-index="${idx}" value="${escapeAttr(rule.scenario || '')}" placeholder="scenario_id"></div>
     </div>`;
   }).join('');
@@ -335,6 +380,7 @@ function renderTopicsSection(dev) {
     <tr>
       <td><input data-topic-field="name" data-index="${idx}" value="${escapeAttr(topic.name || '')}" placeholder="Name"></td>
       <td><input data-topic-field="topic" data-index="${idx}" value="${escapeAttr(topic.topic || '')}" placeholder="mqtt/topic"></td>
+      <td>${renderRateLimitFields(`data-topic-field="{sub}" data-index="${idx}"`, topic.limit)}</td>
       <td><button class="danger small" data-action="remove-topic" data-index="${idx}">&times;</button></td>
     </tr>`).join('');
   return `
@@ -344,8 +390,8 @@ function renderTopicsSection(dev) {
         <div class="dw-table-actions"><button data-action="add-topic">Add topic</button></div>
       </div>
       <table class="dw-mini-table">
-        <thead><tr><th>Name</th><th>Topic</th><th></th></tr></thead>
-        <tbody>${rows || "<tr><td colspan='3' class='muted small'>No topics</td></tr>"}</tbody>
+        <thead><tr><th>Name</th><th>Topic</th><th>Limit</th><th></th></tr></thead>
+        <tbody>${rows || "<tr><td colspan='4' class='muted small'>No topics</td></tr>"}</tbody>
       </table>
     </div>`;
 }
@@ -482,6 +528,14 @@ function renderStepFields(step, idx) {
         <div class="dw-field"><label>Event</label><input data-step-field="data.event.event" data-index="${idx}" value="${escapeAttr(step.data.event.event || '')}"></div>
         <div class="dw-field"><label>Topic</label><input data-step-field="data.event.topic" data-index="${idx}" value="${escapeAttr(step.data.event.topic || '')}"></div>
         <div class="dw-field"><label>Payload</label><input data-step-field="data.event.payload" data-index="${idx}" value="${escapeAttr(step.data.event.payload || '')}"></div>`;
+    case 'parallel':
+      ensure(step, ['data','parallel']);
+      return `
+        <div class="dw-field"><label>Steps in group</label><input type="number" min="1" data-step-field="data.parallel.count" data-index="${idx}" value="${step.data.parallel.count || 0}"></div>`;
+    case 'join':
+      ensure(step, ['data','join']);
+      return `
+        <div class="dw-field"><label>Timeout ms</label><input type="number" data-step-field="data.join.timeout_ms" data-index="${idx}" value="${step.data.join.timeout_ms || 0}"></div>`;
     default:
       return '';
   }
@@ -190,11 +190,34 @@ function updateDeviceField(field, value) {
   refreshRequiredIndicators();
 }
 
+// limit_* inputs edit owner.limit; returns false for any other field.
+function applyRateLimitField(owner, field, value) {
+  if (!field.startsWith('limit_')) return false;
+  const key = field.slice('limit_'.length);
+  const limit = owner.limit || {mode: 'default', edges: 'leading', window_ms: 300};
+  if (key === 'window_ms') {
+    limit.window_ms = Math.max(parseInt(value, 10) || 0, 0);
+  } else {
+    limit[key] = value;
+  }
+  if (limit.mode === 'default') {
+    delete owner.limit;
+  } else {
+    owner.limit = limit;
+  }
+  if (key === 'mode') {
+    renderDeviceDetail();
+  }
+  return true;
+}
+
 function updateTopicField(indexStr, field, value) {
   const idx = parseInt(indexStr, 10);
   const dev = currentDevice();
   if (!dev || isNaN(idx) || !dev.topics || !dev.topics[idx]) return;
-  dev.topics[idx][field] = value;
+  if (!applyRateLimitField(dev.topics[idx], field, value)) {
+    dev.topics[idx][field] = value;
+  }
   markDirty();
 }
 
@@ -259,10 +282,23 @@ function updateTemplateField(el) {
       const idx = parseInt(el.dataset.index, 10);
       if (Number.isNaN(idx) || !tpl.rules[idx]) return;
       const sub = el.dataset.subfield;
+      if (applyRateLimitField(tpl.rules[idx], sub, el.value)) {
+        break;
+      }
       if (sub === 'payload_required') {
         tpl.rules[idx].payload_required = el.type === 'checkbox' ? el.checked : el.value === 'true';
+      } else if (sub === 'min' || sub === 'max') {
+        const num = parseFloat(el.value);
+        if (Number.isNaN(num)) {
+          delete tpl.rules[idx][sub];
+        } else {
+          tpl.rules[idx][sub] = num;
+        }
       } else {
         tpl.rules[idx][sub] = el.value;
+        if (sub === 'match') {
+          renderDeviceDetail();
+        }
       }
       break;
     }
@@ -273,6 +309,9 @@ function updateTemplateField(el) {
       const idx = parseInt(el.dataset.index, 10);
       if (Number.isNaN(idx) || !tpl.rules[idx]) return;
       const sub = el.dataset.subfield;
+      if (applyRateLimitField(tpl.rules[idx], sub, el.value)) {
+        break;
+      }
       if (sub === 'state') {
         tpl.rules[idx].required_state = el.value === 'true';
       } else {
@@ -640,6 +679,8 @@ function ensureMqttTemplate(dev) {
     rule.payload = rule.payload || '';
     rule.scenario = rule.scenario || '';
     rule.payload_required = !!rule.payload_required;
+    rule.match = rule.match || 'exact';
+    rule.field = rule.field || '';
   });
 }
 
@@ -1027,6 +1068,20 @@ function normalizeStepForEditing(step) {
       if (event.payload === undefined) event.payload = step.payload || '';
       break;
     }
+    case 'parallel': {
+      const parallel = step.data.parallel = step.data.parallel || {};
+      if (parallel.count === undefined) {
+        parallel.count = (step.parallel && typeof step.parallel.count === 'number') ? step.parallel.count : 0;
+      }
+      break;
+    }
+    case 'join': {
+      const join = step.data.join = step.data.join || {};
+      if (join.timeout_ms === undefined) {
+        join.timeout_ms = (step.join && typeof step.join.timeout_ms === 'number') ? step.join.timeout_ms : 0;
+      }
+      break;
+    }
     default:
       break;
   }
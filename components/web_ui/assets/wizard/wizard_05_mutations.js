@@ -93,6 +93,16 @@ function serializeStepForSave(step) {
       out.payload = event.payload || '';
       break;
     }
+    case 'parallel': {
+      const parallel = (safe.data && safe.data.parallel) || {};
+      out.parallel = {count: toInt(parallel.count)};
+      break;
+    }
+    case 'join': {
+      const join = (safe.data && safe.data.join) || {};
+      out.join = {timeout_ms: toInt(join.timeout_ms)};
+      break;
+    }
     case 'audio_stop':
     case 'delay':
     case 'nop':
@@ -411,7 +421,15 @@ function activateProfile(id) {
   state.activeProfile = id;
   renderProfiles();
   fetch('/api/devices/profile/activate?id=' + encodeURIComponent(id), {method: 'POST'})
-    .then(() => loadModel())
+    .then(r => r.ok ? r.json() : {})
+    .then(resp => {
+      let msg = '';
+      if (resp && typeof resp.switch_us === 'number') {
+        msg = 'Switched in ' + (resp.switch_us / 1000).toFixed(1) + ' ms (' +
+          (resp.cached ? 'cached' : 'from SD') + ', cache ' + resp.hits + ' hits / ' + resp.misses + ' misses)';
+      }
+      loadModel(msg);
+    })
     .catch(err => setStatus('Activate failed: ' + err.message, '#f87171'));
 }
 
@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <dirent.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
@@ -24,6 +25,8 @@
 #include "mqtt_core.h"
 #include "device_manager.h"
 #include "automation_engine.h"
+#include "automation_scheduler.h"
+#include "automation_trace.h"
 #include "dm_template_runtime.h"
 #include "cJSON.h"
 #include "driver/gpio.h"
@@ -44,6 +47,7 @@
 #define WEB_SESSION_TOKEN_LEN       64
 #define WEB_SESSION_TTL_US          (12LL * 60 * 60 * 1000000)
 #define WEB_AUTH_RESET_HOLD_US      (10LL * 1000000)
+#define WEB_BULK_IMPORT_MAX_BYTES   (4u * 1024 * 1024)     // every profile, decoded into PSRAM
 
 typedef esp_err_t (*web_handler_fn)(httpd_req_t *);
 
@@ -68,6 +72,8 @@ static TaskHandle_t s_reset_task = NULL;
 #endif
 
 static esp_err_t devices_templates_handler(httpd_req_t *req);
+static esp_err_t automation_scheduler_handler(httpd_req_t *req);
+static esp_err_t automation_stats_handler(httpd_req_t *req);
 static char *build_uid_monitor_json(void);
 static char *build_mqtt_users_json(const app_mqtt_config_t *mqtt_cfg);
 static esp_err_t mqtt_users_handler(httpd_req_t *req);
@@ -93,14 +99,13 @@ static char *dup_empty_json_array(void)
 
 static char *build_uid_monitor_json(void)
 {
-    const device_manager_config_t *cfg = device_manager_lock_config();
+    const device_manager_config_t *cfg = device_manager_acquire_config();
     if (!cfg) {
-        device_manager_unlock_config();
         return dup_empty_json_array();
     }
     cJSON *root = cJSON_CreateArray();
     if (!root) {
-        device_manager_unlock_config();
+        device_manager_release_config(cfg);
         return dup_empty_json_array();
     }
     uint8_t limit = cfg->device_capacity ? cfg->device_capacity : DEVICE_MANAGER_MAX_DEVICES;
@@ -112,7 +117,7 @@ static char *build_uid_monitor_json(void)
         cJSON *dev_obj = cJSON_CreateObject();
         if (!dev_obj) {
             cJSON_Delete(root);
-            device_manager_unlock_config();
+            device_manager_release_config(cfg);
             return dup_empty_json_array();
         }
         cJSON_AddStringToObject(dev_obj, "id", dev->id);
@@ -120,7 +125,7 @@ static char *build_uid_monitor_json(void)
         cJSON *slot_arr = cJSON_AddArrayToObject(dev_obj, "slots");
         if (!slot_arr) {
             cJSON_Delete(root);
-            device_manager_unlock_config();
+            device_manager_release_config(cfg);
             return dup_empty_json_array();
         }
         dm_uid_runtime_snapshot_t snapshot;
@@ -138,7 +143,7 @@ static char *build_uid_monitor_json(void)
             cJSON *slot_obj = cJSON_CreateObject();
             if (!slot_obj) {
                 cJSON_Delete(root);
-                device_manager_unlock_config();
+                device_manager_release_config(cfg);
                 return dup_empty_json_array();
             }
             cJSON_AddNumberToObject(slot_obj, "index", s);
@@ -156,7 +161,7 @@ static char *build_uid_monitor_json(void)
     }
     char *printed = cJSON_PrintUnformatted(root);
     cJSON_Delete(root);
-    device_manager_unlock_config();
+    device_manager_release_config(cfg);
     if (!printed) {
         return dup_empty_json_array();
     }
@@ -680,6 +685,11 @@ static esp_err_t status_handler(httpd_req_t *req)
         "\"sd\":{\"ok\":%s,\"total\":%llu,\"free\":%llu},"
         "\"diag\":{\"verbose_logging\":%s},"
         "\"clients\":{\"total\":%u},"
+        "\"devices\":{\"generation\":%" PRIu32 ",\"persisted_generation\":%" PRIu32 ","
+        "\"persist_pending\":%s,\"persist_error\":\"%s\","
+        "\"profile_cache\":{\"hits\":%" PRIu32 ",\"misses\":%" PRIu32 ",\"evictions\":%" PRIu32 ","
+        "\"entries\":%u,\"bytes\":%u,\"budget\":%u,\"last_switch_us\":%" PRIu32 ",\"last_switch_cached\":%s,"
+        "\"hit_avg_us\":%" PRIu32 ",\"miss_avg_us\":%" PRIu32 "}},"
         "\"uid_monitor\":%s}";
     mqtt_client_stats_t stats;
     mqtt_core_get_client_stats(&stats);
@@ -689,6 +699,11 @@ static esp_err_t status_handler(httpd_req_t *req)
     bool sd_ok = (esp_vfs_fat_info("/sdcard", &kb_total, &kb_free) == ESP_OK);
     uint64_t sd_total = sd_ok ? kb_total : 0;
     uint64_t sd_free = sd_ok ? kb_free : 0;
+    device_manager_persist_status_t persist;
+    device_manager_get_persist_status(&persist);
+    const char *persist_error = persist.last_error == ESP_OK ? "" : esp_err_to_name(persist.last_error);
+    device_manager_profile_cache_status_t pcache;
+    device_manager_get_profile_cache_status(&pcache);
     int needed = snprintf(NULL, 0, fmt,
                           cfg->wifi.ssid, cfg->wifi.hostname, ip_buf, network_is_ap_mode() ? "true" : "false",
                           cfg->mqtt.broker_id, cfg->mqtt.port, cfg->mqtt.keepalive_seconds,
@@ -709,6 +724,20 @@ static esp_err_t status_handler(httpd_req_t *req)
                           (unsigned long long)sd_free,
                           cfg->verbose_logging ? "true" : "false",
                           stats.total,
+                          persist.generation,
+                          persist.persisted_generation,
+                          persist.persist_pending ? "true" : "false",
+                          persist_error,
+                          pcache.hits,
+                          pcache.misses,
+                          pcache.evictions,
+                          (unsigned)pcache.entries,
+                          (unsigned)pcache.bytes,
+                          (unsigned)pcache.budget,
+                          pcache.last_switch_us,
+                          pcache.last_switch_cached ? "true" : "false",
+                          pcache.hit_avg_us,
+                          pcache.miss_avg_us,
                           uid_json ? uid_json : "[]");
     if (needed < 0) {
         if (uid_json) {
@@ -750,6 +779,20 @@ static esp_err_t status_handler(httpd_req_t *req)
              (unsigned long long)sd_free,
              cfg->verbose_logging ? "true" : "false",
              stats.total,
+             persist.generation,
+             persist.persisted_generation,
+             persist.persist_pending ? "true" : "false",
+             persist_error,
+             pcache.hits,
+             pcache.misses,
+             pcache.evictions,
+             (unsigned)pcache.entries,
+             (unsigned)pcache.bytes,
+             (unsigned)pcache.budget,
+             pcache.last_switch_us,
+             pcache.last_switch_cached ? "true" : "false",
+             pcache.hit_avg_us,
+             pcache.miss_avg_us,
              uid_json ? uid_json : "[]");
     esp_err_t res = web_ui_send_ok(req, "application/json", buf);
     heap_caps_free(buf);
@@ -762,24 +805,71 @@ static esp_err_t status_handler(httpd_req_t *req)
     return res;
 }
 
+typedef struct {
+    httpd_req_t *req;
+    size_t sent;
+    const char *type;       // NULL: JSON
+} web_chunk_sink_t;
+
+static esp_err_t chunk_sink(void *ctx, const char *data, size_t len)
+{
+    web_chunk_sink_t *out = (web_chunk_sink_t *)ctx;
+    if (!out->sent) {
+        httpd_resp_set_type(out->req, out->type ? out->type : "application/json");
+    }
+    esp_err_t err = httpd_resp_send_chunk(out->req, data, (ssize_t)len);
+    if (err == ESP_OK) {
+        out->sent += len;
+    }
+    return err;
+}
+
+// Written straight from the config generation into chunks; no JSON copy is held.
 static esp_err_t devices_config_handler(httpd_req_t *req)
 {
-    char *json = NULL;
-    size_t len = 0;
     char query[128];
     char profile[DEVICE_MANAGER_ID_MAX_LEN] = {0};
     if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
         httpd_query_key_value(query, "profile", profile, sizeof(profile));
     }
-    esp_err_t err = profile[0] ? device_manager_export_profile_json(profile, &json, &len)
-                               : device_manager_export_json(&json, &len);
-    if (err != ESP_OK || !json) {
-        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "device config unavailable");
+    web_chunk_sink_t out = {.req = req};
+    esp_err_t err = device_manager_export_profile_stream(profile[0] ? profile : NULL, chunk_sink, &out);
+    if (err != ESP_OK) {
+        if (!out.sent) {
+            return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "device config unavailable");
+        }
+        // Headers are gone already; dropping the connection tells the client it is cut short.
+        ESP_LOGW(TAG, "device config export aborted after %u bytes: %s", (unsigned)out.sent, esp_err_to_name(err));
+        return ESP_FAIL;
     }
-    httpd_resp_set_type(req, "application/json");
-    esp_err_t res = httpd_resp_send(req, json, len);
-    heap_caps_free(json);
-    return res;
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+// Request body handed to the config parser as it arrives.
+typedef struct {
+    httpd_req_t *req;
+    size_t remaining;
+    bool failed;
+} body_source_t;
+
+static esp_err_t body_source(void *ctx, char *buf, size_t cap, size_t *out_len)
+{
+    body_source_t *src = (body_source_t *)ctx;
+    *out_len = 0;
+    while (src->remaining > 0) {
+        int r = httpd_req_recv(src->req, buf, src->remaining < cap ? src->remaining : cap);
+        if (r == HTTPD_SOCK_ERR_TIMEOUT) {
+            continue;
+        }
+        if (r <= 0) {
+            src->failed = true;
+            return ESP_FAIL;
+        }
+        src->remaining -= (size_t)r;
+        *out_len = (size_t)r;
+        break;
+    }
+    return ESP_OK;
 }
 
 static esp_err_t devices_apply_handler(httpd_req_t *req)
@@ -788,35 +878,92 @@ static esp_err_t devices_apply_handler(httpd_req_t *req)
     if (len == 0 || len > 128 * 1024) {
         return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "invalid body");
     }
-    char *body = heap_caps_malloc(len + 1, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-    if (!body) {
-        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "no memory");
-    }
-    size_t received = 0;
-    while (received < len) {
-        int r = httpd_req_recv(req, body + received, len - received);
-        if (r <= 0) {
-            if (r == HTTPD_SOCK_ERR_TIMEOUT) {
-                continue;
-            }
-            heap_caps_free(body);
-            return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "recv failed");
-        }
-        received += (size_t)r;
-    }
-    body[len] = 0;
     char query[128];
     char profile[DEVICE_MANAGER_ID_MAX_LEN] = {0};
     if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
         httpd_query_key_value(query, "profile", profile, sizeof(profile));
     }
-    esp_err_t err = device_manager_apply_profile_json(profile[0] ? profile : NULL, body, len);
-    heap_caps_free(body);
+    // Parsed straight into the new config while it is received; no copy of the body is kept.
+    body_source_t src = {.req = req, .remaining = len};
+    esp_err_t err = device_manager_apply_profile_stream(profile[0] ? profile : NULL, body_source, &src);
+    if (src.failed) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "recv failed");
+    }
     if (err != ESP_OK) {
         return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, esp_err_to_name(err));
     }
-    device_manager_sync_file();
-    return web_ui_send_ok(req, "application/json", "{\"status\":\"ok\"}");
+    // The config is live now; the SD copy follows from the persistence task.
+    device_manager_persist_status_t persist;
+    device_manager_get_persist_status(&persist);
+    char resp[160];
+    int n = snprintf(resp, sizeof(resp), "{\"status\":\"ok\",\"generation\":%" PRIu32 ",\"persist_pending\":%s",
+                     persist.generation, persist.persist_pending ? "true" : "false");
+    // Counts for the live config only; /api/devices/validate has the details.
+    uint16_t errors = 0, warnings = 0;
+    if (!profile[0] && device_manager_validate(false, NULL, NULL, &errors, &warnings) == ESP_OK) {
+        n += snprintf(resp + n, sizeof(resp) - n, ",\"errors\":%u,\"warnings\":%u", errors, warnings);
+    }
+    snprintf(resp + n, sizeof(resp) - n, "}");
+    return web_ui_send_ok(req, "application/json", resp);
+}
+
+// Reference check of the live config; `?full=1` rebuilds the index and looks at the card again.
+static esp_err_t devices_validate_handler(httpd_req_t *req)
+{
+    char query[64];
+    char full[4] = {0};
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        httpd_query_key_value(query, "full", full, sizeof(full));
+    }
+    web_chunk_sink_t out = {.req = req};
+    esp_err_t err = device_manager_validate(full[0] == '1', chunk_sink, &out, NULL, NULL);
+    if (err != ESP_OK) {
+        if (!out.sent) {
+            return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, esp_err_to_name(err));
+        }
+        ESP_LOGW(TAG, "validation report aborted after %u bytes: %s", (unsigned)out.sent, esp_err_to_name(err));
+        return ESP_FAIL;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+// Whole-device backup: every profile in one checksummed CBOR stream (see dm_bulk.h).
+static esp_err_t devices_export_cbor_handler(httpd_req_t *req)
+{
+    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"devices.cbor\"");
+    web_chunk_sink_t out = {.req = req, .type = "application/cbor"};
+    esp_err_t err = device_manager_export_bulk_stream(chunk_sink, &out);
+    if (err != ESP_OK) {
+        if (!out.sent) {
+            return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "device backup unavailable");
+        }
+        ESP_LOGW(TAG, "device backup aborted after %u bytes: %s", (unsigned)out.sent, esp_err_to_name(err));
+        return ESP_FAIL;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+static esp_err_t devices_import_cbor_handler(httpd_req_t *req)
+{
+    size_t len = req->content_len;
+    if (len == 0 || len > WEB_BULK_IMPORT_MAX_BYTES) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "invalid body");
+    }
+    body_source_t src = {.req = req, .remaining = len};
+    uint8_t profiles = 0;
+    esp_err_t err = device_manager_import_bulk_stream(body_source, &src, &profiles);
+    if (src.failed) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "recv failed");
+    }
+    if (err != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, esp_err_to_name(err));
+    }
+    device_manager_persist_status_t persist;
+    device_manager_get_persist_status(&persist);
+    char resp[96];
+    snprintf(resp, sizeof(resp), "{\"status\":\"ok\",\"profiles\":%u,\"generation\":%" PRIu32 "}",
+             (unsigned)profiles, persist.generation);
+    return web_ui_send_ok(req, "application/json", resp);
 }
 
 static esp_err_t devices_run_handler(httpd_req_t *req)
@@ -909,7 +1056,13 @@ static esp_err_t devices_profile_activate_handler(httpd_req_t *req)
     if (err != ESP_OK) {
         return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, esp_err_to_name(err));
     }
-    return web_ui_send_ok(req, "application/json", "{\"status\":\"ok\"}");
+    device_manager_profile_cache_status_t pcache;
+    device_manager_get_profile_cache_status(&pcache);
+    char resp[160];
+    snprintf(resp, sizeof(resp),
+             "{\"status\":\"ok\",\"switch_us\":%" PRIu32 ",\"cached\":%s,\"hits\":%" PRIu32 ",\"misses\":%" PRIu32 "}",
+             pcache.last_switch_us, pcache.last_switch_cached ? "true" : "false", pcache.hits, pcache.misses);
+    return web_ui_send_ok(req, "application/json", resp);
 }
 
 static esp_err_t devices_profile_download_handler(httpd_req_t *req)
@@ -920,13 +1073,13 @@ static esp_err_t devices_profile_download_handler(httpd_req_t *req)
         httpd_query_key_value(query, "profile", id, sizeof(id));
     }
     if (!id[0]) {
-        const device_manager_config_t *cfg = device_manager_lock_config();
+        const device_manager_config_t *cfg = device_manager_acquire_config();
         if (cfg) {
             if (cfg->active_profile[0]) {
                 strncpy(id, cfg->active_profile, sizeof(id) - 1);
                 id[sizeof(id) - 1] = 0;
             }
-            device_manager_unlock_config();
+            device_manager_release_config(cfg);
         }
     }
     if (!id[0]) {
@@ -956,6 +1109,41 @@ static esp_err_t devices_variables_handler(httpd_req_t *req)
     return web_ui_send_ok(req, "application/json", "[]");
 }
 
+// POST /api/room/reset[?baseline=1]: resets runtimes, flags, variables and running scenarios.
+static esp_err_t room_reset_handler(httpd_req_t *req)
+{
+    char query[32];
+    char baseline[4] = {0};
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        httpd_query_key_value(query, "baseline", baseline, sizeof(baseline));
+    }
+    automation_room_reset_report_t report;
+    esp_err_t err = automation_engine_room_reset(baseline[0] == '1', &report);
+    if (err != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, esp_err_to_name(err));
+    }
+    char body[192];
+    snprintf(body, sizeof(body),
+             "{\"status\":\"ok\",\"duration_us\":%lld,\"runtimes\":%u,\"jobs_cancelled\":%u,"
+             "\"flags_cleared\":%u,\"variables_cleared\":%u,\"baseline_flags\":%u}",
+             (long long)report.duration_us,
+             (unsigned)report.runtimes,
+             (unsigned)report.jobs_cancelled,
+             (unsigned)report.flags_cleared,
+             (unsigned)report.variables_cleared,
+             (unsigned)report.baseline_flags);
+    return web_ui_send_ok(req, "application/json", body);
+}
+
+// POST /api/room/baseline: saves the current flags for later room resets.
+static esp_err_t room_baseline_handler(httpd_req_t *req)
+{
+    char body[48];
+    snprintf(body, sizeof(body), "{\"status\":\"ok\",\"flags\":%u}",
+             (unsigned)automation_engine_save_flag_baseline());
+    return web_ui_send_ok(req, "application/json", body);
+}
+
 static esp_err_t wifi_config_handler(httpd_req_t *req)
 {
     char q[160];
@@ -1361,7 +1549,7 @@ static esp_err_t start_httpd(void)
     }
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.server_port = 80;
-    config.max_uri_handlers = 40; // many handlers registered
+    config.max_uri_handlers = 48; // many handlers registered
     config.max_open_sockets = 20;  // target max clients (clamped by LWIP budget below)
     // Keep max_open_sockets within LWIP_MAX_SOCKETS budget (httpd uses ~3 internally).
 #ifdef CONFIG_LWIP_MAX_SOCKETS
@@ -1408,6 +1596,9 @@ static esp_err_t start_httpd(void)
     static web_route_t route_files = {.fn = files_handler, .redirect_on_fail = false};
     static web_route_t route_devices_cfg = {.fn = devices_config_handler, .redirect_on_fail = false};
     static web_route_t route_devices_apply = {.fn = devices_apply_handler, .redirect_on_fail = false};
+    static web_route_t route_devices_validate = {.fn = devices_validate_handler, .redirect_on_fail = false};
+    static web_route_t route_devices_export_cbor = {.fn = devices_export_cbor_handler, .redirect_on_fail = false};
+    static web_route_t route_devices_import_cbor = {.fn = devices_import_cbor_handler, .redirect_on_fail = false};
     static web_route_t route_devices_run = {.fn = devices_run_handler, .redirect_on_fail = false};
     static web_route_t route_profile_create = {.fn = devices_profile_create_handler, .redirect_on_fail = false};
     static web_route_t route_profile_delete = {.fn = devices_profile_delete_handler, .redirect_on_fail = false};
@@ -1416,6 +1607,10 @@ static esp_err_t start_httpd(void)
     static web_route_t route_profile_download = {.fn = devices_profile_download_handler, .redirect_on_fail = false};
     static web_route_t route_variables = {.fn = devices_variables_handler, .redirect_on_fail = false};
     static web_route_t route_templates = {.fn = devices_templates_handler, .redirect_on_fail = false};
+    static web_route_t route_scheduler = {.fn = automation_scheduler_handler, .redirect_on_fail = false};
+    static web_route_t route_automation_stats = {.fn = automation_stats_handler, .redirect_on_fail = false};
+    static web_route_t route_room_reset = {.fn = room_reset_handler, .redirect_on_fail = false};
+    static web_route_t route_room_baseline = {.fn = room_baseline_handler, .redirect_on_fail = false};
     static web_route_t route_auth_password = {.fn = auth_password_handler, .redirect_on_fail = false};
     static web_route_t route_logout = {.fn = auth_logout_handler, .redirect_on_fail = false};
 
@@ -1442,6 +1637,9 @@ static esp_err_t start_httpd(void)
     ESP_RETURN_ON_ERROR(register_guarded_route("/api/files", HTTP_GET, &route_files), TAG, "register files");
     ESP_RETURN_ON_ERROR(register_guarded_route("/api/devices/config", HTTP_GET, &route_devices_cfg), TAG, "register devices cfg");
     ESP_RETURN_ON_ERROR(register_guarded_route("/api/devices/apply", HTTP_POST, &route_devices_apply), TAG, "register devices apply");
+    ESP_RETURN_ON_ERROR(register_guarded_route("/api/devices/validate", HTTP_GET, &route_devices_validate), TAG, "register devices validate");
+    ESP_RETURN_ON_ERROR(register_guarded_route("/api/devices/export.cbor", HTTP_GET, &route_devices_export_cbor), TAG, "register devices export");
+    ESP_RETURN_ON_ERROR(register_guarded_route("/api/devices/import.cbor", HTTP_POST, &route_devices_import_cbor), TAG, "register devices import");
     ESP_RETURN_ON_ERROR(register_guarded_route("/api/devices/run", HTTP_GET, &route_devices_run), TAG, "register devices run");
     ESP_RETURN_ON_ERROR(register_guarded_route("/api/devices/profile/create", HTTP_POST, &route_profile_create), TAG, "register profile create");
     ESP_RETURN_ON_ERROR(register_guarded_route("/api/devices/profile/delete", HTTP_POST, &route_profile_delete), TAG, "register profile delete");
@@ -1450,6 +1648,10 @@ static esp_err_t start_httpd(void)
     ESP_RETURN_ON_ERROR(register_guarded_route("/api/devices/profile/download", HTTP_GET, &route_profile_download), TAG, "register profile download");
     ESP_RETURN_ON_ERROR(register_guarded_route("/api/devices/variables", HTTP_GET, &route_variables), TAG, "register variables");
     ESP_RETURN_ON_ERROR(register_guarded_route("/api/devices/templates", HTTP_GET, &route_templates), TAG, "register templates");
+    ESP_RETURN_ON_ERROR(register_guarded_route("/api/automation/scheduler", HTTP_GET, &route_scheduler), TAG, "register scheduler stats");
+    ESP_RETURN_ON_ERROR(register_guarded_route("/api/automation/stats", HTTP_GET, &route_automation_stats), TAG, "register automation stats");
+    ESP_RETURN_ON_ERROR(register_guarded_route("/api/room/reset", HTTP_POST, &route_room_reset), TAG, "register room reset");
+    ESP_RETURN_ON_ERROR(register_guarded_route("/api/room/baseline", HTTP_POST, &route_room_baseline), TAG, "register room baseline");
     return ESP_OK;
 }
 
@@ -1501,3 +1703,156 @@ static esp_err_t devices_templates_handler(httpd_req_t *req)
     free(json);
     return res;
 }
+
+// Shared bucket bounds of every histogram below; the open last bucket is reported as -1.
+static cJSON *add_bucket_bounds_json(cJSON *root)
+{
+    cJSON *bounds = cJSON_AddArrayToObject(root, "bucket_ms");
+    for (size_t i = 0; bounds && i < AUTOMATION_HISTOGRAM_BUCKETS; ++i) {
+        uint32_t le = automation_histogram_bucket_ms[i];
+        cJSON_AddItemToArray(bounds, cJSON_CreateNumber(le == UINT32_MAX ? -1 : (double)le));
+    }
+    return bounds;
+}
+
+static void add_histogram_json(cJSON *parent, const char *name, const automation_histogram_t *hist)
+{
+    cJSON *obj = cJSON_AddObjectToObject(parent, name);
+    if (!obj) {
+        return;
+    }
+    cJSON_AddNumberToObject(obj, "count", hist->count);
+    cJSON_AddNumberToObject(obj, "p50_ms", automation_histogram_percentile(hist, 50));
+    cJSON_AddNumberToObject(obj, "p95_ms", automation_histogram_percentile(hist, 95));
+    cJSON_AddNumberToObject(obj, "p99_ms", automation_histogram_percentile(hist, 99));
+    cJSON_AddNumberToObject(obj, "max_ms", hist->max_ms);
+    cJSON_AddNumberToObject(obj, "total_ms", (double)hist->total_ms);
+    cJSON *buckets = cJSON_AddArrayToObject(obj, "buckets");
+    for (size_t i = 0; buckets && i < AUTOMATION_HISTOGRAM_BUCKETS; ++i) {
+        cJSON_AddItemToArray(buckets, cJSON_CreateNumber(hist->buckets[i]));
+    }
+}
+
+static esp_err_t automation_scheduler_handler(httpd_req_t *req)
+{
+    automation_scheduler_stats_t stats;
+    automation_engine_get_scheduler_stats(&stats);
+    cJSON *root = cJSON_CreateObject();
+    cJSON *bounds = root ? add_bucket_bounds_json(root) : NULL;
+    cJSON *classes = root ? cJSON_AddArrayToObject(root, "classes") : NULL;
+    if (!bounds || !classes) {
+        cJSON_Delete(root);
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "no mem");
+    }
+    cJSON_AddNumberToObject(root, "running", stats.running);
+    cJSON_AddNumberToObject(root, "rate_passed", stats.rate_passed);
+    cJSON_AddNumberToObject(root, "rate_suppressed", stats.rate_suppressed);
+    for (int cls = AUTOMATION_PRIORITY_COUNT - 1; cls >= 0; --cls) {
+        const automation_priority_stats_t *c = &stats.classes[cls];
+        cJSON *obj = cJSON_CreateObject();
+        if (!obj) {
+            cJSON_Delete(root);
+            return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "no mem");
+        }
+        cJSON_AddStringToObject(obj, "priority", automation_priority_to_string((automation_priority_t)cls));
+        cJSON_AddNumberToObject(obj, "submitted", c->submitted);
+        cJSON_AddNumberToObject(obj, "started", c->started);
+        cJSON_AddNumberToObject(obj, "coalesced", c->coalesced);
+        cJSON_AddNumberToObject(obj, "dropped", c->dropped);
+        cJSON_AddNumberToObject(obj, "replaced", c->replaced);
+        cJSON_AddNumberToObject(obj, "rejected", c->rejected);
+        cJSON_AddNumberToObject(obj, "pending", c->pending);
+        add_histogram_json(obj, "wait", &c->wait);
+        cJSON_AddItemToArray(classes, obj);
+    }
+    char *json = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    if (!json) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "no mem");
+    }
+    httpd_resp_set_type(req, "application/json");
+    esp_err_t res = httpd_resp_send(req, json, HTTPD_RESP_USE_STRLEN);
+    free(json);
+    return res;
+}
+
+// GET /api/automation/stats[?reset=1]: per-scenario queue/run histograms, step timings, recent runs.
+static esp_err_t automation_stats_handler(httpd_req_t *req)
+{
+    char q[32];
+    char reset[4] = {0};
+    if (httpd_req_get_url_query_str(req, q, sizeof(q)) == ESP_OK) {
+        httpd_query_key_value(q, "reset", reset, sizeof(reset));
+    }
+    automation_trace_snapshot_t *snap = NULL;
+    if (automation_trace_snapshot(&snap) != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "no mem");
+    }
+    if (reset[0] == '1') {
+        automation_trace_reset();
+    }
+    cJSON *root = cJSON_CreateObject();
+    cJSON *bounds = root ? add_bucket_bounds_json(root) : NULL;
+    cJSON *scenarios = root ? cJSON_AddArrayToObject(root, "scenarios") : NULL;
+    cJSON *recent = root ? cJSON_AddArrayToObject(root, "recent") : NULL;
+    if (!bounds || !scenarios || !recent) {
+        cJSON_Delete(root);
+        automation_trace_snapshot_free(snap);
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "no mem");
+    }
+    for (size_t i = 0; i < snap->scenario_count; ++i) {
+        const automation_scenario_stats_t *sc = &snap->scenarios[i];
+        cJSON *obj = cJSON_CreateObject();
+        if (!obj) {
+            break;
+        }
+        cJSON_AddItemToArray(scenarios, obj);
+        cJSON_AddStringToObject(obj, "device", sc->device_id);
+        cJSON_AddStringToObject(obj, "scenario", sc->scenario_id);
+        cJSON_AddNumberToObject(obj, "runs", sc->runs);
+        cJSON_AddNumberToObject(obj, "cancelled", sc->cancelled);
+        cJSON_AddNumberToObject(obj, "failed", sc->failed);
+        add_histogram_json(obj, "queue", &sc->queue);
+        add_histogram_json(obj, "run", &sc->run);
+        cJSON *steps = cJSON_AddArrayToObject(obj, "steps");
+        for (uint8_t s = 0; steps && s < sc->step_count; ++s) {
+            const automation_step_stats_t *st = &sc->steps[s];
+            cJSON *step = cJSON_CreateObject();
+            if (!step) {
+                break;
+            }
+            cJSON_AddNumberToObject(step, "count", st->count);
+            cJSON_AddNumberToObject(step, "avg_us", st->count ? (double)(st->total_us / st->count) : 0);
+            cJSON_AddNumberToObject(step, "max_us", st->max_us);
+            cJSON_AddItemToArray(steps, step);
+        }
+    }
+    int64_t now_us = esp_timer_get_time();
+    for (size_t i = 0; i < snap->recent_count; ++i) {
+        const automation_trace_record_t *rec = &snap->recent[i];
+        const automation_scenario_stats_t *sc = automation_trace_snapshot_find(snap, rec->key);
+        cJSON *obj = cJSON_CreateObject();
+        if (!obj) {
+            break;
+        }
+        cJSON_AddItemToArray(recent, obj);
+        cJSON_AddStringToObject(obj, "device", sc ? sc->device_id : "");
+        cJSON_AddStringToObject(obj, "scenario", sc ? sc->scenario_id : "");
+        cJSON_AddNumberToObject(obj, "queue_ms", rec->queue_ms);
+        cJSON_AddNumberToObject(obj, "run_ms", rec->run_ms);
+        cJSON_AddStringToObject(obj, "result", rec->result == ESP_OK ? "ok"
+                                              : rec->result == ESP_ERR_INVALID_STATE ? "cancelled"
+                                                                                     : esp_err_to_name(rec->result));
+        cJSON_AddNumberToObject(obj, "age_ms", (double)((now_us - rec->finished_us) / 1000));
+    }
+    automation_trace_snapshot_free(snap);
+    char *json = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    if (!json) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "no mem");
+    }
+    httpd_resp_set_type(req, "application/json");
+    esp_err_t res = httpd_resp_send(req, json, HTTPD_RESP_USE_STRLEN);
+    free(json);
+    return res;
+}
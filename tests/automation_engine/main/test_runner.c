@@ -0,0 +1,16 @@
+#include "unity.h"
+
+extern void register_automation_bytecode_tests(void);
+extern void register_automation_scheduler_tests(void);
+extern void register_automation_trace_tests(void);
+extern void register_automation_checkpoint_tests(void);
+
+void app_main(void)
+{
+    UNITY_BEGIN();
+    register_automation_bytecode_tests();
+    register_automation_scheduler_tests();
+    register_automation_trace_tests();
+    register_automation_checkpoint_tests();
+    UNITY_END();
+}
@@ -1,10 +1,50 @@
 #include "unity.h"
+#include "dm_timer_wheel.h"
+#include "esp_timer.h"
 
+extern void register_cbor_tests(void);
+extern void register_config_arena_tests(void);
 extern void register_device_manager_parse_tests(void);
+extern void register_file_atomic_tests(void);
+extern void register_json_reader_tests(void);
+extern void register_json_writer_tests(void);
+extern void register_payload_match_tests(void);
+extern void register_profile_cache_tests(void);
+extern void register_profile_codec_tests(void);
+extern void register_rate_gate_tests(void);
+extern void register_schema_tests(void);
+extern void register_template_dispatch_tests(void);
+extern void register_timer_wheel_tests(void);
+extern void register_uid_set_tests(void);
+extern void register_xref_tests(void);
+
+void setUp(void)
+{
+}
+
+// Some tests run the timer wheel on their own clock; bring it back to real time.
+void tearDown(void)
+{
+    dm_timer_wheel_rebase(esp_timer_get_time());
+}
 
 void app_main(void)
 {
     UNITY_BEGIN();
+    register_cbor_tests();
+    register_config_arena_tests();
     register_device_manager_parse_tests();
+    register_file_atomic_tests();
+    register_json_reader_tests();
+    register_json_writer_tests();
+    register_payload_match_tests();
+    register_profile_cache_tests();
+    register_profile_codec_tests();
+    register_rate_gate_tests();
+    register_schema_tests();
+    register_template_dispatch_tests();
+    register_timer_wheel_tests();
+    register_uid_set_tests();
+    register_xref_tests();
     UNITY_END();
 }
@@ -0,0 +1,332 @@
+// Converts device config backups between the JSON of GET /api/devices/config and the CBOR
+// bundle of GET /api/devices/export.cbor (see dm_bulk.h), so a fleet backup can be read,
+// edited and restored from a workstation.
+//
+//   dm_cbor_tool encode IN.json OUT.cbor   IN is a bundle [header, config, ...] or one config
+//   dm_cbor_tool decode IN.cbor OUT.json   checks the checksum, writes the bundle as JSON
+//   dm_cbor_tool check IN.json [ROUNDS]    round trips, then JSON against CBOR import/export
+//
+// Conversion replays reader events into the other writer, so members the firmware does not
+// know survive it; only `check` goes through device configs.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dm_bulk.h"
+#include "dm_config.h"
+#include "dm_storage.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "sim.h"
+
+#define TOOL_RECV_CHUNK 1436    // what httpd_req_recv() tends to return
+
+typedef struct {
+    const char *data;
+    size_t len;
+    size_t pos;
+} mem_source_t;
+
+typedef struct {
+    dm_json_writer_t *w;
+    int depth;
+    bool unwrap;            // drop the array around a JSON bundle
+} bridge_t;
+
+static int64_t wall_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static esp_err_t mem_source(void *ctx, char *buf, size_t cap, size_t *out_len)
+{
+    mem_source_t *src = (mem_source_t *)ctx;
+    size_t n = src->len - src->pos;
+    if (n > cap) {
+        n = cap;
+    }
+    if (n > TOOL_RECV_CHUNK) {
+        n = TOOL_RECV_CHUNK;
+    }
+    memcpy(buf, src->data + src->pos, n);
+    src->pos += n;
+    *out_len = n;
+    return ESP_OK;
+}
+
+static esp_err_t count_sink(void *ctx, const char *data, size_t len)
+{
+    *(size_t *)ctx += len;
+    return ESP_OK;
+}
+
+static esp_err_t bridge_event(void *ctx, dm_json_event_t event, const dm_json_value_t *value)
+{
+    bridge_t *b = (bridge_t *)ctx;
+    if (b->unwrap && ((event == DM_JSON_EVENT_ARRAY_BEGIN && b->depth == 0) ||
+                      (event == DM_JSON_EVENT_ARRAY_END && b->depth == 1))) {
+        b->depth += event == DM_JSON_EVENT_ARRAY_BEGIN ? 1 : -1;
+        return ESP_OK;
+    }
+    switch (event) {
+    case DM_JSON_EVENT_OBJECT_BEGIN: b->depth++; dm_json_begin_object(b->w); break;
+    case DM_JSON_EVENT_OBJECT_END: b->depth--; dm_json_end_object(b->w); break;
+    case DM_JSON_EVENT_ARRAY_BEGIN: b->depth++; dm_json_begin_array(b->w); break;
+    case DM_JSON_EVENT_ARRAY_END: b->depth--; dm_json_end_array(b->w); break;
+    case DM_JSON_EVENT_KEY: dm_json_key(b->w, value->str); break;
+    case DM_JSON_EVENT_STRING: dm_json_string(b->w, value->str); break;
+    case DM_JSON_EVENT_NUMBER: dm_json_number(b->w, value->number); break;
+    case DM_JSON_EVENT_BOOL: dm_json_bool(b->w, value->boolean); break;
+    case DM_JSON_EVENT_NULL: dm_json_null(b->w); break;
+    }
+    return b->w->err;
+}
+
+static char *read_file(const char *path, size_t *out_len)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "%s: cannot open\n", path);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *data = size >= 0 ? malloc((size_t)size + 1) : NULL;
+    if (data && fread(data, 1, (size_t)size, f) != (size_t)size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    if (!data) {
+        fprintf(stderr, "%s: read failed\n", path);
+        return NULL;
+    }
+    data[size] = '\0';
+    *out_len = (size_t)size;
+    return data;
+}
+
+static int write_file(const char *path, const char *data, size_t len)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f || fwrite(data, 1, len, f) != len || fclose(f) != 0) {
+        fprintf(stderr, "%s: write failed\n", path);
+        return 1;
+    }
+    return 0;
+}
+
+// JSON bundle or single config -> CBOR bundle. A single config gets a header naming its
+// active profile.
+static esp_err_t encode(const char *json, size_t len, dm_json_buffer_t *out)
+{
+    static dm_bulk_writer_t b;
+    static dm_json_reader_t reader;
+    memset(out, 0, sizeof(*out));
+    dm_bulk_writer_init(&b, dm_json_buffer_sink, out);
+    size_t lead = strspn(json, " \t\r\n");
+    bridge_t bridge = {.w = &b.w, .unwrap = lead < len && json[lead] == '['};
+    if (!bridge.unwrap) {
+        device_manager_config_t *cfg = dm_config_create(0);
+        esp_err_t err = cfg ? dm_storage_parse_json(json, len, cfg) : ESP_ERR_NO_MEM;
+        if (err != ESP_OK) {
+            dm_config_destroy(cfg);
+            return err;
+        }
+        dm_bulk_write_header(&b, cfg->active_profile, 1);
+        dm_config_destroy(cfg);
+    }
+    dm_json_reader_init(&reader, bridge_event, &bridge);
+    esp_err_t err = dm_json_reader_feed(&reader, json, len);
+    if (err == ESP_OK) {
+        err = dm_json_reader_finish(&reader);
+    }
+    esp_err_t done = dm_bulk_writer_finish(&b);
+    return err != ESP_OK ? err : done;
+}
+
+// CBOR bundle -> JSON bundle, once the checksum matched.
+static esp_err_t decode(const char *cbor, size_t len, dm_json_buffer_t *out)
+{
+    static dm_json_writer_t w;
+    static dm_bulk_reader_t reader;
+    memset(out, 0, sizeof(*out));
+    dm_json_writer_init(&w, dm_json_buffer_sink, out);
+    dm_json_begin_array(&w);
+    bridge_t bridge = {.w = &w};
+    dm_bulk_reader_init(&reader, bridge_event, &bridge);
+    esp_err_t err = dm_bulk_reader_feed(&reader, (const uint8_t *)cbor, len);
+    if (err == ESP_OK) {
+        err = dm_bulk_reader_finish(&reader);
+    }
+    if (err != ESP_OK) {
+        fprintf(stderr, "rejected at byte %zu\n", reader.cbor.offset);
+    }
+    dm_json_end_array(&w);
+    esp_err_t done = dm_json_writer_finish(&w);
+    return err != ESP_OK ? err : done;
+}
+
+static esp_err_t bulk_import(const char *data, size_t len, dm_bulk_set_t *set)
+{
+    mem_source_t src = {.data = data, .len = len};
+    return dm_bulk_import(mem_source, &src, set);
+}
+
+static esp_err_t bulk_write(const dm_bulk_set_t *set, dm_json_sink_fn sink, void *ctx)
+{
+    static dm_bulk_writer_t b;
+    dm_bulk_writer_init(&b, sink, ctx);
+    dm_bulk_write_header(&b, set->active_profile, set->count);
+    for (uint8_t i = 0; i < set->count; ++i) {
+        dm_storage_write_config(&b.w, set->profiles[i]);
+    }
+    return dm_bulk_writer_finish(&b);
+}
+
+static int check(const char *json, size_t len, int rounds)
+{
+    dm_json_buffer_t first, text, second;
+    esp_err_t err = encode(json, len, &first);
+    if (err == ESP_OK) {
+        err = decode(first.data, first.len, &text);
+    }
+    if (err == ESP_OK) {
+        err = encode(text.data, text.len, &second);
+    }
+    if (err != ESP_OK) {
+        fprintf(stderr, "conversion failed: %s\n", esp_err_to_name(err));
+        return 1;
+    }
+    if (first.len != second.len || memcmp(first.data, second.data, first.len) != 0) {
+        fprintf(stderr, "CBOR -> JSON -> CBOR differs (%zu/%zu bytes)\n", first.len, second.len);
+        return 1;
+    }
+    heap_caps_free(text.data);
+    heap_caps_free(second.data);
+
+    // The reference: each profile as the config JSON export prints it.
+    dm_bulk_set_t set;
+    if (bulk_import(first.data, first.len, &set) != ESP_OK) {
+        fprintf(stderr, "bulk import failed\n");
+        return 1;
+    }
+    heap_caps_free(first.data);
+    char *ref[DEVICE_MANAGER_MAX_PROFILES];
+    size_t ref_len[DEVICE_MANAGER_MAX_PROFILES];
+    size_t json_total = 0;
+    uint8_t count = set.count;
+    for (uint8_t i = 0; i < count; ++i) {
+        if (dm_storage_export_json(set.profiles[i], &ref[i], &ref_len[i]) != ESP_OK) {
+            return 1;
+        }
+        json_total += ref_len[i];
+    }
+    dm_json_buffer_t bulk = {0};
+    if (bulk_write(&set, dm_json_buffer_sink, &bulk) != ESP_OK) {
+        return 1;
+    }
+
+    int64_t json_in = 0, cbor_in = 0, json_out = 0, cbor_out = 0;
+    for (int r = 0; r < rounds; ++r) {
+        int64_t start = wall_us();
+        for (uint8_t i = 0; i < count; ++i) {
+            mem_source_t src = {.data = ref[i], .len = ref_len[i]};
+            device_manager_config_t *cfg = dm_config_create(0);
+            if (!cfg || dm_storage_parse_stream(mem_source, &src, cfg) != ESP_OK) {
+                fprintf(stderr, "json import failed\n");
+                return 1;
+            }
+            dm_config_destroy(cfg);
+        }
+        json_in += wall_us() - start;
+
+        dm_bulk_set_free(&set);
+        start = wall_us();
+        if (bulk_import(bulk.data, bulk.len, &set) != ESP_OK || set.count != count) {
+            fprintf(stderr, "cbor import failed\n");
+            return 1;
+        }
+        cbor_in += wall_us() - start;
+
+        size_t json_bytes = 0, cbor_bytes = 0;
+        start = wall_us();
+        for (uint8_t i = 0; i < count; ++i) {
+            dm_storage_export_stream(set.profiles[i], count_sink, &json_bytes);
+        }
+        json_out += wall_us() - start;
+        start = wall_us();
+        bulk_write(&set, count_sink, &cbor_bytes);
+        cbor_out += wall_us() - start;
+        if (json_bytes != json_total || cbor_bytes != bulk.len) {
+            fprintf(stderr, "export sizes changed (%zu/%zu, %zu/%zu)\n",
+                    json_bytes, json_total, cbor_bytes, bulk.len);
+            return 1;
+        }
+    }
+    for (uint8_t i = 0; i < count; ++i) {
+        char *again = NULL;
+        size_t again_len = 0;
+        if (dm_storage_export_json(set.profiles[i], &again, &again_len) != ESP_OK ||
+            again_len != ref_len[i] || memcmp(again, ref[i], again_len) != 0) {
+            fprintf(stderr, "profile %u differs after CBOR import\n", (unsigned)i);
+            return 1;
+        }
+        heap_caps_free(again);
+        heap_caps_free(ref[i]);
+    }
+    dm_bulk_set_free(&set);
+
+    printf("bulk backup: %u profiles, %d rounds\n", (unsigned)count, rounds);
+    printf("  json: %7zu B, import %8.1f us, export %8.1f us\n",
+           json_total, (double)json_in / rounds, (double)json_out / rounds);
+    printf("  cbor: %7zu B, import %8.1f us, export %8.1f us\n",
+           bulk.len, (double)cbor_in / rounds, (double)cbor_out / rounds);
+    heap_caps_free(bulk.data);
+    return 0;
+}
+
+static int usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s encode IN.json OUT.cbor\n"
+                    "       %s decode IN.cbor OUT.json\n"
+                    "       %s check IN.json [ROUNDS]\n", argv0, argv0, argv0);
+    return 2;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3) {
+        return usage(argv[0]);
+    }
+    esp_log_level_set("*", ESP_LOG_WARN);
+    size_t len = 0;
+    char *in = read_file(argv[2], &len);
+    if (!in) {
+        return 1;
+    }
+    int rc;
+    if (strcmp(argv[1], "check") == 0) {
+        int rounds = argc > 3 ? atoi(argv[3]) : 200;
+        rc = rounds > 0 ? check(in, len, rounds) : usage(argv[0]);
+    } else if (argc == 4 && (strcmp(argv[1], "encode") == 0 || strcmp(argv[1], "decode") == 0)) {
+        dm_json_buffer_t out;
+        esp_err_t err = argv[1][0] == 'e' ? encode(in, len, &out) : decode(in, len, &out);
+        if (err != ESP_OK) {
+            fprintf(stderr, "%s: %s\n", argv[2], esp_err_to_name(err));
+            rc = 1;
+        } else {
+            rc = write_file(argv[3], out.data, out.len);
+        }
+        heap_caps_free(out.data);
+    } else {
+        rc = usage(argv[0]);
+    }
+    free(in);
+    return rc;
+}
@@ -0,0 +1,230 @@
+// Device config JSON export benchmark: the streaming writer against a cJSON tree printed
+// with cJSON_PrintUnformatted() and copied into a response buffer, which is what the
+// exporter did before. The tree is rebuilt by parsing the streamed document, so it holds
+// the same nodes the old builder created; its build time is parse time, not struct walking.
+//
+//   dm_json_export_bench [ROUNDS] [DEVICES]
+//
+// Peak heap counts everything taken through heap_caps_* (cJSON is hooked onto it) on top
+// of the config itself. Time to first byte is when the first chunk could go to the socket.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cJSON.h"
+#include "dm_config.h"
+#include "dm_storage.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "sim.h"
+
+#define BENCH_DEFAULT_DEVICES 48
+#define BENCH_BACKUP_PATH     "dm_export_bench.json"
+
+typedef struct {
+    int64_t start_us;
+    int64_t first_us;
+    size_t bytes;
+    size_t chunks;
+} bench_sink_t;
+
+static int64_t wall_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void *bench_cjson_malloc(size_t size)
+{
+    return heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+}
+
+// Stands in for httpd_resp_send_chunk(): counts what would go on the wire.
+static esp_err_t bench_sink(void *ctx, const char *data, size_t len)
+{
+    bench_sink_t *out = (bench_sink_t *)ctx;
+    if (!out->chunks) {
+        out->first_us = wall_us();
+    }
+    out->chunks++;
+    out->bytes += len;
+    (void)data;
+    return ESP_OK;
+}
+
+static int fill_room(device_manager_config_t *cfg, uint8_t count)
+{
+    if (dm_config_reset_devices(cfg, count) != ESP_OK) {
+        return -1;
+    }
+    cfg->device_count = count;
+    cfg->profile_count = 1;
+    strcpy(cfg->profiles[0].id, "default");
+    strcpy(cfg->profiles[0].name, "Default");
+    cfg->profiles[0].device_count = count;
+    strcpy(cfg->active_profile, "default");
+    for (uint8_t i = 0; i < count; ++i) {
+        device_descriptor_t *dev = &cfg->devices[i];
+        snprintf(dev->id, sizeof(dev->id), "prop_%u", i);
+        snprintf(dev->display_name, sizeof(dev->display_name), "Prop \"%u\"", i);
+        dev->topic_count = 3;
+        static const char *topic_names[] = {"state", "cmd", "sensor"};
+        for (uint8_t t = 0; t < dev->topic_count; ++t) {
+            strcpy(dev->topics[t].name, topic_names[t]);
+            snprintf(dev->topics[t].topic, sizeof(dev->topics[t].topic), "quest/room1/prop_%u/%s", i, topic_names[t]);
+        }
+        char topic[DEVICE_MANAGER_TOPIC_MAX_LEN];
+        char track[DEVICE_MANAGER_TRACK_NAME_MAX_LEN];
+        snprintf(topic, sizeof(topic), "quest/room1/prop_%u/cmd", i);
+        snprintf(track, sizeof(track), "/sdcard/audio/prop_%u.mp3", i);
+        dev->scenarios = dm_config_alloc_scenarios(cfg, 4);
+        if (!dev->scenarios) {
+            return -1;
+        }
+        dev->scenario_count = 4;
+        for (uint8_t s = 0; s < dev->scenario_count; ++s) {
+            device_scenario_t *sc = &dev->scenarios[s];
+            snprintf(sc->id, sizeof(sc->id), "scn_%u", s);
+            snprintf(sc->name, sizeof(sc->name), "Scenario %u", s);
+            strcpy(sc->button_label, "Run");
+            sc->steps = dm_config_alloc_steps(cfg, 5);
+            if (!sc->steps) {
+                return -1;
+            }
+            sc->step_count = 5;
+            sc->steps[0].type = DEVICE_ACTION_MQTT_PUBLISH;
+            sc->steps[0].data.mqtt.topic = topic;
+            sc->steps[0].data.mqtt.payload = "{\"relay\":1}";
+            sc->steps[1].type = DEVICE_ACTION_DELAY;
+            sc->steps[1].delay_ms = 1500;
+            sc->steps[2].type = DEVICE_ACTION_AUDIO_PLAY;
+            sc->steps[2].data.audio.track = track;
+            sc->steps[3].type = DEVICE_ACTION_SET_FLAG;
+            sc->steps[3].data.flag.flag = "door_open";
+            sc->steps[3].data.flag.value = true;
+            sc->steps[4].type = DEVICE_ACTION_EVENT_BUS;
+            sc->steps[4].data.event.event = "relay_cmd";
+            sc->steps[4].data.event.payload = "off";
+            for (uint8_t k = 0; k < sc->step_count; ++k) {
+                if (dm_config_intern_step(cfg, &sc->steps[k]) != ESP_OK) {
+                    return -1;
+                }
+            }
+        }
+        dev->template_assigned = true;
+        dev->template_config.type = DM_TEMPLATE_TYPE_MQTT_TRIGGER;
+        dm_mqtt_trigger_template_t *mqtt = &dev->template_config.data.mqtt;
+        mqtt->rule_count = 2;
+        for (uint8_t r = 0; r < mqtt->rule_count; ++r) {
+            snprintf(mqtt->rules[r].topic, sizeof(mqtt->rules[r].topic), "quest/room1/prop_%u/sensor", i);
+            snprintf(mqtt->rules[r].payload, sizeof(mqtt->rules[r].payload), "%s", r ? "off" : "on");
+            mqtt->rules[r].payload_required = true;
+            snprintf(mqtt->rules[r].scenario, sizeof(mqtt->rules[r].scenario), "scn_%u", r);
+        }
+    }
+    return 0;
+}
+
+// The previous exporter: whole tree, printed string, then a copy for the response.
+static esp_err_t export_tree(const char *doc, size_t *out_len, int64_t *ttfb_us)
+{
+    int64_t start = wall_us();
+    cJSON *root = cJSON_Parse(doc);
+    if (!root) {
+        return ESP_ERR_NO_MEM;
+    }
+    char *printed = cJSON_PrintUnformatted(root);
+    char *copy = NULL;
+    size_t len = printed ? strlen(printed) : 0;
+    if (printed) {
+        copy = heap_caps_malloc(len + 1, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (copy) {
+            memcpy(copy, printed, len + 1);
+        }
+    }
+    *ttfb_us = wall_us() - start;
+    cJSON_free(printed);
+    cJSON_Delete(root);
+    heap_caps_free(copy);
+    *out_len = len;
+    return copy ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+int main(int argc, char **argv)
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 200;
+    int devices = argc > 2 ? atoi(argv[2]) : BENCH_DEFAULT_DEVICES;
+    if (rounds <= 0 || devices <= 0 || devices > DEVICE_MANAGER_MAX_DEVICES) {
+        fprintf(stderr, "usage: %s [ROUNDS] [DEVICES<=%d]\n", argv[0], DEVICE_MANAGER_MAX_DEVICES);
+        return 2;
+    }
+    esp_log_level_set("*", ESP_LOG_WARN);
+    cJSON_Hooks hooks = {.malloc_fn = bench_cjson_malloc, .free_fn = heap_caps_free};
+    cJSON_InitHooks(&hooks);
+
+    device_manager_config_t *cfg = dm_config_create(0);
+    if (!cfg || fill_room(cfg, (uint8_t)devices) != 0) {
+        fprintf(stderr, "room does not fit the config arena budget\n");
+        return 1;
+    }
+    char *doc = NULL;
+    size_t doc_len = 0;
+    if (dm_storage_export_json(cfg, &doc, &doc_len) != ESP_OK) {
+        fprintf(stderr, "export failed\n");
+        return 1;
+    }
+
+    int64_t stream_ttfb = 0, stream_total = 0, tree_ttfb = 0;
+    size_t stream_peak = 0, tree_peak = 0, chunks = 0;
+    for (int r = 0; r < rounds; ++r) {
+        bench_sink_t sink = {.start_us = wall_us()};
+        size_t base = host_heap_in_use();
+        host_heap_reset_peak();
+        if (dm_storage_export_stream(cfg, bench_sink, &sink) != ESP_OK || sink.bytes != doc_len) {
+            fprintf(stderr, "streamed export differs (%zu/%zu bytes)\n", sink.bytes, doc_len);
+            return 1;
+        }
+        stream_total += wall_us() - sink.start_us;
+        stream_ttfb += sink.first_us - sink.start_us;
+        stream_peak = host_heap_peak() - base;
+        chunks = sink.chunks;
+
+        size_t tree_len = 0;
+        int64_t ttfb = 0;
+        base = host_heap_in_use();
+        host_heap_reset_peak();
+        if (export_tree(doc, &tree_len, &ttfb) != ESP_OK || tree_len != doc_len) {
+            fprintf(stderr, "tree export differs (%zu/%zu bytes)\n", tree_len, doc_len);
+            return 1;
+        }
+        tree_ttfb += ttfb;
+        tree_peak = host_heap_peak() - base;
+    }
+
+    // The SD backup takes the same path into the temp file.
+    size_t base = host_heap_in_use();
+    host_heap_reset_peak();
+    int64_t save_start = wall_us();
+    esp_err_t save_err = dm_storage_save(BENCH_BACKUP_PATH, cfg);
+    int64_t save_us = wall_us() - save_start;
+    size_t save_peak = host_heap_peak() - base;
+    remove(BENCH_BACKUP_PATH);
+    if (save_err != ESP_OK) {
+        fprintf(stderr, "backup save failed: %s\n", esp_err_to_name(save_err));
+        return 1;
+    }
+
+    printf("config json: %d devices, %zu bytes, %d rounds\n", devices, doc_len, rounds);
+    printf("  tree+print+copy: peak heap %7zu B, first byte after %7.1f us\n",
+           tree_peak, (double)tree_ttfb / rounds);
+    printf("  streaming:       peak heap %7zu B, first byte after %7.1f us, done after %7.1f us (%zu chunks)\n",
+           stream_peak, (double)stream_ttfb / rounds, (double)stream_total / rounds, chunks);
+    printf("  backup save:     peak heap %7zu B, %" PRId64 " us\n", save_peak, save_us);
+    heap_caps_free(doc);
+    dm_config_destroy(cfg);
+    return 0;
+}
@@ -0,0 +1,188 @@
+// Device config JSON import benchmark: the streaming importer fed in HTTP-sized chunks
+// against what POST /api/devices/apply held before, the whole body plus its cJSON tree while
+// the config was filled from it. The old builder is gone, so the tree side is measured as
+// body + cJSON_Parse() with the streaming import run while the tree is still alive; its time
+// is the tree parse alone and so is a lower bound.
+//
+//   dm_json_import_bench [ROUNDS] [DEVICES]
+//
+// Every round also checks that export -> import -> export gives the same bytes.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cJSON.h"
+#include "dm_config.h"
+#include "dm_storage.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "sim.h"
+
+#define BENCH_DEFAULT_DEVICES 48
+#define BENCH_RECV_CHUNK      1436      // one TCP segment, what httpd_req_recv() tends to return
+
+typedef struct {
+    const char *data;
+    size_t len;
+    size_t pos;
+} bench_source_t;
+
+static int64_t wall_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void *bench_cjson_malloc(size_t size)
+{
+    return heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+}
+
+// Stands in for httpd_req_recv(): hands out the body a segment at a time.
+static esp_err_t bench_source(void *ctx, char *buf, size_t cap, size_t *out_len)
+{
+    bench_source_t *src = (bench_source_t *)ctx;
+    size_t n = src->len - src->pos;
+    if (n > cap) {
+        n = cap;
+    }
+    if (n > BENCH_RECV_CHUNK) {
+        n = BENCH_RECV_CHUNK;
+    }
+    memcpy(buf, src->data + src->pos, n);
+    src->pos += n;
+    *out_len = n;
+    return ESP_OK;
+}
+
+// Room in the shape the web wizard produces: topics with limits, scenarios and a template.
+static int build_room(char *out, size_t cap, int devices)
+{
+    size_t len = 0;
+    len += snprintf(out + len, cap - len,
+                    "{\"schema\":1,\"generation\":7,\"active_profile\":\"default\","
+                    "\"profiles\":[{\"id\":\"default\",\"name\":\"Default\",\"device_count\":%d}],"
+                    "\"devices\":[", devices);
+    for (int i = 0; i < devices && len < cap; ++i) {
+        len += snprintf(out + len, cap - len,
+                        "%s{\"id\":\"prop_%d\",\"display_name\":\"Prop %d\",\"topics\":["
+                        "{\"name\":\"state\",\"topic\":\"quest/room1/prop_%d/state\"},"
+                        "{\"name\":\"cmd\",\"topic\":\"quest/room1/prop_%d/cmd\","
+                        "\"limit\":{\"mode\":\"throttle\",\"edges\":\"leading\",\"window_ms\":250}}],"
+                        "\"scenarios\":[",
+                        i ? "," : "", i, i, i, i);
+        for (int s = 0; s < 4 && len < cap; ++s) {
+            len += snprintf(out + len, cap - len,
+                            "%s{\"id\":\"scn_%d\",\"name\":\"Scenario %d\",\"button_enabled\":true,"
+                            "\"button_label\":\"Run\",\"steps\":["
+                            "{\"type\":\"mqtt_publish\",\"topic\":\"quest/room1/prop_%d/cmd\","
+                            "\"payload\":\"{\\\"relay\\\":1}\",\"qos\":1},"
+                            "{\"type\":\"delay\",\"delay_ms\":1500},"
+                            "{\"type\":\"audio_play\",\"track\":\"/sdcard/audio/prop_%d.mp3\"},"
+                            "{\"type\":\"set_flag\",\"flag\":\"door_open\",\"value\":true},"
+                            "{\"type\":\"event\",\"event\":\"relay_cmd\",\"payload\":\"off\"}]}",
+                            s ? "," : "", s, s, i, i);
+        }
+        len += snprintf(out + len, cap - len,
+                        "],\"template\":{\"type\":\"on_mqtt_event\",\"mqtt\":{\"rules\":["
+                        "{\"topic\":\"quest/room1/prop_%d/sensor\",\"payload\":\"on\",\"scenario\":\"scn_0\"},"
+                        "{\"topic\":\"quest/room1/prop_%d/sensor\",\"payload\":\"off\",\"scenario\":\"scn_1\"}]}}}",
+                        i, i);
+    }
+    len += snprintf(out + len, cap - len, "]}");
+    return len < cap ? (int)len : -1;
+}
+
+static esp_err_t import_stream(const char *doc, size_t len, device_manager_config_t *cfg)
+{
+    bench_source_t src = {.data = doc, .len = len};
+    return dm_storage_parse_stream(bench_source, &src, cfg);
+}
+
+int main(int argc, char **argv)
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 200;
+    int devices = argc > 2 ? atoi(argv[2]) : BENCH_DEFAULT_DEVICES;
+    if (rounds <= 0 || devices <= 0 || devices > DEVICE_MANAGER_MAX_DEVICES) {
+        fprintf(stderr, "usage: %s [ROUNDS] [DEVICES<=%d]\n", argv[0], DEVICE_MANAGER_MAX_DEVICES);
+        return 2;
+    }
+    esp_log_level_set("*", ESP_LOG_WARN);
+    cJSON_Hooks hooks = {.malloc_fn = bench_cjson_malloc, .free_fn = heap_caps_free};
+    cJSON_InitHooks(&hooks);
+
+    size_t cap = 4096 + (size_t)devices * 4096;
+    char *room = malloc(cap);
+    int room_len = room ? build_room(room, cap, devices) : -1;
+    if (room_len < 0) {
+        fprintf(stderr, "room text does not fit\n");
+        return 1;
+    }
+    // The exported form is the reference: that is what the UI posts back.
+    device_manager_config_t *cfg = dm_config_create(0);
+    char *doc = NULL;
+    size_t doc_len = 0;
+    if (!cfg || dm_storage_parse_json(room, (size_t)room_len, cfg) != ESP_OK ||
+        dm_storage_export_json(cfg, &doc, &doc_len) != ESP_OK) {
+        fprintf(stderr, "room does not fit the config arena budget\n");
+        return 1;
+    }
+    dm_config_destroy(cfg);
+    free(room);
+
+    int64_t stream_us = 0, tree_us = 0;
+    size_t stream_peak = 0, tree_peak = 0, config_bytes = 0;
+    for (int r = 0; r < rounds; ++r) {
+        size_t base = host_heap_in_use();
+        host_heap_reset_peak();
+        int64_t start = wall_us();
+        device_manager_config_t *next = dm_config_create(0);
+        if (!next || import_stream(doc, doc_len, next) != ESP_OK) {
+            fprintf(stderr, "streaming import failed\n");
+            return 1;
+        }
+        stream_us += wall_us() - start;
+        stream_peak = host_heap_peak() - base;
+        config_bytes = host_heap_in_use() - base;
+
+        char *again = NULL;
+        size_t again_len = 0;
+        if (dm_storage_export_json(next, &again, &again_len) != ESP_OK || again_len != doc_len ||
+            memcmp(again, doc, doc_len) != 0) {
+            fprintf(stderr, "round trip differs (%zu/%zu bytes)\n", again_len, doc_len);
+            return 1;
+        }
+        heap_caps_free(again);
+        dm_config_destroy(next);
+
+        base = host_heap_in_use();
+        host_heap_reset_peak();
+        start = wall_us();
+        char *body = heap_caps_malloc(doc_len + 1, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!body) {
+            return 1;
+        }
+        memcpy(body, doc, doc_len + 1);
+        cJSON *root = cJSON_ParseWithLength(body, doc_len);
+        tree_us += wall_us() - start;
+        next = dm_config_create(0);
+        if (!root || !next || import_stream(body, doc_len, next) != ESP_OK) {
+            fprintf(stderr, "tree import failed\n");
+            return 1;
+        }
+        tree_peak = host_heap_peak() - base;
+        cJSON_Delete(root);
+        heap_caps_free(body);
+        dm_config_destroy(next);
+    }
+
+    printf("config json import: %d devices, %zu bytes, %d rounds, config %zu B\n",
+           devices, doc_len, rounds, config_bytes);
+    printf("  body+tree:  peak heap %7zu B, tree parse alone %8.1f us\n", tree_peak, (double)tree_us / rounds);
+    printf("  streaming:  peak heap %7zu B, import done after %8.1f us\n", stream_peak, (double)stream_us / rounds);
+    heap_caps_free(doc);
+    return 0;
+}
@@ -0,0 +1,330 @@
+// Profile storage benchmark: saves and loads a generated room through dm_profiles.c with
+// the profile directory on the host file system, next to a raw v4 file of the same devices.
+//
+//   dm_profile_bench [ROUNDS]
+//
+// Reports file size and mean save/load time per format. Host files sit in the page cache,
+// so the times show encode/decode cost, not SD card latency; on the card the smaller file
+// is what pays off. A profile switch is timed both ways: as a miss (copy of the live
+// generation plus the profile file read into it) and as a hit of the profile cache.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "dm_config.h"
+#include "dm_profile_cache.h"
+#include "dm_profiles.h"
+#include "profiles/dm_profile_legacy.h"
+#include "esp_log.h"
+#include "sim.h"
+
+#define BENCH_PROFILE_ID "bench"
+#define BENCH_RAW_ID     "bench_v4"
+// The slot count of the fixed descriptor table, so results compare with older runs.
+#define BENCH_DEVICES    12
+
+// The benchmark has no simulated clock; logging only needs a timestamp.
+int64_t sim_clock_now_us(void)
+{
+    return 0;
+}
+
+static int64_t wall_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static long file_size(const char *id)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s.bin", DM_PROFILE_STORAGE_DIR, id);
+    struct stat st;
+    return stat(path, &st) == 0 ? (long)st.st_size : -1;
+}
+
+// A typical room: every device has a few topics and scenarios, half run a template.
+static int fill_room(device_manager_config_t *cfg, uint8_t count)
+{
+    if (dm_config_reset_devices(cfg, count) != ESP_OK) {
+        return -1;
+    }
+    cfg->device_count = count;
+    for (uint8_t i = 0; i < count; ++i) {
+        device_descriptor_t *dev = &cfg->devices[i];
+        snprintf(dev->id, sizeof(dev->id), "prop_%u", i);
+        snprintf(dev->display_name, sizeof(dev->display_name), "Prop %u", i);
+        dev->topic_count = 3;
+        static const char *topic_names[] = {"state", "cmd", "sensor"};
+        for (uint8_t t = 0; t < dev->topic_count; ++t) {
+            strcpy(dev->topics[t].name, topic_names[t]);
+            snprintf(dev->topics[t].topic, sizeof(dev->topics[t].topic), "quest/room1/prop_%u/%s", i, topic_names[t]);
+        }
+        char topic[DEVICE_MANAGER_TOPIC_MAX_LEN];
+        char track[DEVICE_MANAGER_TRACK_NAME_MAX_LEN];
+        char flag[DEVICE_MANAGER_FLAG_NAME_MAX_LEN];
+        snprintf(topic, sizeof(topic), "quest/room1/prop_%u/cmd", i);
+        snprintf(track, sizeof(track), "/sdcard/audio/prop_%u.mp3", i);
+        snprintf(flag, sizeof(flag), "prop_%u_done", i);
+        dev->scenarios = dm_config_alloc_scenarios(cfg, 3);
+        if (!dev->scenarios) {
+            return -1;
+        }
+        dev->scenario_count = 3;
+        for (uint8_t s = 0; s < dev->scenario_count; ++s) {
+            device_scenario_t *sc = &dev->scenarios[s];
+            snprintf(sc->id, sizeof(sc->id), "scn_%u", s);
+            snprintf(sc->name, sizeof(sc->name), "Scenario %u", s);
+            sc->button_enabled = s == 0;
+            strcpy(sc->button_label, "Run");
+            sc->steps = dm_config_alloc_steps(cfg, 4);
+            if (!sc->steps) {
+                return -1;
+            }
+            sc->step_count = 4;
+            sc->steps[0].type = DEVICE_ACTION_MQTT_PUBLISH;
+            sc->steps[0].data.mqtt.topic = topic;
+            sc->steps[0].data.mqtt.payload = "{\"relay\":1}";
+            sc->steps[1].type = DEVICE_ACTION_DELAY;
+            sc->steps[1].delay_ms = 2000;
+            sc->steps[2].type = DEVICE_ACTION_AUDIO_PLAY;
+            sc->steps[2].data.audio.track = track;
+            sc->steps[3].type = DEVICE_ACTION_SET_FLAG;
+            sc->steps[3].data.flag.flag = flag;
+            sc->steps[3].data.flag.value = true;
+            for (uint8_t k = 0; k < sc->step_count; ++k) {
+                if (dm_config_intern_step(cfg, &sc->steps[k]) != ESP_OK) {
+                    return -1;
+                }
+            }
+        }
+        if (i & 1) {
+            dev->template_assigned = true;
+            dev->template_config.type = DM_TEMPLATE_TYPE_MQTT_TRIGGER;
+            dm_mqtt_trigger_template_t *mqtt = &dev->template_config.data.mqtt;
+            mqtt->rule_count = 2;
+            for (uint8_t r = 0; r < mqtt->rule_count; ++r) {
+                snprintf(mqtt->rules[r].topic, sizeof(mqtt->rules[r].topic), "quest/room1/prop_%u/sensor", i);
+                snprintf(mqtt->rules[r].payload, sizeof(mqtt->rules[r].payload), "%s", r ? "off" : "on");
+                mqtt->rules[r].payload_required = true;
+                snprintf(mqtt->rules[r].scenario, sizeof(mqtt->rules[r].scenario), "scn_%u", r);
+            }
+        }
+    }
+    return 0;
+}
+
+static void legacy_from_device(const device_descriptor_t *src, dm_legacy_descriptor_t *dst)
+{
+    memset(dst, 0, sizeof(*dst));
+    memcpy(dst->id, src->id, sizeof(dst->id));
+    memcpy(dst->display_name, src->display_name, sizeof(dst->display_name));
+    dst->topic_count = src->topic_count;
+    memcpy(dst->topics, src->topics, sizeof(dst->topics));
+    dst->scenario_count = src->scenario_count;
+    for (uint8_t s = 0; s < src->scenario_count; ++s) {
+        const device_scenario_t *sc = &src->scenarios[s];
+        dm_legacy_scenario_t *out = &dst->scenarios[s];
+        memcpy(out->id, sc->id, sizeof(out->id));
+        memcpy(out->name, sc->name, sizeof(out->name));
+        out->button_enabled = sc->button_enabled;
+        memcpy(out->button_label, sc->button_label, sizeof(out->button_label));
+        out->priority = sc->priority;
+        out->concurrency = sc->concurrency;
+        out->step_count = sc->step_count;
+        for (uint8_t i = 0; i < sc->step_count; ++i) {
+            out->steps[i].type = sc->steps[i].type;
+            out->steps[i].delay_ms = sc->steps[i].delay_ms;
+            dm_legacy_step_data_from_config(&sc->steps[i], &out->steps[i].data);
+        }
+    }
+    dst->template_assigned = src->template_assigned;
+    dst->template_config = src->template_config;
+    memcpy(dst->topic_limits, src->topic_limits, sizeof(dst->topic_limits));
+}
+
+// Same layout the v4 writer produced: header followed by raw fixed-size descriptors.
+static int write_raw_v4(const device_descriptor_t *devices, uint8_t count)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s.bin", DM_PROFILE_STORAGE_DIR, BENCH_RAW_ID);
+    FILE *fp = fopen(path, "wb");
+    dm_legacy_descriptor_t *record = calloc(1, sizeof(*record));
+    if (!fp || !record) {
+        if (fp) {
+            fclose(fp);
+        }
+        free(record);
+        return -1;
+    }
+    uint32_t hdr[3] = {0x44504647u, 4u, count};
+    size_t ok = fwrite(hdr, sizeof(hdr), 1, fp);
+    for (uint8_t i = 0; i < count; ++i) {
+        legacy_from_device(&devices[i], record);
+        ok += fwrite(record, sizeof(*record), 1, fp);
+    }
+    fclose(fp);
+    free(record);
+    return ok == (size_t)count + 1 ? 0 : -1;
+}
+
+static void bench_release(const device_manager_config_t *cfg)
+{
+    device_manager_config_t *owned = (device_manager_config_t *)cfg;
+    if (--owned->refs == 0) {
+        dm_config_destroy(owned);
+    }
+}
+
+// What device_manager_profile_activate() does besides runtime registration, per source.
+static int bench_switch(const device_manager_config_t *live, int rounds, double *miss_us, double *hit_us)
+{
+    int64_t miss = 0;
+    int64_t hit = 0;
+    dm_profile_cache_init(DM_PROFILE_CACHE_BUDGET_BYTES, bench_release);
+    for (int i = 0; i < rounds; ++i) {
+        int64_t t0 = wall_us();
+        device_manager_config_t *draft = dm_config_create(0);
+        if (!draft || dm_config_copy(draft, live) != ESP_OK ||
+            dm_profiles_load_profile(BENCH_PROFILE_ID, draft) != ESP_OK) {
+            return -1;
+        }
+        strcpy(draft->active_profile, BENCH_PROFILE_ID);
+        int64_t t1 = wall_us();
+        draft->refs = 1;
+        dm_profile_cache_put(draft);
+        int64_t t2 = wall_us();
+        device_manager_config_t *cached = dm_profile_cache_take(BENCH_PROFILE_ID);
+        if (!cached) {
+            return -1;
+        }
+        cached->profile_count = live->profile_count;
+        memcpy(cached->profiles, live->profiles, sizeof(cached->profiles));
+        int64_t t3 = wall_us();
+        bench_release(cached);
+        miss += t1 - t0;
+        hit += t3 - t2;
+    }
+    *miss_us = (double)miss / rounds;
+    *hit_us = (double)hit / rounds;
+    return 0;
+}
+
+static bool same_devices(const device_manager_config_t *a, const device_manager_config_t *b)
+{
+    if (a->device_count != b->device_count) {
+        return false;
+    }
+    for (uint8_t i = 0; i < a->device_count; ++i) {
+        if (dm_config_device_digest(&a->devices[i], true) != dm_config_device_digest(&b->devices[i], true)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 200;
+    if (rounds <= 0) {
+        fprintf(stderr, "usage: %s [ROUNDS]\n", argv[0]);
+        return 2;
+    }
+    esp_log_level_set("*", ESP_LOG_WARN);
+    const uint8_t count = BENCH_DEVICES;
+    device_manager_config_t *cfg = dm_config_create(0);
+    device_manager_config_t *loaded = dm_config_create(0);
+    if (!cfg || !loaded || fill_room(cfg, count) != 0) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    strcpy(cfg->active_profile, BENCH_PROFILE_ID);
+
+    int64_t save_us = 0;
+    int64_t load_us = 0;
+    int64_t raw_save_us = 0;
+    int64_t raw_load_us = 0;
+    for (int i = 0; i < rounds; ++i) {
+        int64_t t0 = wall_us();
+        if (dm_profiles_store_active(cfg) != ESP_OK) {
+            fprintf(stderr, "save failed\n");
+            return 1;
+        }
+        int64_t t1 = wall_us();
+        if (dm_profiles_load_profile(BENCH_PROFILE_ID, loaded) != ESP_OK || !same_devices(cfg, loaded)) {
+            fprintf(stderr, "load mismatch\n");
+            return 1;
+        }
+        int64_t t2 = wall_us();
+        if (write_raw_v4(cfg->devices, count) != 0) {
+            fprintf(stderr, "raw save failed\n");
+            return 1;
+        }
+        int64_t t3 = wall_us();
+        // The v4 reader stays for migration, so the old format loads through the same call.
+        if (dm_profiles_load_profile(BENCH_RAW_ID, loaded) != ESP_OK || !same_devices(cfg, loaded)) {
+            fprintf(stderr, "v4 load mismatch\n");
+            return 1;
+        }
+        int64_t t4 = wall_us();
+        save_us += t1 - t0;
+        load_us += t2 - t1;
+        raw_save_us += t3 - t2;
+        raw_load_us += t4 - t3;
+    }
+
+#ifdef CONFIG_BROKER_PROFILE_COMPRESS
+    const char *variant = "v5+lz";
+#else
+    const char *variant = "v5";
+#endif
+    printf("%u devices, %d rounds\n", count, rounds);
+    printf("%-6s %8ld bytes  save %7.1f us  load %7.1f us\n",
+           variant,
+           file_size(BENCH_PROFILE_ID),
+           (double)save_us / rounds,
+           (double)load_us / rounds);
+    printf("%-6s %8ld bytes  save %7.1f us  load %7.1f us\n",
+           "v4",
+           file_size(BENCH_RAW_ID),
+           (double)raw_save_us / rounds,
+           (double)raw_load_us / rounds);
+
+    double miss_us = 0;
+    double hit_us = 0;
+    if (bench_switch(cfg, rounds, &miss_us, &hit_us) != 0) {
+        fprintf(stderr, "switch failed\n");
+        return 1;
+    }
+    printf("switch: from file %7.1f us, from cache %7.2f us\n", miss_us, hit_us);
+
+    // Config memory for the same room: fixed slots as before versus the arena.
+    dm_config_arena_stats_t stats;
+    dm_config_arena_get_stats(loaded->arena, &stats);
+    size_t arrays = 0;
+    for (uint8_t i = 0; i < count; ++i) {
+        arrays += dm_config_device_bytes(&loaded->devices[i]);
+    }
+    printf("config: fixed %zu bytes/device (%zu for %u slots), arena %zu bytes/device "
+           "(%zu used, %zu reserved, %" PRIu32 " strings in %zu bytes, %" PRIu32 " shared)\n",
+           sizeof(dm_legacy_descriptor_t),
+           sizeof(dm_legacy_descriptor_t) * count,
+           count,
+           stats.used / count,
+           stats.used,
+           stats.reserved,
+           stats.strings,
+           stats.string_bytes,
+           stats.string_hits);
+    printf("config: %zu bytes/device in slot and arrays, %zu of them the template union\n",
+           arrays / count,
+           sizeof(dm_template_config_t));
+    dm_config_destroy(cfg);
+    dm_config_destroy(loaded);
+    return 0;
+}
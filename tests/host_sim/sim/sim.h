@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// Host simulator for the template runtimes: a fake clock that drives the timer wheel and
+// a log of every action the runtimes emit through the stubbed broker services.
+
+typedef enum {
+    SIM_ACTION_PUBLISH = 0,
+    SIM_ACTION_AUDIO_PLAY,
+    SIM_ACTION_AUDIO_STOP,
+    SIM_ACTION_AUDIO_PAUSE,
+    SIM_ACTION_AUDIO_RESUME,
+    SIM_ACTION_TRIGGER,
+    SIM_ACTION_COUNT,
+} sim_action_type_t;
+
+#define SIM_ACTION_FIELD_MAX 128
+
+typedef struct {
+    sim_action_type_t type;
+    int64_t at_ms;
+    char target[SIM_ACTION_FIELD_MAX];      // topic, track or device id
+    char detail[SIM_ACTION_FIELD_MAX];      // payload or scenario id
+} sim_action_t;
+
+// Clock -----------------------------------------------------------------------
+int64_t sim_clock_now_us(void);
+// Moves the clock forward one wheel tick at a time so due timers fire in order.
+void sim_clock_advance_to(int64_t target_us);
+
+// Action log ------------------------------------------------------------------
+// With recording off actions are only counted (benchmark mode).
+void sim_actions_set_recording(bool on);
+void sim_actions_clear(void);
+void sim_actions_record(sim_action_type_t type, const char *target, const char *detail);
+size_t sim_actions_count(void);
+const sim_action_t *sim_actions_get(size_t index);
+uint64_t sim_actions_total(void);
+const char *sim_action_name(sim_action_type_t type);
+bool sim_action_from_name(const char *name, sim_action_type_t *out);
+
+// Rooms -----------------------------------------------------------------------
+// Registers `count` generated rooms; see sim_rooms.c for their topics.
+esp_err_t sim_rooms_register(int count);
+// Loads a device config as served by GET /api/devices/config and registers its
+// templates.
+esp_err_t sim_config_load(const char *path);
+
+// Host heap -------------------------------------------------------------------
+// Only memory taken through heap_caps_* is counted.
+size_t host_heap_in_use(void);
+size_t host_heap_peak(void);
+void host_heap_reset_peak(void);
@@ -0,0 +1,102 @@
+#include "sim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dm_timer_wheel.h"
+
+static int64_t s_now_us;
+static sim_action_t *s_actions;
+static size_t s_action_count;
+static size_t s_action_cap;
+static uint64_t s_action_total;
+static bool s_recording = true;
+
+static const char *const s_action_names[SIM_ACTION_COUNT] = {
+    [SIM_ACTION_PUBLISH] = "publish",
+    [SIM_ACTION_AUDIO_PLAY] = "audio",
+    [SIM_ACTION_AUDIO_STOP] = "audio_stop",
+    [SIM_ACTION_AUDIO_PAUSE] = "audio_pause",
+    [SIM_ACTION_AUDIO_RESUME] = "audio_resume",
+    [SIM_ACTION_TRIGGER] = "trigger",
+};
+
+int64_t sim_clock_now_us(void)
+{
+    return s_now_us;
+}
+
+void sim_clock_advance_to(int64_t target_us)
+{
+    const int64_t tick_us = DM_TIMER_WHEEL_TICK_MS * 1000LL;
+    while (s_now_us < target_us) {
+        int64_t next = (s_now_us / tick_us + 1) * tick_us;
+        s_now_us = next < target_us ? next : target_us;
+        dm_timer_wheel_advance(s_now_us);
+    }
+}
+
+void sim_actions_set_recording(bool on)
+{
+    s_recording = on;
+}
+
+void sim_actions_clear(void)
+{
+    s_action_count = 0;
+}
+
+void sim_actions_record(sim_action_type_t type, const char *target, const char *detail)
+{
+    s_action_total++;
+    if (!s_recording) {
+        return;
+    }
+    if (s_action_count == s_action_cap) {
+        size_t next_cap = s_action_cap ? s_action_cap * 2 : 64;
+        sim_action_t *next = realloc(s_actions, next_cap * sizeof(*next));
+        if (!next) {
+            fprintf(stderr, "host_sim: action log out of memory\n");
+            abort();
+        }
+        s_actions = next;
+        s_action_cap = next_cap;
+    }
+    sim_action_t *action = &s_actions[s_action_count++];
+    action->type = type;
+    action->at_ms = s_now_us / 1000;
+    snprintf(action->target, sizeof(action->target), "%s", target ? target : "");
+    snprintf(action->detail, sizeof(action->detail), "%s", detail ? detail : "");
+}
+
+size_t sim_actions_count(void)
+{
+    return s_action_count;
+}
+
+const sim_action_t *sim_actions_get(size_t index)
+{
+    return index < s_action_count ? &s_actions[index] : NULL;
+}
+
+uint64_t sim_actions_total(void)
+{
+    return s_action_total;
+}
+
+const char *sim_action_name(sim_action_type_t type)
+{
+    return type < SIM_ACTION_COUNT ? s_action_names[type] : "?";
+}
+
+bool sim_action_from_name(const char *name, sim_action_type_t *out)
+{
+    for (int i = 0; i < SIM_ACTION_COUNT; ++i) {
+        if (strcmp(s_action_names[i], name) == 0) {
+            *out = (sim_action_type_t)i;
+            return true;
+        }
+    }
+    return false;
+}
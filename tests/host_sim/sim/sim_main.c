@@ -0,0 +1,471 @@
+// Trace-driven runner for the template runtimes.
+//
+//   dm_host_sim [-v] [--bench ROUNDS] TRACE...
+//
+// A trace is a text file, one command per line, '#' starts a comment:
+//   rooms N                     register N generated rooms (sim_rooms.c)
+//   config FILE                 register the templates of a device config JSON
+//   T TOPIC [PAYLOAD]           MQTT message at T ms; T counts from the first message,
+//                               so recorded traces may carry wall-clock timestamps.
+//                               A message dated before the current time goes out now.
+//   flag NAME 0|1               flag change, delivered now
+//   wait MS                     advance the clock, firing due timers
+//   reset                       room reset of every runtime
+//   expect ACTION [ARGS]        the next matching action since the last expect must exist:
+//                               publish TOPIC [PAYLOAD] | audio TRACK | audio_stop |
+//                               audio_pause | audio_resume | trigger DEVICE SCENARIO
+//   expect none                 no actions since the last expect
+//
+// With --bench the trace is replayed ROUNDS more times without checks and the runner
+// reports messages per second and CPU time per message.
+
+#include <errno.h>
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dm_template_runtime.h"
+#include "esp_log.h"
+#include "sim.h"
+
+#define SIM_LINE_MAX 512
+
+typedef enum {
+    CMD_ROOMS,
+    CMD_CONFIG,
+    CMD_MQTT,
+    CMD_FLAG,
+    CMD_WAIT,
+    CMD_RESET,
+    CMD_EXPECT,
+    CMD_EXPECT_NONE,
+} sim_cmd_type_t;
+
+typedef struct {
+    sim_cmd_type_t type;
+    int line;
+    int64_t value;              // message time (ms), wait (ms), room count or flag state
+    sim_action_type_t action;
+    char *arg1;                 // topic, flag, path or expected target
+    char *arg2;                 // payload or expected detail; NULL matches anything
+} sim_cmd_t;
+
+typedef struct {
+    const char *path;
+    sim_cmd_t *cmds;
+    size_t count;
+    size_t messages;
+} sim_trace_t;
+
+static bool s_verbose;
+
+static char *dup_str(const char *s)
+{
+    size_t len = strlen(s) + 1;
+    char *out = malloc(len);
+    if (out) {
+        memcpy(out, s, len);
+    }
+    return out;
+}
+
+static char *next_token(char **cursor)
+{
+    char *s = *cursor;
+    while (*s == ' ' || *s == '\t') {
+        ++s;
+    }
+    if (!*s) {
+        *cursor = s;
+        return NULL;
+    }
+    char *start = s;
+    while (*s && *s != ' ' && *s != '\t') {
+        ++s;
+    }
+    if (*s) {
+        *s++ = '\0';
+    }
+    *cursor = s;
+    return start;
+}
+
+// The rest of the line, trimmed; payloads may contain spaces.
+static char *rest_of_line(char *cursor)
+{
+    while (*cursor == ' ' || *cursor == '\t') {
+        ++cursor;
+    }
+    size_t len = strlen(cursor);
+    while (len > 0 && (cursor[len - 1] == ' ' || cursor[len - 1] == '\t')) {
+        cursor[--len] = '\0';
+    }
+    return cursor;
+}
+
+static bool parse_int(const char *s, int64_t *out)
+{
+    if (!s) {
+        return false;
+    }
+    char *end = NULL;
+    errno = 0;
+    long long v = strtoll(s, &end, 10);
+    if (errno || end == s || *end) {
+        return false;
+    }
+    *out = v;
+    return true;
+}
+
+static bool parse_expect(sim_cmd_t *cmd, char *cursor)
+{
+    char *name = next_token(&cursor);
+    if (!name) {
+        return false;
+    }
+    if (strcmp(name, "none") == 0) {
+        cmd->type = CMD_EXPECT_NONE;
+        return true;
+    }
+    cmd->type = CMD_EXPECT;
+    if (!sim_action_from_name(name, &cmd->action)) {
+        return false;
+    }
+    switch (cmd->action) {
+    case SIM_ACTION_PUBLISH: {
+        char *topic = next_token(&cursor);
+        char *payload = rest_of_line(cursor);
+        cmd->arg1 = topic ? dup_str(topic) : NULL;
+        cmd->arg2 = payload[0] ? dup_str(payload) : NULL;
+        return cmd->arg1 != NULL;
+    }
+    case SIM_ACTION_AUDIO_PLAY: {
+        char *track = next_token(&cursor);
+        cmd->arg1 = track ? dup_str(track) : NULL;
+        return cmd->arg1 != NULL;
+    }
+    case SIM_ACTION_TRIGGER: {
+        char *device = next_token(&cursor);
+        char *scenario = next_token(&cursor);
+        cmd->arg1 = device ? dup_str(device) : NULL;
+        cmd->arg2 = scenario ? dup_str(scenario) : NULL;
+        return cmd->arg1 && cmd->arg2;
+    }
+    default:
+        return true;
+    }
+}
+
+static bool parse_line(sim_cmd_t *cmd, char *line, const char *dir, bool *first_message, int64_t *t0)
+{
+    char *cursor = line;
+    char *word = next_token(&cursor);
+    int64_t number = 0;
+    if (strcmp(word, "rooms") == 0) {
+        cmd->type = CMD_ROOMS;
+        return parse_int(next_token(&cursor), &cmd->value) && cmd->value > 0;
+    }
+    if (strcmp(word, "config") == 0) {
+        char *file = next_token(&cursor);
+        if (!file) {
+            return false;
+        }
+        char path[SIM_LINE_MAX * 2];
+        snprintf(path, sizeof(path), "%s%s%s", file[0] == '/' ? "" : dir, file[0] == '/' ? "" : "/", file);
+        cmd->type = CMD_CONFIG;
+        cmd->arg1 = dup_str(path);
+        return cmd->arg1 != NULL;
+    }
+    if (strcmp(word, "flag") == 0) {
+        char *name = next_token(&cursor);
+        cmd->type = CMD_FLAG;
+        cmd->arg1 = name ? dup_str(name) : NULL;
+        return cmd->arg1 && parse_int(next_token(&cursor), &cmd->value);
+    }
+    if (strcmp(word, "wait") == 0) {
+        cmd->type = CMD_WAIT;
+        return parse_int(next_token(&cursor), &cmd->value) && cmd->value >= 0;
+    }
+    if (strcmp(word, "reset") == 0) {
+        cmd->type = CMD_RESET;
+        return true;
+    }
+    if (strcmp(word, "expect") == 0) {
+        return parse_expect(cmd, cursor);
+    }
+    if (parse_int(word, &number)) {
+        char *topic = next_token(&cursor);
+        if (!topic) {
+            return false;
+        }
+        if (*first_message) {
+            *t0 = number;
+            *first_message = false;
+        }
+        cmd->type = CMD_MQTT;
+        cmd->value = number - *t0;
+        cmd->arg1 = dup_str(topic);
+        cmd->arg2 = dup_str(rest_of_line(cursor));
+        return cmd->arg1 && cmd->arg2;
+    }
+    return false;
+}
+
+static bool load_trace(sim_trace_t *trace, const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return false;
+    }
+    char *path_copy = dup_str(path);
+    const char *dir = dirname(path_copy);
+    size_t cap = 0;
+    char line[SIM_LINE_MAX];
+    int line_no = 0;
+    bool first_message = true;
+    int64_t t0 = 0;
+    bool ok = true;
+    memset(trace, 0, sizeof(*trace));
+    trace->path = path;
+    while (ok && fgets(line, sizeof(line), fp)) {
+        line_no++;
+        line[strcspn(line, "\r\n")] = '\0';
+        char *hash = strchr(line, '#');
+        if (hash && (hash == line || hash[-1] == ' ' || hash[-1] == '\t')) {
+            *hash = '\0';
+        }
+        if (!rest_of_line(line)[0]) {
+            continue;
+        }
+        if (trace->count == cap) {
+            cap = cap ? cap * 2 : 64;
+            sim_cmd_t *next = realloc(trace->cmds, cap * sizeof(*next));
+            if (!next) {
+                ok = false;
+                break;
+            }
+            trace->cmds = next;
+        }
+        sim_cmd_t *cmd = &trace->cmds[trace->count];
+        memset(cmd, 0, sizeof(*cmd));
+        cmd->line = line_no;
+        if (!parse_line(cmd, rest_of_line(line), dir, &first_message, &t0)) {
+            fprintf(stderr, "%s:%d: cannot parse line\n", path, line_no);
+            ok = false;
+            break;
+        }
+        trace->messages += cmd->type == CMD_MQTT || cmd->type == CMD_FLAG;
+        trace->count++;
+    }
+    free(path_copy);
+    fclose(fp);
+    return ok;
+}
+
+static void free_trace(sim_trace_t *trace)
+{
+    for (size_t i = 0; i < trace->count; ++i) {
+        free(trace->cmds[i].arg1);
+        free(trace->cmds[i].arg2);
+    }
+    free(trace->cmds);
+    memset(trace, 0, sizeof(*trace));
+}
+
+static void print_action(FILE *out, const sim_action_t *action)
+{
+    fprintf(out, "  %8lld ms  %-12s %s%s%s\n",
+            (long long)action->at_ms,
+            sim_action_name(action->type),
+            action->target,
+            action->detail[0] ? " " : "",
+            action->detail);
+}
+
+static bool action_matches(const sim_action_t *action, const sim_cmd_t *cmd)
+{
+    if (action->type != cmd->action) {
+        return false;
+    }
+    if (cmd->arg1 && strcmp(action->target, cmd->arg1) != 0) {
+        return false;
+    }
+    return !cmd->arg2 || strcmp(action->detail, cmd->arg2) == 0;
+}
+
+static bool check_expect(const sim_trace_t *trace, const sim_cmd_t *cmd, size_t *cursor)
+{
+    size_t count = sim_actions_count();
+    if (cmd->type == CMD_EXPECT_NONE) {
+        if (*cursor == count) {
+            return true;
+        }
+        fprintf(stderr, "%s:%d: expected no actions, got:\n", trace->path, cmd->line);
+    } else {
+        for (size_t i = *cursor; i < count; ++i) {
+            if (action_matches(sim_actions_get(i), cmd)) {
+                *cursor = i + 1;
+                return true;
+            }
+        }
+        fprintf(stderr, "%s:%d: expected %s %s%s%s, got:\n",
+                trace->path,
+                cmd->line,
+                sim_action_name(cmd->action),
+                cmd->arg1 ? cmd->arg1 : "",
+                cmd->arg2 ? " " : "",
+                cmd->arg2 ? cmd->arg2 : "");
+    }
+    for (size_t i = *cursor; i < count; ++i) {
+        print_action(stderr, sim_actions_get(i));
+    }
+    if (*cursor == count) {
+        fprintf(stderr, "  (nothing)\n");
+    }
+    return false;
+}
+
+// Runs the trace once. Setup commands only run when `setup` is set, expectations only
+// when `check` is set.
+static bool run_trace(const sim_trace_t *trace, bool setup, bool check)
+{
+    int64_t base_us = sim_clock_now_us();
+    size_t cursor = sim_actions_count();
+    for (size_t i = 0; i < trace->count; ++i) {
+        const sim_cmd_t *cmd = &trace->cmds[i];
+        esp_err_t err = ESP_OK;
+        switch (cmd->type) {
+        case CMD_ROOMS:
+            err = setup ? sim_rooms_register((int)cmd->value) : ESP_OK;
+            break;
+        case CMD_CONFIG:
+            err = setup ? sim_config_load(cmd->arg1) : ESP_OK;
+            break;
+        case CMD_MQTT:
+            sim_clock_advance_to(base_us + cmd->value * 1000);
+            dm_template_runtime_handle_mqtt(cmd->arg1, cmd->arg2);
+            break;
+        case CMD_FLAG:
+            dm_template_runtime_handle_flag(cmd->arg1, cmd->value != 0);
+            break;
+        case CMD_WAIT:
+            sim_clock_advance_to(sim_clock_now_us() + cmd->value * 1000);
+            break;
+        case CMD_RESET:
+            dm_template_runtime_reset_state();
+            break;
+        case CMD_EXPECT:
+        case CMD_EXPECT_NONE:
+            if (check && !check_expect(trace, cmd, &cursor)) {
+                return false;
+            }
+            break;
+        }
+        if (err != ESP_OK) {
+            fprintf(stderr, "%s:%d: setup failed: %s\n", trace->path, cmd->line, esp_err_to_name(err));
+            return false;
+        }
+    }
+    return true;
+}
+
+static double elapsed_s(const struct timespec *start, const struct timespec *end)
+{
+    return (double)(end->tv_sec - start->tv_sec) + (double)(end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void run_bench(const sim_trace_t *trace, int rounds)
+{
+    sim_actions_set_recording(false);
+    uint64_t actions_before = sim_actions_total();
+    struct timespec wall_start;
+    struct timespec wall_end;
+    struct timespec cpu_start;
+    struct timespec cpu_end;
+    clock_gettime(CLOCK_MONOTONIC, &wall_start);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_start);
+    for (int r = 0; r < rounds; ++r) {
+        dm_template_runtime_reset_state();
+        run_trace(trace, false, false);
+    }
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_end);
+    clock_gettime(CLOCK_MONOTONIC, &wall_end);
+    sim_actions_set_recording(true);
+
+    double messages = (double)trace->messages * rounds;
+    double wall = elapsed_s(&wall_start, &wall_end);
+    double cpu = elapsed_s(&cpu_start, &cpu_end);
+    if (messages <= 0 || wall <= 0) {
+        printf("%s: nothing to benchmark\n", trace->path);
+        return;
+    }
+    // Timer wheel ticks between messages are part of the measured work.
+    printf("%s: %.0f msgs in %.3f s, %.0f msgs/s, %.1f ns CPU/msg, %llu actions\n",
+           trace->path,
+           messages,
+           wall,
+           messages / wall,
+           cpu * 1e9 / messages,
+           (unsigned long long)(sim_actions_total() - actions_before));
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [-v] [--bench ROUNDS] TRACE...\n", argv0);
+}
+
+int main(int argc, char **argv)
+{
+    int rounds = 0;
+    int first_trace = argc;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-v") == 0) {
+            s_verbose = true;
+        } else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc) {
+            rounds = atoi(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 2;
+        } else {
+            first_trace = i;
+            break;
+        }
+    }
+    if (first_trace >= argc) {
+        usage(argv[0]);
+        return 2;
+    }
+    esp_log_level_set("*", s_verbose ? ESP_LOG_INFO : ESP_LOG_ERROR);
+
+    int failures = 0;
+    for (int i = first_trace; i < argc; ++i) {
+        sim_trace_t trace;
+        if (!load_trace(&trace, argv[i])) {
+            failures++;
+            continue;
+        }
+        dm_template_runtime_reset();
+        sim_actions_clear();
+        if (dm_template_runtime_init() != ESP_OK || !run_trace(&trace, true, true)) {
+            failures++;
+            free_trace(&trace);
+            continue;
+        }
+        if (s_verbose) {
+            for (size_t a = 0; a < sim_actions_count(); ++a) {
+                print_action(stdout, sim_actions_get(a));
+            }
+        }
+        printf("%s: ok, %zu messages, %zu actions\n", trace.path, trace.messages, sim_actions_count());
+        if (rounds > 0) {
+            run_bench(&trace, rounds);
+        }
+        free_trace(&trace);
+    }
+    dm_template_runtime_reset();
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,201 @@
+#include "sim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "device_manager.h"
+#include "dm_config.h"
+#include "dm_storage.h"
+#include "dm_template_runtime.h"
+#include "dm_templates.h"
+
+#define SIM_ROOM_UID_SLOTS 4
+#define SIM_ROOM_BUTTONS   4
+#define SIM_ROOM_STEPS     4
+
+// Runtimes read their template in place, so the generated ones live here for the run.
+static dm_template_config_t *s_room_templates;
+static int s_room_capacity;
+
+// Room NN, every template on its own device "rNN_<kind>":
+//   uid       readers rNN/reader0..3 expect CARD0..3, start rNN/uid/start,
+//             result on rNN/uid/result ("ok"/"fail"), /sdcard/ok.mp3 on success
+//   signal    heartbeat rNN/hb, 3 s hold, 1 s timeout, rNN/laser ON when done,
+//             /sdcard/hold.mp3 while held, /sdcard/done.mp3 on completion, reset rNN/hb/reset
+//   buttons   rNN/button0..3 "pressed" -> scenario on_button
+//   flag      flag rNN_done=1 -> scenario on_done
+//   cond      flag rNN_done -> cond_true / cond_false
+//   tick      scenario tick every 60 s
+//   seq       rNN/lever0..3 in order within 5 s, rNN/seq "open" / "fail", scenario seq_open
+static void room_device_id(char *out, size_t len, int room, const char *kind)
+{
+    snprintf(out, len, "r%02d_%s", room, kind);
+}
+
+static esp_err_t register_room_template(dm_template_config_t *store, const dm_template_config_t *tpl,
+                                        int room, const char *kind)
+{
+    char id[DEVICE_MANAGER_ID_MAX_LEN];
+    room_device_id(id, sizeof(id), room, kind);
+    dm_template_config_t *slot = &store[room * DM_TEMPLATE_TYPE_COUNT + tpl->type];
+    *slot = *tpl;
+    return dm_template_runtime_register(NULL, slot, id);
+}
+
+static esp_err_t register_room(dm_template_config_t *store, int room)
+{
+    static dm_template_config_t tpl;
+    char text[DEVICE_MANAGER_TOPIC_MAX_LEN];
+    esp_err_t err;
+
+    memset(&tpl, 0, sizeof(tpl));
+    tpl.type = DM_TEMPLATE_TYPE_UID;
+    dm_uid_template_t *uid = &tpl.data.uid;
+    for (int s = 0; s < SIM_ROOM_UID_SLOTS; ++s) {
+        char card[16];
+        snprintf(text, sizeof(text), "r%02d/reader%d", room, s);
+        snprintf(card, sizeof(card), "CARD%d", s);
+        dm_uid_template_set_slot(uid, (uint8_t)s, text, text);
+        dm_uid_template_add_value(uid, (uint8_t)s, card);
+    }
+    snprintf(uid->start_topic, sizeof(uid->start_topic), "r%02d/uid/start", room);
+    snprintf(uid->success_topic, sizeof(uid->success_topic), "r%02d/uid/result", room);
+    strcpy(uid->success_payload, "ok");
+    snprintf(uid->fail_topic, sizeof(uid->fail_topic), "r%02d/uid/result", room);
+    strcpy(uid->fail_payload, "fail");
+    strcpy(uid->success_audio_track, "/sdcard/ok.mp3");
+    if ((err = register_room_template(store, &tpl, room, "uid")) != ESP_OK) {
+        return err;
+    }
+
+    memset(&tpl, 0, sizeof(tpl));
+    tpl.type = DM_TEMPLATE_TYPE_SIGNAL_HOLD;
+    dm_signal_hold_template_t *sig = &tpl.data.signal;
+    snprintf(sig->heartbeat_topic, sizeof(sig->heartbeat_topic), "r%02d/hb", room);
+    snprintf(sig->reset_topic, sizeof(sig->reset_topic), "r%02d/hb/reset", room);
+    snprintf(sig->signal_topic, sizeof(sig->signal_topic), "r%02d/laser", room);
+    strcpy(sig->signal_payload_on, "ON");
+    sig->required_hold_ms = 3000;
+    sig->heartbeat_timeout_ms = 1000;
+    strcpy(sig->hold_track, "/sdcard/hold.mp3");
+    strcpy(sig->complete_track, "/sdcard/done.mp3");
+    if ((err = register_room_template(store, &tpl, room, "signal")) != ESP_OK) {
+        return err;
+    }
+
+    memset(&tpl, 0, sizeof(tpl));
+    tpl.type = DM_TEMPLATE_TYPE_MQTT_TRIGGER;
+    tpl.data.mqtt.rule_count = SIM_ROOM_BUTTONS;
+    for (int r = 0; r < SIM_ROOM_BUTTONS; ++r) {
+        dm_mqtt_trigger_rule_t *rule = &tpl.data.mqtt.rules[r];
+        snprintf(rule->topic, sizeof(rule->topic), "r%02d/button%d", room, r);
+        strcpy(rule->payload, "pressed");
+        rule->payload_required = true;
+        strcpy(rule->scenario, "on_button");
+    }
+    if ((err = register_room_template(store, &tpl, room, "buttons")) != ESP_OK) {
+        return err;
+    }
+
+    memset(&tpl, 0, sizeof(tpl));
+    tpl.type = DM_TEMPLATE_TYPE_FLAG_TRIGGER;
+    tpl.data.flag.rule_count = 1;
+    snprintf(tpl.data.flag.rules[0].flag, sizeof(tpl.data.flag.rules[0].flag), "r%02d_done", room);
+    tpl.data.flag.rules[0].required_state = true;
+    strcpy(tpl.data.flag.rules[0].scenario, "on_done");
+    if ((err = register_room_template(store, &tpl, room, "flag")) != ESP_OK) {
+        return err;
+    }
+
+    memset(&tpl, 0, sizeof(tpl));
+    tpl.type = DM_TEMPLATE_TYPE_IF_CONDITION;
+    tpl.data.condition.rule_count = 1;
+    snprintf(tpl.data.condition.rules[0].flag, sizeof(tpl.data.condition.rules[0].flag), "r%02d_done", room);
+    tpl.data.condition.rules[0].required_state = true;
+    strcpy(tpl.data.condition.true_scenario, "cond_true");
+    strcpy(tpl.data.condition.false_scenario, "cond_false");
+    if ((err = register_room_template(store, &tpl, room, "cond")) != ESP_OK) {
+        return err;
+    }
+
+    memset(&tpl, 0, sizeof(tpl));
+    tpl.type = DM_TEMPLATE_TYPE_INTERVAL_TASK;
+    tpl.data.interval.interval_ms = 60000;
+    strcpy(tpl.data.interval.scenario, "tick");
+    if ((err = register_room_template(store, &tpl, room, "tick")) != ESP_OK) {
+        return err;
+    }
+
+    memset(&tpl, 0, sizeof(tpl));
+    tpl.type = DM_TEMPLATE_TYPE_SEQUENCE_LOCK;
+    dm_sequence_template_t *seq = &tpl.data.sequence;
+    seq->step_count = SIM_ROOM_STEPS;
+    for (int s = 0; s < SIM_ROOM_STEPS; ++s) {
+        snprintf(seq->steps[s].topic, sizeof(seq->steps[s].topic), "r%02d/lever%d", room, s);
+    }
+    seq->timeout_ms = 5000;
+    seq->reset_on_error = true;
+    snprintf(seq->success_topic, sizeof(seq->success_topic), "r%02d/seq", room);
+    strcpy(seq->success_payload, "open");
+    strcpy(seq->success_scenario, "seq_open");
+    snprintf(seq->fail_topic, sizeof(seq->fail_topic), "r%02d/seq", room);
+    strcpy(seq->fail_payload, "fail");
+    return register_room_template(store, &tpl, room, "seq");
+}
+
+esp_err_t sim_rooms_register(int count)
+{
+    dm_template_config_t *store = s_room_templates;
+    if (count > s_room_capacity) {
+        store = calloc((size_t)count * DM_TEMPLATE_TYPE_COUNT, sizeof(*store));
+        if (!store) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    esp_err_t err = ESP_OK;
+    for (int room = 0; room < count && err == ESP_OK; ++room) {
+        err = register_room(store, room);
+    }
+    // Every room the old store held has been registered again from the new one.
+    if (store != s_room_templates && err == ESP_OK) {
+        free(s_room_templates);
+        s_room_templates = store;
+        s_room_capacity = count;
+    } else if (store != s_room_templates) {
+        dm_template_runtime_reset();
+        free(store);
+    }
+    return err;
+}
+
+static esp_err_t sim_file_source(void *ctx, char *buf, size_t cap, size_t *out_len)
+{
+    *out_len = fread(buf, 1, cap, (FILE *)ctx);
+    return ferror((FILE *)ctx) ? ESP_FAIL : ESP_OK;
+}
+
+esp_err_t sim_config_load(const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    device_manager_config_t *cfg = dm_config_create(0);
+    if (!cfg) {
+        fclose(fp);
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t err = dm_storage_internal_parse_stream(sim_file_source, fp, cfg);
+    fclose(fp);
+    cfg->refs = 1;      // the runtimes take their own references
+    // Same rule as device_manager: only devices with an assigned template get a runtime.
+    for (uint8_t i = 0; err == ESP_OK && i < cfg->device_count && i < cfg->device_capacity; ++i) {
+        const device_descriptor_t *dev = &cfg->devices[i];
+        if (dev->template_assigned && dev->id[0]) {
+            err = dm_template_runtime_register(cfg, &dev->template_config, dev->id);
+        }
+    }
+    device_manager_release_config(cfg);
+    return err;
+}
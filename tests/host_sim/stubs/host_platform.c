@@ -0,0 +1,276 @@
+// Minimal ESP-IDF and FreeRTOS surface for running device_manager code on Linux.
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <malloc.h>
+#include <stdlib.h>
+
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_task_wdt.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "sim.h"
+
+static esp_log_level_t s_log_level = ESP_LOG_WARN;
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code) {
+    case ESP_OK:
+        return "ESP_OK";
+    case ESP_FAIL:
+        return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:
+        return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:
+        return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:
+        return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:
+        return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:
+        return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED:
+        return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_INVALID_CRC:
+        return "ESP_ERR_INVALID_CRC";
+    default:
+        return "ESP_ERR_UNKNOWN";
+    }
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    (void)tag;
+    s_log_level = level;
+}
+
+void host_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    static const char letters[] = "NEWIDV";
+    if (level > s_log_level) {
+        return;
+    }
+    fprintf(stderr, "%c (%lld) %s: ", letters[level], (long long)(sim_clock_now_us() / 1000), tag);
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
+
+// Bytes held through heap_caps_* and their high-water mark, for the benchmarks.
+static size_t s_heap_in_use;
+static size_t s_heap_peak;
+
+static void *heap_account(void *ptr)
+{
+    if (ptr) {
+        s_heap_in_use += malloc_usable_size(ptr);
+        if (s_heap_in_use > s_heap_peak) {
+            s_heap_peak = s_heap_in_use;
+        }
+    }
+    return ptr;
+}
+
+void *heap_caps_malloc(size_t size, uint32_t caps)
+{
+    (void)caps;
+    return heap_account(malloc(size));
+}
+
+void *heap_caps_calloc(size_t n, size_t size, uint32_t caps)
+{
+    (void)caps;
+    return heap_account(calloc(n, size));
+}
+
+void *heap_caps_realloc(void *ptr, size_t size, uint32_t caps)
+{
+    (void)caps;
+    size_t old = ptr ? malloc_usable_size(ptr) : 0;
+    void *grown = realloc(ptr, size);
+    if (grown || size == 0) {
+        s_heap_in_use -= old;
+        return heap_account(grown);
+    }
+    return NULL;
+}
+
+void heap_caps_free(void *ptr)
+{
+    if (ptr) {
+        s_heap_in_use -= malloc_usable_size(ptr);
+    }
+    free(ptr);
+}
+
+size_t host_heap_in_use(void)
+{
+    return s_heap_in_use;
+}
+
+size_t host_heap_peak(void)
+{
+    return s_heap_peak;
+}
+
+void host_heap_reset_peak(void)
+{
+    s_heap_peak = s_heap_in_use;
+}
+
+size_t heap_caps_get_free_size(uint32_t caps)
+{
+    (void)caps;
+    return SIZE_MAX;
+}
+
+esp_err_t esp_task_wdt_reset(void)
+{
+    return ESP_OK;
+}
+
+// Byte-table CRC like the ROM one; the table is filled on first use.
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len)
+{
+    static uint32_t table[256];
+    if (!table[1]) {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+    }
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; ++i) {
+        crc = table[(crc ^ buf[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return sim_clock_now_us();
+}
+
+struct esp_timer {
+    esp_timer_create_args_t args;
+};
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *out)
+{
+    if (!args || !out) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *out = calloc(1, sizeof(**out));
+    if (!*out) {
+        return ESP_ERR_NO_MEM;
+    }
+    (*out)->args = *args;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    (void)timeout_us;
+    return timer ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us)
+{
+    (void)period_us;
+    return timer ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    return timer ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    free(timer);
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer)
+{
+    (void)timer;
+    return false;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(sim_clock_now_us() / 1000);
+}
+
+typedef struct {
+    int depth;
+    bool recursive;
+} host_lock_t;
+
+static SemaphoreHandle_t create_lock(bool recursive)
+{
+    host_lock_t *lock = calloc(1, sizeof(*lock));
+    if (lock) {
+        lock->recursive = recursive;
+    }
+    return lock;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return create_lock(false);
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void)
+{
+    return create_lock(true);
+}
+
+// A second take of a plain mutex would deadlock on target; fail loudly instead.
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait)
+{
+    (void)wait;
+    host_lock_t *lock = sem;
+    if (!lock || (!lock->recursive && lock->depth > 0)) {
+        fprintf(stderr, "host_sim: mutex %p taken twice\n", sem);
+        abort();
+    }
+    lock->depth++;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    host_lock_t *lock = sem;
+    if (!lock || lock->depth == 0) {
+        return pdFALSE;
+    }
+    lock->depth--;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t sem, TickType_t wait)
+{
+    return xSemaphoreTake(sem, wait);
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t sem)
+{
+    return xSemaphoreGive(sem);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    free(sem);
+}
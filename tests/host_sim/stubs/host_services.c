@@ -0,0 +1,119 @@
+// Broker services the template runtimes call into. Each call lands in the simulator's
+// action log instead of the network, the speaker or the automation engine.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "audio_player.h"
+#include "automation_engine.h"
+#include "config_store.h"
+#include "device_manager.h"
+#include "dm_config.h"
+#include "event_bus.h"
+#include "mqtt_core.h"
+#include "sim.h"
+
+#define HOST_SCENARIO_HANDLES 512
+
+typedef struct {
+    char device_id[SIM_ACTION_FIELD_MAX];
+    char scenario_id[SIM_ACTION_FIELD_MAX];
+} host_scenario_t;
+
+static host_scenario_t s_scenarios[HOST_SCENARIO_HANDLES];
+static size_t s_scenario_count;
+static app_config_t s_app_config;
+
+esp_err_t mqtt_core_publish(const char *topic, const char *payload)
+{
+    sim_actions_record(SIM_ACTION_PUBLISH, topic, payload);
+    return ESP_OK;
+}
+
+esp_err_t audio_player_play(const char *path)
+{
+    sim_actions_record(SIM_ACTION_AUDIO_PLAY, path, NULL);
+    return ESP_OK;
+}
+
+void audio_player_stop(void)
+{
+    sim_actions_record(SIM_ACTION_AUDIO_STOP, NULL, NULL);
+}
+
+void audio_player_pause(void)
+{
+    sim_actions_record(SIM_ACTION_AUDIO_PAUSE, NULL, NULL);
+}
+
+void audio_player_resume(void)
+{
+    sim_actions_record(SIM_ACTION_AUDIO_RESUME, NULL, NULL);
+}
+
+// Handles stay valid for the whole run, like the engine's handle table.
+automation_scenario_handle_t automation_engine_resolve(const char *device_id, const char *scenario_id)
+{
+    if (!device_id || !scenario_id || !scenario_id[0]) {
+        return AUTOMATION_SCENARIO_HANDLE_INVALID;
+    }
+    for (size_t i = 0; i < s_scenario_count; ++i) {
+        if (strcmp(s_scenarios[i].device_id, device_id) == 0 &&
+            strcmp(s_scenarios[i].scenario_id, scenario_id) == 0) {
+            return (automation_scenario_handle_t)i;
+        }
+    }
+    if (s_scenario_count >= HOST_SCENARIO_HANDLES) {
+        return AUTOMATION_SCENARIO_HANDLE_INVALID;
+    }
+    host_scenario_t *slot = &s_scenarios[s_scenario_count];
+    snprintf(slot->device_id, sizeof(slot->device_id), "%s", device_id);
+    snprintf(slot->scenario_id, sizeof(slot->scenario_id), "%s", scenario_id);
+    return (automation_scenario_handle_t)s_scenario_count++;
+}
+
+void automation_engine_release(automation_scenario_handle_t handle)
+{
+    (void)handle;
+}
+
+esp_err_t automation_engine_trigger_handle(automation_scenario_handle_t handle)
+{
+    if (handle >= s_scenario_count) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    sim_actions_record(SIM_ACTION_TRIGGER, s_scenarios[handle].device_id, s_scenarios[handle].scenario_id);
+    return ESP_OK;
+}
+
+esp_err_t automation_engine_trigger(const char *device_id, const char *scenario_id)
+{
+    sim_actions_record(SIM_ACTION_TRIGGER, device_id, scenario_id);
+    return ESP_OK;
+}
+
+// Flags reach the runtimes through dm_template_runtime_handle_flag() in the trace runner.
+esp_err_t event_bus_register_handler(event_bus_handler_t handler)
+{
+    (void)handler;
+    return ESP_OK;
+}
+
+const app_config_t *config_store_get(void)
+{
+    return &s_app_config;
+}
+
+// Runtimes keep the generation they read their template from; single-threaded here.
+void device_manager_retain_config(const device_manager_config_t *cfg)
+{
+    ((device_manager_config_t *)cfg)->refs++;
+}
+
+void device_manager_release_config(const device_manager_config_t *cfg)
+{
+    device_manager_config_t *owned = (device_manager_config_t *)cfg;
+    if (owned && --owned->refs == 0) {
+        dm_config_destroy(owned);
+    }
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <stdint.h>
+
+// Same convention as the ROM: chainable, start from 0.
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len);